@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/resource.h>
+#include "bench.h"
+#include "util.h"
+
+/* Initial size of an operation's samples array */
+#define BM_SAMPLE_ALLOC 64
+
+static BenchOperation *bm_get_operation(Bench *, const char *name);
+static void bm_free_operation(BenchOperation *);
+static int bm_sample_comparator(const void *, const void *);
+static uint64_t bm_percentile(const uint64_t *sorted_samples,
+                              size_t sample_num, size_t percentile);
+static long bm_peak_rss_kb(void);
+
+Bench *bm_new(void)
+{
+    Bench *bench = malloc(sizeof(Bench));
+    RETURN_IF_NULL(bench);
+    memset(bench, 0, sizeof(Bench));
+
+    if ((bench->operations = list_new()) == NULL) {
+        free(bench);
+        return NULL;
+    }
+
+    return bench;
+}
+
+void bm_free(Bench *bench)
+{
+    if (bench == NULL) {
+        return;
+    }
+
+    list_free_all_custom(bench->operations,
+                         (ListEntryFree)bm_free_operation);
+    free(bench);
+}
+
+static void bm_free_operation(BenchOperation *operation)
+{
+    if (operation == NULL) {
+        return;
+    }
+
+    free(operation->name);
+    free(operation->samples);
+    free(operation);
+}
+
+void bm_start(Bench *bench, const char *operation_name)
+{
+    assert(!is_null_or_empty(operation_name));
+
+    if (bench->depth++ > 0) {
+        return;
+    }
+
+    snprintf(bench->name, MAX_BENCH_OPERATION_NAME_SIZE, "%s",
+             operation_name);
+    get_monotonic_time(&bench->start);
+}
+
+Status bm_end(Bench *bench)
+{
+    assert(bench->depth > 0);
+
+    if (--bench->depth > 0) {
+        return STATUS_SUCCESS;
+    }
+
+    struct timespec now;
+    get_monotonic_time(&now);
+
+    uint64_t elapsed = (uint64_t)(now.tv_sec - bench->start.tv_sec) *
+                       1000000000 + now.tv_nsec - bench->start.tv_nsec;
+
+    BenchOperation *operation = bm_get_operation(bench, bench->name);
+
+    if (operation == NULL) {
+        return OUT_OF_MEMORY("Unable to record operation timing");
+    }
+
+    if (operation->sample_num == operation->sample_alloc) {
+        size_t sample_alloc = operation->sample_alloc * 2;
+        uint64_t *samples = realloc(operation->samples,
+                                    sample_alloc * sizeof(uint64_t));
+
+        if (samples == NULL) {
+            return OUT_OF_MEMORY("Unable to record operation timing");
+        }
+
+        operation->samples = samples;
+        operation->sample_alloc = sample_alloc;
+    }
+
+    operation->samples[operation->sample_num++] = elapsed;
+
+    return STATUS_SUCCESS;
+}
+
+static BenchOperation *bm_get_operation(Bench *bench, const char *name)
+{
+    /* Benchmarks only use a handful of distinct operations
+     * so a linear search is sufficient */
+    size_t operation_num = list_size(bench->operations);
+    BenchOperation *operation;
+
+    for (size_t k = 0; k < operation_num; k++) {
+        operation = list_get(bench->operations, k);
+
+        if (strcmp(operation->name, name) == 0) {
+            return operation;
+        }
+    }
+
+    operation = malloc(sizeof(BenchOperation));
+    RETURN_IF_NULL(operation);
+    memset(operation, 0, sizeof(BenchOperation));
+
+    operation->name = strdup(name);
+    operation->samples = malloc(BM_SAMPLE_ALLOC * sizeof(uint64_t));
+    operation->sample_alloc = BM_SAMPLE_ALLOC;
+
+    if (operation->name == NULL || operation->samples == NULL ||
+        !list_add(bench->operations, operation)) {
+        bm_free_operation(operation);
+        return NULL;
+    }
+
+    return operation;
+}
+
+static int bm_sample_comparator(const void *v1, const void *v2)
+{
+    uint64_t s1 = *(const uint64_t *)v1;
+    uint64_t s2 = *(const uint64_t *)v2;
+
+    return (s1 > s2) - (s1 < s2);
+}
+
+/* Nearest rank percentile */
+static uint64_t bm_percentile(const uint64_t *sorted_samples,
+                              size_t sample_num, size_t percentile)
+{
+    size_t rank = (percentile * sample_num + 99) / 100;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    return sorted_samples[rank - 1];
+}
+
+static long bm_peak_rss_kb(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == -1) {
+        return -1;
+    }
+
+#ifdef __MACH__
+    /* ru_maxrss is reported in bytes on OS X */
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/* Results are written as one JSON object per line so that they can be
+ * easily consumed by other tools. Latencies are in microseconds */
+void bm_write_results(const Bench *bench, FILE *output)
+{
+    size_t operation_num = list_size(bench->operations);
+    const BenchOperation *operation;
+
+    for (size_t k = 0; k < operation_num; k++) {
+        operation = list_get(bench->operations, k);
+        size_t sample_num = operation->sample_num;
+        uint64_t *samples = operation->samples;
+
+        qsort(samples, sample_num, sizeof(uint64_t), bm_sample_comparator);
+
+        fprintf(output, "{\"operation\":\"");
+
+        for (const char *c = operation->name; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', output);
+            } else if ((unsigned char)*c < 0x20) {
+                fprintf(output, "\\u%04x", *c);
+                continue;
+            }
+
+            fputc(*c, output);
+        }
+
+        fprintf(output, "\",\"samples\":%zu,\"p50_us\":%.1f,"
+                "\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+                sample_num,
+                bm_percentile(samples, sample_num, 50) / 1000.0,
+                bm_percentile(samples, sample_num, 90) / 1000.0,
+                bm_percentile(samples, sample_num, 99) / 1000.0,
+                samples[sample_num - 1] / 1000.0);
+    }
+
+    fprintf(output, "{\"peak_rss_kb\":%ld}\n", bm_peak_rss_kb());
+    fflush(output);
+}
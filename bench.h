@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_BENCH_H
+#define WED_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "list.h"
+#include "status.h"
+
+#define MAX_BENCH_OPERATION_NAME_SIZE 100
+
+/* In bench mode the time taken to process each top level key press is
+ * recorded against the name of the operation it invoked. Key presses
+ * processed by nested input loops (e.g. text entered into a prompt) are
+ * timed as part of the operation which opened the prompt */
+
+/* Timings for a single operation */
+typedef struct {
+    char *name; /* Operation name */
+    uint64_t *samples; /* Time taken by each invocation in nanoseconds */
+    size_t sample_num; /* Number of samples */
+    size_t sample_alloc; /* Size of samples array */
+} BenchOperation;
+
+typedef struct {
+    List *operations; /* List of BenchOperation's in order first run */
+    size_t depth; /* Nesting depth of operations currently running */
+    char name[MAX_BENCH_OPERATION_NAME_SIZE]; /* Operation being timed */
+    struct timespec start; /* Time outermost operation started */
+} Bench;
+
+Bench *bm_new(void);
+void bm_free(Bench *);
+void bm_start(Bench *, const char *operation_name);
+Status bm_end(Bench *);
+void bm_write_results(const Bench *, FILE *);
+
+#endif
@@ -31,6 +31,19 @@
 #include "file.h"
 #include "config.h"
 #include "encoding.h"
+#include "trace.h"
+
+/* The extent of an edit applied by bf_apply_batch before and after
+ * the whole batch has been applied */
+typedef struct {
+    size_t offset; /* Start of the edit before */
+    size_t delete_end; /* End of the deleted text before */
+    size_t delete_end_line; /* Line delete_end was on */
+    size_t new_offset; /* Start of the edit after */
+    size_t new_line_no; /* Line new_offset is on */
+    size_t insert_end; /* End of the inserted text after */
+    size_t insert_end_line; /* Line insert_end is on */
+} EditBounds;
 
 #define FILE_BUF_SIZE 1024
 #define DETECT_FF_LINE_NUM 5
@@ -42,6 +55,10 @@ static Status bf_input_stream_close(InputStream *);
 static Status bf_output_stream_write(OutputStream *, const char buf[],
                                      size_t buf_len, size_t *bytes_written);
 static Status bf_output_stream_close(OutputStream *);
+static Status bf_text_output_stream_write(OutputStream *, const char buf[],
+                                          size_t buf_len,
+                                          size_t *bytes_written);
+static Status bf_text_output_stream_close(OutputStream *);
 static int is_selection(Direction *);
 static void bf_default_movement_selection_handler(Buffer *, int is_select,
                                                   Direction *);
@@ -54,7 +71,6 @@ static Status bf_advance_bp_to_line_offset(Buffer *, BufferPos *,
 static void bf_update_line_col_offset(Buffer *, const BufferPos *);
 static Status bf_add_mark(Buffer *, Mark *);
 static Mark *bf_get_mark(const Buffer *, const BufferPos *);
-static int bf_remove_pos_mark(Buffer *, const BufferPos *, int free);
 static int bf_remove_mark(Buffer *, Mark *, int free);
 static Status bf_update_marks(Buffer *, const BufferPos *change_pos,
                               TextChangeType change_type, size_t change_length,
@@ -66,10 +82,60 @@ static Status bf_insert_expanded_tab(Buffer *, int advance_cursor);
 static Status bf_auto_indent(Buffer *, int advance_cursor);
 static Status bf_convert_fileformat(TextSelection *in_ts, TextSelection *out_ts, 
                                     int *conversion_perfomed);
+static size_t bf_count_lines(const char *str, size_t str_len);
+static Status bf_apply_batch(Buffer *, const TextEdit *, size_t edit_num,
+                             BatchChange **inverse_ptr);
+static Status bf_update_marks_after_edits(Buffer *, const EditBounds *,
+                                          size_t edit_num);
+static void bf_update_pos_after_edits(BufferPos *, MarkProperties,
+                                      const EditBounds *, size_t edit_num);
+static size_t bf_cursor_index(const Buffer *, size_t offset);
+static void bf_free_cursor(Buffer *, Cursor *);
+static int bf_cursor_comparator(const void *, const void *);
+static void bf_merge_cursors(Buffer *);
+static int bf_cursor_edit(const BufferPos *pos, const BufferPos *select_start,
+                          Direction, const char *str, size_t str_len,
+                          TextEdit *);
+static int bf_text_edit_comparator(const void *, const void *);
+static Status bf_cursors_edit(Buffer *, Direction, const char *str,
+                              size_t str_len);
 static Status bf_mask_allows_input(const Buffer *, const char *str,
                                    size_t str_len, int *input_allowed);
+static Status bf_insert_textselection_str(Buffer *, const TextSelection *,
+                                          int advance_cursor);
+static Status bf_copy_block(Buffer *, TextSelection *);
+static Status bf_edit_block(Buffer *, Direction, const char *str,
+                            size_t str_len);
+static Status bf_paste_block(Buffer *, const char *str, size_t str_len,
+                             int advance_cursor);
+static size_t bf_large_file_chunk(const Buffer *, size_t offset,
+                                  size_t *chunk_offset);
+static void bf_large_file_edited(Buffer *, size_t start, size_t end);
+static Status bf_store_large_file_window(Buffer *);
+static int bf_is_buffer_file(const Buffer *, const char *file_path);
+static Status bf_load_large_file_window(Buffer *, size_t chunk_index,
+                                        size_t chunk_offset);
+
+Buffer *bf_new(const FileInfo *file_info, const Config *config)
+{
+    Buffer *buffer = bf_new_unloaded(file_info, config);
+    RETURN_IF_NULL(buffer);
+
+    Status status = bf_init_view(buffer);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        bf_free(buffer);
+        return NULL;
+    }
 
-Buffer *bf_new(const FileInfo *file_info, const HashMap *config)
+    return buffer;
+}
+
+/* Create a buffer without a view. Until bf_init_view is called the buffer
+ * can't be displayed, but it uses little memory, so this is used for
+ * buffers whose file isn't loaded yet */
+Buffer *bf_new_unloaded(const FileInfo *file_info, const Config *config)
 {
     assert(file_info != NULL);
 
@@ -78,7 +144,7 @@ Buffer *bf_new(const FileInfo *file_info, const HashMap *config)
 
     memset(buffer, 0, sizeof(Buffer));
 
-    if ((buffer->config = new_hashmap()) == NULL) {
+    if ((buffer->config = cf_new_config(config, CL_BUFFER)) == NULL) {
         bf_free(buffer);
         return NULL;
     }
@@ -88,12 +154,12 @@ Buffer *bf_new(const FileInfo *file_info, const HashMap *config)
         return NULL;
     }
 
-    if ((buffer->data = gb_new(GAP_INCREMENT)) == NULL) {
+    if ((buffer->cursors = list_new()) == NULL) {
         bf_free(buffer);
         return NULL;
     }
 
-    if (!cf_populate_config(config, buffer->config, CL_BUFFER)) {
+    if ((buffer->data = gb_new(GAP_INCREMENT)) == NULL) {
         bf_free(buffer);
         return NULL;
     }
@@ -108,21 +174,57 @@ Buffer *bf_new(const FileInfo *file_info, const HashMap *config)
     bc_init(&buffer->changes);
     buffer->change_state = bc_get_current_state(&buffer->changes);
 
+    return buffer;
+}
+
+Status bf_init_view(Buffer *buffer)
+{
+    if (buffer->bv != NULL) {
+        return STATUS_SUCCESS;
+    }
+
     if ((buffer->bv = bv_new(24, 80, &buffer->pos)) == NULL) {
-        bf_free(buffer);
-        return NULL;
+        return OUT_OF_MEMORY("Unable to create buffer view");
     }
 
-    if (!STATUS_IS_SUCCESS(bf_add_new_mark(buffer, &buffer->bv->screen_start,
-                                           MP_NO_ADJUST_ON_BUFFER_POS))) {
-        bf_free(buffer);
-        return 0;
+    Status status = bf_add_new_mark(buffer, &buffer->bv->screen_start,
+                                    MP_NO_ADJUST_ON_BUFFER_POS);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        bv_free(buffer->bv);
+        buffer->bv = NULL;
     }
 
-    return buffer;
+    return status;
+}
+
+/* Free the content, undo history and view of an unmodified buffer so that
+ * only its file info and config remain. The buffer can be loaded again
+ * using bf_init_view and bf_load_file */
+Status bf_unload(Buffer *buffer)
+{
+    if (bf_is_dirty(buffer) || buffer->large_file != NULL) {
+        return st_get_error(ERR_BUFFER_MODIFIED,
+                            "Unable to unload modified buffer %s",
+                            buffer->file_info.file_name);
+    }
+
+    RETURN_IF_FAIL(bf_reset(buffer));
+
+    buffer->change_state = bc_get_current_state(&buffer->changes);
+    gb_compact(buffer->data);
+    bs_reset(&buffer->search, NULL);
+
+    if (buffer->bv != NULL) {
+        bf_remove_pos_mark(buffer, &buffer->bv->screen_start, 1);
+        bv_free(buffer->bv);
+        buffer->bv = NULL;
+    }
+
+    return STATUS_SUCCESS;
 }
 
-Buffer *bf_new_empty(const char *file_name, const HashMap *config)
+Buffer *bf_new_empty(const char *file_name, const Config *config)
 {
     FileInfo file_info;
 
@@ -149,19 +251,29 @@ void bf_free(Buffer *buffer)
     bc_free(&buffer->changes);
     free_hashmap_values(buffer->marks, (void (*)(void *))bp_free_mark);
     free_hashmap(buffer->marks);
+    list_free_all(buffer->cursors);
     bv_free(buffer->bv);
 
+    if (buffer->large_file != NULL) {
+        lf_free(buffer->large_file);
+        free(buffer->large_file);
+    }
+
+    jn_free(buffer->journal);
     free(buffer);
 }
 
 void bf_free_syntax_match_cache(Buffer *buffer)
 {
-    bv_free_syntax_match_cache(buffer->bv);
+    if (buffer->bv != NULL) {
+        bv_free_syntax_match_cache(buffer->bv);
+    }
 }
 
 Status bf_clear(Buffer *buffer)
 {
     BufferPos *pos = &buffer->pos;
+    bf_clear_cursors(buffer);
     bf_select_reset(buffer);
     bp_to_buffer_start(pos);
     return bf_delete(buffer, bf_length(buffer));
@@ -169,13 +281,21 @@ Status bf_clear(Buffer *buffer)
 
 Status bf_reset(Buffer *buffer)
 {
+    /* The journalled changes no longer apply so are discarded */
+    Journal *journal = buffer->journal;
+    buffer->journal = NULL;
+
     bc_disable(&buffer->changes); 
     Status status = bf_clear(buffer);
     bc_enable(&buffer->changes);
+
+    buffer->journal = journal;
     RETURN_IF_FAIL(status);
 
+    jn_reset(journal, &buffer->file_info.file_stat);
     bc_free(&buffer->changes);
     bc_init(&buffer->changes);
+    buffer->is_partial = 0;
 
     return status;
 }
@@ -225,12 +345,16 @@ Status bf_load_file(Buffer *buffer)
         return STATUS_SUCCESS;
     }
 
-    /* We don't want the inital load into the buffer to be undoable */
+    /* We don't want the inital load into the buffer to be undoable
+     * or journalled */
+    Journal *journal = buffer->journal;
+    buffer->journal = NULL;
     bc_disable(&buffer->changes);
 
     Status status = bf_read_file(buffer, &buffer->file_info);
 
     bc_enable(&buffer->changes);
+    buffer->journal = journal;
 
     return status;
 }
@@ -238,6 +362,8 @@ Status bf_load_file(Buffer *buffer)
 /* Read file content info buffer at current position */
 Status bf_read_file(Buffer *buffer, const FileInfo *file_info)
 {
+    TR_SPAN("bf_read_file");
+
     if (!fi_file_exists(file_info)) {
         return st_get_error(ERR_FILE_DOESNT_EXIST, "File doesn't exist: %s",
                             file_info->rel_path);
@@ -262,8 +388,9 @@ Status bf_read_file(Buffer *buffer, const FileInfo *file_info)
     Status status = STATUS_SUCCESS;
     char buf[FILE_BUF_SIZE];
     size_t read;
+    size_t offset = buffer->pos.offset;
 
-    gb_set_point(buffer->data, buffer->pos.offset);
+    gb_set_point(buffer->data, offset);
 
     do {
         read = fread(buf, sizeof(char), FILE_BUF_SIZE, input_file);
@@ -280,6 +407,9 @@ Status bf_read_file(Buffer *buffer, const FileInfo *file_info)
             status = OUT_OF_MEMORY("Unable to populate buffer");
             break;
         }
+
+        jn_add_insert(buffer->journal, offset, buf, read);
+        offset += read;
     } while (read == FILE_BUF_SIZE);
 
     fclose(input_file);
@@ -298,6 +428,407 @@ Status bf_read_file(Buffer *buffer, const FileInfo *file_info)
     return status;
 }
 
+/* Open a file which is too large to load into memory. Only a window of
+ * consecutive chunks around the cursor is loaded into the buffer */
+Status bf_load_large_file(Buffer *buffer, size_t chunk_size)
+{
+    RETURN_IF_FAIL(bf_reset(buffer));
+
+    LargeFile *lf = malloc(sizeof(LargeFile));
+
+    if (lf == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate large file");
+    }
+
+    Status status = lf_init(lf, buffer->file_info.abs_path, chunk_size);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        lf_free(lf);
+        free(lf);
+        return status;
+    }
+
+    buffer->large_file = lf;
+    status = bf_load_large_file_window(buffer, 0, 0);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        /* Nothing has been edited, so the buffer can be reset or
+         * unloaded as though the file was never opened */
+        buffer->large_file = NULL;
+        lf_free(lf);
+        free(lf);
+    }
+
+    return status;
+}
+
+int bf_is_large_file(const Buffer *buffer)
+{
+    return buffer->large_file != NULL;
+}
+
+/* The number of lines in the file which precede the loaded window */
+size_t bf_line_no_offset(const Buffer *buffer)
+{
+    const LargeFile *lf = buffer->large_file;
+
+    if (lf == NULL || lf->window_chunks == 0) {
+        return 0;
+    }
+
+    return lf->chunks[lf->window_start].start_line;
+}
+
+/* The number of lines in the file as far as it has been indexed */
+size_t bf_display_lines(const Buffer *buffer)
+{
+    const LargeFile *lf = buffer->large_file;
+    size_t lines = bf_lines(buffer);
+
+    if (lf == NULL || lf->window_chunks == 0) {
+        return lines;
+    }
+
+    size_t window_end = lf->window_start + lf->window_chunks;
+    lines += bf_line_no_offset(buffer);
+
+    if (window_end < lf->chunk_num) {
+        lines += lf_lines_indexed(lf) - lf->chunks[window_end].start_line;
+    }
+
+    return lines;
+}
+
+size_t bf_display_length(const Buffer *buffer)
+{
+    const LargeFile *lf = buffer->large_file;
+    size_t length = bf_length(buffer);
+
+    if (lf == NULL) {
+        return length;
+    }
+
+    size_t window_end = lf->window_start + lf->window_chunks;
+
+    for (size_t k = 0; k < lf->chunk_num; k++) {
+        if (k < lf->window_start || k >= window_end) {
+            length += lf_chunk_length(lf, k);
+        }
+    }
+
+    return length + (lf->file_size - lf->index_offset);
+}
+
+/* Move the window when the cursor has entered its first or last chunk, so
+ * that the text either side of the cursor is always loaded */
+Status bf_update_large_file_window(Buffer *buffer)
+{
+    LargeFile *lf = buffer->large_file;
+
+    if (lf == NULL || lf->window_chunks == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    size_t chunk_offset;
+    size_t chunk_index = bf_large_file_chunk(buffer, buffer->pos.offset,
+                                             &chunk_offset);
+    size_t last_chunk = lf->window_start + lf->window_chunks - 1;
+
+    if (chunk_index == lf->window_start && chunk_index > 0) {
+        return bf_load_large_file_window(buffer, chunk_index, chunk_offset);
+    } else if (chunk_index == last_chunk && chunk_index > lf->window_start) {
+        RETURN_IF_FAIL(lf_index_to_chunk(lf, chunk_index + 1));
+
+        if (chunk_index + 1 < lf->chunk_num) {
+            return bf_load_large_file_window(buffer, chunk_index,
+                                             chunk_offset);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Index the next chunk of the file. This is called between keypresses
+ * until the whole file has been indexed */
+Status bf_index_large_file(Buffer *buffer, int *index_pending)
+{
+    LargeFile *lf = buffer->large_file;
+    *index_pending = 0;
+
+    if (lf == NULL || lf_index_complete(lf)) {
+        return STATUS_SUCCESS;
+    }
+
+    RETURN_IF_FAIL(lf_index_next_chunk(lf));
+    *index_pending = !lf_index_complete(lf);
+
+    return STATUS_SUCCESS;
+}
+
+/* Continue a forward search outside of the loaded window. The chunks after
+ * the window are searched first then those before it. On success the
+ * window containing the match is loaded and last_match_pos is set */
+Status bf_large_file_find_next(Buffer *buffer, int *found_match,
+                               int *wrapped)
+{
+    LargeFile *lf = buffer->large_file;
+    BufferSearch *search = &buffer->search;
+    *found_match = 0;
+    *wrapped = 0;
+
+    assert(lf != NULL);
+
+    /* A match at the end of the window may extend into the next chunk */
+    size_t chunk_offset;
+    size_t cursor_chunk = bf_large_file_chunk(buffer, buffer->pos.offset,
+                                              &chunk_offset);
+    size_t search_start = lf->window_start + lf->window_chunks;
+
+    if (cursor_chunk + 1 < search_start) {
+        search_start--;
+    }
+
+    /* The window content may have been edited */
+    RETURN_IF_FAIL(bf_store_large_file_window(buffer));
+
+    size_t chunk_index, match_offset;
+
+    RETURN_IF_FAIL(lf_find_next(lf, search, search_start, SIZE_MAX,
+                                &chunk_index, &match_offset, found_match));
+
+    if (!*found_match && lf->window_start > 0) {
+        RETURN_IF_FAIL(lf_find_next(lf, search, 0, lf->window_start,
+                                    &chunk_index, &match_offset,
+                                    found_match));
+        *wrapped = *found_match;
+    }
+
+    if (!*found_match) {
+        return STATUS_SUCCESS;
+    }
+
+    RETURN_IF_FAIL(bf_load_large_file_window(buffer, chunk_index,
+                                             match_offset));
+
+    search->last_match_pos = buffer->pos;
+
+    return STATUS_SUCCESS;
+}
+
+/* Determine which chunk the window offset is in */
+static size_t bf_large_file_chunk(const Buffer *buffer, size_t offset,
+                                  size_t *chunk_offset)
+{
+    const LargeFile *lf = buffer->large_file;
+    size_t chunk_start = 0;
+    size_t k;
+
+    for (k = 0; k + 1 < lf->window_chunks; k++) {
+        if (offset < lf->boundaries[k].offset) {
+            break;
+        }
+
+        chunk_start = lf->boundaries[k].offset;
+    }
+
+    *chunk_offset = offset - chunk_start;
+
+    return lf->window_start + k;
+}
+
+/* Record which loaded chunks the text between start and end (inclusive)
+ * belongs to before an edit is made there. An edit on a boundary marks
+ * the chunks both sides of it, as inserted text is added to the end of
+ * the earlier chunk */
+static void bf_large_file_edited(Buffer *buffer, size_t start, size_t end)
+{
+    LargeFile *lf = buffer->large_file;
+
+    if (lf == NULL || lf->window_chunks == 0) {
+        return;
+    }
+
+    size_t chunk_start = 0;
+    size_t chunk_end;
+
+    for (size_t k = 0; k < lf->window_chunks; k++) {
+        if (k + 1 < lf->window_chunks) {
+            chunk_end = lf->boundaries[k].offset;
+        } else {
+            chunk_end = SIZE_MAX;
+        }
+
+        if (start <= chunk_end && end >= chunk_start) {
+            lf->window_modified[k] = 1;
+        }
+
+        chunk_start = chunk_end;
+    }
+}
+
+/* Keep any edits made to the loaded chunks so they aren't lost when
+ * the window moves. Only the chunks which have been edited are copied */
+static Status bf_store_large_file_window(Buffer *buffer)
+{
+    LargeFile *lf = buffer->large_file;
+
+    if (lf->window_chunks == 0 ||
+        !bc_has_state_changed(&buffer->changes, lf->window_state)) {
+        memset(lf->window_modified, 0, sizeof(lf->window_modified));
+        return STATUS_SUCCESS;
+    }
+
+    size_t chunk_start = 0;
+    size_t chunk_end;
+    size_t text_len;
+    char *text;
+
+    for (size_t k = 0; k < lf->window_chunks; k++) {
+        if (k + 1 < lf->window_chunks) {
+            chunk_end = lf->boundaries[k].offset;
+        } else {
+            chunk_end = gb_length(buffer->data);
+        }
+
+        if (!lf->window_modified[k]) {
+            chunk_start = chunk_end;
+            continue;
+        }
+
+        text_len = chunk_end - chunk_start;
+        /* Always allocate so an empty chunk is still treated as edited */
+        text = malloc(text_len + 1);
+
+        if (text == NULL) {
+            return OUT_OF_MEMORY("Unable to store large file edits");
+        }
+
+        gb_get_range(buffer->data, chunk_start, text, text_len);
+        lf_set_chunk_text(lf, lf->window_start + k, text, text_len);
+        lf->window_modified[k] = 0;
+
+        chunk_start = chunk_end;
+    }
+
+    lf->window_state = bc_get_current_state(&buffer->changes);
+
+    return STATUS_SUCCESS;
+}
+
+/* Load the chunks either side of chunk_index into the buffer and move the
+ * cursor to chunk_offset within chunk_index. Undo history, selections and
+ * additional cursors are limited to the loaded window so are reset */
+static Status bf_load_large_file_window(Buffer *buffer, size_t chunk_index,
+                                        size_t chunk_offset)
+{
+    LargeFile *lf = buffer->large_file;
+    BufferPos *screen_start = &buffer->bv->screen_start;
+    size_t screen_chunk_offset = 0;
+    size_t screen_chunk = SIZE_MAX;
+
+    if (lf->window_chunks > 0) {
+        RETURN_IF_FAIL(bf_store_large_file_window(buffer));
+        screen_chunk = bf_large_file_chunk(buffer, screen_start->offset,
+                                           &screen_chunk_offset);
+    }
+
+    RETURN_IF_FAIL(lf_index_to_chunk(lf, chunk_index + 1));
+
+    if (lf->chunk_num == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    chunk_index = MIN(chunk_index, lf->chunk_num - 1);
+    size_t window_start = chunk_index > 0 ? chunk_index - 1 : 0;
+    size_t window_end = MIN(window_start + LF_WINDOW_CHUNKS, lf->chunk_num);
+    size_t window_len = 0;
+    size_t max_chunk_len = 0;
+    size_t chunk_len;
+
+    for (size_t k = window_start; k < window_end; k++) {
+        chunk_len = lf_chunk_length(lf, k);
+        window_len += chunk_len;
+        max_chunk_len = MAX(max_chunk_len, chunk_len);
+    }
+
+    for (size_t k = 0; k + 1 < lf->window_chunks; k++) {
+        bf_remove_pos_mark(buffer, &lf->boundaries[k], 1);
+    }
+
+    lf->window_chunks = 0;
+
+    RETURN_IF_FAIL(bf_reset(buffer));
+
+    char *chunk_text = malloc(max_chunk_len + 1);
+
+    if (chunk_text == NULL || !gb_preallocate(buffer->data, window_len)) {
+        free(chunk_text);
+        return OUT_OF_MEMORY("Unable to load large file window");
+    }
+
+    Status status = STATUS_SUCCESS;
+    size_t chunk_starts[LF_WINDOW_CHUNKS];
+
+    gb_set_point(buffer->data, 0);
+
+    for (size_t k = window_start; k < window_end; k++) {
+        chunk_starts[k - window_start] = gb_length(buffer->data);
+        status = lf_read_chunk(lf, k, chunk_text);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        if (!gb_add(buffer->data, chunk_text, lf_chunk_length(lf, k))) {
+            status = OUT_OF_MEMORY("Unable to populate buffer");
+            break;
+        }
+    }
+
+    free(chunk_text);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        bf_reset(buffer);
+        return status;
+    }
+
+    lf->window_start = window_start;
+
+    for (size_t k = 1; k < window_end - window_start; k++) {
+        lf->boundaries[k - 1] = bp_init_from_offset(chunk_starts[k],
+                                                    &buffer->pos);
+        RETURN_IF_FAIL(bf_add_new_mark(buffer, &lf->boundaries[k - 1],
+                                       MP_ADJUST_OFFSET_ONLY));
+        lf->window_chunks = k;
+    }
+
+    lf->window_chunks = window_end - window_start;
+    lf->window_state = bc_get_current_state(&buffer->changes);
+    memset(lf->window_modified, 0, sizeof(lf->window_modified));
+    buffer->change_state = lf->window_state;
+
+    size_t chunk_start = chunk_starts[chunk_index - window_start];
+    size_t offset = MIN(chunk_start + chunk_offset, gb_length(buffer->data));
+    BufferPos pos = bp_init_from_offset(offset, &buffer->pos);
+
+    /* Keep the same text at the top of the screen if it's still loaded */
+    if (screen_chunk >= window_start && screen_chunk < window_end) {
+        offset = chunk_starts[screen_chunk - window_start] +
+                 screen_chunk_offset;
+        *screen_start = bp_init_from_offset(MIN(offset, pos.offset), &pos);
+        bp_to_line_start(screen_start);
+    } else {
+        *screen_start = pos;
+        bp_to_line_start(screen_start);
+    }
+
+    bs_reset(&buffer->search, NULL);
+    bf_free_syntax_match_cache(buffer);
+    bf_set_is_draw_dirty(buffer, 1);
+
+    return bf_set_bp(buffer, &pos, 0);
+}
+
 /* Add new line to buffer end if one doesn't exist */
 static Status bf_add_new_line_at_buffer_end(Buffer *buffer)
 {
@@ -322,11 +853,36 @@ static Status bf_add_new_line_at_buffer_end(Buffer *buffer)
 
 /* Write buffer to temporary file in same directory as file_path
  * then rename temporary file to file_path */
+/* Returns true if file_path refers to the file the buffer was read from */
+static int bf_is_buffer_file(const Buffer *buffer, const char *file_path)
+{
+    const struct stat *file_stat = &buffer->file_info.file_stat;
+    struct stat path_stat;
+
+    return fi_file_exists(&buffer->file_info) &&
+           stat(file_path, &path_stat) == 0 &&
+           path_stat.st_dev == file_stat->st_dev &&
+           path_stat.st_ino == file_stat->st_ino;
+}
+
 Status bf_write_file(Buffer *buffer, const char *file_path)
 {
     assert(!is_null_or_empty(file_path));
 
-    RETURN_IF_FAIL(bf_add_new_line_at_buffer_end(buffer));
+    if (buffer->is_partial && bf_is_buffer_file(buffer, file_path)) {
+        return st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE,
+                            "Unable to save %s as lines at the start of "
+                            "the file were removed whilst following it, "
+                            "save it as a different file instead",
+                            buffer->file_info.file_name);
+    }
+
+    if (buffer->large_file != NULL) {
+        /* The whole file is written from the chunks it's composed of */
+        RETURN_IF_FAIL(bf_store_large_file_window(buffer));
+    } else {
+        RETURN_IF_FAIL(bf_add_new_line_at_buffer_end(buffer));
+    }
 
     const FileInfo *file_info = &buffer->file_info;
 
@@ -354,6 +910,11 @@ Status bf_write_file(Buffer *buffer, const char *file_path)
     size_t bytes_retrieved;
     char buf[FILE_BUF_SIZE];
 
+    if (buffer->large_file != NULL) {
+        status = lf_write(buffer->large_file, output_file);
+        bytes_remaining = 0;
+    }
+
     /* Read text from gap buffer and write to temporary file */
 
     while (bytes_remaining > 0) {
@@ -408,6 +969,11 @@ Status bf_write_file(Buffer *buffer, const char *file_path)
 cleanup:
     if (STATUS_IS_SUCCESS(status)) {
         buffer->change_state = bc_get_current_state(&buffer->changes);
+
+        if (buffer->large_file != NULL) {
+            /* Subsequent chunks are read from the file just written */
+            status = lf_saved(buffer->large_file, file_path);
+        }
     } else {
         remove(tmp_file_path);
     }
@@ -474,6 +1040,12 @@ int bf_is_view_initialised(const Buffer *buffer)
 
 int bf_is_dirty(const Buffer *buffer)
 {
+    /* Edits to a large file outside the loaded window are
+     * no longer part of the undo history */
+    if (buffer->large_file != NULL && buffer->large_file->modified) {
+        return 1;
+    }
+
     return bc_has_state_changed(&buffer->changes, buffer->change_state);
 }
 
@@ -489,7 +1061,8 @@ void bf_set_is_draw_dirty(Buffer *buffer, int is_draw_dirty)
 
 int bf_get_range(Buffer *buffer, Range *range)
 {
-    if (!bf_selection_started(buffer)) {
+    /* Block selections aren't contiguous, see bf_get_block */
+    if (!bf_selection_started(buffer) || buffer->block_select) {
         return 0;
     } else if (bp_compare(&buffer->pos, &buffer->select_start) == 0) {
         /* Cannot have empty selection */
@@ -621,14 +1194,65 @@ Status bf_get_buffer_output_stream(BufferOutputStream *bos, Buffer *buffer,
     return STATUS_SUCCESS;
 }
 
-/* TODO Consider UTF-8 punctuation and whitespace */
-CharacterClass bf_character_class(const Buffer *buffer, const BufferPos *pos)
+static Status bf_text_output_stream_write(OutputStream *os, const char buf[],
+                                          size_t buf_len,
+                                          size_t *bytes_written)
 {
-    CharInfo char_info;
-    en_utf8_char_info(&char_info, CIP_DEFAULT, pos, buffer->config);
+    TextOutputStream *tos = (TextOutputStream *)os;
+    GapBuffer *data = tos->data;
+    size_t required = gb_length(data) + buf_len;
+
+    if (required > data->allocated) {
+        /* Grow geometrically so that collecting large amounts of output
+         * doesn't result in a reallocation for every chunk written */
+        if (!gb_preallocate(data, MAX(required, data->allocated * 2))) {
+            return OUT_OF_MEMORY("Unable to store command output");
+        }
+    }
 
-    if (char_info.byte_length == 1) {
-        uchar character = bp_get_uchar(pos);
+    if (!gb_add(data, buf, buf_len)) {
+        return OUT_OF_MEMORY("Unable to store command output");
+    }
+
+    *bytes_written = buf_len;
+
+    return STATUS_SUCCESS;
+}
+
+static Status bf_text_output_stream_close(OutputStream *os)
+{
+    TextOutputStream *tos = (TextOutputStream *)os;
+    gb_free(tos->data);
+    tos->data = NULL;
+
+    return STATUS_SUCCESS;
+}
+
+Status bf_get_text_output_stream(TextOutputStream *tos)
+{
+    *tos = (TextOutputStream) {
+        .os = {
+            .write = bf_text_output_stream_write,
+            .close = bf_text_output_stream_close
+        },
+        .data = gb_new(GAP_INCREMENT)
+    };
+
+    if (tos->data == NULL) {
+        return OUT_OF_MEMORY("Unable to create output stream");
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* TODO Consider UTF-8 punctuation and whitespace */
+CharacterClass bf_character_class(const Buffer *buffer, const BufferPos *pos)
+{
+    CharInfo char_info;
+    en_utf8_char_info(&char_info, CIP_DEFAULT, pos, buffer->config);
+
+    if (char_info.byte_length == 1) {
+        uchar character = bp_get_uchar(pos);
 
         if (isspace(character)) {
             return CCLASS_WHITESPACE;
@@ -1335,10 +1959,11 @@ static Status bf_add_mark(Buffer *buffer, Mark *mark)
 
     char addr[50];
     snprintf(addr, sizeof(addr), "%p", (void *)mark->pos);
+    HashMapKey key = hashmap_hash_key(addr);
 
-    if (hashmap_get(buffer->marks, addr) != NULL) {
+    if (hashmap_get_hashed(buffer->marks, &key) != NULL) {
         return st_get_error(ERR_DUPLICATE_MARK, "Mark already tracked");
-    } else if (!hashmap_set(buffer->marks, addr, mark)) {
+    } else if (!hashmap_set_hashed(buffer->marks, &key, mark)) {
         return OUT_OF_MEMORY("Unable to save mark" );
     }
 
@@ -1353,7 +1978,7 @@ static Mark *bf_get_mark(const Buffer *buffer, const BufferPos *pos)
     return hashmap_get(buffer->marks, addr);
 }
 
-static int bf_remove_pos_mark(Buffer *buffer, const BufferPos *pos, int free)
+int bf_remove_pos_mark(Buffer *buffer, const BufferPos *pos, int free)
 {
     Mark *mark = bf_get_mark(buffer, pos);
     return bf_remove_mark(buffer, mark, free);
@@ -1381,19 +2006,18 @@ static Status bf_update_marks(Buffer *buffer, const BufferPos *change_pos,
                               TextChangeType change_type, size_t change_length,
                               size_t change_lines)
 {
-    /* TODO Need HashMapIterator implementation to avoid heap allocation
-     * just to loop through hash entries */
-    const char **mark_refs = hashmap_get_keys(buffer->marks);
+    TR_SPAN("bf_update_marks");
 
-    if (mark_refs == NULL) {
-        return OUT_OF_MEMORY("Unable to allocate mark list");
-    }
+    bf_large_file_edited(buffer, change_pos->offset,
+                         change_pos->offset +
+                         (change_type == TCT_DELETE ? change_length : 0));
 
-    size_t mark_num = hashmap_size(buffer->marks);
-    Mark *mark;
+    HashMapIterator iter;
+    void *mark;
+
+    hashmap_iter_init(&iter, buffer->marks);
 
-    for (size_t k = 0; k < mark_num; k++) {
-        mark = (Mark *)hashmap_get(buffer->marks, mark_refs[k]);
+    while (hashmap_iter_next(&iter, NULL, &mark)) {
         assert(mark != NULL);
 
         if (mark != NULL) {
@@ -1402,8 +2026,6 @@ static Status bf_update_marks(Buffer *buffer, const BufferPos *change_pos,
         }
     }
 
-    free(mark_refs);
-
     return STATUS_SUCCESS;
 }
 
@@ -1590,6 +2212,7 @@ Status bf_insert_string(Buffer *buffer, const char *string,
 
     bf_update_marks(buffer, &buffer->pos, TCT_INSERT, string_length,
                     lines_after - lines_before);
+    jn_add_insert(buffer->journal, start_pos.offset, string, string_length);
 
     status = bc_add_text_insert(&buffer->changes, string_length, &start_pos);
 
@@ -1695,6 +2318,7 @@ Status bf_delete(Buffer *buffer, size_t byte_num)
 
     bf_update_marks(buffer, &buffer->pos, TCT_DELETE, byte_num,
                     lines_before - lines_after);
+    jn_add_delete(buffer->journal, pos->offset, byte_num);
 
     Status status = STATUS_SUCCESS;
 
@@ -1747,6 +2371,8 @@ Status bf_select_reset(Buffer *buffer)
         bf_set_is_draw_dirty(buffer, 1);
     }
 
+    buffer->block_select = 0;
+
     return STATUS_SUCCESS;
 }
 
@@ -1762,6 +2388,39 @@ Status bf_delete_range(Buffer *buffer, const Range *range)
     return bf_delete(buffer, delete_byte_num);
 }
 
+/* Replace the text in range with string. Unlike bf_replace_string, which
+ * is called repeatedly by streams, the whole replacement is performed as
+ * one delete and one insert so marks are only updated twice and a single
+ * undo record is created regardless of the amount of text involved */
+Status bf_replace_range(Buffer *buffer, const Range *range,
+                        const char *string, size_t string_length)
+{
+    int grouped_changes_started = bc_grouped_changes_started(&buffer->changes);
+
+    if (!grouped_changes_started) {
+        RETURN_IF_FAIL(bc_start_grouped_changes(&buffer->changes));
+    }
+
+    Status status = STATUS_SUCCESS;
+
+    if (range->end.offset > range->start.offset) {
+        status = bf_delete_range(buffer, range);
+    } else {
+        bf_select_reset(buffer);
+        buffer->pos = range->start;
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_insert_string(buffer, string, string_length, 0);
+    }
+
+    if (!grouped_changes_started) {
+        bc_end_grouped_changes(&buffer->changes);
+    }
+
+    return status;
+}
+
 Status bf_select_all_text(Buffer *buffer)
 {
     if (gb_length(buffer->data) == 0) {
@@ -1781,7 +2440,9 @@ Status bf_copy_selected_text(Buffer *buffer, TextSelection *text_selection)
     memset(text_selection, 0, sizeof(TextSelection));
     Range range;
 
-    if (!bf_get_range(buffer, &range)) {
+    if (bf_block_selected(buffer)) {
+        return bf_copy_block(buffer, text_selection);
+    } else if (!bf_get_range(buffer, &range)) {
         return STATUS_SUCCESS;
     }
 
@@ -1812,7 +2473,10 @@ Status bf_cut_selected_text(Buffer *buffer, TextSelection *text_selection)
     memset(text_selection, 0, sizeof(TextSelection));
     Range range;
 
-    if (!bf_get_range(buffer, &range)) {
+    if (bf_block_selected(buffer)) {
+        RETURN_IF_FAIL(bf_copy_block(buffer, text_selection));
+        return bf_block_delete(buffer, DIRECTION_NONE);
+    } else if (!bf_get_range(buffer, &range)) {
         return STATUS_SUCCESS;
     }
     
@@ -1838,7 +2502,8 @@ Status bf_insert_textselection(Buffer *buffer, TextSelection *text_selection,
      * if necessary. Usually occurs when copying between buffers */
     if (text_selection->file_format != buffer->file_format) {
         TextSelection converted_selection = {
-            .file_format = buffer->file_format
+            .file_format = buffer->file_format,
+            .is_block = text_selection->is_block
         };
         int conversion_perfomed;
 
@@ -1848,17 +2513,63 @@ Status bf_insert_textselection(Buffer *buffer, TextSelection *text_selection,
         RETURN_IF_FAIL(status);
 
         if (conversion_perfomed) {
-            status = bf_insert_string(buffer, converted_selection.str, 
-                                      converted_selection.str_len,
-                                      advance_cursor);
+            status = bf_insert_textselection_str(buffer, &converted_selection,
+                                                 advance_cursor);
 
             bf_free_textselection(&converted_selection);
             return status;
         }
     }
 
-    return bf_insert_string(buffer, text_selection->str, 
-                            text_selection->str_len, advance_cursor);
+    return bf_insert_textselection_str(buffer, text_selection, advance_cursor);
+}
+
+static Status bf_insert_textselection_str(Buffer *buffer,
+                                          const TextSelection *text_selection,
+                                          int advance_cursor)
+{
+    if (!text_selection->is_block) {
+        if (bf_block_selected(buffer)) {
+            return bf_block_insert(buffer, text_selection->str,
+                                   text_selection->str_len);
+        }
+
+        return bf_insert_string(buffer, text_selection->str,
+                                text_selection->str_len, advance_cursor);
+    }
+
+    /* Pasting a block over a selected block replaces it */
+    int grouped_changes_started = bc_grouped_changes_started(&buffer->changes);
+
+    if (!grouped_changes_started) {
+        RETURN_IF_FAIL(bc_start_grouped_changes(&buffer->changes));
+    }
+
+    Status status = STATUS_SUCCESS;
+    Range range;
+
+    if (bf_block_selected(buffer)) {
+        status = bf_block_delete(buffer, DIRECTION_NONE);
+
+        if (STATUS_IS_SUCCESS(status)) {
+            BufferPos block_start = bp_min(&buffer->pos,
+                                           &buffer->select_start);
+            status = bf_set_bp(buffer, &block_start, 0);
+        }
+    } else if (bf_get_range(buffer, &range)) {
+        status = bf_delete_range(buffer, &range);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_paste_block(buffer, text_selection->str,
+                                text_selection->str_len, advance_cursor);
+    }
+
+    if (!grouped_changes_started) {
+        bc_end_grouped_changes(&buffer->changes);
+    }
+
+    return status;
 }
 
 static Status bf_convert_fileformat(TextSelection *in_ts, TextSelection *out_ts,
@@ -1972,6 +2683,94 @@ Status bf_reset_with_text(Buffer *buffer, const char *text)
     return STATUS_SUCCESS;
 }
 
+/* Add text written to the end of the buffer's file since it was read.
+ * Like the initial load of a file the text isn't undoable, and unlike
+ * bf_insert_string any selection is left in place. When the cursor is on
+ * the last line it's moved to the new last line so that the view follows
+ * the end of the file */
+Status bf_append_file_text(Buffer *buffer, const char *text, size_t text_len)
+{
+    if (text_len == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    BufferPos end_pos = buffer->pos;
+    bp_to_buffer_end(&end_pos);
+    int follow_end = bp_at_last_line(&buffer->pos) &&
+                     !bf_selection_started(buffer);
+
+    gb_set_point(buffer->data, end_pos.offset);
+    size_t lines_before = gb_lines(buffer->data);
+
+    if (!gb_insert(buffer->data, text, text_len)) {
+        return OUT_OF_MEMORY("Unable to append text");
+    }
+
+    size_t lines_after = gb_lines(buffer->data);
+    buffer->is_draw_dirty = 1;
+
+    RETURN_IF_FAIL(bf_update_marks(buffer, &end_pos, TCT_INSERT, text_len,
+                                   lines_after - lines_before));
+
+    if (!follow_end) {
+        return STATUS_SUCCESS;
+    }
+
+    BufferPos pos = end_pos;
+    bp_to_buffer_end(&pos);
+    bp_to_line_start(&pos);
+
+    return bf_set_bp(buffer, &pos, 0);
+}
+
+/* Remove lines from the start of the buffer so that no more than
+ * max_lines complete lines remain. This bounds the memory used by a buffer
+ * that text is continually appended to. The undo history refers to offsets
+ * in the removed text so is discarded. As the buffer then only holds the
+ * end of the file it's marked as partial so it isn't saved over it */
+Status bf_trim_leading_lines(Buffer *buffer, size_t max_lines)
+{
+    size_t lines = gb_lines(buffer->data);
+
+    if (max_lines == 0 || lines <= max_lines) {
+        return STATUS_SUCCESS;
+    }
+
+    size_t remove_lines = lines - max_lines;
+    int is_dirty = bf_is_dirty(buffer);
+    BufferPos pos = buffer->pos;
+
+    bf_clear_cursors(buffer);
+    bf_select_reset(buffer);
+    bp_to_buffer_start(&buffer->pos);
+
+    BufferPos trim_end = buffer->pos;
+    bp_advance_to_line(&trim_end, remove_lines + 1);
+    bp_to_line_start(&trim_end);
+
+    bc_disable(&buffer->changes);
+    Status status = bf_delete(buffer, trim_end.offset);
+    bc_enable(&buffer->changes);
+
+    if (STATUS_IS_SUCCESS(status) && pos.offset >= trim_end.offset) {
+        /* Whole lines were removed so the column is unchanged */
+        pos.offset -= trim_end.offset;
+        pos.line_no -= remove_lines;
+        status = bf_set_bp(buffer, &pos, 0);
+    }
+
+    bc_free(&buffer->changes);
+    bc_init(&buffer->changes);
+    buffer->change_state = bc_get_current_state(&buffer->changes);
+    buffer->is_partial = 1;
+
+    if (is_dirty) {
+        buffer->change_state.version++;
+    }
+
+    return status;
+}
+
 Status bf_set_mask(Buffer *buffer, const Regex *regex)
 {
     bf_remove_mask(buffer);
@@ -2012,6 +2811,23 @@ void bf_remove_mask(Buffer *buffer)
 
 Status bf_goto_line(Buffer *buffer, size_t line_no)
 {
+    LargeFile *lf = buffer->large_file;
+
+    if (lf != NULL && line_no > 0) {
+        size_t line_no_offset = bf_line_no_offset(buffer);
+
+        /* Load the window containing the line if it isn't already */
+        if (line_no <= line_no_offset ||
+            line_no > line_no_offset + bf_lines(buffer)) {
+            size_t chunk_index;
+            RETURN_IF_FAIL(lf_index_to_line(lf, line_no, &chunk_index));
+            RETURN_IF_FAIL(bf_load_large_file_window(buffer, chunk_index, 0));
+            line_no_offset = bf_line_no_offset(buffer);
+        }
+
+        line_no -= MIN(line_no - 1, line_no_offset);
+    }
+
     buffer->pos = bp_init_from_line_col(line_no, 1, &buffer->pos);
     bf_update_line_col_offset(buffer, &buffer->pos);
     return STATUS_SUCCESS;
@@ -2460,3 +3276,1047 @@ size_t bf_get_line(const Buffer *buffer, const BufferPos *pos, char *buf,
     return bf_get_text(buffer, &start, buf, text_len);
 }
 
+
+static size_t bf_count_lines(const char *str, size_t str_len)
+{
+    size_t lines = 0;
+    const char *end = str + str_len;
+
+    while (str < end && (str = memchr(str, '\n', end - str)) != NULL) {
+        lines++;
+        str++;
+    }
+
+    return lines;
+}
+
+/* Apply edits sorted by position in a single pass over the buffer,
+ * updating all marks in one further pass. The returned inverse contains
+ * the edits which reverse this application */
+static Status bf_apply_batch(Buffer *buffer, const TextEdit *edits,
+                             size_t edit_num, BatchChange **inverse_ptr)
+{
+    TR_SPAN("bf_apply_batch");
+
+    size_t buffer_len = gb_length(buffer->data);
+    size_t min_offset = 0;
+    size_t text_len = 0;
+
+    for (size_t k = 0; k < edit_num; k++) {
+        const TextEdit *edit = &edits[k];
+
+        if (edit->pos.data != buffer->data ||
+            edit->pos.offset < min_offset ||
+            edit->pos.offset + edit->delete_len > buffer_len) {
+            return st_get_error(ERR_INVALID_BUFFERPOS,
+                                "Invalid Buffer Position");
+        }
+
+        min_offset = edit->pos.offset + edit->delete_len;
+        text_len += edit->delete_len;
+    }
+
+    BatchChange *inverse = bc_batch_new(edit_num, text_len);
+    GapBufferEdit *gb_edits = malloc(MAX(edit_num, 1) *
+                                     sizeof(GapBufferEdit));
+    EditBounds *bounds = malloc(MAX(edit_num, 1) * sizeof(EditBounds));
+
+    if (inverse == NULL || gb_edits == NULL || bounds == NULL) {
+        bc_batch_free(inverse);
+        free(gb_edits);
+        free(bounds);
+        return OUT_OF_MEMORY("Unable to apply edits");
+    }
+
+    char *text = inverse->text;
+    size_t inserted = 0;
+    size_t deleted = 0;
+    size_t lines_inserted = 0;
+    size_t lines_deleted = 0;
+
+    for (size_t k = 0; k < edit_num; k++) {
+        const TextEdit *edit = &edits[k];
+        TextEdit *inverse_edit = &inverse->edits[k];
+        EditBounds *edit_bounds = &bounds[k];
+
+        gb_get_range(buffer->data, edit->pos.offset, text, edit->delete_len);
+        size_t delete_lines = bf_count_lines(text, edit->delete_len);
+        size_t insert_lines = bf_count_lines(edit->str, edit->str_len);
+
+        /* The inverse edit is positioned relative to the buffer once all
+         * edits have been applied. Its column is recalculated if it's
+         * ever used to position a mark */
+        inverse_edit->pos = edit->pos;
+        inverse_edit->pos.offset = edit->pos.offset + inserted - deleted;
+        inverse_edit->pos.line_no = edit->pos.line_no + lines_inserted -
+                                    lines_deleted;
+        inverse_edit->delete_len = edit->str_len;
+        inverse_edit->str = text;
+        inverse_edit->str_len = edit->delete_len;
+
+        edit_bounds->offset = edit->pos.offset;
+        edit_bounds->delete_end = edit->pos.offset + edit->delete_len;
+        edit_bounds->delete_end_line = edit->pos.line_no + delete_lines;
+        edit_bounds->new_offset = inverse_edit->pos.offset;
+        edit_bounds->new_line_no = inverse_edit->pos.line_no;
+        edit_bounds->insert_end = inverse_edit->pos.offset + edit->str_len;
+        edit_bounds->insert_end_line = inverse_edit->pos.line_no +
+                                       insert_lines;
+
+        gb_edits[k].offset = edit->pos.offset;
+        gb_edits[k].delete_len = edit->delete_len;
+        gb_edits[k].str = edit->str;
+        gb_edits[k].str_len = edit->str_len;
+
+        text += edit->delete_len;
+        inserted += edit->str_len;
+        deleted += edit->delete_len;
+        lines_inserted += insert_lines;
+        lines_deleted += delete_lines;
+    }
+
+    Status status = STATUS_SUCCESS;
+
+    if (!gb_apply_edits(buffer->data, gb_edits, edit_num)) {
+        status = OUT_OF_MEMORY("Unable to apply edits");
+        goto cleanup;
+    }
+
+    buffer->is_draw_dirty = 1;
+
+    /* Each edit is journalled relative to the text once the edits
+     * before it have been applied */
+    for (size_t k = 0; k < edit_num && buffer->journal != NULL; k++) {
+        jn_add_delete(buffer->journal, bounds[k].new_offset,
+                      edits[k].delete_len);
+        jn_add_insert(buffer->journal, bounds[k].new_offset, edits[k].str,
+                      edits[k].str_len);
+    }
+
+    status = bf_update_marks_after_edits(buffer, bounds, edit_num);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        goto cleanup;
+    }
+
+    bf_update_pos_after_edits(&buffer->pos, MP_NONE, bounds, edit_num);
+    bf_update_pos_after_edits(&buffer->select_start, MP_NONE,
+                              bounds, edit_num);
+    bf_update_line_col_offset(buffer, &buffer->pos);
+
+cleanup:
+    free(gb_edits);
+    free(bounds);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        *inverse_ptr = inverse;
+    } else {
+        bc_batch_free(inverse);
+    }
+
+    return status;
+}
+
+static Status bf_update_marks_after_edits(Buffer *buffer,
+                                          const EditBounds *bounds,
+                                          size_t edit_num)
+{
+    HashMapIterator iter;
+    void *value;
+    Mark *mark;
+
+    for (size_t k = 0; k < edit_num; k++) {
+        bf_large_file_edited(buffer, bounds[k].offset, bounds[k].delete_end);
+    }
+
+    hashmap_iter_init(&iter, buffer->marks);
+
+    while (hashmap_iter_next(&iter, NULL, &value)) {
+        mark = value;
+        assert(mark != NULL);
+
+        if (mark != NULL) {
+            bf_update_pos_after_edits(mark->pos, mark->prop,
+                                      bounds, edit_num);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Equivalent to calling bf_update_mark for each edit in turn. Only the
+ * last edit at or before pos can affect it, as pos is shifted by the net
+ * change of all edits up to and including that one */
+static void bf_update_pos_after_edits(BufferPos *pos, MarkProperties prop,
+                                      const EditBounds *bounds,
+                                      size_t edit_num)
+{
+    if (pos->line_no == 0) {
+        return;
+    }
+
+    int no_adjust_on_pos = prop & MP_NO_ADJUST_ON_BUFFER_POS;
+    size_t low = 0;
+    size_t high = edit_num;
+    size_t mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (bounds[mid].offset < pos->offset ||
+            (bounds[mid].offset == pos->offset && !no_adjust_on_pos)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == 0) {
+        return;
+    }
+
+    const EditBounds *edit_bounds = &bounds[low - 1];
+
+    if (pos->offset < edit_bounds->delete_end) {
+        /* The text pos was in has been deleted */
+        if (no_adjust_on_pos) {
+            pos->offset = edit_bounds->new_offset;
+            pos->line_no = edit_bounds->new_line_no;
+        } else {
+            pos->offset = edit_bounds->insert_end;
+            pos->line_no = edit_bounds->insert_end_line;
+        }
+
+        bp_recalc_col(pos);
+    } else {
+        size_t line_no = pos->line_no;
+        pos->offset = pos->offset - edit_bounds->delete_end +
+                      edit_bounds->insert_end;
+
+        if (!(prop & MP_ADJUST_OFFSET_ONLY)) {
+            pos->line_no = line_no - edit_bounds->delete_end_line +
+                           edit_bounds->insert_end_line;
+
+            if (line_no == edit_bounds->delete_end_line) {
+                bp_recalc_col(pos);
+            }
+        }
+    }
+
+    assert(pos->offset <= gb_length(pos->data));
+}
+
+/* Apply edits at multiple positions as a single change. Edits must be
+ * sorted by position and not overlap. The buffer text is traversed once
+ * and marks are updated once regardless of the number of edits, and a
+ * single undo record is created */
+Status bf_apply_edits(Buffer *buffer, const TextEdit *edits, size_t edit_num)
+{
+    if (edit_num == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    BatchChange *inverse;
+    RETURN_IF_FAIL(bf_apply_batch(buffer, edits, edit_num, &inverse));
+
+    return bc_add_batch_change(&buffer->changes, inverse);
+}
+
+/* Apply a batch and replace it with the batch that reverses it. As with
+ * other undo and redo operations the cursor is moved to the first edit */
+Status bf_apply_batch_change(Buffer *buffer, BatchChange **batch_ptr)
+{
+    BatchChange *batch = *batch_ptr;
+    BatchChange *inverse;
+
+    RETURN_IF_FAIL(bf_apply_batch(buffer, batch->edits, batch->edit_num,
+                                  &inverse));
+
+    bc_batch_free(batch);
+    *batch_ptr = inverse;
+
+    if (inverse->edit_num > 0) {
+        RETURN_IF_FAIL(bf_set_bp(buffer, &inverse->edits[0].pos, 0));
+        bf_merge_cursors(buffer);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+int bf_has_cursors(const Buffer *buffer)
+{
+    return list_size(buffer->cursors) > 0;
+}
+
+size_t bf_cursor_num(const Buffer *buffer)
+{
+    return list_size(buffer->cursors) + 1;
+}
+
+/* Index of the first cursor at or after offset */
+static size_t bf_cursor_index(const Buffer *buffer, size_t offset)
+{
+    size_t low = 0;
+    size_t high = list_size(buffer->cursors);
+    size_t mid;
+    const Cursor *cursor;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        cursor = list_get(buffer->cursors, mid);
+
+        if (cursor->pos.offset < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+Status bf_add_cursor(Buffer *buffer, const BufferPos *pos,
+                     const BufferPos *select_start)
+{
+    assert(pos->data == buffer->data);
+
+    size_t index = bf_cursor_index(buffer, pos->offset);
+    const Cursor *existing = NULL;
+
+    if (index < list_size(buffer->cursors)) {
+        existing = list_get(buffer->cursors, index);
+    }
+
+    if (pos->offset == buffer->pos.offset ||
+        (existing != NULL && existing->pos.offset == pos->offset)) {
+        return STATUS_SUCCESS;
+    }
+
+    Cursor *cursor = malloc(sizeof(Cursor));
+
+    if (cursor == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate cursor");
+    }
+
+    cursor->pos = *pos;
+
+    if (select_start != NULL) {
+        cursor->select_start = *select_start;
+    } else {
+        cursor->select_start = *pos;
+        cursor->select_start.line_no = 0;
+    }
+
+    Status status = bf_add_new_mark(buffer, &cursor->pos, MP_NONE);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        free(cursor);
+        return status;
+    }
+
+    status = bf_add_new_mark(buffer, &cursor->select_start, MP_NONE);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        bf_free_cursor(buffer, cursor);
+        return status;
+    }
+
+    int added;
+
+    if (index == list_size(buffer->cursors)) {
+        added = list_add(buffer->cursors, cursor);
+    } else {
+        added = list_add_at(buffer->cursors, cursor, index);
+    }
+
+    if (!added) {
+        bf_free_cursor(buffer, cursor);
+        return OUT_OF_MEMORY("Unable to add cursor");
+    }
+
+    bf_set_is_draw_dirty(buffer, 1);
+
+    return STATUS_SUCCESS;
+}
+
+static void bf_free_cursor(Buffer *buffer, Cursor *cursor)
+{
+    bf_remove_pos_mark(buffer, &cursor->pos, 1);
+    bf_remove_pos_mark(buffer, &cursor->select_start, 1);
+    free(cursor);
+}
+
+/* Add a cursor on the line below the last cursor or above the first
+ * cursor, in the same column as the primary cursor */
+Status bf_add_cursor_on_line(Buffer *buffer, Direction direction)
+{
+    BufferPos pos = buffer->pos;
+    const Cursor *cursor;
+
+    if (direction == DIRECTION_DOWN) {
+        cursor = list_get_last(buffer->cursors);
+
+        if (cursor != NULL && cursor->pos.offset > pos.offset) {
+            pos = cursor->pos;
+        }
+
+        if (bp_at_last_line(&pos)) {
+            return STATUS_SUCCESS;
+        }
+
+        bp_advance_to_line_col(&pos, pos.line_no + 1, buffer->pos.col_no);
+    } else if (direction == DIRECTION_UP) {
+        cursor = list_get_first(buffer->cursors);
+
+        if (cursor != NULL && cursor->pos.offset < pos.offset) {
+            pos = cursor->pos;
+        }
+
+        if (bp_at_first_line(&pos)) {
+            return STATUS_SUCCESS;
+        }
+
+        bp_reverse_to_line_col(&pos, pos.line_no - 1, buffer->pos.col_no);
+    } else {
+        return STATUS_SUCCESS;
+    }
+
+    return bf_add_cursor(buffer, &pos, NULL);
+}
+
+/* Select every match of the current search pattern, each with its own
+ * cursor. The current match is selected by the primary cursor */
+Status bf_add_cursors_at_search_matches(Buffer *buffer)
+{
+    BufferSearch *search = &buffer->search;
+
+    if (search->opt.pattern == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    RETURN_IF_FAIL(bs_find_all(search, &buffer->pos));
+
+    const SearchMatches *matches = &search->matches;
+
+    if (matches->match_num == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    bf_clear_cursors(buffer);
+
+    const Range *range = &matches->match_ranges[matches->current_match_index];
+    RETURN_IF_FAIL(bf_set_bp(buffer, &range->end, 0));
+    buffer->select_start = range->start;
+
+    Status status = STATUS_SUCCESS;
+
+    for (size_t k = 0; k < matches->match_num && STATUS_IS_SUCCESS(status);
+         k++) {
+        range = &matches->match_ranges[k];
+        status = bf_add_cursor(buffer, &range->end, &range->start);
+    }
+
+    /* The stored matches are invalidated by the first edit */
+    bs_reset(search, NULL);
+    bf_set_is_draw_dirty(buffer, 1);
+
+    return status;
+}
+
+void bf_clear_cursors(Buffer *buffer)
+{
+    size_t cursor_num = list_size(buffer->cursors);
+
+    if (cursor_num == 0) {
+        return;
+    }
+
+    for (size_t k = 0; k < cursor_num; k++) {
+        bf_free_cursor(buffer, list_get(buffer->cursors, k));
+    }
+
+    list_clear(buffer->cursors);
+    bf_set_is_draw_dirty(buffer, 1);
+}
+
+static int bf_cursor_comparator(const void *v1, const void *v2)
+{
+    const Cursor *cursor1 = *(const Cursor **)v1;
+    const Cursor *cursor2 = *(const Cursor **)v2;
+
+    return (cursor1->pos.offset > cursor2->pos.offset) -
+           (cursor1->pos.offset < cursor2->pos.offset);
+}
+
+/* Cursors can end up in the same position after an edit or movement
+ * e.g. backspacing past the start of a line. Keep the cursors sorted and
+ * remove any that now share a position */
+static void bf_merge_cursors(Buffer *buffer)
+{
+    List *cursors = buffer->cursors;
+    size_t cursor_num = list_size(cursors);
+    size_t kept = 0;
+    const Cursor *prev = NULL;
+    Cursor *cursor;
+
+    list_sort(cursors, bf_cursor_comparator);
+
+    for (size_t k = 0; k < cursor_num; k++) {
+        cursor = list_get(cursors, k);
+
+        if (cursor->pos.offset == buffer->pos.offset ||
+            (prev != NULL && cursor->pos.offset == prev->pos.offset)) {
+            bf_free_cursor(buffer, cursor);
+            continue;
+        }
+
+        list_set(cursors, cursor, kept++);
+        prev = cursor;
+    }
+
+    while (list_size(cursors) > kept) {
+        list_pop(cursors);
+    }
+}
+
+Status bf_move_cursors(Buffer *buffer, CursorMovement movement,
+                       Direction direction)
+{
+    int is_select = is_selection(&direction);
+    size_t cursor_num = list_size(buffer->cursors);
+    Cursor *cursor;
+    BufferPos *pos;
+
+    for (size_t k = 0; k < cursor_num; k++) {
+        cursor = list_get(buffer->cursors, k);
+        pos = &cursor->pos;
+
+        if (!is_select) {
+            cursor->select_start.line_no = 0;
+        } else if (cursor->select_start.line_no == 0) {
+            cursor->select_start = *pos;
+        }
+
+        switch (movement) {
+            case CMV_CHAR:
+                if (direction == DIRECTION_LEFT) {
+                    bp_prev_char(pos);
+                } else if (direction == DIRECTION_RIGHT) {
+                    bp_next_char(pos);
+                }
+
+                break;
+            case CMV_LINE:
+                if (direction == DIRECTION_UP && !bp_at_first_line(pos)) {
+                    bp_reverse_to_line_col(pos, pos->line_no - 1,
+                                           pos->col_no);
+                } else if (direction == DIRECTION_DOWN &&
+                           !bp_at_last_line(pos)) {
+                    bp_advance_to_line_col(pos, pos->line_no + 1,
+                                           pos->col_no);
+                }
+
+                break;
+            case CMV_LINE_START:
+                bp_to_line_start(pos);
+                break;
+            case CMV_LINE_END:
+                bp_to_line_end(pos);
+                break;
+            default:
+                assert(!"Invalid CursorMovement");
+                break;
+        }
+    }
+
+    bf_merge_cursors(buffer);
+    bf_set_is_draw_dirty(buffer, 1);
+
+    return STATUS_SUCCESS;
+}
+
+/* Determine the edit to make at a cursor. Selected text is always
+ * deleted. Otherwise str is inserted or, when direction is set, the
+ * character before or after the cursor is deleted */
+static int bf_cursor_edit(const BufferPos *pos, const BufferPos *select_start,
+                          Direction direction, const char *str,
+                          size_t str_len, TextEdit *edit)
+{
+    edit->pos = *pos;
+    edit->delete_len = 0;
+    edit->str = str;
+    edit->str_len = str_len;
+
+    if (select_start->line_no > 0 && select_start->offset != pos->offset) {
+        edit->pos = bp_min(pos, select_start);
+        edit->delete_len = bp_max(pos, select_start).offset -
+                           edit->pos.offset;
+    } else if (direction == DIRECTION_LEFT) {
+        bp_prev_char(&edit->pos);
+        edit->delete_len = pos->offset - edit->pos.offset;
+    } else if (direction == DIRECTION_RIGHT) {
+        BufferPos next = *pos;
+        bp_next_char(&next);
+        edit->delete_len = next.offset - pos->offset;
+    }
+
+    return edit->delete_len > 0 || edit->str_len > 0;
+}
+
+static int bf_text_edit_comparator(const void *v1, const void *v2)
+{
+    const TextEdit *edit1 = v1;
+    const TextEdit *edit2 = v2;
+
+    return (edit1->pos.offset > edit2->pos.offset) -
+           (edit1->pos.offset < edit2->pos.offset);
+}
+
+/* Perform the same edit at every cursor as a single change */
+static Status bf_cursors_edit(Buffer *buffer, Direction direction,
+                              const char *str, size_t str_len)
+{
+    TR_SPAN("bf_cursors_edit");
+
+    size_t cursor_num = list_size(buffer->cursors);
+    TextEdit *edits = malloc((cursor_num + 1) * sizeof(TextEdit));
+
+    if (edits == NULL) {
+        return OUT_OF_MEMORY("Unable to edit at cursors");
+    }
+
+    size_t edit_num = 0;
+
+    if (bf_cursor_edit(&buffer->pos, &buffer->select_start, direction,
+                       str, str_len, &edits[edit_num])) {
+        edit_num++;
+    }
+
+    Cursor *cursor;
+
+    for (size_t k = 0; k < cursor_num; k++) {
+        cursor = list_get(buffer->cursors, k);
+
+        if (bf_cursor_edit(&cursor->pos, &cursor->select_start, direction,
+                           str, str_len, &edits[edit_num])) {
+            edit_num++;
+        }
+    }
+
+    qsort(edits, edit_num, sizeof(TextEdit), bf_text_edit_comparator);
+
+    /* Selections can overlap, in which case the edits are combined */
+    size_t kept = 0;
+    TextEdit *prev;
+    size_t end;
+
+    for (size_t k = 0; k < edit_num; k++) {
+        if (kept > 0) {
+            prev = &edits[kept - 1];
+            end = prev->pos.offset + prev->delete_len;
+
+            if (edits[k].pos.offset < end) {
+                end = MAX(end, edits[k].pos.offset + edits[k].delete_len);
+                prev->delete_len = end - prev->pos.offset;
+                continue;
+            }
+        }
+
+        edits[kept++] = edits[k];
+    }
+
+    Status status = bf_apply_edits(buffer, edits, kept);
+    free(edits);
+
+    bf_select_reset(buffer);
+
+    for (size_t k = 0; k < cursor_num; k++) {
+        cursor = list_get(buffer->cursors, k);
+        cursor->select_start.line_no = 0;
+    }
+
+    bf_merge_cursors(buffer);
+
+    return status;
+}
+
+Status bf_cursors_insert(Buffer *buffer, const char *string,
+                         size_t string_length)
+{
+    if (string == NULL) {
+        return st_get_error(ERR_INVALID_CHARACTER, "Cannot insert NULL string");
+    } else if (string_length == 0) {
+        return STATUS_SUCCESS;
+    } else if (bf_has_mask(buffer)) {
+        int input_allowed;
+        RETURN_IF_FAIL(bf_mask_allows_input(buffer, string, string_length,
+                                            &input_allowed));
+
+        if (!input_allowed) {
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return bf_cursors_edit(buffer, DIRECTION_NONE, string, string_length);
+}
+
+/* Delete the selection at each cursor or the character before
+ * (DIRECTION_LEFT) or after (DIRECTION_RIGHT) cursors without one */
+Status bf_cursors_delete(Buffer *buffer, Direction direction)
+{
+    return bf_cursors_edit(buffer, direction, NULL, 0);
+}
+
+/* Switch between linear and block selection. A block selection is
+ * started at the cursor if no text is currently selected */
+Status bf_toggle_block_select(Buffer *buffer)
+{
+    if (buffer->block_select) {
+        buffer->block_select = 0;
+    } else {
+        bf_clear_cursors(buffer);
+        bf_select_continue(buffer);
+        buffer->block_select = 1;
+    }
+
+    bf_set_is_draw_dirty(buffer, 1);
+
+    return STATUS_SUCCESS;
+}
+
+int bf_block_selected(const Buffer *buffer)
+{
+    return buffer->block_select && bf_selection_started(buffer);
+}
+
+/* The block spanned by the cursor and the selection start. A block can
+ * have zero width, in which case it marks a column on each of its lines */
+int bf_get_block(const Buffer *buffer, Block *block)
+{
+    if (!bf_block_selected(buffer)) {
+        return 0;
+    }
+
+    const BufferPos *pos = &buffer->pos;
+    const BufferPos *select_start = &buffer->select_start;
+
+    block->start_line = MIN(pos->line_no, select_start->line_no);
+    block->end_line = MAX(pos->line_no, select_start->line_no);
+    block->start_col = MIN(pos->col_no, select_start->col_no);
+    block->end_col = MAX(pos->col_no, select_start->col_no);
+
+    return 1;
+}
+
+/* Index the part of each line that lies within a block. The lines are
+ * visited in a single pass from the first line of the block, scanning
+ * each line only as far as the end of the block */
+Status bf_get_block_lines(const Buffer *buffer, const Block *block,
+                          BlockLine **lines_ptr, size_t *line_num_ptr)
+{
+    assert(block->start_line <= block->end_line);
+    assert(block->start_col <= block->end_col);
+
+    size_t line_num = block->end_line - block->start_line + 1;
+    BlockLine *lines = malloc(line_num * sizeof(BlockLine));
+
+    if (lines == NULL) {
+        return OUT_OF_MEMORY("Unable to index block lines");
+    }
+
+    BufferPos pos = bp_init_from_line_col(block->start_line, 1, &buffer->pos);
+    bp_to_line_start(&pos);
+    size_t line_index = 0;
+    BlockLine *line;
+
+    do {
+        line = &lines[line_index++];
+
+        bp_advance_to_col(&pos, block->start_col);
+        line->start = pos;
+        line->pad = 0;
+
+        if (pos.col_no < block->start_col) {
+            line->pad = block->start_col - pos.col_no;
+        }
+
+        bp_advance_to_col(&pos, block->end_col);
+        line->len = pos.offset - line->start.offset;
+    } while (line_index < line_num && bp_next_line(&pos));
+
+    *lines_ptr = lines;
+    *line_num_ptr = line_index;
+
+    return STATUS_SUCCESS;
+}
+
+static Status bf_copy_block(Buffer *buffer, TextSelection *text_selection)
+{
+    Block block;
+
+    if (!bf_get_block(buffer, &block) || block.start_col == block.end_col) {
+        return STATUS_SUCCESS;
+    }
+
+    BlockLine *lines;
+    size_t line_num;
+
+    RETURN_IF_FAIL(bf_get_block_lines(buffer, &block, &lines, &line_num));
+
+    const char *new_line = bf_new_line_str(buffer->file_format);
+    size_t new_line_len = strlen(new_line);
+    size_t str_len = (line_num - 1) * new_line_len;
+
+    for (size_t k = 0; k < line_num; k++) {
+        str_len += lines[k].len;
+    }
+
+    char *str = malloc(str_len + 1);
+
+    if (str == NULL) {
+        free(lines);
+        return OUT_OF_MEMORY("Unable to copy selected block");
+    }
+
+    char *str_iter = str;
+
+    for (size_t k = 0; k < line_num; k++) {
+        if (k > 0) {
+            memcpy(str_iter, new_line, new_line_len);
+            str_iter += new_line_len;
+        }
+
+        str_iter += gb_get_range(buffer->data, lines[k].start.offset,
+                                 str_iter, lines[k].len);
+    }
+
+    *str_iter = '\0';
+    free(lines);
+
+    text_selection->str = str;
+    text_selection->str_len = str_len;
+    text_selection->file_format = buffer->file_format;
+    text_selection->is_block = 1;
+
+    return STATUS_SUCCESS;
+}
+
+/* Apply the same edit to every line of the block as a single change.
+ * Lines that don't reach the block are left unchanged. A block with
+ * width has its contents replaced by str. A zero width block has str
+ * inserted at its column or, when str is empty, has the character before
+ * (DIRECTION_LEFT) or after (DIRECTION_RIGHT) its column deleted */
+static Status bf_edit_block(Buffer *buffer, Direction direction,
+                            const char *str, size_t str_len)
+{
+    Block block;
+
+    if (!bf_get_block(buffer, &block)) {
+        return STATUS_SUCCESS;
+    }
+
+    BlockLine *lines;
+    size_t line_num;
+
+    RETURN_IF_FAIL(bf_get_block_lines(buffer, &block, &lines, &line_num));
+
+    TextEdit *edits = malloc(line_num * sizeof(TextEdit));
+
+    if (edits == NULL) {
+        free(lines);
+        return OUT_OF_MEMORY("Unable to edit block");
+    }
+
+    int has_width = block.start_col < block.end_col;
+    size_t edit_num = 0;
+    const BlockLine *line;
+    TextEdit *edit;
+    CharInfo char_info;
+
+    for (size_t k = 0; k < line_num; k++) {
+        line = &lines[k];
+        edit = &edits[edit_num];
+
+        if (line->pad > 0) {
+            continue;
+        }
+
+        *edit = (TextEdit) {
+            .pos = line->start,
+            .delete_len = line->len,
+            .str = str,
+            .str_len = str_len
+        };
+
+        if (has_width || str_len > 0) {
+            if (edit->delete_len == 0 && str_len == 0) {
+                continue;
+            }
+        } else if (direction == DIRECTION_LEFT) {
+            if (bp_at_line_start(&line->start)) {
+                continue;
+            }
+
+            bp_prev_char(&edit->pos);
+            edit->delete_len = line->start.offset - edit->pos.offset;
+        } else if (direction == DIRECTION_RIGHT) {
+            if (bp_at_line_end(&line->start)) {
+                continue;
+            }
+
+            en_utf8_char_info(&char_info, CIP_DEFAULT, &line->start,
+                              buffer->config);
+            edit->delete_len = char_info.byte_length;
+        } else {
+            continue;
+        }
+
+        edit_num++;
+    }
+
+    Status status = bf_apply_edits(buffer, edits, edit_num);
+
+    free(edits);
+    free(lines);
+
+    return status;
+}
+
+/* Replace the contents of the selected block on each line with string.
+ * Typing into a zero width block inserts text at its column on every line */
+Status bf_block_insert(Buffer *buffer, const char *string,
+                       size_t string_length)
+{
+    if (string == NULL) {
+        return st_get_error(ERR_INVALID_CHARACTER, "Cannot insert NULL string");
+    } else if (string_length == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    return bf_edit_block(buffer, DIRECTION_NONE, string, string_length);
+}
+
+/* Delete the contents of the selected block or, for a zero width block,
+ * the character before (DIRECTION_LEFT) or after (DIRECTION_RIGHT) its
+ * column on each line */
+Status bf_block_delete(Buffer *buffer, Direction direction)
+{
+    return bf_edit_block(buffer, direction, NULL, 0);
+}
+
+/* Insert text copied from a block so that each of its lines is inserted
+ * at the cursor column on successive lines. Lines that don't reach the
+ * cursor column are padded with spaces and lines are added to the end of
+ * the buffer as required */
+static Status bf_paste_block(Buffer *buffer, const char *str, size_t str_len,
+                             int advance_cursor)
+{
+    const BufferPos start = buffer->pos;
+    const char *new_line = bf_new_line_str(buffer->file_format);
+    size_t new_line_len = strlen(new_line);
+    size_t text_line_num = bf_count_lines(str, str_len) + 1;
+
+    Block block = {
+        .start_line = start.line_no,
+        .end_line = MIN(start.line_no + text_line_num - 1,
+                        gb_lines(buffer->data) + 1),
+        .start_col = start.col_no,
+        .end_col = start.col_no
+    };
+
+    BlockLine *lines;
+    size_t line_num;
+
+    RETURN_IF_FAIL(bf_get_block_lines(buffer, &block, &lines, &line_num));
+
+    /* Each line of the buffer is padded to the cursor column at most and
+     * each added line starts with a new line and is padded to the cursor
+     * column */
+    size_t text_len = str_len + (text_line_num - line_num) *
+                                (new_line_len + start.col_no - 1);
+
+    for (size_t k = 0; k < line_num; k++) {
+        text_len += lines[k].pad;
+    }
+
+    TextEdit *edits = malloc((line_num + 1) * sizeof(TextEdit));
+    char *text = malloc(MAX(text_len, 1));
+
+    if (edits == NULL || text == NULL) {
+        free(edits);
+        free(text);
+        free(lines);
+        return OUT_OF_MEMORY("Unable to paste block");
+    }
+
+    size_t edit_num = 0;
+    char *text_iter = text;
+    const char *str_iter = str;
+    const char *str_end = str + str_len;
+    const char *line_end;
+    size_t line_len;
+
+    for (size_t k = 0; k < text_line_num; k++) {
+        line_end = memchr(str_iter, '\n', str_end - str_iter);
+
+        if (line_end == NULL) {
+            line_end = str_end;
+        }
+
+        line_len = line_end - str_iter;
+
+        if (line_len > 0 && str_iter[line_len - 1] == '\r') {
+            line_len--;
+        }
+
+        if (k < line_num) {
+            if (line_len == 0) {
+                str_iter = line_end + 1;
+                continue;
+            }
+
+            edits[edit_num++] = (TextEdit) {
+                .pos = lines[k].start,
+                .str = text_iter,
+                .str_len = lines[k].pad + line_len
+            };
+
+            memset(text_iter, ' ', lines[k].pad);
+            text_iter += lines[k].pad;
+        } else {
+            if (k == line_num) {
+                /* All remaining lines are added at the buffer end */
+                BufferPos buffer_end = lines[line_num - 1].start;
+                bp_to_line_end(&buffer_end);
+
+                edits[edit_num++] = (TextEdit) {
+                    .pos = buffer_end,
+                    .str = text_iter
+                };
+            }
+
+            memcpy(text_iter, new_line, new_line_len);
+            text_iter += new_line_len;
+            memset(text_iter, ' ', start.col_no - 1);
+            text_iter += start.col_no - 1;
+            edits[edit_num - 1].str_len += new_line_len + start.col_no - 1 +
+                                           line_len;
+        }
+
+        memcpy(text_iter, str_iter, line_len);
+        text_iter += line_len;
+        str_iter = line_end + 1;
+    }
+
+    Status status = bf_apply_edits(buffer, edits, edit_num);
+
+    if (STATUS_IS_SUCCESS(status) && !advance_cursor) {
+        status = bf_set_bp(buffer, &start, 0);
+    }
+
+    free(edits);
+    free(text);
+    free(lines);
+
+    return status;
+}
@@ -34,6 +34,8 @@
 #include "external_command.h"
 #include "syntax.h"
 #include "buffer_view.h"
+#include "large_file.h"
+#include "journal.h"
 
 /* Character classification */
 typedef enum {
@@ -57,8 +59,42 @@ typedef struct {
     FileFormat file_format;
     char *str;
     size_t str_len;
+    int is_block; /* Copied from a block selection, one line per block line */
 } TextSelection;
 
+/* An additional cursor. The primary cursor is Buffer.pos */
+typedef struct {
+    BufferPos pos; /* Cursor position */
+    BufferPos select_start; /* Start of selection. line_no = 0 if none */
+} Cursor;
+
+/* Movements applied to additional cursors by bf_move_cursors */
+typedef enum {
+    CMV_CHAR,
+    CMV_LINE,
+    CMV_LINE_START,
+    CMV_LINE_END
+} CursorMovement;
+
+/* A rectangular selection. Columns are screen columns, as in
+ * BufferPos.col_no, so tabs and wide characters are accounted for */
+typedef struct {
+    size_t start_line; /* First line of the block */
+    size_t end_line; /* Last line of the block */
+    size_t start_col; /* First column in the block */
+    size_t end_col; /* Column after the last column in the block */
+} Block;
+
+/* The part of a single line that lies within a Block. A character is
+ * within a block if the column it starts in is */
+typedef struct {
+    BufferPos start; /* Start of the block on this line, or the line end
+                        if the line doesn't reach the block */
+    size_t len; /* Bytes within the block */
+    size_t pad; /* Columns between the line end and the block start for
+                   lines that don't reach the block */
+} BlockLine;
+
 typedef struct Buffer Buffer;
 
 /* The in memory representation of a file */
@@ -68,7 +104,7 @@ struct Buffer {
     BufferPos select_start; /* Starting position of selected text */
     Buffer *next; /* Next buffer in this session */
     size_t line_col_offset; /* Global cursor line offset */
-    HashMap *config; /* Stores config variables */
+    struct Config *config; /* Stores config variables */
     BufferChangeState change_state; /* Reference to state when buffer was
                                        last written */
     int is_draw_dirty; /* Any modification performed since last draw */
@@ -79,6 +115,14 @@ struct Buffer {
     RegexInstance mask; /* Inserted text can match mask */
     HashMap *marks; /* Buffer marks */
     BufferView *bv; /* In memory display of buffer */
+    List *cursors; /* Additional cursors (Cursor *) sorted by position */
+    int block_select; /* Selection is a rectangular block */
+    LargeFile *large_file; /* Set when only a window of the file is
+                              loaded because it's too large for memory */
+    Journal *journal; /* Records changes so they can be recovered, or NULL
+                         if changes aren't journalled */
+    int is_partial; /* Lines at the start of the file have been removed
+                       from the buffer, so it can't be saved over the file */
 };
 
 /* The following two stream implementations make it possible to filter buffer
@@ -100,14 +144,27 @@ typedef struct {
     int replace_mode;
 } BufferOutputStream;
 
-Buffer *bf_new(const FileInfo *, const HashMap *config);
-Buffer *bf_new_empty(const char *, const HashMap *config);
+/* Implements an OutputStream which collects all output in its own storage
+ * rather than writing into a buffer. Once the command has finished the
+ * output can be swapped into a buffer as a single change using
+ * bf_replace_range */
+typedef struct {
+    OutputStream os;
+    GapBuffer *data;
+} TextOutputStream;
+
+Buffer *bf_new(const FileInfo *, const struct Config *config);
+Buffer *bf_new_empty(const char *, const struct Config *config);
+Buffer *bf_new_unloaded(const FileInfo *, const struct Config *config);
+Status bf_init_view(Buffer *);
+Status bf_unload(Buffer *);
 void bf_free(Buffer *);
 void bf_free_syntax_match_cache(Buffer *);
 Status bf_clear(Buffer *);
 Status bf_reset(Buffer *);
 FileFormat bf_detect_fileformat(const Buffer *);
 Status bf_load_file(Buffer *);
+Status bf_load_large_file(Buffer *, size_t chunk_size);
 Status bf_read_file(Buffer *, const FileInfo *);
 Status bf_write_file(Buffer *, const char *file_path);
 char *bf_to_string(const Buffer *);
@@ -126,6 +183,7 @@ Status bf_get_buffer_input_stream(BufferInputStream *, Buffer *, const Range *);
 Status bf_get_buffer_output_stream(BufferOutputStream *, Buffer *,
                                    const BufferPos *write_pos,
                                    int replace_mode);
+Status bf_get_text_output_stream(TextOutputStream *);
 CharacterClass bf_character_class(const Buffer *, const BufferPos *);
 FileFormat bf_get_fileformat(const Buffer *);
 int bf_determine_fileformat(const char *ff_name, FileFormat *);
@@ -159,6 +217,7 @@ Status bf_change_page(Buffer *, Direction);
 Status bf_to_buffer_start(Buffer *, int is_select);
 Status bf_to_buffer_end(Buffer *, int is_select);
 Status bf_add_new_mark(Buffer *, BufferPos *, MarkProperties);
+int bf_remove_pos_mark(Buffer *, const BufferPos *, int free);
 Status bf_insert_character(Buffer *, const char *character, int advance_cursor);
 Status bf_insert_string(Buffer *, const char *string, 
                         size_t string_length, int advance_cursor);
@@ -169,6 +228,8 @@ Status bf_delete_character(Buffer *);
 Status bf_select_continue(Buffer *);
 Status bf_select_reset(Buffer *);
 Status bf_delete_range(Buffer *, const Range *);
+Status bf_replace_range(Buffer *, const Range *, const char *string,
+                        size_t string_length);
 Status bf_select_all_text(Buffer *);
 Status bf_copy_selected_text(Buffer *, TextSelection *);
 Status bf_cut_selected_text(Buffer *, TextSelection *);
@@ -178,6 +239,8 @@ Status bf_delete_word(Buffer *);
 Status bf_delete_prev_word(Buffer *);
 Status bf_set_text(Buffer *, const char *text);
 Status bf_reset_with_text(Buffer *, const char *text);
+Status bf_append_file_text(Buffer *, const char *text, size_t text_len);
+Status bf_trim_leading_lines(Buffer *, size_t max_lines);
 Status bf_set_mask(Buffer *, const Regex *);
 int bf_has_mask(const Buffer *);
 void bf_remove_mask(Buffer *);
@@ -191,5 +254,31 @@ size_t bf_get_text(const Buffer *, const BufferPos *, char *buf,
                    size_t text_len);
 size_t bf_get_line(const Buffer *, const BufferPos *, char *buf,
                    size_t buf_len);
+Status bf_apply_edits(Buffer *, const TextEdit *, size_t edit_num);
+Status bf_apply_batch_change(Buffer *, BatchChange **);
+int bf_has_cursors(const Buffer *);
+size_t bf_cursor_num(const Buffer *);
+Status bf_add_cursor(Buffer *, const BufferPos *pos,
+                     const BufferPos *select_start);
+Status bf_add_cursor_on_line(Buffer *, Direction);
+Status bf_add_cursors_at_search_matches(Buffer *);
+void bf_clear_cursors(Buffer *);
+Status bf_move_cursors(Buffer *, CursorMovement, Direction);
+Status bf_cursors_insert(Buffer *, const char *string, size_t string_length);
+Status bf_cursors_delete(Buffer *, Direction);
+Status bf_toggle_block_select(Buffer *);
+int bf_block_selected(const Buffer *);
+int bf_get_block(const Buffer *, Block *);
+Status bf_get_block_lines(const Buffer *, const Block *, BlockLine **lines_ptr,
+                          size_t *line_num_ptr);
+Status bf_block_insert(Buffer *, const char *string, size_t string_length);
+Status bf_block_delete(Buffer *, Direction);
+int bf_is_large_file(const Buffer *);
+size_t bf_line_no_offset(const Buffer *);
+size_t bf_display_lines(const Buffer *);
+size_t bf_display_length(const Buffer *);
+Status bf_update_large_file_window(Buffer *);
+Status bf_index_large_file(Buffer *, int *index_pending);
+Status bf_large_file_find_next(Buffer *, int *found_match, int *wrapped);
 
 #endif
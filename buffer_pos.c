@@ -42,7 +42,7 @@ static NearestPos bp_determine_nearest_pos(size_t pos, size_t start,
 
 int bp_init(BufferPos *pos, const GapBuffer *data, 
             const FileFormat *file_format,
-            const HashMap *config)
+            const struct Config *config)
 {
     assert(pos != NULL);
     assert(data != NULL);
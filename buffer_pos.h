@@ -21,14 +21,13 @@
 
 #include "gap_buffer.h"
 #include "encoding.h"
-#include "hashmap.h"
 
 /* Represents position in buffer.
  * Each instance is specific to a buffer */
 struct BufferPos {
     const GapBuffer *data; /* Underlying gap buffer that stores text */
     const FileFormat *file_format; /* Reference to file format buffer uses */
-    const HashMap *config; /* Reference to buffers config */
+    const struct Config *config; /* Reference to buffers config */
     size_t offset; /* Offset into text */
     size_t line_no; /* Corresponding line number for this offset */
     size_t col_no; /* Corresponding column number for this offset */
@@ -55,7 +54,7 @@ typedef struct {
 } Range;
 
 int bp_init(BufferPos *, const GapBuffer *, const FileFormat *,
-            const HashMap *config);
+            const struct Config *config);
 Mark *bp_new_mark(BufferPos *, MarkProperties);
 void bp_free_mark(Mark *);
 char bp_get_char(const BufferPos *);
@@ -24,6 +24,7 @@
 #include "buffer.h"
 #include "config.h"
 #include "util.h"
+#include "trace.h"
 
 #define SYNTAX_LOOK_AHEAD_LINES 10
 
@@ -43,6 +44,9 @@ static void bv_clear_view(BufferView *);
 static void bv_populate_syntax_data(const Session *, Buffer *);
 static void bv_populate_search_match_data(Buffer *);
 static void bv_populate_selection_data(Buffer *);
+static void bv_populate_block_selection_data(Buffer *, const Block *);
+static void bv_populate_additional_cursor_data(Buffer *);
+static size_t bv_cursor_end_offset(const Cursor *);
 static void bv_populate_colorcolumn_data(Buffer *);
 static void bv_populate_cursor_data(Buffer *);
 
@@ -104,6 +108,8 @@ void bv_free(BufferView *bv)
 
 void bv_update_view(const Session *sess, Buffer *buffer)
 {
+    TR_SPAN("bv_update_view");
+
     int line_wrap = cf_bool(buffer->config, CV_LINEWRAP);
     int scrolled;
 
@@ -114,13 +120,20 @@ void bv_update_view(const Session *sess, Buffer *buffer)
         scrolled |= bv_horizontal_scroll(buffer);
     }
 
-    if (bf_is_draw_dirty(buffer) || scrolled || buffer->bv->resized) {
+    /* Setting a session level variable doesn't mark each buffer as
+     * dirty, so the config version is checked as well */
+    size_t config_version = cf_version(buffer->config);
+
+    if (bf_is_draw_dirty(buffer) || scrolled || buffer->bv->resized ||
+        config_version != buffer->bv->config_version) {
         bv_populate_buffer_data(buffer);
         bv_populate_syntax_data(sess, buffer);
+        buffer->bv->config_version = config_version;
     }
 
     bv_populate_search_match_data(buffer);
     bv_populate_selection_data(buffer);
+    bv_populate_additional_cursor_data(buffer);
     bv_populate_colorcolumn_data(buffer);
     bv_populate_cursor_data(buffer);
 }
@@ -302,6 +315,8 @@ static SyntaxMatches *bv_get_syntax_matches(const Session *sess,
                                             Buffer *buffer,
                                             const BufferPos *draw_pos)
 {
+    TR_SPAN("bv_get_syntax_matches");
+
     const SyntaxDefinition *syn_def = se_get_syntax_def(sess, buffer);
 
     if (syn_def == NULL) {
@@ -400,6 +415,21 @@ void bv_free_syntax_match_cache(BufferView *bv)
     bv->syn_match_cache.syn_matches = NULL;
 }
 
+size_t bv_memory_usage(const BufferView *bv)
+{
+    return sizeof(BufferView) + bv->rows_allocated * sizeof(Line) +
+           bv->rows_allocated * bv->cols_allocated * sizeof(Cell);
+}
+
+size_t bv_syntax_match_cache_memory_usage(const BufferView *bv)
+{
+    if (bv->syn_match_cache.syn_matches == NULL) {
+        return 0;
+    }
+
+    return sizeof(SyntaxMatches);
+}
+
 static void bv_set_cell(Cell *cell, size_t offset, size_t col_no,
                         size_t col_width, CellAttribute attr,
                         const char *fmt, ...)
@@ -421,6 +451,8 @@ static void bv_set_cell(Cell *cell, size_t offset, size_t col_no,
 
 static void bv_populate_buffer_data(const Buffer *buffer)
 {
+    TR_SPAN("bv_populate_buffer_data");
+
     BufferView *bv = buffer->bv;
     int line_wrap = cf_bool(buffer->config, CV_LINEWRAP);
     BufferPos draw_pos = bv->screen_start;
@@ -716,8 +748,12 @@ static void bv_populate_search_match_data(Buffer *buffer)
 static void bv_populate_selection_data(Buffer *buffer)
 {
     Range select_range;
+    Block block;
 
-    if (!bf_get_range(buffer, &select_range)) {
+    if (bf_get_block(buffer, &block)) {
+        bv_populate_block_selection_data(buffer, &block);
+        return;
+    } else if (!bf_get_range(buffer, &select_range)) {
         return;
     }
 
@@ -742,6 +778,108 @@ static void bv_populate_selection_data(Buffer *buffer)
     }
 }
 
+static void bv_populate_block_selection_data(Buffer *buffer,
+                                             const Block *block)
+{
+    BufferView *bv = buffer->bv;
+    /* Wrapped lines have a line_no of 0 */
+    size_t line_no = bv->screen_start.line_no;
+    Line *line;
+    Cell *cell;
+
+    for (size_t row = 0; row < bv->rows_drawn; row++) {
+        line = &bv->lines[row];
+
+        if (line->line_no != 0) {
+            line_no = line->line_no;
+        }
+
+        if (line_no < block->start_line) {
+            continue;
+        } else if (line_no > block->end_line) {
+            break;
+        }
+
+        for (size_t col = 0; col < bv->cols; col++) {
+            cell = &line->cells[col]; 
+
+            if (cell->text_len == 0) {
+                continue;
+            }
+
+            if (cell->col_no >= block->start_col &&
+                cell->col_no < block->end_col) {
+                cell->attr |= CA_SELECTION;
+            }
+        }
+    }
+}
+
+/* Cursors are sorted by position and their selections don't overlap, so
+ * the visible cells and the cursors can be traversed together */
+static void bv_populate_additional_cursor_data(Buffer *buffer)
+{
+    const List *cursors = buffer->cursors;
+    size_t cursor_num = list_size(cursors);
+
+    if (cursor_num == 0) {
+        return;
+    }
+
+    BufferView *bv = buffer->bv;
+    size_t cursor_index = 0;
+    const Cursor *cursor = list_get(cursors, cursor_index);
+    Range select_range;
+    Line *line;
+    Cell *cell;
+
+    for (size_t row = 0; row < bv->rows_drawn; row++) {
+        line = &bv->lines[row];
+
+        for (size_t col = 0; col < bv->cols; col++) {
+            cell = &line->cells[col]; 
+
+            if (cell->text_len == 0 || cell->offset == (size_t)-1) {
+                continue;
+            }
+
+            while (cell->offset > bv_cursor_end_offset(cursor) &&
+                   ++cursor_index < cursor_num) {
+                cursor = list_get(cursors, cursor_index);
+            }
+
+            if (cursor_index >= cursor_num) {
+                return;
+            }
+
+            if (cell->offset == cursor->pos.offset) {
+                cell->attr |= CA_ADDITIONAL_CURSOR;
+            }
+
+            if (cursor->select_start.line_no > 0) {
+                select_range.start = bp_min(&cursor->pos,
+                                            &cursor->select_start);
+                select_range.end = bp_max(&cursor->pos,
+                                          &cursor->select_start);
+
+                if (bf_offset_in_range(&select_range, cell->offset)) {
+                    cell->attr |= CA_SELECTION;
+                }
+            }
+        }
+    }
+}
+
+static size_t bv_cursor_end_offset(const Cursor *cursor)
+{
+    if (cursor->select_start.line_no > 0 &&
+        cursor->select_start.offset > cursor->pos.offset) {
+        return cursor->select_start.offset;
+    }
+
+    return cursor->pos.offset;
+}
+
 static void bv_populate_colorcolumn_data(Buffer *buffer)
 {
     const size_t color_column = cf_int(buffer->config, CV_COLORCOLUMN);
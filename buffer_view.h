@@ -44,7 +44,8 @@ typedef enum {
     CA_COLORCOLUMN = 1 << 5, /* Is on colorcolumn */
     CA_NEW_LINE = 1 << 6, /* Cell represents new line character */
     CA_LINE_END = 1 << 7, /* Empty cells after a new line */
-    CA_SEARCH_MATCH = 1 << 8 /* Regions that match the current search */
+    CA_SEARCH_MATCH = 1 << 8, /* Regions that match the current search */
+    CA_ADDITIONAL_CURSOR = 1 << 9 /* Location of an additional cursor */
 } CellAttribute;
 
 /* Structure representing each cell in a window */
@@ -95,6 +96,8 @@ typedef struct {
                                        modified since the last update */
     int resized; /* True when the display has been resized and a redraw is
                     required */
+    size_t config_version; /* Version of the buffer config when the view
+                              was last populated */
     size_t rows_drawn; /* The number of rows containing buffer content */
     size_t screen_row_offset; /* Row offset of buffer view in display window */
     size_t screen_col_offset; /* Col offset of buffer view in display window */
@@ -111,6 +114,8 @@ size_t bv_screen_col_no(const struct Buffer *, const BufferPos *);
 void bv_apply_cell_attributes(BufferView *, CellAttribute attr,
                               CellAttribute exclude_cell_attr);
 void bv_free_syntax_match_cache(BufferView *);
+size_t bv_memory_usage(const BufferView *);
+size_t bv_syntax_match_cache_memory_usage(const BufferView *);
 int bv_convert_screen_pos_to_buffer_pos(const BufferView *,
                                         size_t *row_ptr, size_t *col_ptr);
 
@@ -19,12 +19,27 @@
 #include <string.h>
 #include "clipboard.h"
 #include "external_command.h"
+#include "util.h"
 
 #define CLIPBOARD_CMD "wed-clipboard"
 #define CLIPBOARD_CMD_USABLE CLIPBOARD_CMD " --usable"
 #define CLIPBOARD_CMD_COPY   CLIPBOARD_CMD " --copy"
 #define CLIPBOARD_CMD_PASTE  CLIPBOARD_CMD " --paste"
 
+/* Allows text copied from a block selection to be written to the
+ * clipboard command */
+typedef struct {
+    InputStream is;
+    const TextSelection *text_selection;
+    size_t read_offset;
+} TextSelectionInputStream;
+
+static int cl_text_selected(Buffer *, Range *);
+static Status cl_copy_block(Buffer *);
+static Status cl_ts_input_stream_read(InputStream *, char buf[],
+                                      size_t buf_len, size_t *bytes_read);
+static Status cl_ts_input_stream_close(InputStream *);
+
 void cl_init(Clipboard *clipboard)
 {
     memset(clipboard, 0, sizeof(Clipboard));
@@ -55,12 +70,14 @@ Status cl_copy(Clipboard *clipboard, Buffer *buffer)
     Status status = STATUS_SUCCESS;
     Range range;
 
-    if (!bf_get_range(buffer, &range)) {
+    if (!cl_text_selected(buffer, &range)) {
         return status;
     }
 
     if (clipboard->type == CT_INTERNAL) {
         status = bf_copy_selected_text(buffer, &clipboard->text_selection);
+    } else if (clipboard->type == CT_EXTERNAL && bf_block_selected(buffer)) {
+        status = cl_copy_block(buffer);
     } else if (clipboard->type == CT_EXTERNAL) {
         BufferInputStream bis;
         RETURN_IF_FAIL(bf_get_buffer_input_stream(&bis, buffer, &range));
@@ -129,7 +146,7 @@ Status cl_cut(Clipboard *clipboard, Buffer *buffer)
     Status status = STATUS_SUCCESS;
     Range range;
 
-    if (!bf_get_range(buffer, &range)) {
+    if (!cl_text_selected(buffer, &range)) {
         return status;
     }
 
@@ -138,7 +155,11 @@ Status cl_cut(Clipboard *clipboard, Buffer *buffer)
     } else if (clipboard->type == CT_EXTERNAL) {
         status = cl_copy(clipboard, buffer);
 
-        if (STATUS_IS_SUCCESS(status)) {
+        if (!STATUS_IS_SUCCESS(status)) {
+            return status;
+        } else if (bf_block_selected(buffer)) {
+            status = bf_block_delete(buffer, DIRECTION_NONE);
+        } else {
             status = bf_delete_range(buffer, &range); 
         }
     }
@@ -146,3 +167,65 @@ Status cl_cut(Clipboard *clipboard, Buffer *buffer)
     return status;
 }
 
+/* A zero width block has nothing to copy */
+static int cl_text_selected(Buffer *buffer, Range *range)
+{
+    Block block;
+
+    if (bf_get_block(buffer, &block)) {
+        return block.start_col < block.end_col;
+    }
+
+    return bf_get_range(buffer, range);
+}
+
+/* The system clipboard only stores text, so a block copied to it is
+ * pasted back as regular text */
+static Status cl_copy_block(Buffer *buffer)
+{
+    TextSelection text_selection;
+    RETURN_IF_FAIL(bf_copy_selected_text(buffer, &text_selection));
+
+    TextSelectionInputStream tsis = {
+        .is = {
+            .read = cl_ts_input_stream_read,
+            .close = cl_ts_input_stream_close
+        },
+        .text_selection = &text_selection
+    };
+
+    int cmd_status;
+    Status status = ec_run_command(CLIPBOARD_CMD_COPY, (InputStream *)&tsis,
+                                   NULL, NULL, &cmd_status);
+
+    bf_free_textselection(&text_selection);
+    RETURN_IF_FAIL(status);
+
+    if (!ec_cmd_successfull(cmd_status)) {
+        status = st_get_error(ERR_CLIPBOARD_ERROR,
+                              "Unable to copy to system clipboard");
+    }
+
+    return status;
+}
+
+static Status cl_ts_input_stream_read(InputStream *is, char buf[],
+                                      size_t buf_len, size_t *bytes_read)
+{
+    TextSelectionInputStream *tsis = (TextSelectionInputStream *)is;
+    const TextSelection *text_selection = tsis->text_selection;
+    size_t remaining = text_selection->str_len - tsis->read_offset;
+
+    *bytes_read = MIN(buf_len, remaining);
+    memcpy(buf, text_selection->str + tsis->read_offset, *bytes_read);
+    tsis->read_offset += *bytes_read;
+
+    return STATUS_SUCCESS;
+}
+
+static Status cl_ts_input_stream_close(InputStream *is)
+{
+    (void)is;
+    return STATUS_SUCCESS;
+}
+
@@ -35,6 +35,18 @@
 #include "search.h"
 #include "replace.h"
 #include "prompt_completer.h"
+#include "trace.h"
+#include "memory_info.h"
+#include "macro.h"
+
+/* Whilst a pattern is entered into the find prompt the buffer is searched
+ * in chunks of INCREMENTAL_SEARCH_CHUNK_SIZE bytes for a time slice of at
+ * most INCREMENTAL_SEARCH_SLICE_NS nano seconds before input is checked */
+#define INCREMENTAL_SEARCH_CHUNK_SIZE (64 * 1024)
+#define INCREMENTAL_SEARCH_SLICE_NS 5000000
+
+/* Results buffer name is truncated if the pattern is long */
+#define MAX_GREP_BUFFER_NAME_SIZE 50
 
 /* Used for Yes/No type prompt questions
  * e.g. Do you want to save file? */
@@ -54,6 +66,14 @@ static KeyMapping *cm_new_key_mapping(KeyMappingType, const char *key,
                                       Operation, const char *keystr);
 static void cm_free_key_mapping(KeyMapping *);
 static Status cm_run_command(const CommandDefinition *, CommandArgs *);
+static const KeyMapping *cm_find_key_mapping(const KeyMap *, const char *key);
+static Status cm_run_operation(Session *, Operation, const char *key,
+                               int *finished);
+static Status cm_insert_key(Session *, const char *key);
+static Status cm_record_operation(Session *, Operation, const char *key);
+static Status cm_record_key(Session *, const char *key);
+static void cm_build_frozen_map(KeyMap *);
+static void cm_invalidate_frozen_maps(KeyMap *);
 static const char *cm_get_op_mode_str(OperationMode);
 static Status cm_file_output_stream_write(OutputStream *, const char buf[],
                                           size_t buf_len,
@@ -99,6 +119,11 @@ static void cm_generate_find_prompt(const BufferSearch *,
                                     char prompt_text[MAX_CMD_PROMPT_LENGTH]);
 static Status cm_prepare_search(Session *, const BufferPos *start_pos,
                                 int allow_find_all, int select_last_entry);
+static Status cm_process_search_pattern(const Buffer *, char **pattern_ptr,
+                                        size_t *pattern_len);
+static Status cm_continue_incremental_search(BufferSearch *);
+static void cm_get_visible_region(const Buffer *, BufferPos *visible_start,
+                                  BufferPos *visible_end);
 static Status cm_buffer_find(const CommandArgs *);
 static Status cm_buffer_find_next(const CommandArgs *);
 static Status cm_buffer_toggle_search_direction(const CommandArgs *);
@@ -143,6 +168,32 @@ static Status cm_buffer_filter(const CommandArgs *);
 static Status cm_buffer_read(const CommandArgs *);
 static Status cm_session_write(const CommandArgs *);
 static Status cm_session_exec(const CommandArgs *);
+static Status cm_session_jobs(const CommandArgs *);
+static Status cm_session_kill_job(const CommandArgs *);
+static Status cm_session_grep(const CommandArgs *);
+static Status cm_session_file_search_select(const CommandArgs *);
+static Status cm_session_find_file(const CommandArgs *);
+static Status cm_buffer_insert_pasted_text(const CommandArgs *);
+static char *cm_convert_new_lines(const char *text, size_t *text_len,
+                                  const char *new_line);
+static Status cm_session_trace(const CommandArgs *);
+static Status cm_session_trace_dump(const CommandArgs *);
+static Status cm_session_meminfo(const CommandArgs *);
+static Status cm_session_memcompact(const CommandArgs *);
+static Status cm_buffer_add_cursor_on_line(const CommandArgs *);
+static Status cm_buffer_add_cursors_at_matches(const CommandArgs *);
+static Status cm_buffer_clear_cursors(const CommandArgs *);
+static Status cm_buffer_toggle_block_select(const CommandArgs *);
+static Status cm_session_follow(const CommandArgs *);
+static Status cm_session_record_macro(const CommandArgs *);
+static Status cm_buffer_play_macro(const CommandArgs *);
+static Status cm_play_macro(Session *, int *finished);
+static Status cm_play_macro_on_lines(Session *, Buffer *, int *finished,
+                                     size_t *play_num);
+static Status cm_play_macro_at_matches(Session *, Buffer *, int *finished,
+                                       size_t *play_num);
+static Status cm_run_macro_steps(Session *, int *finished);
+static int cm_macro_has_command(const Macro *, Command);
 
 /* Allow the following to exceed 80 columns.
  * This format is easier to read and maipulate in visual block mode in vim */
@@ -213,7 +264,24 @@ static const CommandDefinition cm_commands[] = {
     [CMD_BUFFER_FILTER]                       = { "filter", cm_buffer_filter                      , CMDSIG(1, VAL_TYPE_SHELL_COMMAND)    , CMDT_BUFFER_MOD,  CP_NONE, "shell command CMD", "Filter buffer through shell command" },
     [CMD_BUFFER_READ]                         = { "read"  , cm_buffer_read                        , CMDSIG(1, VAL_TYPE_STR | VAL_TYPE_SHELL_COMMAND), CMDT_BUFFER_MOD, CP_NONE, "shell command CMD or string FILE", "Read command output or file content into buffer" },
     [CMD_BUFFER_WRITE]                        = { "write" , cm_session_write                      , CMDSIG(1, VAL_TYPE_STR | VAL_TYPE_SHELL_COMMAND), CMDT_SESS_MOD, CP_NONE, "shell command CMD or string FILE", "Write buffer content to command or file" },
-    [CMD_SESSION_EXEC]                        = { "exec"  , cm_session_exec                       , CMDSIG(1, VAL_TYPE_SHELL_COMMAND), CMDT_SESS_MOD, CP_NONE, "shell command CMD", "Run shell command" }
+    [CMD_SESSION_EXEC]                        = { "exec"  , cm_session_exec                       , CMDSIG(1, VAL_TYPE_SHELL_COMMAND), CMDT_SESS_MOD, CP_NONE, "shell command CMD", "Run shell command" },
+    [CMD_SESSION_JOBS]                        = { "jobs"  , cm_session_jobs                       , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, "none", "List shell commands running in the background" },
+    [CMD_SESSION_KILL_JOB]                    = { "kill"  , cm_session_kill_job                   , CMDSIG(1, VAL_TYPE_INT)              , CMDT_SESS_MOD,    CP_NONE, "int JOB", "Terminate a background shell command" },
+    [CMD_SESSION_GREP]                        = { "grep"  , cm_session_grep                       , CMDSIG(1, VAL_TYPE_STR | VAL_TYPE_REGEX), CMDT_SESS_MOD, CP_NONE, "string|regex PATTERN", "Search files under the current directory" },
+    [CMD_SESSION_FILE_SEARCH_SELECT]          = { NULL    , cm_session_file_search_select         , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, NULL, NULL },
+    [CMD_SESSION_FIND_FILE]                   = { NULL    , cm_session_find_file                  , CMDSIG_NO_ARGS                       , CMDT_CMD_INPUT,   CP_NONE, NULL, NULL },
+    [CMD_BUFFER_INSERT_PASTED_TEXT]           = { NULL    , cm_buffer_insert_pasted_text          , CMDSIG_NO_ARGS                       , CMDT_NOP,         CP_NONE, NULL, NULL },
+    [CMD_SESSION_TRACE]                       = { "trace" , cm_session_trace                      , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, "none", "Toggle display of frame times in the status bar" },
+    [CMD_SESSION_TRACE_DUMP]                  = { "tracedump", cm_session_trace_dump             , CMDSIG(1, VAL_TYPE_STR)              , CMDT_SESS_MOD,    CP_NONE, "string FILE", "Write recent trace spans to FILE in Chrome trace format" },
+    [CMD_SESSION_MEMINFO]                     = { "meminfo", cm_session_meminfo                   , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, "none", "Display memory used by buffers and the session" },
+    [CMD_SESSION_MEMCOMPACT]                  = { "memcompact", cm_session_memcompact             , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, "none", "Shrink buffer gaps and free cached syntax matches" },
+    [CMD_BUFFER_ADD_CURSOR_ON_LINE]           = { NULL    , cm_buffer_add_cursor_on_line          , CMDSIG(1, VAL_TYPE_INT)              , CMDT_BUFFER_MOVE, CP_NONE, NULL, NULL },
+    [CMD_BUFFER_ADD_CURSORS_AT_MATCHES]       = { NULL    , cm_buffer_add_cursors_at_matches      , CMDSIG_NO_ARGS                       , CMDT_BUFFER_MOVE, CP_NONE, NULL, NULL },
+    [CMD_BUFFER_CLEAR_CURSORS]                = { NULL    , cm_buffer_clear_cursors               , CMDSIG_NO_ARGS                       , CMDT_BUFFER_MOVE, CP_NONE, NULL, NULL },
+    [CMD_BUFFER_TOGGLE_BLOCK_SELECT]          = { NULL    , cm_buffer_toggle_block_select         , CMDSIG_NO_ARGS                       , CMDT_BUFFER_MOVE, CP_NONE, NULL, NULL },
+    [CMD_SESSION_FOLLOW]                      = { "follow", cm_session_follow                     , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, "none", "Toggle adding text appended to the file to the buffer" },
+    [CMD_SESSION_RECORD_MACRO]                = { NULL    , cm_session_record_macro               , CMDSIG_NO_ARGS                       , CMDT_SESS_MOD,    CP_NONE, NULL, NULL },
+    [CMD_BUFFER_PLAY_MACRO]                   = { NULL    , cm_buffer_play_macro                  , CMDSIG(1, VAL_TYPE_INT)              , CMDT_SESS_MOD,    CP_NONE, NULL, NULL }
 };
 
 static const OperationDefinition cm_operations[] = {
@@ -310,7 +378,19 @@ static const OperationDefinition cm_operations[] = {
     [OP_FILE_EXPLORER_SELECT] = { "<wed-file-explorer-select>", OM_FILE_EXPLORER, CMD_NO_ARGS, 0, CMD_SESSION_FILE_EXPLORER_SELECT, "Open the selected file or navigate into the selected directory" },
     [OP_FILE_EXPLORER_QUIT] = { "<wed-file-explorer-quit>", OM_FILE_EXPLORER, CMD_NO_ARGS, 0, CMD_SESSION_FILE_EXPLORER_TOGGLE_ACTIVE, "Return to the last active buffer" },
     [OP_FILE_EXPLORER_EXIT_WED] = { "<wed-file-explorer-exit-wed>", OM_FILE_EXPLORER, CMD_NO_ARGS, 0, CMD_SESSION_END, "Exit" },
-    [OP_FILE_EXPLORER_CLICK_SELECT] = { "<wed-file-explorer-mouse-click>", OM_SESSION, CMD_NO_ARGS, 0, CMD_SESSION_FILE_EXPLORER_CLICK, "Selected a file or directory" }
+    [OP_FILE_EXPLORER_CLICK_SELECT] = { "<wed-file-explorer-mouse-click>", OM_SESSION, CMD_NO_ARGS, 0, CMD_SESSION_FILE_EXPLORER_CLICK, "Selected a file or directory" },
+    [OP_FILE_SEARCH_SELECT] = { "<wed-file-search-select>", OM_FILE_SEARCH, CMD_NO_ARGS, 0, CMD_SESSION_FILE_SEARCH_SELECT, "Open the file containing the selected match" },
+    [OP_FIND_FILE] = { "<wed-find-file>", OM_BUFFER, CMD_NO_ARGS, 0, CMD_SESSION_FIND_FILE, "Find file by name" },
+    [OP_INSERT_PASTED_TEXT] = { "<wed-bracketed-paste>", OM_SESSION, CMD_NO_ARGS, 0, CMD_BUFFER_INSERT_PASTED_TEXT, "Insert text pasted into the terminal" },
+    [OP_ADD_CURSOR_PREV_LINE] = { "<wed-add-cursor-prev-line>", OM_BUFFER, { INT_VAL_STRUCT(DIRECTION_UP) }, 1, CMD_BUFFER_ADD_CURSOR_ON_LINE, "Add a cursor on the line above" },
+    [OP_ADD_CURSOR_NEXT_LINE] = { "<wed-add-cursor-next-line>", OM_BUFFER, { INT_VAL_STRUCT(DIRECTION_DOWN) }, 1, CMD_BUFFER_ADD_CURSOR_ON_LINE, "Add a cursor on the line below" },
+    [OP_ADD_CURSORS_AT_MATCHES] = { "<wed-add-cursors-at-matches>", OM_BUFFER, CMD_NO_ARGS, 0, CMD_BUFFER_ADD_CURSORS_AT_MATCHES, "Add a cursor at each match of the last search" },
+    [OP_CLEAR_CURSORS] = { "<wed-clear-cursors>", OM_BUFFER, CMD_NO_ARGS, 0, CMD_BUFFER_CLEAR_CURSORS, "Remove additional cursors" },
+    [OP_TOGGLE_BLOCK_SELECT] = { "<wed-toggle-block-select>", OM_BUFFER, CMD_NO_ARGS, 0, CMD_BUFFER_TOGGLE_BLOCK_SELECT, "Toggle block selection" },
+    [OP_RECORD_MACRO] = { "<wed-record-macro>", OM_BUFFER, CMD_NO_ARGS, 0, CMD_SESSION_RECORD_MACRO, "Start or stop recording a macro" },
+    [OP_PLAY_MACRO] = { "<wed-play-macro>", OM_BUFFER, { INT_VAL_STRUCT(MT_CURSOR) }, 1, CMD_BUFFER_PLAY_MACRO, "Play the recorded macro" },
+    [OP_PLAY_MACRO_ON_LINES] = { "<wed-play-macro-on-lines>", OM_BUFFER, { INT_VAL_STRUCT(MT_LINES) }, 1, CMD_BUFFER_PLAY_MACRO, "Play the recorded macro on each (selected) line" },
+    [OP_PLAY_MACRO_AT_MATCHES] = { "<wed-play-macro-at-matches>", OM_BUFFER, { INT_VAL_STRUCT(MT_MATCHES) }, 1, CMD_BUFFER_PLAY_MACRO, "Play the recorded macro at each match of the last search" }
 };
 
 /* Default wed keybindings */
@@ -370,6 +450,15 @@ static const KeyMapping cm_key_mappings[] = {
     { KMT_OPERATION, "<M-C-Down>",    { OP_MOVE_LINES_DOWN                  } },
     { KMT_OPERATION, "<C-d>",         { OP_DUPLICATE                        } },
     { KMT_OPERATION, "<C-j>",         { OP_JOIN_LINES                       } },
+    { KMT_OPERATION, "<M-S-Up>",      { OP_ADD_CURSOR_PREV_LINE             } },
+    { KMT_OPERATION, "<M-S-Down>",    { OP_ADD_CURSOR_NEXT_LINE             } },
+    { KMT_OPERATION, "<M-a>",         { OP_ADD_CURSORS_AT_MATCHES           } },
+    { KMT_OPERATION, "<M-k>",         { OP_CLEAR_CURSORS                    } },
+    { KMT_OPERATION, "<M-b>",         { OP_TOGGLE_BLOCK_SELECT              } },
+    { KMT_OPERATION, "<M-r>",         { OP_RECORD_MACRO                     } },
+    { KMT_OPERATION, "<M-p>",         { OP_PLAY_MACRO                       } },
+    { KMT_OPERATION, "<M-l>",         { OP_PLAY_MACRO_ON_LINES              } },
+    { KMT_OPERATION, "<M-m>",         { OP_PLAY_MACRO_AT_MATCHES            } },
     { KMT_OPERATION, "<C-s>",         { OP_SAVE                             } },
     { KMT_OPERATION, "<M-C-s>",       { OP_SAVE_AS                          } },
     { KMT_OPERATION, "<C-f>",         { OP_FIND                             } },
@@ -377,6 +466,7 @@ static const KeyMapping cm_key_mappings[] = {
     { KMT_OPERATION, "<C-r>",         { OP_FIND_REPLACE                     } },
     { KMT_OPERATION, "<C-g>",         { OP_GOTO_LINE                        } },
     { KMT_OPERATION, "<C-o>",         { OP_OPEN                             } },
+    { KMT_OPERATION, "<C-p>",         { OP_FIND_FILE                        } },
     { KMT_OPERATION, "<C-n>",         { OP_NEW                              } },
     { KMT_OPERATION, "<M-C-Right>",   { OP_NEXT_BUFFER                      } },
     { KMT_OPERATION, "<M-Right>",     { OP_NEXT_BUFFER                      } },
@@ -408,7 +498,8 @@ static const KeyMapping cm_key_mappings[] = {
     { KMT_OPERATION, "<C-f>",         { OP_FILE_EXPLORER_FIND               } },
     { KMT_OPERATION, "<Enter>",       { OP_FILE_EXPLORER_SELECT             } },
     { KMT_OPERATION, "<C-t>",         { OP_FILE_EXPLORER_QUIT               } },
-    { KMT_OPERATION, "<Escape>",      { OP_FILE_EXPLORER_EXIT_WED           } }
+    { KMT_OPERATION, "<Escape>",      { OP_FILE_EXPLORER_EXIT_WED           } },
+    { KMT_OPERATION, "<Enter>",       { OP_FILE_SEARCH_SELECT               } }
 };
 
 /* Map key presses to operations. User input can be used to look
@@ -483,6 +574,7 @@ void cm_free_key_map(KeyMap *key_map)
     for (size_t k = 0; k < OM_ENTRY_NUM; k++) {
         rt_free_including_entries(key_map->maps[k],
                                   (FreeFunction)cm_free_key_mapping);
+        rt_free_frozen(key_map->frozen_maps[k]);
     }
 }
 
@@ -494,7 +586,8 @@ void cm_set_operation_mode(KeyMap *key_map, OperationMode op_mode)
         OMM_SESSION | OMM_BUFFER | OMM_PROMPT | OMM_USER,
         OMM_SESSION | OMM_BUFFER | OMM_PROMPT | OMM_PROMPT_COMPLETER | OMM_USER,
         OMM_USER,
-        OMM_SESSION | OMM_FILE_EXPLORER | OMM_USER
+        OMM_SESSION | OMM_FILE_EXPLORER | OMM_USER,
+        OMM_SESSION | OMM_BUFFER | OMM_USER | OMM_FILE_SEARCH
     };
 
     key_map->prev_op_mode = key_map->op_mode;
@@ -505,6 +598,40 @@ void cm_set_operation_mode(KeyMap *key_map, OperationMode op_mode)
     for (size_t k = 0; k < OM_ENTRY_NUM; k++) {
         key_map->active_op_modes[k] = (active_maps >> k) & 1;
     }
+
+    if (key_map->frozen_maps[op_mode] == NULL) {
+        cm_build_frozen_map(key_map);
+    }
+}
+
+/* Merge the maps of the active modes into a single frozen map for the
+ * current operation mode, so that a key can be resolved with one lookup.
+ * Maps are added in order of precedence. If this fails lookups fall back
+ * to searching each active map in turn */
+static void cm_build_frozen_map(KeyMap *key_map)
+{
+    const RadixTree *maps[OM_ENTRY_NUM];
+    size_t map_num = 0;
+
+    for (int k = OM_ENTRY_NUM - 1; k > -1; k--) {
+        if (key_map->active_op_modes[k]) {
+            maps[map_num++] = key_map->maps[k];
+        }
+    }
+
+    key_map->frozen_maps[key_map->op_mode] = rt_freeze(maps, map_num);
+}
+
+/* Called when a map is modified. Frozen maps for other modes are rebuilt
+ * when next entered */
+static void cm_invalidate_frozen_maps(KeyMap *key_map)
+{
+    for (size_t k = 0; k < OM_ENTRY_NUM; k++) {
+        rt_free_frozen(key_map->frozen_maps[k]);
+        key_map->frozen_maps[k] = NULL;
+    }
+
+    cm_build_frozen_map(key_map);
 }
 
 static KeyMapping *cm_new_op_key_mapping(const char *key, Operation operation)
@@ -573,34 +700,16 @@ Status cm_do_operation(Session *sess, const char *key, int *finished)
     assert(!is_null_or_empty(key));
     assert(finished != NULL);
 
-    const KeyMapping *key_mapping = NULL;
     const KeyMap *key_map = &sess->key_map;
+    const KeyMapping *key_mapping = cm_find_key_mapping(key_map, key);
     const RadixTree *map;
 
-    for (int k = OM_ENTRY_NUM - 1; k > -1; k--) {
-        if (key_map->active_op_modes[k]) {
-            map = key_map->maps[k];
-
-            if (rt_find(map, key, strlen(key), (void **)&key_mapping, NULL)) {
-                break;
-            }
-        }
-    }
-
     if (key_mapping != NULL) {
         if (key_mapping->type == KMT_OPERATION) {
-            const OperationDefinition *operation =
-                &cm_operations[key_mapping->value.op];
-            const CommandDefinition *command = &cm_commands[operation->command];
-
-            CommandArgs cmd_args;
-            cmd_args.sess = sess;
-            cmd_args.arg_num = operation->arg_num;
-            cmd_args.key = key;
-            cmd_args.finished = finished;
-            memcpy(cmd_args.args, operation->args, sizeof(operation->args));
-
-            return cm_run_command(command, &cmd_args);
+            RETURN_IF_FAIL(cm_record_operation(sess, key_mapping->value.op,
+                                               key));
+            return cm_run_operation(sess, key_mapping->value.op, key,
+                                    finished);
         } else if (key_mapping->type == KMT_KEYSTR) {
             size_t keystr_len = strlen(key_mapping->value.keystr);
             return ip_add_keystr_input_to_start(&sess->input_buffer,
@@ -612,7 +721,8 @@ Status cm_do_operation(Session *sess, const char *key, int *finished)
     if (!(key[0] == '<' && key[1] != '\0') &&
         !se_command_type_excluded(sess, CMDT_BUFFER_MOD)) {
         /* Just a normal letter character so insert it into buffer */
-        return bf_insert_character(sess->active_buffer, key, 1);
+        RETURN_IF_FAIL(cm_record_key(sess, key));
+        return cm_insert_key(sess, key);
     } else if (strncmp(key, "<wed-", 5) == 0 && key_mapping == NULL) {
         /* An invalid operation was specified */
         for (int k = OM_ENTRY_NUM - 1; k > -1; k--) {
@@ -632,6 +742,189 @@ Status cm_do_operation(Session *sess, const char *key, int *finished)
     return STATUS_SUCCESS;
 }
 
+static Status cm_run_operation(Session *sess, Operation op, const char *key,
+                               int *finished)
+{
+    const OperationDefinition *operation = &cm_operations[op];
+    const CommandDefinition *command = &cm_commands[operation->command];
+
+    CommandArgs cmd_args;
+    cmd_args.sess = sess;
+    cmd_args.arg_num = operation->arg_num;
+    cmd_args.key = key;
+    cmd_args.finished = finished;
+    memcpy(cmd_args.args, operation->args, sizeof(operation->args));
+
+    return cm_run_command(command, &cmd_args);
+}
+
+/* Whilst a macro is recorded each operation is added to it as it's
+ * invoked, so keys mapped to key strings are recorded as the operations
+ * they expand to. Starting, stopping and playing macros isn't recorded */
+static Status cm_record_operation(Session *sess, Operation op,
+                                  const char *key)
+{
+    if (!se_macro_recording(sess)) {
+        return STATUS_SUCCESS;
+    }
+
+    const OperationDefinition *operation = &cm_operations[op];
+
+    switch (operation->command) {
+        case CMD_SESSION_RECORD_MACRO:
+        case CMD_BUFFER_PLAY_MACRO:
+        case CMD_BUFFER_INSERT_PASTED_TEXT:
+            /* Pasted text is recorded when it's inserted */
+            return STATUS_SUCCESS;
+        case CMD_BUFFER_INSERT_CHAR:
+            {
+                const char *text = SVAL(operation->args[0]);
+
+                if (text[0] >= ' ' && text[0] <= '~' && text[1] == '\0') {
+                    /* e.g. <Space> which can be added to typed text */
+                    return mc_add_text(&sess->macro, text, 1);
+                }
+
+                break;
+            }
+        default:
+            break;
+    }
+
+    return mc_add_operation(&sess->macro, op, key);
+}
+
+/* Printable ASCII characters are added to the text typed before them, so
+ * a word typed a key at a time is played back as a single insert */
+static Status cm_record_key(Session *sess, const char *key)
+{
+    if (!se_macro_recording(sess)) {
+        return STATUS_SUCCESS;
+    }
+
+    if (key[0] >= ' ' && key[0] <= '~' && key[1] == '\0') {
+        return mc_add_text(&sess->macro, key, 1);
+    }
+
+    return mc_add_key(&sess->macro, key);
+}
+
+/* Returns the text pressing key inserts into the active buffer or NULL if
+ * key does anything else. This is either the key itself, when it isn't
+ * bound to an operation, or the character an insert operation is bound
+ * to e.g. <Space> inserts a space */
+const char *cm_get_inserted_text(const Session *sess, const char *key)
+{
+    assert(!is_null_or_empty(key));
+
+    if (se_command_type_excluded(sess, CMDT_BUFFER_MOD)) {
+        return NULL;
+    }
+
+    const KeyMapping *key_mapping = cm_find_key_mapping(&sess->key_map, key);
+
+    if (key_mapping == NULL) {
+        if (key[0] == '<' && key[1] != '\0') {
+            return NULL;
+        }
+
+        return key;
+    } else if (key_mapping->type == KMT_OPERATION && se_initialised(sess)) {
+        const OperationDefinition *operation =
+            &cm_operations[key_mapping->value.op];
+
+        if (operation->command == CMD_BUFFER_INSERT_CHAR) {
+            return SVAL(operation->args[0]);
+        }
+    }
+
+    return NULL;
+}
+
+/* Insert a key entered by the user. Tab expansion and auto indent are
+ * applied unless there are multiple cursors or a block is selected */
+static Status cm_insert_key(Session *sess, const char *key)
+{
+    Buffer *buffer = sess->active_buffer;
+
+    if (bf_has_cursors(buffer) || bf_block_selected(buffer)) {
+        if (*key == '\n') {
+            key = bf_new_line_str(buffer->file_format);
+        }
+
+        return cm_insert_typed_text(sess, key, strlen(key));
+    }
+
+    return bf_insert_character(buffer, key, 1);
+}
+
+/* Insert text entered by the user as is at each cursor, or into the
+ * selected block. Used to insert a run of printable characters in one go
+ * rather than a key at a time */
+Status cm_insert_typed_text(Session *sess, const char *text, size_t text_len)
+{
+    Buffer *buffer = sess->active_buffer;
+
+    if (bf_has_cursors(buffer)) {
+        return bf_cursors_insert(buffer, text, text_len);
+    } else if (bf_block_selected(buffer)) {
+        return bf_block_insert(buffer, text, text_len);
+    } else if (bf_has_mask(buffer)) {
+        /* A mask accepts or rejects each character individually */
+        for (size_t k = 0; k < text_len; k++) {
+            RETURN_IF_FAIL(bf_insert_string(buffer, text + k, 1, 1));
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    return bf_insert_string(buffer, text, text_len, 1);
+}
+
+/* Find the mapping for key in the active operation modes, giving
+ * precedence to the most recently activated mode */
+static const KeyMapping *cm_find_key_mapping(const KeyMap *key_map,
+                                             const char *key)
+{
+    const KeyMapping *key_mapping = NULL;
+    const FrozenRadixTree *frozen_map = key_map->frozen_maps[key_map->op_mode];
+
+    if (frozen_map != NULL) {
+        if (rt_frozen_find(frozen_map, key, strlen(key),
+                           (void **)&key_mapping, NULL)) {
+            return key_mapping;
+        }
+
+        return NULL;
+    }
+
+    for (int k = OM_ENTRY_NUM - 1; k > -1; k--) {
+        if (key_map->active_op_modes[k]) {
+            if (rt_find(key_map->maps[k], key, strlen(key),
+                        (void **)&key_mapping, NULL)) {
+                return key_mapping;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns the name of the operation key invokes in the current context
+ * or NULL if key isn't bound to an operation */
+const char *cm_get_operation_name(const Session *sess, const char *key)
+{
+    assert(!is_null_or_empty(key));
+
+    const KeyMapping *key_mapping = cm_find_key_mapping(&sess->key_map, key);
+
+    if (key_mapping == NULL || key_mapping->type != KMT_OPERATION) {
+        return NULL;
+    }
+
+    return cm_operations[key_mapping->value.op].name;
+}
+
 int cm_is_valid_operation(const Session *sess, const char *key,
                           size_t key_len, int *is_prefix)
 {
@@ -640,20 +933,26 @@ int cm_is_valid_operation(const Session *sess, const char *key,
 
     const KeyMapping *key_mapping = NULL;
     const KeyMap *key_map = &sess->key_map;
+    const FrozenRadixTree *frozen_map = key_map->frozen_maps[key_map->op_mode];
     const RadixTree *map;
     *is_prefix = 0;
 
-    for (int k = OM_ENTRY_NUM - 1; k > -1; k--) {
-        if (key_map->active_op_modes[k]) {
-            map = key_map->maps[k];
-            int mode_is_prefix;
+    if (frozen_map != NULL) {
+        rt_frozen_find(frozen_map, key, key_len, (void **)&key_mapping,
+                       is_prefix);
+    } else {
+        for (int k = OM_ENTRY_NUM - 1; k > -1; k--) {
+            if (key_map->active_op_modes[k]) {
+                map = key_map->maps[k];
+                int mode_is_prefix;
 
-            if (rt_find(map, key, key_len, (void **)&key_mapping,
-                        &mode_is_prefix)) {
-                break;
-            }
+                if (rt_find(map, key, key_len, (void **)&key_mapping,
+                            &mode_is_prefix)) {
+                    break;
+                }
 
-            *is_prefix |= mode_is_prefix;
+                *is_prefix |= mode_is_prefix;
+            }
         }
     }
 
@@ -774,6 +1073,8 @@ static const char *cm_get_op_mode_str(OperationMode op_mode)
             return "User";
         case OM_FILE_EXPLORER:
             return "File Explorer";
+        case OM_FILE_SEARCH:
+            return "File Search";
         default:
             break;
     }
@@ -919,8 +1220,15 @@ static Status cm_bp_change_line(const CommandArgs *cmd_args)
     assert(cmd_args->arg_num == 1);
     Session *sess = cmd_args->sess;
     Value param = cmd_args->args[0];
-    return bf_change_line(sess->active_buffer, &sess->active_buffer->pos,
-                          IVAL(param), 1);
+    Buffer *buffer = sess->active_buffer;
+
+    RETURN_IF_FAIL(bf_change_line(buffer, &buffer->pos, IVAL(param), 1));
+
+    if (bf_has_cursors(buffer)) {
+        return bf_move_cursors(buffer, CMV_LINE, IVAL(param));
+    }
+
+    return STATUS_SUCCESS;
 }
 
 static Status cm_bp_change_char(const CommandArgs *cmd_args)
@@ -928,8 +1236,15 @@ static Status cm_bp_change_char(const CommandArgs *cmd_args)
     assert(cmd_args->arg_num == 1);
     Session *sess = cmd_args->sess;
     Value param = cmd_args->args[0];
-    return bf_change_char(sess->active_buffer, &sess->active_buffer->pos,
-                          IVAL(param), 1);
+    Buffer *buffer = sess->active_buffer;
+
+    RETURN_IF_FAIL(bf_change_char(buffer, &buffer->pos, IVAL(param), 1));
+
+    if (bf_has_cursors(buffer)) {
+        return bf_move_cursors(buffer, CMV_CHAR, IVAL(param));
+    }
+
+    return STATUS_SUCCESS;
 }
 
 static Status cm_bp_to_line_start(const CommandArgs *cmd_args)
@@ -937,8 +1252,16 @@ static Status cm_bp_to_line_start(const CommandArgs *cmd_args)
     assert(cmd_args->arg_num == 1);
     Session *sess = cmd_args->sess;
     Value param = cmd_args->args[0];
-    return bf_to_line_start(sess->active_buffer, &sess->active_buffer->pos,
-                            IVAL(param) & DIRECTION_WITH_SELECT, 1);
+    Buffer *buffer = sess->active_buffer;
+
+    RETURN_IF_FAIL(bf_to_line_start(buffer, &buffer->pos,
+                                    IVAL(param) & DIRECTION_WITH_SELECT, 1));
+
+    if (bf_has_cursors(buffer)) {
+        return bf_move_cursors(buffer, CMV_LINE_START, IVAL(param));
+    }
+
+    return STATUS_SUCCESS;
 }
 
 static Status cm_bp_to_hard_line_start(const CommandArgs *cmd_args)
@@ -951,7 +1274,13 @@ static Status cm_bp_to_hard_line_start(const CommandArgs *cmd_args)
     BufferPos *pos = &buffer->pos;
     int is_select = IVAL(param) & DIRECTION_WITH_SELECT;
 
-    return bf_bp_to_line_start(buffer, pos, is_select, 1);
+    RETURN_IF_FAIL(bf_bp_to_line_start(buffer, pos, is_select, 1));
+
+    if (bf_has_cursors(buffer)) {
+        return bf_move_cursors(buffer, CMV_LINE_START, IVAL(param));
+    }
+
+    return STATUS_SUCCESS;
 }
 
 static Status cm_bp_to_line_end(const CommandArgs *cmd_args)
@@ -959,8 +1288,16 @@ static Status cm_bp_to_line_end(const CommandArgs *cmd_args)
     assert(cmd_args->arg_num == 1);
     Session *sess = cmd_args->sess;
     Value param = cmd_args->args[0];
-    return bf_to_line_end(sess->active_buffer,
-                          IVAL(param) & DIRECTION_WITH_SELECT);
+    Buffer *buffer = sess->active_buffer;
+
+    RETURN_IF_FAIL(bf_to_line_end(buffer,
+                                  IVAL(param) & DIRECTION_WITH_SELECT));
+
+    if (bf_has_cursors(buffer)) {
+        return bf_move_cursors(buffer, CMV_LINE_END, IVAL(param));
+    }
+
+    return STATUS_SUCCESS;
 }
 
 static Status cm_bp_to_hard_line_end(const CommandArgs *cmd_args)
@@ -973,7 +1310,13 @@ static Status cm_bp_to_hard_line_end(const CommandArgs *cmd_args)
     BufferPos *pos = &buffer->pos;
     int is_select = IVAL(param) & DIRECTION_WITH_SELECT;
 
-    return bf_bp_to_line_end(buffer, pos, is_select, 1);
+    RETURN_IF_FAIL(bf_bp_to_line_end(buffer, pos, is_select, 1));
+
+    if (bf_has_cursors(buffer)) {
+        return bf_move_cursors(buffer, CMV_LINE_END, IVAL(param));
+    }
+
+    return STATUS_SUCCESS;
 }
 
 static Status cm_bp_to_next_word(const CommandArgs *cmd_args)
@@ -1045,14 +1388,21 @@ static Status cm_bp_goto_matching_bracket(const CommandArgs *cmd_args)
 static Status cm_buffer_insert_char(const CommandArgs *cmd_args)
 {
     assert(cmd_args->arg_num == 1);
-    Session *sess = cmd_args->sess;
     Value param = cmd_args->args[0];
-    return bf_insert_character(sess->active_buffer, SVAL(param), 1);
+
+    return cm_insert_key(cmd_args->sess, SVAL(param));
 }
 
 static Status cm_buffer_delete_char(const CommandArgs *cmd_args)
 {
     Session *sess = cmd_args->sess;
+
+    if (bf_has_cursors(sess->active_buffer)) {
+        return bf_cursors_delete(sess->active_buffer, DIRECTION_RIGHT);
+    } else if (bf_block_selected(sess->active_buffer)) {
+        return bf_block_delete(sess->active_buffer, DIRECTION_RIGHT);
+    }
+
     return bf_delete_character(sess->active_buffer);
 }
 
@@ -1060,6 +1410,12 @@ static Status cm_buffer_backspace(const CommandArgs *cmd_args)
 {
     Session *sess = cmd_args->sess;
 
+    if (bf_has_cursors(sess->active_buffer)) {
+        return bf_cursors_delete(sess->active_buffer, DIRECTION_LEFT);
+    } else if (bf_block_selected(sess->active_buffer)) {
+        return bf_block_delete(sess->active_buffer, DIRECTION_LEFT);
+    }
+
     if (!bf_selection_started(sess->active_buffer)) {
         if (bp_at_buffer_start(&sess->active_buffer->pos)) {
             return STATUS_SUCCESS;
@@ -1089,7 +1445,17 @@ static Status cm_buffer_delete_prev_word(const CommandArgs *cmd_args)
 static Status cm_buffer_insert_line(const CommandArgs *cmd_args)
 {
     Session *sess = cmd_args->sess;
-    return bf_insert_character(sess->active_buffer, "\n", 1);
+    Buffer *buffer = sess->active_buffer;
+
+    if (bf_has_cursors(buffer)) {
+        const char *new_line = bf_new_line_str(buffer->file_format);
+        return bf_cursors_insert(buffer, new_line, strlen(new_line));
+    } else if (bf_block_selected(buffer)) {
+        const char *new_line = bf_new_line_str(buffer->file_format);
+        return bf_block_insert(buffer, new_line, strlen(new_line));
+    }
+
+    return bf_insert_character(buffer, "\n", 1);
 }
 
 static Status cm_buffer_select_all_text(const CommandArgs *cmd_args)
@@ -1259,6 +1625,9 @@ static Status cm_buffer_save_file(const CommandArgs *cmd_args)
         fi_refresh_file_attributes(&buffer->file_info);
     }
 
+    /* The saved file now contains the changes journalled so far */
+    se_add_error(sess, se_journal_saved_buffer(sess, buffer));
+
     char msg[MAX_MSG_SIZE];
     snprintf(msg, MAX_MSG_SIZE, "Save successful: %zu lines, %zu bytes written",
                                 bf_lines(buffer), bf_length(buffer));
@@ -1288,6 +1657,12 @@ static Status cm_buffer_save_as(const CommandArgs *cmd_args)
         return status;
     }
 
+    /* A partial buffer can be saved as a new file, which then contains
+     * everything the buffer does */
+    if (!fi_equal(&orig_file_info, &buffer->file_info)) {
+        buffer->is_partial = 0;
+    }
+
     fi_free(&orig_file_info);
 
     return cm_buffer_save_file(cmd_args);
@@ -1353,8 +1728,19 @@ static void cm_generate_find_prompt(const BufferSearch *search,
         case_sensitive = " (case sensitive)";
     }
 
-    snprintf(prompt_text, MAX_CMD_PROMPT_LENGTH, "Find%s%s%s:", type,
-             direction, case_sensitive);
+    /* Display the number of matches found whilst the pattern is entered */
+    char match_num[30] = "";
+
+    if (bs_find_all_started(search) && !search->invalid) {
+        size_t num = bs_find_all_match_num(search);
+        int more = bs_find_all_active(search) || num == MAX_SEARCH_MATCH_NUM;
+
+        snprintf(match_num, sizeof(match_num), " (%zu%s match%s)", num,
+                 more ? "+" : "", num == 1 && !more ? "" : "es");
+    }
+
+    snprintf(prompt_text, MAX_CMD_PROMPT_LENGTH, "Find%s%s%s%s:", type,
+             direction, case_sensitive, match_num);
 }
 
 static Status cm_prepare_search(Session *sess, const BufferPos *start_pos,
@@ -1395,22 +1781,8 @@ static Status cm_prepare_search(Session *sess, const BufferPos *start_pos,
         return status;
     }
 
-    size_t pattern_len = strlen(pattern);
-
-    if (buffer->search.search_type == BST_TEXT) {
-        char *processed_pattern = su_process_string(
-                                      pattern, pattern_len,
-                                      buffer->file_format == FF_WINDOWS,
-                                      &pattern_len);
-
-        free(pattern);
-
-        if (processed_pattern == NULL) {
-            return OUT_OF_MEMORY("Unable to process input");
-        } else {
-            pattern = processed_pattern;
-        }
-    }
+    size_t pattern_len;
+    RETURN_IF_FAIL(cm_process_search_pattern(buffer, &pattern, &pattern_len));
 
     if (buffer->search.opt.pattern == NULL || buffer->search.invalid ||
         strcmp(buffer->search.opt.pattern, pattern) != 0) {
@@ -1419,6 +1791,12 @@ static Status cm_prepare_search(Session *sess, const BufferPos *start_pos,
         if (STATUS_IS_SUCCESS(status) && allow_find_all) {
             status = bs_find_all(&buffer->search, &buffer->pos);
         }
+    } else if (allow_find_all) {
+        /* The pattern was searched for whilst it was being entered so
+         * finish searching the rest of the buffer */
+        status = bs_find_all_continue(&buffer->search, SIZE_MAX);
+    } else if (bs_find_all_started(&buffer->search)) {
+        bs_reset(&buffer->search, start_pos);
     }
 
     free(pattern);
@@ -1426,80 +1804,276 @@ static Status cm_prepare_search(Session *sess, const BufferPos *start_pos,
     return status;
 }
 
-static Status cm_buffer_find(const CommandArgs *cmd_args)
+/* Text search patterns can contain escape sequences which are converted
+ * into the characters they represent */
+static Status cm_process_search_pattern(const Buffer *buffer,
+                                        char **pattern_ptr,
+                                        size_t *pattern_len)
 {
-    Session *sess = cmd_args->sess;
-    Buffer *buffer = sess->active_buffer;
-    int iter = 0;
+    char *pattern = *pattern_ptr;
+    *pattern_len = strlen(pattern);
 
-    while (1) {
-        RETURN_IF_FAIL(cm_prepare_search(sess, NULL, 1, iter++ == 0));
+    if (buffer->search.search_type != BST_TEXT) {
+        return STATUS_SUCCESS;
+    }
 
-        if (pr_prompt_cancelled(sess->prompt)) {
-            break;
-        }
+    char *processed_pattern = su_process_string(
+                                  pattern, *pattern_len,
+                                  buffer->file_format == FF_WINDOWS,
+                                  pattern_len);
 
-        RETURN_IF_FAIL(cm_buffer_find_next(cmd_args));
+    free(pattern);
+    *pattern_ptr = processed_pattern;
 
-        sess->ui->update(sess->ui);
+    if (processed_pattern == NULL) {
+        return OUT_OF_MEMORY("Unable to process input");
     }
 
-    bs_reset(&buffer->search, NULL);
-    buffer->search.invalid = 1;
-
     return STATUS_SUCCESS;
 }
 
-static Status cm_buffer_find_next(const CommandArgs *cmd_args)
+/* Asks whether the unsaved changes recorded in the journal of the active
+ * buffer should be replayed, which is the case when wed exited without
+ * saving the buffer. Declining removes the journal. Returns true if a
+ * question was asked and the display needs to be updated */
+int cm_offer_buffer_recovery(Session *sess)
 {
-    assert(cmd_args->arg_num == 1);
-    Session *sess = cmd_args->sess;
-    Value param = cmd_args->args[0];
-
     Buffer *buffer = sess->active_buffer;
 
-    if (buffer->search.opt.pattern == NULL) {
-        return STATUS_SUCCESS;
+    if (se_prompt_active(sess) || !jn_recoverable(buffer->journal)) {
+        return 0;
     }
 
-    int find_prev = IVAL(param);
-
-    if (find_prev) {
-        /* Flip the search direction */
-        buffer->search.opt.forward ^= 1;
-    }
+    char prompt_text[50];
+    char *fmt = "Recover unsaved changes to %.*s (Y/n)?";
+    snprintf(prompt_text, sizeof(prompt_text), fmt,
+             sizeof(prompt_text) - strlen(fmt) + 3,
+             buffer->file_info.file_name);
 
-    int found_match;
+    QuestionRespose response = cm_question_prompt(sess, PT_SAVE_FILE,
+                                                  prompt_text,
+                                                  QR_YES | QR_NO, QR_YES);
 
-    Status status = bs_find_next(&buffer->search, &buffer->pos, &found_match);
+    if (response == QR_YES) {
+        se_add_error(sess, se_recover_buffer(sess, buffer));
+    } else {
+        if (response == QR_ERROR) {
+            se_add_error(sess, OUT_OF_MEMORY("Unable to process input"));
+        }
 
-    if (STATUS_IS_SUCCESS(status)) {
-        if (found_match) {
-            if ((buffer->search.opt.forward && 
-                 bp_compare(&buffer->search.last_match_pos,
-                            &buffer->pos) == -1) ||
-                (!buffer->search.opt.forward &&
-                 bp_compare(&buffer->search.last_match_pos,
-                            &buffer->pos) == 1)) {
-                /* Search wrapped past the start or end of the buffer */
-                se_add_msg(sess, "Search wrapped");
-            }
+        jn_decline_recovery(buffer->journal);
+    }
 
-            status = bf_set_bp(buffer, &buffer->search.last_match_pos, 0);
+    return 1;
+}
 
-            if (STATUS_IS_SUCCESS(status)) {
-                bf_select_continue(buffer);
-                bp_advance_to_offset(&buffer->select_start,
-                                     buffer->pos.offset + 
-                                     bs_match_length(&buffer->search));
-            }
-        } else {
-            bf_select_reset(buffer);
+/* Search for the pattern in the find prompt whilst it's being entered.
+ * When the pattern changes any search of the previous pattern is abandoned
+ * and the visible region of the buffer is searched immediately. Each
+ * subsequent call then searches the rest of the buffer for a short time
+ * slice so that input is never blocked for long. search_pending is set
+ * to true whilst part of the buffer remains to be searched. Returns true
+ * if the display needs to be updated */
+int cm_update_incremental_search(Session *sess, int *search_pending)
+{
+    *search_pending = 0;
 
-            char msg[MAX_MSG_SIZE];
-            const char *pattern = buffer->search.opt.pattern;
+    if (!se_prompt_active(sess) ||
+        pr_get_prompt_type(sess->prompt) != PT_FIND) {
+        return 0;
+    }
 
-            if (list_size(sess->search_history) > 0) {
+    Buffer *buffer = sess->active_buffer->next;
+    BufferSearch *search = &buffer->search;
+    char *pattern = pr_get_prompt_content(sess->prompt);
+    size_t pattern_len;
+    Status status = STATUS_SUCCESS;
+
+    if (pattern == NULL) {
+        return 0;
+    } else if (*pattern == '\0') {
+        free(pattern);
+
+        if (search->invalid) {
+            return 0;
+        }
+
+        bs_reset(search, NULL);
+        search->invalid = 1;
+    } else {
+        status = cm_process_search_pattern(buffer, &pattern, &pattern_len);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            st_free_status(status);
+            return 0;
+        }
+
+        if (search->opt.pattern == NULL || search->invalid ||
+            strcmp(search->opt.pattern, pattern) != 0) {
+            BufferPos visible_start, visible_end;
+            cm_get_visible_region(buffer, &visible_start, &visible_end);
+
+            status = bs_reinit(search, NULL, pattern, pattern_len);
+
+            if (STATUS_IS_SUCCESS(status)) {
+                status = bs_find_all_start(search, &buffer->pos,
+                                           &visible_start, &visible_end);
+            }
+        } else if (bs_find_all_active(search)) {
+            status = cm_continue_incremental_search(search);
+        } else {
+            free(pattern);
+            return 0;
+        }
+
+        free(pattern);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            /* Errors such as an incomplete regex are only reported
+             * once the pattern has been submitted */
+            st_free_status(status);
+            bs_reset(search, NULL);
+            search->invalid = 1;
+        }
+    }
+
+    *search_pending = bs_find_all_active(search);
+
+    char prompt_text[MAX_CMD_PROMPT_LENGTH];
+    cm_generate_find_prompt(search, prompt_text);
+    status = pr_set_prompt_text(sess->prompt, prompt_text);
+    se_add_error(sess, status);
+
+    return 1;
+}
+
+static Status cm_continue_incremental_search(BufferSearch *search)
+{
+    struct timespec start;
+    struct timespec now;
+    long elapsed_ns;
+    Status status;
+
+    get_monotonic_time(&start);
+
+    do {
+        status = bs_find_all_continue(search, INCREMENTAL_SEARCH_CHUNK_SIZE);
+        get_monotonic_time(&now);
+        elapsed_ns = (now.tv_sec - start.tv_sec) * 1000000000L +
+                     (now.tv_nsec - start.tv_nsec);
+    } while (STATUS_IS_SUCCESS(status) && bs_find_all_active(search) &&
+             elapsed_ns < INCREMENTAL_SEARCH_SLICE_NS);
+
+    return status;
+}
+
+/* The region of the buffer currently displayed */
+static void cm_get_visible_region(const Buffer *buffer,
+                                  BufferPos *visible_start,
+                                  BufferPos *visible_end)
+{
+    const BufferView *bv = buffer->bv;
+    *visible_start = *visible_end = bv->screen_start;
+    bp_to_line_start(visible_start);
+
+    for (size_t k = 0; k < bv->rows; k++) {
+        if (!bp_next_line(visible_end)) {
+            bp_to_buffer_end(visible_end);
+            break;
+        }
+    }
+}
+
+static Status cm_buffer_find(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    Buffer *buffer = sess->active_buffer;
+    int iter = 0;
+
+    while (1) {
+        RETURN_IF_FAIL(cm_prepare_search(sess, NULL, 1, iter++ == 0));
+
+        if (pr_prompt_cancelled(sess->prompt)) {
+            break;
+        }
+
+        RETURN_IF_FAIL(cm_buffer_find_next(cmd_args));
+
+        sess->ui->update(sess->ui);
+    }
+
+    bs_reset(&buffer->search, NULL);
+    buffer->search.invalid = 1;
+
+    return STATUS_SUCCESS;
+}
+
+static Status cm_buffer_find_next(const CommandArgs *cmd_args)
+{
+    assert(cmd_args->arg_num == 1);
+    Session *sess = cmd_args->sess;
+    Value param = cmd_args->args[0];
+
+    Buffer *buffer = sess->active_buffer;
+
+    if (buffer->search.opt.pattern == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    int find_prev = IVAL(param);
+
+    if (find_prev) {
+        /* Flip the search direction */
+        buffer->search.opt.forward ^= 1;
+    }
+
+    int found_match;
+    int wrapped = 0;
+
+    Status status = bs_find_next(&buffer->search, &buffer->pos, &found_match);
+
+    if (STATUS_IS_SUCCESS(status) && bf_is_large_file(buffer) &&
+        buffer->search.opt.forward &&
+        (!found_match || bp_compare(&buffer->search.last_match_pos,
+                                    &buffer->pos) == -1)) {
+        /* Only part of the file is loaded, so before wrapping search the
+         * rest of it */
+        int large_file_match;
+        status = bf_large_file_find_next(buffer, &large_file_match, &wrapped);
+        found_match |= large_file_match;
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        if (wrapped) {
+            se_add_msg(sess, "Search wrapped");
+        }
+
+        if (found_match) {
+            if ((buffer->search.opt.forward && 
+                 bp_compare(&buffer->search.last_match_pos,
+                            &buffer->pos) == -1) ||
+                (!buffer->search.opt.forward &&
+                 bp_compare(&buffer->search.last_match_pos,
+                            &buffer->pos) == 1)) {
+                /* Search wrapped past the start or end of the buffer */
+                se_add_msg(sess, "Search wrapped");
+            }
+
+            status = bf_set_bp(buffer, &buffer->search.last_match_pos, 0);
+
+            if (STATUS_IS_SUCCESS(status)) {
+                bf_select_continue(buffer);
+                bp_advance_to_offset(&buffer->select_start,
+                                     buffer->pos.offset + 
+                                     bs_match_length(&buffer->search));
+            }
+        } else {
+            bf_select_reset(buffer);
+
+            char msg[MAX_MSG_SIZE];
+            const char *pattern = buffer->search.opt.pattern;
+
+            if (list_size(sess->search_history) > 0) {
                 pattern = list_get_last(sess->search_history);
             }
 
@@ -1654,6 +2228,7 @@ static Status cm_buffer_replace(const CommandArgs *cmd_args)
     int direction = search->opt.forward;
     size_t match_num = 0;
     size_t replace_num = 0;
+    int grouped_changes = 0;
     search->advance_from_last_match = (rep_length > 0);
 
     do {
@@ -1688,6 +2263,8 @@ static Status cm_buffer_replace(const CommandArgs *cmd_args)
                         break;
                     }
 
+                    grouped_changes = 1;
+
                     BufferPos buffer_start = buffer->pos;
                     bp_to_buffer_start(&buffer_start);
                     status = bf_set_bp(buffer, &buffer_start, 0);
@@ -1728,7 +2305,7 @@ static Status cm_buffer_replace(const CommandArgs *cmd_args)
     bf_select_reset(buffer);
     search->opt.forward = direction;
 
-    if (bc_grouped_changes_started(&buffer->changes)) {
+    if (grouped_changes) {
         bc_end_grouped_changes(&buffer->changes);
     }
 
@@ -1751,6 +2328,11 @@ static Status cm_buffer_replace(const CommandArgs *cmd_args)
                  pattern);
     } else if (replace_num == 0) {
         snprintf(msg, MAX_MSG_SIZE, "No occurrences replaced");
+    } else if (bf_is_large_file(buffer)) {
+        /* Only the loaded chunks are searched, so make it clear that
+         * the rest of the file hasn't been changed */
+        snprintf(msg, MAX_MSG_SIZE, "%zu occurrences replaced in the loaded "
+                 "part of the file", replace_num);
     } else {
         snprintf(msg, MAX_MSG_SIZE, "%zu occurrences replaced", replace_num);
     }
@@ -2138,6 +2720,7 @@ static Status cm_session_file_explorer_toggle_active(
         sess->active_buffer = fe_buffer->next;
         cm_set_operation_mode(&sess->key_map, OM_BUFFER);
         se_enable_command_type(sess, CMDT_BUFFER_MOD);
+        se_update_op_mode(sess);
     } else {
         if (!cf_bool(sess->config, CV_FILE_EXPLORER)) {
             RETURN_IF_FAIL(
@@ -2178,7 +2761,17 @@ static Status cm_session_file_explorer_select(const CommandArgs *cmd_args)
     }
 
     if (fi_is_directory(&file_info)) {
-        status = fe_read_directory(file_explorer, file_info.abs_path);
+        int toggled;
+        status = fe_toggle_selected(file_explorer, &toggled);
+
+        if (STATUS_IS_SUCCESS(status) && !toggled) {
+            /* ../ and links to directories change the directory listed */
+            status = fe_read_directory(file_explorer, file_info.abs_path);
+        }
+
+        if (STATUS_IS_SUCCESS(status) && sess->wed_opt.test_mode) {
+            status = fe_wait(file_explorer);
+        }
     } else {
         status = cm_session_file_explorer_toggle_active(cmd_args);
         GOTO_IF_FAIL(status, cleanup);
@@ -2389,6 +2982,11 @@ static Status cm_cmd_input_prompt(Session *sess, const PromptOpt *prompt_opt)
     CommandType disabled_cmd_types = CMDT_CMD_INPUT | CMDT_SESS_MOD;
     se_exclude_command_type(sess, disabled_cmd_types);
 
+    /* The prompt buffer can be edited even when the buffer the prompt
+     * was opened from is read only e.g. a file search results buffer */
+    CommandType read_only = sess->exclude_cmd_types & CMDT_BUFFER_MOD;
+    se_enable_command_type(sess, read_only);
+
     sess->ui->update(sess->ui);
     /* We now start processing input for the prompt.
      * Execution blocks here until the prompt ends */
@@ -2397,6 +2995,7 @@ static Status cm_cmd_input_prompt(Session *sess, const PromptOpt *prompt_opt)
      * text (if any) the user entered into the prompt */
 
     se_enable_command_type(sess, disabled_cmd_types);
+    se_exclude_command_type(sess, read_only);
     se_end_prompt(sess);
     bf_set_is_draw_dirty(sess->active_buffer, 1);
 
@@ -2513,7 +3112,10 @@ static Status cm_session_map(const CommandArgs *cmd_args)
         cm_free_key_mapping(existing_key_mapping);
     }
 
-    if (!rt_insert(map, key_mapping->key, key_len, key_mapping)) {
+    int inserted = rt_insert(map, key_mapping->key, key_len, key_mapping);
+    cm_invalidate_frozen_maps(key_map);
+
+    if (!inserted) {
         return OUT_OF_MEMORY("Unable to create key mapping");
     }
 
@@ -2552,6 +3154,7 @@ static Status cm_session_unmap(const CommandArgs *cmd_args)
 
     rt_delete(map, map_from, map_from_len);
     cm_free_key_mapping(existing_key_mapping);
+    cm_invalidate_frozen_maps(key_map);
 
     char msg[MAX_MSG_SIZE];
     snprintf(msg, MAX_MSG_SIZE, "Unmapped %s", map_from);
@@ -2583,97 +3186,11 @@ static Status cm_session_help(const CommandArgs *cmd_args)
 static Status cm_buffer_filter(const CommandArgs *cmd_args)
 {
     Session *sess = cmd_args->sess;
-    Buffer *buffer = sess->active_buffer;
     Value cmd = cmd_args->args[0];
-    BufferPos orig_pos = buffer->pos;
-    Buffer *err_buffer = NULL;
-    Status status = STATUS_SUCCESS;
-
-    BufferInputStream bis;
-    BufferOutputStream bos;
-    BufferOutputStream bes;
-
-    memset(&bis, 0, sizeof(BufferInputStream));
-    memset(&bos, 0, sizeof(BufferOutputStream));
-    memset(&bes, 0, sizeof(BufferOutputStream));
-
-    Range range;
-    bf_select_all_text(buffer);
-    
-    if (!bf_get_range(buffer, &range)) {
-        range = (Range) {
-            .start = buffer->pos,
-            .end = buffer->pos
-        };
-    }
-    
-    bf_to_buffer_start(buffer, 0);
-
-    err_buffer = bf_new_empty("cmderror", sess->config);
-
-    if (err_buffer == NULL) {
-        goto cleanup;
-    }
-
-    status = bf_get_buffer_input_stream(&bis, buffer, &range);
-    GOTO_IF_FAIL(status, cleanup);
-
-    status = bf_get_buffer_output_stream(&bos, buffer, &buffer->pos, 1);
-    GOTO_IF_FAIL(status, cleanup);
-
-    status = bf_get_buffer_output_stream(&bes, err_buffer, &err_buffer->pos, 0);
-    GOTO_IF_FAIL(status, cleanup);
-
-    status = bc_start_grouped_changes(&buffer->changes);
-    GOTO_IF_FAIL(status, cleanup);
-
-    int cmd_status;
-    status = ec_run_command(CVAL(cmd), (InputStream *)&bis,
-                            (OutputStream *)&bos, (OutputStream *)&bes,
-                            &cmd_status);
-
-    GOTO_IF_FAIL(status, cleanup);
-
-    BufferPos write_pos = bos.write_pos;
-    bf_set_bp(buffer, &write_pos, 0);
-    bf_to_buffer_end(buffer, 1);
-    status = bf_delete(buffer, 0);
-    GOTO_IF_FAIL(status, cleanup);
-    orig_pos = bp_init_from_line_col(orig_pos.line_no, orig_pos.col_no,
-                                     &buffer->pos);
-    bf_set_bp(buffer, &orig_pos, 0);
-
-    if (!ec_cmd_successfull(cmd_status)) {
-        char *error = bf_to_string(err_buffer);
-        error = error == NULL ? "" : error;
-        status = st_get_error(ERR_SHELL_COMMAND_ERROR,
-                              "Error when running command \"%s\": %s",
-                              CVAL(cmd), error);
-        free(error);
-    }
-
-cleanup:
-    bc_end_grouped_changes(&buffer->changes);
-
-    if (bis.buffer != NULL) {
-        bis.is.close((InputStream *)&bis);
-    }
-
-    if (bos.buffer != NULL) {
-        bos.os.close((OutputStream *)&bos);
-    }
-
-    if (bes.buffer != NULL) {
-        bes.os.close((OutputStream *)&bes);
-    }
-
-    if (err_buffer != NULL) {
-        bf_free(err_buffer);
-    } else {
-        status = OUT_OF_MEMORY("Unable to create stderr stream");
-    }
 
-    return status;
+    /* The command runs in the background and the buffer content is
+     * replaced by its output once it has finished */
+    return se_add_job(sess, JT_FILTER, CVAL(cmd), sess->active_buffer);
 }
 
 static Status cm_buffer_read(const CommandArgs *cmd_args)
@@ -2694,60 +3211,7 @@ static Status cm_buffer_read(const CommandArgs *cmd_args)
         status = bf_read_file(buffer, &file_info);
         fi_free(&file_info);
     } else if (source.type == VAL_TYPE_SHELL_COMMAND) {
-        Buffer *err_buffer = NULL;
-        BufferOutputStream bos;
-        BufferOutputStream bes;
-
-        memset(&bos, 0, sizeof(BufferOutputStream));
-        memset(&bes, 0, sizeof(BufferOutputStream));
-
-        err_buffer = bf_new_empty("cmderror", sess->config);
-
-        if (err_buffer == NULL) {
-            goto cleanup;
-        }
-
-        status = bf_get_buffer_output_stream(&bos, buffer, &buffer->pos, 0);
-        GOTO_IF_FAIL(status, cleanup);
-
-        status = bf_get_buffer_output_stream(&bes, err_buffer,
-                                             &err_buffer->pos, 0);
-        GOTO_IF_FAIL(status, cleanup);
-
-        status = bc_start_grouped_changes(&buffer->changes);
-        GOTO_IF_FAIL(status, cleanup);
-
-        int cmd_status;
-
-        status = ec_run_command(CVAL(source), NULL, (OutputStream *)&bos,
-                                (OutputStream *)&bes, &cmd_status);
-        GOTO_IF_FAIL(status, cleanup);
-
-        if (!ec_cmd_successfull(cmd_status)) {
-            char *error = bf_to_string(err_buffer);
-            error = error == NULL ? "" : error;
-            status = st_get_error(ERR_SHELL_COMMAND_ERROR,
-                                  "Error when running command \"%s\": %s",
-                                  CVAL(source), error);
-            free(error);
-        }
-
-cleanup:
-        bc_end_grouped_changes(&buffer->changes);
-
-        if (bos.buffer != NULL) {
-            bos.os.close((OutputStream *)&bos);
-        }
-
-        if (bes.buffer != NULL) {
-            bes.os.close((OutputStream *)&bes);
-        }
-
-        if (err_buffer != NULL) {
-            bf_free(err_buffer);
-        } else {
-            status = OUT_OF_MEMORY("Unable to create stderr stream");
-        }
+        status = se_add_job(sess, JT_READ, CVAL(source), buffer);
     }
 
     return status;
@@ -2846,3 +3310,728 @@ static Status cm_session_exec(const CommandArgs *cmd_args)
     return status;
 }
 
+static Status cm_session_jobs(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    size_t job_num = list_size(sess->jobs);
+
+    if (job_num == 0) {
+        se_add_msg(sess, "No jobs running");
+        return STATUS_SUCCESS;
+    }
+
+    char msg[MAX_MSG_SIZE];
+    size_t written = snprintf(msg, MAX_MSG_SIZE, "Jobs:");
+    const Job *job;
+
+    for (size_t k = 0; k < job_num && written < MAX_MSG_SIZE; k++) {
+        job = list_get(sess->jobs, k);
+        written += snprintf(msg + written, MAX_MSG_SIZE - written,
+                            "%s %zu (%s%s: %s)", k > 0 ? "," : "", job->id,
+                            job->cancelled ? "killed " : "",
+                            jb_type_str(job->type), job->cmd);
+    }
+
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+}
+
+static Status cm_session_kill_job(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    long job_id = IVAL(cmd_args->args[0]);
+
+    if (job_id <= 0) {
+        return st_get_error(ERR_INVALID_JOB_ID, "Invalid job id %ld", job_id);
+    }
+
+    RETURN_IF_FAIL(se_cancel_job(sess, job_id));
+
+    char msg[MAX_MSG_SIZE];
+    snprintf(msg, MAX_MSG_SIZE, "Terminating job %ld", job_id);
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+}
+
+static Status cm_session_grep(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    const Value *pattern = &cmd_args->args[0];
+    SearchOptions opt = { .forward = 1 };
+    int is_regex = pattern->type == VAL_TYPE_REGEX;
+
+    if (is_regex) {
+        opt.pattern = RVAL(*pattern).regex_pattern;
+        opt.case_insensitive = (RVAL(*pattern).modifiers & PCRE_CASELESS) != 0;
+    } else {
+        opt.pattern = SVAL(*pattern);
+    }
+
+    if (is_null_or_empty(opt.pattern)) {
+        return st_get_error(ERR_INVALID_ARGUMENTS,
+                            "Search pattern cannot be empty");
+    }
+
+    opt.pattern_len = strlen(opt.pattern);
+
+    char buffer_name[MAX_GREP_BUFFER_NAME_SIZE];
+    snprintf(buffer_name, sizeof(buffer_name), "[grep %s]", opt.pattern);
+
+    Buffer *buffer = bf_new_empty(buffer_name, sess->config);
+
+    if (buffer == NULL) {
+        return OUT_OF_MEMORY("Unable to create results buffer");
+    }
+
+    /* Results are only ever appended so there is nothing to undo */
+    bc_disable(&buffer->changes);
+
+    if (!se_add_buffer(sess, buffer)) {
+        bf_free(buffer);
+        return OUT_OF_MEMORY("Unable to add results buffer");
+    }
+
+    cf_set_var(CE_VAL(sess, buffer), CL_BUFFER, CV_LINEWRAP, INT_VAL(0));
+    se_set_active_buffer(sess, sess->buffer_num - 1);
+
+    return se_add_file_search(sess, buffer, ".", &opt, is_regex);
+}
+
+/* Open the file containing the match on the current line of a file
+ * search results buffer */
+static Status cm_session_file_search_select(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    const FileSearch *fs = se_get_file_search(sess, sess->active_buffer);
+
+    if (fs == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    const FileSearchMatch *match =
+        fs_get_match(fs, sess->active_buffer->pos.line_no - 1);
+
+    if (match == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    /* The results buffer may be closed once the file is open so take
+     * a copy of the match */
+    FileSearchMatch selected = *match;
+    char *file_path = strdup(match->file_path);
+
+    if (file_path == NULL) {
+        return OUT_OF_MEMORY("Unable to copy file path");
+    }
+
+    Status status = cm_session_open_file(sess, file_path);
+    free(file_path);
+    RETURN_IF_FAIL(status);
+
+    /* Matches are located using a byte offset, which may not correspond
+     * to the column number if the line contains multibyte characters.
+     * The file may also have changed since it was searched so don't
+     * move beyond the end of the line */
+    Buffer *buffer = sess->active_buffer;
+    BufferPos pos = bp_init_from_line_col(selected.line_no, 1, &buffer->pos);
+    size_t offset = pos.offset + selected.col_no - 1;
+
+    while (pos.offset < offset && !bp_at_line_end(&pos)) {
+        bp_next_char(&pos);
+    }
+
+    return bf_set_bp(buffer, &pos, 0);
+}
+
+/* Prompt for part of a file path and open the file below the working
+ * directory which best matches it. The characters entered must appear
+ * in the file path in order but needn't be consecutive */
+static Status cm_session_find_file(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+
+    /* The index is built in the background whilst the user types */
+    RETURN_IF_FAIL(se_start_project_index(sess));
+
+    PromptOpt prompt_opt = {
+        .prompt_type = PT_FIND_FILE,
+        .prompt_text = "Find File:",
+        .history = NULL,
+        .show_last_entry = 0,
+        .select_last_entry = 0
+    };
+
+    cm_cmd_input_prompt(sess, &prompt_opt);
+
+    if (pr_prompt_cancelled(sess->prompt)) {
+        return STATUS_SUCCESS;
+    }
+
+    Prompt *prompt = sess->prompt;
+    char *input = pr_get_prompt_content(prompt);
+
+    if (input == NULL) {
+        return OUT_OF_MEMORY("Unable to process input");
+    } else if (*input == '\0') {
+        free(input);
+        return STATUS_SUCCESS;
+    }
+
+    Status status = pc_run_prompt_completer(sess, prompt, 0);
+
+    /* User input is added to the end of prompt->suggestions
+     * so a match has been found if there are at least two */
+    if (STATUS_IS_SUCCESS(status) && pr_suggestion_num(prompt) < 2) {
+        status = st_get_error(ERR_NO_FILES_MATCH,
+                              "No files match \"%s\"", input);
+    }
+
+    free(input);
+    RETURN_IF_FAIL(status);
+
+    /* Suggestions are ordered so that an exact match or otherwise the
+     * highest scoring match is first */
+    const PromptSuggestion *suggestion = list_get_first(prompt->suggestions);
+
+    return cm_session_open_file(sess, suggestion->text);
+}
+
+/* Insert text pasted into the terminal as a single change. Pasted text is
+ * inserted in the same way as typed text, at each cursor or into the
+ * selected block, but isn't auto indented */
+static Status cm_buffer_insert_pasted_text(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    PastedText pasted_text;
+
+    if (!se_get_pasted_text(sess, &pasted_text)) {
+        return STATUS_SUCCESS;
+    }
+
+    /* The pasted text is always removed from the input buffer, so this
+     * command has type CMDT_NOP, which is never excluded, and checks
+     * itself whether the buffer can be modified. Otherwise text pasted
+     * into a prompt would be left for the next paste to insert */
+    if (se_command_type_excluded(sess, CMDT_BUFFER_MOD)) {
+        free(pasted_text.text);
+        return STATUS_SUCCESS;
+    }
+
+    size_t text_len = pasted_text.text_len;
+
+    if (se_prompt_active(sess)) {
+        /* Prompt input is a single line */
+        const char *line_end = memchr(pasted_text.text, '\n', text_len);
+
+        if (line_end != NULL) {
+            text_len = line_end - pasted_text.text;
+        }
+    }
+
+    Buffer *buffer = sess->active_buffer;
+    const char *new_line = bf_new_line_str(buffer->file_format);
+    char *text = pasted_text.text;
+
+    /* Pasted line endings have been converted to \n, so convert them
+     * again to match the rest of the buffer */
+    if (strcmp(new_line, "\n") != 0 &&
+        (text = cm_convert_new_lines(pasted_text.text, &text_len,
+                                     new_line)) == NULL) {
+        free(pasted_text.text);
+        return OUT_OF_MEMORY("Unable to insert pasted text");
+    }
+
+    Status status = bc_start_grouped_changes(&buffer->changes);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = cm_insert_typed_text(sess, text, text_len);
+    }
+
+    if (STATUS_IS_SUCCESS(status) && se_macro_recording(sess)) {
+        status = mc_add_text(&sess->macro, text, text_len);
+    }
+
+    bc_end_grouped_changes(&buffer->changes);
+
+    if (text != pasted_text.text) {
+        free(text);
+    }
+
+    free(pasted_text.text);
+
+    return status;
+}
+
+/* Returns a copy of text with each \n replaced by new_line. text_len is
+ * updated to the length of the copy */
+static char *cm_convert_new_lines(const char *text, size_t *text_len,
+                                  const char *new_line)
+{
+    size_t new_line_len = strlen(new_line);
+    size_t line_num = 0;
+
+    for (size_t k = 0; k < *text_len; k++) {
+        line_num += (text[k] == '\n');
+    }
+
+    char *converted = malloc(*text_len + line_num * (new_line_len - 1) + 1);
+    RETURN_IF_NULL(converted);
+
+    size_t converted_len = 0;
+
+    for (size_t k = 0; k < *text_len; k++) {
+        if (text[k] == '\n') {
+            memcpy(converted + converted_len, new_line, new_line_len);
+            converted_len += new_line_len;
+        } else {
+            converted[converted_len++] = text[k];
+        }
+    }
+
+    *text_len = converted_len;
+
+    return converted;
+}
+
+static Status cm_session_trace(const CommandArgs *cmd_args)
+{
+#if WED_FEATURE_TRACE
+    Session *sess = cmd_args->sess;
+    tr_toggle_overlay();
+    se_add_msg(sess, tr_overlay_enabled() ? "Frame time overlay enabled"
+                                          : "Frame time overlay disabled");
+
+    return STATUS_SUCCESS;
+#else
+    (void)cmd_args;
+    return st_get_error(ERR_TRACING_NOT_ENABLED,
+                        "Tracing not enabled, "
+                        "reconfigure wed using --enable-trace");
+#endif
+}
+
+static Status cm_session_trace_dump(const CommandArgs *cmd_args)
+{
+#if WED_FEATURE_TRACE
+    Session *sess = cmd_args->sess;
+    const char *file_path = SVAL(cmd_args->args[0]);
+
+    if (is_null_or_empty(file_path)) {
+        return st_get_error(ERR_INVALID_FILE_PATH, "Invalid file path");
+    }
+
+    RETURN_IF_FAIL(tr_write_chrome_trace(file_path));
+
+    char msg[MAX_MSG_SIZE];
+    snprintf(msg, MAX_MSG_SIZE, "Trace written to %s", file_path);
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+#else
+    (void)cmd_args;
+    return st_get_error(ERR_TRACING_NOT_ENABLED,
+                        "Tracing not enabled, "
+                        "reconfigure wed using --enable-trace");
+#endif
+}
+
+static Status cm_session_meminfo(const CommandArgs *cmd_args)
+{
+    RETURN_IF_FAIL(cm_session_add_empty_buffer(cmd_args));
+
+    Session *sess = cmd_args->sess;
+    Buffer *buffer = sess->active_buffer;
+
+    bc_disable(&buffer->changes);
+
+    Status status = mi_generate_report(sess, buffer);
+
+    bc_enable(&buffer->changes);
+
+    bf_to_buffer_start(buffer, 0);
+
+    return status;
+}
+
+static Status cm_session_memcompact(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    size_t bytes_freed;
+
+    RETURN_IF_FAIL(mi_compact(sess, &bytes_freed));
+
+    char size[32];
+    bytes_to_str(bytes_freed, size, sizeof(size));
+
+    char msg[MAX_MSG_SIZE];
+    snprintf(msg, MAX_MSG_SIZE, "Freed %s", size);
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+}
+
+static Status cm_buffer_add_cursor_on_line(const CommandArgs *cmd_args)
+{
+    assert(cmd_args->arg_num == 1);
+    Session *sess = cmd_args->sess;
+    Value param = cmd_args->args[0];
+
+    return bf_add_cursor_on_line(sess->active_buffer, IVAL(param));
+}
+
+static Status cm_buffer_add_cursors_at_matches(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    Buffer *buffer = sess->active_buffer;
+
+    if (buffer->search.opt.pattern == NULL) {
+        se_add_msg(sess, "No search pattern");
+        return STATUS_SUCCESS;
+    }
+
+    RETURN_IF_FAIL(bf_add_cursors_at_search_matches(buffer));
+
+    if (bf_cursor_num(buffer) == 1 && !bf_selection_started(buffer)) {
+        se_add_msg(sess, "No matches found");
+    } else {
+        char msg[MAX_MSG_SIZE];
+        snprintf(msg, MAX_MSG_SIZE, "%zu cursors", bf_cursor_num(buffer));
+        se_add_msg(sess, msg);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status cm_buffer_clear_cursors(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    bf_clear_cursors(sess->active_buffer);
+    return STATUS_SUCCESS;
+}
+
+static Status cm_buffer_toggle_block_select(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    return bf_toggle_block_select(sess->active_buffer);
+}
+
+static Status cm_session_follow(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    Buffer *buffer = sess->active_buffer;
+    int following;
+
+    RETURN_IF_FAIL(se_toggle_tail_follow(sess, buffer, &following));
+
+    char msg[MAX_MSG_SIZE];
+    snprintf(msg, MAX_MSG_SIZE, "%s %s", following ? "Following" :
+             "Stopped following", buffer->file_info.file_name);
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+}
+
+static Status cm_session_record_macro(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+
+    if (sess->macro_recording) {
+        sess->macro_recording = 0;
+        se_add_msg(sess, "Macro recorded");
+        return STATUS_SUCCESS;
+    }
+
+    /* Recording a new macro replaces the previous one */
+    mc_free(&sess->macro);
+    sess->macro_recording = 1;
+    se_add_msg(sess, "Recording macro");
+
+    return STATUS_SUCCESS;
+}
+
+/* All changes made whilst a macro is played are grouped together so they
+ * can be undone in one go. When the macro is played on each line or match
+ * the screen isn't drawn and no messages are displayed until it has been
+ * played everywhere */
+static Status cm_buffer_play_macro(const CommandArgs *cmd_args)
+{
+    Session *sess = cmd_args->sess;
+    Buffer *buffer = sess->active_buffer;
+    const Value param = cmd_args->args[0];
+    MacroTarget target = IVAL(param);
+
+    if (sess->macro_recording) {
+        return st_get_error(ERR_UNABLE_TO_PLAY_MACRO,
+                            "Cannot play a macro whilst recording one");
+    } else if (sess->macro_playing) {
+        return st_get_error(ERR_UNABLE_TO_PLAY_MACRO,
+                            "Cannot play a macro from a macro");
+    } else if (sess->macro.step_num == 0) {
+        se_add_msg(sess, "No macro recorded");
+        return STATUS_SUCCESS;
+    }
+
+    if (target != MT_CURSOR && bf_is_large_file(buffer)) {
+        return st_get_error(ERR_UNABLE_TO_PLAY_MACRO,
+                            "Cannot play a macro on each line or match "
+                            "of a large file");
+    } else if (target == MT_MATCHES) {
+        if (buffer->search.opt.pattern == NULL) {
+            se_add_msg(sess, "No search pattern");
+            return STATUS_SUCCESS;
+        } else if (cm_macro_has_command(&sess->macro, CMD_BUFFER_FIND) ||
+                   cm_macro_has_command(&sess->macro, CMD_BUFFER_REPLACE) ||
+                   cm_macro_has_command(&sess->macro,
+                                        CMD_BUFFER_ADD_CURSORS_AT_MATCHES)) {
+            /* These would change the search the macro is played on */
+            return st_get_error(ERR_UNABLE_TO_PLAY_MACRO,
+                                "Cannot play a macro which searches "
+                                "at each match");
+        }
+    }
+
+    RETURN_IF_FAIL(bc_start_grouped_changes(&buffer->changes));
+
+    sess->macro_playing = 1;
+    int re_enable_msgs = 0;
+    size_t play_num = 0;
+    Status status;
+
+    if (target != MT_CURSOR) {
+        re_enable_msgs = se_disable_msgs(sess);
+    }
+
+    if (target == MT_LINES) {
+        status = cm_play_macro_on_lines(sess, buffer, cmd_args->finished,
+                                        &play_num);
+    } else if (target == MT_MATCHES) {
+        status = cm_play_macro_at_matches(sess, buffer, cmd_args->finished,
+                                          &play_num);
+    } else {
+        status = cm_play_macro(sess, cmd_args->finished);
+    }
+
+    sess->macro_playing = 0;
+
+    /* The macro may have closed the buffer */
+    size_t buffer_index;
+
+    if (se_get_buffer_index(sess, buffer, &buffer_index)) {
+        bc_end_grouped_changes(&buffer->changes);
+    }
+
+    if (re_enable_msgs) {
+        se_enable_msgs(sess);
+    }
+
+    RETURN_IF_FAIL(status);
+
+    if (target != MT_CURSOR) {
+        char msg[MAX_MSG_SIZE];
+        snprintf(msg, MAX_MSG_SIZE, "Macro played %s %zu %s",
+                 target == MT_LINES ? "on" : "at", play_num,
+                 target == MT_LINES ? "lines" : "matches");
+        se_add_msg(sess, msg);
+    }
+
+    return bf_update_large_file_window(sess->active_buffer);
+}
+
+static Status cm_play_macro(Session *sess, int *finished)
+{
+    sess->macro_step = 0;
+    return cm_run_macro_steps(sess, finished);
+}
+
+/* Play the macro with the cursor at the start of each selected line, or
+ * each line in the buffer when there is no selection. Marks track the
+ * next and last lines as the macro can add or remove lines */
+static Status cm_play_macro_on_lines(Session *sess, Buffer *buffer,
+                                     int *finished, size_t *play_num)
+{
+    Range range;
+
+    if (!bf_get_range(buffer, &range)) {
+        range.start = range.end = buffer->pos;
+        bp_to_buffer_start(&range.start);
+        bp_to_buffer_end(&range.end);
+    }
+
+    /* A range ending at the start of a line doesn't include that line,
+     * e.g. the empty line after the trailing new line of a file */
+    if (range.end.line_no > range.start.line_no &&
+        bp_at_line_start(&range.end)) {
+        bp_prev_line(&range.end);
+    }
+
+    RETURN_IF_FAIL(bf_select_reset(buffer));
+
+    BufferPos next = range.start;
+    BufferPos last = range.end;
+    bp_to_line_start(&next);
+    bp_to_line_start(&last);
+
+    RETURN_IF_FAIL(bf_add_new_mark(buffer, &next, MP_NONE));
+    Status status = bf_add_new_mark(buffer, &last, MP_NONE);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        bf_remove_pos_mark(buffer, &next, 1);
+        return status;
+    }
+
+    int is_last_line;
+
+    do {
+        status = bf_set_bp(buffer, &next, 0);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        is_last_line = next.offset >= last.offset;
+
+        if (!is_last_line) {
+            bp_next_line(&next);
+        }
+
+        status = cm_play_macro(sess, finished);
+        (*play_num)++;
+    } while (STATUS_IS_SUCCESS(status) && !is_last_line && !*finished &&
+             !se_has_errors(sess) && sess->active_buffer == buffer);
+
+    size_t buffer_index;
+
+    /* The macro may have closed the buffer */
+    if (se_get_buffer_index(sess, buffer, &buffer_index)) {
+        bf_remove_pos_mark(buffer, &next, 1);
+        bf_remove_pos_mark(buffer, &last, 1);
+    }
+
+    return status;
+}
+
+/* Play the macro with the cursor at the start of each match of the last
+ * search. Searching resumes from the end of the match the macro was
+ * played at, so text the macro inserts isn't searched */
+static Status cm_play_macro_at_matches(Session *sess, Buffer *buffer,
+                                       int *finished, size_t *play_num)
+{
+    BufferSearch *search = &buffer->search;
+    int direction = search->opt.forward;
+    BufferPos resume = buffer->pos;
+    bp_to_buffer_start(&resume);
+
+    RETURN_IF_FAIL(bf_select_reset(buffer));
+    RETURN_IF_FAIL(bf_add_new_mark(buffer, &resume, MP_NONE));
+
+    search->opt.forward = 1;
+    bs_reset(search, &resume);
+    search->advance_from_last_match = 1;
+
+    Status status;
+    int found_match;
+
+    do {
+        status = bs_find_next(search, &resume, &found_match);
+
+        /* A match found after wrapping has already been visited */
+        if (!STATUS_IS_SUCCESS(status) || !found_match || search->wrapped) {
+            break;
+        }
+
+        status = bf_set_bp(buffer, &search->last_match_pos, 0);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        resume = search->last_match_pos;
+        bp_advance_to_offset(&resume, resume.offset + bs_match_length(search));
+
+        status = cm_play_macro(sess, finished);
+        (*play_num)++;
+    } while (STATUS_IS_SUCCESS(status) && !*finished &&
+             !se_has_errors(sess) && sess->active_buffer == buffer);
+
+    size_t buffer_index;
+
+    /* The macro may have closed the buffer */
+    if (se_get_buffer_index(sess, buffer, &buffer_index)) {
+        bf_remove_pos_mark(buffer, &resume, 1);
+        bs_reset(search, NULL);
+        search->opt.forward = direction;
+    }
+
+    return status;
+}
+
+/* Run the macro's steps from the current one until they've all been run or
+ * the prompt they're entered into has finished */
+static Status cm_run_macro_steps(Session *sess, int *finished)
+{
+    const Macro *macro = &sess->macro;
+    Status status = STATUS_SUCCESS;
+
+    while (sess->macro_step < macro->step_num && !*finished) {
+        /* Advance first as an operation which opens a prompt
+         * runs the following steps itself */
+        const MacroStep *step = &macro->steps[sess->macro_step++];
+
+        if (step->type == MST_OPERATION) {
+            const OperationDefinition *operation = &cm_operations[step->op];
+
+            if (!sess->key_map.active_op_modes[operation->op_mode]) {
+                status = st_get_error(ERR_INVALID_OPERATION_KEY_STRING,
+                                      "Operation \"%s\" cannot be "
+                                      "used in this context", step->text);
+            } else {
+                status = cm_run_operation(sess, step->op, step->text,
+                                          finished);
+            }
+        } else if (se_command_type_excluded(sess, CMDT_BUFFER_MOD)) {
+            continue;
+        } else if (step->type == MST_INSERT_KEY) {
+            status = cm_insert_key(sess, step->text);
+        } else {
+            status = cm_insert_typed_text(sess, step->text, step->text_len);
+        }
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            /* The rest of the macro isn't played */
+            sess->macro_step = macro->step_num;
+            break;
+        }
+    }
+
+    return status;
+}
+
+static int cm_macro_has_command(const Macro *macro, Command command)
+{
+    for (size_t k = 0; k < macro->step_num; k++) {
+        const MacroStep *step = &macro->steps[k];
+
+        if (step->type == MST_OPERATION &&
+            cm_operations[step->op].command == command) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Called in place of reading user input when a macro opens a prompt. The
+ * macro's steps are entered into the prompt. If the macro ends before the
+ * prompt is finished the prompt is cancelled */
+void cm_process_macro_input(Session *sess)
+{
+    int finished = 0;
+
+    se_add_error(sess, cm_run_macro_steps(sess, &finished));
+
+    if (!finished && se_prompt_active(sess)) {
+        pr_prompt_set_cancelled(sess->prompt, 1);
+    }
+}
@@ -101,7 +101,24 @@ typedef enum {
     CMD_BUFFER_FILTER,
     CMD_BUFFER_READ,
     CMD_BUFFER_WRITE,
-    CMD_SESSION_EXEC
+    CMD_SESSION_EXEC,
+    CMD_SESSION_JOBS,
+    CMD_SESSION_KILL_JOB,
+    CMD_SESSION_GREP,
+    CMD_SESSION_FILE_SEARCH_SELECT,
+    CMD_SESSION_FIND_FILE,
+    CMD_BUFFER_INSERT_PASTED_TEXT,
+    CMD_SESSION_TRACE,
+    CMD_SESSION_TRACE_DUMP,
+    CMD_SESSION_MEMINFO,
+    CMD_SESSION_MEMCOMPACT,
+    CMD_BUFFER_ADD_CURSOR_ON_LINE,
+    CMD_BUFFER_ADD_CURSORS_AT_MATCHES,
+    CMD_BUFFER_CLEAR_CURSORS,
+    CMD_BUFFER_TOGGLE_BLOCK_SELECT,
+    CMD_SESSION_FOLLOW,
+    CMD_SESSION_RECORD_MACRO,
+    CMD_BUFFER_PLAY_MACRO
 } Command;
 
 /* Operations are instances of commands i.e. they define a command with
@@ -200,7 +217,19 @@ typedef enum {
     OP_FILE_EXPLORER_SELECT,
     OP_FILE_EXPLORER_QUIT,
     OP_FILE_EXPLORER_EXIT_WED,
-    OP_FILE_EXPLORER_CLICK_SELECT
+    OP_FILE_EXPLORER_CLICK_SELECT,
+    OP_FILE_SEARCH_SELECT,
+    OP_FIND_FILE,
+    OP_INSERT_PASTED_TEXT,
+    OP_ADD_CURSOR_PREV_LINE,
+    OP_ADD_CURSOR_NEXT_LINE,
+    OP_ADD_CURSORS_AT_MATCHES,
+    OP_CLEAR_CURSORS,
+    OP_TOGGLE_BLOCK_SELECT,
+    OP_RECORD_MACRO,
+    OP_PLAY_MACRO,
+    OP_PLAY_MACRO_ON_LINES,
+    OP_PLAY_MACRO_AT_MATCHES
 } Operation;
 
 /* Container structure for Command arguments */
@@ -274,7 +303,8 @@ typedef enum {
     OMM_PROMPT           = 1 << 2,
     OMM_PROMPT_COMPLETER = 1 << 3,
     OMM_USER             = 1 << 4,
-    OMM_FILE_EXPLORER    = 1 << 5
+    OMM_FILE_EXPLORER    = 1 << 5,
+    OMM_FILE_SEARCH      = 1 << 6
 } OperationModeMap;
 
 typedef enum {
@@ -284,6 +314,7 @@ typedef enum {
     OM_PROMPT_COMPLETER, /* Prompt with auto complete functionality is open */
     OM_USER, /* User defined mappings */
     OM_FILE_EXPLORER, /* File Explorer is active */
+    OM_FILE_SEARCH, /* File search results buffer is active */
     OM_ENTRY_NUM
 } OperationMode;
 
@@ -293,6 +324,11 @@ typedef struct {
     OperationMode prev_op_mode; /* The previously active operation mode */
     int active_op_modes[OM_ENTRY_NUM]; /* Track which modes are active */
     RadixTree *maps[OM_ENTRY_NUM]; /* Key bindings for each mode */
+    FrozenRadixTree *frozen_maps[OM_ENTRY_NUM]; /* Bindings of the modes
+                                                   active in each operation
+                                                   mode merged into a
+                                                   single map. Built when
+                                                   the mode is entered */
 } KeyMap;
 
 /* A key mapping can either bind a key directly to an operation or to another
@@ -338,7 +374,14 @@ void cm_set_operation_mode(KeyMap *, OperationMode);
 Status cm_do_operation(struct Session *, const char *key, int *finished);
 int cm_is_valid_operation(const struct Session *, const char *key,
                           size_t key_len, int *is_prefix);
+const char *cm_get_inserted_text(const struct Session *, const char *key);
+Status cm_insert_typed_text(struct Session *, const char *text,
+                            size_t text_len);
+const char *cm_get_operation_name(const struct Session *, const char *key);
+void cm_process_macro_input(struct Session *);
 Status cm_do_command(Command cmd, CommandArgs *cmd_args);
+int cm_update_incremental_search(struct Session *, int *search_pending);
+int cm_offer_buffer_recovery(struct Session *);
 int cm_get_command(const char *function_name, Command *cmd);
 Status cm_generate_keybinding_table(HelpTable *);
 Status cm_generate_command_table(HelpTable *);
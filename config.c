@@ -41,12 +41,10 @@
 
 static Status cf_path_append(const char *path, const char *append,
                              char **result);
-static void cf_free_cvd(ConfigVariableDescriptor *);
 static const char *cf_get_config_type_string(ConfigType);
 static Status cf_is_valid_var(ConfigEntity, ConfigLevel, ConfigVariable,
-                              ConfigVariableDescriptor **var_ptr);
-static const ConfigVariableDescriptor *cf_get_variable(const HashMap *config,
-                                                       ConfigVariable);
+                              Config **config_ptr);
+static const Value *cf_get_value(const Config *, ConfigVariable);
 static const char *cf_get_config_level_str(ConfigLevel);
 static Status cf_tabwidth_validator(ConfigEntity, Value);
 static Status cf_fileexplorerwidth_validator(ConfigEntity, Value);
@@ -58,6 +56,9 @@ static Status cf_syntaxtype_on_change_event(ConfigEntity, Value, Value);
 static Status cf_syntaxhorizon_validator(ConfigEntity, Value);
 static Status cf_syntaxhorizon_on_change_event(ConfigEntity entity,
                                                Value, Value);
+static Status cf_largefile_validator(ConfigEntity, Value);
+static Status cf_followlines_validator(ConfigEntity, Value);
+static Status cf_buffermemory_validator(ConfigEntity, Value);
 static Status cf_theme_validator(ConfigEntity, Value);
 static Status cf_theme_on_change_event(ConfigEntity, Value, Value);
 static Status cf_fileformat_validator(ConfigEntity, Value);
@@ -84,6 +85,10 @@ static const ConfigVariableDescriptor cf_default_config[CV_ENTRY_NUM] = {
     [CV_FILE_EXPLORER] = { "fileexplorer", "fe" , CL_SESSION , BOOL_VAL_STRUCT(1), NULL, NULL, "Enables/Disables file explorer visibility" },
     [CV_FILE_EXPLORER_WIDTH] = { "fileexplorerwidth", "few" , CL_SESSION , INT_VAL_STRUCT(CFG_FILE_EXPLORER_WIDTH_DEFAULT), cf_fileexplorerwidth_validator, NULL, "Sets the file explorer width in columns" },
     [CV_FILE_EXPLORER_POSITION] = { "fileexplorerposition", "fep" , CL_SESSION , STR_VAL_STRUCT(CFG_FILE_EXPLORER_POSITION_LEFT), cf_fileexplorerposition_validator, NULL, "Sets the file explorer position" },
+    [CV_LARGEFILE] = { "largefile", "lf" , CL_SESSION , INT_VAL_STRUCT(CFG_LARGEFILE_DEFAULT), cf_largefile_validator, NULL, "Size in MB from which files are loaded a window at a time (0 disables)" },
+    [CV_FOLLOWLINES] = { "followlines", "fl" , CL_SESSION , INT_VAL_STRUCT(CFG_FOLLOWLINES_DEFAULT), cf_followlines_validator, NULL, "Maximum lines kept in a buffer following its file (0 for no limit)" },
+    [CV_BUFFERMEMORY] = { "buffermemory", "bm" , CL_SESSION , INT_VAL_STRUCT(CFG_BUFFERMEMORY_DEFAULT), cf_buffermemory_validator, NULL, "Memory in MB used by buffers before inactive unmodified buffers are unloaded (0 for no limit)" },
+    [CV_JOURNAL] = { "journal", "jn" , CL_SESSION , BOOL_VAL_STRUCT(1), NULL, NULL, "Enables/Disables journalling changes to files so they can be recovered" },
     [CV_FILETYPE] = { "filetype" , "ft" , CL_BUFFER , STR_VAL_STRUCT("") , cf_filetype_validator , cf_filetype_on_change_event, "Sets the type of the current file" },
     [CV_SYNTAXTYPE] = { "syntaxtype", "st" , CL_BUFFER , STR_VAL_STRUCT("") , cf_syntaxtype_validator, cf_syntaxtype_on_change_event, "Set the syntax definition to use for highlighting" },
     [CV_FILEFORMAT] = { "fileformat", "ff" , CL_BUFFER , STR_VAL_STRUCT("unix") , cf_fileformat_validator, cf_fileformat_on_change_event, "Sets line endings used by file" }
@@ -117,18 +122,17 @@ ConfigLevel cf_get_config_levels(ConfigVariable config_variable)
     return cf_default_config[config_variable].config_levels;
 }
 
+const char *cf_get_var_name(ConfigVariable config_variable)
+{
+    assert(config_variable < CV_ENTRY_NUM);
+    return cf_default_config[config_variable].name;
+}
+
 /* This function runs on session creation */
 Status cf_init_session_config(Session *sess)
 {
-    HashMap *config = sess->config;
-
-    if (config == NULL) {
-        /* We know the hashmap size so ensure we have a low load
-         * factor and don't have to resize the hashmap */
-        config = sess->config = new_sized_hashmap(cf_var_num * 2);
-    }
-
-    if (!cf_populate_config(NULL, config, CL_SESSION)) {
+    if (sess->config == NULL &&
+        (sess->config = cf_new_config(NULL, CL_SESSION)) == NULL) {
         return OUT_OF_MEMORY("Unable to load config");
     }
     
@@ -166,74 +170,54 @@ Status cf_init_session_config(Session *sess)
     return STATUS_SUCCESS;
 }
 
-void cf_free_config(HashMap *config)
-{
-    if (config == NULL) {
-        return;
-    }
-
-    for (size_t k = 0; k < cf_var_num; k++) {
-        ConfigVariableDescriptor *cvd = hashmap_get(config,
-                                                    cf_default_config[k].name);
-        cf_free_cvd(cvd);
-    }
-
-    free_hashmap(config);
-}
-
-static void cf_free_cvd(ConfigVariableDescriptor *cvd)
+/* Create a config containing the variables which can be set at
+ * config_level. Values are copied from parent when it contains them,
+ * otherwise default values are used */
+Config *cf_new_config(const Config *parent, ConfigLevel config_level)
 {
-    if (cvd == NULL) {
-        return;
-    }
+    Config *config = malloc(sizeof(Config));
+    RETURN_IF_NULL(config);
 
-    va_free_value(cvd->default_value);
-    free(cvd);
-}
+    memset(config, 0, sizeof(Config));
+    config->parent = parent;
+    config->config_level = config_level;
 
-/* Initialise config from existing config
- * i.e. populate buffer config from session config */
-int cf_populate_config(const HashMap *src_config, HashMap *dst_config, 
-                       ConfigLevel config_level)
-{
-    ConfigVariableDescriptor *clone;
-    const ConfigVariableDescriptor *orig;
+    const Value *value;
 
     for (size_t k = 0; k < cf_var_num; k++) {
         if (!(cf_default_config[k].config_levels & config_level)) {
             continue;
         }
 
-        clone = malloc(sizeof(ConfigVariableDescriptor));
-
-        if (clone == NULL) {
-            return 0;
-        }
-
-        if (src_config == NULL) {
-            orig = &cf_default_config[k];
+        if (parent != NULL) {
+            value = cf_get_value(parent, k);
         } else {
-            orig = hashmap_get(src_config, cf_default_config[k].name);
+            value = &cf_default_config[k].default_value;
+        }
 
-            if (orig == NULL) {
-                orig = &cf_default_config[k];
-            }
+        if (!STATUS_IS_SUCCESS(va_deep_copy_value(*value,
+                                                  &config->values[k]))) {
+            cf_free_config(config);
+            return NULL;
         }
+    }
 
-        memcpy(clone, orig, sizeof(ConfigVariableDescriptor));
+    return config;
+}
 
-        if (!STATUS_IS_SUCCESS(va_deep_copy_value(clone->default_value,
-                                                  &clone->default_value))) {
-            return 0;
-        }
+void cf_free_config(Config *config)
+{
+    if (config == NULL) {
+        return;
+    }
 
-        if (!(hashmap_set(dst_config, clone->name, clone) && 
-              hashmap_set(dst_config, clone->short_name, clone))) {
-            return 0;
+    for (size_t k = 0; k < cf_var_num; k++) {
+        if (cf_default_config[k].config_levels & config->config_level) {
+            va_free_value(config->values[k]);
         }
     }
 
-    return 1;
+    free(config);
 }
 
 static const char *cf_get_config_type_string(ConfigType config_type)
@@ -357,21 +341,24 @@ Status cf_set_named_var(ConfigEntity entity, ConfigLevel config_level,
 Status cf_set_var(ConfigEntity entity, ConfigLevel config_level, 
                   ConfigVariable config_variable, Value value)
 {
-    ConfigVariableDescriptor *var;
+    const ConfigVariableDescriptor *var = &cf_default_config[config_variable];
+    Config *config;
 
     RETURN_IF_FAIL(cf_is_valid_var(entity, config_level,
-                                   config_variable, &var));
+                                   config_variable, &config));
+
+    Value *var_value = &config->values[config_variable];
 
-    if (var->default_value.type != value.type) {
+    if (var_value->type != value.type) {
         /* Allow Boolean variables to be set with integer values */
-        if (var->default_value.type == VAL_TYPE_BOOL &&
+        if (var_value->type == VAL_TYPE_BOOL &&
             value.type == VAL_TYPE_INT) {
             value = BOOL_VAL(IVAL(value) ? 1 : 0);
         } else {
             return st_get_error(ERR_INVALID_VAL,
                                 "%s must have value of type %s",
                                 var->name,
-                                va_get_value_type(var->default_value));
+                                va_get_value_type(*var_value));
         }
     }
 
@@ -379,8 +366,9 @@ Status cf_set_var(ConfigEntity entity, ConfigLevel config_level,
         RETURN_IF_FAIL(var->custom_validator(entity, value));
     }
 
-    Value old_value = var->default_value;
-    RETURN_IF_FAIL(va_deep_copy_value(value, &var->default_value));
+    Value old_value = *var_value;
+    RETURN_IF_FAIL(va_deep_copy_value(value, var_value));
+    config->version++;
 
     Status status = STATUS_SUCCESS;
 
@@ -405,11 +393,11 @@ Status cf_set_var(ConfigEntity entity, ConfigLevel config_level,
 
 static Status cf_is_valid_var(ConfigEntity entity, ConfigLevel config_level, 
                               ConfigVariable config_variable, 
-                              ConfigVariableDescriptor **var_ptr)
+                              Config **config_ptr)
 {
     assert(config_variable < CV_ENTRY_NUM);
 
-    HashMap *config = NULL;
+    Config *config = NULL;
 
     if (config_level & CL_SESSION) {
         config = entity.sess->config;
@@ -421,40 +409,38 @@ static Status cf_is_valid_var(ConfigEntity entity, ConfigLevel config_level,
 
     const char *var_name = cf_default_config[config_variable].name;
 
-    ConfigVariableDescriptor *var = hashmap_get(config, var_name);
-
-    if (var == NULL) {
-        if (!(cf_default_config[config_variable].config_levels &
-              config_level)) {
-            return st_get_error(ERR_INCORRECT_CONFIG_LEVEL, 
-                                "Variable %s can only be referenced "
-                                "at the %s level",
-                                var_name,
-                                (config_level & CL_BUFFER) ?
-                                "session" : "buffer");
-        }
-
-        return st_get_error(ERR_INVALID_VAR,
-                            "Invalid config variable %s", var_name);
+    if (!(cf_default_config[config_variable].config_levels &
+          config->config_level)) {
+        return st_get_error(ERR_INCORRECT_CONFIG_LEVEL, 
+                            "Variable %s can only be referenced "
+                            "at the %s level",
+                            var_name,
+                            (config_level & CL_BUFFER) ?
+                            "session" : "buffer");
     }
 
-    *var_ptr = var;
+    *config_ptr = config;
 
     return STATUS_SUCCESS;
 }
 
-static const ConfigVariableDescriptor *cf_get_variable(const HashMap *config,
-                                                       ConfigVariable config_var
-                                                      )
+/* Variables which can't be set at the level of config are read from its
+ * parent, or have their default value if config has no parent */
+static const Value *cf_get_value(const Config *config,
+                                 ConfigVariable config_var)
 {
     assert(config_var < CV_ENTRY_NUM);
 
-    const char *var_name = cf_default_config[config_var].name;
-    const ConfigVariableDescriptor *var = hashmap_get(config, var_name);
+    if (!(cf_default_config[config_var].config_levels &
+          config->config_level)) {
+        if (config->parent == NULL) {
+            return &cf_default_config[config_var].default_value;
+        }
 
-    assert(var != NULL);
+        return cf_get_value(config->parent, config_var);
+    }
 
-    return var;
+    return &config->values[config_var];
 }
 
 Status cf_print_var(ConfigEntity entity, ConfigLevel config_level,
@@ -468,47 +454,60 @@ Status cf_print_var(ConfigEntity entity, ConfigLevel config_level,
                             var_name);
     }
 
-    ConfigVariableDescriptor *var;
+    Config *config;
 
     RETURN_IF_FAIL(cf_is_valid_var(entity, config_level,
-                                   config_variable, &var));
+                                   config_variable, &config));
 
+    Value value = config->values[config_variable];
     char var_msg[MAX_MSG_SIZE];
-    char *value_str = va_to_string(var->default_value);
-    ValueType value_type = var->default_value.type;
-    const char *fmt = (value_type == VAL_TYPE_STR ? "%s=\"%s\"" : "%s=%s");
-    snprintf(var_msg, MAX_MSG_SIZE, fmt, var->name, value_str);
+    char *value_str = va_to_string(value);
+    const char *fmt = (value.type == VAL_TYPE_STR ? "%s=\"%s\"" : "%s=%s");
+    snprintf(var_msg, MAX_MSG_SIZE, fmt,
+             cf_default_config[config_variable].name, value_str);
     free(value_str);
     se_add_msg(entity.sess, var_msg);
 
     return STATUS_SUCCESS;
 }
 
-int cf_bool(const HashMap *config, ConfigVariable config_var)
+int cf_bool(const Config *config, ConfigVariable config_var)
+{
+    const Value *value = cf_get_value(config, config_var);
+
+    assert(value->type == VAL_TYPE_BOOL);
+
+    return BVAL(*value);
+}
+
+long cf_int(const Config *config, ConfigVariable config_var)
 {
-    const ConfigVariableDescriptor *var = cf_get_variable(config, config_var);
+    const Value *value = cf_get_value(config, config_var);
 
-    assert(var->default_value.type == VAL_TYPE_BOOL);
+    assert(value->type == VAL_TYPE_INT);
 
-    return BVAL(var->default_value);
+    return IVAL(*value);
 }
 
-long cf_int(const HashMap *config, ConfigVariable config_var)
+const char *cf_string(const Config *config, ConfigVariable config_var)
 {
-    const ConfigVariableDescriptor *var = cf_get_variable(config, config_var);
+    const Value *value = cf_get_value(config, config_var);
 
-    assert(var->default_value.type == VAL_TYPE_INT);
+    assert(value->type == VAL_TYPE_STR);
 
-    return IVAL(var->default_value);
+    return SVAL(*value);
 }
 
-const char *cf_string(const HashMap *config, ConfigVariable config_var)
+/* Changes each time a variable in config or one of its parents is set */
+size_t cf_version(const Config *config)
 {
-    const ConfigVariableDescriptor *var = cf_get_variable(config, config_var);
+    size_t version = 0;
 
-    assert(var->default_value.type == VAL_TYPE_STR);
+    for (; config != NULL; config = config->parent) {
+        version += config->version;
+    }
 
-    return SVAL(var->default_value);
+    return version;
 }
 
 Status cf_generate_variable_table(HelpTable *help_table)
@@ -704,6 +703,45 @@ static Status cf_syntaxhorizon_on_change_event(ConfigEntity entity,
     return STATUS_SUCCESS;
 }
 
+static Status cf_largefile_validator(ConfigEntity entity, Value value)
+{
+    (void)entity;
+
+    if (IVAL(value) < CFG_LARGEFILE_MIN) {
+        return st_get_error(ERR_INVALID_LARGEFILE,
+                            "largefile must be at least %d",
+                            CFG_LARGEFILE_MIN);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status cf_followlines_validator(ConfigEntity entity, Value value)
+{
+    (void)entity;
+
+    if (IVAL(value) < CFG_FOLLOWLINES_MIN) {
+        return st_get_error(ERR_INVALID_FOLLOWLINES,
+                            "followlines must be at least %d",
+                            CFG_FOLLOWLINES_MIN);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status cf_buffermemory_validator(ConfigEntity entity, Value value)
+{
+    (void)entity;
+
+    if (IVAL(value) < CFG_BUFFERMEMORY_MIN) {
+        return st_get_error(ERR_INVALID_BUFFERMEMORY,
+                            "buffermemory must be at least %d",
+                            CFG_BUFFERMEMORY_MIN);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static Status cf_theme_validator(ConfigEntity entity, Value value)
 {
     if (!se_is_valid_theme(entity.sess, SVAL(value))) {
@@ -21,7 +21,6 @@
 
 #include "value.h"
 #include "status.h"
-#include "hashmap.h"
 #include "session.h"
 #include "buffer.h"
 
@@ -46,6 +45,15 @@
 #define CFG_SYNTAX_HORIZON_DEFAULT 20
 #define CFG_SYNTAX_HORIZON_MIN 0
 
+#define CFG_LARGEFILE_DEFAULT 256
+#define CFG_LARGEFILE_MIN 0
+
+#define CFG_FOLLOWLINES_DEFAULT 0
+#define CFG_FOLLOWLINES_MIN 0
+
+#define CFG_BUFFERMEMORY_DEFAULT 0
+#define CFG_BUFFERMEMORY_MIN 0
+
 /* Some variables apply at the session and buffer levels
  * e.g. ln=0; in ~/.wedrc turns off line numbers for all buffers.
  * However when in wed typing <C-\>ln=0; only affects the active buffer.
@@ -85,12 +93,32 @@ typedef enum {
     CV_FILE_EXPLORER,
     CV_FILE_EXPLORER_WIDTH,
     CV_FILE_EXPLORER_POSITION,
+    CV_LARGEFILE,
+    CV_FOLLOWLINES,
+    CV_BUFFERMEMORY,
+    CV_JOURNAL,
     CV_FILETYPE,
     CV_SYNTAXTYPE,
     CV_FILEFORMAT,
     CV_ENTRY_NUM
 } ConfigVariable;
 
+typedef struct Config Config;
+
+/* The values of config variables at a single level. Values are stored in
+ * an array indexed by ConfigVariable so reading a variable doesn't require
+ * its name to be hashed. Variables which can't be set at this level are
+ * read from the parent config, e.g. a buffer config reads session only
+ * variables from the session config */
+struct Config {
+    const Config *parent; /* Config variables are inherited from or NULL */
+    ConfigLevel config_level; /* Level of variables stored in values */
+    size_t version; /* Incremented each time a variable is set, so values
+                       derived from config can be cached */
+    Value values[CV_ENTRY_NUM]; /* Only variables that can be set at
+                                   config_level are populated */
+};
+
 /* Container struct */
 typedef struct {
     Session *sess; /* Session ref */
@@ -118,19 +146,20 @@ typedef struct {
 
 int cf_str_to_var(const char *str, ConfigVariable *);
 ConfigLevel cf_get_config_levels(ConfigVariable);
+const char *cf_get_var_name(ConfigVariable);
 Status cf_init_session_config(Session *);
-int cf_populate_config(const HashMap *src_config, HashMap *dst_config,
-                       ConfigLevel);
+Config *cf_new_config(const Config *parent, ConfigLevel);
 void cf_load_config_def(Session *, ConfigType, const char *config_name);
-void cf_free_config(HashMap *config);
+void cf_free_config(Config *);
 Status cf_load_config(Session *, const char *config_file_path);
 Status cf_load_config_if_exists(Session *, const char *dir, const char *file);
 Status cf_set_named_var(ConfigEntity, ConfigLevel, char *var_name, Value);
 Status cf_set_var(ConfigEntity, ConfigLevel, ConfigVariable, Value);
 Status cf_print_var(ConfigEntity, ConfigLevel, const char *var_name);
-int cf_bool(const HashMap *config, ConfigVariable);
-long cf_int(const HashMap *config, ConfigVariable);
-const char *cf_string(const HashMap *config, ConfigVariable);
+int cf_bool(const Config *, ConfigVariable);
+long cf_int(const Config *, ConfigVariable);
+const char *cf_string(const Config *, ConfigVariable);
+size_t cf_version(const Config *);
 Status cf_generate_variable_table(HelpTable *);
 void cf_free_variable_table(HelpTable *);
 
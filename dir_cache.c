@@ -0,0 +1,761 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* For DT_DIR, DT_UNKNOWN and dirfd */
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "dir_cache.h"
+#include "util.h"
+
+/* Number of directories whose listings are kept */
+#define DC_MAX_LISTINGS 16
+/* Initial size of the buffer entry names are read into */
+#define DC_NAMES_INIT 4096
+/* Number of entries a listing initially has space for */
+#define DC_ENTRIES_INIT 64
+/* Number of entries read between checks for cancellation */
+#define DC_CANCEL_CHECK_INTERVAL 256
+
+#ifdef __linux__
+#define DC_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                         IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+                         IN_ONLYDIR)
+#endif
+
+/* A directory read on a worker thread. The entries read replace those of
+ * listing once the read has finished */
+typedef struct {
+    DirCache *dir_cache; /* Cache the read was started by */
+    DirListing *listing; /* Listing read or NULL if it's been removed */
+    char *dir_path; /* Directory read */
+    char *names; /* Entry names read, each null terminated */
+    size_t names_len; /* Size of names used */
+    size_t names_alloc; /* Size of names allocated */
+    DirCacheEntry *entries; /* Entries read */
+    size_t entry_num; /* Number of entries read */
+    size_t entry_alloc; /* Number of entries allocated */
+    time_t mtime; /* Directory modification time or -1 if unreadable */
+    time_t read_time; /* Time the read started */
+    pthread_t thread; /* Thread reading the directory */
+    Status status; /* Result of the read */
+    int cancelled; /* True if the result is no longer needed */
+    int done; /* True once the read has finished */
+} DirCacheRead;
+
+static DirListing *dc_new_listing(const char *dir_path);
+static void dc_free_listing(DirCache *, DirListing *);
+static int dc_listing_valid(DirListing *);
+static Status dc_start_read(DirCache *, DirListing *);
+static void *dc_read_run(void *);
+static Status dc_read_entries(DirCacheRead *);
+static Status dc_add_entry(DirCacheRead *, int dir_fd,
+                           const struct dirent *);
+static int dc_read_cancelled(DirCacheRead *);
+static int dc_entry_cmp(const void *, const void *);
+static void dc_free_read(DirCacheRead *);
+static Status dc_finish_reads(DirCache *, int wait, int *updated);
+static void dc_add_read_entries(DirCacheRead *);
+static void dc_watch_listing(DirCache *, DirListing *);
+static void dc_read_watch_events(DirCache *);
+
+DirCache *dc_new(void)
+{
+    DirCache *dir_cache = malloc(sizeof(DirCache));
+    RETURN_IF_NULL(dir_cache);
+    memset(dir_cache, 0, sizeof(DirCache));
+
+    dir_cache->notify_fds[0] = dir_cache->notify_fds[1] = -1;
+    dir_cache->watch_fd = -1;
+    dir_cache->listings = list_new();
+    dir_cache->reads = list_new();
+    pthread_mutex_init(&dir_cache->read_lock, NULL);
+
+    if (dir_cache->listings == NULL || dir_cache->reads == NULL ||
+        pipe(dir_cache->notify_fds) == -1) {
+        dir_cache->notify_fds[0] = dir_cache->notify_fds[1] = -1;
+        dc_free(dir_cache);
+        return NULL;
+    }
+
+    /* The main thread drains the pipe without blocking and reading
+     * threads shouldn't block if the pipe is full as the main thread will
+     * already have been notified */
+    for (size_t k = 0; k < 2; k++) {
+        int flags = fcntl(dir_cache->notify_fds[k], F_GETFL);
+
+        if (flags != -1) {
+            fcntl(dir_cache->notify_fds[k], F_SETFL, flags | O_NONBLOCK);
+        }
+    }
+
+#ifdef __linux__
+    /* Without inotify listings are checked using modification times */
+    dir_cache->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    return dir_cache;
+}
+
+void dc_free(DirCache *dir_cache)
+{
+    if (dir_cache == NULL) {
+        return;
+    }
+
+    if (dir_cache->listings != NULL) {
+        while (list_size(dir_cache->listings) > 0) {
+            dc_free_listing(dir_cache, list_pop(dir_cache->listings));
+        }
+    }
+
+    if (dir_cache->reads != NULL) {
+        /* Threads stop reading once they see they've been cancelled */
+        int updated;
+        st_free_status(dc_finish_reads(dir_cache, 1, &updated));
+    }
+
+    for (size_t k = 0; k < 2; k++) {
+        if (dir_cache->notify_fds[k] != -1) {
+            close(dir_cache->notify_fds[k]);
+        }
+    }
+
+    if (dir_cache->watch_fd != -1) {
+        close(dir_cache->watch_fd);
+    }
+
+    pthread_mutex_destroy(&dir_cache->read_lock);
+    list_free(dir_cache->listings);
+    list_free(dir_cache->reads);
+    free(dir_cache);
+}
+
+/* Get the listing of dir_path. listing_ptr is set to NULL if the
+ * directory hasn't been read or has changed since it was read, in which
+ * case it's read in the background */
+Status dc_get_listing(DirCache *dir_cache, const char *dir_path,
+                      DirListing **listing_ptr)
+{
+    DirListing *listing = NULL;
+    *listing_ptr = NULL;
+
+    for (size_t k = 0; k < list_size(dir_cache->listings); k++) {
+        listing = list_get(dir_cache->listings, k);
+
+        if (strcmp(listing->dir_path, dir_path) == 0) {
+            list_remove_at(dir_cache->listings, k);
+            break;
+        }
+
+        listing = NULL;
+    }
+
+    if (listing == NULL) {
+        listing = dc_new_listing(dir_path);
+
+        if (listing == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate directory listing");
+        }
+    }
+
+    /* The most recently used listing is kept last */
+    if (!list_add(dir_cache->listings, listing)) {
+        dc_free_listing(dir_cache, listing);
+        return OUT_OF_MEMORY("Unable to allocate directory listing");
+    }
+
+    if (list_size(dir_cache->listings) > DC_MAX_LISTINGS) {
+        dc_free_listing(dir_cache, list_remove_at(dir_cache->listings, 0));
+    }
+
+    if (!dc_listing_valid(listing)) {
+        if (!listing->reading) {
+            RETURN_IF_FAIL(dc_start_read(dir_cache, listing));
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    *listing_ptr = listing;
+
+    return STATUS_SUCCESS;
+}
+
+/* Wait up to timeout_ms milliseconds for directories being read to
+ * finish being read. A negative timeout waits for all reads */
+Status dc_wait(DirCache *dir_cache, int timeout_ms)
+{
+    int updated;
+
+    if (timeout_ms < 0) {
+        return dc_finish_reads(dir_cache, 1, &updated);
+    }
+
+    struct timespec now, end;
+    get_monotonic_time(&end);
+    end.tv_sec += timeout_ms / 1000;
+    end.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+
+    if (end.tv_nsec >= 1000000000) {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000;
+    }
+
+    while (list_size(dir_cache->reads) > 0) {
+        get_monotonic_time(&now);
+        long remaining_us = (end.tv_sec - now.tv_sec) * 1000000 +
+                            (end.tv_nsec - now.tv_nsec) / 1000;
+
+        if (remaining_us <= 0) {
+            break;
+        }
+
+        struct timeval timeout = {
+            .tv_sec = remaining_us / 1000000,
+            .tv_usec = remaining_us % 1000000
+        };
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(dir_cache->notify_fds[0], &read_fds);
+
+        if (select(dir_cache->notify_fds[0] + 1, &read_fds, NULL, NULL,
+                   &timeout) == -1 && errno != EINTR) {
+            break;
+        }
+
+        RETURN_IF_FAIL(dc_process(dir_cache, &read_fds, &updated));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void dc_add_fds(const DirCache *dir_cache, fd_set *read_fds, int *max_fd)
+{
+    if (list_size(dir_cache->reads) > 0) {
+        int fd = dir_cache->notify_fds[0];
+        FD_SET(fd, read_fds);
+        *max_fd = MAX(*max_fd, fd);
+    }
+
+    if (dir_cache->watch_fd != -1 && list_size(dir_cache->listings) > 0) {
+        FD_SET(dir_cache->watch_fd, read_fds);
+        *max_fd = MAX(*max_fd, dir_cache->watch_fd);
+    }
+}
+
+/* Add the entries of directories that have finished being read to their
+ * listings and mark listings of directories that have changed as stale.
+ * updated is set true if a read finished */
+Status dc_process(DirCache *dir_cache, const fd_set *read_fds, int *updated)
+{
+    *updated = 0;
+
+    if (dir_cache->watch_fd != -1 &&
+        FD_ISSET(dir_cache->watch_fd, read_fds)) {
+        dc_read_watch_events(dir_cache);
+    }
+
+    if (!FD_ISSET(dir_cache->notify_fds[0], read_fds)) {
+        return STATUS_SUCCESS;
+    }
+
+    char buf[64];
+    ssize_t bytes_read;
+
+    do {
+        bytes_read = read(dir_cache->notify_fds[0], buf, sizeof(buf));
+    } while (bytes_read > 0 || (bytes_read == -1 && errno == EINTR));
+
+    return dc_finish_reads(dir_cache, 0, updated);
+}
+
+/* Find the entries whose name contains query. When query contains the
+ * previous query only the entries that matched it are checked. The
+ * indexes of matching entries are stored in listing->matches */
+Status dc_find(DirListing *listing, const char *query, size_t query_len)
+{
+    if (listing->matches == NULL) {
+        listing->matches = malloc(MAX(listing->entry_num, 1) *
+                                  sizeof(size_t));
+
+        if (listing->matches == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate matches");
+        }
+
+        free(listing->query);
+        listing->query = NULL;
+    }
+
+    const int narrow = listing->query != NULL &&
+                       query_len >= listing->query_len &&
+                       strstr(query, listing->query) != NULL;
+    char *new_query = malloc(query_len + 1);
+
+    if (new_query == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate query");
+    }
+
+    memcpy(new_query, query, query_len);
+    new_query[query_len] = '\0';
+
+    const size_t candidate_num = narrow ? listing->match_num
+                                        : listing->entry_num;
+    size_t match_num = 0;
+    size_t index;
+
+    for (size_t k = 0; k < candidate_num; k++) {
+        index = narrow ? listing->matches[k] : k;
+
+        if (query_len == 0 ||
+            strstr(listing->entries[index].name, new_query) != NULL) {
+            listing->matches[match_num++] = index;
+        }
+    }
+
+    free(listing->query);
+    listing->query = new_query;
+    listing->query_len = query_len;
+    listing->match_num = match_num;
+
+    return STATUS_SUCCESS;
+}
+
+static DirListing *dc_new_listing(const char *dir_path)
+{
+    DirListing *listing = malloc(sizeof(DirListing));
+    RETURN_IF_NULL(listing);
+    memset(listing, 0, sizeof(DirListing));
+
+    if ((listing->dir_path = strdup(dir_path)) == NULL) {
+        free(listing);
+        return NULL;
+    }
+
+    listing->watch_wd = -1;
+
+    return listing;
+}
+
+static void dc_free_listing(DirCache *dir_cache, DirListing *listing)
+{
+    if (listing == NULL) {
+        return;
+    }
+
+    DirCacheRead *dir_read;
+
+    /* A read in progress finishes in the background and is discarded */
+    for (size_t k = 0; k < list_size(dir_cache->reads); k++) {
+        dir_read = list_get(dir_cache->reads, k);
+
+        if (dir_read->listing == listing) {
+            pthread_mutex_lock(&dir_cache->read_lock);
+            dir_read->cancelled = 1;
+            pthread_mutex_unlock(&dir_cache->read_lock);
+            dir_read->listing = NULL;
+        }
+    }
+
+#ifdef __linux__
+    if (listing->watch_wd != -1) {
+        inotify_rm_watch(dir_cache->watch_fd, listing->watch_wd);
+    }
+#endif
+
+    free(listing->dir_path);
+    free(listing->names);
+    free(listing->entries);
+    free(listing->query);
+    free(listing->matches);
+    free(listing);
+}
+
+/* A watched directory is valid until an event is received for it. Other
+ * directories are valid whilst their modification time is unchanged,
+ * unless they were modified in the same second they were read as then
+ * later changes in that second can't be detected */
+static int dc_listing_valid(DirListing *listing)
+{
+    if (!listing->listed || listing->stale) {
+        return 0;
+    }
+
+    if (listing->fresh || listing->watch_wd != -1) {
+        /* A listing that has just been read is always used so that
+         * completion waiting for it can't trigger another read */
+        listing->fresh = 0;
+        return 1;
+    }
+
+    struct stat file_stat;
+
+    if (stat(listing->dir_path, &file_stat) == -1) {
+        listing->stale = listing->mtime != -1;
+    } else {
+        listing->stale = file_stat.st_mtime != listing->mtime ||
+                         listing->mtime >= listing->read_time;
+    }
+
+    return !listing->stale;
+}
+
+static Status dc_start_read(DirCache *dir_cache, DirListing *listing)
+{
+    DirCacheRead *dir_read = malloc(sizeof(DirCacheRead));
+
+    if (dir_read == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate directory read");
+    }
+
+    memset(dir_read, 0, sizeof(DirCacheRead));
+    dir_read->dir_cache = dir_cache;
+    dir_read->listing = listing;
+
+    if ((dir_read->dir_path = strdup(listing->dir_path)) == NULL ||
+        !list_add(dir_cache->reads, dir_read)) {
+        dc_free_read(dir_read);
+        return OUT_OF_MEMORY("Unable to allocate directory read");
+    }
+
+    /* Changes made from here on are picked up by the next read */
+    dc_watch_listing(dir_cache, listing);
+    listing->stale = 0;
+
+    int error = pthread_create(&dir_read->thread, NULL, dc_read_run,
+                               dir_read);
+
+    if (error != 0) {
+        list_pop(dir_cache->reads);
+        dc_free_read(dir_read);
+        return st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
+                            "Unable to create thread: %s", strerror(error));
+    }
+
+    listing->reading = 1;
+
+    return STATUS_SUCCESS;
+}
+
+static void *dc_read_run(void *arg)
+{
+    DirCacheRead *dir_read = arg;
+    DirCache *dir_cache = dir_read->dir_cache;
+
+    dir_read->status = dc_read_entries(dir_read);
+
+    if (STATUS_IS_SUCCESS(dir_read->status)) {
+        /* Names are only pointed to once they've all been read, as the
+         * buffer they're read into can move whilst it grows */
+        const char *name = dir_read->names;
+
+        for (size_t k = 0; k < dir_read->entry_num; k++) {
+            dir_read->entries[k].name = name;
+            name += dir_read->entries[k].name_len + 1;
+        }
+
+        qsort(dir_read->entries, dir_read->entry_num, sizeof(DirCacheEntry),
+              dc_entry_cmp);
+    }
+
+    pthread_mutex_lock(&dir_cache->read_lock);
+    dir_read->done = 1;
+    pthread_mutex_unlock(&dir_cache->read_lock);
+
+    /* If the pipe is full the main thread has already been notified */
+    char c = 1;
+    ssize_t written;
+
+    do {
+        written = write(dir_cache->notify_fds[1], &c, 1);
+    } while (written == -1 && errno == EINTR);
+
+    return NULL;
+}
+
+/* A directory that can't be opened is listed without any entries, as
+ * completion is also used to enter paths that don't exist yet */
+static Status dc_read_entries(DirCacheRead *dir_read)
+{
+    dir_read->read_time = time(NULL);
+    dir_read->mtime = -1;
+
+    DIR *dir = opendir(dir_read->dir_path);
+
+    if (dir == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    struct stat file_stat;
+
+    if (fstat(dirfd(dir), &file_stat) == 0) {
+        dir_read->mtime = file_stat.st_mtime;
+    }
+
+    Status status = STATUS_SUCCESS;
+    struct dirent *dir_ent;
+    errno = 0;
+
+    while ((dir_ent = readdir(dir)) != NULL) {
+        if (strcmp(".", dir_ent->d_name) == 0 ||
+            strcmp("..", dir_ent->d_name) == 0) {
+            continue;
+        }
+
+        status = dc_add_entry(dir_read, dirfd(dir), dir_ent);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        if (dir_read->entry_num % DC_CANCEL_CHECK_INTERVAL == 0 &&
+            dc_read_cancelled(dir_read)) {
+            break;
+        }
+
+        errno = 0;
+    }
+
+    if (STATUS_IS_SUCCESS(status) && dir_ent == NULL && errno != 0) {
+        status = st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
+                              "Unable to read from directory - %s",
+                              strerror(errno));
+    }
+
+    closedir(dir);
+
+    return status;
+}
+
+static Status dc_add_entry(DirCacheRead *dir_read, int dir_fd,
+                           const struct dirent *dir_ent)
+{
+    const size_t name_len = strlen(dir_ent->d_name);
+
+    if (dir_read->names_len + name_len + 1 > dir_read->names_alloc) {
+        size_t new_alloc = MAX(dir_read->names_alloc, DC_NAMES_INIT);
+
+        while (dir_read->names_len + name_len + 1 > new_alloc) {
+            new_alloc *= 2;
+        }
+
+        char *names = realloc(dir_read->names, new_alloc);
+
+        if (names == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate directory entries");
+        }
+
+        dir_read->names = names;
+        dir_read->names_alloc = new_alloc;
+    }
+
+    if (dir_read->entry_num == dir_read->entry_alloc) {
+        size_t new_alloc = MAX(dir_read->entry_alloc * 2, DC_ENTRIES_INIT);
+        DirCacheEntry *entries = realloc(dir_read->entries,
+                                         new_alloc * sizeof(DirCacheEntry));
+
+        if (entries == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate directory entries");
+        }
+
+        dir_read->entries = entries;
+        dir_read->entry_alloc = new_alloc;
+    }
+
+    int is_dir = dir_ent->d_type == DT_DIR;
+
+    if (dir_ent->d_type == DT_UNKNOWN) {
+        /* Not all file systems provide the entry type */
+        struct stat file_stat;
+        is_dir = fstatat(dir_fd, dir_ent->d_name, &file_stat,
+                         AT_SYMLINK_NOFOLLOW) == 0 &&
+                 S_ISDIR(file_stat.st_mode);
+    }
+
+    memcpy(dir_read->names + dir_read->names_len, dir_ent->d_name,
+           name_len + 1);
+    dir_read->names_len += name_len + 1;
+
+    DirCacheEntry *entry = &dir_read->entries[dir_read->entry_num++];
+    entry->name = NULL;
+    entry->name_len = name_len;
+    entry->is_dir = is_dir;
+
+    return STATUS_SUCCESS;
+}
+
+static int dc_read_cancelled(DirCacheRead *dir_read)
+{
+    pthread_mutex_lock(&dir_read->dir_cache->read_lock);
+    int cancelled = dir_read->cancelled;
+    pthread_mutex_unlock(&dir_read->dir_cache->read_lock);
+
+    return cancelled;
+}
+
+static int dc_entry_cmp(const void *o1, const void *o2)
+{
+    const DirCacheEntry *entry1 = o1;
+    const DirCacheEntry *entry2 = o2;
+
+    return strcmp(entry1->name, entry2->name);
+}
+
+static void dc_free_read(DirCacheRead *dir_read)
+{
+    free(dir_read->dir_path);
+    free(dir_read->names);
+    free(dir_read->entries);
+    st_free_status(dir_read->status);
+    free(dir_read);
+}
+
+/* Replace the entries of each listing that has finished being read.
+ * When wait is true all reads are waited for */
+static Status dc_finish_reads(DirCache *dir_cache, int wait, int *updated)
+{
+    Status status = STATUS_SUCCESS;
+    DirCacheRead *dir_read;
+    size_t k = 0;
+    int done;
+
+    while (k < list_size(dir_cache->reads)) {
+        dir_read = list_get(dir_cache->reads, k);
+
+        if (!wait) {
+            pthread_mutex_lock(&dir_cache->read_lock);
+            done = dir_read->done;
+            pthread_mutex_unlock(&dir_cache->read_lock);
+
+            if (!done) {
+                k++;
+                continue;
+            }
+        }
+
+        pthread_join(dir_read->thread, NULL);
+        list_remove_at(dir_cache->reads, k);
+
+        if (dir_read->listing != NULL) {
+            dir_read->listing->reading = 0;
+
+            if (STATUS_IS_SUCCESS(dir_read->status)) {
+                dc_add_read_entries(dir_read);
+            } else if (STATUS_IS_SUCCESS(status)) {
+                status = dir_read->status;
+                dir_read->status = STATUS_SUCCESS;
+            }
+        }
+
+        dc_free_read(dir_read);
+        *updated = 1;
+    }
+
+    return status;
+}
+
+/* The entries read are moved into the listing. Matches for the previous
+ * query referred to the old entries so are discarded */
+static void dc_add_read_entries(DirCacheRead *dir_read)
+{
+    DirListing *listing = dir_read->listing;
+
+    free(listing->names);
+    free(listing->entries);
+    free(listing->query);
+    free(listing->matches);
+
+    listing->names = dir_read->names;
+    listing->entries = dir_read->entries;
+    listing->entry_num = dir_read->entry_num;
+    listing->mtime = dir_read->mtime;
+    listing->read_time = dir_read->read_time;
+    listing->query = NULL;
+    listing->query_len = 0;
+    listing->matches = NULL;
+    listing->match_num = 0;
+    listing->listed = 1;
+    listing->fresh = 1;
+
+    dir_read->names = NULL;
+    dir_read->entries = NULL;
+}
+
+static void dc_watch_listing(DirCache *dir_cache, DirListing *listing)
+{
+#ifdef __linux__
+    if (dir_cache->watch_fd != -1 && listing->watch_wd == -1) {
+        listing->watch_wd = inotify_add_watch(dir_cache->watch_fd,
+                                              listing->dir_path,
+                                              DC_WATCH_EVENTS);
+    }
+#else
+    (void)dir_cache;
+    (void)listing;
+#endif
+}
+
+/* Listings of directories that have changed are marked stale so that
+ * they're read again when next used */
+static void dc_read_watch_events(DirCache *dir_cache)
+{
+#ifdef __linux__
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    DirListing *listing;
+    ssize_t bytes_read;
+
+    while ((bytes_read = read(dir_cache->watch_fd, buf, sizeof(buf))) > 0 ||
+           (bytes_read == -1 && errno == EINTR)) {
+        for (ssize_t offset = 0; offset < bytes_read;
+             offset += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)(buf + offset);
+
+            for (size_t k = 0; k < list_size(dir_cache->listings); k++) {
+                listing = list_get(dir_cache->listings, k);
+
+                /* Changes have been missed when the queue overflows */
+                if (!(event->mask & IN_Q_OVERFLOW) &&
+                    listing->watch_wd != event->wd) {
+                    continue;
+                }
+
+                listing->stale = 1;
+
+                if (event->mask & IN_IGNORED) {
+                    /* The directory was removed so isn't watched */
+                    listing->watch_wd = -1;
+                }
+            }
+        }
+    }
+#else
+    (void)dir_cache;
+#endif
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_DIR_CACHE_H
+#define WED_DIR_CACHE_H
+
+#include <time.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include "status.h"
+#include "list.h"
+
+/* A directory cache keeps the entries of recently listed directories so
+ * that path completion doesn't read a directory each time <Tab> is
+ * pressed. Directories are read on a worker thread and the main thread is
+ * notified through a pipe, so a slow file system never blocks input. On
+ * Linux cached directories are watched using inotify and are read again
+ * once they change. Elsewhere a listing is read again when the
+ * directory's modification time changes. Each listing remembers the
+ * entries that matched the last query so that as a file name is typed
+ * only those entries are checked */
+
+/* An entry in a directory */
+typedef struct {
+    const char *name; /* Entry name */
+    size_t name_len; /* Entry name length */
+    int is_dir; /* True if the entry is a directory */
+} DirCacheEntry;
+
+/* The entries of a directory */
+typedef struct {
+    char *dir_path; /* Directory listed */
+    char *names; /* Entry names, each null terminated */
+    DirCacheEntry *entries; /* Entries sorted by name */
+    size_t entry_num; /* Number of entries */
+    time_t mtime; /* Directory modification time when read */
+    time_t read_time; /* Time the directory was read */
+    int watch_wd; /* inotify watch descriptor or -1 if not watched */
+    int listed; /* True once the directory has been read */
+    int stale; /* True if the directory has changed since it was read */
+    int fresh; /* True if the directory was read since it was last used */
+    int reading; /* True whilst the directory is read */
+    char *query; /* Query matches were found for */
+    size_t query_len; /* Length of query */
+    size_t *matches; /* Indexes of entries containing query */
+    size_t match_num; /* Number of matches */
+} DirListing;
+
+typedef struct {
+    List *listings; /* Listings with the most recently used last */
+    List *reads; /* Directories being read */
+    pthread_mutex_t read_lock; /* Guards the done flag of each read */
+    int notify_fds[2]; /* Pipe written to when a read finishes */
+    int watch_fd; /* inotify descriptor or -1 if unavailable */
+    int completion_pending; /* True if a path completion is waiting for a
+                               directory to be read */
+} DirCache;
+
+DirCache *dc_new(void);
+void dc_free(DirCache *);
+Status dc_get_listing(DirCache *, const char *dir_path,
+                      DirListing **listing_ptr);
+Status dc_wait(DirCache *, int timeout_ms);
+void dc_add_fds(const DirCache *, fd_set *read_fds, int *max_fd);
+Status dc_process(DirCache *, const fd_set *read_fds, int *updated);
+Status dc_find(DirListing *, const char *query, size_t query_len);
+
+#endif
@@ -28,14 +28,14 @@
 #include "util.h"
 
 static void en_ascii_char_info(CharInfo *, CharInfoProperties,
-                               const BufferPos *, const HashMap *config,
+                               const BufferPos *, const Config *config,
                                uchar c);
 static int en_utf8_is_valid_character(const BufferPos *,
                                       size_t *char_byte_length);
 static uint en_utf8_code_point(const uchar *character, uint byte_length);
 
 void en_utf8_char_info(CharInfo *char_info, CharInfoProperties cip, 
-                      const BufferPos *pos, const HashMap *config)
+                      const BufferPos *pos, const Config *config)
 {
     memset(char_info, 0, sizeof(CharInfo));
     uchar c = gb_getu_at(pos->data, pos->offset);
@@ -88,7 +88,7 @@ void en_utf8_char_info(CharInfo *char_info, CharInfoProperties cip,
 }
 
 static void en_ascii_char_info(CharInfo *char_info, CharInfoProperties cip,
-                               const BufferPos *pos, const HashMap *config,
+                               const BufferPos *pos, const Config *config,
                                uchar c)
 {
     assert(c < 128);
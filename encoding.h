@@ -22,9 +22,9 @@
 #include <stddef.h>
 #include <assert.h>
 #include "shared.h"
-#include "hashmap.h"
 
 struct BufferPos;
+struct Config;
 
 /* Line endings supported by wed */
 /* There are currently no plans to support the old mac line endings. Use
@@ -51,7 +51,8 @@ typedef struct {
 } CharInfo;
 
 void en_utf8_char_info(CharInfo *, CharInfoProperties,
-                       const struct BufferPos *, const HashMap *config);
+                       const struct BufferPos *,
+                       const struct Config *config);
 size_t en_utf8_previous_char_offset(const struct BufferPos *);
 
 #endif
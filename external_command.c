@@ -16,22 +16,101 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#define _GNU_SOURCE
 #include <unistd.h> 
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
 #include <sys/wait.h>
 #include "external_command.h"
 #include "util.h"
 
 #define SHELL "/bin/sh"
+/* Size of the buffers used to transfer data to and from the child process.
+ * Large buffers significantly reduce the number of system calls and stream
+ * operations required when filtering large amounts of text */
+#define EC_BUF_SIZE (1024 * 1024)
+
+static void ec_set_pipe_size(int fd);
+static void ec_close_fd(ExternalCommand *, size_t index);
 
 /* is: stdin, os: stdout, es: stderr */
 Status ec_run_command(const char *cmd, InputStream *is, OutputStream *os,
                       OutputStream *es, int *cmd_status)
 {
+    ExternalCommand ec;
+    RETURN_IF_FAIL(ec_start_command(&ec, cmd, is, os, es, 0));
+
+    /* If the child exits before consuming all of its input then writing
+     * to its stdin will raise SIGPIPE, so ignore it while the command runs
+     * and treat EPIPE as the end of input instead */
+    struct sigaction sigpipe_action;
+    struct sigaction prev_sigpipe_action;
+    memset(&sigpipe_action, 0, sizeof(sigpipe_action));
+    sigpipe_action.sa_handler = SIG_IGN;
+    int sigpipe_ignored =
+        sigaction(SIGPIPE, &sigpipe_action, &prev_sigpipe_action) != -1;
+
+    Status status = STATUS_SUCCESS;
+    const nfds_t nfds = ARRAY_SIZE(ec.fds, struct pollfd);
+
+    while (!ec_io_finished(&ec)) {
+        int poll_status = poll(ec.fds, nfds, -1); 
+
+        if (poll_status == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            status = st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
+                                  "poll failed: %s", strerror(errno));
+            break;
+        }
+
+        status = ec_process_command(&ec);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+    }
+
+    for (size_t k = 0; k < nfds; k++) {
+        ec_close_fd(&ec, k);
+    }
+
+    int exited;
+    Status wait_status = ec_wait_command(&ec, 1, &exited);
+    ONLY_OVERWRITE_SUCCESS(status, wait_status);
+    *cmd_status = ec.cmd_status;
+
+    ec_free_command(&ec);
+
+    if (sigpipe_ignored) {
+        sigaction(SIGPIPE, &prev_sigpipe_action, NULL);
+    }
+
+    return status;
+}
+
+/* Start running cmd without waiting for it to complete. The caller is then
+ * responsible for calling ec_process_command when any of the file
+ * descriptors in ec->fds are ready. When background is true the command is
+ * run in its own process group so that it and any processes it creates can
+ * be terminated together using ec_terminate_command */
+Status ec_start_command(ExternalCommand *ec, const char *cmd,
+                        InputStream *is, OutputStream *os, OutputStream *es,
+                        int background)
+{
+    memset(ec, 0, sizeof(ExternalCommand));
+
+    for (size_t k = 0; k < ARRAY_SIZE(ec->fds, struct pollfd); k++) {
+        ec->fds[k].fd = -1;
+    }
+
     /* Three Pipes:
      * in_pipe - parent writes to child's stdin
      * out_pipe - parent reads from child's stdout
@@ -84,6 +163,17 @@ Status ec_run_command(const char *cmd, InputStream *is, OutputStream *os,
     } else if (pid == 0) {
         /* Child process */
 
+        /* The signal mask and ignored signals are inherited across
+         * exec, so restore the defaults wed has changed */
+        sigset_t sig_set;
+        sigemptyset(&sig_set);
+        sigprocmask(SIG_SETMASK, &sig_set, NULL);
+        signal(SIGPIPE, SIG_DFL);
+
+        if (background) {
+            setpgid(0, 0);
+        }
+
         int dup_success = dup2(child_in_fd, STDIN_FILENO) != -1 &&
                           dup2(child_out_fd, STDOUT_FILENO) != -1 &&
                           dup2(child_err_out_fd, STDERR_FILENO) != -1;
@@ -110,13 +200,27 @@ Status ec_run_command(const char *cmd, InputStream *is, OutputStream *os,
     close(child_out_fd);
     close(child_err_out_fd);
 
-    struct pollfd fds[] = {
-        { .fd = parent_out_fd   , .events = POLLOUT },
-        { .fd = parent_in_fd    , .events = POLLIN  },
-        { .fd = parent_err_in_fd, .events = POLLIN  }
-    };
+    if (background) {
+        /* Also set the process group in the parent, otherwise a kill sent
+         * before the child has run setpgid would miss it */
+        setpgid(pid, pid);
+    }
 
-    const nfds_t nfds = ARRAY_SIZE(fds, struct pollfd);
+    ec->pid = pid;
+    ec->background = background;
+    ec->is = is;
+    ec->os = os;
+    ec->es = es;
+
+    ec->fds[EC_STDIN] = (struct pollfd) {
+        .fd = parent_out_fd, .events = POLLOUT
+    };
+    ec->fds[EC_STDOUT] = (struct pollfd) {
+        .fd = parent_in_fd, .events = POLLIN
+    };
+    ec->fds[EC_STDERR] = (struct pollfd) {
+        .fd = parent_err_in_fd, .events = POLLIN
+    };
 
     int out_fd_flags = fcntl(parent_out_fd, F_GETFL);
     int in_fd_flags = fcntl(parent_in_fd, F_GETFL);
@@ -143,105 +247,248 @@ Status ec_run_command(const char *cmd, InputStream *is, OutputStream *os,
         goto cleanup;
     }
 
-    OutputStream *output_streams[] = { NULL, os, es };
-    char in_buf[4096];
-    char out_buf[4096];
-    size_t in_bytes;
-    size_t out_bytes;
-    int pending_write = 0;
+    /* The parent shouldn't pass these descriptors on to other commands */
+    fcntl(parent_out_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(parent_in_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(parent_err_in_fd, F_SETFD, FD_CLOEXEC);
+
+    ec_set_pipe_size(parent_out_fd);
+    ec_set_pipe_size(parent_in_fd);
+
+    ec->in_buf = malloc(EC_BUF_SIZE);
+    ec->out_buf = malloc(EC_BUF_SIZE);
+
+    if (ec->in_buf == NULL || ec->out_buf == NULL) {
+        status = OUT_OF_MEMORY("Unable to allocate command buffers");
+        goto cleanup;
+    }
 
     if (is == NULL) {
-        close(fds[0].fd);
-        fds[0].fd = -1;
+        ec_close_fd(ec, EC_STDIN);
     }
 
-    do {
-        int poll_status = poll(fds, nfds, -1); 
+    return STATUS_SUCCESS;
 
-        if (poll_status == -1) {
-            if (errno == EINTR) {
-                continue;
-            }
+cleanup:
+    ec_free_command(ec);
 
-            status = st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
-                                  "poll failed: %s", strerror(errno));
-            break;
-        }
+    return status;
+}
 
-        if (fds[0].fd != -1 && fds[0].revents & POLLOUT) {
-            if (!pending_write) {
-                status = is->read(is, in_buf, sizeof(in_buf), &in_bytes);
-            }
+/* Transfer data between the streams and the child process for any of
+ * ec->fds that have been flagged as ready in revents */
+Status ec_process_command(ExternalCommand *ec)
+{
+    Status status = STATUS_SUCCESS;
+    struct pollfd *in_fd = &ec->fds[EC_STDIN];
+
+    if (in_fd->fd != -1 && in_fd->revents & (POLLOUT | POLLERR)) {
+        if (ec->in_written == ec->in_bytes) {
+            /* All previously read input has been written so read
+             * the next chunk */
+            RETURN_IF_FAIL(ec->is->read(ec->is, ec->in_buf, EC_BUF_SIZE,
+                                        &ec->in_bytes));
+            ec->in_written = 0;
+        }
 
-            if (!STATUS_IS_SUCCESS(status)) {
-                break;
-            } else if (in_bytes == 0) {
-                close(fds[0].fd);
-                fds[0].fd = -1;
-            } else {
-                ssize_t written = write(fds[0].fd, in_buf, in_bytes);
-
-                if (written == -1) {
-                    if (errno != EAGAIN) {
-                        status = st_get_error(
-                                     ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
-                                     "Unable to write to child process "
-                                     "stdin: %s", strerror(errno));
-                        break;
-                    } else {
-                        pending_write = 1;
-                    }
-                } else {
-                    pending_write = 0;
+        if (ec->in_bytes == 0) {
+            ec_close_fd(ec, EC_STDIN);
+        } else {
+            /* The pipe may not be able to accept all of the input
+             * in one write, in which case the remainder is written
+             * the next time the pipe is writable */
+            ssize_t written = write(in_fd->fd, ec->in_buf + ec->in_written,
+                                    ec->in_bytes - ec->in_written);
+
+            if (written == -1) {
+                if (errno == EPIPE) {
+                    /* Child has stopped reading its input */
+                    ec_close_fd(ec, EC_STDIN);
+                } else if (errno != EAGAIN) {
+                    return st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
+                                        "Unable to write to child process "
+                                        "stdin: %s", strerror(errno));
                 }
+            } else {
+                ec->in_written += written;
             }
         }
+    }
 
-        for (size_t k = 1; k < 3; k++) {
-            if (fds[k].fd != -1 && fds[k].revents & (POLLIN | POLLHUP)) {
-                ssize_t read_bytes = read(fds[k].fd, out_buf, sizeof(out_buf));
-
-                if (read_bytes == -1) {
-                    if (errno != EAGAIN) {
-                        status = st_get_error(
-                                     ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
-                                     "Unable to read child process output: %s",
-                                     strerror(errno));
-                        break;
-                    }
-                } else if (read_bytes == 0) {
-                    close(fds[k].fd);
-                    fds[k].fd = -1;
-                } else if (output_streams[k] != NULL) {
-                    status = output_streams[k]->write(output_streams[k],
-                                                      out_buf,
-                                                      read_bytes,
-                                                      &out_bytes);
-
-                    if (!STATUS_IS_SUCCESS(status)) {
-                        break;
-                    }
-                }
+    OutputStream *output_streams[] = { NULL, ec->os, ec->es };
+    size_t out_bytes;
+
+    for (size_t k = EC_STDOUT; k <= EC_STDERR; k++) {
+        struct pollfd *out_fd = &ec->fds[k];
+
+        if (out_fd->fd == -1 || !(out_fd->revents & (POLLIN | POLLHUP))) {
+            continue;
+        }
+
+        ssize_t read_bytes = read(out_fd->fd, ec->out_buf, EC_BUF_SIZE);
+
+        if (read_bytes == -1) {
+            if (errno != EAGAIN) {
+                return st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
+                                    "Unable to read child process output: %s",
+                                    strerror(errno));
             }
+        } else if (read_bytes == 0) {
+            ec_close_fd(ec, k);
+        } else if (output_streams[k] != NULL) {
+            status = output_streams[k]->write(output_streams[k],
+                                              ec->out_buf, read_bytes,
+                                              &out_bytes);
+            RETURN_IF_FAIL(status);
         }
-    } while (!(fds[0].fd == -1 && fds[1].fd == -1 && fds[2].fd == -1));
+    }
 
-cleanup:
-    for (size_t k = 0; k < nfds; k++) {
-        if (fds[k].fd != -1) {
-            close(fds[k].fd);
+    return status;
+}
+
+/* True when the child has closed its output and has no more input to
+ * receive. The child may still need to be waited on */
+int ec_io_finished(const ExternalCommand *ec)
+{
+    for (size_t k = 0; k < ARRAY_SIZE(ec->fds, struct pollfd); k++) {
+        if (ec->fds[k].fd != -1) {
+            return 0;
         }
     }
 
-    if (waitpid(pid, cmd_status, 0) == -1) {
-        if (STATUS_IS_SUCCESS(status)) {
-            status = st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
-                                  "Waiting for child process failed: %s",
-                                  strerror(errno));
+    return 1;
+}
+
+/* Add the file descriptors this command is waiting on to the sets
+ * supplied so they can be used with select */
+void ec_add_fds(const ExternalCommand *ec, fd_set *read_fds,
+                fd_set *write_fds, int *max_fd)
+{
+    for (size_t k = 0; k < ARRAY_SIZE(ec->fds, struct pollfd); k++) {
+        int fd = ec->fds[k].fd;
+
+        if (fd == -1) {
+            continue;
+        }
+
+        if (ec->fds[k].events & POLLOUT) {
+            FD_SET(fd, write_fds);
+        } else {
+            FD_SET(fd, read_fds);
         }
+
+        *max_fd = MAX(*max_fd, fd);
     }
+}
 
-    return status;
+/* Populate revents from the result of a call to select */
+void ec_set_revents(ExternalCommand *ec, const fd_set *read_fds,
+                    const fd_set *write_fds)
+{
+    for (size_t k = 0; k < ARRAY_SIZE(ec->fds, struct pollfd); k++) {
+        struct pollfd *pfd = &ec->fds[k];
+        pfd->revents = 0;
+
+        if (pfd->fd == -1) {
+            continue;
+        }
+
+        if (pfd->events & POLLOUT) {
+            if (FD_ISSET(pfd->fd, write_fds)) {
+                pfd->revents = POLLOUT;
+            }
+        } else if (FD_ISSET(pfd->fd, read_fds)) {
+            pfd->revents = POLLIN;
+        }
+    }
+}
+
+/* Reap the child process. When block is false *exited is set to 0 if the
+ * child hasn't yet exited */
+Status ec_wait_command(ExternalCommand *ec, int block, int *exited)
+{
+    *exited = ec->exited;
+
+    if (ec->exited || ec->pid <= 0) {
+        return STATUS_SUCCESS;
+    }
+
+    pid_t pid;
+
+    do {
+        pid = waitpid(ec->pid, &ec->cmd_status, block ? 0 : WNOHANG);
+    } while (pid == -1 && errno == EINTR);
+
+    if (pid == -1) {
+        ec->exited = 1;
+        *exited = 1;
+        return st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
+                            "Waiting for child process failed: %s",
+                            strerror(errno));
+    } else if (pid == ec->pid) {
+        ec->exited = 1;
+        *exited = 1;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Ask the command to terminate by sending it SIGTERM */
+void ec_terminate_command(ExternalCommand *ec)
+{
+    if (ec->pid > 0 && !ec->exited) {
+        /* Signal the process group as the shell may have created
+         * further child processes */
+        kill(ec->background ? -ec->pid : ec->pid, SIGTERM);
+    }
+}
+
+/* Release all resources used by ec. If the child is still running it is
+ * terminated and waited on */
+void ec_free_command(ExternalCommand *ec)
+{
+    for (size_t k = 0; k < ARRAY_SIZE(ec->fds, struct pollfd); k++) {
+        ec_close_fd(ec, k);
+    }
+
+    if (ec->pid > 0 && !ec->exited) {
+        int exited;
+        ec_wait_command(ec, 0, &exited);
+
+        if (!exited) {
+            ec_terminate_command(ec);
+            ec_wait_command(ec, 0, &exited);
+
+            if (!exited) {
+                kill(ec->background ? -ec->pid : ec->pid, SIGKILL);
+                ec_wait_command(ec, 1, &exited);
+            }
+        }
+    }
+
+    free(ec->in_buf);
+    free(ec->out_buf);
+    ec->in_buf = NULL;
+    ec->out_buf = NULL;
+}
+
+static void ec_close_fd(ExternalCommand *ec, size_t index)
+{
+    if (ec->fds[index].fd != -1) {
+        close(ec->fds[index].fd);
+        ec->fds[index].fd = -1;
+    }
+}
+
+/* Increase pipe capacity where supported so that the child process
+ * can produce and consume more data between each poll */
+static void ec_set_pipe_size(int fd)
+{
+#ifdef F_SETPIPE_SZ
+    fcntl(fd, F_SETPIPE_SZ, EC_BUF_SIZE);
+#else
+    (void)fd;
+#endif
 }
 
 int ec_cmd_successfull(int cmd_status)
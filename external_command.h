@@ -19,6 +19,9 @@
 #ifndef WED_EXTERNAL_COMMAND_H
 #define WED_EXTERNAL_COMMAND_H
 
+#include <sys/types.h>
+#include <sys/select.h>
+#include <poll.h>
 #include "status.h"
 
 typedef struct InputStream InputStream;
@@ -37,8 +40,46 @@ struct OutputStream {
     Status (*close)(OutputStream *os);
 };
 
+/* Index into ExternalCommand fds for each of the child's standard streams */
+typedef enum {
+    EC_STDIN,
+    EC_STDOUT,
+    EC_STDERR
+} ExternalCommandFd;
+
+/* A running external command. This allows a command to be run without
+ * blocking, with data transferred to and from the command as its file
+ * descriptors become ready */
+typedef struct {
+    pid_t pid; /* Child process ID */
+    struct pollfd fds[3]; /* Parent end of the pipes to the child's stdin,
+                             stdout and stderr. Set to -1 once closed */
+    InputStream *is; /* Data written to stdin is read from here */
+    OutputStream *os; /* stdout is written here */
+    OutputStream *es; /* stderr is written here */
+    char *in_buf; /* Input waiting to be written to the child */
+    size_t in_bytes; /* Bytes in in_buf */
+    size_t in_written; /* Bytes from in_buf written so far */
+    char *out_buf; /* Used when reading child output */
+    int cmd_status; /* waitpid status once child has exited */
+    int exited; /* True once the child has been waited on */
+    int background; /* Child runs in its own process group */
+} ExternalCommand;
+
 Status ec_run_command(const char *cmd, InputStream *is, OutputStream *os,
                       OutputStream *es, int *cmd_status);
+Status ec_start_command(ExternalCommand *, const char *cmd,
+                        InputStream *is, OutputStream *os, OutputStream *es,
+                        int background);
+Status ec_process_command(ExternalCommand *);
+int ec_io_finished(const ExternalCommand *);
+void ec_add_fds(const ExternalCommand *, fd_set *read_fds,
+                fd_set *write_fds, int *max_fd);
+void ec_set_revents(ExternalCommand *, const fd_set *read_fds,
+                    const fd_set *write_fds);
+Status ec_wait_command(ExternalCommand *, int block, int *exited);
+void ec_terminate_command(ExternalCommand *);
+void ec_free_command(ExternalCommand *);
 int ec_cmd_successfull(int cmd_status);
 
 #endif
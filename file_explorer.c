@@ -21,32 +21,134 @@
 #define _DEFAULT_SOURCE
 
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#endif
 #include "file_explorer.h"
 #include "util.h"
 
-/* The maximum number of directory entries that are stored */
-#define MAX_DIR_ENT_NUM 1000
-/* The maximum size of a directory entry name as given by: man 3 readdir */
-#define MAX_DNAME_SIZE 256
+/* Size of the buffer each batch of directory entries is read into */
+#define FE_READ_BUF_SIZE (256 * 1024)
+/* Minimum size of each block entry names are stored in */
+#define FE_NAME_BLOCK_SIZE (64 * 1024)
+/* Number of entries a directory initially has space for */
+#define FE_ENTRIES_INIT 64
+/* Number of spaces each level of the tree is indented by */
+#define FE_INDENT_SIZE 2
 
-/* Classify each directory entry */
-typedef enum {
-    DET_FILE,
-    DET_DIRECTORY
-} DirectoryEntryType;
+#ifdef __linux__
+/* Events which indicate an entry has been added to or removed from a
+ * directory */
+#define FE_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                         IN_MOVED_TO | IN_ONLYDIR)
 
-/* Represents a directory entry. This structure is used for temporary storage
- * before entries are added to the buffer */
+/* Layout of each record returned by getdents64 */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+/* Entry names are stored one after another in blocks. Blocks aren't
+ * moved once allocated so names can be referenced directly. The names of
+ * removed entries are only freed along with their directory */
+struct FileExplorerNameBlock {
+    FileExplorerNameBlock *next; /* Previously allocated block */
+    size_t size; /* Number of bytes names can occupy */
+    size_t used; /* Number of bytes names occupy */
+    char names[]; /* NUL terminated names */
+};
+
+/* The entries of a directory read in the background */
+typedef struct {
+    FileExplorer *file_explorer; /* Explorer the directory is listed in */
+    FileExplorerDir *dir; /* Directory the entries are added to, or NULL
+                             if it's no longer expanded. Only accessed by
+                             the main thread */
+    FileExplorerDir result; /* Entries read. Only accessed by the reading
+                               thread until it's done */
+    pthread_t thread; /* Thread reading the directory */
+    Status status; /* Result of reading the directory */
+    int done; /* True once the thread has finished. Protected by
+                 read_lock */
+    int cancelled; /* True if the entries are no longer required.
+                      Protected by read_lock */
+} FileExplorerRead;
+
+/* An entry added to or removed from a directory */
 typedef struct {
-    char name[MAX_DNAME_SIZE];
-    DirectoryEntryType type;
-} DirectoryEntry;
+    int added; /* True if the entry was added */
+    DirectoryEntryType type; /* File or directory */
+    size_t name_len; /* Length of name */
+    char name[]; /* Entry name */
+} FileExplorerEvent;
 
+static FileExplorerDir *fe_new_dir(const char *path, FileExplorerDir *parent);
+static void fe_free_dir(FileExplorerDir *);
+static void fe_close_dir(FileExplorer *, FileExplorerDir *);
+static const char *fe_add_name(FileExplorerDir *, const char *name,
+                               size_t name_len);
+static int fe_reserve_entries(FileExplorerDir *, size_t entry_num);
+static Status fe_add_dir_entry(FileExplorerDir *, int dir_fd,
+                               const char *name, unsigned char d_type);
 static int fe_cmp_de(const void *, const void *);
+static int fe_find_entry(const FileExplorerDir *, const DirectoryEntry *,
+                         size_t *entry_index);
+static Status fe_start_read(FileExplorer *, FileExplorerDir *);
+static void *fe_read_run(void *);
+static Status fe_read_entries(FileExplorerRead *);
+static int fe_read_cancelled(FileExplorerRead *);
+static void fe_free_read(FileExplorerRead *);
+static Status fe_finish_reads(FileExplorer *, int wait, int *updated);
+static Status fe_add_read_entries(FileExplorer *, FileExplorerRead *);
+static void fe_watch_dir(FileExplorer *, FileExplorerDir *);
+static Status fe_read_watch_events(FileExplorer *, int *updated);
+static Status fe_apply_event(FileExplorer *, FileExplorerDir *,
+                             const char *name, size_t name_len,
+                             DirectoryEntryType, int added);
+static Status fe_insert_entry(FileExplorer *, FileExplorerDir *,
+                              size_t entry_index, const char *name,
+                              size_t name_len, DirectoryEntryType);
+static Status fe_remove_entry(FileExplorer *, FileExplorerDir *,
+                              size_t entry_index);
+static Status fe_expand(FileExplorer *, FileExplorerDir *,
+                        size_t entry_index);
+static Status fe_collapse(FileExplorer *, FileExplorerDir *,
+                          size_t entry_index);
+static int fe_add_sub_dir(FileExplorerDir *, FileExplorerDir *sub_dir);
+static void fe_remove_sub_dir(FileExplorerDir *, const FileExplorerDir *);
+static size_t fe_sub_dir_position(const FileExplorerDir *,
+                                  size_t entry_index);
+static size_t fe_sub_dir_rows(const FileExplorerDir *, size_t position);
+static void fe_shift_sub_dirs(FileExplorerDir *, size_t entry_index,
+                              int added);
+static size_t fe_row_num(const FileExplorer *);
+static size_t fe_entry_row(const FileExplorer *, const FileExplorerDir *,
+                           size_t entry_index);
+static int fe_find_row(const FileExplorer *, size_t row,
+                       FileExplorerDir **dir_ptr, size_t *entry_index);
+static void fe_add_row_num(FileExplorerDir *, size_t row_num);
+static void fe_remove_row_num(FileExplorerDir *, size_t row_num);
+static Status fe_insert_rows(FileExplorer *, size_t row,
+                             const FileExplorerDir *, size_t entry_index,
+                             size_t entry_num);
+static Status fe_delete_rows(FileExplorer *, size_t row, size_t row_num);
+static Status fe_set_cursor_row(Buffer *, size_t row);
 
 FileExplorer *fe_new(Buffer *buffer)
 {
@@ -55,6 +157,36 @@ FileExplorer *fe_new(Buffer *buffer)
     memset(file_explorer, 0, sizeof(FileExplorer));
 
     file_explorer->buffer = buffer;
+    file_explorer->notify_fds[0] = file_explorer->notify_fds[1] = -1;
+    file_explorer->watch_fd = -1;
+    file_explorer->dirs = list_new();
+    file_explorer->reads = list_new();
+    pthread_mutex_init(&file_explorer->read_lock, NULL);
+
+    if (file_explorer->dirs == NULL || file_explorer->reads == NULL ||
+        pipe(file_explorer->notify_fds) == -1) {
+        file_explorer->notify_fds[0] = file_explorer->notify_fds[1] = -1;
+        file_explorer->buffer = NULL;
+        fe_free(file_explorer);
+        return NULL;
+    }
+
+    /* The main thread drains the pipe without blocking and reading
+     * threads shouldn't block if the pipe is full as the main thread will
+     * already have been notified */
+    for (size_t k = 0; k < 2; k++) {
+        int flags = fcntl(file_explorer->notify_fds[k], F_GETFL);
+
+        if (flags != -1) {
+            fcntl(file_explorer->notify_fds[k], F_SETFL, flags | O_NONBLOCK);
+        }
+    }
+
+#ifdef __linux__
+    /* Without inotify the tree isn't updated when files are added or
+     * removed */
+    file_explorer->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
 
     return file_explorer;
 }
@@ -65,6 +197,29 @@ void fe_free(FileExplorer *file_explorer)
         return;
     }
 
+    if (file_explorer->root != NULL) {
+        fe_close_dir(file_explorer, file_explorer->root);
+    }
+
+    if (file_explorer->reads != NULL) {
+        /* Threads exit as soon as they see they've been cancelled */
+        int updated;
+        st_free_status(fe_finish_reads(file_explorer, 1, &updated));
+    }
+
+    for (size_t k = 0; k < 2; k++) {
+        if (file_explorer->notify_fds[k] != -1) {
+            close(file_explorer->notify_fds[k]);
+        }
+    }
+
+    if (file_explorer->watch_fd != -1) {
+        close(file_explorer->watch_fd);
+    }
+
+    pthread_mutex_destroy(&file_explorer->read_lock);
+    list_free(file_explorer->dirs);
+    list_free(file_explorer->reads);
     bf_free(file_explorer->buffer);
     free(file_explorer->dir_path);
     free(file_explorer);
@@ -84,149 +239,1292 @@ Status fe_read_cwd(FileExplorer *file_explorer)
     return fe_read_directory(file_explorer, cwd);
 }
 
+/* List dir_path at the root of the tree. Its entries are added to the
+ * tree once they've been read in the background */
 Status fe_read_directory(FileExplorer *file_explorer, const char *dir_path)
 {
-    static DirectoryEntry entries[MAX_DIR_ENT_NUM];
-    Status status = STATUS_SUCCESS;
+    char *path = strdup(dir_path);
+
+    if (path == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate directory path");
+    }
 
-    DIR *dir = opendir(dir_path);
+    FileExplorerDir *root = fe_new_dir(path, NULL);
 
-    if (dir == NULL) {
-        return st_get_error(ERR_UNABLE_TO_OPEN_DIRECTORY,
-                            "Unable to open directory %s for reading: %s",
-                            dir_path, strerror(errno));
+    if (root == NULL || !list_add(file_explorer->dirs, root)) {
+        fe_free_dir(root);
+        free(path);
+        return OUT_OF_MEMORY("Unable to allocate directory");
     }
 
+    if (file_explorer->root != NULL) {
+        fe_close_dir(file_explorer, file_explorer->root);
+    }
+
+    free(file_explorer->dir_path);
+    file_explorer->dir_path = path;
+    file_explorer->root = root;
+    file_explorer->parent_row = strcmp("/", path) != 0;
+
     Buffer *buffer = file_explorer->buffer;
     RETURN_IF_FAIL(bf_reset(buffer));
 
-    file_explorer->dir_path = strdup(dir_path);
+    if (file_explorer->parent_row) {
+        bc_disable(&buffer->changes);
+        Status status = bf_insert_string(buffer, "../", 3, 0);
+        bc_enable(&buffer->changes);
+        RETURN_IF_FAIL(status);
+    }
+
+    RETURN_IF_FAIL(bf_to_buffer_start(buffer, 0));
+
+    return fe_start_read(file_explorer, root);
+}
+
+/* Wait for all directories being read and add their entries to the
+ * tree */
+Status fe_wait(FileExplorer *file_explorer)
+{
+    int updated;
+    return fe_finish_reads(file_explorer, 1, &updated);
+}
+
+void fe_add_fds(const FileExplorer *file_explorer, fd_set *read_fds,
+                int *max_fd)
+{
+    if (list_size(file_explorer->reads) > 0) {
+        int fd = file_explorer->notify_fds[0];
+        FD_SET(fd, read_fds);
+        *max_fd = MAX(*max_fd, fd);
+    }
+
+    if (file_explorer->watch_fd != -1 && file_explorer->root != NULL) {
+        FD_SET(file_explorer->watch_fd, read_fds);
+        *max_fd = MAX(*max_fd, file_explorer->watch_fd);
+    }
+}
+
+/* Add the entries of directories that have been read and apply changes
+ * reported by inotify. updated is set true if the tree changed */
+Status fe_process(FileExplorer *file_explorer, const fd_set *read_fds,
+                  int *updated)
+{
+    Status status = STATUS_SUCCESS;
+    *updated = 0;
+
+    if (list_size(file_explorer->reads) > 0 &&
+        FD_ISSET(file_explorer->notify_fds[0], read_fds)) {
+        char buf[64];
+        ssize_t bytes_read;
+
+        do {
+            bytes_read = read(file_explorer->notify_fds[0], buf, sizeof(buf));
+        } while (bytes_read > 0 || (bytes_read == -1 && errno == EINTR));
+
+        status = fe_finish_reads(file_explorer, 0, updated);
+    }
+
+    if (STATUS_IS_SUCCESS(status) && file_explorer->watch_fd != -1 &&
+        FD_ISSET(file_explorer->watch_fd, read_fds)) {
+        status = fe_read_watch_events(file_explorer, updated);
+    }
+
+    return status;
+}
+
+Buffer *fe_get_buffer(const FileExplorer *file_explorer)
+{
+    return file_explorer->buffer;
+}
 
+/* Returns the path of the entry on the cursor line */
+char *fe_get_selected(const FileExplorer *file_explorer)
+{
     if (file_explorer->dir_path == NULL) {
-        return OUT_OF_MEMORY("Unable to allocate directory path");
+        return NULL;
     }
 
-    file_explorer->dir_entries = 0;
-    file_explorer->file_entries = 0;
+    const char *dir_path = file_explorer->dir_path;
+    const char *entry_name = "..";
+    const size_t row = file_explorer->buffer->pos.line_no - 1;
+    FileExplorerDir *dir;
+    size_t entry_index;
 
-    struct dirent *entry;
-    size_t entry_index = 0;
-    DirectoryEntry *de;
-    errno = 0;
+    if (fe_find_row(file_explorer, row, &dir, &entry_index)) {
+        dir_path = dir->path;
+        entry_name = dir->entries[entry_index].name;
+    } else if (!file_explorer->parent_row || row != 0) {
+        return NULL;
+    }
 
-    while (entry_index < MAX_DIR_ENT_NUM && (entry = readdir(dir)) != NULL) {
-        if (strcmp(".", entry->d_name) == 0 ||
-            strcmp("..", entry->d_name) == 0 ||
-            (entry->d_type != DT_REG &&
-             entry->d_type != DT_DIR &&
-             entry->d_type != DT_LNK)) {
-            continue;
-        }
+    const size_t dir_path_len = strlen(dir_path);
+    const char *path_separator = "/";
+    
+    if (dir_path[dir_path_len - 1] == '/') {
+        path_separator = "";
+    }
+
+    return concat_all(3, dir_path, path_separator, entry_name);
+}
 
-        de = &entries[entry_index++];
+/* Returns true if row lists a directory. The ../ row is a directory */
+int fe_is_directory_row(const FileExplorer *file_explorer, size_t row)
+{
+    FileExplorerDir *dir;
+    size_t entry_index;
 
-        snprintf(de->name, MAX_DNAME_SIZE, "%s", entry->d_name); 
-        
-        if (entry->d_type == DT_DIR) {
-            de->type = DET_DIRECTORY;
-            file_explorer->dir_entries++;
-        } else {
-            de->type = DET_FILE;
-            file_explorer->file_entries++;
-        } 
+    if (fe_find_row(file_explorer, row, &dir, &entry_index)) {
+        return dir->entries[entry_index].type == DET_DIRECTORY;
     }
 
-    if (errno) {
-        status = st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
-                              "Unable to read from directory %s: %s",
-                              dir_path, strerror(errno));
+    return file_explorer->parent_row && row == 0;
+}
+
+/* Expand or collapse the directory on the cursor line. toggled is set
+ * false if the cursor line isn't a directory in the tree */
+Status fe_toggle_selected(FileExplorer *file_explorer, int *toggled)
+{
+    const size_t row = file_explorer->buffer->pos.line_no - 1;
+    FileExplorerDir *dir;
+    size_t entry_index;
+    *toggled = 0;
+
+    if (!fe_find_row(file_explorer, row, &dir, &entry_index) ||
+        dir->entries[entry_index].type != DET_DIRECTORY) {
+        return STATUS_SUCCESS;
     }
 
-    closedir(dir);
-    RETURN_IF_FAIL(status);
+    *toggled = 1;
+
+    if (dir->entries[entry_index].dir != NULL) {
+        return fe_collapse(file_explorer, dir, entry_index);
+    }
+
+    return fe_expand(file_explorer, dir, entry_index);
+}
 
-    const size_t entry_num = entry_index;
-    qsort(entries, entry_num, sizeof(DirectoryEntry), fe_cmp_de);
+static FileExplorerDir *fe_new_dir(const char *path, FileExplorerDir *parent)
+{
+    FileExplorerDir *dir = malloc(sizeof(FileExplorerDir));
+    RETURN_IF_NULL(dir);
+    memset(dir, 0, sizeof(FileExplorerDir));
 
-    if (strcmp("/", dir_path) != 0) {
-        RETURN_IF_FAIL(bf_insert_string(buffer, "../", 3, 1));
+    dir->path = strdup(path);
+    dir->events = list_new();
 
-        if (entry_num > 0) {
-            RETURN_IF_FAIL(bf_insert_string(buffer, "\n", 1, 1));
+    if (dir->path == NULL || dir->events == NULL) {
+        fe_free_dir(dir);
+        return NULL;
+    }
+
+    dir->parent = parent;
+    dir->depth = parent != NULL ? parent->depth + 1 : 0;
+    dir->watch_wd = -1;
+
+    return dir;
+}
+
+static void fe_free_dir(FileExplorerDir *dir)
+{
+    if (dir == NULL) {
+        return;
+    }
+
+    FileExplorerNameBlock *block = dir->names;
+    FileExplorerNameBlock *next;
+
+    while (block != NULL) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+
+    if (dir->events != NULL) {
+        list_free_values(dir->events);
+        list_free(dir->events);
+    }
+
+    free(dir->sub_dirs);
+    free(dir->entries);
+    free(dir->path);
+    free(dir);
+}
+
+/* Remove dir and the directories expanded below it from the tree. Their
+ * rows must already have been removed */
+static void fe_close_dir(FileExplorer *file_explorer, FileExplorerDir *dir)
+{
+    for (size_t k = 0; k < dir->sub_dir_num; k++) {
+        fe_close_dir(file_explorer, dir->sub_dirs[k]);
+    }
+
+#ifdef __linux__
+    if (dir->watch_wd != -1) {
+        inotify_rm_watch(file_explorer->watch_fd, dir->watch_wd);
+    }
+#endif
+
+    for (size_t k = 0; k < list_size(file_explorer->dirs); k++) {
+        if (list_get(file_explorer->dirs, k) == dir) {
+            list_remove_at(file_explorer->dirs, k);
+            break;
         }
+    }
 
-        file_explorer->dir_entries++;
+    FileExplorerRead *dir_read;
+
+    for (size_t k = 0; k < list_size(file_explorer->reads); k++) {
+        dir_read = list_get(file_explorer->reads, k);
+
+        if (dir_read->dir == dir) {
+            dir_read->dir = NULL;
+            pthread_mutex_lock(&file_explorer->read_lock);
+            dir_read->cancelled = 1;
+            pthread_mutex_unlock(&file_explorer->read_lock);
+        }
     }
 
-    for (entry_index = 0; entry_index < entry_num; entry_index++) {
-        de = &entries[entry_index];
+    if (file_explorer->root == dir) {
+        file_explorer->root = NULL;
+    }
 
-        RETURN_IF_FAIL(bf_insert_string(buffer, de->name, strlen(de->name), 1)); 
+    fe_free_dir(dir);
+}
 
-        if (de->type == DET_DIRECTORY) {
-            RETURN_IF_FAIL(bf_insert_string(buffer, "/", 1, 1));
+static const char *fe_add_name(FileExplorerDir *dir, const char *name,
+                               size_t name_len)
+{
+    FileExplorerNameBlock *block = dir->names;
+
+    if (block == NULL || block->size - block->used < name_len + 1) {
+        size_t size = MAX(FE_NAME_BLOCK_SIZE, name_len + 1);
+        block = malloc(sizeof(FileExplorerNameBlock) + size);
+        RETURN_IF_NULL(block);
+
+        block->next = dir->names;
+        block->size = size;
+        block->used = 0;
+        dir->names = block;
+    }
+
+    char *name_copy = block->names + block->used;
+    memcpy(name_copy, name, name_len);
+    name_copy[name_len] = '\0';
+    block->used += name_len + 1;
+
+    return name_copy;
+}
+
+static int fe_reserve_entries(FileExplorerDir *dir, size_t entry_num)
+{
+    if (dir->entry_alloc >= entry_num) {
+        return 1;
+    }
+
+    size_t entry_alloc = MAX(dir->entry_alloc * 2, FE_ENTRIES_INIT);
+    entry_alloc = MAX(entry_alloc, entry_num);
+    DirectoryEntry *entries = realloc(dir->entries,
+                                      entry_alloc * sizeof(DirectoryEntry));
+
+    if (entries == NULL) {
+        return 0;
+    }
+
+    dir->entries = entries;
+    dir->entry_alloc = entry_alloc;
+
+    return 1;
+}
+
+/* Add an entry read from a directory. Only files, directories and links
+ * are listed. Links are listed as files */
+static Status fe_add_dir_entry(FileExplorerDir *dir, int dir_fd,
+                               const char *name, unsigned char d_type)
+{
+    if (strcmp(".", name) == 0 || strcmp("..", name) == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    if (d_type == DT_UNKNOWN) {
+        /* Not all file systems provide the type of each entry */
+        struct stat entry_stat;
+
+        if (fstatat(dir_fd, name, &entry_stat, AT_SYMLINK_NOFOLLOW) == -1) {
+            return STATUS_SUCCESS;
         }
 
-        if (entry_index < entry_num - 1) {
-            RETURN_IF_FAIL(bf_insert_string(buffer, "\n", 1, 1));
+        if (S_ISDIR(entry_stat.st_mode)) {
+            d_type = DT_DIR;
+        } else if (S_ISREG(entry_stat.st_mode)) {
+            d_type = DT_REG;
+        } else if (S_ISLNK(entry_stat.st_mode)) {
+            d_type = DT_LNK;
         }
     }
 
-    RETURN_IF_FAIL(bf_to_buffer_start(buffer, 0));
+    if (d_type != DT_REG && d_type != DT_DIR && d_type != DT_LNK) {
+        return STATUS_SUCCESS;
+    }
 
-    return status;
+    size_t name_len = strlen(name);
+
+    if (!fe_reserve_entries(dir, dir->entry_num + 1)) {
+        return OUT_OF_MEMORY("Unable to allocate directory entries");
+    }
+
+    DirectoryEntry *de = &dir->entries[dir->entry_num];
+    de->name = fe_add_name(dir, name, name_len);
+
+    if (de->name == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate directory entry name");
+    }
+
+    de->name_len = name_len;
+    de->type = d_type == DT_DIR ? DET_DIRECTORY : DET_FILE;
+    de->dir = NULL;
+    dir->entry_num++;
+
+    return STATUS_SUCCESS;
 }
 
+/* Directories are listed before files and entries of the same type are
+ * ordered by name ignoring case */
 static int fe_cmp_de(const void *o1, const void *o2)
 {
     const DirectoryEntry *de1 = (const DirectoryEntry *)o1;
     const DirectoryEntry *de2 = (const DirectoryEntry *)o2;
 
-    if (de1->type == de2->type) {
-        return strncasecmp(de1->name, de2->name, MAX_DNAME_SIZE);
+    if (de1->type != de2->type) {
+        return de1->type == DET_DIRECTORY ? -1 : 1;
     }
 
-    if (de1->type == DET_DIRECTORY) {
-        return -1;
-    } else if (de2->type == DET_DIRECTORY) {
-        return 1;
+    int cmp = strcasecmp(de1->name, de2->name);
+
+    if (cmp == 0) {
+        /* Give names that only differ in case a consistent order */
+        cmp = strcmp(de1->name, de2->name);
+    }
+
+    return cmp;
+}
+
+/* Returns true if an entry matching de exists. entry_index is set to the
+ * index of the entry or the index it would be inserted at */
+static int fe_find_entry(const FileExplorerDir *dir, const DirectoryEntry *de,
+                         size_t *entry_index)
+{
+    size_t start = 0;
+    size_t end = dir->entry_num;
+    size_t mid;
+    int cmp;
+
+    while (start < end) {
+        mid = start + (end - start) / 2;
+        cmp = fe_cmp_de(de, &dir->entries[mid]);
+
+        if (cmp == 0) {
+            *entry_index = mid;
+            return 1;
+        } else if (cmp < 0) {
+            end = mid;
+        } else {
+            start = mid + 1;
+        }
     }
 
+    *entry_index = start;
+
     return 0;
 }
 
-Buffer *fe_get_buffer(const FileExplorer *file_explorer)
+/* The directory is watched before it's read so no changes are missed */
+static Status fe_start_read(FileExplorer *file_explorer, FileExplorerDir *dir)
 {
-    return file_explorer->buffer;
+    fe_watch_dir(file_explorer, dir);
+
+    FileExplorerRead *dir_read = malloc(sizeof(FileExplorerRead));
+
+    if (dir_read == NULL) {
+        return OUT_OF_MEMORY("Unable to read directory");
+    }
+
+    memset(dir_read, 0, sizeof(FileExplorerRead));
+    dir_read->file_explorer = file_explorer;
+    dir_read->dir = dir;
+    dir_read->result.path = strdup(dir->path);
+
+    if (dir_read->result.path == NULL ||
+        !list_add(file_explorer->reads, dir_read)) {
+        fe_free_read(dir_read);
+        return OUT_OF_MEMORY("Unable to read directory");
+    }
+
+    int error = pthread_create(&dir_read->thread, NULL, fe_read_run,
+                               dir_read);
+
+    if (error != 0) {
+        list_pop(file_explorer->reads);
+        fe_free_read(dir_read);
+        return st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
+                            "Unable to create thread: %s", strerror(error));
+    }
+
+    dir->reading = 1;
+
+    return STATUS_SUCCESS;
 }
 
-char *fe_get_selected(const FileExplorer *file_explorer)
+static void *fe_read_run(void *arg)
 {
-    if (file_explorer->dir_path == NULL ||
-        (file_explorer->dir_entries == 0 &&
-         file_explorer->file_entries == 0)) {
-        return NULL;
+    FileExplorerRead *dir_read = arg;
+    FileExplorer *file_explorer = dir_read->file_explorer;
+    FileExplorerDir *result = &dir_read->result;
+
+    dir_read->status = fe_read_entries(dir_read);
+
+    if (STATUS_IS_SUCCESS(dir_read->status)) {
+        qsort(result->entries, result->entry_num, sizeof(DirectoryEntry),
+              fe_cmp_de);
+    }
+
+    pthread_mutex_lock(&file_explorer->read_lock);
+    dir_read->done = 1;
+    pthread_mutex_unlock(&file_explorer->read_lock);
+
+    /* If the pipe is full the main thread has already been notified */
+    char c = 1;
+    ssize_t written;
+
+    do {
+        written = write(file_explorer->notify_fds[1], &c, 1);
+    } while (written == -1 && errno == EINTR);
+
+    return NULL;
+}
+
+/* Read entries a batch at a time, so large directories are read with
+ * few system calls */
+static Status fe_read_entries(FileExplorerRead *dir_read)
+{
+    FileExplorerDir *dir = &dir_read->result;
+    Status status = STATUS_SUCCESS;
+
+#ifdef __linux__
+    int dir_fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd == -1) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_DIRECTORY,
+                            "Unable to open directory %s for reading: %s",
+                            dir->path, strerror(errno));
     }
 
-    static char entry_name[MAX_DNAME_SIZE];
-    const Buffer *buffer = file_explorer->buffer;
-    const BufferPos *pos = &buffer->pos;
-    size_t entry_name_len = bf_get_line(buffer, pos, entry_name,
-                                        MAX_DNAME_SIZE);
+    char *buf = malloc(FE_READ_BUF_SIZE);
 
-    if (entry_name_len == MAX_DNAME_SIZE) {
-        entry_name_len--;
+    if (buf == NULL) {
+        close(dir_fd);
+        return OUT_OF_MEMORY("Unable to allocate directory read buffer");
     }
 
-    entry_name[entry_name_len] = '\0';
-    const char *dir_path = file_explorer->dir_path;
-    const size_t dir_path_len = strlen(dir_path);
+    const struct linux_dirent64 *entry;
+    long bytes_read;
+
+    while ((bytes_read = syscall(SYS_getdents64, dir_fd, buf,
+                                 FE_READ_BUF_SIZE)) > 0 &&
+           !fe_read_cancelled(dir_read)) {
+        for (long offset = 0; offset < bytes_read &&
+                              STATUS_IS_SUCCESS(status);
+             offset += entry->d_reclen) {
+            entry = (const struct linux_dirent64 *)(buf + offset);
+            status = fe_add_dir_entry(dir, dir_fd, entry->d_name,
+                                      entry->d_type);
+        }
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+    }
+
+    if (bytes_read == -1 && STATUS_IS_SUCCESS(status)) {
+        status = st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
+                              "Unable to read from directory %s: %s",
+                              dir->path, strerror(errno));
+    }
+
+    free(buf);
+    close(dir_fd);
+#else
+    DIR *dir_stream = opendir(dir->path);
+
+    if (dir_stream == NULL) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_DIRECTORY,
+                            "Unable to open directory %s for reading: %s",
+                            dir->path, strerror(errno));
+    }
+
+    struct dirent *entry;
+    errno = 0;
+
+    while (STATUS_IS_SUCCESS(status) && !fe_read_cancelled(dir_read) &&
+           (entry = readdir(dir_stream)) != NULL) {
+        status = fe_add_dir_entry(dir, dirfd(dir_stream), entry->d_name,
+                                  entry->d_type);
+    }
+
+    if (errno && STATUS_IS_SUCCESS(status)) {
+        status = st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
+                              "Unable to read from directory %s: %s",
+                              dir->path, strerror(errno));
+    }
+
+    closedir(dir_stream);
+#endif
+
+    return status;
+}
+
+static int fe_read_cancelled(FileExplorerRead *dir_read)
+{
+    FileExplorer *file_explorer = dir_read->file_explorer;
+
+    pthread_mutex_lock(&file_explorer->read_lock);
+    int cancelled = dir_read->cancelled;
+    pthread_mutex_unlock(&file_explorer->read_lock);
+
+    return cancelled;
+}
+
+static void fe_free_read(FileExplorerRead *dir_read)
+{
+    FileExplorerDir *result = &dir_read->result;
+    FileExplorerNameBlock *block = result->names;
+    FileExplorerNameBlock *next;
+
+    while (block != NULL) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(result->entries);
+    free(result->path);
+    st_free_status(dir_read->status);
+    free(dir_read);
+}
+
+/* Add the entries of each directory that has been read to the tree. When
+ * wait is true all reads are waited for */
+static Status fe_finish_reads(FileExplorer *file_explorer, int wait,
+                              int *updated)
+{
+    Status status = STATUS_SUCCESS;
+    Status read_status;
+    FileExplorerRead *dir_read;
+    size_t k = 0;
+    int done;
+
+    while (k < list_size(file_explorer->reads)) {
+        dir_read = list_get(file_explorer->reads, k);
+
+        if (!wait) {
+            pthread_mutex_lock(&file_explorer->read_lock);
+            done = dir_read->done;
+            pthread_mutex_unlock(&file_explorer->read_lock);
+
+            if (!done) {
+                k++;
+                continue;
+            }
+        }
+
+        pthread_join(dir_read->thread, NULL);
+        list_remove_at(file_explorer->reads, k);
+
+        read_status = fe_add_read_entries(file_explorer, dir_read);
+        fe_free_read(dir_read);
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = read_status;
+        } else {
+            st_free_status(read_status);
+        }
+
+        *updated = 1;
+    }
+
+    return status;
+}
+
+/* The entries read are moved into the directory and displayed below it.
+ * Changes to the directory reported whilst it was read are then applied */
+static Status fe_add_read_entries(FileExplorer *file_explorer,
+                                  FileExplorerRead *dir_read)
+{
+    FileExplorerDir *dir = dir_read->dir;
+
+    if (dir == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    dir->reading = 0;
+
+    if (!STATUS_IS_SUCCESS(dir_read->status)) {
+        Status status = dir_read->status;
+        dir_read->status = STATUS_SUCCESS;
+        return status;
+    }
+
+    FileExplorerDir *result = &dir_read->result;
+    dir->names = result->names;
+    dir->entries = result->entries;
+    dir->entry_num = result->entry_num;
+    dir->entry_alloc = result->entry_alloc;
+    result->names = NULL;
+    result->entries = NULL;
+
+    size_t row = file_explorer->parent_row;
+
+    if (dir->parent != NULL) {
+        row = fe_entry_row(file_explorer, dir->parent, dir->entry_index) + 1;
+    }
+
+    Status status = fe_insert_rows(file_explorer, row, dir, 0,
+                                   dir->entry_num);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        fe_add_row_num(dir, dir->entry_num);
+    }
+
+    FileExplorerEvent *event;
+
+    while (list_size(dir->events) > 0) {
+        event = list_remove_at(dir->events, 0);
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = fe_apply_event(file_explorer, dir, event->name,
+                                    event->name_len, event->type,
+                                    event->added);
+        }
+
+        free(event);
+    }
+
+    return status;
+}
+
+static void fe_watch_dir(FileExplorer *file_explorer, FileExplorerDir *dir)
+{
+#ifdef __linux__
+    if (file_explorer->watch_fd != -1 && dir->watch_wd == -1) {
+        dir->watch_wd = inotify_add_watch(file_explorer->watch_fd, dir->path,
+                                          FE_WATCH_EVENTS);
+    }
+#else
+    (void)file_explorer;
+    (void)dir;
+#endif
+}
+
+/* Add or remove entries as they're added to or removed from the
+ * directories they're displayed in */
+static Status fe_read_watch_events(FileExplorer *file_explorer, int *updated)
+{
+#ifdef __linux__
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    FileExplorerDir *dir;
+    Status status = STATUS_SUCCESS;
+    ssize_t bytes_read;
+    int overflow = 0;
+
+    while ((bytes_read = read(file_explorer->watch_fd, buf,
+                              sizeof(buf))) > 0 ||
+           (bytes_read == -1 && errno == EINTR)) {
+        for (ssize_t offset = 0; offset < bytes_read;
+             offset += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)(buf + offset);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = 1;
+            }
+
+            if (event->len == 0 || overflow ||
+                !STATUS_IS_SUCCESS(status)) {
+                continue;
+            }
+
+            dir = NULL;
+
+            for (size_t k = 0; k < list_size(file_explorer->dirs); k++) {
+                dir = list_get(file_explorer->dirs, k);
+
+                if (dir->watch_wd == event->wd) {
+                    break;
+                }
+
+                dir = NULL;
+            }
+
+            if (dir != NULL) {
+                status = fe_apply_event(file_explorer, dir, event->name,
+                                        strlen(event->name),
+                                        (event->mask & IN_ISDIR) ?
+                                        DET_DIRECTORY : DET_FILE,
+                                        event->mask & (IN_CREATE |
+                                                       IN_MOVED_TO));
+                *updated = 1;
+            }
+        }
+    }
+
+    if (overflow && STATUS_IS_SUCCESS(status) &&
+        file_explorer->dir_path != NULL) {
+        /* Changes have been missed so the tree is read again */
+        status = fe_read_directory(file_explorer, file_explorer->dir_path);
+        *updated = 1;
+    }
+
+    return status;
+#else
+    (void)file_explorer;
+    (void)updated;
+    return STATUS_SUCCESS;
+#endif
+}
+
+/* Changes are idempotent so it doesn't matter if the entries read already
+ * include a change made whilst the directory was read */
+static Status fe_apply_event(FileExplorer *file_explorer,
+                             FileExplorerDir *dir, const char *name,
+                             size_t name_len, DirectoryEntryType type,
+                             int added)
+{
+    if (dir->reading) {
+        FileExplorerEvent *event = malloc(sizeof(FileExplorerEvent) +
+                                          name_len + 1);
+
+        if (event == NULL || !list_add(dir->events, event)) {
+            free(event);
+            return OUT_OF_MEMORY("Unable to save directory change");
+        }
+
+        event->added = added;
+        event->type = type;
+        event->name_len = name_len;
+        memcpy(event->name, name, name_len);
+        event->name[name_len] = '\0';
+
+        return STATUS_SUCCESS;
+    }
+
+    DirectoryEntry de = { .name = name, .name_len = name_len, .type = type };
+    size_t entry_index;
+    int found = fe_find_entry(dir, &de, &entry_index);
+
+    if (added && !found) {
+        return fe_insert_entry(file_explorer, dir, entry_index, name,
+                               name_len, type);
+    } else if (!added && found) {
+        return fe_remove_entry(file_explorer, dir, entry_index);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status fe_insert_entry(FileExplorer *file_explorer,
+                              FileExplorerDir *dir, size_t entry_index,
+                              const char *name, size_t name_len,
+                              DirectoryEntryType type)
+{
+    if (!fe_reserve_entries(dir, dir->entry_num + 1)) {
+        return OUT_OF_MEMORY("Unable to allocate directory entries");
+    }
+
+    const char *name_copy = fe_add_name(dir, name, name_len);
+
+    if (name_copy == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate directory entry name");
+    }
+
+    DirectoryEntry *de = &dir->entries[entry_index];
+    memmove(de + 1, de, (dir->entry_num - entry_index) *
+                        sizeof(DirectoryEntry));
+    *de = (DirectoryEntry) {
+        .name = name_copy,
+        .name_len = name_len,
+        .type = type,
+        .dir = NULL
+    };
+    dir->entry_num++;
+    fe_shift_sub_dirs(dir, entry_index, 1);
+
+    size_t row = fe_entry_row(file_explorer, dir, entry_index);
+    RETURN_IF_FAIL(fe_insert_rows(file_explorer, row, dir, entry_index, 1));
+    fe_add_row_num(dir, 1);
+
+    return STATUS_SUCCESS;
+}
+
+static Status fe_remove_entry(FileExplorer *file_explorer,
+                              FileExplorerDir *dir, size_t entry_index)
+{
+    if (dir->entries[entry_index].dir != NULL) {
+        RETURN_IF_FAIL(fe_collapse(file_explorer, dir, entry_index));
+    }
+
+    size_t row = fe_entry_row(file_explorer, dir, entry_index);
+    RETURN_IF_FAIL(fe_delete_rows(file_explorer, row, 1));
+    fe_remove_row_num(dir, 1);
+
+    DirectoryEntry *de = &dir->entries[entry_index];
+    memmove(de, de + 1, (dir->entry_num - entry_index - 1) *
+                        sizeof(DirectoryEntry));
+    dir->entry_num--;
+    fe_shift_sub_dirs(dir, entry_index, 0);
+
+    return STATUS_SUCCESS;
+}
+
+static Status fe_expand(FileExplorer *file_explorer, FileExplorerDir *dir,
+                        size_t entry_index)
+{
+    DirectoryEntry *de = &dir->entries[entry_index];
+    const size_t dir_path_len = strlen(dir->path);
     const char *path_separator = "/";
     
-    if (dir_path[dir_path_len - 1] == '/') {
+    if (dir->path[dir_path_len - 1] == '/') {
         path_separator = "";
     }
 
-    return concat_all(3, dir_path, path_separator, entry_name);
+    char *path = concat_all(3, dir->path, path_separator, de->name);
+
+    if (path == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate directory path");
+    }
+
+    FileExplorerDir *sub_dir = fe_new_dir(path, dir);
+    free(path);
+
+    if (sub_dir == NULL || !list_add(file_explorer->dirs, sub_dir)) {
+        fe_free_dir(sub_dir);
+        return OUT_OF_MEMORY("Unable to allocate directory");
+    }
+
+    sub_dir->entry_index = entry_index;
+
+    if (!fe_add_sub_dir(dir, sub_dir)) {
+        fe_close_dir(file_explorer, sub_dir);
+        return OUT_OF_MEMORY("Unable to allocate directory");
+    }
+
+    de->dir = sub_dir;
+    Status status = fe_start_read(file_explorer, sub_dir);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        de->dir = NULL;
+        fe_remove_sub_dir(dir, sub_dir);
+        fe_close_dir(file_explorer, sub_dir);
+    }
+
+    return status;
+}
+
+static Status fe_collapse(FileExplorer *file_explorer, FileExplorerDir *dir,
+                          size_t entry_index)
+{
+    DirectoryEntry *de = &dir->entries[entry_index];
+    FileExplorerDir *sub_dir = de->dir;
+    const size_t row_num = sub_dir->row_num;
+
+    if (row_num > 0) {
+        size_t row = fe_entry_row(file_explorer, dir, entry_index) + 1;
+        RETURN_IF_FAIL(fe_delete_rows(file_explorer, row, row_num));
+        fe_remove_row_num(sub_dir, row_num);
+    }
+
+    de->dir = NULL;
+    fe_remove_sub_dir(dir, sub_dir);
+    fe_close_dir(file_explorer, sub_dir);
+
+    return STATUS_SUCCESS;
+}
+
+/* The number of rows, and so lines, the tree currently has */
+static size_t fe_row_num(const FileExplorer *file_explorer)
+{
+    size_t row_num = file_explorer->parent_row;
+
+    if (file_explorer->root != NULL) {
+        row_num += file_explorer->root->row_num;
+    }
+
+    return row_num;
+}
+
+/* Add sub_dir to the expanded subdirectories of dir. sub_dir has no rows
+ * yet so the rows before the subdirectories after it are unchanged */
+static int fe_add_sub_dir(FileExplorerDir *dir, FileExplorerDir *sub_dir)
+{
+    if (dir->sub_dir_num == dir->sub_dir_alloc) {
+        size_t sub_dir_alloc = MAX(dir->sub_dir_alloc * 2, 8);
+        FileExplorerDir **sub_dirs = realloc(dir->sub_dirs, sub_dir_alloc *
+                                             sizeof(FileExplorerDir *));
+
+        if (sub_dirs == NULL) {
+            return 0;
+        }
+
+        dir->sub_dirs = sub_dirs;
+        dir->sub_dir_alloc = sub_dir_alloc;
+    }
+
+    size_t position = fe_sub_dir_position(dir, sub_dir->entry_index);
+    memmove(dir->sub_dirs + position + 1, dir->sub_dirs + position,
+            (dir->sub_dir_num - position) * sizeof(FileExplorerDir *));
+    dir->sub_dirs[position] = sub_dir;
+    dir->sub_dir_num++;
+    sub_dir->rows_before = fe_sub_dir_rows(dir, position);
+
+    return 1;
+}
+
+/* Remove sub_dir, whose rows must already have been removed, from the
+ * expanded subdirectories of dir */
+static void fe_remove_sub_dir(FileExplorerDir *dir,
+                              const FileExplorerDir *sub_dir)
+{
+    assert(sub_dir->row_num == 0);
+
+    size_t position = fe_sub_dir_position(dir, sub_dir->entry_index);
+
+    if (position < dir->sub_dir_num && dir->sub_dirs[position] == sub_dir) {
+        memmove(dir->sub_dirs + position, dir->sub_dirs + position + 1,
+                (dir->sub_dir_num - position - 1) *
+                sizeof(FileExplorerDir *));
+        dir->sub_dir_num--;
+    }
+}
+
+/* Returns the number of subdirectories of dir expanded from entries
+ * before entry_index */
+static size_t fe_sub_dir_position(const FileExplorerDir *dir,
+                                  size_t entry_index)
+{
+    size_t low = 0;
+    size_t high = dir->sub_dir_num;
+    size_t mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (dir->sub_dirs[mid]->entry_index < entry_index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/* Returns the rows displayed below the first position expanded
+ * subdirectories of dir */
+static size_t fe_sub_dir_rows(const FileExplorerDir *dir, size_t position)
+{
+    if (position == 0) {
+        return 0;
+    }
+
+    const FileExplorerDir *sub_dir = dir->sub_dirs[position - 1];
+
+    return sub_dir->rows_before + sub_dir->row_num;
+}
+
+/* Update the entry indexes of the subdirectories expanded after an entry
+ * is added at or removed from entry_index */
+static void fe_shift_sub_dirs(FileExplorerDir *dir, size_t entry_index,
+                              int added)
+{
+    size_t position = fe_sub_dir_position(dir, entry_index);
+
+    for (size_t k = position; k < dir->sub_dir_num; k++) {
+        if (added) {
+            dir->sub_dirs[k]->entry_index++;
+        } else {
+            dir->sub_dirs[k]->entry_index--;
+        }
+    }
+}
+
+/* Returns the row an entry is displayed on, starting from 0 */
+static size_t fe_entry_row(const FileExplorer *file_explorer,
+                           const FileExplorerDir *dir, size_t entry_index)
+{
+    size_t row = 0;
+
+    while (1) {
+        row += entry_index +
+               fe_sub_dir_rows(dir, fe_sub_dir_position(dir, entry_index));
+
+        if (dir->parent == NULL) {
+            break;
+        }
+
+        /* Add the row of the directory itself */
+        entry_index = dir->entry_index;
+        row++;
+        dir = dir->parent;
+    }
+
+    return row + file_explorer->parent_row;
+}
+
+/* Find the entry displayed on row. At each level of the tree the last
+ * subdirectory expanded at or before row is found, then row is either in
+ * that subdirectory or maps directly to an entry once the rows of the
+ * subdirectories before it are skipped */
+static int fe_find_row(const FileExplorer *file_explorer, size_t row,
+                       FileExplorerDir **dir_ptr, size_t *entry_index)
+{
+    FileExplorerDir *dir = file_explorer->root;
+    const FileExplorerDir *sub_dir;
+    size_t sub_dir_row;
+    size_t low, high, mid;
+
+    if (dir == NULL) {
+        return 0;
+    } else if (file_explorer->parent_row) {
+        if (row == 0) {
+            return 0;
+        }
+
+        row--;
+    }
+
+    while (1) {
+        low = 0;
+        high = dir->sub_dir_num;
+
+        while (low < high) {
+            mid = low + (high - low) / 2;
+            sub_dir = dir->sub_dirs[mid];
+
+            if (sub_dir->entry_index + sub_dir->rows_before <= row) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (low > 0) {
+            sub_dir = dir->sub_dirs[low - 1];
+            sub_dir_row = sub_dir->entry_index + sub_dir->rows_before;
+
+            if (row > sub_dir_row && row - sub_dir_row <= sub_dir->row_num) {
+                row -= sub_dir_row + 1;
+                dir = (FileExplorerDir *)sub_dir;
+                continue;
+            }
+
+            row -= sub_dir->rows_before;
+
+            if (row > sub_dir->entry_index) {
+                row -= sub_dir->row_num;
+            }
+        }
+
+        break;
+    }
+
+    if (row >= dir->entry_num) {
+        return 0;
+    }
+
+    *dir_ptr = dir;
+    *entry_index = row;
+
+    return 1;
+}
+
+/* Add row_num rows to dir and the directories above it. The subdirectories
+ * expanded after each of them in their parent are displayed row_num rows
+ * further down */
+static void fe_add_row_num(FileExplorerDir *dir, size_t row_num)
+{
+    FileExplorerDir *parent;
+    size_t position;
+
+    for (; dir != NULL; dir = parent) {
+        dir->row_num += row_num;
+        parent = dir->parent;
+
+        if (parent == NULL) {
+            break;
+        }
+
+        position = fe_sub_dir_position(parent, dir->entry_index);
+
+        for (size_t k = position + 1; k < parent->sub_dir_num; k++) {
+            parent->sub_dirs[k]->rows_before += row_num;
+        }
+    }
 }
 
+static void fe_remove_row_num(FileExplorerDir *dir, size_t row_num)
+{
+    FileExplorerDir *parent;
+    size_t position;
+
+    for (; dir != NULL; dir = parent) {
+        dir->row_num -= row_num;
+        parent = dir->parent;
+
+        if (parent == NULL) {
+            break;
+        }
+
+        position = fe_sub_dir_position(parent, dir->entry_index);
+
+        for (size_t k = position + 1; k < parent->sub_dir_num; k++) {
+            parent->sub_dirs[k]->rows_before -= row_num;
+        }
+    }
+}
+
+/* Insert lines for entry_num entries of dir starting at row. The lines
+ * are written in one insert, which isn't undoable, and the cursor stays
+ * on the entry it was on. Row counts are updated by the caller */
+static Status fe_insert_rows(FileExplorer *file_explorer, size_t row,
+                             const FileExplorerDir *dir, size_t entry_index,
+                             size_t entry_num)
+{
+    if (entry_num == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    Buffer *buffer = file_explorer->buffer;
+    const size_t row_num = fe_row_num(file_explorer);
+    const size_t indent = dir->depth * FE_INDENT_SIZE;
+    const DirectoryEntry *de;
+    size_t text_len = entry_num - 1;
+
+    for (size_t k = entry_index; k < entry_index + entry_num; k++) {
+        de = &dir->entries[k];
+        text_len += indent + de->name_len + (de->type == DET_DIRECTORY);
+    }
+
+    /* Rows are separated by new lines. When inserted after existing rows
+     * a new line is needed before them, otherwise after them */
+    if (row_num > 0) {
+        text_len++;
+    }
+
+    char *text = malloc(text_len);
+
+    if (text == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate directory entries");
+    }
+
+    char *end = text;
+
+    if (row_num > 0 && row == row_num) {
+        *end++ = '\n';
+    }
+
+    for (size_t k = entry_index; k < entry_index + entry_num; k++) {
+        de = &dir->entries[k];
+
+        if (k > entry_index) {
+            *end++ = '\n';
+        }
+
+        memset(end, ' ', indent);
+        end += indent;
+        memcpy(end, de->name, de->name_len);
+        end += de->name_len;
+
+        if (de->type == DET_DIRECTORY) {
+            *end++ = '/';
+        }
+    }
+
+    if (row < row_num) {
+        *end++ = '\n';
+    }
+
+    size_t cursor_row = buffer->pos.line_no - 1;
+    BufferPos pos = buffer->pos;
+
+    if (row < row_num) {
+        pos = bp_init_from_line_col(row + 1, 1, &buffer->pos);
+
+        if (cursor_row >= row) {
+            cursor_row += entry_num;
+        }
+    } else {
+        bp_to_buffer_end(&pos);
+    }
+
+    Status status = bf_set_bp(buffer, &pos, 0);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        bc_disable(&buffer->changes);
+        status = bf_insert_string(buffer, text, text_len, 0);
+        bc_enable(&buffer->changes);
+    }
+
+    free(text);
+    RETURN_IF_FAIL(status);
+
+    return fe_set_cursor_row(buffer, cursor_row);
+}
+
+/* Delete the lines of row_num rows starting at row. Row counts are
+ * updated by the caller */
+static Status fe_delete_rows(FileExplorer *file_explorer, size_t row,
+                             size_t row_num)
+{
+    Buffer *buffer = file_explorer->buffer;
+    const size_t total_row_num = fe_row_num(file_explorer);
+    size_t cursor_row = buffer->pos.line_no - 1;
+    Range range;
+
+    if (row + row_num < total_row_num) {
+        range.start = bp_init_from_line_col(row + 1, 1, &buffer->pos);
+        range.end = bp_init_from_line_col(row + row_num + 1, 1,
+                                          &buffer->pos);
+    } else {
+        /* Delete the new line that ends the row before */
+        range.end = buffer->pos;
+        bp_to_buffer_end(&range.end);
+
+        if (row > 0) {
+            range.start = bp_init_from_line_col(row, 1, &buffer->pos);
+            bp_to_line_end(&range.start);
+        } else {
+            range.start = range.end;
+            bp_to_buffer_start(&range.start);
+        }
+    }
+
+    if (cursor_row >= row + row_num) {
+        cursor_row -= row_num;
+    } else if (cursor_row >= row) {
+        cursor_row = MIN(row, total_row_num - row_num - 1);
+    }
+
+    if (range.end.offset > range.start.offset) {
+        bc_disable(&buffer->changes);
+        Status status = bf_delete_range(buffer, &range);
+        bc_enable(&buffer->changes);
+        RETURN_IF_FAIL(status);
+    }
+
+    return fe_set_cursor_row(buffer, cursor_row);
+}
+
+static Status fe_set_cursor_row(Buffer *buffer, size_t row)
+{
+    BufferPos pos = bp_init_from_line_col(row + 1, 1, &buffer->pos);
+    return bf_set_bp(buffer, &pos, 0);
+}
@@ -19,22 +19,98 @@
 #ifndef WED_FILE_EXPLORER_H
 #define WED_FILE_EXPLORER_H
 
+#include <pthread.h>
+#include <sys/select.h>
 #include "buffer.h"
+#include "list.h"
 
-/* The file explorer contains a list of files and directories present in
- * a specified directory */
+/* The file explorer displays the files and directories below a directory
+ * as a tree. Selecting a directory expands or collapses it in place. The
+ * entries of a directory are read by a background thread, in large
+ * batches using getdents64 on Linux, and added to the tree once sorted.
+ * On Linux each expanded directory is watched using inotify, so entries
+ * are added to and removed from the tree as files are created and
+ * deleted without the directory being read again.
+ *
+ * Entry names are stored in blocks which are allocated for each directory
+ * and never moved. Each entry is displayed as a line of the explorer's
+ * buffer. Expanding, collapsing or updating a directory only inserts or
+ * deletes the lines of the entries that changed, which are written in a
+ * single insert. Each directory keeps its expanded subdirectories in entry
+ * order along with the rows displayed before each one, so the row of an
+ * entry, and the entry on a row, are found using a binary search at each
+ * level of the tree rather than by counting the rows of every entry */
+
+/* Classify each directory entry */
+typedef enum {
+    DET_DIRECTORY,
+    DET_FILE
+} DirectoryEntryType;
+
+typedef struct FileExplorerDir FileExplorerDir;
+typedef struct FileExplorerNameBlock FileExplorerNameBlock;
+
+typedef struct {
+    const char *name; /* Entry name, stored in a name block of its
+                         directory */
+    size_t name_len; /* Length of name */
+    DirectoryEntryType type; /* File or directory */
+    FileExplorerDir *dir; /* Contents of the directory when it's expanded,
+                             otherwise NULL */
+} DirectoryEntry;
+
+/* An expanded directory */
+struct FileExplorerDir {
+    char *path; /* Absolute path of directory */
+    FileExplorerDir *parent; /* Directory containing this one or NULL */
+    size_t depth; /* Number of directories above this one in the tree */
+    FileExplorerNameBlock *names; /* Blocks storing entry names */
+    DirectoryEntry *entries; /* Directories then files sorted by name */
+    size_t entry_num; /* Number of entries */
+    size_t entry_alloc; /* Size of entries array */
+    size_t row_num; /* Number of rows displayed below this directory,
+                       including the rows of expanded subdirectories */
+    size_t entry_index; /* Index of the entry in parent this directory is
+                           expanded from */
+    size_t rows_before; /* Rows displayed below the subdirectories of
+                           parent expanded before this one */
+    FileExplorerDir **sub_dirs; /* Expanded subdirectories ordered by
+                                   entry index */
+    size_t sub_dir_num; /* Number of expanded subdirectories */
+    size_t sub_dir_alloc; /* Size of sub_dirs array */
+    int watch_wd; /* inotify watch descriptor or -1 */
+    int reading; /* True whilst entries are read in the background */
+    List *events; /* Changes to the directory reported whilst it was
+                     read, applied once the read is complete */
+};
+
+/* The file explorer contains a tree of the files and directories present
+ * in a specified directory */
 typedef struct {
-    char *dir_path; /* The directory which is listed */
-    Buffer *buffer; /* Contains a sequence of directories and files */
-    size_t dir_entries; /* The number of directory entries in the buffer */
-    size_t file_entries; /* The number of file entries in the buffer */
+    char *dir_path; /* The directory at the root of the tree */
+    FileExplorerDir *root; /* Contents of dir_path */
+    int parent_row; /* True if the first row links to the parent of
+                       dir_path */
+    List *dirs; /* All expanded directories */
+    Buffer *buffer; /* Contains a line for each visible entry */
+    List *reads; /* Directories being read in the background */
+    pthread_mutex_t read_lock; /* Protects the state of each read */
+    int notify_fds[2]; /* Reading threads write to notify_fds[1] when
+                          done. notify_fds[0] is monitored by main
+                          thread */
+    int watch_fd; /* inotify descriptor or -1 if unavailable */
 } FileExplorer;
 
 FileExplorer *fe_new(Buffer *buffer);
 void fe_free(FileExplorer *);
 Status fe_read_cwd(FileExplorer *);
 Status fe_read_directory(FileExplorer *, const char *dir_path);
+Status fe_wait(FileExplorer *);
+void fe_add_fds(const FileExplorer *, fd_set *read_fds, int *max_fd);
+Status fe_process(FileExplorer *, const fd_set *read_fds, int *updated);
 Buffer *fe_get_buffer(const FileExplorer *);
 char *fe_get_selected(const FileExplorer *);
+int fe_is_directory_row(const FileExplorer *, size_t row);
+Status fe_toggle_selected(FileExplorer *, int *toggled);
 
 #endif
@@ -0,0 +1,1468 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* For DT_DIR, DT_REG, DT_LNK and _SC_NPROCESSORS_ONLN */
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "file_search.h"
+#include "util.h"
+
+/* Upper limit on the number of worker threads */
+#define FS_MAX_WORKER_NUM 16
+/* Files containing a null byte in their first FS_BINARY_CHECK_SIZE bytes
+ * are treated as binary and aren't searched */
+#define FS_BINARY_CHECK_SIZE 8192
+/* Maximum number of bytes of a matching line displayed in the results */
+#define FS_MAX_LINE_DISPLAY_SIZE 256
+/* Initial size of each worker's task queue */
+#define FS_TASK_QUEUE_SIZE 64
+/* Initial size of result text and match arrays */
+#define FS_RESULT_ALLOC_SIZE 512
+/* When listing files each worker passes paths to the main thread in
+ * batches of roughly this many bytes */
+#define FS_LIST_BATCH_SIZE 8192
+
+/* A file or directory waiting to be searched */
+struct FileSearchTask {
+    const FileSearchIgnoreList *ignore; /* Ignore rules in effect for path */
+    int is_dir; /* True if path is a directory */
+    char path[]; /* File or directory path */
+};
+
+/* The matches found in a single file. The text field contains the lines
+ * that will be displayed to the user, one line for each match */
+struct FileSearchResult {
+    FileSearchResult *next; /* Next result in queue */
+    char *file_path; /* File the matches were found in */
+    char *text; /* Formatted match lines */
+    size_t text_len;
+    size_t text_alloc;
+    FileSearchMatch *matches; /* Location of each match */
+    size_t match_num;
+    size_t match_alloc;
+};
+
+/* A pattern from a .gitignore file */
+typedef struct {
+    char *pattern; /* fnmatch pattern */
+    int negate; /* Pattern started with ! */
+    int dir_only; /* Pattern ended with / so only matches directories */
+    int anchored; /* Pattern contains a / so is matched against the path
+                     relative to the .gitignore file rather than the name */
+} FileSearchIgnorePattern;
+
+/* The patterns from the .gitignore file in a directory. Patterns in a
+ * subdirectory take precedence over those in parent directories */
+struct FileSearchIgnoreList {
+    const FileSearchIgnoreList *parent; /* Ignore list of parent directory */
+    char *base; /* Directory containing .gitignore with trailing / */
+    size_t base_len;
+    FileSearchIgnorePattern *patterns;
+    size_t pattern_num;
+};
+
+/* Tasks are added and removed from the tail of the queue by the worker
+ * that owns it, so that a worker continues to search the most recently
+ * discovered directory. Other workers take tasks from the head */
+typedef struct {
+    pthread_mutex_t lock;
+    FileSearchTask **tasks;
+    size_t head;
+    size_t tail;
+    size_t alloc;
+} FileSearchQueue;
+
+struct FileSearchWorker {
+    FileSearch *fs; /* The search this worker is part of */
+    size_t index; /* Index in fs->workers */
+    pthread_t thread;
+    FileSearchQueue queue; /* Tasks for this worker */
+    RegexSearch regex; /* Copy of fs->regex with its own output vector */
+    FileSearchResult *result; /* Result for file currently being searched */
+};
+
+static FileSearch *fs_alloc(const char *dir_path);
+static void fs_free_ignore_list(FileSearchIgnoreList *);
+static void fs_free_result(FileSearchResult *);
+static void fs_free_task_queue(FileSearchQueue *);
+static Status fs_init_search(FileSearch *);
+static void *fs_worker_run(void *);
+static FileSearchTask *fs_new_task(const char *path, int is_dir,
+                                   const FileSearchIgnoreList *);
+static int fs_push_task(FileSearchWorker *, FileSearchTask *);
+static FileSearchTask *fs_next_task(FileSearchWorker *);
+static FileSearchTask *fs_pop_task(FileSearchQueue *, int from_tail);
+static FileSearchTask *fs_steal_task(FileSearchWorker *);
+static void fs_task_done(FileSearch *);
+static void fs_worker_finished(FileSearch *);
+static int fs_is_cancelled(FileSearch *);
+static void fs_notify(FileSearch *);
+static void fs_set_worker_error(FileSearch *, Status);
+static char *fs_join_path(const char *dir_path, const char *name);
+static Status fs_search_dir(FileSearchWorker *, const FileSearchTask *);
+static Status fs_load_ignore_list(FileSearch *, const char *dir_path,
+                                  const FileSearchIgnoreList *parent,
+                                  const FileSearchIgnoreList **ignore);
+static int fs_parse_ignore_pattern(char *line, FileSearchIgnorePattern *);
+static int fs_is_ignored(const FileSearchIgnoreList *, const char *path,
+                         const char *name, int is_dir);
+static Status fs_search_file(FileSearchWorker *, const FileSearchTask *);
+static int fs_find_next(FileSearchWorker *, const char *text, size_t text_len,
+                        size_t point, int check_utf8, size_t *match_point);
+static Status fs_add_match(FileSearchWorker *, const char *file_path,
+                           size_t line_no, size_t col_no, const char *line,
+                           size_t line_len);
+static int fs_append_text(FileSearchResult *, const char *text,
+                          size_t text_len);
+static void fs_add_result(FileSearch *, FileSearchResult *);
+static Status fs_list_path(FileSearchWorker *, const char *path, int is_dir);
+static Status fs_store_matches(FileSearch *, FileSearchResult *);
+static Status fs_store_paths(FileSearch *, const FileSearchResult *);
+
+FileSearch *fs_new(const char *dir_path, const SearchOptions *opt,
+                   int is_regex)
+{
+    assert(!is_null_or_empty(dir_path));
+    assert(opt != NULL);
+    assert(opt->pattern_len > 0);
+
+    FileSearch *fs = fs_alloc(dir_path);
+    RETURN_IF_NULL(fs);
+
+    fs->is_regex = is_regex;
+    fs->opt = *opt;
+    fs->opt.forward = 1;
+    fs->opt.pattern = malloc(opt->pattern_len + 1);
+
+    if (fs->opt.pattern == NULL) {
+        fs_free(fs);
+        return NULL;
+    }
+
+    memcpy(fs->opt.pattern, opt->pattern, opt->pattern_len);
+    fs->opt.pattern[opt->pattern_len] = '\0';
+
+    return fs;
+}
+
+/* Create a search which lists every file and directory under dir_path
+ * which isn't ignored */
+FileSearch *fs_new_file_list(const char *dir_path)
+{
+    assert(!is_null_or_empty(dir_path));
+
+    FileSearch *fs = fs_alloc(dir_path);
+    RETURN_IF_NULL(fs);
+
+    fs->list_files = 1;
+
+    if ((fs->dir_paths = list_new()) == NULL) {
+        fs_free(fs);
+        return NULL;
+    }
+
+    return fs;
+}
+
+static FileSearch *fs_alloc(const char *dir_path)
+{
+    FileSearch *fs = malloc(sizeof(FileSearch));
+    RETURN_IF_NULL(fs);
+    memset(fs, 0, sizeof(FileSearch));
+
+    fs->notify_fds[0] = fs->notify_fds[1] = -1;
+
+    fs->dir_path = strdup(dir_path);
+    fs->ignore_lists = list_new();
+    fs->file_paths = list_new();
+
+    if (fs->dir_path == NULL || fs->ignore_lists == NULL ||
+        fs->file_paths == NULL) {
+        fs_free(fs);
+        return NULL;
+    }
+
+    return fs;
+}
+
+void fs_free(FileSearch *fs)
+{
+    if (fs == NULL) {
+        return;
+    }
+
+    if (fs->started) {
+        fs_cancel(fs);
+        fs_wait(fs);
+
+        FileSearchResult *result = fs->results_head;
+        FileSearchResult *next;
+
+        while (result != NULL) {
+            next = result->next;
+            fs_free_result(result);
+            result = next;
+        }
+
+        st_free_status(fs->worker_status);
+        pthread_mutex_destroy(&fs->state_lock);
+        pthread_mutex_destroy(&fs->results_lock);
+        pthread_cond_destroy(&fs->state_changed);
+    }
+
+    if (fs->is_regex) {
+        rs_free(&fs->regex);
+    } else if (!fs->list_files) {
+        ts_free(&fs->text);
+    }
+
+    if (fs->workers != NULL) {
+        for (size_t k = 0; k < fs->worker_num; k++) {
+            fs_free_task_queue(&fs->workers[k].queue);
+        }
+
+        free(fs->workers);
+    }
+
+    for (size_t k = 0; k < 2; k++) {
+        if (fs->notify_fds[k] != -1) {
+            close(fs->notify_fds[k]);
+        }
+    }
+
+    list_free_all_custom(fs->ignore_lists,
+                         (ListEntryFree)fs_free_ignore_list);
+    list_free_all(fs->file_paths);
+
+    if (fs->dir_paths != NULL) {
+        list_free_all(fs->dir_paths);
+    }
+
+    free(fs->matches);
+    free(fs->opt.pattern);
+    free(fs->dir_path);
+    free(fs);
+}
+
+static void fs_free_ignore_list(FileSearchIgnoreList *ignore)
+{
+    if (ignore == NULL) {
+        return;
+    }
+
+    for (size_t k = 0; k < ignore->pattern_num; k++) {
+        free(ignore->patterns[k].pattern);
+    }
+
+    free(ignore->patterns);
+    free(ignore->base);
+    free(ignore);
+}
+
+static void fs_free_result(FileSearchResult *result)
+{
+    if (result == NULL) {
+        return;
+    }
+
+    free(result->file_path);
+    free(result->text);
+    free(result->matches);
+    free(result);
+}
+
+static void fs_free_task_queue(FileSearchQueue *queue)
+{
+    if (queue->tasks == NULL) {
+        return;
+    }
+
+    for (size_t k = queue->head; k < queue->tail; k++) {
+        free(queue->tasks[k]);
+    }
+
+    free(queue->tasks);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+static Status fs_init_search(FileSearch *fs)
+{
+    if (fs->is_regex) {
+        RETURN_IF_FAIL(rs_init(&fs->regex, &fs->opt));
+    } else if (!fs->list_files) {
+        RETURN_IF_FAIL(ts_init(&fs->text, &fs->opt));
+    }
+
+    if (pipe(fs->notify_fds) == -1) {
+        fs->notify_fds[0] = fs->notify_fds[1] = -1;
+        return st_get_error(ERR_UNABLE_TO_SEARCH_FILES,
+                            "Unable to create pipe: %s", strerror(errno));
+    }
+
+    /* The main thread drains the pipe without blocking and workers
+     * shouldn't block if the pipe is full as the main thread will
+     * already have been notified */
+    for (size_t k = 0; k < 2; k++) {
+        int flags = fcntl(fs->notify_fds[k], F_GETFL);
+
+        if (flags == -1 ||
+            fcntl(fs->notify_fds[k], F_SETFL, flags | O_NONBLOCK) == -1) {
+            return st_get_error(ERR_UNABLE_TO_SEARCH_FILES,
+                                "Unable to configure pipe: %s",
+                                strerror(errno));
+        }
+    }
+
+    long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpu_num < 1) {
+        cpu_num = 1;
+    }
+
+    fs->worker_num = MIN((size_t)cpu_num, FS_MAX_WORKER_NUM);
+    fs->workers = malloc(sizeof(FileSearchWorker) * fs->worker_num);
+
+    if (fs->workers == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate file search workers");
+    }
+
+    memset(fs->workers, 0, sizeof(FileSearchWorker) * fs->worker_num);
+
+    for (size_t k = 0; k < fs->worker_num; k++) {
+        FileSearchWorker *worker = &fs->workers[k];
+        FileSearchQueue *queue = &worker->queue;
+
+        worker->fs = fs;
+        worker->index = k;
+        worker->regex = fs->regex;
+
+        queue->tasks = malloc(sizeof(FileSearchTask *) * FS_TASK_QUEUE_SIZE);
+
+        if (queue->tasks == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate file search queue");
+        }
+
+        queue->alloc = FS_TASK_QUEUE_SIZE;
+        pthread_mutex_init(&queue->lock, NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+Status fs_start(FileSearch *fs)
+{
+    assert(!fs->started);
+
+    RETURN_IF_FAIL(fs_init_search(fs));
+
+    FileSearchTask *task = fs_new_task(fs->dir_path, 1, NULL);
+
+    if (task == NULL) {
+        return OUT_OF_MEMORY("Unable to create file search task");
+    }
+
+    pthread_mutex_init(&fs->state_lock, NULL);
+    pthread_mutex_init(&fs->results_lock, NULL);
+    pthread_cond_init(&fs->state_changed, NULL);
+    fs->worker_status = STATUS_SUCCESS;
+    fs->started = 1;
+
+    /* Searching starts from the top level directory which is given to the
+     * first worker. Other workers will steal tasks from it */
+    fs->pending = 1;
+    fs->workers[0].queue.tasks[fs->workers[0].queue.tail++] = task;
+
+    /* Hold the state lock whilst threads are created so that no worker can
+     * finish before thread_num is final */
+    pthread_mutex_lock(&fs->state_lock);
+
+    for (size_t k = 0; k < fs->worker_num; k++) {
+        if (pthread_create(&fs->workers[k].thread, NULL, fs_worker_run,
+                           &fs->workers[k]) != 0) {
+            break;
+        }
+
+        fs->thread_num++;
+    }
+
+    pthread_mutex_unlock(&fs->state_lock);
+
+    if (fs->thread_num == 0) {
+        fs->joined = 1;
+        fs->workers_finished = 1;
+        return st_get_error(ERR_UNABLE_TO_SEARCH_FILES,
+                            "Unable to create file search threads");
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void fs_cancel(FileSearch *fs)
+{
+    if (!fs->started) {
+        return;
+    }
+
+    pthread_mutex_lock(&fs->state_lock);
+    fs->cancelled = 1;
+    pthread_mutex_unlock(&fs->state_lock);
+}
+
+/* Block until all workers have exited */
+void fs_wait(FileSearch *fs)
+{
+    if (!fs->started || fs->joined) {
+        return;
+    }
+
+    for (size_t k = 0; k < fs->thread_num; k++) {
+        pthread_join(fs->workers[k].thread, NULL);
+    }
+
+    fs->joined = 1;
+}
+
+int fs_get_fd(const FileSearch *fs)
+{
+    return fs->notify_fds[0];
+}
+
+static void *fs_worker_run(void *arg)
+{
+    FileSearchWorker *worker = arg;
+    FileSearch *fs = worker->fs;
+    FileSearchTask *task;
+    Status status;
+
+    while ((task = fs_next_task(worker)) != NULL) {
+        /* Once cancelled the remaining tasks are discarded */
+        if (!fs_is_cancelled(fs)) {
+            if (task->is_dir) {
+                status = fs_search_dir(worker, task);
+            } else if (fs->list_files) {
+                status = fs_list_path(worker, task->path, 0);
+            } else {
+                status = fs_search_file(worker, task);
+            }
+
+            fs_set_worker_error(fs, status);
+        }
+
+        free(task);
+        fs_task_done(fs);
+    }
+
+    /* Pass on any paths listed since the last batch */
+    if (worker->result != NULL) {
+        fs_add_result(fs, worker->result);
+        worker->result = NULL;
+    }
+
+    fs_worker_finished(fs);
+
+    return NULL;
+}
+
+static FileSearchTask *fs_new_task(const char *path, int is_dir,
+                                   const FileSearchIgnoreList *ignore)
+{
+    size_t path_len = strlen(path);
+    FileSearchTask *task = malloc(sizeof(FileSearchTask) + path_len + 1);
+    RETURN_IF_NULL(task);
+
+    task->ignore = ignore;
+    task->is_dir = is_dir;
+    memcpy(task->path, path, path_len + 1);
+
+    return task;
+}
+
+static int fs_push_task(FileSearchWorker *worker, FileSearchTask *task)
+{
+    FileSearch *fs = worker->fs;
+    FileSearchQueue *queue = &worker->queue;
+
+    /* The task must be counted before it can be stolen, otherwise the
+     * pending count could reach zero whilst work remains */
+    pthread_mutex_lock(&fs->state_lock);
+    fs->pending++;
+    pthread_mutex_unlock(&fs->state_lock);
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->tail == queue->alloc) {
+        if (queue->head > 0) {
+            memmove(queue->tasks, queue->tasks + queue->head,
+                    sizeof(FileSearchTask *) * (queue->tail - queue->head));
+            queue->tail -= queue->head;
+            queue->head = 0;
+        } else {
+            size_t alloc = queue->alloc * 2;
+            FileSearchTask **tasks = realloc(queue->tasks,
+                                             sizeof(FileSearchTask *) * alloc);
+
+            if (tasks == NULL) {
+                pthread_mutex_unlock(&queue->lock);
+                fs_task_done(fs);
+                return 0;
+            }
+
+            queue->tasks = tasks;
+            queue->alloc = alloc;
+        }
+    }
+
+    queue->tasks[queue->tail++] = task;
+
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_mutex_lock(&fs->state_lock);
+    fs->work_generation++;
+
+    if (fs->idle_workers > 0) {
+        pthread_cond_broadcast(&fs->state_changed);
+    }
+
+    pthread_mutex_unlock(&fs->state_lock);
+
+    return 1;
+}
+
+/* Returns the next task this worker should process or NULL when all
+ * tasks have been completed */
+static FileSearchTask *fs_next_task(FileSearchWorker *worker)
+{
+    FileSearch *fs = worker->fs;
+    FileSearchTask *task;
+    size_t work_generation;
+    int finished;
+
+    while (1) {
+        if ((task = fs_pop_task(&worker->queue, 1)) != NULL) {
+            return task;
+        }
+
+        pthread_mutex_lock(&fs->state_lock);
+        work_generation = fs->work_generation;
+        finished = fs->pending == 0;
+        pthread_mutex_unlock(&fs->state_lock);
+
+        if (finished) {
+            return NULL;
+        }
+
+        if ((task = fs_steal_task(worker)) != NULL) {
+            return task;
+        }
+
+        /* Tasks remain in progress so wait for one of them to add more
+         * work or for all work to complete. A change in work_generation
+         * means a task was added since the queues were checked */
+        pthread_mutex_lock(&fs->state_lock);
+
+        while (fs->pending > 0 && fs->work_generation == work_generation) {
+            fs->idle_workers++;
+            pthread_cond_wait(&fs->state_changed, &fs->state_lock);
+            fs->idle_workers--;
+        }
+
+        finished = fs->pending == 0;
+        pthread_mutex_unlock(&fs->state_lock);
+
+        if (finished) {
+            return NULL;
+        }
+    }
+}
+
+static FileSearchTask *fs_pop_task(FileSearchQueue *queue, int from_tail)
+{
+    FileSearchTask *task = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->tail > queue->head) {
+        if (from_tail) {
+            task = queue->tasks[--queue->tail];
+        } else {
+            task = queue->tasks[queue->head++];
+        }
+
+        if (queue->head == queue->tail) {
+            queue->head = queue->tail = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return task;
+}
+
+static FileSearchTask *fs_steal_task(FileSearchWorker *worker)
+{
+    FileSearch *fs = worker->fs;
+    FileSearchTask *task;
+    size_t index;
+
+    for (size_t k = 1; k < fs->worker_num; k++) {
+        index = (worker->index + k) % fs->worker_num;
+
+        if ((task = fs_pop_task(&fs->workers[index].queue, 0)) != NULL) {
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+static void fs_task_done(FileSearch *fs)
+{
+    pthread_mutex_lock(&fs->state_lock);
+
+    if (--fs->pending == 0) {
+        pthread_cond_broadcast(&fs->state_changed);
+    }
+
+    pthread_mutex_unlock(&fs->state_lock);
+}
+
+static void fs_worker_finished(FileSearch *fs)
+{
+    int notify = 0;
+
+    pthread_mutex_lock(&fs->state_lock);
+
+    if (++fs->finished_workers == fs->thread_num) {
+        fs->workers_finished = 1;
+        notify = 1;
+    }
+
+    pthread_mutex_unlock(&fs->state_lock);
+
+    if (notify) {
+        fs_notify(fs);
+    }
+}
+
+static int fs_is_cancelled(FileSearch *fs)
+{
+    pthread_mutex_lock(&fs->state_lock);
+    int cancelled = fs->cancelled;
+    pthread_mutex_unlock(&fs->state_lock);
+
+    return cancelled;
+}
+
+static void fs_notify(FileSearch *fs)
+{
+    char c = 0;
+    ssize_t written;
+
+    /* If the pipe is full the main thread already has a notification
+     * waiting, so EAGAIN can be ignored */
+    do {
+        written = write(fs->notify_fds[1], &c, 1);
+    } while (written == -1 && errno == EINTR);
+}
+
+static void fs_set_worker_error(FileSearch *fs, Status status)
+{
+    if (STATUS_IS_SUCCESS(status)) {
+        return;
+    }
+
+    pthread_mutex_lock(&fs->results_lock);
+
+    /* Only the first error is reported */
+    if (STATUS_IS_SUCCESS(fs->worker_status)) {
+        fs->worker_status = status;
+    } else {
+        st_free_status(status);
+    }
+
+    pthread_mutex_unlock(&fs->results_lock);
+
+    fs_notify(fs);
+}
+
+static char *fs_join_path(const char *dir_path, const char *name)
+{
+    if (strcmp(dir_path, ".") == 0) {
+        return strdup(name);
+    }
+
+    size_t dir_len = strlen(dir_path);
+    size_t name_len = strlen(name);
+    int add_sep = dir_len > 0 && dir_path[dir_len - 1] != '/';
+    char *path = malloc(dir_len + add_sep + name_len + 1);
+    RETURN_IF_NULL(path);
+
+    memcpy(path, dir_path, dir_len);
+
+    if (add_sep) {
+        path[dir_len] = '/';
+    }
+
+    memcpy(path + dir_len + add_sep, name, name_len + 1);
+
+    return path;
+}
+
+/* Read a directory and add a task for each entry that isn't ignored */
+static Status fs_search_dir(FileSearchWorker *worker,
+                            const FileSearchTask *task)
+{
+    FileSearch *fs = worker->fs;
+    const FileSearchIgnoreList *ignore;
+
+    RETURN_IF_FAIL(fs_load_ignore_list(fs, task->path, task->ignore,
+                                       &ignore));
+
+    if (fs->list_files && strcmp(task->path, fs->dir_path) != 0) {
+        /* Every directory except the top level directory is listed */
+        RETURN_IF_FAIL(fs_list_path(worker, task->path, 1));
+    }
+
+    DIR *dir = opendir(task->path);
+
+    if (dir == NULL) {
+        /* Unreadable directories are skipped */
+        return STATUS_SUCCESS;
+    }
+
+    Status status = STATUS_SUCCESS;
+    struct dirent *dir_ent;
+    struct stat file_info;
+    FileSearchTask *child;
+    char *path;
+    int is_dir;
+
+    while ((dir_ent = readdir(dir)) != NULL) {
+        const char *name = dir_ent->d_name;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+            strcmp(name, ".git") == 0) {
+            continue;
+        }
+
+        if ((path = fs_join_path(task->path, name)) == NULL) {
+            status = OUT_OF_MEMORY("Unable to create path");
+            break;
+        }
+
+        if (dir_ent->d_type == DT_DIR) {
+            is_dir = 1;
+        } else if (dir_ent->d_type == DT_REG) {
+            is_dir = 0;
+        } else if (dir_ent->d_type == DT_LNK ||
+                   dir_ent->d_type == DT_UNKNOWN) {
+            /* Symbolic links to files are followed, but not links to
+             * directories as they can create cycles */
+            if (stat(path, &file_info) == -1 ||
+                (S_ISDIR(file_info.st_mode) &&
+                 dir_ent->d_type == DT_LNK)) {
+                free(path);
+                continue;
+            } else if (S_ISDIR(file_info.st_mode)) {
+                is_dir = 1;
+            } else if (S_ISREG(file_info.st_mode)) {
+                is_dir = 0;
+            } else {
+                free(path);
+                continue;
+            }
+        } else {
+            free(path);
+            continue;
+        }
+
+        if (fs_is_ignored(ignore, path, name, is_dir)) {
+            free(path);
+            continue;
+        }
+
+        child = fs_new_task(path, is_dir, ignore);
+        free(path);
+
+        if (child == NULL || !fs_push_task(worker, child)) {
+            free(child);
+            status = OUT_OF_MEMORY("Unable to create file search task");
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    return status;
+}
+
+/* Parse the .gitignore file in dir_path if one exists. ignore is set
+ * to the list of rules that apply to the entries in dir_path */
+static Status fs_load_ignore_list(FileSearch *fs, const char *dir_path,
+                                  const FileSearchIgnoreList *parent,
+                                  const FileSearchIgnoreList **ignore)
+{
+    *ignore = parent;
+
+    char *path = fs_join_path(dir_path, ".gitignore");
+
+    if (path == NULL) {
+        return OUT_OF_MEMORY("Unable to create path");
+    }
+
+    FILE *file = fopen(path, "r");
+    free(path);
+
+    if (file == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    Status status = STATUS_SUCCESS;
+    FileSearchIgnoreList *list = malloc(sizeof(FileSearchIgnoreList));
+    char *line = NULL;
+    size_t line_alloc = 0;
+    size_t pattern_alloc = 0;
+
+    if (list == NULL) {
+        fclose(file);
+        return OUT_OF_MEMORY("Unable to allocate ignore list");
+    }
+
+    memset(list, 0, sizeof(FileSearchIgnoreList));
+    list->parent = parent;
+
+    /* Paths are matched relative to the directory containing
+     * the .gitignore file */
+    if (strcmp(dir_path, ".") == 0) {
+        list->base = strdup("");
+    } else {
+        list->base = fs_join_path(dir_path, "");
+    }
+
+    if (list->base == NULL) {
+        status = OUT_OF_MEMORY("Unable to allocate ignore list");
+        goto cleanup;
+    }
+
+    list->base_len = strlen(list->base);
+
+    while (getline(&line, &line_alloc, file) != -1) {
+        FileSearchIgnorePattern pattern;
+
+        if (!fs_parse_ignore_pattern(line, &pattern)) {
+            continue;
+        }
+
+        if ((pattern.pattern = strdup(pattern.pattern)) == NULL) {
+            status = OUT_OF_MEMORY("Unable to allocate ignore pattern");
+            goto cleanup;
+        }
+
+        if (list->pattern_num == pattern_alloc) {
+            size_t alloc = pattern_alloc == 0 ? 8 : pattern_alloc * 2;
+            FileSearchIgnorePattern *patterns =
+                realloc(list->patterns,
+                        sizeof(FileSearchIgnorePattern) * alloc);
+
+            if (patterns == NULL) {
+                free(pattern.pattern);
+                status = OUT_OF_MEMORY("Unable to allocate ignore pattern");
+                goto cleanup;
+            }
+
+            list->patterns = patterns;
+            pattern_alloc = alloc;
+        }
+
+        list->patterns[list->pattern_num++] = pattern;
+    }
+
+    if (list->pattern_num == 0) {
+        goto cleanup;
+    }
+
+    pthread_mutex_lock(&fs->state_lock);
+    int added = list_add(fs->ignore_lists, list);
+    pthread_mutex_unlock(&fs->state_lock);
+
+    if (!added) {
+        status = OUT_OF_MEMORY("Unable to add ignore list");
+        goto cleanup;
+    }
+
+    *ignore = list;
+    list = NULL;
+
+cleanup:
+    fs_free_ignore_list(list);
+    free(line);
+    fclose(file);
+
+    return status;
+}
+
+/* Supports the commonly used subset of the gitignore pattern format:
+ * comments, negation with !, directory only patterns ending in /,
+ * patterns anchored by a /, a leading ** / and glob characters.
+ * The pattern field is set to point into line, which is modified */
+static int fs_parse_ignore_pattern(char *line,
+                                   FileSearchIgnorePattern *pattern)
+{
+    size_t len = strlen(line);
+
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                       line[len - 1] == ' ')) {
+        line[--len] = '\0';
+    }
+
+    if (len == 0 || *line == '#') {
+        return 0;
+    }
+
+    memset(pattern, 0, sizeof(FileSearchIgnorePattern));
+
+    if (*line == '!') {
+        pattern->negate = 1;
+        line++;
+        len--;
+    } else if (*line == '\\') {
+        line++;
+        len--;
+    }
+
+    if (len > 0 && line[len - 1] == '/') {
+        pattern->dir_only = 1;
+        line[--len] = '\0';
+    }
+
+    if (strncmp(line, "**/", 3) == 0) {
+        line += 3;
+        len -= 3;
+    }
+
+    if (*line == '/') {
+        pattern->anchored = 1;
+        line++;
+        len--;
+    } else if (strchr(line, '/') != NULL) {
+        pattern->anchored = 1;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    pattern->pattern = line;
+
+    return 1;
+}
+
+/* The last matching pattern in the deepest .gitignore file determines
+ * whether a path is ignored */
+static int fs_is_ignored(const FileSearchIgnoreList *ignore, const char *path,
+                         const char *name, int is_dir)
+{
+    const FileSearchIgnorePattern *pattern;
+
+    for (; ignore != NULL; ignore = ignore->parent) {
+        for (size_t k = ignore->pattern_num; k > 0; k--) {
+            pattern = &ignore->patterns[k - 1];
+
+            if (pattern->dir_only && !is_dir) {
+                continue;
+            }
+
+            if (pattern->anchored) {
+                if (fnmatch(pattern->pattern, path + ignore->base_len,
+                            FNM_PATHNAME) == 0) {
+                    return !pattern->negate;
+                }
+            } else if (fnmatch(pattern->pattern, name, 0) == 0) {
+                return !pattern->negate;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static Status fs_search_file(FileSearchWorker *worker,
+                             const FileSearchTask *task)
+{
+    FileSearch *fs = worker->fs;
+    int fd = open(task->path, O_RDONLY);
+
+    if (fd == -1) {
+        /* Unreadable files are skipped */
+        return STATUS_SUCCESS;
+    }
+
+    struct stat file_info;
+
+    /* pcre_exec takes an int length so larger files can't be
+     * searched using a regex */
+    if (fstat(fd, &file_info) == -1 || !S_ISREG(file_info.st_mode) ||
+        file_info.st_size == 0 ||
+        (fs->is_regex && file_info.st_size > INT_MAX)) {
+        close(fd);
+        return STATUS_SUCCESS;
+    }
+
+    size_t text_len = file_info.st_size;
+    void *map = mmap(NULL, text_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return STATUS_SUCCESS;
+    }
+
+    posix_madvise(map, text_len, POSIX_MADV_SEQUENTIAL);
+
+    const char *text = map;
+    Status status = STATUS_SUCCESS;
+
+    if (memchr(text, '\0', MIN(text_len, FS_BINARY_CHECK_SIZE)) != NULL) {
+        munmap(map, text_len);
+        return STATUS_SUCCESS;
+    }
+
+    size_t point = 0;
+    size_t match_point;
+    size_t line_no = 1;
+    size_t line_start = 0;
+    size_t counted = 0;
+    const char *newline;
+    int check_utf8 = 1;
+
+    while (point < text_len &&
+           fs_find_next(worker, text, text_len, point, check_utf8,
+                        &match_point)) {
+        /* The text was validated as UTF-8 on the first search */
+        check_utf8 = 0;
+
+        while ((newline = memchr(text + counted, '\n',
+                                 match_point - counted)) != NULL) {
+            line_no++;
+            counted = line_start = newline - text + 1;
+        }
+
+        counted = match_point;
+
+        newline = memchr(text + match_point, '\n', text_len - match_point);
+        size_t line_end = newline == NULL ? text_len
+                                          : (size_t)(newline - text);
+
+        status = fs_add_match(worker, task->path, line_no,
+                              match_point - line_start + 1,
+                              text + line_start, line_end - line_start);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        /* Only one match is reported per line */
+        point = line_end + 1;
+    }
+
+    munmap(map, text_len);
+
+    if (worker->result != NULL) {
+        if (STATUS_IS_SUCCESS(status)) {
+            fs_add_result(fs, worker->result);
+        } else {
+            fs_free_result(worker->result);
+        }
+
+        worker->result = NULL;
+    }
+
+    return status;
+}
+
+static int fs_find_next(FileSearchWorker *worker, const char *text,
+                        size_t text_len, size_t point, int check_utf8,
+                        size_t *match_point)
+{
+    FileSearch *fs = worker->fs;
+
+    if (!fs->is_regex) {
+        return ts_find_next_in_text(&fs->text, text, point, text_len,
+                                    match_point);
+    }
+
+    int found_match = 0;
+    Status status = rs_find_next_in_text(&worker->regex, text, point,
+                                         text_len, check_utf8, match_point,
+                                         &found_match);
+
+    /* Files which aren't valid UTF-8 or cause the regex to exceed
+     * PCRE's limits are skipped */
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        return 0;
+    }
+
+    return found_match;
+}
+
+/* Add a line of the form path:line:col:text to the result for the
+ * current file */
+static Status fs_add_match(FileSearchWorker *worker, const char *file_path,
+                           size_t line_no, size_t col_no, const char *line,
+                           size_t line_len)
+{
+    FileSearchResult *result = worker->result;
+
+    if (result == NULL) {
+        result = malloc(sizeof(FileSearchResult));
+
+        if (result == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate file search result");
+        }
+
+        memset(result, 0, sizeof(FileSearchResult));
+        worker->result = result;
+
+        if ((result->file_path = strdup(file_path)) == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate file search result");
+        }
+    }
+
+    if (result->match_num == result->match_alloc) {
+        size_t alloc = result->match_alloc == 0 ? FS_RESULT_ALLOC_SIZE / 8
+                                                : result->match_alloc * 2;
+        FileSearchMatch *matches = realloc(result->matches,
+                                           sizeof(FileSearchMatch) * alloc);
+
+        if (matches == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate file search result");
+        }
+
+        result->matches = matches;
+        result->match_alloc = alloc;
+    }
+
+    /* file_path is set when the result is written out as the result
+     * file_path is freed at that point */
+    result->matches[result->match_num++] = (FileSearchMatch) {
+        .file_path = NULL,
+        .line_no = line_no,
+        .col_no = col_no
+    };
+
+    if (line_len > FS_MAX_LINE_DISPLAY_SIZE) {
+        line_len = FS_MAX_LINE_DISPLAY_SIZE;
+
+        /* Don't split a UTF-8 character */
+        while (line_len > 0 && (line[line_len] & 0xC0) == 0x80) {
+            line_len--;
+        }
+    } else if (line_len > 0 && line[line_len - 1] == '\r') {
+        line_len--;
+    }
+
+    char prefix[64];
+    int prefix_len = snprintf(prefix, sizeof(prefix), ":%zu:%zu:",
+                              line_no, col_no);
+
+    if (!(fs_append_text(result, file_path, strlen(file_path)) &&
+          fs_append_text(result, prefix, prefix_len) &&
+          fs_append_text(result, line, line_len) &&
+          fs_append_text(result, "\n", 1))) {
+        return OUT_OF_MEMORY("Unable to allocate file search result");
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static int fs_append_text(FileSearchResult *result, const char *text,
+                          size_t text_len)
+{
+    if (result->text_len + text_len > result->text_alloc) {
+        size_t alloc = MAX(result->text_alloc * 2, FS_RESULT_ALLOC_SIZE);
+
+        while (alloc < result->text_len + text_len) {
+            alloc *= 2;
+        }
+
+        char *new_text = realloc(result->text, alloc);
+
+        if (new_text == NULL) {
+            return 0;
+        }
+
+        result->text = new_text;
+        result->text_alloc = alloc;
+    }
+
+    memcpy(result->text + result->text_len, text, text_len);
+    result->text_len += text_len;
+
+    return 1;
+}
+
+/* Make the results for a file available to the main thread */
+static void fs_add_result(FileSearch *fs, FileSearchResult *result)
+{
+    int notify;
+
+    pthread_mutex_lock(&fs->results_lock);
+
+    /* The main thread only needs notifying once for all results
+     * added before it next writes out results */
+    notify = fs->results_head == NULL;
+
+    if (fs->results_tail == NULL) {
+        fs->results_head = result;
+    } else {
+        fs->results_tail->next = result;
+    }
+
+    fs->results_tail = result;
+
+    pthread_mutex_unlock(&fs->results_lock);
+
+    if (notify) {
+        fs_notify(fs);
+    }
+}
+
+/* When listing files paths are added to the worker's result as lines of
+ * text which are passed to the main thread in batches. Directory paths
+ * end with a / */
+static Status fs_list_path(FileSearchWorker *worker, const char *path,
+                           int is_dir)
+{
+    /* A path containing a newline can't be listed as a line */
+    if (strchr(path, '\n') != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    FileSearchResult *result = worker->result;
+
+    if (result == NULL) {
+        result = malloc(sizeof(FileSearchResult));
+
+        if (result == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate file search result");
+        }
+
+        memset(result, 0, sizeof(FileSearchResult));
+        worker->result = result;
+    }
+
+    if (!(fs_append_text(result, path, strlen(path)) &&
+          (!is_dir || fs_append_text(result, "/", 1)) &&
+          fs_append_text(result, "\n", 1))) {
+        return OUT_OF_MEMORY("Unable to allocate file search result");
+    }
+
+    if (result->text_len >= FS_LIST_BATCH_SIZE) {
+        fs_add_result(worker->fs, result);
+        worker->result = NULL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Called by the main thread when fs_get_fd is readable. Writes out
+ * any results available as lines of text to os (if os isn't NULL) and
+ * records the location of each match or each path listed */
+Status fs_write_results(FileSearch *fs, OutputStream *os)
+{
+    char buf[64];
+    ssize_t bytes_read;
+
+    do {
+        bytes_read = read(fs->notify_fds[0], buf, sizeof(buf));
+    } while (bytes_read > 0 || (bytes_read == -1 && errno == EINTR));
+
+    /* Workers add their results before exiting, so if they had all
+     * exited before the results were taken then all results have been
+     * written out once the results below have been processed */
+    pthread_mutex_lock(&fs->state_lock);
+    int workers_finished = fs->workers_finished;
+    pthread_mutex_unlock(&fs->state_lock);
+
+    pthread_mutex_lock(&fs->results_lock);
+    FileSearchResult *result = fs->results_head;
+    Status status = fs->worker_status;
+    fs->results_head = fs->results_tail = NULL;
+    fs->worker_status = STATUS_SUCCESS;
+    pthread_mutex_unlock(&fs->results_lock);
+
+    FileSearchResult *next;
+    size_t written;
+
+    while (result != NULL && STATUS_IS_SUCCESS(status)) {
+        for (size_t k = 0; os != NULL && k < result->text_len &&
+                           STATUS_IS_SUCCESS(status); k += written) {
+            status = os->write(os, result->text + k, result->text_len - k,
+                               &written);
+        }
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        if (fs->list_files) {
+            status = fs_store_paths(fs, result);
+        } else {
+            status = fs_store_matches(fs, result);
+        }
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        next = result->next;
+        fs_free_result(result);
+        result = next;
+    }
+
+    while (result != NULL) {
+        next = result->next;
+        fs_free_result(result);
+        result = next;
+    }
+
+    if (workers_finished) {
+        fs->finished = 1;
+    }
+
+    return status;
+}
+
+/* Take ownership of the file path and matches of a result */
+static Status fs_store_matches(FileSearch *fs, FileSearchResult *result)
+{
+    if (fs->match_num + result->match_num > fs->match_alloc) {
+        size_t alloc = MAX(fs->match_alloc * 2, FS_RESULT_ALLOC_SIZE);
+
+        while (alloc < fs->match_num + result->match_num) {
+            alloc *= 2;
+        }
+
+        FileSearchMatch *matches = realloc(fs->matches,
+                                           sizeof(FileSearchMatch) * alloc);
+
+        if (matches == NULL) {
+            return OUT_OF_MEMORY("Unable to store file search matches");
+        }
+
+        fs->matches = matches;
+        fs->match_alloc = alloc;
+    }
+
+    if (!list_add(fs->file_paths, result->file_path)) {
+        return OUT_OF_MEMORY("Unable to store file search matches");
+    }
+
+    for (size_t k = 0; k < result->match_num; k++) {
+        result->matches[k].file_path = result->file_path;
+        fs->matches[fs->match_num++] = result->matches[k];
+    }
+
+    result->file_path = NULL;
+
+    return STATUS_SUCCESS;
+}
+
+/* Store a copy of each path listed in the text of a result */
+static Status fs_store_paths(FileSearch *fs, const FileSearchResult *result)
+{
+    const char *line = result->text;
+    const char *end = result->text + result->text_len;
+    const char *line_end;
+    size_t line_len;
+    char *path;
+    List *paths;
+
+    while (line < end) {
+        line_end = memchr(line, '\n', end - line);
+        line_len = line_end - line;
+
+        if (line[line_len - 1] == '/') {
+            paths = fs->dir_paths;
+            line_len--;
+        } else {
+            paths = fs->file_paths;
+        }
+
+        if ((path = strndup(line, line_len)) == NULL ||
+            !list_add(paths, path)) {
+            free(path);
+            return OUT_OF_MEMORY("Unable to store file list");
+        }
+
+        line = line_end + 1;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+int fs_finished(const FileSearch *fs)
+{
+    return fs->finished;
+}
+
+size_t fs_match_num(const FileSearch *fs)
+{
+    return fs->match_num;
+}
+
+size_t fs_file_num(const FileSearch *fs)
+{
+    return list_size(fs->file_paths);
+}
+
+const FileSearchMatch *fs_get_match(const FileSearch *fs, size_t match_index)
+{
+    if (match_index >= fs->match_num) {
+        return NULL;
+    }
+
+    return &fs->matches[match_index];
+}
+
+const char *fs_get_file_path(const FileSearch *fs, size_t file_index)
+{
+    return list_get(fs->file_paths, file_index);
+}
+
+size_t fs_dir_num(const FileSearch *fs)
+{
+    return fs->dir_paths == NULL ? 0 : list_size(fs->dir_paths);
+}
+
+const char *fs_get_dir_path(const FileSearch *fs, size_t dir_index)
+{
+    return list_get(fs->dir_paths, dir_index);
+}
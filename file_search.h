@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_FILE_SEARCH_H
+#define WED_FILE_SEARCH_H
+
+#include <pthread.h>
+#include "shared.h"
+#include "status.h"
+#include "search_util.h"
+#include "text_search.h"
+#include "regex_search.h"
+#include "external_command.h"
+#include "list.h"
+
+/* A file search recursively searches each file in a directory tree for
+ * a text or regex pattern. The search is performed by a pool of worker
+ * threads so that the user can continue editing whilst it runs. Each
+ * worker has its own queue of files and directories to search and will
+ * take work from the queues of other workers once its own queue is empty.
+ * Files and directories matched by a .gitignore file are skipped.
+ *
+ * Workers notify the main thread that results are available by writing
+ * to a pipe, which allows the pipe to be monitored in the main input
+ * loop alongside stdin.
+ *
+ * A file search created by fs_new_file_list has no pattern and instead
+ * lists every file and directory that isn't ignored */
+
+struct Buffer;
+
+/* Location of a single match. One match is reported per line */
+typedef struct {
+    const char *file_path; /* Path of file containing the match */
+    size_t line_no; /* Line number of match, starting from 1 */
+    size_t col_no; /* Byte offset of match in line, starting from 1 */
+} FileSearchMatch;
+
+typedef struct FileSearchTask FileSearchTask;
+typedef struct FileSearchResult FileSearchResult;
+typedef struct FileSearchIgnoreList FileSearchIgnoreList;
+typedef struct FileSearchWorker FileSearchWorker;
+typedef struct FileSearch FileSearch;
+
+struct FileSearch {
+    char *dir_path; /* Directory searched */
+    SearchOptions opt; /* Pattern and case sensitivity */
+    int is_regex; /* True if pattern is a regex */
+    int list_files; /* True if files are listed rather than searched */
+    TextSearch text; /* Text search shared (read only) by workers */
+    RegexSearch regex; /* Compiled regex, each worker uses a copy */
+    struct Buffer *buffer; /* The buffer results are displayed in */
+    FileSearchWorker *workers; /* Worker threads */
+    size_t worker_num; /* Number of workers allocated */
+    size_t thread_num; /* Number of worker threads successfully created */
+    int started; /* True if fs_start succeeded */
+    int joined; /* True once all worker threads have been joined */
+    pthread_mutex_t state_lock; /* Protects the fields below */
+    pthread_cond_t state_changed; /* Signalled when new work is added or
+                                     all work is complete */
+    size_t pending; /* Number of tasks queued or being processed */
+    size_t idle_workers; /* Number of workers waiting for work */
+    size_t work_generation; /* Incremented each time a task is added */
+    size_t finished_workers; /* Number of workers that have exited */
+    int workers_finished; /* True when all workers have exited */
+    int cancelled; /* True if the search has been cancelled */
+    List *ignore_lists; /* Parsed .gitignore files, freed with search */
+    pthread_mutex_t results_lock; /* Protects the fields below */
+    FileSearchResult *results_head; /* Results not yet written out */
+    FileSearchResult *results_tail;
+    Status worker_status; /* First error encountered by a worker */
+    int notify_fds[2]; /* Workers write to notify_fds[1] when results are
+                          available. notify_fds[0] is monitored by main
+                          thread */
+    /* The fields below are only accessed by the main thread */
+    FileSearchMatch *matches; /* Matches written out so far */
+    size_t match_num; /* Number of matches written out */
+    size_t match_alloc; /* Size of matches array */
+    List *file_paths; /* Paths of files containing matches or of all files
+                         when listing files */
+    List *dir_paths; /* Paths of directories when listing files */
+    int finished; /* True once workers have finished and all results have
+                     been written out */
+};
+
+FileSearch *fs_new(const char *dir_path, const SearchOptions *, int is_regex);
+FileSearch *fs_new_file_list(const char *dir_path);
+void fs_free(FileSearch *);
+Status fs_start(FileSearch *);
+void fs_cancel(FileSearch *);
+void fs_wait(FileSearch *);
+int fs_get_fd(const FileSearch *);
+Status fs_write_results(FileSearch *, OutputStream *);
+int fs_finished(const FileSearch *);
+size_t fs_match_num(const FileSearch *);
+size_t fs_file_num(const FileSearch *);
+const FileSearchMatch *fs_get_match(const FileSearch *, size_t match_index);
+const char *fs_get_file_path(const FileSearch *, size_t file_index);
+size_t fs_dir_num(const FileSearch *);
+const char *fs_get_dir_path(const FileSearch *, size_t dir_index);
+
+#endif
@@ -16,17 +16,32 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#define _GNU_SOURCE
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #include "gap_buffer.h"
 #include "util.h"
 
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+#define GB_USE_MMAP 1
+#else
+#define GB_USE_MMAP 0
+#endif
+
 static void gb_move_gap_to_point(GapBuffer *);
+static size_t gb_target_gap_size(size_t buffer_len);
 static int gb_increase_gap_if_required(GapBuffer *, size_t new_size);
 static int gb_decrease_gap_if_required(GapBuffer *);
+static int gb_grow(GapBuffer *, size_t new_alloc);
+static int gb_shrink(GapBuffer *, size_t gap_size);
+static void *gb_resize_text(GapBuffer *, size_t *new_alloc);
+static void gb_free_text(GapBuffer *);
 static size_t gb_internal_point(const GapBuffer *, size_t external_point);
 static size_t gb_external_point(const GapBuffer *, size_t internal_point);
 
@@ -51,6 +66,7 @@ GapBuffer *gb_new(size_t size)
 
     buffer->allocated = size;
     buffer->gap_end = size;
+    buffer->gap_increment = GAP_INCREMENT;
 
     return buffer;
 }
@@ -61,7 +77,7 @@ void gb_free(GapBuffer *buffer)
         return;
     }
 
-    free(buffer->text);
+    gb_free_text(buffer);
     free(buffer);
 }
 
@@ -131,9 +147,20 @@ size_t gb_gap_size(const GapBuffer *buffer)
     return buffer->gap_end - buffer->gap_start;
 }
 
+size_t gb_allocated(const GapBuffer *buffer)
+{
+    return buffer->allocated;
+}
+
+/* Unlike growth caused by inserts the caller knows how much space is
+ * required, so only a minimal gap is added */
 int gb_preallocate(GapBuffer *buffer, size_t size)
 {
-    return gb_increase_gap_if_required(buffer, size);
+    if (size <= buffer->allocated) {
+        return 1;
+    }
+
+    return gb_grow(buffer, size + GAP_INCREMENT);
 }
 
 /* This function moves the gap to the end of the buffer
@@ -146,17 +173,43 @@ void gb_contiguous_storage(GapBuffer *buffer)
     gb_move_gap_to_point(buffer);
 }
 
-static int gb_increase_gap_if_required(GapBuffer *buffer, size_t new_size)
+/* The gap a buffer of this length should have after growing or shrinking.
+ * Sizing the gap in proportion to the buffer keeps the number of reallocs,
+ * each of which can copy all the text, logarithmic in the amount of text
+ * inserted */
+static size_t gb_target_gap_size(size_t buffer_len)
 {
-    size_t new_alloc;
+    size_t gap_size = buffer_len / GAP_GROWTH_DIVISOR;
 
-    if (new_size > buffer->allocated) {
-        new_alloc = new_size + GAP_INCREMENT; 
-    } else {
+    return gap_size > GAP_INCREMENT ? gap_size : GAP_INCREMENT;
+}
+
+static int gb_increase_gap_if_required(GapBuffer *buffer, size_t new_size)
+{
+    if (new_size <= buffer->allocated) {
         return 1;
     }
 
-    void *ptr = realloc(buffer->text, new_alloc);
+    /* Consecutive growths indicate a stream of inserts e.g. a paste or
+     * command output, so the gap grows faster than the buffer alone
+     * would suggest until it's next shrunk */
+    size_t gap_size = gb_target_gap_size(new_size);
+
+    if (buffer->gap_increment > gap_size) {
+        gap_size = buffer->gap_increment;
+    }
+
+    if (buffer->gap_increment < GAP_MAX_INCREMENT) {
+        buffer->gap_increment *= 2;
+    }
+
+    return gb_grow(buffer, new_size + gap_size);
+}
+
+static int gb_grow(GapBuffer *buffer, size_t new_alloc)
+{
+    size_t old_alloc = buffer->allocated;
+    void *ptr = gb_resize_text(buffer, &new_alloc);
 
     if (ptr == NULL) {
         return 0;
@@ -164,7 +217,7 @@ static int gb_increase_gap_if_required(GapBuffer *buffer, size_t new_size)
 
     buffer->text = ptr;
 
-    size_t byte_num = buffer->allocated - buffer->gap_end;
+    size_t byte_num = old_alloc - buffer->gap_end;
 
     if (byte_num > 0) {
         /* Move text to allow gap to use newly allocated space */
@@ -173,7 +226,7 @@ static int gb_increase_gap_if_required(GapBuffer *buffer, size_t new_size)
                 byte_num);
     }
 
-    size_t size_increase = new_alloc - buffer->allocated;
+    size_t size_increase = new_alloc - old_alloc;
 
     if (buffer->point > buffer->gap_end) {
         buffer->point += size_increase;
@@ -202,14 +255,24 @@ static int gb_increase_gap_if_required(GapBuffer *buffer, size_t new_size)
     return 1;
 }
 
+/* Only shrink once the gap is several times larger than it would be
+ * after growing. Without this margin alternating inserts and deletes
+ * around the threshold would realloc on every edit */
 static int gb_decrease_gap_if_required(GapBuffer *buffer)
 {
-    if (!(gb_gap_size(buffer) > (2 * GAP_INCREMENT))) {
+    size_t gap_size = gb_target_gap_size(gb_length(buffer));
+
+    if (!(gb_gap_size(buffer) > (GAP_SHRINK_FACTOR * gap_size))) {
         return 1;
     }
 
+    return gb_shrink(buffer, gap_size);
+}
+
+static int gb_shrink(GapBuffer *buffer, size_t gap_size)
+{
     size_t buffer_len = gb_length(buffer);
-    size_t new_alloc = buffer_len + GAP_INCREMENT;
+    size_t new_alloc = buffer_len + gap_size;
 
     /* Move the gap to the end of the buffer so that
      * it is shrunk by the realloc */
@@ -218,7 +281,7 @@ static int gb_decrease_gap_if_required(GapBuffer *buffer)
 
     gb_move_gap_to_point(buffer);
 
-    void *ptr = realloc(buffer->text, new_alloc);
+    void *ptr = gb_resize_text(buffer, &new_alloc);
 
     gb_set_point(buffer, point);
 
@@ -227,12 +290,81 @@ static int gb_decrease_gap_if_required(GapBuffer *buffer)
     }
 
     buffer->text = ptr;
-    buffer->gap_end = buffer->gap_start + GAP_INCREMENT;
+    buffer->gap_end = new_alloc;
     buffer->allocated = new_alloc;
+    buffer->gap_increment = GAP_INCREMENT;
 
     return 1;
 }
 
+/* Buffers above GAP_MMAP_THRESHOLD are stored in anonymous mappings.
+ * mremap can then grow them by remapping pages rather than copying
+ * the text and huge pages reduce TLB pressure when scanning them.
+ * new_alloc may be rounded up to a whole number of mapping units */
+static void *gb_resize_text(GapBuffer *buffer, size_t *new_alloc)
+{
+#if GB_USE_MMAP
+    if (*new_alloc >= GAP_MMAP_THRESHOLD) {
+        size_t map_size = (*new_alloc + GAP_MMAP_UNIT - 1) / GAP_MMAP_UNIT;
+        map_size *= GAP_MMAP_UNIT;
+        void *ptr;
+
+        if (buffer->mapped) {
+            ptr = mremap(buffer->text, buffer->allocated, map_size,
+                         MREMAP_MAYMOVE);
+        } else {
+            ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (ptr != MAP_FAILED) {
+                memcpy(ptr, buffer->text, MIN(buffer->allocated, map_size));
+                free(buffer->text);
+            }
+        }
+
+        if (ptr == MAP_FAILED) {
+            return NULL;
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, map_size, MADV_HUGEPAGE);
+#endif
+
+        buffer->mapped = 1;
+        *new_alloc = map_size;
+
+        return ptr;
+    } else if (buffer->mapped) {
+        /* Shrunk below the threshold so move back to the heap */
+        void *ptr = malloc(*new_alloc);
+
+        if (ptr == NULL) {
+            return NULL;
+        }
+
+        memcpy(ptr, buffer->text, *new_alloc);
+        munmap(buffer->text, buffer->allocated);
+        buffer->mapped = 0;
+
+        return ptr;
+    }
+#endif
+
+    return realloc(buffer->text, *new_alloc);
+}
+
+static void gb_free_text(GapBuffer *buffer)
+{
+#if GB_USE_MMAP
+    if (buffer->mapped) {
+        munmap(buffer->text, buffer->allocated);
+        return;
+    }
+#endif
+
+    free(buffer->text);
+}
+
 int gb_insert(GapBuffer *buffer, const char *str, size_t str_len)
 {
     assert(str != NULL);
@@ -365,6 +497,90 @@ int gb_replace(GapBuffer *buffer, size_t byte_num, const char *str,
     return 1;
 }
 
+/* Apply edits sorted by offset in a single pass. Offsets are relative to
+ * the buffer content before any edit is applied and edits must not
+ * overlap. The gap is grown at most once and only ever moves forward, so
+ * the cost is proportional to the distance between the first and last
+ * edit rather than to the number of edits multiplied by that distance */
+int gb_apply_edits(GapBuffer *buffer, const GapBufferEdit *edits,
+                   size_t edit_num)
+{
+    size_t buffer_len = gb_length(buffer);
+    size_t insert_len = 0;
+    size_t min_offset = 0;
+
+    for (size_t k = 0; k < edit_num; k++) {
+        const GapBufferEdit *edit = &edits[k];
+
+        assert(edit->offset >= min_offset);
+        assert(edit->offset + edit->delete_len <= buffer_len);
+        assert(edit->str != NULL || edit->str_len == 0);
+
+        if (edit->offset < min_offset ||
+            edit->offset + edit->delete_len > buffer_len ||
+            (edit->str == NULL && edit->str_len > 0)) {
+            return 0;
+        }
+
+        min_offset = edit->offset + edit->delete_len;
+        insert_len += edit->str_len;
+    }
+
+    if (!gb_increase_gap_if_required(buffer, buffer_len + insert_len)) {
+        return 0;
+    }
+
+    size_t inserted = 0;
+    size_t deleted = 0;
+
+    for (size_t k = 0; k < edit_num; k++) {
+        const GapBufferEdit *edit = &edits[k];
+
+        buffer->point = gb_internal_point(buffer,
+                                          edit->offset + inserted - deleted);
+        gb_move_gap_to_point(buffer);
+
+        const char *text = buffer->text + buffer->gap_end;
+
+        for (size_t j = 0; j < edit->delete_len; j++) {
+            if (*text++ == '\n') {
+                buffer->lines--;
+            }
+        }
+
+        buffer->gap_end += edit->delete_len;
+
+        char *gap = buffer->text + buffer->gap_start;
+
+        for (size_t j = 0; j < edit->str_len; j++) {
+            if (edit->str[j] == '\n') {
+                buffer->lines++;
+            }
+
+            *gap++ = edit->str[j];
+        }
+
+        buffer->gap_start += edit->str_len;
+        inserted += edit->str_len;
+        deleted += edit->delete_len;
+    }
+
+    gb_decrease_gap_if_required(buffer);
+
+    return 1;
+}
+
+/* Release unused gap memory e.g. after a large deletion has left
+ * the buffer with a gap much bigger than is needed for editing */
+int gb_compact(GapBuffer *buffer)
+{
+    if (!(gb_gap_size(buffer) > (2 * GAP_INCREMENT))) {
+        return 1;
+    }
+
+    return gb_shrink(buffer, GAP_INCREMENT);
+}
+
 void gb_clear(GapBuffer *buffer)
 {
     buffer->point = 0;
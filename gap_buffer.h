@@ -25,6 +25,31 @@
 #define GAP_INCREMENT 1024
 #endif
 
+/* When the gap grows it's sized to at least 1/GAP_GROWTH_DIVISOR of
+ * the buffer length */
+#ifndef GAP_GROWTH_DIVISOR
+#define GAP_GROWTH_DIVISOR 16
+#endif
+
+/* Upper limit on the gap added in response to a stream of inserts */
+#ifndef GAP_MAX_INCREMENT
+#define GAP_MAX_INCREMENT (64 * 1024 * 1024)
+#endif
+
+/* The gap is shrunk once it's this many times larger than required */
+#ifndef GAP_SHRINK_FACTOR
+#define GAP_SHRINK_FACTOR 4
+#endif
+
+/* Buffers of at least this size are allocated with mmap where supported.
+ * Mappings are sized in multiples of GAP_MMAP_UNIT, the huge page size
+ * on x86-64 */
+#ifndef GAP_MMAP_THRESHOLD
+#define GAP_MMAP_THRESHOLD (64 * 1024 * 1024)
+#endif
+
+#define GAP_MMAP_UNIT (2 * 1024 * 1024)
+
 /* GapBuffer is the data structure used to
  * store text in wed */
 typedef struct {
@@ -34,19 +59,34 @@ typedef struct {
     size_t gap_end; /* Position gap ends */
     size_t allocated; /* Bytes allocated */
     size_t lines; /* Number of new line (\n) characters */
+    size_t gap_increment; /* Minimum gap added on the next growth. Doubles
+                             with each growth and resets when shrunk */
+    int mapped; /* True when text is stored in an mmap'd region */
 } GapBuffer;
 
+/* Replaces delete_len bytes at offset with str. Used to apply
+ * many edits at once with gb_apply_edits */
+typedef struct {
+    size_t offset; /* Offset before any edit is applied */
+    size_t delete_len; /* Bytes to delete from offset */
+    const char *str; /* Text to insert at offset */
+    size_t str_len; /* Length of str */
+} GapBufferEdit;
+
 GapBuffer *gb_new(size_t size);
 void gb_free(GapBuffer *);
 size_t gb_length(const GapBuffer *);
 size_t gb_lines(const GapBuffer *);
 size_t gb_gap_size(const GapBuffer *);
+size_t gb_allocated(const GapBuffer *);
 int gb_preallocate(GapBuffer *, size_t size);
 void gb_contiguous_storage(GapBuffer *);
 int gb_insert(GapBuffer *, const char *str, size_t str_len);
 int gb_add(GapBuffer *, const char *str, size_t str_len);
 int gb_delete(GapBuffer *, size_t byte_num);
 int gb_replace(GapBuffer *, size_t byte_num, const char *str, size_t str_len);
+int gb_apply_edits(GapBuffer *, const GapBufferEdit *, size_t edit_num);
+int gb_compact(GapBuffer *);
 void gb_clear(GapBuffer *);
 size_t gb_get_point(const GapBuffer *);
 int gb_set_point(GapBuffer *, size_t point);
@@ -47,6 +47,7 @@ SyntaxDefinition *sh_new(Session *sess)
     sh_def->syn_def.load = sh_load;
     sh_def->syn_def.generate_matches = sh_generate_matches;
     sh_def->syn_def.free = sh_free;
+    sh_def->syn_def.memory_usage = NULL;
 
     return (SyntaxDefinition *)sh_def;
 }
@@ -19,31 +19,44 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "hashmap.h"
 
-/* Default bucket num */
-#define HM_BUCKET_NUM_BLOCK 100
+/* Default slot num */
+#define HM_SLOT_NUM_BLOCK 32
 /* Seed used for murmurhash2 */
 #define HM_SEED 24842118
-/* Max load factor before expansion */
-#define HM_MAX_LOAD_FACTOR 0.75
+/* Control byte values. Full slots have the top bit clear */
+#define HM_CTRL_EMPTY 0x80
+#define HM_CTRL_DELETED 0xFE
+/* Max load factor before expansion, counting deleted slots, is
+ * HM_MAX_LOAD_NUM / HM_MAX_LOAD_DEN. This guarantees each probe sequence
+ * ends at an empty slot */
+#define HM_MAX_LOAD_NUM 7
+#define HM_MAX_LOAD_DEN 8
 
-static HashMapNode *new_hashmapnode(const char *key, uint32_t hash,
-                                    void *value);
 static uint32_t murmurhash2(const void *key, int len, uint32_t seed);
-static HashMapNode *get_bucket(const HashMap *, const char *key,
-                               uint32_t *hash, size_t *index);
-static int resize_required(HashMap *);
-static int resize_hashmap(HashMap *, size_t size);
-static void free_hashmapnodes(HashMap *);
-static void free_hashmapnode(HashMapNode *);
+static uint8_t hm_ctrl_hash(uint32_t hash);
+static uint32_t hm_match_byte(const uint8_t *group, uint8_t byte);
+static uint32_t hm_match_free(const uint8_t *group);
+static unsigned hm_first_bit(uint32_t mask);
+static const char *hm_entry_key(const HashMapEntry *);
+static int hm_alloc_slots(HashMap *, size_t slot_num);
+static HashMapEntry *hm_find(const HashMap *, const HashMapKey *);
+static size_t hm_find_free_slot(const HashMap *, uint32_t hash);
+static int hm_reserve_slot(HashMap *);
+static int resize_hashmap(HashMap *, size_t slot_num);
+static void free_hashmap_keys(HashMap *);
 static void hashmap_free_value(void *entry);
 
 HashMap *new_hashmap(void)
 {
-    return new_sized_hashmap(HM_BUCKET_NUM_BLOCK);
+    return new_sized_hashmap(HM_SLOT_NUM_BLOCK);
 }
 
+/* size is the number of entries the hashmap can hold before resizing */
 HashMap *new_sized_hashmap(size_t size)
 {
     if (size == 0) {
@@ -56,34 +69,40 @@ HashMap *new_sized_hashmap(size_t size)
         return NULL;
     }
 
-    hashmap->buckets = list_new_sized(size);
+    size_t slot_num = HM_GROUP_SIZE;
 
-    if (hashmap->buckets == NULL) {
+    while (slot_num / HM_MAX_LOAD_DEN * HM_MAX_LOAD_NUM < size) {
+        slot_num *= 2;
+    }
+
+    if (!hm_alloc_slots(hashmap, slot_num)) {
         free(hashmap);
         return NULL;
     }
 
-    hashmap->bucket_num = size;
-    hashmap->entry_num = 0;
-
     return hashmap;
 }
 
-static HashMapNode *new_hashmapnode(const char *key, uint32_t hash,
-                                    void *value)
+/* Control bytes and slots are allocated together. As slot_num is a
+ * multiple of HM_GROUP_SIZE the slots that follow the control bytes are
+ * suitably aligned */
+static int hm_alloc_slots(HashMap *hashmap, size_t slot_num)
 {
-    HashMapNode *node = malloc(sizeof(HashMapNode));
+    uint8_t *ctrl = malloc(slot_num + slot_num * sizeof(HashMapEntry));
 
-    if (node == NULL) {
-        return NULL;
+    if (ctrl == NULL) {
+        return 0;
     }
 
-    node->key = strdup(key);
-    node->hash = hash;
-    node->value = value;
-    node->next = NULL;
+    memset(ctrl, HM_CTRL_EMPTY, slot_num);
+
+    hashmap->ctrl = ctrl;
+    hashmap->entries = (HashMapEntry *)(ctrl + slot_num);
+    hashmap->slot_num = slot_num;
+    hashmap->entry_num = 0;
+    hashmap->deleted_num = 0;
 
-    return node;
+    return 1;
 }
 
 /* MurmurHash2 was written by Austin Appleby, and is placed in the public
@@ -125,60 +144,220 @@ static uint32_t murmurhash2(const void *key, int len, uint32_t seed)
     return h;
 }
 
-static HashMapNode *get_bucket(const HashMap *hashmap, const char *key,
-                               uint32_t *hash, size_t *index)
+/* The low 7 bits of the hash are stored in the control byte. The
+ * remaining bits determine which group probing starts at */
+static uint8_t hm_ctrl_hash(uint32_t hash)
 {
-    *hash = murmurhash2(key, strlen(key), HM_SEED);
-    *index = *hash % hashmap->bucket_num;
-    HashMapNode *node = list_get(hashmap->buckets, *index);
+    return hash & 0x7F;
+}
 
-    if (node == NULL) {
-        return NULL;
+/* Returns a bit mask with a bit set for each control byte in the group
+ * equal to byte */
+static uint32_t hm_match_byte(const uint8_t *group, uint8_t byte)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    __m128i match = _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte));
+
+    return (uint32_t)_mm_movemask_epi8(match);
+#else
+    uint32_t mask = 0;
+
+    for (size_t k = 0; k < HM_GROUP_SIZE; k++) {
+        if (group[k] == byte) {
+            mask |= (uint32_t)1 << k;
+        }
     }
 
-    /* Loop through nodes in bucket to find entry that
-     * matches our key */
-    while (node != NULL) {
-        if (strcmp(node->key, key) == 0) {
-            return node;
+    return mask;
+#endif
+}
+
+/* Returns a bit mask with a bit set for each empty or deleted slot in the
+ * group. Both have the top bit of their control byte set */
+static uint32_t hm_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+    return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+    uint32_t mask = 0;
+
+    for (size_t k = 0; k < HM_GROUP_SIZE; k++) {
+        if (group[k] & 0x80) {
+            mask |= (uint32_t)1 << k;
         }
+    }
+
+    return mask;
+#endif
+}
 
-        node = node->next;
+/* mask must be non zero */
+static unsigned hm_first_bit(uint32_t mask)
+{
+#ifdef __GNUC__
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned bit = 0;
+
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit++;
+    }
+
+    return bit;
+#endif
+}
+
+static const char *hm_entry_key(const HashMapEntry *entry)
+{
+    if (entry->key_len < HM_INLINE_KEY_SIZE) {
+        return entry->key.inline_key;
+    }
+
+    return entry->key.key;
+}
+
+HashMapKey hashmap_hash_key(const char *key)
+{
+    HashMapKey hm_key = {
+        .key = key,
+        .key_len = key != NULL ? strlen(key) : 0,
+        .hash = 0
+    };
+
+    if (key != NULL) {
+        hm_key.hash = murmurhash2(key, hm_key.key_len, HM_SEED);
+    }
+
+    return hm_key;
+}
+
+/* Groups are probed in a triangular sequence i.e. the group index is
+ * increased by 1, 2, 3, ... which, as the group number is a power of two,
+ * visits every group */
+static HashMapEntry *hm_find(const HashMap *hashmap, const HashMapKey *key)
+{
+    const uint8_t ctrl_hash = hm_ctrl_hash(key->hash);
+    const size_t group_mask = hashmap->slot_num / HM_GROUP_SIZE - 1;
+    size_t group = (key->hash >> 7) & group_mask;
+    HashMapEntry *entry;
+    uint32_t mask;
+    size_t slot;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const uint8_t *ctrl = hashmap->ctrl + group * HM_GROUP_SIZE;
+        mask = hm_match_byte(ctrl, ctrl_hash);
+
+        while (mask != 0) {
+            slot = group * HM_GROUP_SIZE + hm_first_bit(mask);
+            entry = &hashmap->entries[slot];
+
+            if (entry->hash == key->hash && entry->key_len == key->key_len &&
+                memcmp(hm_entry_key(entry), key->key, key->key_len) == 0) {
+                return entry;
+            }
+
+            mask &= mask - 1;
+        }
+
+        /* Keys are always inserted at the first free slot in their probe
+         * sequence so an empty slot ends the search */
+        if (hm_match_byte(ctrl, HM_CTRL_EMPTY) != 0) {
+            break;
+        }
+
+        group = (group + step) & group_mask;
     }
 
     return NULL;
 }
 
+/* The hashmap must contain at least one free slot */
+static size_t hm_find_free_slot(const HashMap *hashmap, uint32_t hash)
+{
+    const size_t group_mask = hashmap->slot_num / HM_GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & group_mask;
+    uint32_t mask;
+
+    for (size_t step = 1; ; step++) {
+        mask = hm_match_free(hashmap->ctrl + group * HM_GROUP_SIZE);
+
+        if (mask != 0) {
+            return group * HM_GROUP_SIZE + hm_first_bit(mask);
+        }
+
+        group = (group + step) & group_mask;
+    }
+}
+
+/* Ensure there is room for another entry. Rehashing in place is
+ * sufficient when most of the used slots are deleted */
+static int hm_reserve_slot(HashMap *hashmap)
+{
+    size_t max_load = hashmap->slot_num / HM_MAX_LOAD_DEN * HM_MAX_LOAD_NUM;
+
+    if (hashmap->entry_num + hashmap->deleted_num < max_load) {
+        return 1;
+    }
+
+    if (hashmap->entry_num < max_load / 2) {
+        return resize_hashmap(hashmap, hashmap->slot_num);
+    }
+
+    return resize_hashmap(hashmap, hashmap->slot_num * 2);
+}
+
 int hashmap_set(HashMap *hashmap, const char *key, void *value)
 {
     if (key == NULL) {
         return 0;
     }
 
-    uint32_t hash;
-    size_t index;
-    HashMapNode *node = get_bucket(hashmap, key, &hash, &index);
+    HashMapKey hm_key = hashmap_hash_key(key);
+
+    return hashmap_set_hashed(hashmap, &hm_key, value);
+}
+
+int hashmap_set_hashed(HashMap *hashmap, const HashMapKey *key, void *value)
+{
+    if (key->key == NULL || key->key_len >= UINT32_MAX) {
+        return 0;
+    }
+
+    HashMapEntry *entry = hm_find(hashmap, key);
 
-    if (node != NULL) {
-        node->value = value;
+    if (entry != NULL) {
+        entry->value = value;
         return 1;
     }
 
-    if ((node = new_hashmapnode(key, hash, value)) == NULL) {
+    if (!hm_reserve_slot(hashmap)) {
         return 0;
     }
 
-    /* To save traversing through all nodes in the bucket add
-     * the new node at the start of the linked list */
-    node->next = list_get(hashmap->buckets, index);
-    list_set(hashmap->buckets, node, index);
+    size_t slot = hm_find_free_slot(hashmap, key->hash);
+    entry = &hashmap->entries[slot];
 
-    hashmap->entry_num++;
+    if (key->key_len < HM_INLINE_KEY_SIZE) {
+        memcpy(entry->key.inline_key, key->key, key->key_len + 1);
+    } else if ((entry->key.key = strdup(key->key)) == NULL) {
+        return 0;
+    }
 
-    if (resize_required(hashmap)) {
-        resize_hashmap(hashmap, hashmap->bucket_num * 2); 
+    if (hashmap->ctrl[slot] == HM_CTRL_DELETED) {
+        hashmap->deleted_num--;
     }
 
+    hashmap->ctrl[slot] = hm_ctrl_hash(key->hash);
+    entry->value = value;
+    entry->hash = key->hash;
+    entry->key_len = key->key_len;
+
+    hashmap->entry_num++;
+
     return 1;
 }
 
@@ -188,42 +367,56 @@ void *hashmap_get(const HashMap *hashmap, const char *key)
         return NULL;
     }
 
-    uint32_t hash;
-    size_t index;
-    HashMapNode *node = get_bucket(hashmap, key, &hash, &index);
+    HashMapKey hm_key = hashmap_hash_key(key);
+
+    return hashmap_get_hashed(hashmap, &hm_key);
+}
+
+void *hashmap_get_hashed(const HashMap *hashmap, const HashMapKey *key)
+{
+    if (key->key == NULL) {
+        return NULL;
+    }
+
+    const HashMapEntry *entry = hm_find(hashmap, key);
 
-    if (node == NULL) {
+    if (entry == NULL) {
         return NULL;
     }
 
-    return node->value;
+    return entry->value;
 }
 
 int hashmap_delete(HashMap *hashmap, const char *key)
 {
-    uint32_t hash;
-    size_t index;
-    HashMapNode *node = get_bucket(hashmap, key, &hash, &index);
-
-    if (node == NULL) {
+    if (key == NULL) {
         return 0;
     }
 
-    HashMapNode *first = list_get(hashmap->buckets, index);
+    HashMapKey hm_key = hashmap_hash_key(key);
+    HashMapEntry *entry = hm_find(hashmap, &hm_key);
 
-    if (node == first) {
-        /* If node is the first entry in the linked list then
-         * need to update bucket list */
-        list_set(hashmap->buckets, node->next, index);
-    } else {
-        while (first->next != node) {
-            first = first->next;
-        }
+    if (entry == NULL) {
+        return 0;
+    }
 
-        first->next = node->next;
+    size_t slot = entry - hashmap->entries;
+    const uint8_t *group = hashmap->ctrl +
+                           slot / HM_GROUP_SIZE * HM_GROUP_SIZE;
+
+    if (entry->key_len >= HM_INLINE_KEY_SIZE) {
+        free(entry->key.key);
     }
 
-    free_hashmapnode(node);
+    /* If the group contains an empty slot then no probe sequence has
+     * continued past it, so the slot can be marked empty rather than
+     * deleted */
+    if (hm_match_byte(group, HM_CTRL_EMPTY) != 0) {
+        hashmap->ctrl[slot] = HM_CTRL_EMPTY;
+    } else {
+        hashmap->ctrl[slot] = HM_CTRL_DELETED;
+        hashmap->deleted_num++;
+    }
 
     hashmap->entry_num--;
 
@@ -232,9 +425,10 @@ int hashmap_delete(HashMap *hashmap, const char *key)
 
 void hashmap_clear(HashMap *hashmap)
 {
-    free_hashmapnodes(hashmap);
-    list_nullify(hashmap->buckets);
+    free_hashmap_keys(hashmap);
+    memset(hashmap->ctrl, HM_CTRL_EMPTY, hashmap->slot_num);
     hashmap->entry_num = 0;
+    hashmap->deleted_num = 0;
 }
 
 size_t hashmap_size(const HashMap *hashmap)
@@ -242,65 +436,83 @@ size_t hashmap_size(const HashMap *hashmap)
     return hashmap->entry_num;
 }
 
-const char **hashmap_get_keys(const HashMap *hashmap)
+void hashmap_iter_init(HashMapIterator *iter, const HashMap *hashmap)
 {
-    const char **keys = malloc(sizeof(char *) * hashmap->entry_num);
+    iter->hashmap = hashmap;
+    iter->slot = 0;
+}
 
-    if (keys == NULL) {
-        return NULL;
-    }
+/* Returns 1 and sets key and value (either of which can be NULL) to the
+ * next entry, or returns 0 when all entries have been visited */
+int hashmap_iter_next(HashMapIterator *iter, const char **key, void **value)
+{
+    const HashMap *hashmap = iter->hashmap;
 
-    size_t index = 0;
-    HashMapNode *node;
+    while (iter->slot < hashmap->slot_num) {
+        size_t slot = iter->slot++;
 
-    for (size_t k = 0; k < hashmap->bucket_num; k++) {
-        node = list_get(hashmap->buckets, k);
+        if (hashmap->ctrl[slot] & 0x80) {
+            continue;
+        }
+
+        const HashMapEntry *entry = &hashmap->entries[slot];
+
+        if (key != NULL) {
+            *key = hm_entry_key(entry);
+        }
 
-        while (node != NULL) {
-            keys[index++] = node->key;
-            node = node->next;
-        } 
+        if (value != NULL) {
+            *value = entry->value;
+        }
+
+        return 1;
     }
 
-    return keys;
+    return 0;
 }
 
-/* Only checks to see if hashmap bucket number should be increased */
-static int resize_required(HashMap *hashmap)
+/* Memory used by the hashmap itself i.e. control bytes, slots and keys
+ * too long to be stored inline. The size of the values isn't known so
+ * isn't included */
+size_t hashmap_memory_usage(const HashMap *hashmap)
 {
-    double load_factor = (double)hashmap->entry_num / hashmap->bucket_num;
+    size_t bytes = sizeof(HashMap) +
+                   hashmap->slot_num * (1 + sizeof(HashMapEntry));
 
-    return load_factor > HM_MAX_LOAD_FACTOR;
+    for (size_t k = 0; k < hashmap->slot_num; k++) {
+        if (!(hashmap->ctrl[k] & 0x80) &&
+            hashmap->entries[k].key_len >= HM_INLINE_KEY_SIZE) {
+            bytes += hashmap->entries[k].key_len + 1;
+        }
+    }
+
+    return bytes;
 }
 
-static int resize_hashmap(HashMap *hashmap, size_t size)
+/* Move all entries into a new set of slots. Deleted slots are discarded */
+static int resize_hashmap(HashMap *hashmap, size_t slot_num)
 {
-    List *buckets = list_new_sized(size); 
+    HashMap old = *hashmap;
 
-    if (buckets == NULL) {
+    if (!hm_alloc_slots(hashmap, slot_num)) {
+        *hashmap = old;
         return 0;
     }
 
-    size_t index;
-    HashMapNode *node, *next;
+    size_t slot;
 
-    /* Loop through existing nodes and determine their new bucket */
-    for (size_t k = 0; k < hashmap->bucket_num; k++) {
-        node = list_get(hashmap->buckets, k);
+    for (size_t k = 0; k < old.slot_num; k++) {
+        if (old.ctrl[k] & 0x80) {
+            continue;
+        }
 
-        while (node != NULL) {
-            next = node->next;
-            index = node->hash % size;
-            node->next = list_get(buckets, index);
-            list_set(buckets, node, index);
-            node = next;
-        } 
+        slot = hm_find_free_slot(hashmap, old.entries[k].hash);
+        hashmap->ctrl[slot] = old.ctrl[k];
+        hashmap->entries[slot] = old.entries[k];
     }
 
-    list_free(hashmap->buckets);
-
-    hashmap->buckets = buckets;
-    hashmap->bucket_num = size;
+    hashmap->entry_num = old.entry_num;
+    free(old.ctrl);
 
     return 1;
 }
@@ -311,34 +523,19 @@ void free_hashmap(HashMap *hashmap)
         return;
     }
 
-    free_hashmapnodes(hashmap);
-    list_free(hashmap->buckets);
+    free_hashmap_keys(hashmap);
+    free(hashmap->ctrl);
     free(hashmap);
 }
 
-static void free_hashmapnodes(HashMap *hashmap)
-{
-    HashMapNode *node, *next;
-
-    for (size_t k = 0; k < hashmap->bucket_num; k++) {
-        node = list_get(hashmap->buckets, k);
-
-        while (node != NULL) {
-            next = node->next;
-            free_hashmapnode(node);
-            node = next;
-        } 
-    }
-}
-
-static void free_hashmapnode(HashMapNode *node)
+static void free_hashmap_keys(HashMap *hashmap)
 {
-    if (node == NULL) {
-        return;
+    for (size_t k = 0; k < hashmap->slot_num; k++) {
+        if (!(hashmap->ctrl[k] & 0x80) &&
+            hashmap->entries[k].key_len >= HM_INLINE_KEY_SIZE) {
+            free(hashmap->entries[k].key.key);
+        }
     }
-
-    free(node->key);
-    free(node);
 }
 
 static void hashmap_free_value(void *entry)
@@ -358,16 +555,10 @@ void free_hashmap_values(HashMap *hashmap, void (*free_func)(void *))
         free_func = hashmap_free_value;
     }
 
-    HashMapNode *node;
-
-    for (size_t k = 0; k < hashmap->bucket_num; k++) {
-        node = list_get(hashmap->buckets, k);
-
-        while (node != NULL) {
-            free_func(node->value);
-            node->value = NULL;
-            node = node->next;
-        } 
+    for (size_t k = 0; k < hashmap->slot_num; k++) {
+        if (!(hashmap->ctrl[k] & 0x80)) {
+            free_func(hashmap->entries[k].value);
+            hashmap->entries[k].value = NULL;
+        }
     }
 }
-
@@ -19,40 +19,74 @@
 #ifndef WED_HASHMAP_H
 #define WED_HASHMAP_H
 
+#include <stddef.h>
 #include <stdint.h>
-#include "list.h"
 
-/* Simple hashmap implementation using the murmurhash2 hash function.
+/* Open addressing hashmap using the murmurhash2 hash function.
  * Currently only accepts (char *) for keys and can grow but not shrink
- * when resizing. Enhancing it would be straightforward, however it's
- * sufficient for the moment. */
+ * when resizing.
+ *
+ * Entries are stored in a single array of slots alongside an array of
+ * control bytes, one per slot. A control byte marks its slot as empty,
+ * deleted or full, in which case it holds the low 7 bits of the hash of
+ * the slot's key. Slots are probed in groups of HM_GROUP_SIZE: the
+ * control bytes of a group are compared with the hash all at once (using
+ * SSE2 when available) and keys are only compared for slots whose control
+ * byte matches. Short keys are stored in the slot itself, so most entries
+ * need no allocation of their own. */
+
+/* Number of slots probed at once */
+#define HM_GROUP_SIZE 16
+/* Keys shorter than this are stored inline in their slot */
+#define HM_INLINE_KEY_SIZE 24
+
+typedef struct {
+    union {
+        char inline_key[HM_INLINE_KEY_SIZE]; /* Key when short enough */
+        char *key; /* Heap allocated copy of longer keys */
+    } key;
+    void *value; /* Values have to be pointers */
+    uint32_t hash; /* Stored to avoid recalculation when resizing */
+    uint32_t key_len; /* Key length excluding null terminator */
+} HashMapEntry;
 
 typedef struct {
-    List *buckets; /* A resizable array of buckets */
+    uint8_t *ctrl; /* A control byte for each slot */
+    HashMapEntry *entries; /* Slots, allocated along with ctrl */
+    size_t slot_num; /* A power of two and multiple of HM_GROUP_SIZE */
     size_t entry_num; /* Items in hashmap */
-    size_t bucket_num; /* Bucket list size */
+    size_t deleted_num; /* Slots marked as deleted */
 } HashMap;
 
-typedef struct HashMapNode HashMapNode;
+/* A key and its hash. Allows the hash of a key to be calculated once
+ * when a key is looked up repeatedly or used for more than one operation */
+typedef struct {
+    const char *key;
+    size_t key_len;
+    uint32_t hash;
+} HashMapKey;
 
-/* Each bucket can contain a linked list of HashMapNodes */
-struct HashMapNode {
-    void *key; /* The key that was used for this entry */
-    void *value; /* Values have to be pointers */
-    uint32_t hash; /* Stored to avoid recalculation when resizing */
-    HashMapNode *next; /* Next node in bucket or NULL */
-};
+/* Iterates over the entries of a hashmap without allocating. Values can
+ * be modified during iteration, but entries can't be added or deleted */
+typedef struct {
+    const HashMap *hashmap;
+    size_t slot; /* Next slot to examine */
+} HashMapIterator;
 
 HashMap *new_hashmap(void);
 HashMap *new_sized_hashmap(size_t size);
 int hashmap_set(HashMap *, const char *key, void *value);
 void *hashmap_get(const HashMap *, const char *key);
 int hashmap_delete(HashMap *, const char *key);
+HashMapKey hashmap_hash_key(const char *key);
+int hashmap_set_hashed(HashMap *, const HashMapKey *, void *value);
+void *hashmap_get_hashed(const HashMap *, const HashMapKey *);
 void hashmap_clear(HashMap *);
 size_t hashmap_size(const HashMap *);
-const char **hashmap_get_keys(const HashMap *);
+void hashmap_iter_init(HashMapIterator *, const HashMap *);
+int hashmap_iter_next(HashMapIterator *, const char **key, void **value);
+size_t hashmap_memory_usage(const HashMap *);
 void free_hashmap(HashMap *);
 void free_hashmap_values(HashMap *, void (*free_func)(void *));
 
 #endif
-
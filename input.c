@@ -35,9 +35,19 @@
  * MIN_DRAW_INTERVAL_NS nano seconds must pass between
  * screen redraws */
 #define MIN_DRAW_INTERVAL_NS 200000
+/* How frequently to check if a job which has closed its
+ * output streams has exited */
+#define JOB_WAIT_INTERVAL_NS 10000000
+/* How frequently to check followed files that can't be watched */
+#define FOLLOW_POLL_INTERVAL_S 1
+/* Maximum number of characters inserted as a single run */
+#define MAX_INSERT_RUN_SIZE 4096
 
 static Status ip_add_keystr_input(InputBuffer *, size_t pos,
                                   const char *keystr, size_t keystr_len);
+static Status ip_add_pasted_text(InputBuffer *, char *text,
+                                 size_t text_len);
+static void ip_free_pasted_text(PastedText *);
 static int ip_input_available(const InputBuffer *);
 static void ip_setup_signal_handlers(void);
 static void ip_process_input_buffer(Session *, int *finished,
@@ -50,7 +60,19 @@ static int ip_parse_key(const Session *, const char *keystr,
                         size_t *keystr_len, size_t *parsed_len);
 static void ip_handle_keypress(Session *, const char *keystr, int *finished,
                                struct timespec *last_draw, int *redraw_due);
+static int ip_input_starts_with(GapBuffer *, const char *str);
+static Status ip_get_keystr_paste(Session *, GapBuffer *);
+static Status ip_add_paste_key(const char *keystr, char **text,
+                               size_t *text_len, size_t *text_alloc);
+static size_t ip_get_insert_run(const Session *, GapBuffer *, char *run,
+                                size_t run_size);
+static int ip_is_insert_run_char(const Session *, char character);
+static void ip_handle_insert_run(Session *, const char *run, size_t run_len,
+                                 struct timespec *last_draw, int *redraw_due);
+static void ip_update_display(Session *, struct timespec *last_draw,
+                              int *redraw_due);
 static void ip_handle_error(Session *);
+static void ip_complete_incremental_search(Session *);
 static int ip_is_special_key(const TermKeyKey *);
 static int ip_is_wed_operation(const char *key, const char **next);
 
@@ -85,12 +107,23 @@ int ip_init(InputBuffer *input_buffer)
         return 0;
     }
 
+    input_buffer->pasted_text = list_new();
+
+    if (input_buffer->pasted_text == NULL) {
+        return 0;
+    }
+
     return 1;
 }
 
 void ip_free(InputBuffer *input_buffer)
 {
     gb_free(input_buffer->buffer);
+
+    if (input_buffer->pasted_text != NULL) {
+        list_free_all_custom(input_buffer->pasted_text,
+                             (ListEntryFree)ip_free_pasted_text);
+    }
 }
 
 Status ip_add_keystr_input_to_end(InputBuffer *input_buffer,
@@ -132,6 +165,63 @@ Status ip_add_mouse_click_event(InputBuffer *input_buffer, const char *keystr,
    return ip_add_keystr_input_to_end(input_buffer, keystr, keystr_len);
 }
 
+/* Takes ownership of text which must have been allocated with malloc */
+Status ip_add_paste_event(InputBuffer *input_buffer, const char *keystr,
+                          size_t keystr_len, char *text, size_t text_len)
+{
+    RETURN_IF_FAIL(ip_add_pasted_text(input_buffer, text, text_len));
+
+    return ip_add_keystr_input_to_end(input_buffer, keystr, keystr_len);
+}
+
+/* Takes ownership of text */
+static Status ip_add_pasted_text(InputBuffer *input_buffer, char *text,
+                                 size_t text_len)
+{
+    PastedText *pasted_text = malloc(sizeof(PastedText));
+
+    if (pasted_text == NULL) {
+        free(text);
+        return OUT_OF_MEMORY("Unable to save pasted text");
+    }
+
+    pasted_text->text = text;
+    pasted_text->text_len = text_len;
+
+    if (!list_add(input_buffer->pasted_text, pasted_text)) {
+        ip_free_pasted_text(pasted_text);
+        return OUT_OF_MEMORY("Unable to save pasted text");
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Remove the oldest pasted text from the input buffer. The caller is
+ * responsible for freeing pasted_text->text. Returns false if there is
+ * no pasted text */
+int ip_get_pasted_text(InputBuffer *input_buffer, PastedText *pasted_text)
+{
+    if (list_size(input_buffer->pasted_text) == 0) {
+        return 0;
+    }
+
+    PastedText *oldest = list_remove_at(input_buffer->pasted_text, 0);
+    *pasted_text = *oldest;
+    free(oldest);
+
+    return 1;
+}
+
+static void ip_free_pasted_text(PastedText *pasted_text)
+{
+    if (pasted_text == NULL) {
+        return;
+    }
+
+    free(pasted_text->text);
+    free(pasted_text);
+}
+
 static int ip_input_available(const InputBuffer *input_buffer)
 {
     GapBuffer *buffer = input_buffer->buffer;
@@ -170,6 +260,14 @@ static void ip_setup_signal_handlers(void)
         fatal("Unable to set SIGINT signal handler");
     }
 
+    /* Background jobs can exit before all input is written to them,
+     * in which case the write fails with EPIPE instead */
+    sig_action.sa_handler = SIG_IGN;
+
+    if (sigaction(SIGPIPE, &sig_action, NULL) == -1) {
+        fatal("Unable to set SIGPIPE signal handler");
+    }
+
     sigset_t sig_set;
     sigemptyset(&sig_set);
     sigaddset(&sig_set, SIGWINCH);
@@ -208,17 +306,40 @@ void ip_process_input(Session *sess)
     int finished = 0;
     int redraw_due = 0;
     struct timespec last_draw; 
+    struct timespec now;
     struct timespec *timeout = NULL;
+    struct timespec *select_timeout;
     struct timespec wait_timeout;
+    struct timespec job_timeout;
+    struct timespec follow_timeout;
+    struct timespec no_timeout;
+    int search_pending;
+    int index_pending;
+    int follow_pending = 0;
+    int job_output_written;
     static sigset_t old_set;
     memset(&wait_timeout, 0, sizeof(struct timespec));
+    memset(&job_timeout, 0, sizeof(struct timespec));
+    memset(&follow_timeout, 0, sizeof(struct timespec));
+    memset(&no_timeout, 0, sizeof(struct timespec));
+    job_timeout.tv_nsec = JOB_WAIT_INTERVAL_NS;
+    follow_timeout.tv_sec = FOLLOW_POLL_INTERVAL_S;
     /* old_set is used in pselect to control
      * when SIGWINCH signal fires */
     sigemptyset(&old_set);
     /* Use monotonic clock as we're only interested in
      * measuring time intervals that have passed */
     get_monotonic_time(&last_draw);
-    fd_set fds;
+    fd_set read_fds;
+    fd_set write_fds;
+    int max_fd;
+
+    if (se_macro_playing(sess)) {
+        /* A prompt was opened by a macro, its input comes from the
+         * macro rather than the user */
+        cm_process_macro_input(sess);
+        return;
+    }
 
     if (sess->wed_opt.test_mode) {
         ip_process_input_buffer(sess, &finished, &last_draw, &redraw_due);
@@ -229,11 +350,152 @@ void ip_process_input(Session *sess)
         if (ip_input_available(&sess->input_buffer)) {
             ip_process_input_buffer(sess, &finished, &last_draw, &redraw_due);
         } else {
-            FD_ZERO(&fds);
-            FD_SET(STDIN_FILENO, &fds);
+            FD_ZERO(&read_fds);
+            FD_ZERO(&write_fds);
+            FD_SET(STDIN_FILENO, &read_fds);
+            max_fd = STDIN_FILENO;
+            select_timeout = timeout;
+
+            if (se_has_jobs(sess)) {
+                se_add_job_fds(sess, &read_fds, &write_fds, &max_fd);
+
+                if (timeout == NULL && se_jobs_awaiting_exit(sess)) {
+                    select_timeout = &job_timeout;
+                }
+            }
+
+            se_add_file_search_fds(sess, &read_fds, &max_fd);
+            se_add_project_index_fds(sess, &read_fds, &max_fd);
+            se_add_file_explorer_fds(sess, &read_fds, &max_fd);
+            se_add_dir_cache_fds(sess, &read_fds, &max_fd);
+            se_add_tail_follow_fds(sess, &read_fds, &max_fd);
+
+            if (select_timeout == NULL && se_tail_follow_requires_poll(sess)) {
+                select_timeout = &follow_timeout;
+            }
+
+            /* Search for the pattern in the find prompt as it's typed. The
+             * search continues in the background between keypresses so
+             * when it isn't complete only poll for input */
+            if (cm_update_incremental_search(sess, &search_pending)) {
+                ip_handle_error(sess);
+                sess->ui->update(sess->ui);
+                get_monotonic_time(&last_draw);
+            }
+
+            /* Large files are indexed in the background in the same way */
+            index_pending = se_index_large_files(sess);
+
+            /* Offer to replay the changes journalled for the active buffer
+             * when wed exited without saving them */
+            if (cm_offer_buffer_recovery(sess)) {
+                ip_handle_error(sess);
+                sess->ui->update(sess->ui);
+                get_monotonic_time(&last_draw);
+            }
 
-            /* Wait for user input or signal */
-            pselect_res = pselect(1, &fds, NULL, NULL, timeout, &old_set);
+            /* Journal files are written in the background so any failure
+             * is only reported here */
+            se_report_journal_errors(sess);
+
+            if (se_has_errors(sess)) {
+                ip_handle_error(sess);
+                sess->ui->update(sess->ui);
+                get_monotonic_time(&last_draw);
+            }
+
+            if (timeout == NULL &&
+                (search_pending || index_pending || follow_pending)) {
+                select_timeout = &no_timeout;
+            }
+
+            /* Wait for user input, job output, search results or signal */
+            pselect_res = pselect(max_fd + 1, &read_fds, &write_fds, NULL,
+                                  select_timeout, &old_set);
+
+            job_output_written = 0;
+
+            if (pselect_res >= 0 && se_has_jobs(sess) &&
+                se_process_jobs(sess, &read_fds, &write_fds,
+                                &job_output_written) > 0) {
+                /* A job has completed and updated its buffer */
+                ip_handle_error(sess);
+                sess->ui->update(sess->ui);
+                get_monotonic_time(&last_draw);
+            } else if (job_output_written) {
+                /* Read output is inserted as it arrives so redraws are
+                 * limited as for search results */
+                ip_handle_error(sess);
+                get_monotonic_time(&now);
+
+                if (now.tv_nsec - last_draw.tv_nsec >= MIN_DRAW_INTERVAL_NS) {
+                    sess->ui->update(sess->ui);
+                    get_monotonic_time(&last_draw);
+                } else {
+                    redraw_due = 1;
+                }
+            }
+
+            if (pselect_res > 0 &&
+                se_process_file_searches(sess, &read_fds) > 0) {
+                /* Search results arrive in many small batches so limit
+                 * redraws in the same way as for user input */
+                ip_handle_error(sess);
+                get_monotonic_time(&now);
+
+                if (now.tv_nsec - last_draw.tv_nsec >= MIN_DRAW_INTERVAL_NS) {
+                    sess->ui->update(sess->ui);
+                    get_monotonic_time(&last_draw);
+                } else {
+                    redraw_due = 1;
+                }
+            }
+
+            if (pselect_res >= 0 &&
+                se_process_tail_follows(sess, &read_fds,
+                                        &follow_pending) > 0) {
+                /* Text can be appended to a followed file many times a
+                 * second so redraws are limited as for search results */
+                ip_handle_error(sess);
+                get_monotonic_time(&now);
+
+                if (now.tv_nsec - last_draw.tv_nsec >= MIN_DRAW_INTERVAL_NS) {
+                    sess->ui->update(sess->ui);
+                    get_monotonic_time(&last_draw);
+                } else {
+                    redraw_due = 1;
+                }
+            }
+
+            if (pselect_res > 0 &&
+                se_process_dir_cache(sess, &read_fds) > 0) {
+                /* A directory path completion was waiting for has been
+                 * read */
+                ip_handle_error(sess);
+                sess->ui->update(sess->ui);
+                get_monotonic_time(&last_draw);
+            }
+
+            if (pselect_res > 0 &&
+                se_process_file_explorer(sess, &read_fds) > 0) {
+                /* Directory entries have been read or files have been
+                 * added or removed */
+                ip_handle_error(sess);
+                sess->ui->update(sess->ui);
+                get_monotonic_time(&last_draw);
+            }
+
+            if (pselect_res > 0) {
+                /* The index isn't displayed so only errors need to be
+                 * shown when it's updated */
+                se_process_project_index(sess, &read_fds);
+
+                if (se_has_errors(sess)) {
+                    ip_handle_error(sess);
+                    sess->ui->update(sess->ui);
+                    get_monotonic_time(&last_draw);
+                }
+            }
 
             if (pselect_res == -1) {
                 /* pselect failed */
@@ -249,11 +511,13 @@ void ip_process_input(Session *sess)
                         continue;
                     } else if (ip_sigterm_signal) {
                         sess->ui->end(sess->ui);
+                        /* Ensure the changes made are recoverable */
+                        se_sync_journals(sess);
                         exit(ip_sigterm_signal);
                     }
                 }
                 /* TODO Handle general failure of pselect */
-            } else if (pselect_res == 0) {
+            } else if (pselect_res == 0 && timeout != NULL) {
                 input_buffer->arg = IA_NO_INPUT_AVAILABLE_TO_READ;
                 sess->ui->get_input(sess->ui);
                 /* pselect timed out so attempt to interpret any unprocessed
@@ -269,7 +533,7 @@ void ip_process_input(Session *sess)
                 }
 
                 timeout = NULL;
-            } else if (pselect_res > 0) {
+            } else if (pselect_res > 0 && FD_ISSET(STDIN_FILENO, &read_fds)) {
                 input_buffer->arg = IA_INPUT_AVAILABLE_TO_READ;
                 sess->ui->get_input(sess->ui);
 
@@ -303,28 +567,210 @@ static void ip_process_input_buffer(Session *sess, int *finished,
     GapBuffer *buffer = input_buffer->buffer;
 
     static char keystr[MAX_KEY_STR_SIZE];
+    static char insert_run[MAX_INSERT_RUN_SIZE];
     size_t keystr_len;
+    size_t run_len;
     Status status;
 
     while (ip_input_available(input_buffer) && !*finished) {
-        status = ip_get_next_key(sess, buffer, keystr,
-                                 sizeof(keystr), &keystr_len);
+        if (ip_input_starts_with(buffer, WED_PASTE_START)) {
+            status = ip_get_keystr_paste(sess, buffer);
+
+            if (!STATUS_IS_SUCCESS(status)) {
+                se_add_error(sess, status);
+                ip_handle_error(sess);
+            }
+
+            continue;
+        }
 
-        if (STATUS_IS_SUCCESS(status)) {
-            ip_handle_keypress(sess, keystr, finished,
-                               last_draw, redraw_due);
+        run_len = ip_get_insert_run(sess, buffer, insert_run,
+                                    sizeof(insert_run));
+
+        if (run_len > 0) {
+            ip_handle_insert_run(sess, insert_run, run_len,
+                                 last_draw, redraw_due);
         } else {
-            se_add_error(sess, status);
-            ip_handle_error(sess);
+            status = ip_get_next_key(sess, buffer, keystr,
+                                     sizeof(keystr), &keystr_len);
+
+            if (STATUS_IS_SUCCESS(status)) {
+                ip_handle_keypress(sess, keystr, finished,
+                                   last_draw, redraw_due);
+            } else {
+                se_add_error(sess, status);
+                ip_handle_error(sess);
+            }
         }
 
-        if (sess->wed_opt.test_mode && se_has_errors(sess)) {
-            gb_clear(sess->input_buffer.buffer);
-            return;
+        if (sess->wed_opt.test_mode) {
+            ip_complete_incremental_search(sess);
+
+            if (se_has_errors(sess)) {
+                gb_clear(sess->input_buffer.buffer);
+                return;
+            }
         }
     }
 }
 
+/* Test mode doesn't idle between keys, so search for the pattern in the
+ * find prompt after each key instead. The whole buffer is searched before
+ * the next key is processed so that results are consistent */
+static void ip_complete_incremental_search(Session *sess)
+{
+    int search_pending;
+
+    do {
+        cm_update_incremental_search(sess, &search_pending);
+    } while (search_pending);
+}
+
+static int ip_input_starts_with(GapBuffer *buffer, const char *str)
+{
+    const size_t str_len = strlen(str);
+    char start[str_len];
+
+    return gb_length(buffer) >= str_len &&
+           gb_get_range(buffer, 0, start, str_len) == str_len &&
+           memcmp(start, str, str_len) == 0;
+}
+
+/* Convert the keys between WED_PASTE_START and WED_PASTE_END at the start
+ * of the input buffer into text and replace them with a paste of that
+ * text, as if it had been pasted into a terminal */
+static Status ip_get_keystr_paste(Session *sess, GapBuffer *buffer)
+{
+    char input[MAX_KEY_STR_SIZE];
+    char keystr[MAX_KEY_STR_SIZE];
+    size_t bytes, keystr_len, parsed_len;
+    char *text = NULL;
+    size_t text_len = 0;
+    size_t text_alloc = 0;
+    Status status = STATUS_SUCCESS;
+
+    gb_set_point(buffer, 0);
+    gb_delete(buffer, strlen(WED_PASTE_START));
+
+    while (gb_length(buffer) > 0 && STATUS_IS_SUCCESS(status)) {
+        if (ip_input_starts_with(buffer, WED_PASTE_END)) {
+            gb_set_point(buffer, 0);
+            gb_delete(buffer, strlen(WED_PASTE_END));
+            break;
+        }
+
+        bytes = gb_get_range(buffer, 0, input,
+                             MIN(gb_length(buffer), sizeof(input) - 1));
+        input[bytes] = '\0';
+
+        if (ip_parse_key(sess, input, keystr, sizeof(keystr), &keystr_len,
+                         &parsed_len)) {
+            status = ip_add_paste_key(keystr, &text, &text_len, &text_alloc);
+        } else {
+            parsed_len = 1;
+        }
+
+        gb_set_point(buffer, 0);
+        gb_delete(buffer, parsed_len);
+    }
+
+    if (!STATUS_IS_SUCCESS(status) || text_len == 0) {
+        free(text);
+        return status;
+    }
+
+    RETURN_IF_FAIL(ip_add_pasted_text(&sess->input_buffer, text, text_len));
+
+    return ip_add_keystr_input_to_start(&sess->input_buffer,
+                                        WED_BRACKETED_PASTE,
+                                        strlen(WED_BRACKETED_PASTE));
+}
+
+/* Append the text a key represents in the same way the TUI converts
+ * keys received during a paste. Other special keys are dropped */
+static Status ip_add_paste_key(const char *keystr, char **text,
+                               size_t *text_len, size_t *text_alloc)
+{
+    const char *key_text = NULL;
+
+    if (keystr[0] != '<' || keystr[1] == '\0') {
+        key_text = keystr;
+    } else if (strcmp(keystr, "<Space>") == 0) {
+        key_text = " ";
+    } else if (strcmp(keystr, "<Tab>") == 0) {
+        key_text = "\t";
+    } else if (strcmp(keystr, "<Enter>") == 0) {
+        key_text = "\n";
+    } else {
+        return STATUS_SUCCESS;
+    }
+
+    const size_t key_text_len = strlen(key_text);
+
+    if (*text_len + key_text_len > *text_alloc) {
+        size_t alloc = MAX(*text_alloc * 2, MAX_KEY_STR_SIZE);
+        char *new_text = realloc(*text, alloc);
+
+        if (new_text == NULL) {
+            return OUT_OF_MEMORY("Unable to save pasted text");
+        }
+
+        *text = new_text;
+        *text_alloc = alloc;
+    }
+
+    memcpy(*text + *text_len, key_text, key_text_len);
+    *text_len += key_text_len;
+
+    return STATUS_SUCCESS;
+}
+
+/* When input starts with a run of at least two printable characters,
+ * each of which inserts itself into the buffer, the run is removed from
+ * the input buffer so that it can be inserted in one go rather than a key
+ * at a time. Characters which need special handling, such as tabs and
+ * new lines, keys of the form <...> and characters bound to other
+ * operations end a run. Returns the length of the run or zero if input
+ * doesn't start with one */
+static size_t ip_get_insert_run(const Session *sess, GapBuffer *buffer,
+                                char *run, size_t run_size)
+{
+    if (gb_length(buffer) < 2 ||
+        !ip_is_insert_run_char(sess, gb_get_at(buffer, 0)) ||
+        !ip_is_insert_run_char(sess, gb_get_at(buffer, 1))) {
+        return 0;
+    }
+
+    size_t bytes = gb_get_range(buffer, 0, run,
+                                MIN(gb_length(buffer), run_size));
+    size_t run_len = 2;
+
+    while (run_len < bytes && ip_is_insert_run_char(sess, run[run_len])) {
+        run_len++;
+    }
+
+    gb_set_point(buffer, 0);
+    gb_delete(buffer, run_len);
+
+    return run_len;
+}
+
+/* Only printable ASCII characters are considered, as each is a complete
+ * key which can be checked without being parsed */
+static int ip_is_insert_run_char(const Session *sess, char character)
+{
+    if (character < ' ' || character > '~' || character == '<') {
+        return 0;
+    }
+
+    const char key[] = { character, '\0' };
+    /* A space is parsed as the key <Space> */
+    const char *text = cm_get_inserted_text(sess, character == ' ' ?
+                                                  "<Space>" : key);
+
+    return text != NULL && text[0] == character && text[1] == '\0';
+}
+
 static Status ip_get_next_key(Session *sess, GapBuffer *buffer,
                               char *keystr_buffer, size_t keystr_buffer_len,
                               size_t *keystr_len_ptr)
@@ -440,26 +886,80 @@ static void ip_handle_keypress(Session *sess, const char *keystr,
                                int *finished, struct timespec *last_draw,
                                int *redraw_due)
 {
-    static struct timespec now;
+    if (sess->bench != NULL) {
+        const char *operation_name = cm_get_operation_name(sess, keystr);
+        bm_start(sess->bench, operation_name != NULL ? operation_name
+                                                     : keystr);
+    }
+
     /* This is where user input invokes a command */
     se_add_error(sess, cm_do_operation(sess, keystr, finished));
+
+    /* Keep the text around the cursor loaded when only part
+     * of a file is in memory */
+    if (!*finished) {
+        se_add_error(sess, bf_update_large_file_window(sess->active_buffer));
+    }
+
+    if (sess->bench != NULL) {
+        se_add_error(sess, bm_end(sess->bench));
+    }
+
     /* Immediately display any errors that have occurred */
     ip_handle_error(sess);
     se_save_key(sess, keystr);
 
     if (!*finished) {
-        get_monotonic_time(&now);
+        ip_update_display(sess, last_draw, redraw_due);
+    }
+}
 
-        if (now.tv_nsec - last_draw->tv_nsec >= MIN_DRAW_INTERVAL_NS) {
-            sess->ui->update(sess->ui);
-            get_monotonic_time(last_draw);
-        } else {
-            /* A redraw is due but wait longer to see if the user enters
-             * more input before refreshing screen. This allows us to deal
-             * with a user pasting a large amount of text into the terminal
-             * smoothly */
-            *redraw_due = 1;
-        }
+/* Equivalent to calling ip_handle_keypress for each character in run */
+static void ip_handle_insert_run(Session *sess, const char *run,
+                                 size_t run_len, struct timespec *last_draw,
+                                 int *redraw_due)
+{
+    if (sess->bench != NULL) {
+        bm_start(sess->bench, "<insert-run>");
+    }
+
+    Status status = cm_insert_typed_text(sess, run, run_len);
+
+    if (STATUS_IS_SUCCESS(status) && se_macro_recording(sess)) {
+        status = mc_add_text(&sess->macro, run, run_len);
+    }
+
+    se_add_error(sess, status);
+    se_add_error(sess, bf_update_large_file_window(sess->active_buffer));
+
+    if (sess->bench != NULL) {
+        se_add_error(sess, bm_end(sess->bench));
+    }
+
+    ip_handle_error(sess);
+
+    const char last_key[] = { run[run_len - 1], '\0' };
+    se_save_key(sess, last_key);
+
+    ip_update_display(sess, last_draw, redraw_due);
+}
+
+static void ip_update_display(Session *sess, struct timespec *last_draw,
+                              int *redraw_due)
+{
+    static struct timespec now;
+
+    get_monotonic_time(&now);
+
+    if (now.tv_nsec - last_draw->tv_nsec >= MIN_DRAW_INTERVAL_NS) {
+        sess->ui->update(sess->ui);
+        get_monotonic_time(last_draw);
+    } else {
+        /* A redraw is due but wait longer to see if the user enters
+         * more input before refreshing screen. This allows us to deal
+         * with a user pasting a large amount of text into the terminal
+         * smoothly */
+        *redraw_due = 1;
     }
 }
 
@@ -22,6 +22,7 @@
 #include "lib/libtermkey/termkey.h"
 #include "gap_buffer.h"
 #include "status.h"
+#include "list.h"
 
 struct Session;
 
@@ -70,6 +71,21 @@ typedef struct {
     } data; /* Data relating to this event */
 } MouseClickEvent;
 
+/* Text pasted into the terminal. Terminals which support bracketed paste
+ * mode mark the start and end of pasted text so that it can be inserted
+ * in one go rather than processed as individual key presses */
+typedef struct {
+    char *text; /* Pasted text with line endings converted to \n */
+    size_t text_len; /* Pasted text length */
+} PastedText;
+
+/* Pasted text is inserted by this operation */
+#define WED_BRACKETED_PASTE "<wed-bracketed-paste>"
+/* Keys between these in a key string are treated as pasted text, allowing
+ * bracketed pastes to be given using --key-string */
+#define WED_PASTE_START "<wed-paste-start>"
+#define WED_PASTE_END "<wed-paste-end>"
+
 /* Structure through which input is read in and stored to be processed */
 typedef struct {
     GapBuffer *buffer; /* Store key string input */
@@ -82,6 +98,7 @@ typedef struct {
                               processing continues */
     MouseClickEvent last_mouse_click; /* The last mouse click event that
                                          occurred */
+    List *pasted_text; /* Pasted text waiting to be inserted, oldest first */
 } InputBuffer;
 
 int ip_init(InputBuffer *);
@@ -95,5 +112,8 @@ Status ip_add_keystr_input_to_end(InputBuffer *, const char *keystr,
 Status ip_add_mouse_click_event(InputBuffer *, const char *keystr,
                                 size_t keystr_len, const MouseClickEvent *);
 const MouseClickEvent *ip_get_last_mouse_click_event(const InputBuffer *);
+Status ip_add_paste_event(InputBuffer *, const char *keystr,
+                          size_t keystr_len, char *text, size_t text_len);
+int ip_get_pasted_text(InputBuffer *, PastedText *);
 
 #endif
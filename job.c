@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "job.h"
+#include "util.h"
+
+static Status jb_start_filter(Job *);
+static Status jb_start_read(Job *);
+static Status jb_process_output(Job *, int *output_written);
+static Status jb_write_output(Job *);
+static void jb_end_grouped_changes(Job *);
+static Status jb_complete_filter(Job *);
+static Status jb_complete_read(Job *);
+
+Job *jb_new(size_t id, JobType type, const char *cmd, Buffer *buffer,
+            const struct Config *config)
+{
+    assert(!is_null_or_empty(cmd));
+    assert(buffer != NULL);
+
+    Job *job = malloc(sizeof(Job));
+    RETURN_IF_NULL(job);
+    memset(job, 0, sizeof(Job));
+
+    job->id = id;
+    job->type = type;
+    job->buffer = buffer;
+
+    if ((job->cmd = strdup(cmd)) == NULL) {
+        jb_free(job);
+        return NULL;
+    }
+
+    if ((job->err_buffer = bf_new_empty("cmderror", config)) == NULL) {
+        jb_free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+void jb_free(Job *job)
+{
+    if (job == NULL) {
+        return;
+    }
+
+    if (job->started) {
+        ec_free_command(&job->ec);
+    }
+
+    jb_end_grouped_changes(job);
+
+    if (job->bis.buffer != NULL) {
+        job->bis.is.close((InputStream *)&job->bis);
+    }
+
+    if (job->tos.data != NULL) {
+        job->tos.os.close((OutputStream *)&job->tos);
+    }
+
+    if (job->range.start.data != NULL) {
+        bf_remove_pos_mark(job->buffer, &job->range.start, 1);
+
+        if (job->type == JT_FILTER) {
+            bf_remove_pos_mark(job->buffer, &job->range.end, 1);
+        }
+    }
+
+    if (job->bes.buffer != NULL) {
+        job->bes.os.close((OutputStream *)&job->bes);
+    }
+
+    bf_free(job->err_buffer);
+    free(job->cmd);
+    free(job);
+}
+
+Status jb_start(Job *job)
+{
+    RETURN_IF_FAIL(bf_get_buffer_output_stream(&job->bes, job->err_buffer,
+                                               &job->err_buffer->pos, 0));
+
+    /* Command output is collected separately from the buffer. Filter
+     * output replaces the buffer content as a single change once the
+     * command has finished, read output is inserted as it arrives */
+    RETURN_IF_FAIL(bf_get_text_output_stream(&job->tos));
+
+    if (job->type == JT_FILTER) {
+        RETURN_IF_FAIL(jb_start_filter(job));
+    } else {
+        RETURN_IF_FAIL(jb_start_read(job));
+    }
+
+    job->started = 1;
+
+    return STATUS_SUCCESS;
+}
+
+static Status jb_start_filter(Job *job)
+{
+    Buffer *buffer = job->buffer;
+    BufferPos pos = buffer->pos;
+    bp_to_buffer_start(&pos);
+    job->range.start = pos;
+    bp_to_buffer_end(&pos);
+    job->range.end = pos;
+
+    /* The range is read from the buffer as the command consumes it, so
+     * the output is only applied if the buffer is unmodified when the
+     * command finishes */
+    job->change_state = bc_get_current_state(&buffer->changes);
+    RETURN_IF_FAIL(bf_add_new_mark(buffer, &job->range.start, MP_NONE));
+    Status status = bf_add_new_mark(buffer, &job->range.end,
+                                    MP_NO_ADJUST_ON_BUFFER_POS);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        bf_remove_pos_mark(buffer, &job->range.start, 1);
+        job->range.start.data = NULL;
+        return status;
+    }
+
+    RETURN_IF_FAIL(bf_get_buffer_input_stream(&job->bis, buffer,
+                                              &job->range));
+
+    return ec_start_command(&job->ec, job->cmd, (InputStream *)&job->bis,
+                            (OutputStream *)&job->tos,
+                            (OutputStream *)&job->bes, 1);
+}
+
+static Status jb_start_read(Job *job)
+{
+    /* Track the position output will be inserted at as the buffer
+     * may be modified in the meantime. The mark moves past each piece
+     * of output as it's inserted */
+    job->range.start = job->buffer->pos;
+    RETURN_IF_FAIL(bf_add_new_mark(job->buffer, &job->range.start, MP_NONE));
+
+    return ec_start_command(&job->ec, job->cmd, NULL,
+                            (OutputStream *)&job->tos,
+                            (OutputStream *)&job->bes, 1);
+}
+
+void jb_add_fds(const Job *job, fd_set *read_fds, fd_set *write_fds,
+                int *max_fd)
+{
+    ec_add_fds(&job->ec, read_fds, write_fds, max_fd);
+}
+
+Status jb_process(Job *job, const fd_set *read_fds, const fd_set *write_fds,
+                  int *output_written)
+{
+    *output_written = 0;
+    ec_set_revents(&job->ec, read_fds, write_fds);
+    RETURN_IF_FAIL(ec_process_command(&job->ec));
+
+    return jb_process_output(job, output_written);
+}
+
+static Status jb_process_output(Job *job, int *output_written)
+{
+    *output_written = 0;
+
+    if (job->type != JT_READ || job->cancelled ||
+        gb_length(job->tos.data) == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    *output_written = 1;
+
+    return jb_write_output(job);
+}
+
+/* Insert the read output received so far at the tracked position. All
+ * output is added to one undo group, which is left open until the job
+ * exits so that the output can be undone, or removed on cancellation,
+ * in a single step */
+static Status jb_write_output(Job *job)
+{
+    Buffer *buffer = job->buffer;
+    GapBuffer *data = job->tos.data;
+
+    if (!job->grouped_changes) {
+        RETURN_IF_FAIL(bc_start_grouped_changes(&buffer->changes));
+        job->grouped_changes = 1;
+    }
+
+    /* The cursor and selection may have moved since the job was started
+     * so keep them in place relative to the surrounding text */
+    BufferPos orig_pos = buffer->pos;
+    BufferPos select_start = buffer->select_start;
+    int selection_started = bf_selection_started(buffer);
+    int block_select = buffer->block_select;
+
+    RETURN_IF_FAIL(bf_add_new_mark(buffer, &orig_pos,
+                                   MP_NO_ADJUST_ON_BUFFER_POS));
+    Status status = STATUS_SUCCESS;
+
+    if (selection_started) {
+        status = bf_add_new_mark(buffer, &select_start,
+                                 MP_NO_ADJUST_ON_BUFFER_POS);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        Range range = { .start = job->range.start, .end = job->range.start };
+        gb_contiguous_storage(data);
+        status = bf_replace_range(buffer, &range, data->text,
+                                  gb_length(data));
+
+        if (selection_started) {
+            bf_remove_pos_mark(buffer, &select_start, 1);
+        }
+    }
+
+    bf_remove_pos_mark(buffer, &orig_pos, 1);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_set_bp(buffer, &orig_pos, 0);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        if (selection_started) {
+            buffer->select_start = select_start;
+            buffer->block_select = block_select;
+        }
+
+        gb_clear(data);
+        job->output_written = 1;
+    }
+
+    return status;
+}
+
+static void jb_end_grouped_changes(Job *job)
+{
+    BufferChanges *changes = &job->buffer->changes;
+
+    /* The undo history is discarded if the buffer is reset whilst the
+     * job is running */
+    if (job->grouped_changes && bc_grouped_changes_started(changes)) {
+        bc_end_grouped_changes(changes);
+    }
+
+    job->grouped_changes = 0;
+}
+
+/* Block until the job has finished. Used when there is no input loop
+ * available to process the job in the background e.g. in test mode */
+Status jb_run_to_completion(Job *job)
+{
+    ExternalCommand *ec = &job->ec;
+    const nfds_t nfds = ARRAY_SIZE(ec->fds, struct pollfd);
+
+    while (!ec_io_finished(ec)) {
+        if (poll(ec->fds, nfds, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return st_get_error(ERR_UNABLE_TO_RUN_EXTERNAL_COMMAND,
+                                "poll failed: %s", strerror(errno));
+        }
+
+        RETURN_IF_FAIL(ec_process_command(ec));
+
+        int output_written;
+        RETURN_IF_FAIL(jb_process_output(job, &output_written));
+    }
+
+    int exited;
+
+    return ec_wait_command(ec, 1, &exited);
+}
+
+int jb_io_finished(const Job *job)
+{
+    return ec_io_finished(&job->ec);
+}
+
+Status jb_wait(Job *job, int *exited)
+{
+    return ec_wait_command(&job->ec, 0, exited);
+}
+
+/* Called once the job has exited to apply its results to the buffer */
+Status jb_complete(Job *job)
+{
+    if (job->type == JT_READ) {
+        RETURN_IF_FAIL(jb_complete_read(job));
+    } else if (!job->cancelled) {
+        RETURN_IF_FAIL(jb_complete_filter(job));
+    }
+
+    if (job->cancelled) {
+        return STATUS_SUCCESS;
+    }
+
+    if (!ec_cmd_successfull(job->ec.cmd_status)) {
+        char *error = bf_to_string(job->err_buffer);
+        Status status = st_get_error(ERR_SHELL_COMMAND_ERROR,
+                                     "Error when running command \"%s\": %s",
+                                     job->cmd, error == NULL ? "" : error);
+        free(error);
+        return status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status jb_complete_filter(Job *job)
+{
+    Buffer *buffer = job->buffer;
+
+    if (bc_has_state_changed(&buffer->changes, job->change_state)) {
+        return st_get_error(ERR_BUFFER_MODIFIED,
+                            "Buffer was modified whilst job %zu (%s) was "
+                            "running, its output has been discarded",
+                            job->id, job->cmd);
+    }
+
+    BufferPos orig_pos = buffer->pos;
+    TextOutputStream *tos = &job->tos;
+
+    gb_contiguous_storage(tos->data);
+    RETURN_IF_FAIL(bf_replace_range(buffer, &job->range, tos->data->text,
+                                    gb_length(tos->data)));
+
+    orig_pos = bp_init_from_line_col(orig_pos.line_no, orig_pos.col_no,
+                                     &buffer->pos);
+
+    return bf_set_bp(buffer, &orig_pos, 0);
+}
+
+static Status jb_complete_read(Job *job)
+{
+    Status status = STATUS_SUCCESS;
+
+    if (!job->cancelled) {
+        int output_written;
+        status = jb_process_output(job, &output_written);
+    }
+
+    int grouped_changes = job->grouped_changes;
+    jb_end_grouped_changes(job);
+
+    if (job->cancelled && grouped_changes && job->output_written) {
+        /* Remove the output inserted before the job was cancelled. Edits
+         * made whilst the output was being inserted are part of the same
+         * group, so can be restored by redoing it */
+        status = bc_undo(&job->buffer->changes, job->buffer);
+    }
+
+    return status;
+}
+
+void jb_cancel(Job *job)
+{
+    if (job->started && !job->cancelled) {
+        job->cancelled = 1;
+        ec_terminate_command(&job->ec);
+    }
+}
+
+const char *jb_type_str(JobType type)
+{
+    static const char *job_types[] = {
+        [JT_FILTER] = "filter",
+        [JT_READ] = "read"
+    };
+
+    return job_types[type];
+}
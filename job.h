@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_JOB_H
+#define WED_JOB_H
+
+#include "buffer.h"
+#include "external_command.h"
+
+/* A job is an external command that runs in the background whilst the
+ * user continues editing. The file descriptors of each running job are
+ * monitored in the main input loop and processed as they become ready */
+
+/* The operation the job performs on its buffer */
+typedef enum {
+    JT_FILTER, /* Buffer content is replaced by command output */
+    JT_READ /* Command output is inserted at the cursor position */
+} JobType;
+
+typedef struct Job Job;
+
+struct Job {
+    size_t id; /* Number used to identify job to the user */
+    JobType type; /* Filter or read */
+    char *cmd; /* The shell command being run */
+    Buffer *buffer; /* The buffer the job reads from and writes to */
+    Buffer *err_buffer; /* Stores command stderr output */
+    ExternalCommand ec; /* The running command */
+    Range range; /* The buffer text that will be replaced by the output.
+                    For JT_READ only range.start is used, which is where
+                    the next output is inserted */
+    BufferInputStream bis; /* JT_FILTER: Writes range to command stdin */
+    TextOutputStream tos; /* JT_FILTER: Collects output until job finishes
+                             JT_READ: Holds output until it's inserted */
+    BufferOutputStream bes; /* Writes stderr into err_buffer */
+    BufferChangeState change_state; /* JT_FILTER: Buffer state when the job
+                                       started, output is discarded if the
+                                       buffer has been modified since */
+    int grouped_changes; /* JT_READ: True whilst output is being added to
+                            an undo group which is open until job exits */
+    int output_written; /* JT_READ: True once output has been inserted */
+    int started; /* True if command was started successfully */
+    int cancelled; /* True if the user requested the job be terminated */
+};
+
+Job *jb_new(size_t id, JobType, const char *cmd, Buffer *,
+            const struct Config *config);
+void jb_free(Job *);
+Status jb_start(Job *);
+void jb_add_fds(const Job *, fd_set *read_fds, fd_set *write_fds,
+                int *max_fd);
+Status jb_process(Job *, const fd_set *read_fds, const fd_set *write_fds,
+                  int *output_written);
+Status jb_run_to_completion(Job *);
+int jb_io_finished(const Job *);
+Status jb_wait(Job *, int *exited);
+Status jb_complete(Job *);
+void jb_cancel(Job *);
+const char *jb_type_str(JobType);
+
+#endif
@@ -0,0 +1,922 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "journal.h"
+#include "util.h"
+
+/* Initial size of the data buffered for a journal */
+#define JN_DATA_INIT 4096
+#define JN_HASH_BASIS 0x811c9dc5U
+#define JN_HASH_PRIME 0x01000193U
+
+static void *jn_writer_run(void *);
+static void jn_write_journals(JournalWriter *);
+static int jn_write_data(Journal *, const char *data, size_t data_len);
+static int jn_remove_file(Journal *);
+static void jn_make_dir(const char *dir_path);
+static void jn_free_journal(Journal *);
+static char *jn_journal_path(const char *journal_dir, const char *file_path);
+static int jn_in_use(const JournalWriter *, const char *journal_path);
+static int jn_open_existing(Journal *);
+static int jn_file_matches(const char *journal_path, const char *file_path,
+                           const struct stat *file_stat);
+static int jn_header_matches(const char *data, size_t data_len,
+                             const char *file_path,
+                             const struct stat *file_stat);
+static int jn_reserve(Journal *, size_t length);
+static void jn_add(Journal *, const JournalRecord *, const char *str);
+static uint32_t jn_hash(uint32_t hash, const void *data, size_t data_len);
+static uint32_t jn_record_check(const JournalRecord *, const char *str);
+static Status jn_read_file(const char *file_path, char **data_ptr,
+                           size_t *data_len_ptr);
+
+JournalWriter *jn_new_writer(const char *journal_dir)
+{
+    assert(!is_null_or_empty(journal_dir));
+
+    JournalWriter *writer = malloc(sizeof(JournalWriter));
+    RETURN_IF_NULL(writer);
+    memset(writer, 0, sizeof(JournalWriter));
+
+    writer->journal_dir = strdup(journal_dir);
+    writer->journals = list_new();
+
+    if (writer->journal_dir == NULL || writer->journals == NULL) {
+        free(writer->journal_dir);
+        list_free(writer->journals);
+        free(writer);
+        return NULL;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    pthread_cond_init(&writer->synced, NULL);
+
+    if (pthread_create(&writer->thread, NULL, jn_writer_run, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->changed);
+        pthread_cond_destroy(&writer->synced);
+        free(writer->journal_dir);
+        list_free(writer->journals);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+/* All journals should have been freed using jn_free beforehand, so that
+ * their files are removed */
+void jn_free_writer(JournalWriter *writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 1;
+    pthread_cond_signal(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+
+    Journal *journal;
+
+    while (list_size(writer->journals) > 0) {
+        journal = list_pop(writer->journals);
+
+        if (journal->fd != -1) {
+            close(journal->fd);
+        }
+
+        jn_free_journal(journal);
+    }
+
+    list_free(writer->journals);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+    pthread_cond_destroy(&writer->synced);
+    free(writer->journal_dir);
+    free(writer);
+}
+
+/* Write and sync all changes added so far. This is used before wed exits
+ * without freeing the session, so that the journals remain complete */
+void jn_sync(JournalWriter *writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+
+    size_t sync_request = ++writer->sync_requests;
+    pthread_cond_signal(&writer->changed);
+
+    while (writer->syncs_completed < sync_request) {
+        pthread_cond_wait(&writer->synced, &writer->lock);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static void *jn_writer_run(void *arg)
+{
+    JournalWriter *writer = arg;
+    struct timespec deadline;
+    size_t sync_request;
+    int stop;
+
+    pthread_mutex_lock(&writer->lock);
+
+    do {
+        while (!writer->pending && !writer->stop &&
+               writer->sync_requests == writer->syncs_completed) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+
+        /* Changes made shortly after one another, such as those made by
+         * typing, are written and synced together */
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += JN_SYNC_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (JN_SYNC_INTERVAL_MS % 1000) * 1000000L;
+
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        while (!writer->stop &&
+               writer->sync_requests == writer->syncs_completed) {
+            if (pthread_cond_timedwait(&writer->changed, &writer->lock,
+                                       &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        sync_request = writer->sync_requests;
+        stop = writer->stop;
+        writer->pending = 0;
+
+        jn_write_journals(writer);
+
+        writer->syncs_completed = sync_request;
+        pthread_cond_broadcast(&writer->synced);
+    } while (!stop);
+
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+/* Called with the writer's lock held. The lock is released whilst each
+ * journal file is written. Only this thread removes journals from the
+ * list, so the journals before the one being written don't change */
+static void jn_write_journals(JournalWriter *writer)
+{
+    Journal *journal;
+    char *write_data;
+    size_t write_len;
+    int remove_file;
+    int closed;
+    int error;
+    size_t k = 0;
+
+    while (k < list_size(writer->journals)) {
+        journal = list_get(writer->journals, k);
+        remove_file = journal->remove_file;
+        closed = journal->closed;
+        write_len = 0;
+        journal->remove_file = 0;
+
+        if (journal->data_len > 0 && !journal->recoverable &&
+            journal->error == 0) {
+            /* Swap buffers so changes can be added whilst the file is
+             * written */
+            size_t write_alloc = journal->write_alloc;
+            write_data = journal->data;
+            write_len = journal->data_len;
+            journal->data = journal->write_data;
+            journal->write_data = write_data;
+            journal->write_alloc = journal->data_alloc;
+            journal->data_alloc = write_alloc;
+            journal->data_len = 0;
+        }
+
+        pthread_mutex_unlock(&writer->lock);
+
+        error = 0;
+
+        if (remove_file) {
+            error = jn_remove_file(journal);
+        }
+
+        if (write_len > 0 && error == 0) {
+            error = jn_write_data(journal, journal->write_data, write_len);
+        }
+
+        pthread_mutex_lock(&writer->lock);
+
+        if (closed) {
+            list_remove_at(writer->journals, k);
+
+            if (journal->fd != -1) {
+                close(journal->fd);
+            }
+
+            jn_free_journal(journal);
+            continue;
+        }
+
+        if (error != 0) {
+            journal->error = error;
+
+            if (journal->fd != -1) {
+                close(journal->fd);
+                journal->fd = -1;
+            }
+        }
+
+        k++;
+    }
+}
+
+/* Append data to the journal file and sync it. Returns 0 or an errno. The
+ * journal file is locked whilst it's open, so that another wed doesn't
+ * mistake it for the journal of a wed which has exited */
+static int jn_write_data(Journal *journal, const char *data, size_t data_len)
+{
+    if (journal->fd == -1) {
+        jn_make_dir(journal->writer->journal_dir);
+        int fd = open(journal->journal_path,
+                      O_WRONLY | O_CREAT | O_APPEND, 0600);
+
+        if (fd == -1) {
+            return errno;
+        }
+
+        /* The file is only truncated once it's locked, as a journal
+         * locked by another wed is still being written */
+        if (flock(fd, LOCK_EX | LOCK_NB) == -1 || ftruncate(fd, 0) == -1) {
+            int error = errno;
+            close(fd);
+            return error;
+        }
+
+        journal->fd = fd;
+    }
+
+    ssize_t written;
+
+    while (data_len > 0) {
+        written = write(journal->fd, data, data_len);
+
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return errno;
+        }
+
+        data += written;
+        data_len -= written;
+    }
+
+    if (fsync(journal->fd) == -1) {
+        return errno;
+    }
+
+    return 0;
+}
+
+/* Remove the journal file unless it's locked by another wed. Returns 0 or
+ * an errno */
+static int jn_remove_file(Journal *journal)
+{
+    if (journal->fd == -1) {
+        journal->fd = open(journal->journal_path, O_WRONLY);
+
+        if (journal->fd == -1) {
+            return errno == ENOENT ? 0 : errno;
+        }
+
+        if (flock(journal->fd, LOCK_EX | LOCK_NB) == -1) {
+            close(journal->fd);
+            journal->fd = -1;
+            return 0;
+        }
+    }
+
+    int error = 0;
+
+    if (unlink(journal->journal_path) == -1 && errno != ENOENT) {
+        error = errno;
+    }
+
+    close(journal->fd);
+    journal->fd = -1;
+
+    return error;
+}
+
+/* Create dir_path and any missing parent directories */
+static void jn_make_dir(const char *dir_path)
+{
+    char path[PATH_MAX];
+    size_t path_len = strlen(dir_path);
+
+    if (path_len >= sizeof(path)) {
+        return;
+    }
+
+    memcpy(path, dir_path, path_len + 1);
+
+    for (size_t k = 1; k < path_len; k++) {
+        if (path[k] == '/') {
+            path[k] = '\0';
+            mkdir(path, 0700);
+            path[k] = '/';
+        }
+    }
+
+    mkdir(path, 0700);
+}
+
+/* Journal changes made to the buffer of file_path. When an earlier
+ * journal of the file exists it can be replayed unless it's being written
+ * by this session or another wed, or the file has changed since */
+Status jn_new(JournalWriter *writer, const char *file_path,
+              const struct stat *file_stat, Journal **journal_ptr)
+{
+    assert(writer != NULL);
+    assert(!is_null_or_empty(file_path));
+
+    Journal *journal = malloc(sizeof(Journal));
+
+    if (journal == NULL) {
+        return OUT_OF_MEMORY("Unable to create journal");
+    }
+
+    memset(journal, 0, sizeof(Journal));
+
+    journal->writer = writer;
+    journal->file_stat = *file_stat;
+    journal->fd = -1;
+    journal->file_path = strdup(file_path);
+    journal->journal_path = jn_journal_path(writer->journal_dir, file_path);
+
+    if (journal->file_path == NULL || journal->journal_path == NULL) {
+        jn_free_journal(journal);
+        return OUT_OF_MEMORY("Unable to create journal");
+    }
+
+    pthread_mutex_lock(&writer->lock);
+
+    /* A journal which can't be read is replaced */
+    if (!jn_in_use(writer, journal->journal_path)) {
+        journal->recoverable = jn_open_existing(journal);
+    }
+
+    int added = list_add(writer->journals, journal);
+
+    pthread_mutex_unlock(&writer->lock);
+
+    if (!added) {
+        jn_free_journal(journal);
+        return OUT_OF_MEMORY("Unable to create journal");
+    }
+
+    *journal_ptr = journal;
+
+    return STATUS_SUCCESS;
+}
+
+/* The journal file is removed and the journal is freed by the writer
+ * thread */
+void jn_free(Journal *journal)
+{
+    if (journal == NULL) {
+        return;
+    }
+
+    JournalWriter *writer = journal->writer;
+
+    pthread_mutex_lock(&writer->lock);
+    journal->closed = 1;
+    journal->remove_file = 1;
+    journal->data_len = 0;
+    writer->pending = 1;
+    pthread_cond_signal(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static void jn_free_journal(Journal *journal)
+{
+    free(journal->file_path);
+    free(journal->journal_path);
+    free(journal->data);
+    free(journal->write_data);
+    free(journal);
+}
+
+/* Discard the changes journalled so far. This is used when the buffer
+ * content matches its file again, for example after the buffer is saved.
+ * file_stat is the state of the file subsequent changes are relative to */
+void jn_reset(Journal *journal, const struct stat *file_stat)
+{
+    if (journal == NULL) {
+        return;
+    }
+
+    JournalWriter *writer = journal->writer;
+
+    pthread_mutex_lock(&writer->lock);
+    journal->file_stat = *file_stat;
+    journal->data_len = 0;
+    journal->started = 0;
+    journal->remove_file = 1;
+    journal->recoverable = 0;
+    journal->error = 0;
+    journal->error_reported = 0;
+    writer->pending = 1;
+    pthread_cond_signal(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/* Journal files are named using a hash of the file path followed by the
+ * file name, as the whole path may be longer than a file name can be */
+static char *jn_journal_path(const char *journal_dir, const char *file_path)
+{
+    const char *file_name = strrchr(file_path, '/');
+    file_name = file_name != NULL ? file_name + 1 : file_path;
+
+    uint32_t hash = jn_hash(JN_HASH_BASIS, file_path, strlen(file_path));
+    size_t path_len = strlen(journal_dir) + strlen(file_name) + 16;
+    char *journal_path = malloc(path_len);
+    RETURN_IF_NULL(journal_path);
+
+    snprintf(journal_path, path_len, "%s/%08x-%.64s", journal_dir,
+             (unsigned)hash, file_name);
+
+    return journal_path;
+}
+
+/* Called with the writer's lock held */
+static int jn_in_use(const JournalWriter *writer, const char *journal_path)
+{
+    const Journal *journal;
+
+    for (size_t k = 0; k < list_size(writer->journals); k++) {
+        journal = list_get(writer->journals, k);
+
+        if (strcmp(journal->journal_path, journal_path) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Called with the writer's lock held. Returns true if an existing journal
+ * file can be replayed, in which case it's kept open and locked, so that
+ * no other wed offers to recover it too. A journal file locked by another
+ * wed is still being written, so this journal is marked as failed rather
+ * than replacing it */
+static int jn_open_existing(Journal *journal)
+{
+    int fd = open(journal->journal_path, O_WRONLY | O_APPEND);
+
+    if (fd == -1) {
+        return 0;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        if (errno == EWOULDBLOCK) {
+            journal->error = errno;
+        }
+
+        close(fd);
+        return 0;
+    }
+
+    if (!jn_file_matches(journal->journal_path, journal->file_path,
+                         &journal->file_stat)) {
+        close(fd);
+        return 0;
+    }
+
+    journal->fd = fd;
+
+    return 1;
+}
+
+/* Returns true if the journal file is a journal of file_path in the state
+ * described by file_stat which contains at least one change. Only the
+ * header is read */
+static int jn_file_matches(const char *journal_path, const char *file_path,
+                           const struct stat *file_stat)
+{
+    int fd = open(journal_path, O_RDONLY);
+
+    if (fd == -1) {
+        return 0;
+    }
+
+    size_t header_len = sizeof(JournalHeader) + strlen(file_path);
+    char *header = malloc(header_len);
+    struct stat journal_stat;
+    int matches = 0;
+
+    if (header != NULL && fstat(fd, &journal_stat) == 0 &&
+        (size_t)journal_stat.st_size > header_len &&
+        read(fd, header, header_len) == (ssize_t)header_len) {
+        matches = jn_header_matches(header, header_len, file_path,
+                                    file_stat);
+    }
+
+    free(header);
+    close(fd);
+
+    return matches;
+}
+
+/* Returns true if data starts with the header of a journal of file_path in
+ * the state described by file_stat */
+static int jn_header_matches(const char *data, size_t data_len,
+                             const char *file_path,
+                             const struct stat *file_stat)
+{
+    JournalHeader header;
+
+    if (data_len < sizeof(JournalHeader)) {
+        return 0;
+    }
+
+    memcpy(&header, data, sizeof(JournalHeader));
+
+    return memcmp(header.magic, JN_MAGIC, sizeof(JN_MAGIC)) == 0 &&
+           header.version == JN_VERSION &&
+           header.path_len == strlen(file_path) &&
+           data_len >= sizeof(JournalHeader) + header.path_len &&
+           memcmp(data + sizeof(JournalHeader), file_path,
+                  header.path_len) == 0 &&
+           header.file_size == (uint64_t)file_stat->st_size &&
+           header.mtime == (int64_t)file_stat->st_mtime;
+}
+
+/* Called with the writer's lock held. Ensure length more bytes can be
+ * added to the journal's data */
+static int jn_reserve(Journal *journal, size_t length)
+{
+    size_t required = journal->data_len + length;
+
+    if (required <= journal->data_alloc) {
+        return 1;
+    }
+
+    size_t data_alloc = MAX(MAX(journal->data_alloc * 2, JN_DATA_INIT),
+                            required);
+    char *data = realloc(journal->data, data_alloc);
+
+    if (data == NULL) {
+        return 0;
+    }
+
+    journal->data = data;
+    journal->data_alloc = data_alloc;
+
+    return 1;
+}
+
+void jn_add_insert(Journal *journal, size_t offset, const char *str,
+                   size_t str_len)
+{
+    if (journal == NULL || str_len == 0) {
+        return;
+    }
+
+    JournalRecord record = {
+        .change_type = TCT_INSERT,
+        .offset = offset,
+        .length = str_len
+    };
+
+    record.check = jn_record_check(&record, str);
+    jn_add(journal, &record, str);
+}
+
+void jn_add_delete(Journal *journal, size_t offset, size_t length)
+{
+    if (journal == NULL || length == 0) {
+        return;
+    }
+
+    JournalRecord record = {
+        .change_type = TCT_DELETE,
+        .offset = offset,
+        .length = length
+    };
+
+    record.check = jn_record_check(&record, NULL);
+    jn_add(journal, &record, NULL);
+}
+
+/* Copy a record to the journal's data for the writer thread to write.
+ * When memory can't be allocated no further changes are journalled, so
+ * the journal file still contains a consistent sequence of changes */
+static void jn_add(Journal *journal, const JournalRecord *record,
+                   const char *str)
+{
+    JournalWriter *writer = journal->writer;
+    size_t str_len = str != NULL ? record->length : 0;
+
+    pthread_mutex_lock(&writer->lock);
+
+    if (journal->error != 0) {
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    if (!journal->started) {
+        size_t path_len = strlen(journal->file_path);
+        JournalHeader header;
+        memset(&header, 0, sizeof(JournalHeader));
+        memcpy(header.magic, JN_MAGIC, sizeof(JN_MAGIC));
+        header.version = JN_VERSION;
+        header.path_len = path_len;
+        header.file_size = journal->file_stat.st_size;
+        header.mtime = journal->file_stat.st_mtime;
+
+        if (!jn_reserve(journal, sizeof(JournalHeader) + path_len)) {
+            journal->error = ENOMEM;
+            pthread_mutex_unlock(&writer->lock);
+            return;
+        }
+
+        memcpy(journal->data + journal->data_len, &header,
+               sizeof(JournalHeader));
+        journal->data_len += sizeof(JournalHeader);
+        memcpy(journal->data + journal->data_len, journal->file_path,
+               path_len);
+        journal->data_len += path_len;
+        journal->started = 1;
+    }
+
+    if (!jn_reserve(journal, sizeof(JournalRecord) + str_len)) {
+        journal->error = ENOMEM;
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    memcpy(journal->data + journal->data_len, record, sizeof(JournalRecord));
+    journal->data_len += sizeof(JournalRecord);
+
+    if (str_len > 0) {
+        memcpy(journal->data + journal->data_len, str, str_len);
+        journal->data_len += str_len;
+    }
+
+    if (!writer->pending) {
+        writer->pending = 1;
+        pthread_cond_signal(&writer->changed);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static uint32_t jn_hash(uint32_t hash, const void *data, size_t data_len)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t k = 0; k < data_len; k++) {
+        hash ^= bytes[k];
+        hash *= JN_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+static uint32_t jn_record_check(const JournalRecord *record, const char *str)
+{
+    uint32_t hash = JN_HASH_BASIS;
+    hash = jn_hash(hash, &record->change_type, sizeof(record->change_type));
+    hash = jn_hash(hash, &record->offset, sizeof(record->offset));
+    hash = jn_hash(hash, &record->length, sizeof(record->length));
+
+    if (str != NULL) {
+        hash = jn_hash(hash, str, record->length);
+    }
+
+    return hash;
+}
+
+int jn_recoverable(const Journal *journal)
+{
+    return journal != NULL && journal->recoverable;
+}
+
+/* Read the changes recorded in the existing journal file so that they can
+ * be replayed. The journal should then be reset before the changes are
+ * made to the buffer */
+Status jn_read(Journal *journal, JournalReader *reader)
+{
+    assert(jn_recoverable(journal));
+
+    memset(reader, 0, sizeof(JournalReader));
+
+    RETURN_IF_FAIL(jn_read_file(journal->journal_path, &reader->data,
+                                &reader->data_len));
+
+    if (!jn_header_matches(reader->data, reader->data_len,
+                           journal->file_path, &journal->file_stat)) {
+        jn_free_reader(reader);
+        return st_get_error(ERR_INVALID_JOURNAL,
+                            "Invalid recovery journal for %s",
+                            journal->file_path);
+    }
+
+    reader->offset = sizeof(JournalHeader) + strlen(journal->file_path);
+
+    return STATUS_SUCCESS;
+}
+
+/* The existing journal file is removed and replaced by a journal of the
+ * changes made from now on */
+void jn_decline_recovery(Journal *journal)
+{
+    if (!jn_recoverable(journal)) {
+        return;
+    }
+
+    JournalWriter *writer = journal->writer;
+
+    pthread_mutex_lock(&writer->lock);
+    journal->recoverable = 0;
+    journal->remove_file = 1;
+    writer->pending = 1;
+    pthread_cond_signal(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/* Each failure to journal changes is only reported once */
+Status jn_get_error(Journal *journal)
+{
+    if (journal == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    JournalWriter *writer = journal->writer;
+    int error = 0;
+
+    pthread_mutex_lock(&writer->lock);
+
+    if (journal->error != 0 && !journal->error_reported) {
+        journal->error_reported = 1;
+        error = journal->error;
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+
+    if (error == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    if (error == EWOULDBLOCK) {
+        return st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE,
+                            "Unable to journal changes to %s as another "
+                            "wed is journalling it", journal->file_path);
+    }
+
+    return st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE,
+                        "Unable to journal changes to %s - %s",
+                        journal->file_path, strerror(error));
+}
+
+/* Returns false once all changes have been read. A record which was only
+ * partially written before wed exited is treated as the end of the
+ * journal */
+int jn_next_change(JournalReader *reader, JournalChange *change)
+{
+    JournalRecord record;
+
+    if (reader->data_len - reader->offset < sizeof(JournalRecord)) {
+        return 0;
+    }
+
+    memcpy(&record, reader->data + reader->offset, sizeof(JournalRecord));
+
+    const char *str = reader->data + reader->offset + sizeof(JournalRecord);
+    size_t remaining = reader->data_len - reader->offset -
+                       sizeof(JournalRecord);
+
+    if (record.change_type == TCT_INSERT) {
+        if (record.length > remaining ||
+            record.check != jn_record_check(&record, str)) {
+            return 0;
+        }
+    } else if (record.change_type == TCT_DELETE) {
+        if (record.check != jn_record_check(&record, NULL)) {
+            return 0;
+        }
+
+        str = NULL;
+    } else {
+        return 0;
+    }
+
+    change->change_type = record.change_type;
+    change->offset = record.offset;
+    change->length = record.length;
+    change->str = str;
+
+    reader->offset += sizeof(JournalRecord);
+
+    if (str != NULL) {
+        reader->offset += record.length;
+    }
+
+    return 1;
+}
+
+void jn_free_reader(JournalReader *reader)
+{
+    free(reader->data);
+    memset(reader, 0, sizeof(JournalReader));
+}
+
+static Status jn_read_file(const char *file_path, char **data_ptr,
+                           size_t *data_len_ptr)
+{
+    int fd = open(file_path, O_RDONLY);
+
+    if (fd == -1) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_FILE,
+                            "Unable to open journal %s - %s",
+                            file_path, strerror(errno));
+    }
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) == -1) {
+        close(fd);
+        return st_get_error(ERR_UNABLE_TO_READ_FILE,
+                            "Unable to read journal %s - %s",
+                            file_path, strerror(errno));
+    }
+
+    size_t data_len = file_stat.st_size;
+    char *data = malloc(MAX(data_len, 1));
+
+    if (data == NULL) {
+        close(fd);
+        return OUT_OF_MEMORY("Unable to read journal");
+    }
+
+    size_t total = 0;
+    ssize_t bytes_read;
+
+    while (total < data_len) {
+        bytes_read = read(fd, data + total, data_len - total);
+
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read <= 0) {
+            break;
+        }
+
+        total += bytes_read;
+    }
+
+    close(fd);
+
+    *data_ptr = data;
+    *data_len_ptr = total;
+
+    return STATUS_SUCCESS;
+}
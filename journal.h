@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_JOURNAL_H
+#define WED_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "status.h"
+#include "list.h"
+#include "undo.h"
+
+/* A journal records the text changes made to a buffer since its file was
+ * last read or written, so that unsaved changes can be recovered when wed
+ * exits without saving them, for example when it's killed. Each change is
+ * appended to the journal in memory, which only takes a copy of the text
+ * inserted, and a single writer thread appends the changes to the journal
+ * file and syncs it every JN_SYNC_INTERVAL_MS milliseconds. Journal files
+ * are stored in ~/.wed/journal and removed once their buffer is saved or
+ * closed. Journal files are locked using flock whilst they're open, so
+ * that the journal of a wed which is still running isn't mistaken for one
+ * left by a wed which exited without saving. A journal file consists of a
+ * header identifying the file and the state it was in when journalling
+ * began, followed by insert and delete records. Replaying the records
+ * against the file in the same state restores the buffer content */
+
+#define JN_MAGIC "WEDJRNL"
+#define JN_VERSION 1
+/* Maximum time changes wait before they're written and synced */
+#define JN_SYNC_INTERVAL_MS 500
+
+typedef struct {
+    char magic[8]; /* JN_MAGIC */
+    uint32_t version; /* JN_VERSION */
+    uint32_t path_len; /* Length of the file path following the header */
+    uint64_t file_size; /* Size of the file when journalling began */
+    int64_t mtime; /* Modification time of the file */
+} JournalHeader;
+
+typedef struct {
+    uint32_t change_type; /* TCT_INSERT or TCT_DELETE */
+    uint32_t check; /* Checksum of the record and inserted text, so that
+                       a partially written record is ignored */
+    uint64_t offset; /* Offset of change in buffer */
+    uint64_t length; /* Length of text inserted or deleted. Inserted text
+                        follows the record */
+} JournalRecord;
+
+typedef struct JournalWriter JournalWriter;
+
+/* The journal of a buffer. Changes are added by the main thread and
+ * written by the writer thread. Fields other than those set on creation
+ * are guarded by the writer's lock */
+typedef struct {
+    JournalWriter *writer; /* Writer this journal belongs to */
+    char *file_path; /* Absolute path of the file journalled */
+    char *journal_path; /* Path of the journal file */
+    struct stat file_stat; /* File state changes are relative to */
+    char *data; /* Header and records not yet written */
+    size_t data_len; /* Length of data */
+    size_t data_alloc; /* Size of data allocated */
+    char *write_data; /* Data being written by the writer thread */
+    size_t write_alloc; /* Size of write_data allocated */
+    int fd; /* Locked journal file descriptor or -1 if not open. Only
+               used by the writer thread once the journal is created */
+    int started; /* True once the header has been added */
+    int remove_file; /* True if the journal file is to be removed before
+                        any more data is written */
+    int recoverable; /* True if an existing journal file could be
+                        replayed. Nothing is written until recovery has
+                        been accepted or declined */
+    int closed; /* True once the buffer no longer uses the journal. The
+                   writer thread frees it */
+    int error; /* errno of the last failure or 0 */
+    int error_reported; /* True once error has been reported */
+} Journal;
+
+struct JournalWriter {
+    char *journal_dir; /* Directory journal files are stored in */
+    List *journals; /* Journals with the most recently created last */
+    pthread_t thread; /* Thread writing journal files */
+    pthread_mutex_t lock; /* Guards the journals and their data */
+    pthread_cond_t changed; /* Signalled when there is work to do */
+    pthread_cond_t synced; /* Signalled when a sync has completed */
+    int pending; /* True if there is data to write */
+    size_t sync_requests; /* Number of syncs requested */
+    size_t syncs_completed; /* Number of syncs completed */
+    int stop; /* True once the writer thread should finish */
+};
+
+/* A change read from a journal file */
+typedef struct {
+    TextChangeType change_type; /* Insert or delete */
+    size_t offset; /* Offset of change */
+    size_t length; /* Length of text inserted or deleted */
+    const char *str; /* Text inserted */
+} JournalChange;
+
+/* Reads the changes recorded in a journal file */
+typedef struct {
+    char *data; /* Journal file content */
+    size_t data_len; /* Length of data */
+    size_t offset; /* Offset of the next record */
+} JournalReader;
+
+JournalWriter *jn_new_writer(const char *journal_dir);
+void jn_free_writer(JournalWriter *);
+void jn_sync(JournalWriter *);
+Status jn_new(JournalWriter *, const char *file_path,
+              const struct stat *file_stat, Journal **journal_ptr);
+void jn_free(Journal *);
+void jn_reset(Journal *, const struct stat *file_stat);
+void jn_add_insert(Journal *, size_t offset, const char *str,
+                   size_t str_len);
+void jn_add_delete(Journal *, size_t offset, size_t length);
+int jn_recoverable(const Journal *);
+Status jn_read(Journal *, JournalReader *);
+void jn_decline_recovery(Journal *);
+Status jn_get_error(Journal *);
+int jn_next_change(JournalReader *, JournalChange *);
+void jn_free_reader(JournalReader *);
+
+#endif
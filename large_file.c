@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "large_file.h"
+#include "util.h"
+
+#define LF_COPY_BUF_SIZE 65536
+
+static Status lf_open(LargeFile *, const char *file_path);
+static Status lf_pread(const LargeFile *, char *buf, size_t len,
+                       off_t offset);
+static Status lf_read_chunk_range(const LargeFile *, size_t chunk_index,
+                                  size_t offset, size_t len, char *buf);
+static Status lf_write_all(int output_fd, const char *buf, size_t len);
+static Status lf_copy_file_range(const LargeFile *, int output_fd,
+                                 off_t offset, size_t len);
+static size_t lf_count_lines(const char *text, size_t len);
+static void lf_update_start_lines(LargeFile *, size_t chunk_index);
+
+Status lf_init(LargeFile *lf, const char *file_path, size_t chunk_size)
+{
+    assert(chunk_size > 0);
+
+    memset(lf, 0, sizeof(LargeFile));
+    lf->fd = -1;
+    lf->chunk_size = chunk_size;
+
+    return lf_open(lf, file_path);
+}
+
+static Status lf_open(LargeFile *lf, const char *file_path)
+{
+    int fd = open(file_path, O_RDONLY);
+
+    if (fd == -1) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_FILE,
+                            "Unable to open file %s for reading - %s",
+                            file_path, strerror(errno));
+    }
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) == -1) {
+        Status status = st_get_error(ERR_UNABLE_TO_READ_FILE,
+                                     "Unable to stat file %s - %s",
+                                     file_path, strerror(errno));
+        close(fd);
+        return status;
+    }
+
+    if (lf->fd != -1) {
+        close(lf->fd);
+    }
+
+    lf->fd = fd;
+    lf->file_size = file_stat.st_size;
+
+    return STATUS_SUCCESS;
+}
+
+void lf_free(LargeFile *lf)
+{
+    if (lf == NULL) {
+        return;
+    }
+
+    for (size_t k = 0; k < lf->chunk_num; k++) {
+        free(lf->chunks[k].text);
+    }
+
+    free(lf->chunks);
+
+    if (lf->fd != -1) {
+        close(lf->fd);
+    }
+
+    lf->chunks = NULL;
+    lf->chunk_num = lf->chunk_alloc = 0;
+    lf->fd = -1;
+}
+
+int lf_index_complete(const LargeFile *lf)
+{
+    return lf->index_offset >= lf->file_size;
+}
+
+/* Add the next chunk to the index. Reading a chunk at a time allows the
+ * index to be built in the background between keypresses */
+Status lf_index_next_chunk(LargeFile *lf)
+{
+    if (lf_index_complete(lf)) {
+        return STATUS_SUCCESS;
+    }
+
+    if (lf->chunk_num == lf->chunk_alloc) {
+        size_t chunk_alloc = lf->chunk_alloc == 0 ? 16 : lf->chunk_alloc * 2;
+        LargeFileChunk *chunks = realloc(lf->chunks,
+                                         chunk_alloc * sizeof(LargeFileChunk));
+
+        if (chunks == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate large file index");
+        }
+
+        lf->chunks = chunks;
+        lf->chunk_alloc = chunk_alloc;
+    }
+
+    size_t read_len = MIN(lf->chunk_size,
+                          (size_t)(lf->file_size - lf->index_offset));
+    char *buf = malloc(read_len);
+
+    if (buf == NULL) {
+        return OUT_OF_MEMORY("Unable to allocate chunk");
+    }
+
+    Status status = lf_pread(lf, buf, read_len, lf->index_offset);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        free(buf);
+        return status;
+    }
+
+    size_t length = read_len;
+
+    /* Unless this is the last chunk end it after the last new line it
+     * contains, so that each chunk starts on a new line */
+    if (lf->index_offset + (off_t)read_len < lf->file_size) {
+        while (length > 0 && buf[length - 1] != '\n') {
+            length--;
+        }
+
+        if (length == 0) {
+            length = read_len;
+        }
+    }
+
+    LargeFileChunk *chunk = &lf->chunks[lf->chunk_num];
+    memset(chunk, 0, sizeof(LargeFileChunk));
+    chunk->offset = lf->index_offset;
+    chunk->length = length;
+    chunk->lines = lf_count_lines(buf, length);
+
+    if (lf->chunk_num > 0) {
+        const LargeFileChunk *prev = &lf->chunks[lf->chunk_num - 1];
+        chunk->start_line = prev->start_line + prev->lines;
+    }
+
+    free(buf);
+
+    lf->chunk_num++;
+    lf->index_offset += length;
+
+    return STATUS_SUCCESS;
+}
+
+Status lf_index_to_chunk(LargeFile *lf, size_t chunk_index)
+{
+    while (lf->chunk_num <= chunk_index && !lf_index_complete(lf)) {
+        RETURN_IF_FAIL(lf_index_next_chunk(lf));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Find the chunk in which line line_no starts, indexing the file as far
+ * as necessary. Line numbers beyond the end of the file map to the last
+ * chunk */
+Status lf_index_to_line(LargeFile *lf, size_t line_no, size_t *chunk_index)
+{
+    assert(line_no > 0);
+
+    /* Line line_no starts after the new line which ends the line before */
+    size_t new_line = line_no - 1;
+
+    while (lf_lines_indexed(lf) < new_line && !lf_index_complete(lf)) {
+        RETURN_IF_FAIL(lf_index_next_chunk(lf));
+    }
+
+    *chunk_index = 0;
+
+    if (lf->chunk_num == 0 || new_line == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    /* Binary search for the chunk containing the new line */
+    size_t low = 0;
+    size_t high = lf->chunk_num - 1;
+    size_t mid;
+    const LargeFileChunk *chunk;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        chunk = &lf->chunks[mid];
+
+        if (chunk->start_line + chunk->lines >= new_line) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    chunk = &lf->chunks[low];
+
+    /* Chunks end after their last new line so when it's the new line
+     * being looked for the line starts in the next chunk */
+    if (chunk->start_line + chunk->lines == new_line) {
+        RETURN_IF_FAIL(lf_index_to_chunk(lf, low + 1));
+
+        if (low + 1 < lf->chunk_num) {
+            low++;
+        }
+    }
+
+    *chunk_index = low;
+
+    return STATUS_SUCCESS;
+}
+
+size_t lf_chunk_length(const LargeFile *lf, size_t chunk_index)
+{
+    assert(chunk_index < lf->chunk_num);
+
+    const LargeFileChunk *chunk = &lf->chunks[chunk_index];
+    return chunk->text != NULL ? chunk->text_len : chunk->length;
+}
+
+/* The number of new lines indexed so far */
+size_t lf_lines_indexed(const LargeFile *lf)
+{
+    if (lf->chunk_num == 0) {
+        return 0;
+    }
+
+    const LargeFileChunk *chunk = &lf->chunks[lf->chunk_num - 1];
+    return chunk->start_line + chunk->lines;
+}
+
+/* Copy the content of a chunk into buf which must have space for
+ * lf_chunk_length bytes */
+Status lf_read_chunk(const LargeFile *lf, size_t chunk_index, char *buf)
+{
+    return lf_read_chunk_range(lf, chunk_index, 0,
+                               lf_chunk_length(lf, chunk_index), buf);
+}
+
+static Status lf_read_chunk_range(const LargeFile *lf, size_t chunk_index,
+                                  size_t offset, size_t len, char *buf)
+{
+    const LargeFileChunk *chunk = &lf->chunks[chunk_index];
+
+    assert(offset + len <= lf_chunk_length(lf, chunk_index));
+
+    if (chunk->text != NULL) {
+        memcpy(buf, chunk->text + offset, len);
+        return STATUS_SUCCESS;
+    }
+
+    return lf_pread(lf, buf, len, chunk->offset + offset);
+}
+
+static Status lf_pread(const LargeFile *lf, char *buf, size_t len,
+                       off_t offset)
+{
+    ssize_t bytes_read;
+
+    while (len > 0) {
+        bytes_read = pread(lf->fd, buf, len, offset);
+
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read == -1) {
+            return st_get_error(ERR_UNABLE_TO_READ_FILE,
+                                "Unable to read from file - %s",
+                                strerror(errno));
+        } else if (bytes_read == 0) {
+            return st_get_error(ERR_UNABLE_TO_READ_FILE,
+                                "Unable to read from file - "
+                                "file has been truncated");
+        }
+
+        buf += bytes_read;
+        offset += bytes_read;
+        len -= bytes_read;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Replace the content of a chunk with edited text. The large file takes
+ * ownership of text */
+void lf_set_chunk_text(LargeFile *lf, size_t chunk_index, char *text,
+                       size_t text_len)
+{
+    assert(chunk_index < lf->chunk_num);
+
+    LargeFileChunk *chunk = &lf->chunks[chunk_index];
+
+    free(chunk->text);
+    chunk->text = text;
+    chunk->text_len = text_len;
+    chunk->lines = lf_count_lines(text, text_len);
+    lf->modified = 1;
+
+    lf_update_start_lines(lf, chunk_index + 1);
+}
+
+static size_t lf_count_lines(const char *text, size_t len)
+{
+    size_t lines = 0;
+    const char *end = text + len;
+
+    while (text < end && (text = memchr(text, '\n', end - text)) != NULL) {
+        lines++;
+        text++;
+    }
+
+    return lines;
+}
+
+static void lf_update_start_lines(LargeFile *lf, size_t chunk_index)
+{
+    for (size_t k = MAX(chunk_index, 1); k < lf->chunk_num; k++) {
+        lf->chunks[k].start_line = lf->chunks[k - 1].start_line +
+                                   lf->chunks[k - 1].lines;
+    }
+}
+
+/* Search forwards for the first match which starts in the chunks
+ * [start_chunk, end_chunk). Each chunk is searched along with the start of
+ * the following chunk so matches which cross a chunk boundary are found,
+ * provided they're no longer than LF_SEARCH_OVERLAP bytes */
+Status lf_find_next(LargeFile *lf, BufferSearch *search, size_t start_chunk,
+                    size_t end_chunk, size_t *chunk_index,
+                    size_t *match_offset, int *found_match)
+{
+    *found_match = 0;
+
+    char *buf = NULL;
+    size_t buf_alloc = 0;
+    size_t chunk_len, overlap, match_point;
+    Status status = STATUS_SUCCESS;
+
+    for (size_t k = start_chunk; k < end_chunk && !*found_match; k++) {
+        status = lf_index_to_chunk(lf, k + 1);
+
+        if (!STATUS_IS_SUCCESS(status) || k >= lf->chunk_num) {
+            break;
+        }
+
+        chunk_len = lf_chunk_length(lf, k);
+        overlap = 0;
+
+        if (k + 1 < lf->chunk_num) {
+            overlap = MIN(LF_SEARCH_OVERLAP, lf_chunk_length(lf, k + 1));
+        }
+
+        if (chunk_len + overlap > buf_alloc) {
+            char *new_buf = realloc(buf, chunk_len + overlap);
+
+            if (new_buf == NULL) {
+                status = OUT_OF_MEMORY("Unable to allocate search buffer");
+                break;
+            }
+
+            buf = new_buf;
+            buf_alloc = chunk_len + overlap;
+        }
+
+        status = lf_read_chunk(lf, k, buf);
+
+        if (STATUS_IS_SUCCESS(status) && overlap > 0) {
+            status = lf_read_chunk_range(lf, k + 1, 0, overlap,
+                                         buf + chunk_len);
+        }
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        if (search->search_type == BST_TEXT) {
+            *found_match = ts_find_next_in_text(&search->type.text, buf, 0,
+                                                chunk_len + overlap,
+                                                &match_point) &&
+                           match_point < chunk_len;
+        } else {
+            status = rs_find_next_in_range(&search->type.regex, buf,
+                                           chunk_len + overlap, 0, chunk_len,
+                                           1, &match_point, found_match);
+
+            if (!STATUS_IS_SUCCESS(status)) {
+                break;
+            }
+        }
+
+        if (*found_match) {
+            *chunk_index = k;
+            *match_offset = match_point;
+        }
+    }
+
+    free(buf);
+
+    return status;
+}
+
+/* Write the content of the file, including any edits, to output_fd.
+ * Text is streamed a chunk at a time */
+Status lf_write(const LargeFile *lf, int output_fd)
+{
+    const LargeFileChunk *chunk;
+
+    for (size_t k = 0; k < lf->chunk_num; k++) {
+        chunk = &lf->chunks[k];
+
+        if (chunk->text != NULL) {
+            RETURN_IF_FAIL(lf_write_all(output_fd, chunk->text,
+                                        chunk->text_len));
+        } else {
+            RETURN_IF_FAIL(lf_copy_file_range(lf, output_fd, chunk->offset,
+                                              chunk->length));
+        }
+    }
+
+    /* The part of the file which hasn't been indexed yet */
+    return lf_copy_file_range(lf, output_fd, lf->index_offset,
+                              lf->file_size - lf->index_offset);
+}
+
+static Status lf_copy_file_range(const LargeFile *lf, int output_fd,
+                                 off_t offset, size_t len)
+{
+    char buf[LF_COPY_BUF_SIZE];
+    size_t copy_len;
+
+    while (len > 0) {
+        copy_len = MIN(len, LF_COPY_BUF_SIZE);
+        RETURN_IF_FAIL(lf_pread(lf, buf, copy_len, offset));
+        RETURN_IF_FAIL(lf_write_all(output_fd, buf, copy_len));
+        offset += copy_len;
+        len -= copy_len;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status lf_write_all(int output_fd, const char *buf, size_t len)
+{
+    ssize_t written;
+
+    while (len > 0) {
+        written = write(output_fd, buf, len);
+
+        if (written == -1 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            return st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE,
+                                "Unable to write to temporary file - %s",
+                                strerror(errno));
+        }
+
+        buf += written;
+        len -= written;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Called once the content written by lf_write has replaced the file at
+ * file_path. Edits are now part of the file so chunks read from it again */
+Status lf_saved(LargeFile *lf, const char *file_path)
+{
+    RETURN_IF_FAIL(lf_open(lf, file_path));
+
+    off_t offset = 0;
+    LargeFileChunk *chunk;
+
+    for (size_t k = 0; k < lf->chunk_num; k++) {
+        chunk = &lf->chunks[k];
+
+        if (chunk->text != NULL) {
+            chunk->length = chunk->text_len;
+            free(chunk->text);
+            chunk->text = NULL;
+            chunk->text_len = 0;
+        }
+
+        chunk->offset = offset;
+        offset += chunk->length;
+    }
+
+    lf->index_offset = offset;
+    lf->modified = 0;
+
+    return STATUS_SUCCESS;
+}
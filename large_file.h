@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_LARGE_FILE_H
+#define WED_LARGE_FILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "status.h"
+#include "buffer_pos.h"
+#include "undo.h"
+#include "search.h"
+
+/* Default size of the chunks a large file is divided into. Only a few
+ * chunks are held in memory at a time */
+#define LF_CHUNK_SIZE (4 * 1024 * 1024)
+/* Number of consecutive chunks loaded into the buffer. The cursor is kept
+ * in the middle chunk so that the text either side of it is available */
+#define LF_WINDOW_CHUNKS 3
+/* Bytes of the following chunk searched along with each chunk, so that
+ * matches which straddle a chunk boundary can be found */
+#define LF_SEARCH_OVERLAP 4096
+
+/* A contiguous part of a large file. Chunks end at a line boundary unless
+ * a line is longer than the chunk size */
+typedef struct {
+    off_t offset; /* Offset of chunk in file */
+    size_t length; /* Bytes of file covered by chunk */
+    size_t start_line; /* Lines preceding chunk */
+    size_t lines; /* New lines in chunk content */
+    char *text; /* Edited content which replaces the file bytes, or NULL
+                   if the chunk is unmodified */
+    size_t text_len; /* Length of edited content */
+} LargeFileChunk;
+
+/* A file too large to be loaded into memory. The file is indexed a chunk
+ * at a time, which produces a sparse line index, and a window of chunks
+ * is loaded into the buffer. Edits made to the window are kept in memory
+ * when the window moves and written out when the file is saved */
+typedef struct {
+    int fd; /* File descriptor used to read chunks */
+    off_t file_size; /* Size of the file when opened or last saved */
+    size_t chunk_size; /* Maximum bytes read per chunk */
+    LargeFileChunk *chunks; /* Chunks indexed so far */
+    size_t chunk_num; /* Number of chunks indexed */
+    size_t chunk_alloc; /* Number of chunks allocated */
+    off_t index_offset; /* Offset the next chunk is indexed from */
+    int modified; /* Chunk content has been edited */
+    size_t window_start; /* First chunk loaded into the buffer */
+    size_t window_chunks; /* Number of chunks loaded into the buffer */
+    BufferPos boundaries[LF_WINDOW_CHUNKS - 1]; /* Start of each loaded
+                                                   chunk after the first.
+                                                   These are buffer marks */
+    BufferChangeState window_state; /* Buffer state when window loaded */
+    int window_modified[LF_WINDOW_CHUNKS]; /* Loaded chunks edited since
+                                             the window was stored */
+} LargeFile;
+
+Status lf_init(LargeFile *, const char *file_path, size_t chunk_size);
+void lf_free(LargeFile *);
+int lf_index_complete(const LargeFile *);
+Status lf_index_next_chunk(LargeFile *);
+Status lf_index_to_chunk(LargeFile *, size_t chunk_index);
+Status lf_index_to_line(LargeFile *, size_t line_no, size_t *chunk_index);
+size_t lf_chunk_length(const LargeFile *, size_t chunk_index);
+size_t lf_lines_indexed(const LargeFile *);
+Status lf_read_chunk(const LargeFile *, size_t chunk_index, char *buf);
+void lf_set_chunk_text(LargeFile *, size_t chunk_index, char *text,
+                       size_t text_len);
+Status lf_find_next(LargeFile *, BufferSearch *, size_t start_chunk,
+                    size_t end_chunk, size_t *chunk_index,
+                    size_t *match_offset, int *found_match);
+Status lf_write(const LargeFile *, int output_fd);
+Status lf_saved(LargeFile *, const char *file_path);
+
+#endif
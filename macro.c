@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "macro.h"
+
+#define MACRO_STEPS_INIT 16
+
+static Status mc_add_step(Macro *, MacroStepType, Operation,
+                          const char *text, size_t text_len);
+
+void mc_init(Macro *macro)
+{
+    memset(macro, 0, sizeof(Macro));
+}
+
+/* Frees all steps leaving macro empty */
+void mc_free(Macro *macro)
+{
+    if (macro == NULL) {
+        return;
+    }
+
+    for (size_t k = 0; k < macro->step_num; k++) {
+        free(macro->steps[k].text);
+    }
+
+    free(macro->steps);
+    mc_init(macro);
+}
+
+Status mc_add_operation(Macro *macro, Operation op, const char *key)
+{
+    assert(key != NULL);
+    return mc_add_step(macro, MST_OPERATION, op, key, strlen(key));
+}
+
+Status mc_add_key(Macro *macro, const char *key)
+{
+    assert(key != NULL);
+    return mc_add_step(macro, MST_INSERT_KEY, OP_NOP, key, strlen(key));
+}
+
+/* Text typed straight after other text is appended to the same step */
+Status mc_add_text(Macro *macro, const char *text, size_t text_len)
+{
+    assert(text != NULL);
+
+    if (text_len == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    MacroStep *last = macro->step_num > 0 ?
+                      &macro->steps[macro->step_num - 1] : NULL;
+
+    if (last == NULL || last->type != MST_INSERT_TEXT) {
+        return mc_add_step(macro, MST_INSERT_TEXT, OP_NOP, text, text_len);
+    }
+
+    char *new_text = realloc(last->text, last->text_len + text_len + 1);
+
+    if (new_text == NULL) {
+        return OUT_OF_MEMORY("Unable to record macro");
+    }
+
+    memcpy(new_text + last->text_len, text, text_len);
+    last->text = new_text;
+    last->text_len += text_len;
+    last->text[last->text_len] = '\0';
+
+    return STATUS_SUCCESS;
+}
+
+static Status mc_add_step(Macro *macro, MacroStepType type, Operation op,
+                          const char *text, size_t text_len)
+{
+    if (macro->step_num == macro->step_alloc) {
+        size_t new_alloc = macro->step_alloc == 0 ? MACRO_STEPS_INIT
+                                                  : macro->step_alloc * 2;
+        MacroStep *steps = realloc(macro->steps,
+                                   new_alloc * sizeof(MacroStep));
+
+        if (steps == NULL) {
+            return OUT_OF_MEMORY("Unable to record macro");
+        }
+
+        macro->steps = steps;
+        macro->step_alloc = new_alloc;
+    }
+
+    MacroStep *step = &macro->steps[macro->step_num];
+    step->text = malloc(text_len + 1);
+
+    if (step->text == NULL) {
+        return OUT_OF_MEMORY("Unable to record macro");
+    }
+
+    memcpy(step->text, text, text_len);
+    step->text[text_len] = '\0';
+    step->text_len = text_len;
+    step->type = type;
+    step->op = op;
+    macro->step_num++;
+
+    return STATUS_SUCCESS;
+}
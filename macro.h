@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_MACRO_H
+#define WED_MACRO_H
+
+#include <stddef.h>
+#include "status.h"
+#include "command.h"
+
+/* A keyboard macro is recorded as the operations the keys pressed invoked
+ * rather than as the keys themselves. Each key is resolved once, when it's
+ * recorded, so playing a macro runs its operations directly without the
+ * keys being parsed or looked up in the key map again. Printable
+ * characters typed one after another are stored as a single step and
+ * inserted in one go */
+
+typedef enum {
+    MST_OPERATION, /* Run an operation */
+    MST_INSERT_KEY, /* Insert a key that isn't bound to an operation */
+    MST_INSERT_TEXT /* Insert text that was typed or pasted */
+} MacroStepType;
+
+typedef struct {
+    MacroStepType type;
+    Operation op; /* The operation run by an MST_OPERATION step */
+    char *text; /* The key pressed or the text inserted */
+    size_t text_len; /* Length of text */
+} MacroStep;
+
+typedef struct {
+    MacroStep *steps; /* Steps in the order they're run */
+    size_t step_num; /* Number of steps recorded */
+    size_t step_alloc; /* Number of steps memory is allocated for */
+} Macro;
+
+/* Where a macro is played */
+typedef enum {
+    MT_CURSOR, /* Once at the cursor */
+    MT_LINES, /* At the start of each selected line, or each line
+                 when there is no selection */
+    MT_MATCHES /* At the start of each match of the last search */
+} MacroTarget;
+
+void mc_init(Macro *);
+void mc_free(Macro *);
+Status mc_add_operation(Macro *, Operation, const char *key);
+Status mc_add_key(Macro *, const char *key);
+Status mc_add_text(Macro *, const char *text, size_t text_len);
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "memory_info.h"
+#include "session.h"
+#include "buffer.h"
+#include "util.h"
+#include "build_config.h"
+
+#define MI_SIZE_STR_LEN 32
+#define MI_LINE_LEN 256
+
+static size_t mi_history_memory_usage(const List *);
+static size_t mi_filetype_regex_memory_usage(const HashMap *);
+static size_t mi_syntax_regex_memory_usage(const SyntaxManager *);
+static size_t mi_session_buffers_memory_total(const Session *);
+static Status mi_insert_line(Buffer *, const char *label, size_t bytes,
+                             const char *detail);
+static Status mi_bf_insert(Buffer *, const char *str);
+
+void mi_buffer_memory_info(const Buffer *buffer, BufferMemoryInfo *info)
+{
+    memset(info, 0, sizeof(BufferMemoryInfo));
+
+    info->text_used = gb_length(buffer->data);
+    info->text_allocated = gb_allocated(buffer->data);
+    info->gap_size = gb_gap_size(buffer->data);
+    info->undo = bc_memory_usage(&buffer->changes);
+    info->search_matches = bs_matches_memory_usage(&buffer->search);
+    info->marks = hashmap_memory_usage(buffer->marks) +
+                  hashmap_size(buffer->marks) * (sizeof(Mark) +
+                                                 sizeof(BufferPos));
+
+    if (buffer->bv != NULL) {
+        info->syntax_match_cache =
+            bv_syntax_match_cache_memory_usage(buffer->bv);
+        info->view = bv_memory_usage(buffer->bv);
+    }
+}
+
+size_t mi_buffer_memory_total(const BufferMemoryInfo *info)
+{
+    return info->text_allocated + info->undo + info->syntax_match_cache +
+           info->search_matches + info->view + info->marks;
+}
+
+void mi_session_memory_info(const Session *sess, SessionMemoryInfo *info)
+{
+    memset(info, 0, sizeof(SessionMemoryInfo));
+
+    const List *histories[] = {
+        sess->search_history, sess->replace_history, sess->command_history,
+        sess->lineno_history, sess->buffer_history
+    };
+
+    for (size_t k = 0; k < ARRAY_SIZE(histories, const List *); k++) {
+        info->history += mi_history_memory_usage(histories[k]);
+    }
+
+    info->regexes = mi_filetype_regex_memory_usage(sess->filetypes) +
+                    mi_syntax_regex_memory_usage(&sess->sm);
+
+    for (const Buffer *buffer = sess->buffers; buffer != NULL;
+         buffer = buffer->next) {
+        info->regexes += ru_memory_usage(&buffer->mask) +
+                         bs_regex_memory_usage(&buffer->search);
+    }
+
+#if WED_FEATURE_LUA
+    info->lua = ls_memory_usage(sess->ls);
+#endif
+}
+
+static size_t mi_history_memory_usage(const List *history)
+{
+    if (history == NULL) {
+        return 0;
+    }
+
+    size_t bytes = sizeof(List) + history->allocated * sizeof(void *);
+    size_t entry_num = list_size(history);
+
+    for (size_t k = 0; k < entry_num; k++) {
+        bytes += strlen(list_get(history, k)) + 1;
+    }
+
+    return bytes;
+}
+
+static size_t mi_filetype_regex_memory_usage(const HashMap *filetypes)
+{
+    size_t bytes = 0;
+    HashMapIterator iter;
+    void *value;
+    const FileType *file_type;
+
+    hashmap_iter_init(&iter, filetypes);
+
+    while (hashmap_iter_next(&iter, NULL, &value)) {
+        file_type = value;
+        bytes += ru_memory_usage(&file_type->file_pattern) +
+                 ru_memory_usage(&file_type->file_content);
+    }
+
+    return bytes;
+}
+
+static size_t mi_syntax_regex_memory_usage(const SyntaxManager *sm)
+{
+    size_t bytes = 0;
+    HashMapIterator iter;
+    void *value;
+    const SyntaxDefinition *syn_def;
+
+    hashmap_iter_init(&iter, sm->syn_defs);
+
+    while (hashmap_iter_next(&iter, NULL, &value)) {
+        syn_def = value;
+
+        if (syn_def != NULL && syn_def->memory_usage != NULL) {
+            bytes += syn_def->memory_usage(syn_def);
+        }
+    }
+
+    return bytes;
+}
+
+static size_t mi_session_buffers_memory_total(const Session *sess)
+{
+    BufferMemoryInfo info;
+    size_t bytes = 0;
+
+    for (const Buffer *buffer = sess->buffers; buffer != NULL;
+         buffer = buffer->next) {
+        mi_buffer_memory_info(buffer, &info);
+        bytes += mi_buffer_memory_total(&info);
+    }
+
+    return bytes;
+}
+
+Status mi_generate_report(const Session *sess, Buffer *report)
+{
+    char line[MI_LINE_LEN];
+    char used[MI_SIZE_STR_LEN];
+    char gap[MI_SIZE_STR_LEN];
+    BufferMemoryInfo info;
+    SessionMemoryInfo sess_info;
+    size_t total = 0;
+
+    RETURN_IF_FAIL(mi_bf_insert(report, "Memory Usage\n"));
+
+    for (const Buffer *buffer = sess->buffers; buffer != NULL;
+         buffer = buffer->next) {
+        /* The report buffer is still being written */
+        if (buffer == report) {
+            continue;
+        }
+
+        mi_buffer_memory_info(buffer, &info);
+        total += mi_buffer_memory_total(&info);
+
+        snprintf(line, MI_LINE_LEN, "\n%s\n", buffer->file_info.file_name);
+        RETURN_IF_FAIL(mi_bf_insert(report, line));
+
+        bytes_to_str(info.text_used, used, MI_SIZE_STR_LEN);
+        bytes_to_str(info.gap_size, gap, MI_SIZE_STR_LEN);
+        snprintf(line, MI_LINE_LEN, "(%s used, %s gap)", used, gap);
+
+        RETURN_IF_FAIL(mi_insert_line(report, "Text", info.text_allocated,
+                                      line));
+        RETURN_IF_FAIL(mi_insert_line(report, "Undo history", info.undo,
+                                      NULL));
+        RETURN_IF_FAIL(mi_insert_line(report, "Syntax match cache",
+                                      info.syntax_match_cache, NULL));
+        RETURN_IF_FAIL(mi_insert_line(report, "Search matches",
+                                      info.search_matches, NULL));
+        RETURN_IF_FAIL(mi_insert_line(report, "View cells", info.view, NULL));
+        RETURN_IF_FAIL(mi_insert_line(report, "Marks", info.marks, NULL));
+        RETURN_IF_FAIL(mi_insert_line(report, "Total",
+                                      mi_buffer_memory_total(&info), NULL));
+    }
+
+    mi_session_memory_info(sess, &sess_info);
+    total += sess_info.history + sess_info.regexes + sess_info.lua;
+
+    RETURN_IF_FAIL(mi_bf_insert(report, "\nSession\n"));
+    RETURN_IF_FAIL(mi_insert_line(report, "History lists", sess_info.history,
+                                  NULL));
+    RETURN_IF_FAIL(mi_insert_line(report, "Compiled regexes",
+                                  sess_info.regexes, NULL));
+#if WED_FEATURE_LUA
+    RETURN_IF_FAIL(mi_insert_line(report, "Lua state", sess_info.lua, NULL));
+#endif
+    RETURN_IF_FAIL(mi_insert_line(report, "Total", total, NULL));
+
+    return STATUS_SUCCESS;
+}
+
+/* Shrink oversized gaps and drop cached data that will be regenerated
+ * when next required */
+Status mi_compact(Session *sess, size_t *bytes_freed)
+{
+    size_t before = mi_session_buffers_memory_total(sess);
+
+    for (Buffer *buffer = sess->buffers; buffer != NULL;
+         buffer = buffer->next) {
+        if (!gb_compact(buffer->data)) {
+            return OUT_OF_MEMORY("Unable to compact buffer");
+        }
+
+        if (buffer->bv != NULL) {
+            bv_free_syntax_match_cache(buffer->bv);
+        }
+    }
+
+    size_t after = mi_session_buffers_memory_total(sess);
+    *bytes_freed = before > after ? before - after : 0;
+
+    return STATUS_SUCCESS;
+}
+
+static Status mi_insert_line(Buffer *buffer, const char *label, size_t bytes,
+                             const char *detail)
+{
+    char size[MI_SIZE_STR_LEN];
+    char line[MI_LINE_LEN];
+
+    bytes_to_str(bytes, size, MI_SIZE_STR_LEN);
+
+    if (detail != NULL) {
+        snprintf(line, MI_LINE_LEN, "    %-20s %12s %s\n", label, size, detail);
+    } else {
+        snprintf(line, MI_LINE_LEN, "    %-20s %12s\n", label, size);
+    }
+
+    return mi_bf_insert(buffer, line);
+}
+
+static Status mi_bf_insert(Buffer *buffer, const char *str)
+{
+    return bf_insert_string(buffer, str, strlen(str), 1);
+}
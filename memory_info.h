@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_MEMORY_INFO_H
+#define WED_MEMORY_INFO_H
+
+#include <stddef.h>
+#include "status.h"
+
+struct Session;
+struct Buffer;
+
+/* Approximate memory footprint of a buffer. Sizes are in bytes and only
+ * include memory allocated by wed, not allocator overhead */
+typedef struct {
+    size_t text_used; /* Bytes of buffer content */
+    size_t text_allocated; /* Bytes allocated by the gap buffer */
+    size_t gap_size; /* Unused bytes in the gap */
+    size_t undo; /* Undo and redo history */
+    size_t syntax_match_cache; /* Cached syntax matches */
+    size_t search_matches; /* Stored search matches */
+    size_t view; /* BufferView lines and cells */
+    size_t marks; /* Buffer marks */
+} BufferMemoryInfo;
+
+/* Approximate memory footprint of session wide data */
+typedef struct {
+    size_t history; /* Prompt history lists */
+    size_t regexes; /* Compiled filetype, syntax, mask and search regexes */
+    size_t lua; /* Lua interpreter state */
+} SessionMemoryInfo;
+
+void mi_buffer_memory_info(const struct Buffer *, BufferMemoryInfo *);
+size_t mi_buffer_memory_total(const BufferMemoryInfo *);
+void mi_session_memory_info(const struct Session *, SessionMemoryInfo *);
+Status mi_generate_report(const struct Session *, struct Buffer *report);
+Status mi_compact(struct Session *, size_t *bytes_freed);
+
+#endif
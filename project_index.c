@@ -0,0 +1,588 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "project_index.h"
+#include "util.h"
+
+/* Queries longer than this can't be matched */
+#define PI_MAX_QUERY_LENGTH 256
+/* Bonus for each character of the query matched */
+#define PI_MATCH_SCORE 16
+/* Bonus for a match at the start of a path component */
+#define PI_COMPONENT_START_BONUS 32
+/* Bonus for a match at the start of a word e.g. after _ or camel case */
+#define PI_WORD_START_BONUS 24
+/* Bonus for a match immediately after the previous match */
+#define PI_CONSECUTIVE_BONUS 24
+/* Bonus for a match in the file name part of a path */
+#define PI_FILE_NAME_BONUS 8
+/* Maximum penalty for unmatched characters between two matches */
+#define PI_MAX_GAP_PENALTY 16
+
+#ifdef __linux__
+/* Events which indicate the list of files in a directory has changed */
+#define PI_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                         IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+static Status pi_start_crawl(ProjectIndex *);
+static Status pi_update_crawl(ProjectIndex *);
+static Status pi_add_crawl_paths(ProjectIndex *);
+static void pi_watch_dirs(ProjectIndex *);
+static int pi_read_watch_events(ProjectIndex *);
+static void pi_finish_crawl(ProjectIndex *);
+static uint64_t pi_char_bit(unsigned char);
+static uint64_t pi_char_mask(const char *str, size_t str_len);
+static const char *pi_find_char(const char *str, size_t str_len, char lower);
+static size_t pi_match_forward(const char *path, size_t path_len,
+                               size_t start, const char *query,
+                               size_t query_len, size_t positions[]);
+static int pi_match_backward(const char *path, size_t end,
+                             const char *query, size_t query_len,
+                             size_t *start);
+static int pi_score_match(const IndexedPath *, const size_t positions[],
+                          size_t query_len);
+static int pi_match_path(const IndexedPath *, const char *query,
+                         size_t query_len, int *score);
+static void pi_add_match(ProjectIndexMatch matches[], size_t *match_num,
+                         size_t max_matches, const IndexedPath *, int score);
+
+ProjectIndex *pi_new(const char *dir_path)
+{
+    ProjectIndex *pi = malloc(sizeof(ProjectIndex));
+    RETURN_IF_NULL(pi);
+
+    memset(pi, 0, sizeof(ProjectIndex));
+    pi->watch_fd = -1;
+
+    if ((pi->dir_path = strdup(dir_path)) == NULL) {
+        free(pi);
+        return NULL;
+    }
+
+    return pi;
+}
+
+void pi_free(ProjectIndex *pi)
+{
+    if (pi == NULL) {
+        return;
+    }
+
+    fs_free(pi->crawl);
+    fs_free(pi->listing);
+    free(pi->crawl_paths);
+    free(pi->paths);
+    free(pi->dir_path);
+
+    if (pi->watch_fd != -1) {
+        close(pi->watch_fd);
+    }
+
+    free(pi);
+}
+
+/* Start building the index in the background */
+Status pi_start(ProjectIndex *pi)
+{
+#ifdef __linux__
+    if (pi->watch_fd == -1) {
+        /* The index can still be built without inotify, it just won't
+         * be updated when files change */
+        pi->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (pi->watch_fd != -1) {
+            inotify_add_watch(pi->watch_fd, pi->dir_path, PI_WATCH_EVENTS);
+        }
+    }
+#endif
+
+    if (pi->crawl != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    return pi_start_crawl(pi);
+}
+
+static Status pi_start_crawl(ProjectIndex *pi)
+{
+    FileSearch *crawl = fs_new_file_list(pi->dir_path);
+
+    if (crawl == NULL) {
+        return OUT_OF_MEMORY("Unable to create project index");
+    }
+
+    Status status = fs_start(crawl);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        fs_free(crawl);
+        return status;
+    }
+
+    pi->crawl = crawl;
+    pi->crawl_path_num = 0;
+    pi->crawl_dir_num = 0;
+    pi->stale = 0;
+
+    return STATUS_SUCCESS;
+}
+
+/* Block until the index has been built */
+Status pi_wait(ProjectIndex *pi)
+{
+    if (pi->crawl == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    fs_wait(pi->crawl);
+
+    return pi_update_crawl(pi);
+}
+
+void pi_add_fds(const ProjectIndex *pi, fd_set *read_fds, int *max_fd)
+{
+    int fd;
+
+    if (pi->crawl != NULL && !fs_finished(pi->crawl)) {
+        fd = fs_get_fd(pi->crawl);
+        FD_SET(fd, read_fds);
+        *max_fd = MAX(*max_fd, fd);
+    }
+
+    if (pi->watch_fd != -1) {
+        FD_SET(pi->watch_fd, read_fds);
+        *max_fd = MAX(*max_fd, pi->watch_fd);
+    }
+}
+
+/* Add paths from a crawl in progress and rebuild the index if files
+ * have changed. updated is set to true if the paths in the index
+ * changed */
+Status pi_process(ProjectIndex *pi, const fd_set *read_fds, int *updated)
+{
+    *updated = 0;
+
+    if (pi->watch_fd != -1 && FD_ISSET(pi->watch_fd, read_fds) &&
+        pi_read_watch_events(pi)) {
+        /* A crawl already in progress may have missed the change so
+         * another crawl is started once it completes */
+        pi->stale = 1;
+
+        if (pi->crawl == NULL) {
+            RETURN_IF_FAIL(pi_start_crawl(pi));
+        }
+    }
+
+    if (pi->crawl == NULL || !FD_ISSET(fs_get_fd(pi->crawl), read_fds)) {
+        return STATUS_SUCCESS;
+    }
+
+    size_t path_num = pi_path_num(pi);
+    Status status = pi_update_crawl(pi);
+    *updated = (pi->crawl == NULL || path_num != pi_path_num(pi));
+
+    return status;
+}
+
+static Status pi_update_crawl(ProjectIndex *pi)
+{
+    Status status = fs_write_results(pi->crawl, NULL);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = pi_add_crawl_paths(pi);
+    }
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        /* Keep the existing index if there is one */
+        fs_free(pi->crawl);
+        pi->crawl = NULL;
+        pi->crawl_path_num = 0;
+        return status;
+    }
+
+    pi_watch_dirs(pi);
+
+    if (!fs_finished(pi->crawl)) {
+        return STATUS_SUCCESS;
+    }
+
+    pi_finish_crawl(pi);
+
+    if (pi->stale) {
+        return pi_start_crawl(pi);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status pi_add_crawl_paths(ProjectIndex *pi)
+{
+    size_t file_num = fs_file_num(pi->crawl);
+
+    if (file_num > pi->crawl_path_alloc) {
+        size_t alloc = MAX(file_num, pi->crawl_path_alloc * 2);
+        IndexedPath *paths = realloc(pi->crawl_paths,
+                                     alloc * sizeof(IndexedPath));
+
+        if (paths == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate project index");
+        }
+
+        pi->crawl_paths = paths;
+        pi->crawl_path_alloc = alloc;
+    }
+
+    IndexedPath *indexed_path;
+    const char *name;
+
+    for (size_t k = pi->crawl_path_num; k < file_num; k++) {
+        indexed_path = &pi->crawl_paths[k];
+        indexed_path->path = fs_get_file_path(pi->crawl, k);
+        indexed_path->path_len = strlen(indexed_path->path);
+        name = strrchr(indexed_path->path, '/');
+        indexed_path->name_offset = name == NULL ? 0 :
+                                    (size_t)(name + 1 - indexed_path->path);
+        indexed_path->char_mask = pi_char_mask(indexed_path->path,
+                                               indexed_path->path_len);
+    }
+
+    pi->crawl_path_num = file_num;
+
+    return STATUS_SUCCESS;
+}
+
+/* Watch each directory listed by the crawl. Adding a watch for a
+ * directory that is already watched has no effect */
+static void pi_watch_dirs(ProjectIndex *pi)
+{
+#ifdef __linux__
+    size_t dir_num = fs_dir_num(pi->crawl);
+
+    for (size_t k = pi->crawl_dir_num;
+         pi->watch_fd != -1 && k < dir_num; k++) {
+        /* Failure, for example because the watch limit has been
+         * reached, only means changes in this directory are missed */
+        inotify_add_watch(pi->watch_fd, fs_get_dir_path(pi->crawl, k),
+                          PI_WATCH_EVENTS);
+    }
+
+    pi->crawl_dir_num = dir_num;
+#else
+    (void)pi;
+#endif
+}
+
+/* Returns true if any events were read */
+static int pi_read_watch_events(ProjectIndex *pi)
+{
+#ifdef __linux__
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t bytes_read;
+    int changed = 0;
+
+    /* Only the fact that something changed is needed, the individual
+     * events are discarded */
+    while ((bytes_read = read(pi->watch_fd, buf, sizeof(buf))) > 0 ||
+           (bytes_read == -1 && errno == EINTR)) {
+        if (bytes_read > 0) {
+            changed = 1;
+        }
+    }
+
+    return changed;
+#else
+    (void)pi;
+    return 0;
+#endif
+}
+
+/* Replace the existing listing with the completed crawl */
+static void pi_finish_crawl(ProjectIndex *pi)
+{
+    /* All workers have exited so the threads can be joined */
+    fs_wait(pi->crawl);
+
+    fs_free(pi->listing);
+    free(pi->paths);
+
+    pi->listing = pi->crawl;
+    pi->paths = pi->crawl_paths;
+    pi->path_num = pi->crawl_path_num;
+    pi->crawl = NULL;
+    pi->crawl_paths = NULL;
+    pi->crawl_path_num = 0;
+    pi->crawl_path_alloc = 0;
+}
+
+/* Number of paths which can currently be queried */
+size_t pi_path_num(const ProjectIndex *pi)
+{
+    if (pi->listing == NULL) {
+        return pi->crawl_path_num;
+    }
+
+    return pi->path_num;
+}
+
+int pi_building(const ProjectIndex *pi)
+{
+    return pi->listing == NULL && pi->crawl != NULL;
+}
+
+/* Letters (ignoring case) and digits have their own bit. Other
+ * characters share the remaining bits */
+static uint64_t pi_char_bit(unsigned char c)
+{
+    if (c >= 'a' && c <= 'z') {
+        return (uint64_t)1 << (c - 'a');
+    } else if (c >= 'A' && c <= 'Z') {
+        return (uint64_t)1 << (c - 'A');
+    } else if (c >= '0' && c <= '9') {
+        return (uint64_t)1 << (c - '0' + 26);
+    }
+
+    return (uint64_t)1 << (36 + (c % 28));
+}
+
+static uint64_t pi_char_mask(const char *str, size_t str_len)
+{
+    uint64_t mask = 0;
+
+    for (size_t k = 0; k < str_len; k++) {
+        mask |= pi_char_bit((unsigned char)str[k]);
+    }
+
+    return mask;
+}
+
+/* Find the first occurrence of a character ignoring case. memchr is
+ * used as it's typically vectorised */
+static const char *pi_find_char(const char *str, size_t str_len, char lower)
+{
+    const char *lower_pos = memchr(str, lower, str_len);
+
+    if (lower < 'a' || lower > 'z') {
+        return lower_pos;
+    }
+
+    if (lower_pos != NULL) {
+        str_len = lower_pos - str;
+    }
+
+    const char *upper_pos = memchr(str, lower - 'a' + 'A', str_len);
+
+    return upper_pos != NULL ? upper_pos : lower_pos;
+}
+
+/* Match each query character with its first occurrence after the
+ * previous match. Returns the number of query characters matched */
+static size_t pi_match_forward(const char *path, size_t path_len,
+                               size_t start, const char *query,
+                               size_t query_len, size_t positions[])
+{
+    const char *pos;
+    size_t k;
+
+    for (k = 0; k < query_len && start < path_len; k++) {
+        pos = pi_find_char(path + start, path_len - start, query[k]);
+
+        if (pos == NULL) {
+            break;
+        }
+
+        positions[k] = pos - path;
+        start = positions[k] + 1;
+    }
+
+    return k;
+}
+
+/* Working backwards from the last character of a forward match find the
+ * latest position the match can start from. This gives a shorter match
+ * when a query character occurs earlier in the path than is useful */
+static int pi_match_backward(const char *path, size_t end,
+                             const char *query, size_t query_len,
+                             size_t *start)
+{
+    size_t k = query_len;
+    size_t pos = end + 1;
+
+    while (k > 0 && pos > 0) {
+        pos--;
+
+        if (tolower((unsigned char)path[pos]) == query[k - 1]) {
+            k--;
+        }
+    }
+
+    *start = pos;
+
+    return k == 0;
+}
+
+static int pi_score_match(const IndexedPath *indexed_path,
+                          const size_t positions[], size_t query_len)
+{
+    const char *path = indexed_path->path;
+    int score = 0;
+    size_t pos, gap;
+    char prev;
+
+    for (size_t k = 0; k < query_len; k++) {
+        pos = positions[k];
+        score += PI_MATCH_SCORE;
+
+        if (pos == 0 || path[pos - 1] == '/') {
+            score += PI_COMPONENT_START_BONUS;
+        } else {
+            prev = path[pos - 1];
+
+            if (prev == '_' || prev == '-' || prev == '.' || prev == ' ' ||
+                (islower((unsigned char)prev) &&
+                 isupper((unsigned char)path[pos]))) {
+                score += PI_WORD_START_BONUS;
+            }
+        }
+
+        if (pos >= indexed_path->name_offset) {
+            score += PI_FILE_NAME_BONUS;
+        }
+
+        if (k > 0) {
+            gap = pos - positions[k - 1] - 1;
+
+            if (gap == 0) {
+                score += PI_CONSECUTIVE_BONUS;
+            } else {
+                score -= MIN(gap, PI_MAX_GAP_PENALTY);
+            }
+        }
+    }
+
+    /* Prefer shorter paths when scores are otherwise equal */
+    return score * 256 - (int)MIN(indexed_path->path_len, 255);
+}
+
+/* query must be lower case. Returns true if path contains each query
+ * character in order */
+static int pi_match_path(const IndexedPath *indexed_path, const char *query,
+                         size_t query_len, int *score)
+{
+    size_t positions[PI_MAX_QUERY_LENGTH];
+    const char *path = indexed_path->path;
+    size_t path_len = indexed_path->path_len;
+    size_t start;
+
+    if (pi_match_forward(path, path_len, 0, query, query_len,
+                         positions) < query_len) {
+        return 0;
+    }
+
+    pi_match_backward(path, positions[query_len - 1], query, query_len,
+                      &start);
+    pi_match_forward(path, path_len, start, query, query_len, positions);
+    *score = pi_score_match(indexed_path, positions, query_len);
+
+    /* Matching only the file name is usually what was intended, so try
+     * that as well when the match above begins in a directory name */
+    if (start < indexed_path->name_offset &&
+        pi_match_forward(path, path_len, indexed_path->name_offset,
+                         query, query_len, positions) == query_len) {
+        *score = MAX(*score, pi_score_match(indexed_path, positions,
+                                            query_len));
+    }
+
+    return 1;
+}
+
+/* Insert a match keeping matches ordered by score. When matches is
+ * full the lowest scoring match is dropped */
+static void pi_add_match(ProjectIndexMatch matches[], size_t *match_num,
+                         size_t max_matches, const IndexedPath *indexed_path,
+                         int score)
+{
+    size_t k = *match_num;
+
+    if (k == max_matches) {
+        if (score <= matches[k - 1].score) {
+            return;
+        }
+
+        k--;
+    } else {
+        (*match_num)++;
+    }
+
+    while (k > 0 && matches[k - 1].score < score) {
+        matches[k] = matches[k - 1];
+        k--;
+    }
+
+    matches[k].indexed_path = indexed_path;
+    matches[k].score = score;
+}
+
+/* Find the paths which best match query, ignoring case. Query characters
+ * must occur in the path in order but not necessarily consecutively.
+ * Matches are written to matches ordered by score and the number of
+ * matches found is returned */
+size_t pi_find(const ProjectIndex *pi, const char *query, size_t query_len,
+               ProjectIndexMatch matches[], size_t max_matches)
+{
+    if (query_len == 0 || query_len > PI_MAX_QUERY_LENGTH ||
+        max_matches == 0) {
+        return 0;
+    }
+
+    char lower_query[PI_MAX_QUERY_LENGTH];
+
+    for (size_t k = 0; k < query_len; k++) {
+        lower_query[k] = tolower((unsigned char)query[k]);
+    }
+
+    const IndexedPath *paths = pi->listing == NULL ? pi->crawl_paths :
+                                                     pi->paths;
+    size_t path_num = pi_path_num(pi);
+    uint64_t query_mask = pi_char_mask(query, query_len);
+    size_t match_num = 0;
+    int score;
+
+    for (size_t k = 0; k < path_num; k++) {
+        /* Most paths can be rejected by checking that they contain each
+         * character in the query without scanning the path */
+        if ((paths[k].char_mask & query_mask) != query_mask ||
+            paths[k].path_len < query_len) {
+            continue;
+        }
+
+        if (pi_match_path(&paths[k], lower_query, query_len, &score)) {
+            pi_add_match(matches, &match_num, max_matches, &paths[k],
+                         score);
+        }
+    }
+
+    return match_num;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_PROJECT_INDEX_H
+#define WED_PROJECT_INDEX_H
+
+#include <stdint.h>
+#include <sys/select.h>
+#include "shared.h"
+#include "status.h"
+#include "file_search.h"
+
+/* A project index lists every file below a directory so that files can
+ * be found by fuzzy matching their path. The index is built in the
+ * background by a FileSearch listing and is queried whilst the crawl is
+ * still running. On Linux directories are watched using inotify and the
+ * index is rebuilt in the background when files are added, removed or
+ * renamed. The new listing replaces the existing one once complete */
+
+/* A path in the index along with data used to speed up matching */
+typedef struct {
+    const char *path; /* Path relative to index directory */
+    size_t path_len; /* Path length */
+    size_t name_offset; /* Offset of file name in path */
+    uint64_t char_mask; /* Set of characters that occur in path */
+} IndexedPath;
+
+/* A path which matched a query */
+typedef struct {
+    const IndexedPath *indexed_path; /* Matching path */
+    int score; /* Higher scores are better matches */
+} ProjectIndexMatch;
+
+typedef struct {
+    char *dir_path; /* Directory indexed */
+    FileSearch *listing; /* Completed listing paths point into */
+    IndexedPath *paths; /* Paths from listing */
+    size_t path_num; /* Number of paths */
+    FileSearch *crawl; /* Listing in progress or NULL */
+    IndexedPath *crawl_paths; /* Paths from crawl listed so far */
+    size_t crawl_path_num; /* Number of crawl paths */
+    size_t crawl_path_alloc; /* Size of crawl_paths array */
+    size_t crawl_dir_num; /* Number of crawl directories processed */
+    int stale; /* True if the tree changed since the crawl started */
+    int watch_fd; /* inotify descriptor or -1 if unavailable */
+} ProjectIndex;
+
+ProjectIndex *pi_new(const char *dir_path);
+void pi_free(ProjectIndex *);
+Status pi_start(ProjectIndex *);
+Status pi_wait(ProjectIndex *);
+void pi_add_fds(const ProjectIndex *, fd_set *read_fds, int *max_fd);
+Status pi_process(ProjectIndex *, const fd_set *read_fds, int *updated);
+size_t pi_path_num(const ProjectIndex *);
+int pi_building(const ProjectIndex *);
+size_t pi_find(const ProjectIndex *, const char *query, size_t query_len,
+               ProjectIndexMatch matches[], size_t max_matches);
+
+#endif
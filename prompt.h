@@ -23,7 +23,7 @@
 #include "list.h"
 
 /* Max length of prompt text */
-#define MAX_CMD_PROMPT_LENGTH 50
+#define MAX_CMD_PROMPT_LENGTH 64
 
 typedef enum {
     PT_SAVE_FILE,
@@ -33,6 +33,7 @@ typedef enum {
     PT_COMMAND,
     PT_GOTO,
     PT_BUFFER,
+    PT_FIND_FILE,
     PT_ENTRY_NUM
 } PromptType;
 
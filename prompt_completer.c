@@ -16,21 +16,20 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-/* For DT_DIR */
-#define _BSD_SOURCE
-#define _DEFAULT_SOURCE
-
 /* In case user invokes completion on a directory 
  * containing a large number of files */
-#define MAX_DIR_ENT_NUM 1000
+#define MAX_PATH_SUGGESTION_NUM 1000
+/* Milliseconds completion waits for a directory to be read */
+#define PATH_COMPLETION_WAIT_MS 50
+/* Number of fuzzy matches suggested when finding a file */
+#define MAX_FIND_FILE_SUGGESTION_NUM 50
 
 #include <stdio.h> 
-#include <dirent.h> 
 #include <libgen.h>
-#include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include "prompt_completer.h"
+#include "dir_cache.h"
 #include "util.h"
 
 /* Function that recives input from the prompt and generates
@@ -51,16 +50,19 @@ static Status pc_complete_buffer(const Session *, List *suggestions,
                                  const char *str, size_t str_len);
 static Status pc_complete_path(const Session *, List *suggestions,
                                const char *str, size_t str_len);
+static Status pc_complete_indexed_path(const Session *, List *suggestions,
+                                       const char *str, size_t str_len);
 
 /* Specify which prompt types have prompt completers available */
 static const PromptCompleterConfig pc_prompt_completers[PT_ENTRY_NUM] = {
-    [PT_SAVE_FILE] = { pc_complete_path  , 0 },
-    [PT_OPEN_FILE] = { pc_complete_path  , 0 },
-    [PT_FIND]      = { NULL              , 0 },
-    [PT_REPLACE]   = { NULL              , 0 },
-    [PT_COMMAND]   = { NULL              , 0 },
-    [PT_GOTO]      = { NULL              , 0 },
-    [PT_BUFFER]    = { pc_complete_buffer, 1 }
+    [PT_SAVE_FILE] = { pc_complete_path        , 0 },
+    [PT_OPEN_FILE] = { pc_complete_path        , 0 },
+    [PT_FIND]      = { NULL                    , 0 },
+    [PT_REPLACE]   = { NULL                    , 0 },
+    [PT_COMMAND]   = { NULL                    , 0 },
+    [PT_GOTO]      = { NULL                    , 0 },
+    [PT_BUFFER]    = { pc_complete_buffer      , 1 },
+    [PT_FIND_FILE] = { pc_complete_indexed_path, 1 }
 };
 
 PromptSuggestion *pc_new_suggestion(const char *text, SuggestionRank rank,
@@ -78,6 +80,7 @@ PromptSuggestion *pc_new_suggestion(const char *text, SuggestionRank rank,
 
     suggestion->text_len = strlen(text);
     suggestion->rank = rank;
+    suggestion->score = 0;
     suggestion->data = data;
 
     return suggestion;
@@ -176,9 +179,15 @@ static int pc_suggestion_comparator(const void *s1, const void *s2)
 
     if (suggestion1->rank < suggestion2->rank) {
         return -1;
+    } else if (suggestion1->rank > suggestion2->rank) {
+        return 1;
+    }
+
+    if (suggestion1->score > suggestion2->score) {
+        return -1;
     }
 
-    return suggestion1->rank - suggestion2->rank;
+    return suggestion1->score < suggestion2->score;
 }
 
 static Status pc_complete_buffer(const Session *sess, List *suggestions,
@@ -221,11 +230,12 @@ static Status pc_complete_buffer(const Session *sess, List *suggestions,
     return STATUS_SUCCESS;
 }
 
+/* Directory entries are listed by the session's directory cache. If the
+ * directory isn't cached and can't be read in time completion finishes
+ * without suggestions and is run again once the directory has been read */
 static Status pc_complete_path(const Session *sess, List *suggestions,
                                const char *str, size_t str_len)
 {
-    (void)sess;
-
     /* When only ~ is provided expand it to users home directory */
     if (strcmp("~", str) == 0) {
         str = getenv("HOME"); 
@@ -274,8 +284,7 @@ static Status pc_complete_path(const Session *sess, List *suggestions,
     }
 
     int home_dir_path = (dir_path[0] == '~');
-    const char *canon_dir_path;
-    DIR *dir = NULL;
+    char *canon_dir_path = NULL;
 
     if (home_dir_path) {
         /* Expand ~ to users home directory so we can read the 
@@ -288,91 +297,128 @@ static Status pc_complete_path(const Session *sess, List *suggestions,
             status = OUT_OF_MEMORY("Unable to allocated path");
             goto cleanup;
         }
-    } else {
-        canon_dir_path = dir_path;
     }
 
-    dir = opendir(canon_dir_path);
+    DirCache *dir_cache = sess->dir_cache;
+    const char *list_path = home_dir_path ? canon_dir_path : dir_path;
+    DirListing *listing;
 
-    if (home_dir_path) {
-        free((char *)canon_dir_path);
+    status = dc_get_listing(dir_cache, list_path, &listing);
+
+    if (STATUS_IS_SUCCESS(status) && listing == NULL) {
+        /* Most directories are read almost immediately so wait briefly
+         * before leaving the directory to be read in the background */
+        status = dc_wait(dir_cache, sess->wed_opt.test_mode ?
+                                    -1 : PATH_COMPLETION_WAIT_MS);
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = dc_get_listing(dir_cache, list_path, &listing);
+        }
     }
 
-    if (dir == NULL) {
+    if (!STATUS_IS_SUCCESS(status)) {
+        goto cleanup;
+    } else if (listing == NULL) {
+        dir_cache->completion_pending = 1;
         goto cleanup;
     }
+
+    status = dc_find(listing, file_name != NULL ? file_name : "",
+                     file_name_len);
     
+    if (!STATUS_IS_SUCCESS(status)) {
+        goto cleanup;
+    }
+
     if (strcmp(dir_path, "/") == 0) {
         dir_path = "";
     }
 
-    struct dirent *dir_ent;
+    const size_t match_num = MIN(listing->match_num,
+                                 MAX_PATH_SUGGESTION_NUM);
+    const DirCacheEntry *entry;
     PromptSuggestion *suggestion;
     SuggestionRank rank;
-    size_t dir_ent_num = 0;
-    errno = 0;
 
-    while (dir_ent_num++ < MAX_DIR_ENT_NUM &&
-           (dir_ent = readdir(dir)) != NULL) {
-
-        if (strcmp(".", dir_ent->d_name) == 0 ||
-            strcmp("..", dir_ent->d_name) == 0) {
-            continue;
-        }
-
-        rank = SR_NO_MATCH;
+    for (size_t k = 0; k < match_num; k++) {
+        entry = &listing->entries[listing->matches[k]];
 
         if (file_name == NULL) {
             rank = SR_DEFAULT_MATCH;            
-        } else if (strcmp(file_name, dir_ent->d_name) == 0) {
+        } else if (entry->name_len == file_name_len &&
+                   strcmp(file_name, entry->name) == 0) {
             rank = SR_EXACT_MATCH;
-        } else if (strncmp(file_name, dir_ent->d_name, file_name_len) == 0) {
+        } else if (strncmp(file_name, entry->name, file_name_len) == 0) {
             rank = SR_STARTS_WITH; 
-        } else if (strstr(file_name, dir_ent->d_name) != NULL) {
+        } else {
             rank = SR_CONTAINS;
         }
 
-        if (rank != SR_NO_MATCH) {
-            char *suggestion_path;
-
-            if (dir_ent->d_type == DT_DIR) {
-                suggestion_path = concat_all(4, dir_path, "/",
-                                             dir_ent->d_name,"/");
-            } else {
-                suggestion_path = concat_all(3, dir_path, "/",
-                                             dir_ent->d_name);
-            }
+        char *suggestion_path;
 
-            if (suggestion_path == NULL) {
-                status = OUT_OF_MEMORY("Unable to allocated suggested path");
-                goto cleanup;
-            }
-
-            suggestion = pc_new_suggestion(suggestion_path, rank, NULL);
+        if (entry->is_dir) {
+            suggestion_path = concat_all(4, dir_path, "/", entry->name, "/");
+        } else {
+            suggestion_path = concat_all(3, dir_path, "/", entry->name);
+        }
 
-            free(suggestion_path);
-            
-            if (suggestion == NULL || !list_add(suggestions, suggestion)) {
-                free(suggestion);
-                status = OUT_OF_MEMORY("Unable to allocated suggested buffer");
-                goto cleanup;
-            }
+        if (suggestion_path == NULL) {
+            status = OUT_OF_MEMORY("Unable to allocated suggested path");
+            goto cleanup;
         }
-    }
 
-    if (errno) {
-        status = st_get_error(ERR_UNABLE_TO_READ_DIRECTORY,
-                              "Unable to read from directory - %s",
-                              strerror(errno));
-    }
+        suggestion = pc_new_suggestion(suggestion_path, rank, NULL);
 
-cleanup:
-    if (dir != NULL) {
-        closedir(dir);
+        free(suggestion_path);
+        
+        if (suggestion == NULL || !list_add(suggestions, suggestion)) {
+            free(suggestion);
+            status = OUT_OF_MEMORY("Unable to allocated suggested buffer");
+            goto cleanup;
+        }
     }
 
+cleanup:
+    free(canon_dir_path);
     free(path1);
     free(path2);
 
     return status;
 }
+
+/* Fuzzy match input against the paths in the project index */
+static Status pc_complete_indexed_path(const Session *sess, List *suggestions,
+                                       const char *str, size_t str_len)
+{
+    if (sess->project_index == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    ProjectIndexMatch matches[MAX_FIND_FILE_SUGGESTION_NUM];
+    size_t match_num = pi_find(sess->project_index, str, str_len, matches,
+                               MAX_FIND_FILE_SUGGESTION_NUM);
+    const IndexedPath *indexed_path;
+    PromptSuggestion *suggestion;
+    SuggestionRank rank;
+
+    for (size_t k = 0; k < match_num; k++) {
+        indexed_path = matches[k].indexed_path;
+
+        if (strcmp(indexed_path->path, str) == 0) {
+            rank = SR_EXACT_MATCH;
+        } else {
+            rank = SR_CONTAINS;
+        }
+
+        suggestion = pc_new_suggestion(indexed_path->path, rank, NULL);
+
+        if (suggestion == NULL || !list_add(suggestions, suggestion)) {
+            free(suggestion);
+            return OUT_OF_MEMORY("Unable to allocated suggested path");
+        }
+
+        suggestion->score = matches[k].score;
+    }
+
+    return STATUS_SUCCESS;
+}
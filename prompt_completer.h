@@ -41,6 +41,7 @@ typedef struct {
     char *text; /* Suggestion text */
     size_t text_len; /* Suggestion text length */
     SuggestionRank rank; /* Rank */
+    int score; /* Orders suggestions of equal rank, higher is better */
     const void *data; /* Data relevant to the suggestion */
 } PromptSuggestion;
 
@@ -24,6 +24,22 @@
 #include <assert.h>
 #include "radix_tree.h"
 
+/* An entry collected from a RadixTree while freezing */
+typedef struct {
+    char *key; /* Full key string */
+    size_t key_len; /* Key length excluding null character */
+    void *data; /* Data stored for key */
+    size_t rtree_index; /* Index of the tree the entry is from. Entries
+                           from earlier trees take precedence */
+} RadixTreeEntry;
+
+/* Range of sorted entries below a FrozenRadixTree node */
+typedef struct {
+    size_t start; /* First entry */
+    size_t end; /* One past last entry */
+    size_t depth; /* Bytes of key represented by node and its ancestors */
+} FrozenRadixTreeRange;
+
 static void rt_free_tree(RadixTreeNode *, FreeFunction);
 static RadixTreeNode *rt_new_node(const char *str, size_t str_len, void *data,
                                   RadixTreeNode *sibling, RadixTreeNode *child);
@@ -32,6 +48,12 @@ static size_t rt_prefix(const char *str, size_t str_len,
                         const char *key, size_t key_len);
 static int rt_split(RadixTreeNode *node, size_t prefix_len);
 static int rt_join(RadixTreeNode *parent);
+static int rt_collect_entries(const RadixTreeNode *, size_t rtree_index,
+                              char **key, size_t *key_size, size_t depth,
+                              RadixTreeEntry *entries, size_t *entry_num);
+static int rt_entry_comparator(const void *, const void *);
+static int rt_build_frozen(FrozenRadixTree *, const RadixTreeEntry *entries,
+                           size_t entry_num);
 
 RadixTree *rt_new(void)
 {
@@ -359,3 +381,280 @@ int rt_delete(RadixTree *rtree, const char *str, size_t str_len)
     return 1;
 }
 
+
+/* Create a FrozenRadixTree containing the entries of all rtrees. When a
+ * key is present in more than one tree the data from the earliest tree
+ * in rtrees is used. The frozen tree doesn't reflect subsequent changes
+ * to rtrees */
+FrozenRadixTree *rt_freeze(const RadixTree *rtrees[], size_t rtree_num)
+{
+    FrozenRadixTree *frtree = NULL;
+    RadixTreeEntry *entries = NULL;
+    size_t entry_num = 0;
+    size_t total_entries = 0;
+    size_t key_size = 64;
+    char *key = malloc(key_size);
+
+    if (key == NULL) {
+        return NULL;
+    }
+
+    for (size_t k = 0; k < rtree_num; k++) {
+        total_entries += rtrees[k]->entries;
+    }
+
+    entries = malloc(sizeof(RadixTreeEntry) * (total_entries + 1));
+
+    if (entries == NULL) {
+        goto cleanup;
+    }
+
+    for (size_t k = 0; k < rtree_num; k++) {
+        if (!rt_collect_entries(rtrees[k]->root, k, &key, &key_size, 0,
+                                entries, &entry_num)) {
+            goto cleanup;
+        }
+    }
+
+    qsort(entries, entry_num, sizeof(RadixTreeEntry), rt_entry_comparator);
+
+    /* Remove duplicate keys. As entries with equal keys are ordered by
+     * tree the first is the one which takes precedence */
+    size_t unique_num = 0;
+
+    for (size_t k = 0; k < entry_num; k++) {
+        if (unique_num > 0 &&
+            entries[k].key_len == entries[unique_num - 1].key_len &&
+            memcmp(entries[k].key, entries[unique_num - 1].key,
+                   entries[k].key_len) == 0) {
+            free(entries[k].key);
+            continue;
+        }
+
+        entries[unique_num++] = entries[k];
+    }
+
+    entry_num = unique_num;
+    frtree = malloc(sizeof(FrozenRadixTree));
+
+    if (frtree == NULL) {
+        goto cleanup;
+    }
+
+    if (!rt_build_frozen(frtree, entries, entry_num)) {
+        free(frtree);
+        frtree = NULL;
+    }
+
+cleanup:
+    for (size_t k = 0; k < entry_num; k++) {
+        free(entries[k].key);
+    }
+
+    free(entries);
+    free(key);
+
+    return frtree;
+}
+
+/* Add the entries in node, its children and siblings to entries. The
+ * first depth bytes of key contain the key of node's parent */
+static int rt_collect_entries(const RadixTreeNode *node, size_t rtree_index,
+                              char **key, size_t *key_size, size_t depth,
+                              RadixTreeEntry *entries, size_t *entry_num)
+{
+    for (; node != NULL; node = node->sibling) {
+        if (depth + node->key_len > *key_size) {
+            size_t new_size = (depth + node->key_len) * 2;
+            char *new_key = realloc(*key, new_size);
+
+            if (new_key == NULL) {
+                return 0;
+            }
+
+            *key = new_key;
+            *key_size = new_size;
+        }
+
+        memcpy(*key + depth, node->key, node->key_len);
+
+        if (node->child != NULL) {
+            if (!rt_collect_entries(node->child, rtree_index, key, key_size,
+                                    depth + node->key_len, entries,
+                                    entry_num)) {
+                return 0;
+            }
+
+            continue;
+        }
+
+        /* Entry keys include the null character */
+        RadixTreeEntry *entry = &entries[*entry_num];
+        entry->key_len = depth + node->key_len - 1;
+        entry->key = malloc(entry->key_len + 1);
+
+        if (entry->key == NULL) {
+            return 0;
+        }
+
+        memcpy(entry->key, *key, entry->key_len + 1);
+        entry->data = node->data;
+        entry->rtree_index = rtree_index;
+        (*entry_num)++;
+    }
+
+    return 1;
+}
+
+/* Order entries by key then by tree. A key sorts before the keys it's a
+ * prefix of */
+static int rt_entry_comparator(const void *v1, const void *v2)
+{
+    const RadixTreeEntry *entry1 = v1;
+    const RadixTreeEntry *entry2 = v2;
+    size_t len = entry1->key_len < entry2->key_len ?
+                 entry1->key_len : entry2->key_len;
+    int cmp = memcmp(entry1->key, entry2->key, len);
+
+    if (cmp != 0) {
+        return cmp;
+    } else if (entry1->key_len != entry2->key_len) {
+        return entry1->key_len < entry2->key_len ? -1 : 1;
+    } else if (entry1->rtree_index != entry2->rtree_index) {
+        return entry1->rtree_index < entry2->rtree_index ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/* Build the nodes of frtree from sorted unique entries. Nodes are
+ * processed in breadth first order, each node adding its children to the
+ * end of the node array. The entries below each node are a contiguous
+ * range of the sorted entries */
+static int rt_build_frozen(FrozenRadixTree *frtree,
+                           const RadixTreeEntry *entries, size_t entry_num)
+{
+    size_t max_nodes = 1;
+
+    for (size_t k = 0; k < entry_num; k++) {
+        max_nodes += entries[k].key_len;
+    }
+
+    if (max_nodes > UINT32_MAX) {
+        return 0;
+    }
+
+    frtree->nodes = malloc(sizeof(FrozenRadixTreeNode) * max_nodes);
+    frtree->labels = malloc(max_nodes);
+    FrozenRadixTreeRange *ranges = malloc(sizeof(FrozenRadixTreeRange) *
+                                          max_nodes);
+
+    if (frtree->nodes == NULL || frtree->labels == NULL || ranges == NULL) {
+        free(frtree->nodes);
+        free(frtree->labels);
+        free(ranges);
+        return 0;
+    }
+
+    memset(frtree->nodes, 0, sizeof(FrozenRadixTreeNode));
+    frtree->labels[0] = '\0';
+    ranges[0] = (FrozenRadixTreeRange) { 0, entry_num, 0 };
+    size_t node_num = 1;
+
+    for (size_t k = 0; k < node_num; k++) {
+        FrozenRadixTreeNode *node = &frtree->nodes[k];
+        size_t start = ranges[k].start;
+        size_t end = ranges[k].end;
+        size_t depth = ranges[k].depth;
+
+        if (start < end && entries[start].key_len == depth) {
+            node->is_entry = 1;
+            node->data = entries[start].data;
+            start++;
+        }
+
+        node->first_child = node_num;
+
+        while (start < end) {
+            unsigned char label = entries[start].key[depth];
+            size_t child_end = start + 1;
+
+            while (child_end < end &&
+                   (unsigned char)entries[child_end].key[depth] == label) {
+                child_end++;
+            }
+
+            frtree->nodes[node_num] = (FrozenRadixTreeNode) { 0 };
+            frtree->labels[node_num] = label;
+            ranges[node_num] = (FrozenRadixTreeRange) {
+                start, child_end, depth + 1
+            };
+            node->child_num++;
+            node_num++;
+            start = child_end;
+        }
+    }
+
+    free(ranges);
+
+    frtree->node_num = node_num;
+    frtree->entries = entry_num;
+
+    return 1;
+}
+
+void rt_free_frozen(FrozenRadixTree *frtree)
+{
+    if (frtree != NULL) {
+        free(frtree->nodes);
+        free(frtree->labels);
+        free(frtree);
+    }
+}
+
+/* Equivalent to rt_find. Each byte of str selects a child of the current
+ * node, which is found by scanning the labels of the node's children */
+int rt_frozen_find(const FrozenRadixTree *frtree, const char *str,
+                   size_t str_len, void **data, int *is_prefix)
+{
+    if (is_prefix != NULL) {
+        *is_prefix = 0;
+    }
+
+    if (str == NULL) {
+        return 0;
+    }
+
+    const FrozenRadixTreeNode *node = frtree->nodes;
+    const unsigned char *labels;
+    size_t child;
+
+    for (size_t k = 0; k < str_len; k++) {
+        labels = frtree->labels + node->first_child;
+
+        /* Most nodes have few children so a linear scan is used */
+        for (child = 0; child < node->child_num; child++) {
+            if (labels[child] == (unsigned char)str[k]) {
+                break;
+            }
+        }
+
+        if (child == node->child_num) {
+            return 0;
+        }
+
+        node = &frtree->nodes[node->first_child + child];
+    }
+
+    if (!node->is_entry) {
+        if (is_prefix != NULL) {
+            *is_prefix = node->child_num > 0;
+        }
+
+        return 0;
+    } else if (data != NULL) {
+        *data = node->data;
+    }
+
+    return 1;
+}
@@ -23,6 +23,7 @@
 #define WED_RADIX_TREE_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct RadixTreeNode RadixTreeNode;
 typedef void (*FreeFunction)(void *);
@@ -44,6 +45,26 @@ typedef struct {
     size_t entries; /* The number of string keys in the tree (not nodes) */
 } RadixTree;
 
+/* Node of a FrozenRadixTree. Each node represents one byte of a key */
+typedef struct {
+    void *data; /* Data stored at this node if it's an entry */
+    uint32_t first_child; /* Index of first child node */
+    uint16_t child_num; /* Number of child nodes */
+    uint8_t is_entry; /* A key ends at this node */
+} FrozenRadixTreeNode;
+
+/* Read only form of one or more radix trees which is built for fast
+ * lookup. Nodes are stored in a single array in breadth first order so
+ * the children of a node are adjacent. The byte each node represents is
+ * stored in a parallel array, allowing a node's children to be searched
+ * without loading the nodes themselves */
+typedef struct {
+    FrozenRadixTreeNode *nodes; /* Nodes, the first being the root */
+    unsigned char *labels; /* Byte leading to each node from its parent */
+    size_t node_num; /* Number of nodes */
+    size_t entries; /* The number of string keys in the tree */
+} FrozenRadixTree;
+
 RadixTree *rt_new(void);
 void rt_free(RadixTree *);
 void rt_free_including_entries(RadixTree *, FreeFunction);
@@ -52,5 +73,9 @@ int rt_find(const RadixTree *, const char *str, size_t str_len,
             void **data, int *is_prefix);
 int rt_insert(RadixTree *, const char *str, size_t str_len, void *data);
 int rt_delete(RadixTree *, const char *str, size_t str_len);
+FrozenRadixTree *rt_freeze(const RadixTree *rtrees[], size_t rtree_num);
+void rt_free_frozen(FrozenRadixTree *);
+int rt_frozen_find(const FrozenRadixTree *, const char *str, size_t str_len,
+                   void **data, int *is_prefix);
 
 #endif
@@ -26,6 +26,7 @@
 #include "status.h"
 #include "buffer_pos.h"
 #include "util.h"
+#include "regex_util.h"
 #include "build_config.h"
 
 static Status rs_find_prev_str(const char *str, size_t str_len, size_t point,
@@ -33,7 +34,8 @@ static Status rs_find_prev_str(const char *str, size_t str_len, size_t point,
                                int *found_match, RegexSearch *);
 static Status rs_find_next_str(const char *str, size_t point, size_t limit,
                                size_t *match_point, int *found_match,
-                               RegexSearch *);
+                               RegexSearch *, int exec_options);
+static int rs_is_continuation_byte(char);
 
 /* Initialise regex search */
 Status rs_init(RegexSearch *search, const SearchOptions *opt)
@@ -90,6 +92,11 @@ void rs_free(RegexSearch *search)
     }
 }
 
+size_t rs_memory_usage(const RegexSearch *search)
+{
+    return ru_compiled_size(search->regex, search->study);
+}
+
 Status rs_reinit(RegexSearch *search, const SearchOptions *opt)
 {
     rs_free(search);
@@ -119,7 +126,7 @@ Status rs_find_next(RegexSearch *search, const SearchOptions *opt,
 
     RETURN_IF_FAIL(rs_find_next_str(pos.data->text, pos.offset, limit, 
                                     data->match_point, data->found_match,
-                                    search));
+                                    search, 0));
 
     if (*data->found_match || *data->wrapped) {
         return STATUS_SUCCESS;
@@ -138,7 +145,7 @@ Status rs_find_next(RegexSearch *search, const SearchOptions *opt,
     RETURN_IF_FAIL(rs_find_next_str(pos.data->text, pos.offset,
                                     MIN(limit + regex_buffer, buffer_len),
                                     data->match_point, data->found_match,
-                                    search));
+                                    search, 0));
 
     return STATUS_SUCCESS;
 }
@@ -205,7 +212,7 @@ static Status rs_find_prev_str(const char *str, size_t str_len, size_t point,
             found = 0;
 
             status = rs_find_next_str(str, search_point, point + search_length,
-                                      match_point, &found, search);
+                                      match_point, &found, search, 0);
 
             if (found && *match_point < start_point) {
                 *found_match = 1;
@@ -232,7 +239,7 @@ static Status rs_find_prev_str(const char *str, size_t str_len, size_t point,
                  * it can simply be used at this point without the need
                  * for another search */
                 status = rs_find_next_str(str, mpoint, mpoint + mlength,
-                                          match_point, found_match, search);
+                                          match_point, found_match, search, 0);
             }
 
             return status;
@@ -242,12 +249,84 @@ static Status rs_find_prev_str(const char *str, size_t str_len, size_t point,
     return status;
 }
 
+/* Search contiguous text which isn't stored in a GapBuffer e.g. a memory
+ * mapped file. Only the output vector of the RegexSearch instance is written
+ * to, so threads can search simultaneously using their own copy of the
+ * instance. If check_utf8 is false the text must already be known to be
+ * valid UTF-8 e.g. from a previous search of the same text */
+Status rs_find_next_in_text(RegexSearch *search, const char *text,
+                            size_t point, size_t limit, int check_utf8,
+                            size_t *match_point, int *found_match)
+{
+    return rs_find_next_str(text, point, limit, match_point, found_match,
+                            search, check_utf8 ? 0 : PCRE_NO_UTF8_CHECK);
+}
+
+/* Find the next match starting in the range [point, limit) of text. Only the
+ * range and REGEX_BUFFER_SIZE bytes either side of it are passed to PCRE so
+ * that a large text can be searched a chunk at a time without the text
+ * preceding each chunk being rescanned. When check_utf8 is false the range
+ * must be within a range which has already been searched */
+Status rs_find_next_in_range(RegexSearch *search, const char *text,
+                             size_t text_len, size_t point, size_t limit,
+                             int check_utf8, size_t *match_point,
+                             int *found_match)
+{
+    size_t subject_start = point - MIN(point, REGEX_BUFFER_SIZE);
+    size_t subject_end = MIN(limit + REGEX_BUFFER_SIZE, text_len);
+    int exec_options = check_utf8 ? 0 : PCRE_NO_UTF8_CHECK;
+
+    /* The subject has to start and end on a character boundary */
+    while (subject_start < point &&
+           rs_is_continuation_byte(text[subject_start])) {
+        subject_start++;
+    }
+
+    while (subject_end > limit && subject_end < text_len &&
+           rs_is_continuation_byte(text[subject_end])) {
+        subject_end--;
+    }
+
+    /* Prevent ^ and $ matching at the edges of the subject unless they
+     * are also the edges of a line */
+    if (subject_start > 0 && text[subject_start - 1] != '\n') {
+        exec_options |= PCRE_NOTBOL;
+    }
+
+    if (subject_end < text_len && text[subject_end] != '\n') {
+        exec_options |= PCRE_NOTEOL;
+    }
+
+    *found_match = 0;
+
+    RETURN_IF_FAIL(rs_find_next_str(text + subject_start,
+                                    point - subject_start,
+                                    subject_end - subject_start,
+                                    match_point, found_match, search,
+                                    exec_options));
+
+    if (*found_match) {
+        *match_point += subject_start;
+
+        if (*match_point >= limit) {
+            *found_match = 0;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static int rs_is_continuation_byte(char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
 static Status rs_find_next_str(const char *str, size_t point, size_t limit,
                                size_t *match_point, int *found_match,
-                               RegexSearch *search)
+                               RegexSearch *search, int exec_options)
 {
     search->return_code = pcre_exec(search->regex, search->study, str, limit,
-                                    point, 0, search->output_vector,
+                                    point, exec_options, search->output_vector,
                                     OUTPUT_VECTOR_SIZE);
 
     if (search->return_code < 0) {
@@ -84,10 +84,17 @@ typedef struct {
 
 Status rs_init(RegexSearch *, const SearchOptions *);
 void rs_free(RegexSearch *);
+size_t rs_memory_usage(const RegexSearch *);
 Status rs_reinit(RegexSearch *, const SearchOptions *);
 Status rs_find_next(RegexSearch *search, const SearchOptions *opt,
                     SearchData *);
 Status rs_find_prev(RegexSearch *search, const SearchOptions *opt,
                     SearchData *);
+Status rs_find_next_in_text(RegexSearch *, const char *text, size_t point,
+                            size_t limit, int check_utf8, size_t *match_point,
+                            int *found_match);
+Status rs_find_next_in_range(RegexSearch *, const char *text, size_t text_len,
+                             size_t point, size_t limit, int check_utf8,
+                             size_t *match_point, int *found_match);
 
 #endif
@@ -95,6 +95,31 @@ void ru_free_instance(const RegexInstance *reg_inst)
     pcre_free(reg_inst->regex);
 }
 
+size_t ru_memory_usage(const RegexInstance *reg_inst)
+{
+    return ru_compiled_size(reg_inst->regex, reg_inst->regex_study);
+}
+
+/* The number of bytes PCRE has allocated for a compiled regex
+ * and its study data */
+size_t ru_compiled_size(const pcre *regex, const pcre_extra *study)
+{
+    if (regex == NULL) {
+        return 0;
+    }
+
+    size_t regex_size = 0;
+    size_t study_size = 0;
+
+    pcre_fullinfo(regex, NULL, PCRE_INFO_SIZE, &regex_size);
+
+    if (study != NULL) {
+        pcre_fullinfo(regex, study, PCRE_INFO_STUDYSIZE, &study_size);
+    }
+
+    return regex_size + study_size;
+}
+
 Status ru_exec(RegexResult *result, const RegexInstance *reg_inst,
                const char *str, size_t str_len, size_t start)
 {
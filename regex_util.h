@@ -49,6 +49,8 @@ Status ru_compile(RegexInstance *, const Regex *);
 Status ru_compile_custom_error_msg(RegexInstance *, const Regex *,
                                    const char *fmt, ...);
 void ru_free_instance(const RegexInstance *);
+size_t ru_memory_usage(const RegexInstance *);
+size_t ru_compiled_size(const pcre *, const pcre_extra *);
 Status ru_exec(RegexResult *, const RegexInstance *, const char *str,
                size_t str_len, size_t start);
 Status ru_exec_custom_error_msg(RegexResult *, const RegexInstance *,
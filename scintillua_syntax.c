@@ -41,6 +41,7 @@ SyntaxDefinition *sl_new(Session *sess)
     sl_def->syn_def.load = sl_load;
     sl_def->syn_def.generate_matches = sl_generate_matches;
     sl_def->syn_def.free = sl_free;
+    sl_def->syn_def.memory_usage = NULL;
 
     return (SyntaxDefinition *)sl_def;
 }
@@ -21,8 +21,15 @@
 #include <assert.h>
 #include "search.h"
 #include "util.h"
+#include "trace.h"
 
+static void bs_select_current_match(BufferSearch *,
+                                    const BufferPos *current_pos,
+                                    int forward);
 static int bs_set_match_index(BufferSearch *, size_t index);
+static Status bs_find_all_in_range(BufferSearch *, size_t start, size_t end,
+                                   BufferPos *pos, SearchMatches *);
+static size_t bs_next_char_offset(const GapBuffer *, size_t offset);
 
 Status bs_init(BufferSearch *search, const BufferPos *start_pos,
                const char *pattern, size_t pattern_len)
@@ -78,6 +85,8 @@ void bs_reset(BufferSearch *search, const BufferPos *start_pos)
     search->last_match_pos.line_no = 0;
     search->matches.match_num = 0;
     search->matches.current_match_index = 0;
+    search->incremental.started = 0;
+    search->incremental.active = 0;
 
     if (start_pos != NULL) {
         search->start_pos = *start_pos;
@@ -111,6 +120,30 @@ void bs_free(BufferSearch *search)
 
     search->opt.pattern = NULL;
     search->opt.pattern_len = 0;
+
+    free(search->incremental.scan_matches);
+    search->incremental.scan_matches = NULL;
+    search->incremental.active = 0;
+}
+
+size_t bs_matches_memory_usage(const BufferSearch *search)
+{
+    size_t bytes = sizeof(SearchMatches);
+
+    if (search->incremental.scan_matches != NULL) {
+        bytes += sizeof(SearchMatches);
+    }
+
+    return bytes;
+}
+
+size_t bs_regex_memory_usage(const BufferSearch *search)
+{
+    if (search->last_search_type != BST_REGEX) {
+        return 0;
+    }
+
+    return rs_memory_usage(&search->type.regex);
 }
 
 Status bs_find_next(BufferSearch *search, const BufferPos *current_pos,
@@ -212,6 +245,8 @@ size_t bs_match_length(const BufferSearch *search)
 
 Status bs_find_all(BufferSearch *search, const BufferPos *current_pos)
 {
+    TR_SPAN("bs_find_all");
+
     BufferPos pos = *current_pos;
     int orig_direction = search->opt.forward;
     bp_to_buffer_start(&pos);
@@ -250,10 +285,238 @@ Status bs_find_all(BufferSearch *search, const BufferPos *current_pos)
         search->wrapped = 0;
     }
 
-    if (!STATUS_IS_SUCCESS(status) || matches->match_num == 0) {
+    if (STATUS_IS_SUCCESS(status)) {
+        bs_select_current_match(search, current_pos, orig_direction);
+    }
+
+    return status;
+}
+
+/* Begin finding all matches incrementally. The visible region is searched
+ * immediately so that its matches can be displayed straight away. The rest
+ * of the buffer is then searched by calling bs_find_all_continue until
+ * bs_find_all_active returns false. Calling this function again (or any
+ * function which resets the search) cancels the previous search */
+Status bs_find_all_start(BufferSearch *search, const BufferPos *current_pos,
+                         const BufferPos *visible_start,
+                         const BufferPos *visible_end)
+{
+    assert(search != NULL);
+    assert(current_pos != NULL);
+    assert(visible_start != NULL);
+    assert(visible_end != NULL);
+
+    IncrementalSearch *incremental = &search->incremental;
+
+    if (incremental->scan_matches == NULL) {
+        incremental->scan_matches = malloc(sizeof(SearchMatches));
+
+        if (incremental->scan_matches == NULL) {
+            return OUT_OF_MEMORY("Unable to allocate search matches");
+        }
+    }
+
+    BufferPos pos = *current_pos;
+    bp_to_buffer_start(&pos);
+    bs_reset(search, &pos);
+
+    incremental->current_pos = *current_pos;
+    incremental->scan_pos = pos;
+    incremental->scan_offset = 0;
+    incremental->buffer_len = gb_length(pos.data);
+    incremental->scan_matches->match_num = 0;
+    incremental->scan_matches->current_match_index = 0;
+
+    pos = *visible_start;
+
+    RETURN_IF_FAIL(bs_find_all_in_range(search, visible_start->offset,
+                                        visible_end->offset, &pos,
+                                        &search->matches));
+
+    incremental->started = 1;
+    incremental->active = 1;
+
+    return STATUS_SUCCESS;
+}
+
+/* Search up to max_bytes more of the buffer. Once the whole buffer has been
+ * searched the matches found replace those found in the visible region and
+ * the search becomes equivalent to one performed by bs_find_all */
+Status bs_find_all_continue(BufferSearch *search, size_t max_bytes)
+{
+    assert(search != NULL);
+
+    IncrementalSearch *incremental = &search->incremental;
+
+    if (!incremental->active) {
+        return STATUS_SUCCESS;
+    }
+
+    const GapBuffer *data = incremental->scan_pos.data;
+    size_t buffer_len = gb_length(data);
+
+    if (buffer_len != incremental->buffer_len) {
+        /* The buffer has been modified since the search started so the
+         * matches found so far can't be relied upon */
+        bs_reset(search, NULL);
+        search->invalid = 1;
+        return STATUS_SUCCESS;
+    }
+
+    SearchMatches *scan_matches = incremental->scan_matches;
+    size_t end = incremental->scan_offset +
+                 MIN(max_bytes, buffer_len - incremental->scan_offset);
+
+    /* Chunks end on a character boundary */
+    while (end < buffer_len && (gb_get_at(data, end) & 0xC0) == 0x80) {
+        end++;
+    }
+
+    Status status = bs_find_all_in_range(search, incremental->scan_offset,
+                                         end, &incremental->scan_pos,
+                                         scan_matches);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        incremental->active = 0;
         return status;
     }
 
+    incremental->scan_offset = end;
+
+    if (end < buffer_len && scan_matches->match_num < MAX_SEARCH_MATCH_NUM) {
+        return STATUS_SUCCESS;
+    }
+
+    incremental->active = 0;
+
+    SearchMatches *matches = &search->matches;
+    memcpy(matches->match_ranges, scan_matches->match_ranges,
+           scan_matches->match_num * sizeof(Range));
+    matches->match_num = scan_matches->match_num;
+
+    if (matches->match_num == MAX_SEARCH_MATCH_NUM) {
+        search->finished = 0;
+        search->start_pos.line_no = 0;
+        search->wrapped = 0;
+    } else {
+        search->finished = 1;
+    }
+
+    bs_select_current_match(search, &incremental->current_pos,
+                            search->opt.forward);
+
+    return STATUS_SUCCESS;
+}
+
+int bs_find_all_started(const BufferSearch *search)
+{
+    return search->incremental.started;
+}
+
+int bs_find_all_active(const BufferSearch *search)
+{
+    return search->incremental.active;
+}
+
+/* The number of matches found so far. Whilst an incremental search is
+ * active this includes matches in the visible region which the scan of the
+ * whole buffer hasn't reached yet */
+size_t bs_find_all_match_num(const BufferSearch *search)
+{
+    const IncrementalSearch *incremental = &search->incremental;
+
+    if (!incremental->active) {
+        return search->matches.match_num;
+    }
+
+    size_t match_num = incremental->scan_matches->match_num;
+    const SearchMatches *matches = &search->matches;
+
+    for (size_t k = 0; k < matches->match_num; k++) {
+        if (matches->match_ranges[k].start.offset >=
+            incremental->scan_offset) {
+            match_num++;
+        }
+    }
+
+    return MIN(match_num, MAX_SEARCH_MATCH_NUM);
+}
+
+/* Add matches which start in the range [start, end) of the buffer. pos is
+ * advanced to each match found so must be at or before start */
+static Status bs_find_all_in_range(BufferSearch *search, size_t start,
+                                   size_t end, BufferPos *pos,
+                                   SearchMatches *matches)
+{
+    GapBuffer *data = (GapBuffer *)pos->data;
+    size_t buffer_len = gb_length(data);
+    size_t point = start;
+    size_t match_point;
+    size_t match_length;
+    int found_match;
+    int check_utf8 = 1;
+    Range *range;
+
+    gb_contiguous_storage(data);
+    end = MIN(end, buffer_len);
+
+    while (point < end && matches->match_num < MAX_SEARCH_MATCH_NUM) {
+        if (search->search_type == BST_TEXT) {
+            match_length = search->opt.pattern_len;
+            found_match = ts_find_next_in_text(&search->type.text, data->text,
+                                               point,
+                                               MIN(end + match_length - 1,
+                                                   buffer_len),
+                                               &match_point);
+        } else {
+            RETURN_IF_FAIL(rs_find_next_in_range(&search->type.regex,
+                                                 data->text, buffer_len,
+                                                 point, end, check_utf8,
+                                                 &match_point,
+                                                 &found_match));
+            match_length = search->type.regex.match_length;
+            /* The rest of the range has now been validated */
+            check_utf8 = 0;
+        }
+
+        if (!found_match) {
+            break;
+        }
+
+        bp_advance_to_offset(pos, match_point);
+        range = &matches->match_ranges[matches->match_num++];
+        range->start = range->end = *pos;
+        bp_advance_to_offset(&range->end, match_point + match_length);
+
+        point = bs_next_char_offset(data, match_point);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static size_t bs_next_char_offset(const GapBuffer *data, size_t offset)
+{
+    size_t buffer_len = gb_length(data);
+
+    do {
+        offset++;
+    } while (offset < buffer_len &&
+             (gb_get_at(data, offset) & 0xC0) == 0x80);
+
+    return offset;
+}
+
+/* Select the match which bs_find_next will move to from current_pos */
+static void bs_select_current_match(BufferSearch *search,
+                                    const BufferPos *current_pos,
+                                    int forward)
+{
+    SearchMatches *matches = &search->matches;
+
+    if (matches->match_num == 0) {
+        return;
+    }
+
     int start = 0;
     int end = matches->match_num - 1;
     size_t mid;
@@ -272,11 +535,11 @@ Status bs_find_all(BufferSearch *search, const BufferPos *current_pos)
         }
     }
 
-    if (orig_direction &&
+    if (forward &&
         bp_compare(current_pos, &matches->match_ranges[mid].start) > 0) {
         mid++;
         mid %= matches->match_num;        
-    } else if (!orig_direction &&
+    } else if (!forward &&
                bp_compare(current_pos,
                           &matches->match_ranges[mid].start) < 0) {
         if (mid == 0) {
@@ -286,7 +549,7 @@ Status bs_find_all(BufferSearch *search, const BufferPos *current_pos)
         } 
     }
 
-    if (orig_direction) {
+    if (forward) {
         if (mid == 0) {
             mid = matches->match_num - 1;
         } else {
@@ -298,8 +561,6 @@ Status bs_find_all(BufferSearch *search, const BufferPos *current_pos)
     }
 
     bs_set_match_index(search, mid);
-
-    return status;
 }
 
 static int bs_set_match_index(BufferSearch *search, size_t index)
@@ -43,6 +43,19 @@ typedef struct {
     size_t current_match_index; /* The current match displayed */
 } SearchMatches;
 
+/* State of an incremental search. All matches are found a chunk at a time
+ * so that input isn't blocked whilst a large buffer is searched */
+typedef struct {
+    int started; /* True if the current matches were found incrementally */
+    int active; /* True whilst part of the buffer remains to be searched */
+    BufferPos current_pos; /* Used to select the current match once the
+                              whole buffer has been searched */
+    BufferPos scan_pos; /* Position of the last match found by the scan */
+    size_t scan_offset; /* Offset the next chunk is searched from */
+    size_t buffer_len; /* Buffer length when the search started */
+    SearchMatches *scan_matches; /* Matches found by the scan so far */
+} IncrementalSearch;
+
 /* Search structure which abstracts text
  * and regex searches */
 struct BufferSearch {
@@ -69,6 +82,8 @@ struct BufferSearch {
     } type;
     /* When bs_find_all is called matches are stored in this structure */
     SearchMatches matches;
+    /* Used when matches are found incrementally by bs_find_all_start */
+    IncrementalSearch incremental;
 };
 
 typedef struct BufferSearch BufferSearch;
@@ -80,9 +95,18 @@ Status bs_reinit(BufferSearch *, const BufferPos *start_pos,
 void bs_reset(BufferSearch *, const BufferPos *start_pos);
 Status bs_init_default_opt(BufferSearch *);
 void bs_free(BufferSearch *);
+size_t bs_matches_memory_usage(const BufferSearch *);
+size_t bs_regex_memory_usage(const BufferSearch *);
 Status bs_find_next(BufferSearch *, const BufferPos *start_pos,
                     int *found_match);
 size_t bs_match_length(const BufferSearch *);
 Status bs_find_all(BufferSearch *, const BufferPos *current_pos);
+Status bs_find_all_start(BufferSearch *, const BufferPos *current_pos,
+                         const BufferPos *visible_start,
+                         const BufferPos *visible_end);
+Status bs_find_all_continue(BufferSearch *, size_t max_bytes);
+int bs_find_all_started(const BufferSearch *);
+int bs_find_all_active(const BufferSearch *);
+size_t bs_find_all_match_num(const BufferSearch *);
 
 #endif
@@ -20,6 +20,10 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "session.h"
 #include "status.h"
 #include "util.h"
@@ -29,9 +33,14 @@
 #include "build_config.h"
 #include "tui.h"
 #include "prompt_completer.h"
+#include "memory_info.h"
 
 #define MAX_EMPTY_BUFFER_NAME_SIZE 20
 #define FILE_TYPE_FILE_BUF_SIZE 128
+/* Maximum number of entries from each history saved in a snapshot */
+#define MAX_SNAPSHOT_HISTORY_NUM 100
+/* Directory below HOME journal files are stored in */
+#define JOURNAL_DIR "/.wed/journal"
 
 static const char *se_get_empty_buffer_name(Session *);
 static Status se_add_to_history(List *, const char *text);
@@ -42,6 +51,43 @@ static void se_determine_fileformat(Session *, Buffer *);
 static int se_is_valid_config_def(Session *, HashMap *, ConfigType,
                                   const char *def_name);
 static int se_add_buffer_from_stdin(Session *);
+static void se_free_buffer_jobs(Session *, const Buffer *);
+static void se_finish_job(Session *, Job *);
+static void se_free_buffer_file_search(Session *, const Buffer *);
+static Status se_write_file_search_results(Session *, FileSearch *);
+static void se_free_buffer_tail_follow(Session *, const Buffer *);
+static void se_append_buffer(Session *, Buffer *);
+static Status se_load_buffer_file(Session *, Buffer *, int is_stdin);
+static Status se_journal_buffer(Session *, Buffer *);
+static Status se_restore_snapshot(Session *, size_t *active_buffer_index);
+static Status se_add_deferred_buffer(Session *, const char *file_path,
+                                     const SnapshotBuffer *,
+                                     Buffer **buffer_ptr);
+static void se_restore_buffer_settings(Session *, Buffer *, const Snapshot *,
+                                       const SnapshotBuffer *);
+static void se_restore_buffer_search(Buffer *, const Snapshot *,
+                                     const SnapshotBuffer *);
+static DeferredBuffer *se_get_deferred_buffer(const Session *,
+                                              const Buffer *,
+                                              size_t *index_ptr);
+static Status se_load_deferred_buffer(Session *, Buffer *);
+static Status se_restore_buffer_positions(Buffer *, const DeferredBuffer *);
+static void se_free_deferred_buffer(Session *, const Buffer *);
+static Status se_unload_buffer(Session *, Buffer *);
+static void se_record_buffer_positions(const Buffer *, uint64_t *file_size,
+                                       uint64_t *hash,
+                                       uint64_t positions[SP_ENTRY_NUM]);
+static int se_can_unload_buffer(const Session *, const Buffer *);
+static void se_limit_buffer_memory(Session *);
+static void se_set_recent_buffer(Session *, Buffer *);
+static void se_remove_recent_buffer(Session *, const Buffer *);
+static Status se_add_snapshot_buffer(const Session *, SnapshotWriter *,
+                                     const Buffer *);
+static Status se_add_snapshot_search(SnapshotWriter *, const Buffer *);
+static Status se_add_snapshot_settings(const Session *, SnapshotWriter *,
+                                       const Buffer *);
+static Status se_add_snapshot_history(SnapshotWriter *, SnapshotHistory,
+                                      const List *history);
 
 Session *se_new(void)
 {
@@ -106,6 +152,8 @@ int se_init(Session *sess, const WedOpt *wed_opt, char *buffer_paths[],
         return 0;
     }
 
+    mc_init(&sess->macro);
+
     if ((sess->filetypes = new_hashmap()) == NULL) {
         return 0;
     }
@@ -134,6 +182,31 @@ int se_init(Session *sess, const WedOpt *wed_opt, char *buffer_paths[],
         return 0;
     }
 
+    if ((sess->dir_cache = dc_new()) == NULL) {
+        return 0;
+    }
+
+    const char *home_path = getenv("HOME");
+
+    /* Changes aren't journalled in test mode, so that tests don't write
+     * journals or offer to recover those left by wed. Bench mode still
+     * journals as it's part of the cost of each edit */
+    if (!is_null_or_empty(home_path) &&
+        (!sess->wed_opt.test_mode || sess->wed_opt.bench_mode)) {
+        char *journal_dir = concat(home_path, JOURNAL_DIR);
+
+        if (journal_dir == NULL) {
+            return 0;
+        }
+
+        sess->journal_writer = jn_new_writer(journal_dir);
+        free(journal_dir);
+
+        if (sess->journal_writer == NULL) {
+            return 0;
+        }
+    }
+
     if ((sess->themes = new_hashmap()) == NULL) {
         return 0;
     }
@@ -152,6 +225,26 @@ int se_init(Session *sess, const WedOpt *wed_opt, char *buffer_paths[],
         return 0;
     }
 
+    if ((sess->jobs = list_new()) == NULL) {
+        return 0;
+    }
+
+    if ((sess->file_searches = list_new()) == NULL) {
+        return 0;
+    }
+
+    if ((sess->tail_follows = list_new()) == NULL) {
+        return 0;
+    }
+
+    if ((sess->deferred_buffers = list_new()) == NULL) {
+        return 0;
+    }
+
+    if ((sess->recent_buffers = list_new()) == NULL) {
+        return 0;
+    }
+
 #if WED_FEATURE_LUA
     if ((sess->ls = ls_new(sess)) == 0) {
         return 0;
@@ -169,21 +262,40 @@ int se_init(Session *sess, const WedOpt *wed_opt, char *buffer_paths[],
     se_add_error(sess, ls_init(sess->ls));
 #endif
 
+    size_t active_buffer_index = 0;
+
+    if (sess->wed_opt.session_file_path != NULL &&
+        access(sess->wed_opt.session_file_path, F_OK) == 0) {
+        se_add_error(sess, se_restore_snapshot(sess, &active_buffer_index));
+    }
+
     if (buffer_num == 1 && strcmp("-", buffer_paths[0]) == 0) {
         if (!se_add_buffer_from_stdin(sess)) {
             warn("Failed to read from stdin");
             return 0;
         }
+
+        active_buffer_index = sess->buffer_num - 1;
     } else {
         Status status;
         int buffer_index;
+        Buffer *buffer;
 
         for (int k = 0; k < buffer_num; k++) {
             status = se_get_buffer_index_by_path(sess, buffer_paths[k],
                                                  &buffer_index);
 
+            /* Files are only loaded once their buffer is made active */
             if (STATUS_IS_SUCCESS(status) && buffer_index < 0) {
-                status = se_add_new_buffer(sess, buffer_paths[k], 0);
+                status = se_add_deferred_buffer(sess, buffer_paths[k], NULL,
+                                                &buffer);
+                buffer_index = sess->buffer_num - 1;
+            }
+
+            /* The first file specified on the command line is active
+             * rather than the buffer active when the snapshot was taken */
+            if (k == 0 && STATUS_IS_SUCCESS(status)) {
+                active_buffer_index = buffer_index;
             }
 
             se_add_error(sess, status);
@@ -194,7 +306,7 @@ int se_init(Session *sess, const WedOpt *wed_opt, char *buffer_paths[],
         se_add_new_empty_buffer(sess);
     }
 
-    if (!se_set_active_buffer(sess, 0)) {
+    if (!se_set_active_buffer(sess, active_buffer_index)) {
         return 0;
     }
 
@@ -211,6 +323,11 @@ int se_init(Session *sess, const WedOpt *wed_opt, char *buffer_paths[],
 
     se_add_error(sess, fe_read_cwd(sess->file_explorer));
 
+    if (sess->wed_opt.test_mode) {
+        /* Ensure the listing is complete so that results are consistent */
+        se_add_error(sess, fe_wait(sess->file_explorer));
+    }
+
     se_enable_msgs(sess);
 
     sess->initialised = 1;
@@ -224,6 +341,14 @@ void se_free(Session *sess)
         return;
     }
 
+    /* Jobs and searches reference buffers so must be freed first */
+    list_free_all_custom(sess->jobs, (ListEntryFree)jb_free);
+    list_free_all_custom(sess->file_searches, (ListEntryFree)fs_free);
+    list_free_all_custom(sess->tail_follows, (ListEntryFree)tf_free);
+    list_free_all(sess->deferred_buffers);
+    list_free(sess->recent_buffers);
+    pi_free(sess->project_index);
+
     Buffer *buffer = sess->buffers;
     Buffer *tmp;
 
@@ -233,11 +358,15 @@ void se_free(Session *sess)
         buffer = tmp;
     }
 
+    /* Freeing the buffers removed their journal files */
+    jn_free_writer(sess->journal_writer);
     ip_free(&sess->input_buffer);
     cm_free_key_map(&sess->key_map);
+    mc_free(&sess->macro);
     cf_free_config(sess->config);
     pr_free(sess->prompt, 1);
     fe_free(sess->file_explorer);
+    dc_free(sess->dir_cache);
     bf_free(sess->error_buffer);
     bf_free(sess->msg_buffer);
     list_free_all(sess->search_history);
@@ -279,11 +408,18 @@ int se_add_buffer(Session *sess, Buffer *buffer)
         se_enable_msgs(sess);
     }
 
+    se_append_buffer(sess, buffer);
+    
+    return 1;
+}
+
+static void se_append_buffer(Session *sess, Buffer *buffer)
+{
     sess->buffer_num++;
 
     if (sess->buffers == NULL) {
         sess->buffers = buffer;
-        return 1;
+        return;
     }
 
     Buffer *buff = sess->buffers;
@@ -296,8 +432,6 @@ int se_add_buffer(Session *sess, Buffer *buffer)
 
         buff = buff->next;
     } while (1);
-    
-    return 1;
 }
 
 int se_is_valid_buffer_index(const Session *sess, size_t buffer_index)
@@ -341,9 +475,36 @@ int se_set_active_buffer(Session *sess, size_t buffer_index)
          iter++;
     }
 
+    Status status = se_load_deferred_buffer(sess, buffer);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        se_add_error(sess, status);
+
+        /* The buffer couldn't be loaded so can't be displayed. The active
+         * buffer stays active unless it can't be displayed either, in
+         * which case an empty buffer is made active */
+        if (sess->active_buffer != NULL &&
+            bf_is_view_initialised(sess->active_buffer)) {
+            return 1;
+        }
+
+        status = se_add_new_empty_buffer(sess);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            se_add_error(sess, status);
+            return 0;
+        }
+
+        buffer_index = sess->buffer_num - 1;
+        buffer = se_get_buffer(sess, buffer_index);
+    }
+
     sess->active_buffer = buffer;
     sess->active_buffer_index = buffer_index;
     bf_set_is_draw_dirty(buffer, 1);
+    se_update_op_mode(sess);
+    se_set_recent_buffer(sess, buffer);
+    se_limit_buffer_memory(sess);
 
     return 1;
 }
@@ -415,10 +576,16 @@ int se_remove_buffer(Session *sess, Buffer *to_remove)
 
     sess->buffer_num--;
 
+    se_free_buffer_jobs(sess, buffer);
+    se_free_buffer_file_search(sess, buffer);
+    se_free_buffer_tail_follow(sess, buffer);
+    se_free_deferred_buffer(sess, buffer);
+    se_remove_recent_buffer(sess, buffer);
     bf_free(buffer);
 
-    if (sess->active_buffer != NULL) {
-        bf_set_is_draw_dirty(sess->active_buffer, 1);
+    if (sess->active_buffer != NULL &&
+        se_get_buffer_index(sess, sess->active_buffer, &buffer_index)) {
+        se_set_active_buffer(sess, buffer_index);
     }
 
     return 1;
@@ -460,6 +627,8 @@ int se_end_prompt(Session *sess)
     sess->active_buffer = prompt_buffer->next;
 
     cm_set_operation_mode(&sess->key_map, sess->key_map.prev_op_mode);
+    /* The active buffer may have been changed using the prompt */
+    se_update_op_mode(sess);
 
     return 1;
 }
@@ -600,7 +769,7 @@ Status se_add_new_buffer(Session *sess, const char *file_path, int is_stdin)
         goto cleanup;
     }
 
-    status = bf_load_file(buffer);
+    status = se_load_buffer_file(sess, buffer, is_stdin);
 
     if (!STATUS_IS_SUCCESS(status)) {
         goto cleanup;
@@ -620,6 +789,43 @@ cleanup:
     return status;
 }
 
+static Status se_load_buffer_file(Session *sess, Buffer *buffer, int is_stdin)
+{
+    size_t large_file_size = cf_int(sess->config, CV_LARGEFILE) *
+                             1024 * 1024;
+
+    if (!is_stdin && large_file_size > 0 &&
+        fi_file_exists(&buffer->file_info) &&
+        (size_t)buffer->file_info.file_stat.st_size >= large_file_size) {
+        return bf_load_large_file(buffer, LF_CHUNK_SIZE);
+    }
+
+    RETURN_IF_FAIL(bf_load_file(buffer));
+
+    if (is_stdin) {
+        return STATUS_SUCCESS;
+    }
+
+    return se_journal_buffer(sess, buffer);
+}
+
+/* Journal changes made to the buffer of a file so that they can be
+ * recovered if wed exits before they're saved. Large files aren't
+ * journalled as their changes are only applied when the window they were
+ * made in is loaded */
+static Status se_journal_buffer(Session *sess, Buffer *buffer)
+{
+    if (buffer->journal != NULL || sess->journal_writer == NULL ||
+        !cf_bool(sess->config, CV_JOURNAL) ||
+        bf_is_large_file(buffer) ||
+        !fi_file_exists(&buffer->file_info)) {
+        return STATUS_SUCCESS;
+    }
+
+    return jn_new(sess->journal_writer, buffer->file_info.abs_path,
+                  &buffer->file_info.file_stat, &buffer->journal);
+}
+
 static const char *se_get_empty_buffer_name(Session *sess)
 {
     static char empty_buf_name[MAX_EMPTY_BUFFER_NAME_SIZE];
@@ -773,10 +979,28 @@ Status se_add_filetype_def(Session *sess, FileType *file_type)
 static size_t se_populate_file_buf(const Buffer *buffer, char *file_buf,
                                    size_t file_buf_size)
 {
-    BufferPos pos_start = buffer->pos;
-    bp_to_buffer_start(&pos_start);
-    file_buf_size = bf_get_text(buffer, &pos_start, file_buf,
-                                file_buf_size - 1);
+    if (bf_is_view_initialised(buffer)) {
+        BufferPos pos_start = buffer->pos;
+        bp_to_buffer_start(&pos_start);
+        file_buf_size = bf_get_text(buffer, &pos_start, file_buf,
+                                    file_buf_size - 1);
+    } else {
+        /* The file of a deferred buffer isn't loaded, so read the start
+         * of the file instead */
+        FILE *file = NULL;
+
+        if (fi_file_exists(&buffer->file_info)) {
+            file = fopen(buffer->file_info.abs_path, "rb");
+        }
+
+        if (file == NULL) {
+            return 0;
+        }
+
+        file_buf_size = fread(file_buf, 1, file_buf_size - 1, file);
+        fclose(file);
+    }
+
     file_buf[file_buf_size] = '\0';
 
     if (file_buf_size == 0) {
@@ -808,15 +1032,13 @@ static size_t se_populate_file_buf(const Buffer *buffer, char *file_buf,
 static void se_determine_filetype(Session *sess, Buffer *buffer)
 {
     HashMap *filetypes = sess->filetypes;
-    size_t key_num = hashmap_size(filetypes);
-    const char **keys = hashmap_get_keys(filetypes);
 
-    if (key_num == 0) {
+    if (hashmap_size(filetypes) == 0) {
         return;
-    } else if (keys == NULL) {
-        se_add_error(sess, OUT_OF_MEMORY("Unable to generate filetypes set"));
     }
 
+    HashMapIterator iter;
+    void *value;
     FileType *file_type;
     int matches;
 
@@ -824,8 +1046,10 @@ static void se_determine_filetype(Session *sess, Buffer *buffer)
     size_t file_buf_size = se_populate_file_buf(buffer, file_buf,
                                                 FILE_TYPE_FILE_BUF_SIZE);
 
-    for (size_t k = 0; k < key_num; k++) {
-        file_type = hashmap_get(filetypes, keys[k]);
+    hashmap_iter_init(&iter, filetypes);
+
+    while (hashmap_iter_next(&iter, NULL, &value)) {
+        file_type = value;
 
         if (file_type != NULL) {
             se_add_error(sess, ft_matches(file_type, &buffer->file_info,
@@ -839,8 +1063,6 @@ static void se_determine_filetype(Session *sess, Buffer *buffer)
             }
         }
     }
-
-    free(keys);
 }
 
 int se_msgs_enabled(const Session *sess)
@@ -1084,3 +1306,1359 @@ const MouseClickEvent *se_get_last_mouse_click_event(const Session *sess)
     return ip_get_last_mouse_click_event(&sess->input_buffer);
 }
 
+int se_get_pasted_text(Session *sess, PastedText *pasted_text)
+{
+    return ip_get_pasted_text(&sess->input_buffer, pasted_text);
+}
+
+
+Status se_add_job(Session *sess, JobType type, const char *cmd,
+                  Buffer *buffer)
+{
+    const Job *running;
+
+    /* A filter job's output is discarded if its buffer is modified, and
+     * read output is inserted as a single change, so a buffer can only
+     * be written to by one job at a time */
+    for (size_t k = 0; k < list_size(sess->jobs); k++) {
+        running = list_get(sess->jobs, k);
+
+        if (running->buffer == buffer) {
+            return st_get_error(ERR_JOB_RUNNING,
+                                "Job %zu (%s) is already running on "
+                                "this buffer", running->id, running->cmd);
+        }
+    }
+
+    Job *job = jb_new(sess->job_num + 1, type, cmd, buffer, sess->config);
+
+    if (job == NULL) {
+        return OUT_OF_MEMORY("Unable to create job");
+    }
+
+    Status status = jb_start(job);
+    GOTO_IF_FAIL(status, cleanup);
+
+    if (sess->wed_opt.test_mode) {
+        /* Tests expect deterministic output so don't run jobs
+         * in the background */
+        status = jb_run_to_completion(job);
+        GOTO_IF_FAIL(status, cleanup);
+
+        status = jb_complete(job);
+        goto cleanup;
+    }
+
+    if (!list_add(sess->jobs, job)) {
+        status = OUT_OF_MEMORY("Unable to add job");
+        goto cleanup;
+    }
+
+    sess->job_num++;
+
+    char msg[MAX_MSG_SIZE];
+    snprintf(msg, sizeof(msg), "Job %zu started: %s", job->id, job->cmd);
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+
+cleanup:
+    jb_free(job);
+
+    return status;
+}
+
+int se_has_jobs(const Session *sess)
+{
+    return list_size(sess->jobs) > 0;
+}
+
+/* Returns true if a job has finished processing input and output
+ * but the command itself has yet to exit */
+int se_jobs_awaiting_exit(const Session *sess)
+{
+    for (size_t k = 0; k < list_size(sess->jobs); k++) {
+        if (jb_io_finished(list_get(sess->jobs, k))) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void se_add_job_fds(const Session *sess, fd_set *read_fds, fd_set *write_fds,
+                    int *max_fd)
+{
+    for (size_t k = 0; k < list_size(sess->jobs); k++) {
+        jb_add_fds(list_get(sess->jobs, k), read_fds, write_fds, max_fd);
+    }
+}
+
+/* Process any job file descriptors that are ready and complete any
+ * jobs that have exited. output_written is set true if output was
+ * inserted into a buffer. Returns the number of jobs completed */
+int se_process_jobs(Session *sess, const fd_set *read_fds,
+                    const fd_set *write_fds, int *output_written)
+{
+    int completed = 0;
+    size_t k = 0;
+    Job *job;
+    Status status;
+    int exited;
+    int job_output_written;
+
+    *output_written = 0;
+
+    while (k < list_size(sess->jobs)) {
+        job = list_get(sess->jobs, k);
+
+        if (!jb_io_finished(job)) {
+            status = jb_process(job, read_fds, write_fds,
+                                &job_output_written);
+            *output_written |= job_output_written;
+
+            if (!STATUS_IS_SUCCESS(status)) {
+                se_add_error(sess, status);
+                jb_cancel(job);
+            }
+        }
+
+        exited = 0;
+
+        if (jb_io_finished(job)) {
+            se_add_error(sess, jb_wait(job, &exited));
+        }
+
+        if (exited) {
+            list_remove_at(sess->jobs, k);
+            se_finish_job(sess, job);
+            completed++;
+        } else {
+            k++;
+        }
+    }
+
+    return completed;
+}
+
+static void se_finish_job(Session *sess, Job *job)
+{
+    se_add_error(sess, jb_complete(job));
+
+    int cmd_status = job->ec.cmd_status;
+    char msg[MAX_MSG_SIZE];
+
+    if (WIFEXITED(cmd_status)) {
+        snprintf(msg, sizeof(msg), "Job %zu (%s) finished with exit status %d",
+                 job->id, job->cmd, WEXITSTATUS(cmd_status));
+    } else if (WIFSIGNALED(cmd_status)) {
+        snprintf(msg, sizeof(msg), "Job %zu (%s) terminated by signal %d",
+                 job->id, job->cmd, WTERMSIG(cmd_status));
+    } else {
+        snprintf(msg, sizeof(msg), "Job %zu (%s) finished", job->id, job->cmd);
+    }
+
+    se_add_msg(sess, msg);
+
+    bf_set_is_draw_dirty(job->buffer, 1);
+    jb_free(job);
+}
+
+Status se_cancel_job(Session *sess, size_t job_id)
+{
+    Job *job;
+
+    for (size_t k = 0; k < list_size(sess->jobs); k++) {
+        job = list_get(sess->jobs, k);
+
+        if (job->id == job_id) {
+            jb_cancel(job);
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return st_get_error(ERR_INVALID_JOB_ID, "No job with id %zu", job_id);
+}
+
+/* Jobs write to their buffer when they complete, so cancel any jobs
+ * that reference a buffer which is being removed */
+static void se_free_buffer_jobs(Session *sess, const Buffer *buffer)
+{
+    size_t k = 0;
+    Job *job;
+
+    while (k < list_size(sess->jobs)) {
+        job = list_get(sess->jobs, k);
+
+        if (job->buffer == buffer) {
+            list_remove_at(sess->jobs, k);
+            jb_cancel(job);
+            jb_free(job);
+        } else {
+            k++;
+        }
+    }
+}
+
+Status se_add_file_search(Session *sess, Buffer *buffer, const char *dir_path,
+                          const SearchOptions *opt, int is_regex)
+{
+    FileSearch *fs = fs_new(dir_path, opt, is_regex);
+
+    if (fs == NULL) {
+        return OUT_OF_MEMORY("Unable to create file search");
+    }
+
+    fs->buffer = buffer;
+
+    Status status = fs_start(fs);
+    GOTO_IF_FAIL(status, cleanup);
+
+    if (!list_add(sess->file_searches, fs)) {
+        status = OUT_OF_MEMORY("Unable to add file search");
+        goto cleanup;
+    }
+
+    if (sess->wed_opt.test_mode) {
+        /* Don't return until the search has completed so that
+         * results are available to subsequent commands */
+        fs_wait(fs);
+        status = se_write_file_search_results(sess, fs);
+    }
+
+    se_update_op_mode(sess);
+
+    return status;
+
+cleanup:
+    fs_free(fs);
+
+    return status;
+}
+
+/* Returns the search writing results to buffer or NULL if buffer
+ * isn't a file search results buffer */
+FileSearch *se_get_file_search(const Session *sess, const Buffer *buffer)
+{
+    FileSearch *fs;
+
+    for (size_t k = 0; k < list_size(sess->file_searches); k++) {
+        fs = list_get(sess->file_searches, k);
+
+        if (fs->buffer == buffer) {
+            return fs;
+        }
+    }
+
+    return NULL;
+}
+
+void se_add_file_search_fds(const Session *sess, fd_set *read_fds,
+                            int *max_fd)
+{
+    FileSearch *fs;
+    int fd;
+
+    for (size_t k = 0; k < list_size(sess->file_searches); k++) {
+        fs = list_get(sess->file_searches, k);
+
+        if (!fs_finished(fs)) {
+            fd = fs_get_fd(fs);
+            FD_SET(fd, read_fds);
+            *max_fd = MAX(*max_fd, fd);
+        }
+    }
+}
+
+/* Write out the results of any searches which have notified that
+ * results are available. Returns the number of searches updated */
+int se_process_file_searches(Session *sess, const fd_set *read_fds)
+{
+    int updated = 0;
+    FileSearch *fs;
+
+    for (size_t k = 0; k < list_size(sess->file_searches); k++) {
+        fs = list_get(sess->file_searches, k);
+
+        if (!fs_finished(fs) && FD_ISSET(fs_get_fd(fs), read_fds)) {
+            se_add_error(sess, se_write_file_search_results(sess, fs));
+            updated++;
+        }
+    }
+
+    return updated;
+}
+
+static Status se_write_file_search_results(Session *sess, FileSearch *fs)
+{
+    Buffer *buffer = fs->buffer;
+    BufferPos write_pos = buffer->pos;
+    bp_to_buffer_end(&write_pos);
+
+    BufferOutputStream bos;
+    RETURN_IF_FAIL(bf_get_buffer_output_stream(&bos, buffer, &write_pos, 0));
+
+    Status status = fs_write_results(fs, (OutputStream *)&bos);
+    bos.os.close((OutputStream *)&bos);
+    bf_set_is_draw_dirty(buffer, 1);
+
+    RETURN_IF_FAIL(status);
+
+    if (fs_finished(fs)) {
+        char msg[MAX_MSG_SIZE];
+        snprintf(msg, sizeof(msg), "Found %zu matches in %zu files",
+                 fs_match_num(fs), fs_file_num(fs));
+        se_add_msg(sess, msg);
+
+        /* All threads have exited so only the matches need to be kept */
+        fs_wait(fs);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static void se_free_buffer_file_search(Session *sess, const Buffer *buffer)
+{
+    FileSearch *fs;
+
+    for (size_t k = 0; k < list_size(sess->file_searches); k++) {
+        fs = list_get(sess->file_searches, k);
+
+        if (fs->buffer == buffer) {
+            list_remove_at(sess->file_searches, k);
+            fs_free(fs);
+            return;
+        }
+    }
+}
+
+/* Build the index of files below the working directory used to find
+ * files by name, if it hasn't been built already */
+Status se_start_project_index(Session *sess)
+{
+    if (sess->project_index == NULL) {
+        if ((sess->project_index = pi_new(".")) == NULL) {
+            return OUT_OF_MEMORY("Unable to create project index");
+        }
+
+        RETURN_IF_FAIL(pi_start(sess->project_index));
+    }
+
+    if (sess->wed_opt.test_mode) {
+        /* Ensure the index is complete so that results are consistent */
+        return pi_wait(sess->project_index);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void se_add_project_index_fds(const Session *sess, fd_set *read_fds,
+                              int *max_fd)
+{
+    if (sess->project_index != NULL) {
+        pi_add_fds(sess->project_index, read_fds, max_fd);
+    }
+}
+
+/* Add files listed since the last call to the project index. Returns
+ * true if the files in the index changed */
+int se_process_project_index(Session *sess, const fd_set *read_fds)
+{
+    int updated = 0;
+
+    if (sess->project_index != NULL) {
+        se_add_error(sess, pi_process(sess->project_index, read_fds,
+                                      &updated));
+    }
+
+    return updated;
+}
+
+void se_add_file_explorer_fds(const Session *sess, fd_set *read_fds,
+                              int *max_fd)
+{
+    fe_add_fds(sess->file_explorer, read_fds, max_fd);
+}
+
+/* Add directory entries that have been read to the file explorer and
+ * apply changes to the directories it lists. Returns true if the
+ * file explorer changed */
+int se_process_file_explorer(Session *sess, const fd_set *read_fds)
+{
+    int updated = 0;
+    se_add_error(sess, fe_process(sess->file_explorer, read_fds, &updated));
+    return updated;
+}
+
+void se_add_dir_cache_fds(const Session *sess, fd_set *read_fds,
+                          int *max_fd)
+{
+    dc_add_fds(sess->dir_cache, read_fds, max_fd);
+}
+
+/* Path completion that was waiting for a directory to be read is run
+ * again, provided completion was the last thing the user did. Returns
+ * true if the prompt was updated */
+int se_process_dir_cache(Session *sess, const fd_set *read_fds)
+{
+    DirCache *dir_cache = sess->dir_cache;
+    int updated = 0;
+
+    se_add_error(sess, dc_process(dir_cache, read_fds, &updated));
+
+    if (!updated || !dir_cache->completion_pending) {
+        return 0;
+    }
+
+    dir_cache->completion_pending = 0;
+
+    const char *prev_key = se_get_prev_key(sess);
+    int reverse = strncmp(prev_key, "<S-Tab>", MAX_KEY_STR_SIZE) == 0;
+
+    if (!se_prompt_active(sess) ||
+        !(reverse || strncmp(prev_key, "<Tab>", MAX_KEY_STR_SIZE) == 0)) {
+        return 0;
+    }
+
+    se_add_error(sess, pc_run_prompt_completer(sess, sess->prompt, reverse));
+
+    return 1;
+}
+
+/* Index the next chunk of a large file. Files are indexed a chunk at a
+ * time between keypresses so that input is never blocked for long. Returns
+ * true if a chunk was indexed */
+int se_index_large_files(Session *sess)
+{
+    int index_pending;
+
+    for (Buffer *buffer = sess->buffers; buffer != NULL;
+         buffer = buffer->next) {
+        if (bf_is_large_file(buffer) &&
+            !lf_index_complete(buffer->large_file)) {
+            Status status = bf_index_large_file(buffer, &index_pending);
+
+            if (!STATUS_IS_SUCCESS(status)) {
+                se_add_error(sess, status);
+                return 0;
+            }
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Start following the file displayed in buffer, or stop following it if
+ * it's already followed. following is set to true if the file is now
+ * being followed */
+Status se_toggle_tail_follow(Session *sess, Buffer *buffer, int *following)
+{
+    TailFollow *tf;
+
+    for (size_t k = 0; k < list_size(sess->tail_follows); k++) {
+        tf = list_get(sess->tail_follows, k);
+
+        if (tf->buffer == buffer) {
+            list_remove_at(sess->tail_follows, k);
+            tf_free(tf);
+            *following = 0;
+
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if ((tf = tf_new(buffer)) == NULL) {
+        return OUT_OF_MEMORY("Unable to follow file");
+    }
+
+    Status status = tf_start(tf);
+    GOTO_IF_FAIL(status, cleanup);
+
+    if (!list_add(sess->tail_follows, tf)) {
+        status = OUT_OF_MEMORY("Unable to follow file");
+        goto cleanup;
+    }
+
+    /* The buffer content now follows the file rather than the changes
+     * made to it */
+    jn_free(buffer->journal);
+    buffer->journal = NULL;
+    *following = 1;
+
+    return STATUS_SUCCESS;
+
+cleanup:
+    tf_free(tf);
+
+    return status;
+}
+
+/* Returns true if a followed file can't be watched so has to be checked
+ * periodically */
+int se_tail_follow_requires_poll(const Session *sess)
+{
+    for (size_t k = 0; k < list_size(sess->tail_follows); k++) {
+        if (tf_requires_poll(list_get(sess->tail_follows, k))) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void se_add_tail_follow_fds(const Session *sess, fd_set *read_fds,
+                            int *max_fd)
+{
+    for (size_t k = 0; k < list_size(sess->tail_follows); k++) {
+        tf_add_fds(list_get(sess->tail_follows, k), read_fds, max_fd);
+    }
+}
+
+/* Add text appended to followed files to their buffers. A file that can't
+ * be read is no longer followed. read_pending is set to true if text
+ * remains to be read. Returns the number of buffers updated */
+int se_process_tail_follows(Session *sess, const fd_set *read_fds,
+                            int *read_pending)
+{
+    size_t max_lines = cf_int(sess->config, CV_FOLLOWLINES);
+    int updated = 0;
+    size_t k = 0;
+    TailFollowEvent event;
+    TailFollow *tf;
+    Status status;
+    char msg[MAX_MSG_SIZE];
+
+    *read_pending = 0;
+
+    while (k < list_size(sess->tail_follows)) {
+        tf = list_get(sess->tail_follows, k);
+        status = tf_process(tf, read_fds, max_lines, &event);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            se_add_error(sess, status);
+            list_remove_at(sess->tail_follows, k);
+            tf_free(tf);
+            updated++;
+            continue;
+        }
+
+        if (event == TFE_TRUNCATED || event == TFE_REPLACED) {
+            snprintf(msg, sizeof(msg), "%s %s, reading from start",
+                     tf->buffer->file_info.file_name,
+                     event == TFE_TRUNCATED ? "truncated" : "replaced");
+            se_add_msg(sess, msg);
+        }
+
+        if (event != TFE_NONE) {
+            updated++;
+        }
+
+        *read_pending |= tf->read_pending;
+        k++;
+    }
+
+    return updated;
+}
+
+static void se_free_buffer_tail_follow(Session *sess, const Buffer *buffer)
+{
+    TailFollow *tf;
+
+    for (size_t k = 0; k < list_size(sess->tail_follows); k++) {
+        tf = list_get(sess->tail_follows, k);
+
+        if (tf->buffer == buffer) {
+            list_remove_at(sess->tail_follows, k);
+            tf_free(tf);
+            return;
+        }
+    }
+}
+
+/* File search results buffers use their own key bindings and can't be
+ * modified, so switch operation mode when a results buffer becomes or
+ * stops being the active buffer */
+void se_update_op_mode(Session *sess)
+{
+    OperationMode op_mode = sess->key_map.op_mode;
+
+    if ((op_mode != OM_BUFFER && op_mode != OM_FILE_SEARCH) ||
+        sess->active_buffer == NULL) {
+        return;
+    }
+
+    OperationMode new_op_mode = OM_BUFFER;
+
+    if (se_get_file_search(sess, sess->active_buffer) != NULL) {
+        new_op_mode = OM_FILE_SEARCH;
+    }
+
+    if (new_op_mode == op_mode) {
+        return;
+    }
+
+    cm_set_operation_mode(&sess->key_map, new_op_mode);
+
+    if (new_op_mode == OM_FILE_SEARCH) {
+        se_exclude_command_type(sess, CMDT_BUFFER_MOD);
+    } else {
+        se_enable_command_type(sess, CMDT_BUFFER_MOD);
+    }
+}
+
+void se_set_bench(Session *sess, Bench *bench)
+{
+    sess->bench = bench;
+}
+
+int se_macro_recording(const Session *sess)
+{
+    return sess->macro_recording;
+}
+
+int se_macro_playing(const Session *sess)
+{
+    return sess->macro_playing;
+}
+
+/* Restore the buffers and histories saved in the session snapshot. Only
+ * the path and config of each buffer are restored, its file is loaded
+ * when the buffer is first made active. This way restoring a session
+ * doesn't depend on the number or size of the files open in it */
+static Status se_restore_snapshot(Session *sess, size_t *active_buffer_index)
+{
+    Snapshot snapshot;
+    RETURN_IF_FAIL(sn_open(&snapshot, sess->wed_opt.session_file_path));
+
+    List *histories[SH_ENTRY_NUM] = {
+        [SH_SEARCH] = sess->search_history,
+        [SH_REPLACE] = sess->replace_history,
+        [SH_COMMAND] = sess->command_history,
+        [SH_LINENO] = sess->lineno_history,
+        [SH_BUFFER] = sess->buffer_history
+    };
+
+    const SnapshotHeader *header = snapshot.header;
+    const SnapshotHistoryEntry *entry;
+    Status status = STATUS_SUCCESS;
+
+    for (size_t k = 0; k < header->history_num && STATUS_IS_SUCCESS(status);
+         k++) {
+        entry = &snapshot.history[k];
+        status = se_add_to_history(histories[entry->history],
+                                   sn_string(&snapshot, entry->text));
+    }
+
+    /* Relative paths are only valid when wed is started in the directory
+     * the snapshot was taken in */
+    char cwd[PATH_MAX];
+    int same_cwd = getcwd(cwd, sizeof(cwd)) != NULL &&
+                   strcmp(cwd, sn_string(&snapshot, header->cwd)) == 0;
+    const SnapshotBuffer *record;
+    const char *file_path;
+    Buffer *buffer;
+
+    for (size_t k = 0; k < header->buffer_num; k++) {
+        record = &snapshot.buffers[k];
+        file_path = sn_string(&snapshot, same_cwd ? record->rel_path :
+                                                    record->abs_path);
+
+        /* A file which can't be opened any more, for example because it
+         * has been replaced by a directory, is reported and the remaining
+         * buffers are still restored */
+        se_add_error(sess, se_add_deferred_buffer(sess, file_path, record,
+                                                  &buffer));
+
+        if (buffer == NULL) {
+            continue;
+        }
+
+        if (k == header->active_buffer_index) {
+            *active_buffer_index = sess->buffer_num - 1;
+        }
+
+        se_restore_buffer_settings(sess, buffer, &snapshot, record);
+        se_restore_buffer_search(buffer, &snapshot, record);
+    }
+
+    sn_close(&snapshot);
+
+    return status;
+}
+
+/* Add a buffer for a file without reading the file, other than to
+ * determine its filetype. When record is set the buffer is being restored
+ * from a snapshot and files which no longer exist are skipped */
+static Status se_add_deferred_buffer(Session *sess, const char *file_path,
+                                     const SnapshotBuffer *record,
+                                     Buffer **buffer_ptr)
+{
+    *buffer_ptr = NULL;
+
+    if (is_null_or_empty(file_path)) {
+        return st_get_error(ERR_INVALID_FILE_PATH,
+                            "Invalid file path - \"%s\"", file_path);
+    }
+
+    FileInfo file_info;
+    Status status;
+    RETURN_IF_FAIL(fi_init(&file_info, file_path));
+
+    if (record != NULL && !fi_file_exists(&file_info)) {
+        fi_free(&file_info);
+        return STATUS_SUCCESS;
+    } else if (fi_is_directory(&file_info)) {
+        status = st_get_error(ERR_FILE_IS_DIRECTORY,
+                              "%s is a directory", file_info.file_name);
+        fi_free(&file_info);
+        return status;
+    } else if (fi_is_special(&file_info)) {
+        status = st_get_error(ERR_FILE_IS_SPECIAL,
+                              "%s is not a regular file", file_info.file_name);
+        fi_free(&file_info);
+        return status;
+    }
+
+    Buffer *buffer = bf_new_unloaded(&file_info, sess->config);
+
+    if (buffer == NULL) {
+        fi_free(&file_info);
+        return OUT_OF_MEMORY("Unable to create buffer");
+    }
+
+    DeferredBuffer *deferred = malloc(sizeof(DeferredBuffer));
+
+    if (deferred == NULL || !list_add(sess->deferred_buffers, deferred)) {
+        free(deferred);
+        bf_free(buffer);
+        return OUT_OF_MEMORY("Unable to create buffer");
+    }
+
+    deferred->buffer = buffer;
+    deferred->file_size = 0;
+    deferred->hash = 0;
+
+    if (record != NULL) {
+        deferred->file_size = record->file_size;
+        deferred->hash = record->hash;
+        memcpy(deferred->positions, record->positions,
+               sizeof(deferred->positions));
+    }
+
+    /* The syntaxtype and fileformat are determined once the file is
+     * loaded */
+    int re_enable_msgs = se_disable_msgs(sess);
+
+    se_determine_filetype(sess, buffer);
+
+    if (re_enable_msgs) {
+        se_enable_msgs(sess);
+    }
+
+    se_append_buffer(sess, buffer);
+    *buffer_ptr = buffer;
+
+    return STATUS_SUCCESS;
+}
+
+static void se_restore_buffer_settings(Session *sess, Buffer *buffer,
+                                       const Snapshot *snapshot,
+                                       const SnapshotBuffer *record)
+{
+    const SnapshotSetting *setting;
+    ConfigVariable config_variable;
+
+    for (size_t k = 0; k < record->setting_num; k++) {
+        setting = &snapshot->settings[record->setting_start + k];
+
+        if (cf_str_to_var(sn_string(snapshot, setting->name),
+                          &config_variable) &&
+            (cf_get_config_levels(config_variable) & CL_BUFFER)) {
+            /* A setting can be invalid if the config it depends on has
+             * changed since the snapshot was taken, in which case it's
+             * ignored */
+            st_free_status(cf_set_var(CE_VAL(sess, buffer), CL_BUFFER,
+                                      config_variable,
+                                      sn_setting_value(snapshot, setting)));
+        }
+    }
+}
+
+/* Restore the last search of a buffer, so that commands which operate on
+ * the matches of the last search can be used and the next search uses the
+ * same options */
+static void se_restore_buffer_search(Buffer *buffer, const Snapshot *snapshot,
+                                     const SnapshotBuffer *record)
+{
+    BufferSearch *search = &buffer->search;
+    const char *pattern = sn_string(snapshot, record->search_pattern);
+
+    search->search_type = (record->search_flags & SS_REGEX) ?
+                          BST_REGEX : BST_TEXT;
+    search->opt.case_insensitive =
+        (record->search_flags & SS_CASE_INSENSITIVE) != 0;
+    search->opt.forward = (record->search_flags & SS_FORWARD) != 0;
+
+    if (*pattern != '\0') {
+        /* A regex which no longer compiles, for example because the regex
+         * library has changed, is ignored */
+        st_free_status(bs_reinit(search, NULL, pattern, strlen(pattern)));
+        /* As is the case once a find has finished */
+        search->invalid = 1;
+    }
+}
+
+static DeferredBuffer *se_get_deferred_buffer(const Session *sess,
+                                              const Buffer *buffer,
+                                              size_t *index_ptr)
+{
+    /* Only buffers without a view can be deferred */
+    if (bf_is_view_initialised(buffer)) {
+        return NULL;
+    }
+
+    const size_t deferred_num = list_size(sess->deferred_buffers);
+    DeferredBuffer *deferred;
+
+    for (size_t k = 0; k < deferred_num; k++) {
+        deferred = list_get(sess->deferred_buffers, k);
+
+        if (deferred->buffer == buffer) {
+            if (index_ptr != NULL) {
+                *index_ptr = k;
+            }
+
+            return deferred;
+        }
+    }
+
+    return NULL;
+}
+
+/* Load the file of a deferred buffer and create its view. Positions are
+ * only restored if the file's content hasn't changed since they were
+ * recorded. When the file can't be read the buffer stays deferred, as
+ * saving an empty or partially loaded buffer would overwrite the file */
+static Status se_load_deferred_buffer(Session *sess, Buffer *buffer)
+{
+    const DeferredBuffer *deferred = se_get_deferred_buffer(sess, buffer,
+                                                            NULL);
+
+    if (deferred == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    fi_refresh_file_attributes(&buffer->file_info);
+    Status status = bf_init_view(buffer);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = se_load_buffer_file(sess, buffer, 0);
+    }
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        /* Discards any text read and the view */
+        st_free_status(bf_unload(buffer));
+        return status;
+    }
+
+    int re_enable_msgs = se_disable_msgs(sess);
+
+    se_determine_filetypes_if_unset(sess, buffer);
+
+    if (!bf_is_large_file(buffer) && deferred->hash != 0 &&
+        deferred->file_size == gb_length(buffer->data) &&
+        deferred->hash == sn_hash_text(buffer->data)) {
+        se_add_error(sess, se_restore_buffer_positions(buffer, deferred));
+    } else {
+        se_determine_fileformat(sess, buffer);
+    }
+
+    if (re_enable_msgs) {
+        se_enable_msgs(sess);
+    }
+
+    se_free_deferred_buffer(sess, buffer);
+
+    return STATUS_SUCCESS;
+}
+
+static Status se_restore_buffer_positions(Buffer *buffer,
+                                          const DeferredBuffer *deferred)
+{
+    const size_t text_len = gb_length(buffer->data);
+    const uint64_t *positions = deferred->positions;
+
+    /* Unset positions are SN_NO_POSITION so are never within the text */
+    if (positions[SP_CURSOR] <= text_len) {
+        BufferPos pos = bp_init_from_offset(positions[SP_CURSOR],
+                                            &buffer->pos);
+        RETURN_IF_FAIL(bf_set_bp(buffer, &pos, 0));
+    }
+
+    if (positions[SP_SCREEN_START] <= text_len) {
+        buffer->bv->screen_start =
+            bp_init_from_offset(positions[SP_SCREEN_START], &buffer->pos);
+    }
+
+    if (positions[SP_SELECT_START] <= text_len) {
+        buffer->select_start =
+            bp_init_from_offset(positions[SP_SELECT_START], &buffer->pos);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static void se_free_deferred_buffer(Session *sess, const Buffer *buffer)
+{
+    size_t deferred_index;
+    DeferredBuffer *deferred = se_get_deferred_buffer(sess, buffer,
+                                                      &deferred_index);
+
+    if (deferred == NULL) {
+        return;
+    }
+
+    list_remove_at(sess->deferred_buffers, deferred_index);
+    free(deferred);
+}
+
+/* Record the positions in a buffer then unload it, so that only its file
+ * info and config remain in memory */
+static Status se_unload_buffer(Session *sess, Buffer *buffer)
+{
+    DeferredBuffer *deferred = malloc(sizeof(DeferredBuffer));
+
+    if (deferred == NULL || !list_add(sess->deferred_buffers, deferred)) {
+        free(deferred);
+        return OUT_OF_MEMORY("Unable to unload buffer");
+    }
+
+    deferred->buffer = buffer;
+    se_record_buffer_positions(buffer, &deferred->file_size, &deferred->hash,
+                               deferred->positions);
+
+    Status status = bf_unload(buffer);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        list_remove_at(sess->deferred_buffers,
+                       list_size(sess->deferred_buffers) - 1);
+        free(deferred);
+    }
+
+    return status;
+}
+
+static void se_record_buffer_positions(const Buffer *buffer,
+                                       uint64_t *file_size, uint64_t *hash,
+                                       uint64_t positions[SP_ENTRY_NUM])
+{
+    *file_size = gb_length(buffer->data);
+    *hash = sn_hash_text(buffer->data);
+    positions[SP_CURSOR] = buffer->pos.offset;
+    positions[SP_SCREEN_START] = buffer->bv->screen_start.offset;
+    positions[SP_SELECT_START] = SN_NO_POSITION;
+
+    if (bf_selection_started(buffer)) {
+        positions[SP_SELECT_START] = buffer->select_start.offset;
+    }
+}
+
+/* Only unmodified buffers displaying a file are unloaded, as they can be
+ * read from the file again. Buffers which jobs, file searches or tail
+ * follows write to stay loaded */
+static int se_can_unload_buffer(const Session *sess, const Buffer *buffer)
+{
+    if (buffer == sess->active_buffer ||
+        !bf_is_view_initialised(buffer) ||
+        bf_is_dirty(buffer) ||
+        bf_is_large_file(buffer) ||
+        !fi_file_exists(&buffer->file_info) ||
+        jn_recoverable(buffer->journal) ||
+        se_get_file_search(sess, buffer) != NULL) {
+        return 0;
+    }
+
+    const size_t job_num = list_size(sess->jobs);
+
+    for (size_t k = 0; k < job_num; k++) {
+        if (((Job *)list_get(sess->jobs, k))->buffer == buffer) {
+            return 0;
+        }
+    }
+
+    const size_t tail_follow_num = list_size(sess->tail_follows);
+
+    for (size_t k = 0; k < tail_follow_num; k++) {
+        if (((TailFollow *)list_get(sess->tail_follows, k))->buffer ==
+                buffer) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Unload the least recently active buffers until the memory used by
+ * buffers is within the buffermemory limit */
+static void se_limit_buffer_memory(Session *sess)
+{
+    const size_t memory_limit = cf_int(sess->config, CV_BUFFERMEMORY) *
+                                1024 * 1024;
+
+    if (memory_limit == 0) {
+        return;
+    }
+
+    BufferMemoryInfo info;
+    size_t memory_used = 0;
+
+    for (const Buffer *buffer = sess->buffers; buffer != NULL;
+         buffer = buffer->next) {
+        mi_buffer_memory_info(buffer, &info);
+        memory_used += mi_buffer_memory_total(&info);
+    }
+
+    const size_t buffer_num = list_size(sess->recent_buffers);
+    Buffer *buffer;
+    size_t buffer_memory;
+    Status status;
+
+    for (size_t k = 0; k < buffer_num && memory_used > memory_limit; k++) {
+        buffer = list_get(sess->recent_buffers, k);
+
+        if (!se_can_unload_buffer(sess, buffer)) {
+            continue;
+        }
+
+        mi_buffer_memory_info(buffer, &info);
+        buffer_memory = mi_buffer_memory_total(&info);
+        status = se_unload_buffer(sess, buffer);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            se_add_error(sess, status);
+            break;
+        }
+
+        mi_buffer_memory_info(buffer, &info);
+        memory_used -= buffer_memory - mi_buffer_memory_total(&info);
+    }
+}
+
+static void se_set_recent_buffer(Session *sess, Buffer *buffer)
+{
+    se_remove_recent_buffer(sess, buffer);
+    list_add(sess->recent_buffers, buffer);
+}
+
+static void se_remove_recent_buffer(Session *sess, const Buffer *buffer)
+{
+    const size_t buffer_num = list_size(sess->recent_buffers);
+
+    for (size_t k = buffer_num; k > 0; k--) {
+        if (list_get(sess->recent_buffers, k - 1) == buffer) {
+            list_remove_at(sess->recent_buffers, k - 1);
+            break;
+        }
+    }
+}
+
+/* Save the buffers, positions, searches and histories of the session, so
+ * that they can be restored when wed is next started with the same session
+ * file */
+Status se_save_snapshot(Session *sess)
+{
+    if (sess->wed_opt.session_file_path == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    SnapshotWriter writer;
+    sn_init_writer(&writer);
+    Status status = STATUS_SUCCESS;
+    char cwd[PATH_MAX];
+
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        status = sn_set_cwd(&writer, cwd);
+    }
+
+    const List *histories[SH_ENTRY_NUM] = {
+        [SH_SEARCH] = sess->search_history,
+        [SH_REPLACE] = sess->replace_history,
+        [SH_COMMAND] = sess->command_history,
+        [SH_LINENO] = sess->lineno_history,
+        [SH_BUFFER] = sess->buffer_history
+    };
+
+    for (size_t k = 0; k < SH_ENTRY_NUM && STATUS_IS_SUCCESS(status); k++) {
+        status = se_add_snapshot_history(&writer, k, histories[k]);
+    }
+
+    for (const Buffer *buffer = sess->buffers;
+         buffer != NULL && STATUS_IS_SUCCESS(status);
+         buffer = buffer->next) {
+        /* Buffers without a file, such as new unsaved buffers, can't be
+         * restored */
+        if (!fi_file_exists(&buffer->file_info)) {
+            continue;
+        }
+
+        if (buffer == sess->active_buffer) {
+            writer.header.active_buffer_index = writer.header.buffer_num;
+        }
+
+        status = se_add_snapshot_buffer(sess, &writer, buffer);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = sn_write(&writer, sess->wed_opt.session_file_path);
+    }
+
+    sn_free_writer(&writer);
+
+    return status;
+}
+
+static Status se_add_snapshot_buffer(const Session *sess,
+                                     SnapshotWriter *writer,
+                                     const Buffer *buffer)
+{
+    const FileInfo *file_info = &buffer->file_info;
+    SnapshotBuffer *record;
+
+    RETURN_IF_FAIL(sn_add_buffer(writer, file_info->rel_path,
+                                 file_info->abs_path, &record));
+
+    const DeferredBuffer *deferred = se_get_deferred_buffer(sess, buffer,
+                                                            NULL);
+
+    if (deferred != NULL) {
+        /* The file isn't loaded so keep the positions recorded when it
+         * was deferred */
+        record->file_size = deferred->file_size;
+        record->hash = deferred->hash;
+        memcpy(record->positions, deferred->positions,
+               sizeof(record->positions));
+    } else if (!bf_is_large_file(buffer)) {
+        /* Offsets in a large file are relative to the part of the file
+         * loaded, so positions aren't saved for large files */
+        se_record_buffer_positions(buffer, &record->file_size, &record->hash,
+                                   record->positions);
+    }
+
+    record->mtime = file_info->file_stat.st_mtime;
+
+    RETURN_IF_FAIL(se_add_snapshot_search(writer, buffer));
+
+    return se_add_snapshot_settings(sess, writer, buffer);
+}
+
+static Status se_add_snapshot_search(SnapshotWriter *writer,
+                                     const Buffer *buffer)
+{
+    const BufferSearch *search = &buffer->search;
+    const char *pattern = search->opt.pattern;
+    uint32_t search_flags = 0;
+
+    if (search->search_type == BST_REGEX) {
+        search_flags |= SS_REGEX;
+    }
+
+    if (search->opt.case_insensitive) {
+        search_flags |= SS_CASE_INSENSITIVE;
+    }
+
+    if (search->opt.forward) {
+        search_flags |= SS_FORWARD;
+    }
+
+    /* Strings in a snapshot are null terminated, so text patterns
+     * containing null bytes, which can be entered as hex escape
+     * sequences, aren't saved */
+    if (pattern != NULL && strlen(pattern) != search->opt.pattern_len) {
+        pattern = NULL;
+    }
+
+    return sn_set_search(writer, pattern, search_flags);
+}
+
+/* Only buffer variables whose value differs from the session's are saved,
+ * so changes made to the session config still apply to restored buffers */
+static Status se_add_snapshot_settings(const Session *sess,
+                                       SnapshotWriter *writer,
+                                       const Buffer *buffer)
+{
+    const Value *value;
+    int differs;
+
+    for (ConfigVariable k = 0; k < CV_ENTRY_NUM; k++) {
+        if (!(cf_get_config_levels(k) & CL_BUFFER)) {
+            continue;
+        }
+
+        value = &buffer->config->values[k];
+
+        if (value->type == VAL_TYPE_STR) {
+            differs = strcmp(SVAL(*value), cf_string(sess->config, k)) != 0;
+        } else if (value->type == VAL_TYPE_BOOL) {
+            differs = BVAL(*value) != cf_bool(sess->config, k);
+        } else if (value->type == VAL_TYPE_INT) {
+            differs = IVAL(*value) != cf_int(sess->config, k);
+        } else {
+            differs = 0;
+        }
+
+        if (differs) {
+            RETURN_IF_FAIL(sn_add_setting(writer, cf_get_var_name(k), *value));
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static Status se_add_snapshot_history(SnapshotWriter *writer,
+                                      SnapshotHistory snapshot_history,
+                                      const List *history)
+{
+    const size_t entry_num = list_size(history);
+    size_t k = 0;
+
+    if (entry_num > MAX_SNAPSHOT_HISTORY_NUM) {
+        k = entry_num - MAX_SNAPSHOT_HISTORY_NUM;
+    }
+
+    for (; k < entry_num; k++) {
+        RETURN_IF_FAIL(sn_add_history(writer, snapshot_history,
+                                      list_get(history, k)));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Called once a buffer has been written to its file, so that only changes
+ * made from now on are journalled */
+Status se_journal_saved_buffer(Session *sess, Buffer *buffer)
+{
+    Journal *journal = buffer->journal;
+
+    if (journal != NULL &&
+        strcmp(journal->file_path, buffer->file_info.abs_path) == 0) {
+        jn_reset(journal, &buffer->file_info.file_stat);
+        return STATUS_SUCCESS;
+    }
+
+    for (size_t k = 0; k < list_size(sess->tail_follows); k++) {
+        if (((TailFollow *)list_get(sess->tail_follows, k))->buffer ==
+                buffer) {
+            return STATUS_SUCCESS;
+        }
+    }
+
+    /* The buffer has been saved to a different file */
+    jn_free(journal);
+    buffer->journal = NULL;
+
+    RETURN_IF_FAIL(se_journal_buffer(sess, buffer));
+
+    /* A journal left by another session no longer applies to the file */
+    jn_decline_recovery(buffer->journal);
+
+    return STATUS_SUCCESS;
+}
+
+/* Replay the changes recorded in a journal left by a session which exited
+ * without saving them. The changes are grouped so that they can be undone
+ * together */
+Status se_recover_buffer(Session *sess, Buffer *buffer)
+{
+    Journal *journal = buffer->journal;
+
+    assert(jn_recoverable(journal));
+
+    if (bf_is_dirty(buffer)) {
+        jn_decline_recovery(journal);
+        return st_get_error(ERR_BUFFER_MODIFIED,
+                            "Unable to recover changes to modified buffer %s",
+                            buffer->file_info.file_name);
+    }
+
+    JournalReader reader;
+    Status status = jn_read(journal, &reader);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        jn_decline_recovery(journal);
+        return status;
+    }
+
+    /* The changes are journalled again as they're replayed */
+    jn_reset(journal, &buffer->file_info.file_stat);
+    bf_clear_cursors(buffer);
+    bf_select_reset(buffer);
+
+    status = bc_start_grouped_changes(&buffer->changes);
+
+    JournalChange change;
+    BufferPos pos;
+    size_t length;
+    size_t change_num = 0;
+
+    while (STATUS_IS_SUCCESS(status) && jn_next_change(&reader, &change)) {
+        length = bf_length(buffer);
+
+        if (change.offset > length ||
+            (change.change_type == TCT_DELETE &&
+             change.length > length - change.offset)) {
+            status = st_get_error(ERR_INVALID_JOURNAL,
+                                  "Recovery journal for %s doesn't match "
+                                  "file content",
+                                  buffer->file_info.file_name);
+            break;
+        }
+
+        pos = bp_init_from_offset(change.offset, &buffer->pos);
+        status = bf_set_bp(buffer, &pos, 0);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            break;
+        }
+
+        if (change.change_type == TCT_INSERT) {
+            status = bf_insert_string(buffer, change.str, change.length, 0);
+        } else {
+            status = bf_delete(buffer, change.length);
+        }
+
+        change_num++;
+    }
+
+    ONLY_OVERWRITE_SUCCESS(status, bc_end_grouped_changes(&buffer->changes));
+    jn_free_reader(&reader);
+
+    RETURN_IF_FAIL(status);
+
+    char msg[MAX_MSG_SIZE];
+    snprintf(msg, MAX_MSG_SIZE, "Recovered %zu change%s to %s", change_num,
+             change_num == 1 ? "" : "s", buffer->file_info.file_name);
+    se_add_msg(sess, msg);
+
+    return STATUS_SUCCESS;
+}
+
+/* Failures to write journals happen on the writer thread so are reported
+ * between key presses */
+void se_report_journal_errors(Session *sess)
+{
+    Buffer *buffer = sess->buffers;
+
+    while (buffer != NULL) {
+        se_add_error(sess, jn_get_error(buffer->journal));
+        buffer = buffer->next;
+    }
+}
+
+/* Write all journalled changes before exiting without freeing the session,
+ * so that they can be recovered */
+void se_sync_journals(Session *sess)
+{
+    jn_sync(sess->journal_writer);
+}
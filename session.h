@@ -33,6 +33,15 @@
 #include "command.h"
 #include "ui.h"
 #include "file_explorer.h"
+#include "job.h"
+#include "file_search.h"
+#include "project_index.h"
+#include "tail_follow.h"
+#include "dir_cache.h"
+#include "macro.h"
+#include "snapshot.h"
+#include "journal.h"
+#include "bench.h"
 
 #if WED_FEATURE_LUA
 #include "wed_lua.h"
@@ -40,6 +49,18 @@
 
 #define MAX_KEY_STR_SIZE 100
 
+/* A buffer whose file isn't loaded, so that it has no content or view.
+ * Files opened on start, buffers restored from a session snapshot and
+ * buffers unloaded to stay within the buffermemory limit are deferred
+ * until they're next made active */
+typedef struct {
+    Buffer *buffer; /* Deferred buffer */
+    uint64_t file_size; /* Content size when positions were recorded */
+    uint64_t hash; /* Content hash or 0 if there are no positions */
+    uint64_t positions[SP_ENTRY_NUM]; /* Offsets restored when the content
+                                         loaded is unchanged */
+} DeferredBuffer;
+
 /* Top level structure containing all state.
  * A new session is created when wed is invoked. */
 struct Session {
@@ -49,7 +70,7 @@ struct Session {
     Buffer *msg_buffer; /* Buffer which stores messages */
     KeyMap key_map; /* Maps keyboard inputs to commands */
     Clipboard clipboard; /* Handles copy and paste to system clipboard */
-    HashMap *config; /* Stores config variables */
+    struct Config *config; /* Stores config variables */
     Prompt *prompt; /* Used to control prompt */
     FileExplorer *file_explorer;
     CommandType exclude_cmd_types; /* Types of commands that shouldn't run */
@@ -76,6 +97,26 @@ struct Session {
     WedOpt wed_opt; /* Command line option values */
     UI *ui; /* UI interface */
     InputBuffer input_buffer; /* Input is buffered in this structure */
+    List *jobs; /* External commands running in the background */
+    size_t job_num; /* Number of jobs started, used to assign job ids */
+    List *file_searches; /* Searches writing results to a buffer */
+    ProjectIndex *project_index; /* Files below the working directory,
+                                    created when first needed */
+    List *tail_follows; /* Buffers following text appended to their file */
+    DirCache *dir_cache; /* Directories listed when completing paths */
+    Bench *bench; /* Records operation timings in bench mode */
+    Macro macro; /* The last keyboard macro recorded */
+    int macro_recording; /* True whilst the operations invoked by key
+                            presses are added to macro */
+    int macro_playing; /* True whilst macro is played */
+    size_t macro_step; /* The next step of macro to run whilst it's
+                          played */
+    List *deferred_buffers; /* Buffers whose file isn't loaded
+                               (DeferredBuffer *) */
+    List *recent_buffers; /* Buffers with the most recently active last */
+    JournalWriter *journal_writer; /* Writes the journals of buffers, or
+                                      NULL if HOME isn't set or in test
+                                      mode */
 #if WED_FEATURE_LUA
     LuaState *ls;
 #endif
@@ -133,5 +174,41 @@ void se_set_session_finished(Session *);
 const char *se_get_file_type_display_name(const Session *, const Buffer *);
 void se_determine_filetypes_if_unset(Session *, Buffer *);
 const MouseClickEvent *se_get_last_mouse_click_event(const Session *);
+int se_get_pasted_text(Session *, PastedText *);
+Status se_add_job(Session *, JobType, const char *cmd, Buffer *);
+int se_has_jobs(const Session *);
+int se_jobs_awaiting_exit(const Session *);
+void se_add_job_fds(const Session *, fd_set *read_fds, fd_set *write_fds,
+                    int *max_fd);
+int se_process_jobs(Session *, const fd_set *read_fds,
+                    const fd_set *write_fds, int *output_written);
+Status se_cancel_job(Session *, size_t job_id);
+Status se_add_file_search(Session *, Buffer *, const char *dir_path,
+                          const SearchOptions *, int is_regex);
+FileSearch *se_get_file_search(const Session *, const Buffer *);
+void se_add_file_search_fds(const Session *, fd_set *read_fds, int *max_fd);
+int se_process_file_searches(Session *, const fd_set *read_fds);
+Status se_start_project_index(Session *);
+void se_add_project_index_fds(const Session *, fd_set *read_fds, int *max_fd);
+int se_process_project_index(Session *, const fd_set *read_fds);
+void se_add_file_explorer_fds(const Session *, fd_set *read_fds, int *max_fd);
+int se_process_file_explorer(Session *, const fd_set *read_fds);
+void se_add_dir_cache_fds(const Session *, fd_set *read_fds, int *max_fd);
+int se_process_dir_cache(Session *, const fd_set *read_fds);
+int se_index_large_files(Session *);
+Status se_toggle_tail_follow(Session *, Buffer *, int *following);
+int se_tail_follow_requires_poll(const Session *);
+void se_add_tail_follow_fds(const Session *, fd_set *read_fds, int *max_fd);
+int se_process_tail_follows(Session *, const fd_set *read_fds,
+                            int *read_pending);
+void se_update_op_mode(Session *);
+void se_set_bench(Session *, Bench *);
+int se_macro_recording(const Session *);
+int se_macro_playing(const Session *);
+Status se_save_snapshot(Session *);
+Status se_journal_saved_buffer(Session *, Buffer *);
+Status se_recover_buffer(Session *, Buffer *);
+void se_report_journal_errors(Session *);
+void se_sync_journals(Session *);
 
 #endif
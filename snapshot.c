@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "util.h"
+
+/* Number of records each array initially has space for */
+#define SN_RECORDS_INIT 16
+/* Initial size of the string table */
+#define SN_STRINGS_INIT 4096
+/* Size of the chunks buffer content is hashed in */
+#define SN_HASH_CHUNK_SIZE (64 * 1024)
+#define SN_HASH_BASIS 0xcbf29ce484222325ULL
+#define SN_HASH_PRIME 0x100000001b3ULL
+
+static Status sn_add_string(SnapshotWriter *, const char *str,
+                            uint32_t *offset);
+static int sn_reserve(void **array, size_t *alloc, size_t num,
+                      size_t size);
+static int sn_write_section(FILE *, const void *data, size_t size);
+static int sn_valid_string(const Snapshot *, uint32_t offset);
+static uint64_t sn_hash(uint64_t hash, const unsigned char *data,
+                        size_t data_len);
+
+void sn_init_writer(SnapshotWriter *writer)
+{
+    memset(writer, 0, sizeof(SnapshotWriter));
+    memcpy(writer->header.magic, SN_MAGIC, sizeof(SN_MAGIC));
+    writer->header.version = SN_VERSION;
+}
+
+void sn_free_writer(SnapshotWriter *writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+
+    free(writer->buffers);
+    free(writer->settings);
+    free(writer->history);
+    free(writer->strings);
+    sn_init_writer(writer);
+}
+
+Status sn_set_cwd(SnapshotWriter *writer, const char *cwd)
+{
+    return sn_add_string(writer, cwd, &writer->header.cwd);
+}
+
+/* Add a buffer record. Settings added afterwards belong to this buffer.
+ * buffer_ptr is valid until the next buffer is added */
+Status sn_add_buffer(SnapshotWriter *writer, const char *rel_path,
+                     const char *abs_path, SnapshotBuffer **buffer_ptr)
+{
+    const size_t buffer_num = writer->header.buffer_num;
+
+    if (!sn_reserve((void **)&writer->buffers, &writer->buffer_alloc,
+                    buffer_num + 1, sizeof(SnapshotBuffer))) {
+        return OUT_OF_MEMORY("Unable to create snapshot");
+    }
+
+    SnapshotBuffer *buffer = &writer->buffers[buffer_num];
+    memset(buffer, 0, sizeof(SnapshotBuffer));
+    buffer->setting_start = writer->header.setting_num;
+
+    for (size_t k = 0; k < SP_ENTRY_NUM; k++) {
+        buffer->positions[k] = SN_NO_POSITION;
+    }
+
+    RETURN_IF_FAIL(sn_add_string(writer, rel_path, &buffer->rel_path));
+    RETURN_IF_FAIL(sn_add_string(writer, abs_path, &buffer->abs_path));
+
+    writer->header.buffer_num++;
+    *buffer_ptr = buffer;
+
+    return STATUS_SUCCESS;
+}
+
+/* Set the search pattern and options of the last buffer added */
+Status sn_set_search(SnapshotWriter *writer, const char *pattern,
+                     uint32_t search_flags)
+{
+    assert(writer->header.buffer_num > 0);
+
+    SnapshotBuffer *buffer = &writer->buffers[writer->header.buffer_num - 1];
+    buffer->search_flags = search_flags;
+
+    return sn_add_string(writer, pattern, &buffer->search_pattern);
+}
+
+/* Add a config variable to the last buffer added. Only bool, int and
+ * string values are stored */
+Status sn_add_setting(SnapshotWriter *writer, const char *name, Value value)
+{
+    assert(writer->header.buffer_num > 0);
+
+    if (value.type != VAL_TYPE_BOOL && value.type != VAL_TYPE_INT &&
+        value.type != VAL_TYPE_STR) {
+        return STATUS_SUCCESS;
+    }
+
+    const size_t setting_num = writer->header.setting_num;
+
+    if (!sn_reserve((void **)&writer->settings, &writer->setting_alloc,
+                    setting_num + 1, sizeof(SnapshotSetting))) {
+        return OUT_OF_MEMORY("Unable to create snapshot");
+    }
+
+    SnapshotSetting *setting = &writer->settings[setting_num];
+    memset(setting, 0, sizeof(SnapshotSetting));
+    setting->type = value.type;
+
+    RETURN_IF_FAIL(sn_add_string(writer, name, &setting->name));
+
+    if (value.type == VAL_TYPE_STR) {
+        RETURN_IF_FAIL(sn_add_string(writer, SVAL(value) != NULL ?
+                                             SVAL(value) : "",
+                                     &setting->sval));
+    } else {
+        setting->ival = IVAL(value);
+    }
+
+    writer->header.setting_num++;
+    writer->buffers[writer->header.buffer_num - 1].setting_num++;
+
+    return STATUS_SUCCESS;
+}
+
+Status sn_add_history(SnapshotWriter *writer, SnapshotHistory history,
+                      const char *text)
+{
+    const size_t history_num = writer->header.history_num;
+
+    if (!sn_reserve((void **)&writer->history, &writer->history_alloc,
+                    history_num + 1, sizeof(SnapshotHistoryEntry))) {
+        return OUT_OF_MEMORY("Unable to create snapshot");
+    }
+
+    SnapshotHistoryEntry *entry = &writer->history[history_num];
+    entry->history = history;
+
+    RETURN_IF_FAIL(sn_add_string(writer, text, &entry->text));
+
+    writer->header.history_num++;
+
+    return STATUS_SUCCESS;
+}
+
+/* The snapshot is written to a temporary file which then replaces
+ * file_path, so an existing snapshot is never left partially written and
+ * remains valid for anything that has it mapped */
+Status sn_write(const SnapshotWriter *writer, const char *file_path)
+{
+    char *tmp_path = concat(file_path, ".tmp");
+
+    if (tmp_path == NULL) {
+        return OUT_OF_MEMORY("Unable to write snapshot");
+    }
+
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file == NULL) {
+        Status status = st_get_error(ERR_UNABLE_TO_OPEN_FILE,
+                                     "Unable to open %s - %s",
+                                     tmp_path, strerror(errno));
+        free(tmp_path);
+        return status;
+    }
+
+    SnapshotHeader header = writer->header;
+    /* An empty writer still has a string table containing "" */
+    const char *strings = writer->strings != NULL ? writer->strings : "";
+    header.strings_size = writer->strings != NULL ?
+                          writer->header.strings_size : 1;
+
+    int success =
+        sn_write_section(file, &header, sizeof(SnapshotHeader)) &&
+        sn_write_section(file, writer->buffers,
+                         header.buffer_num * sizeof(SnapshotBuffer)) &&
+        sn_write_section(file, writer->settings,
+                         header.setting_num * sizeof(SnapshotSetting)) &&
+        sn_write_section(file, writer->history,
+                         header.history_num * sizeof(SnapshotHistoryEntry)) &&
+        sn_write_section(file, strings, header.strings_size);
+
+    success = fclose(file) == 0 && success;
+
+    if (success && rename(tmp_path, file_path) == 0) {
+        free(tmp_path);
+        return STATUS_SUCCESS;
+    }
+
+    Status status = st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE,
+                                 "Unable to write to %s - %s",
+                                 file_path, strerror(errno));
+    remove(tmp_path);
+    free(tmp_path);
+
+    return status;
+}
+
+/* Map a snapshot file into memory and check its records are consistent
+ * so that they can be used without further checks */
+Status sn_open(Snapshot *snapshot, const char *file_path)
+{
+    memset(snapshot, 0, sizeof(Snapshot));
+
+    int fd = open(file_path, O_RDONLY);
+
+    if (fd == -1) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_FILE,
+                            "Unable to open %s - %s",
+                            file_path, strerror(errno));
+    }
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) == -1 ||
+        (size_t)file_stat.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return st_get_error(ERR_INVALID_SNAPSHOT,
+                            "Invalid session snapshot %s", file_path);
+    }
+
+    void *map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE,
+                     fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return st_get_error(ERR_UNABLE_TO_READ_FILE,
+                            "Unable to read %s - %s",
+                            file_path, strerror(errno));
+    }
+
+    snapshot->map = map;
+    snapshot->map_size = file_stat.st_size;
+
+    const SnapshotHeader *header = map;
+    const char *data = map;
+    size_t offset = sizeof(SnapshotHeader);
+
+    snapshot->header = header;
+    snapshot->buffers = (const SnapshotBuffer *)(data + offset);
+    offset += (size_t)header->buffer_num * sizeof(SnapshotBuffer);
+    snapshot->settings = (const SnapshotSetting *)(data + offset);
+    offset += (size_t)header->setting_num * sizeof(SnapshotSetting);
+    snapshot->history = (const SnapshotHistoryEntry *)(data + offset);
+    offset += (size_t)header->history_num * sizeof(SnapshotHistoryEntry);
+    snapshot->strings = data + offset;
+
+    int valid = memcmp(header->magic, SN_MAGIC, sizeof(SN_MAGIC)) == 0 &&
+                header->version == SN_VERSION &&
+                header->strings_size > 0 &&
+                offset <= snapshot->map_size &&
+                header->strings_size == snapshot->map_size - offset &&
+                snapshot->strings[header->strings_size - 1] == '\0' &&
+                sn_valid_string(snapshot, header->cwd);
+
+    for (size_t k = 0; valid && k < header->buffer_num; k++) {
+        const SnapshotBuffer *buffer = &snapshot->buffers[k];
+        valid = sn_valid_string(snapshot, buffer->rel_path) &&
+                sn_valid_string(snapshot, buffer->abs_path) &&
+                sn_valid_string(snapshot, buffer->search_pattern) &&
+                buffer->setting_start <= header->setting_num &&
+                buffer->setting_num <= header->setting_num -
+                                       buffer->setting_start;
+    }
+
+    for (size_t k = 0; valid && k < header->setting_num; k++) {
+        valid = sn_valid_string(snapshot, snapshot->settings[k].name) &&
+                sn_valid_string(snapshot, snapshot->settings[k].sval);
+    }
+
+    for (size_t k = 0; valid && k < header->history_num; k++) {
+        valid = sn_valid_string(snapshot, snapshot->history[k].text) &&
+                snapshot->history[k].history < SH_ENTRY_NUM;
+    }
+
+    if (!valid) {
+        sn_close(snapshot);
+        return st_get_error(ERR_INVALID_SNAPSHOT,
+                            "Invalid session snapshot %s", file_path);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void sn_close(Snapshot *snapshot)
+{
+    if (snapshot->map != NULL) {
+        munmap(snapshot->map, snapshot->map_size);
+    }
+
+    memset(snapshot, 0, sizeof(Snapshot));
+}
+
+int sn_is_open(const Snapshot *snapshot)
+{
+    return snapshot->map != NULL;
+}
+
+const char *sn_string(const Snapshot *snapshot, uint32_t offset)
+{
+    return snapshot->strings + offset;
+}
+
+/* The value returned refers to the snapshot so must be copied */
+Value sn_setting_value(const Snapshot *snapshot,
+                       const SnapshotSetting *setting)
+{
+    if (setting->type == VAL_TYPE_STR) {
+        return STR_VAL((char *)sn_string(snapshot, setting->sval));
+    } else if (setting->type == VAL_TYPE_BOOL) {
+        return BOOL_VAL(setting->ival);
+    }
+
+    return INT_VAL(setting->ival);
+}
+
+/* Hash text a word at a time. Text is hashed in fixed size chunks so that
+ * the hash doesn't depend on where the gap is. 0 is never returned as it
+ * means no hash was taken */
+uint64_t sn_hash_text(const GapBuffer *text)
+{
+    static unsigned char chunk[SN_HASH_CHUNK_SIZE];
+    const size_t text_len = gb_length(text);
+    uint64_t hash = SN_HASH_BASIS;
+    size_t chunk_len;
+
+    for (size_t point = 0; point < text_len; point += chunk_len) {
+        chunk_len = gb_get_range(text, point, (char *)chunk,
+                                 SN_HASH_CHUNK_SIZE);
+
+        if (chunk_len == 0) {
+            break;
+        }
+
+        hash = sn_hash(hash, chunk, chunk_len);
+    }
+
+    return hash != 0 ? hash : 1;
+}
+
+/* Strings are appended to the string table, which starts with an empty
+ * string so that an offset of 0 is always valid */
+static Status sn_add_string(SnapshotWriter *writer, const char *str,
+                            uint32_t *offset)
+{
+    if (str == NULL || *str == '\0') {
+        *offset = 0;
+        return STATUS_SUCCESS;
+    }
+
+    size_t strings_size = writer->header.strings_size;
+
+    if (strings_size == 0) {
+        strings_size = 1;
+    }
+
+    const size_t str_size = strlen(str) + 1;
+
+    if (strings_size + str_size > UINT32_MAX) {
+        return st_get_error(ERR_INVALID_SNAPSHOT,
+                            "Session snapshot too large");
+    }
+
+    if (strings_size + str_size > writer->strings_alloc) {
+        size_t new_alloc = MAX(writer->strings_alloc * 2, SN_STRINGS_INIT);
+
+        while (strings_size + str_size > new_alloc) {
+            new_alloc *= 2;
+        }
+
+        char *strings = realloc(writer->strings, new_alloc);
+
+        if (strings == NULL) {
+            return OUT_OF_MEMORY("Unable to create snapshot");
+        }
+
+        strings[0] = '\0';
+        writer->strings = strings;
+        writer->strings_alloc = new_alloc;
+    }
+
+    memcpy(writer->strings + strings_size, str, str_size);
+    *offset = strings_size;
+    writer->header.strings_size = strings_size + str_size;
+
+    return STATUS_SUCCESS;
+}
+
+static int sn_reserve(void **array, size_t *alloc, size_t num, size_t size)
+{
+    if (num <= *alloc) {
+        return 1;
+    }
+
+    size_t new_alloc = MAX(*alloc * 2, SN_RECORDS_INIT);
+    void *new_array = realloc(*array, new_alloc * size);
+
+    if (new_array == NULL) {
+        return 0;
+    }
+
+    *array = new_array;
+    *alloc = new_alloc;
+
+    return 1;
+}
+
+static int sn_write_section(FILE *file, const void *data, size_t size)
+{
+    return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+static int sn_valid_string(const Snapshot *snapshot, uint32_t offset)
+{
+    return offset < snapshot->header->strings_size;
+}
+
+static uint64_t sn_hash(uint64_t hash, const unsigned char *data,
+                        size_t data_len)
+{
+    uint64_t word;
+    size_t k = 0;
+
+    for (; k + sizeof(word) <= data_len; k += sizeof(word)) {
+        memcpy(&word, data + k, sizeof(word));
+        hash = (hash ^ word) * SN_HASH_PRIME;
+        hash ^= hash >> 29;
+    }
+
+    for (; k < data_len; k++) {
+        hash = (hash ^ data[k]) * SN_HASH_PRIME;
+    }
+
+    return hash;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_SNAPSHOT_H
+#define WED_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "value.h"
+#include "gap_buffer.h"
+
+/* A session snapshot records the buffers open in a session along with
+ * their positions and config, and the session's histories, so that the
+ * session can be restored when wed is next started. The file consists of
+ * a header followed by arrays of fixed size records and a table of null
+ * terminated strings, each section aligned to 8 bytes. Records refer to
+ * strings by their offset in the string table. Restoring a snapshot maps
+ * the file into memory and reads the records in place, so nothing has to
+ * be parsed. Values are stored in native byte order */
+
+#define SN_MAGIC "WEDSNAP"
+#define SN_VERSION 2
+/* Position offset used when a position isn't set */
+#define SN_NO_POSITION UINT64_MAX
+
+/* Histories stored in a snapshot */
+typedef enum {
+    SH_SEARCH,
+    SH_REPLACE,
+    SH_COMMAND,
+    SH_LINENO,
+    SH_BUFFER,
+    SH_ENTRY_NUM
+} SnapshotHistory;
+
+/* Positions stored for each buffer */
+typedef enum {
+    SP_CURSOR,
+    SP_SCREEN_START,
+    SP_SELECT_START,
+    SP_ENTRY_NUM
+} SnapshotPosition;
+
+/* Flags describing the search options of a buffer */
+typedef enum {
+    SS_REGEX = 1, /* Regex rather than text search */
+    SS_CASE_INSENSITIVE = 1 << 1,
+    SS_FORWARD = 1 << 2
+} SnapshotSearch;
+
+typedef struct {
+    char magic[8]; /* SN_MAGIC */
+    uint32_t version; /* SN_VERSION */
+    uint32_t active_buffer_index; /* Index of the active buffer */
+    uint32_t buffer_num; /* Number of SnapshotBuffer records */
+    uint32_t setting_num; /* Number of SnapshotSetting records */
+    uint32_t history_num; /* Number of SnapshotHistoryEntry records */
+    uint32_t cwd; /* Working directory the snapshot was taken in */
+    uint64_t strings_size; /* Size of the string table */
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t rel_path; /* Path as entered by the user */
+    uint32_t abs_path; /* Absolute path */
+    uint32_t setting_start; /* Index of the buffer's first setting */
+    uint32_t setting_num; /* Number of settings */
+    uint32_t search_pattern; /* Last pattern searched for */
+    uint32_t search_flags; /* SnapshotSearch flags */
+    uint64_t file_size; /* Size of the file when the snapshot was taken */
+    int64_t mtime; /* Modification time of the file */
+    uint64_t hash; /* Hash of the buffer content or 0 if not hashed */
+    uint64_t positions[SP_ENTRY_NUM]; /* Byte offsets of positions */
+} SnapshotBuffer;
+
+/* A buffer config variable whose value differs from the session's */
+typedef struct {
+    uint32_t name; /* Variable name */
+    uint32_t type; /* Value type, VAL_TYPE_BOOL, VAL_TYPE_INT or
+                      VAL_TYPE_STR */
+    int64_t ival; /* Value of a bool or int */
+    uint32_t sval; /* Value of a string */
+    uint32_t pad;
+} SnapshotSetting;
+
+typedef struct {
+    uint32_t history; /* SnapshotHistory the entry belongs to */
+    uint32_t text; /* Entry text */
+} SnapshotHistoryEntry;
+
+/* A snapshot read from a file. The arrays point into the mapped file */
+typedef struct {
+    const SnapshotHeader *header;
+    const SnapshotBuffer *buffers;
+    const SnapshotSetting *settings;
+    const SnapshotHistoryEntry *history;
+    const char *strings;
+    void *map; /* Mapped file or NULL */
+    size_t map_size; /* Size of mapped file */
+} Snapshot;
+
+/* Builds a snapshot in memory so that it can be written in one go */
+typedef struct {
+    SnapshotHeader header;
+    SnapshotBuffer *buffers;
+    size_t buffer_alloc;
+    SnapshotSetting *settings;
+    size_t setting_alloc;
+    SnapshotHistoryEntry *history;
+    size_t history_alloc;
+    char *strings;
+    size_t strings_alloc;
+} SnapshotWriter;
+
+void sn_init_writer(SnapshotWriter *);
+void sn_free_writer(SnapshotWriter *);
+Status sn_set_cwd(SnapshotWriter *, const char *cwd);
+Status sn_add_buffer(SnapshotWriter *, const char *rel_path,
+                     const char *abs_path, SnapshotBuffer **buffer_ptr);
+Status sn_add_setting(SnapshotWriter *, const char *name, Value);
+Status sn_set_search(SnapshotWriter *, const char *pattern,
+                     uint32_t search_flags);
+Status sn_add_history(SnapshotWriter *, SnapshotHistory, const char *text);
+Status sn_write(const SnapshotWriter *, const char *file_path);
+Status sn_open(Snapshot *, const char *file_path);
+void sn_close(Snapshot *);
+int sn_is_open(const Snapshot *);
+const char *sn_string(const Snapshot *, uint32_t offset);
+Value sn_setting_value(const Snapshot *, const SnapshotSetting *);
+uint64_t sn_hash_text(const GapBuffer *);
+
+#endif
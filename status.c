@@ -87,6 +87,19 @@ static const char *st_default_error_messages[] = {
     [ERR_INVALID_FILE_EXPLORER_WIDTH]         = "Invalid file explorer width",
     [ERR_INVALID_SYNTAX_HORIZON]              = "Invalid syntax horizon",
     [ERR_INVALID_FILE_EXPLORER_POSITION]      = "Invalid file explorer position",
+    [ERR_INVALID_JOB_ID]                      = "Invalid job id",
+    [ERR_UNABLE_TO_SEARCH_FILES]              = "Unable to search files",
+    [ERR_NO_FILES_MATCH]                      = "No files match",
+    [ERR_TRACING_NOT_ENABLED]                 = "Tracing not enabled",
+    [ERR_INVALID_LARGEFILE]                   = "Invalid large file size",
+    [ERR_UNABLE_TO_FOLLOW_FILE]               = "Unable to follow file",
+    [ERR_INVALID_FOLLOWLINES]                 = "Invalid follow line limit",
+    [ERR_UNABLE_TO_PLAY_MACRO]                = "Unable to play macro",
+    [ERR_INVALID_SNAPSHOT]                    = "Invalid session snapshot",
+    [ERR_INVALID_BUFFERMEMORY]                = "Invalid buffer memory limit",
+    [ERR_BUFFER_MODIFIED]                     = "Buffer modified",
+    [ERR_INVALID_JOURNAL]                     = "Invalid recovery journal",
+    [ERR_JOB_RUNNING]                         = "Job already running",
     [ERR_ENTRY_NUM]                           = ""
 };
 
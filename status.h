@@ -132,6 +132,19 @@ typedef enum {
     ERR_INVALID_FILE_EXPLORER_WIDTH,
     ERR_INVALID_SYNTAX_HORIZON,
     ERR_INVALID_FILE_EXPLORER_POSITION,
+    ERR_INVALID_JOB_ID,
+    ERR_UNABLE_TO_SEARCH_FILES,
+    ERR_NO_FILES_MATCH,
+    ERR_TRACING_NOT_ENABLED,
+    ERR_INVALID_LARGEFILE,
+    ERR_UNABLE_TO_FOLLOW_FILE,
+    ERR_INVALID_FOLLOWLINES,
+    ERR_UNABLE_TO_PLAY_MACRO,
+    ERR_INVALID_SNAPSHOT,
+    ERR_INVALID_BUFFERMEMORY,
+    ERR_BUFFER_MODIFIED,
+    ERR_INVALID_JOURNAL,
+    ERR_JOB_RUNNING,
     ERR_ENTRY_NUM
 } ErrorCode;
 
@@ -73,6 +73,8 @@ struct SyntaxDefinition {
                                        const char *str, size_t str_len,
                                        size_t offset);
     void (*free)(SyntaxDefinition *);
+    /* Bytes used by compiled patterns. NULL if not tracked */
+    size_t (*memory_usage)(const SyntaxDefinition *);
 };
 
 int sy_str_to_token(SyntaxToken *, const char *token_str);
@@ -20,6 +20,7 @@
 #include <string.h>
 #include "tabbed_view.h"
 #include "config.h"
+#include "trace.h"
 
 static void tv_determine_view_dimensions(TabbedView *, const Session *);
 static Buffer *tv_get_active_editing_buffer(const Session *);
@@ -144,6 +145,7 @@ static Status tv_update_buffer_view(TabbedView *tv, const Session *sess)
     bv_update_view(sess, buffer);
 
     tv->bv = buffer->bv;
+    tv->line_no_offset = bf_line_no_offset(buffer);
     
     return STATUS_SUCCESS;
 }
@@ -155,7 +157,8 @@ static size_t tv_determine_line_no_width(const Buffer *buffer)
     }
 
     char lineno_str[50];
-    return snprintf(lineno_str, sizeof(lineno_str), "%zu ", bf_lines(buffer));
+    return snprintf(lineno_str, sizeof(lineno_str), "%zu ",
+                    bf_display_lines(buffer));
 }
 
 static size_t tv_determine_file_explorer_width(const Session *sess,
@@ -352,14 +355,16 @@ static size_t tv_status_pos_info(TabbedView *tv, const Session *sess,
     const BufferPos *pos = &buffer->pos;
     char rel_pos[5] = { '\0' };
 
-    size_t line_num = bf_lines(buffer);
-    size_t lines_above = screen_start->line_no - 1;
+    size_t line_no_offset = bf_line_no_offset(buffer);
+    size_t screen_line_no = screen_start->line_no + line_no_offset;
+    size_t line_num = bf_display_lines(buffer);
+    size_t lines_above = screen_line_no - 1;
     size_t lines_below;
 
-    if ((screen_start->line_no + bv->rows - 1) >= line_num) {
+    if ((screen_line_no + bv->rows - 1) >= line_num) {
         lines_below = 0; 
     } else {
-        lines_below = line_num - (screen_start->line_no + bv->rows - 1);
+        lines_below = line_num - (screen_line_no + bv->rows - 1);
     }
 
     if (lines_below == 0) {
@@ -377,7 +382,7 @@ static size_t tv_status_pos_info(TabbedView *tv, const Session *sess,
     }
 
     char buf_size[64];
-    bytes_to_str(bf_length(buffer), buf_size, sizeof(buf_size));
+    bytes_to_str(bf_display_length(buffer), buf_size, sizeof(buf_size));
 
     const char *file_type_name = se_get_file_type_display_name(sess, buffer);
 
@@ -388,18 +393,36 @@ static size_t tv_status_pos_info(TabbedView *tv, const Session *sess,
     const char *file_format =
         bf_get_fileformat(buffer) == FF_UNIX ? "LF" : "CRLF";
 
+    /* Frame time overlay: last, average and p99 redraw time */
+    char frame_info[64] = { '\0' };
+
+#if WED_FEATURE_TRACE
+    if (tr_overlay_enabled()) {
+        FrameStats stats;
+        tr_get_frame_stats(&stats);
+        snprintf(frame_info, sizeof(frame_info),
+                 "frame %.1f avg %.1f p99 %.1f ms | ",
+                 stats.last, stats.average, stats.p99);
+    }
+#endif
+
     /* Attempt to print as much info as space allows */
 
+    const char *select_mode = buffer->block_select ? "Block | " : "";
+    const char *large_file = bf_is_large_file(buffer) ? "Large | " : "";
+
     int pos_info_size = snprintf(tv->status_bar[2],
                                  MAX_STATUS_BAR_SECTION_WIDTH,
-                                 "%s | %s | %s | %zu:%zu | %s",
+                                 "%s%s%s%s | %s | %s | %zu:%zu | %s",
+                                 frame_info, large_file, select_mode,
                                  buf_size, file_type_name, file_format,
-                                 pos->line_no, pos->col_no,
+                                 pos->line_no + line_no_offset, pos->col_no,
                                  rel_pos);
 
     if (pos_info_size < 0 || (size_t)pos_info_size > max_segment_width) {
         pos_info_size = snprintf(tv->status_bar[2], max_segment_width, 
-                                 "%zu:%zu ", pos->line_no, pos->col_no);
+                                 "%s%zu:%zu ", frame_info,
+                                 pos->line_no + line_no_offset, pos->col_no);
     }
 
     return pos_info_size;
@@ -55,6 +55,8 @@ typedef struct {
  * is eventually drawn to a window */
 typedef struct {
     BufferView *bv; /* The active buffers display data */
+    size_t line_no_offset; /* Added to displayed line numbers when only part
+                              of a large file is loaded */
     /* A list of buffer tab names to be displayed along the top of the
      * display */
     char buffer_tabs[MAX_VISIBLE_BUFFER_TABS][MAX_BUFFER_TAB_WIDTH];
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "tail_follow.h"
+#include "buffer.h"
+#include "util.h"
+
+/* Size of each read from the file */
+#define TF_READ_BUF_SIZE (64 * 1024)
+
+#ifdef __linux__
+/* Events which indicate the file may have grown, been truncated or been
+ * moved away */
+#define TF_FILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | \
+                        IN_DELETE_SELF)
+/* Events which indicate a new file may have replaced the file */
+#define TF_DIR_EVENTS (IN_CREATE | IN_MOVED_TO)
+#endif
+
+static Status tf_open(TailFollow *);
+static void tf_watch(TailFollow *, int watch_dir);
+static int tf_read_watch_events(TailFollow *);
+static Status tf_update(TailFollow *, size_t max_lines, TailFollowEvent *);
+static Status tf_reset_buffer(TailFollow *, TailFollowEvent);
+static Status tf_read_appended(TailFollow *, off_t file_size,
+                               TailFollowEvent *);
+
+TailFollow *tf_new(Buffer *buffer)
+{
+    TailFollow *tf = malloc(sizeof(TailFollow));
+    RETURN_IF_NULL(tf);
+
+    memset(tf, 0, sizeof(TailFollow));
+    tf->buffer = buffer;
+    tf->fd = -1;
+    tf->watch_fd = -1;
+
+    if ((tf->read_buf = malloc(TF_READ_BUF_SIZE)) == NULL) {
+        free(tf);
+        return NULL;
+    }
+
+    return tf;
+}
+
+void tf_free(TailFollow *tf)
+{
+    if (tf == NULL) {
+        return;
+    }
+
+    if (tf->fd != -1) {
+        close(tf->fd);
+    }
+
+    if (tf->watch_fd != -1) {
+        close(tf->watch_fd);
+    }
+
+    free(tf->read_buf);
+    free(tf);
+}
+
+/* Start following the file from the point it was last read or written.
+ * Anything appended since then is added to the buffer straight away */
+Status tf_start(TailFollow *tf)
+{
+    Buffer *buffer = tf->buffer;
+    FileInfo *file_info = &buffer->file_info;
+
+    if (bf_is_large_file(buffer)) {
+        return st_get_error(ERR_UNABLE_TO_FOLLOW_FILE,
+                            "Unable to follow large files");
+    } else if (!fi_has_file_path(file_info) ||
+               !fi_check_file_exists(file_info)) {
+        return st_get_error(ERR_UNABLE_TO_FOLLOW_FILE,
+                            "Buffer has no file to follow");
+    } else if (fi_is_special(file_info)) {
+        return st_get_error(ERR_UNABLE_TO_FOLLOW_FILE,
+                            "Unable to follow special file %s",
+                            file_info->file_name);
+    }
+
+    off_t read_offset = file_info->file_stat.st_size;
+    dev_t dev = file_info->file_stat.st_dev;
+    ino_t ino = file_info->file_stat.st_ino;
+
+    RETURN_IF_FAIL(tf_open(tf));
+
+#ifdef __linux__
+    /* Without inotify the file is checked periodically instead */
+    tf->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    tf_watch(tf, 1);
+#endif
+
+    TailFollowEvent event;
+
+    if (tf->dev == dev && tf->ino == ino) {
+        tf->read_offset = read_offset;
+    } else if (bf_is_dirty(buffer)) {
+        return st_get_error(ERR_UNABLE_TO_FOLLOW_FILE,
+                            "File %s has been replaced since it was "
+                            "loaded, save or reload it before following",
+                            file_info->file_name);
+    } else {
+        /* The file was replaced after it was loaded */
+        RETURN_IF_FAIL(tf_reset_buffer(tf, TFE_REPLACED));
+    }
+
+    return tf_update(tf, 0, &event);
+}
+
+static Status tf_open(TailFollow *tf)
+{
+    FileInfo *file_info = &tf->buffer->file_info;
+    struct stat file_stat;
+
+    if ((tf->fd = open(file_info->abs_path, O_RDONLY | O_CLOEXEC)) == -1) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_FILE,
+                            "Unable to open file %s for reading - %s",
+                            file_info->file_name, strerror(errno));
+    }
+
+    if (fstat(tf->fd, &file_stat) == -1) {
+        Status status = st_get_error(ERR_UNABLE_TO_READ_FILE,
+                                     "Unable to read from file %s - %s",
+                                     file_info->file_name, strerror(errno));
+        close(tf->fd);
+        tf->fd = -1;
+
+        return status;
+    }
+
+    tf->dev = file_stat.st_dev;
+    tf->ino = file_stat.st_ino;
+    tf->read_offset = 0;
+    tf->read_pending = 0;
+
+    return STATUS_SUCCESS;
+}
+
+/* Watch the file, which has to be done again when it's replaced as the
+ * watch refers to the file not the path. The directory is watched so that
+ * a file created in place of the one followed is noticed */
+static void tf_watch(TailFollow *tf, int watch_dir)
+{
+#ifdef __linux__
+    if (tf->watch_fd == -1) {
+        return;
+    }
+
+    const FileInfo *file_info = &tf->buffer->file_info;
+
+    /* Failure, for example because the watch limit has been reached,
+     * only means changes are noticed later */
+    inotify_add_watch(tf->watch_fd, file_info->abs_path, TF_FILE_EVENTS);
+
+    if (!watch_dir) {
+        return;
+    }
+
+    char *dir_path = strdup(file_info->abs_path);
+
+    if (dir_path != NULL) {
+        char *file_name = strrchr(dir_path, '/');
+
+        if (file_name != NULL) {
+            *(file_name == dir_path ? file_name + 1 : file_name) = '\0';
+            inotify_add_watch(tf->watch_fd, dir_path, TF_DIR_EVENTS);
+        }
+
+        free(dir_path);
+    }
+#else
+    (void)tf;
+    (void)watch_dir;
+#endif
+}
+
+void tf_add_fds(const TailFollow *tf, fd_set *read_fds, int *max_fd)
+{
+    if (tf->watch_fd != -1) {
+        FD_SET(tf->watch_fd, read_fds);
+        *max_fd = MAX(*max_fd, tf->watch_fd);
+    }
+}
+
+/* Returns true if the file isn't watched so has to be checked
+ * periodically */
+int tf_requires_poll(const TailFollow *tf)
+{
+    return tf->watch_fd == -1;
+}
+
+/* Returns true if any events were read */
+static int tf_read_watch_events(TailFollow *tf)
+{
+#ifdef __linux__
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t bytes_read;
+    int changed = 0;
+
+    /* The state of the file is checked directly so the individual
+     * events are discarded */
+    while ((bytes_read = read(tf->watch_fd, buf, sizeof(buf))) > 0 ||
+           (bytes_read == -1 && errno == EINTR)) {
+        if (bytes_read > 0) {
+            changed = 1;
+        }
+    }
+
+    return changed;
+#else
+    (void)tf;
+    return 0;
+#endif
+}
+
+/* Add any text appended to the file to the buffer. Lines are then removed
+ * from the start of the buffer if it has more than max_lines, unless
+ * max_lines is 0 */
+Status tf_process(TailFollow *tf, const fd_set *read_fds, size_t max_lines,
+                  TailFollowEvent *event)
+{
+    *event = TFE_NONE;
+
+    if (tf->watch_fd != -1 && !tf->read_pending &&
+        !(FD_ISSET(tf->watch_fd, read_fds) && tf_read_watch_events(tf))) {
+        return STATUS_SUCCESS;
+    }
+
+    return tf_update(tf, max_lines, event);
+}
+
+static Status tf_update(TailFollow *tf, size_t max_lines,
+                        TailFollowEvent *event)
+{
+    FileInfo *file_info = &tf->buffer->file_info;
+    struct stat path_stat;
+    struct stat file_stat;
+    int path_exists = (stat(file_info->abs_path, &path_stat) == 0);
+
+    if (tf->fd != -1) {
+        if (fstat(tf->fd, &file_stat) == -1) {
+            return st_get_error(ERR_UNABLE_TO_READ_FILE,
+                                "Unable to read from file %s - %s",
+                                file_info->file_name, strerror(errno));
+        }
+
+        if (path_exists && path_stat.st_dev == tf->dev &&
+            path_stat.st_ino == tf->ino) {
+            if (file_stat.st_size < tf->read_offset) {
+                RETURN_IF_FAIL(tf_reset_buffer(tf, TFE_TRUNCATED));
+                *event = TFE_TRUNCATED;
+            }
+
+            RETURN_IF_FAIL(tf_read_appended(tf, file_stat.st_size, event));
+        } else {
+            /* The file has been moved or deleted. Anything written to it
+             * beforehand is read before switching to a new file */
+            RETURN_IF_FAIL(tf_read_appended(tf, file_stat.st_size, event));
+
+            if (!tf->read_pending) {
+                close(tf->fd);
+                tf->fd = -1;
+            }
+        }
+    }
+
+    if (tf->fd == -1 && path_exists) {
+        /* The new file replaces the old file's content rather than being
+         * appended to it */
+        RETURN_IF_FAIL(tf_reset_buffer(tf, TFE_REPLACED));
+        RETURN_IF_FAIL(tf_open(tf));
+        tf_watch(tf, 0);
+        *event = TFE_REPLACED;
+
+        RETURN_IF_FAIL(tf_read_appended(tf, path_stat.st_size, event));
+    }
+
+    if (tf->fd != -1) {
+        /* Keep the file size in sync with the buffer content so that it
+         * can be followed again from the same point */
+        file_info->file_stat.st_dev = tf->dev;
+        file_info->file_stat.st_ino = tf->ino;
+        file_info->file_stat.st_size = tf->read_offset;
+    }
+
+    return bf_trim_leading_lines(tf->buffer, max_lines);
+}
+
+/* Discard the buffer content so that the file is read from the start.
+ * Unsaved changes are never discarded, instead the file stops being
+ * followed and the buffer is left as it is */
+static Status tf_reset_buffer(TailFollow *tf, TailFollowEvent reason)
+{
+    Buffer *buffer = tf->buffer;
+
+    if (bf_is_dirty(buffer)) {
+        return st_get_error(ERR_UNABLE_TO_FOLLOW_FILE,
+                            "File %s was %s, no longer following it "
+                            "as the buffer has unsaved changes",
+                            buffer->file_info.file_name,
+                            reason == TFE_TRUNCATED ? "truncated" :
+                                                      "replaced");
+    }
+
+    RETURN_IF_FAIL(bf_reset(buffer));
+    buffer->change_state = bc_get_current_state(&buffer->changes);
+    tf->read_offset = 0;
+
+    return STATUS_SUCCESS;
+}
+
+/* Read up to TF_MAX_READ_SIZE bytes from the current read offset to
+ * file_size and add them to the end of the buffer. read_pending is set if
+ * bytes remain so that the file can be read in several steps */
+static Status tf_read_appended(TailFollow *tf, off_t file_size,
+                               TailFollowEvent *event)
+{
+    size_t read_limit = TF_MAX_READ_SIZE;
+    ssize_t bytes_read;
+    size_t read_len;
+
+    tf->read_pending = 0;
+
+    while (tf->read_offset < file_size) {
+        if (read_limit == 0) {
+            tf->read_pending = 1;
+            break;
+        }
+
+        read_len = MIN((size_t)(file_size - tf->read_offset),
+                       MIN(read_limit, TF_READ_BUF_SIZE));
+        bytes_read = pread(tf->fd, tf->read_buf, read_len, tf->read_offset);
+
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read == -1) {
+            return st_get_error(ERR_UNABLE_TO_READ_FILE,
+                                "Unable to read from file %s - %s",
+                                tf->buffer->file_info.file_name,
+                                strerror(errno));
+        } else if (bytes_read == 0) {
+            /* The file was truncated after its size was checked, which
+             * is picked up by the next check */
+            break;
+        }
+
+        RETURN_IF_FAIL(bf_append_file_text(tf->buffer, tf->read_buf,
+                                           bytes_read));
+        tf->read_offset += bytes_read;
+        read_limit -= bytes_read;
+
+        if (*event == TFE_NONE) {
+            *event = TFE_APPENDED;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_TAIL_FOLLOW_H
+#define WED_TAIL_FOLLOW_H
+
+#include <sys/types.h>
+#include <sys/select.h>
+#include "status.h"
+
+/* Following a file adds text appended to it to the end of its buffer as
+ * it's written, in the same way as tail -f. On Linux the file and the
+ * directory containing it are watched using inotify, elsewhere the file
+ * is checked periodically. Only the bytes written since the file was last
+ * read are read. A file which is truncated is read again from the start,
+ * and a file which is replaced, for example by log rotation, replaces the
+ * buffer content once the rest of the old file has been read. In both
+ * cases a buffer with unsaved changes stops being followed instead */
+
+/* Bytes read from the file each time it's checked. When more has been
+ * appended the rest is read once input has been processed */
+#define TF_MAX_READ_SIZE (4 * 1024 * 1024)
+
+struct Buffer;
+
+/* How the followed file changed since it was last checked */
+typedef enum {
+    TFE_NONE,
+    TFE_APPENDED,
+    TFE_TRUNCATED,
+    TFE_REPLACED
+} TailFollowEvent;
+
+typedef struct {
+    struct Buffer *buffer; /* The buffer the file is displayed in */
+    int fd; /* Descriptor of the file or -1 if it no longer exists */
+    dev_t dev; /* Device of the file fd refers to */
+    ino_t ino; /* Inode of the file fd refers to */
+    off_t read_offset; /* Bytes of the file added to the buffer */
+    int read_pending; /* True if bytes remain to be read */
+    int watch_fd; /* inotify descriptor or -1 if unavailable */
+    char *read_buf; /* Bytes read from file */
+} TailFollow;
+
+TailFollow *tf_new(struct Buffer *);
+void tf_free(TailFollow *);
+Status tf_start(TailFollow *);
+void tf_add_fds(const TailFollow *, fd_set *read_fds, int *max_fd);
+int tf_requires_poll(const TailFollow *);
+Status tf_process(TailFollow *, const fd_set *read_fds, size_t max_lines,
+                  TailFollowEvent *);
+
+#endif
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+
+#
+# Copyright (C) 2016 Richard Burke
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+# Compares two CSV files produced by the microbench executable and prints
+# the change in cost per operation for each benchmark and size found in
+# both. Exits with a non-zero status if any operation became slower by more
+# than THRESHOLD percent (default 10).
+#
+# Usage: compare_microbench.sh BASELINE.csv CANDIDATE.csv [THRESHOLD]
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 BASELINE.csv CANDIDATE.csv [THRESHOLD]" >&2
+    exit 1
+fi
+
+for f in "$1" "$2"; do
+    if [ ! -f "$f" ]; then
+        echo "$f doesn't exist" >&2
+        exit 1
+    fi
+done
+
+awk -F, -v threshold="${3:-10}" '
+    FNR == 1 {
+        # Skip header
+        next
+    }
+
+    NR == FNR {
+        baseline[$1 "," $2] = $4;
+        next
+    }
+
+    ($1 "," $2) in baseline {
+        old = baseline[$1 "," $2];
+        new = $4;
+        change = old > 0 ? (new - old) / old * 100 : 0;
+        status = "";
+
+        if (change > threshold) {
+            status = "SLOWER";
+            regressions++;
+        } else if (change < -threshold) {
+            status = "FASTER";
+        }
+
+        printf "%-20s %12s %14.2f %14.2f %+8.1f%% %s\n",
+               $1, $2, old, new, change, status;
+    }
+
+    BEGIN {
+        printf "%-20s %12s %14s %14s %9s\n",
+               "benchmark", "size", "base_ns/op", "new_ns/op", "change";
+    }
+
+    END {
+        if (regressions > 0) {
+            printf "%d operation(s) slower by more than %s%%\n",
+                   regressions, threshold > "/dev/stderr";
+            exit 1;
+        }
+    }
+' "$1" "$2"
@@ -0,0 +1,778 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Microbenchmarks for the core data structures wed is built on. Each
+ * benchmark is run against data sets from 1KB up to a maximum size (1GB by
+ * default) and the average cost of a single operation is written as CSV to
+ * stdout. Compare two result files using compare_microbench.sh */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../../wed.h"
+#include "../../session.h"
+#include "../../buffer.h"
+#include "../../gap_buffer.h"
+#include "../../hashmap.h"
+#include "../../radix_tree.h"
+#include "../../list.h"
+#include "../../text_search.h"
+#include "../../regex_search.h"
+#include "../../encoding.h"
+#include "../../buffer_view.h"
+#include "../../util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MB_HAVE_CYCLE_COUNTER 1
+#else
+#define MB_HAVE_CYCLE_COUNTER 0
+#endif
+
+/* Data set sizes start at 1KB and grow by this factor each step */
+#define MB_SIZE_FACTOR 32
+#define MB_MIN_SIZE 1024
+#define MB_DEFAULT_MAX_SIZE ((size_t)1 << 30)
+/* Time spent running the operations of a single benchmark */
+#define MB_DEFAULT_TIME_BUDGET_NS 500000000ULL
+/* Operations are run in batches between checks of the time budget */
+#define MB_BATCH_SIZE 64
+/* Number of operations run when not limited by the data set */
+#define MB_MAX_OPS 1000000
+/* Assumed memory used by each entry in a container. Used to convert a
+ * data set size into an entry count */
+#define MB_ENTRY_SIZE 64
+/* Size of key strings, including the null terminator */
+#define MB_KEY_SIZE 16
+/* Maximum distance from the point at which local edits are made */
+#define MB_LOCAL_DISTANCE 64
+/* Bytes retrieved by each gb_get_range call */
+#define MB_RANGE_SIZE 4096
+/* Line length of generated text */
+#define MB_LINE_LENGTH 80
+
+typedef struct {
+    Session *sess; /* Session used for buffer view benchmarks */
+    size_t size; /* Data set size in bytes */
+    size_t entries; /* Number of entries in container data sets */
+    uint64_t rng; /* xorshift random number generator state */
+    GapBuffer *gb;
+    HashMap *hashmap;
+    RadixTree *rtree;
+    FrozenRadixTree *frtree;
+    List *list;
+    char *keys; /* entries keys each MB_KEY_SIZE bytes long */
+    char range[MB_RANGE_SIZE];
+    FileFormat file_format;
+    BufferPos pos;
+    SearchOptions opt;
+    TextSearch text_search;
+    RegexSearch regex_search;
+    int search_initialised;
+} BenchContext;
+
+/* setup populates the data set and returns the maximum number of operations
+ * that can be run against it or 0 on failure. run performs a single
+ * operation */
+typedef struct {
+    const char *name;
+    size_t (*setup)(BenchContext *);
+    void (*run)(BenchContext *, size_t op);
+    void (*teardown)(BenchContext *);
+} Microbenchmark;
+
+static uint64_t mb_random(BenchContext *);
+static uint64_t mb_cycles(void);
+static uint64_t mb_time_ns(void);
+static size_t mb_parse_size(const char *);
+static int mb_fill_text(GapBuffer *, size_t size, int utf8);
+static int mb_generate_keys(BenchContext *);
+static int mb_run(const Microbenchmark *, BenchContext *,
+                  uint64_t time_budget_ns);
+
+static size_t gb_insert_setup(BenchContext *);
+static void gb_insert_random_run(BenchContext *, size_t);
+static void gb_insert_local_run(BenchContext *, size_t);
+static size_t gb_delete_setup(BenchContext *);
+static void gb_delete_random_run(BenchContext *, size_t);
+static void gb_delete_local_run(BenchContext *, size_t);
+static void gb_get_range_run(BenchContext *, size_t);
+static size_t gb_stream_insert_setup(BenchContext *);
+static void gb_stream_insert_run(BenchContext *, size_t);
+static void gb_teardown(BenchContext *);
+static size_t hashmap_set_setup(BenchContext *);
+static void hashmap_set_run(BenchContext *, size_t);
+static size_t hashmap_get_setup(BenchContext *);
+static void hashmap_get_run(BenchContext *, size_t);
+static void hashmap_teardown(BenchContext *);
+static size_t rt_find_setup(BenchContext *);
+static void rt_find_run(BenchContext *, size_t);
+static void rt_teardown(BenchContext *);
+static size_t rt_frozen_find_setup(BenchContext *);
+static void rt_frozen_find_run(BenchContext *, size_t);
+static void rt_frozen_teardown(BenchContext *);
+static size_t list_add_setup(BenchContext *);
+static void list_add_run(BenchContext *, size_t);
+static void list_teardown(BenchContext *);
+static size_t search_setup(BenchContext *);
+static void ts_find_next_run(BenchContext *, size_t);
+static void rs_find_next_run(BenchContext *, size_t);
+static size_t ts_setup(BenchContext *);
+static size_t rs_setup(BenchContext *);
+static void ts_teardown(BenchContext *);
+static void rs_teardown(BenchContext *);
+static size_t utf8_char_info_setup(BenchContext *);
+static void utf8_char_info_run(BenchContext *, size_t);
+static size_t bv_update_view_setup(BenchContext *);
+static void bv_update_view_run(BenchContext *, size_t);
+static void bv_update_view_teardown(BenchContext *);
+
+static const Microbenchmark microbenchmarks[] = {
+    { "gb_insert_random", gb_insert_setup, gb_insert_random_run, gb_teardown },
+    { "gb_insert_local", gb_insert_setup, gb_insert_local_run, gb_teardown },
+    { "gb_delete_random", gb_delete_setup, gb_delete_random_run, gb_teardown },
+    { "gb_delete_local", gb_delete_setup, gb_delete_local_run, gb_teardown },
+    { "gb_get_range", gb_delete_setup, gb_get_range_run, gb_teardown },
+    { "gb_stream_insert", gb_stream_insert_setup, gb_stream_insert_run,
+      gb_teardown },
+    { "hashmap_set", hashmap_set_setup, hashmap_set_run, hashmap_teardown },
+    { "hashmap_get", hashmap_get_setup, hashmap_get_run, hashmap_teardown },
+    { "rt_find", rt_find_setup, rt_find_run, rt_teardown },
+    { "rt_frozen_find", rt_frozen_find_setup, rt_frozen_find_run,
+      rt_frozen_teardown },
+    { "list_add", list_add_setup, list_add_run, list_teardown },
+    { "ts_find_next", ts_setup, ts_find_next_run, ts_teardown },
+    { "rs_find_next", rs_setup, rs_find_next_run, rs_teardown },
+    { "en_utf8_char_info", utf8_char_info_setup, utf8_char_info_run,
+      gb_teardown },
+    { "bv_update_view", bv_update_view_setup, bv_update_view_run,
+      bv_update_view_teardown }
+};
+
+static const char *mb_usage =
+"Usage: microbench [-m MAX_SIZE] [-t SECONDS] [BENCHMARK]...\n"
+"  -m MAX_SIZE  Largest data set size e.g. 32M (default 1G)\n"
+"  -t SECONDS   Time spent on each benchmark and size (default 0.5)\n"
+"  BENCHMARK    Only run benchmarks whose names contain BENCHMARK\n";
+
+int main(int argc, char *argv[])
+{
+    size_t max_size = MB_DEFAULT_MAX_SIZE;
+    uint64_t time_budget_ns = MB_DEFAULT_TIME_BUDGET_NS;
+    int c;
+
+    while ((c = getopt(argc, argv, "hm:t:")) != -1) {
+        switch (c) {
+            case 'm':
+                max_size = mb_parse_size(optarg);
+
+                if (max_size < MB_MIN_SIZE) {
+                    fprintf(stderr, "Invalid size %s\n", optarg);
+                    return 1;
+                }
+
+                break;
+            case 't':
+                time_budget_ns = (uint64_t)(strtod(optarg, NULL) * 1e9);
+                break;
+            case 'h':
+                printf("%s", mb_usage);
+                return 0;
+            default:
+                fprintf(stderr, "%s", mb_usage);
+                return 1;
+        }
+    }
+
+    WedOpt wed_opt;
+    memset(&wed_opt, 0, sizeof(WedOpt));
+    wed_opt.test_mode = 1;
+
+    Session *sess = se_new();
+
+    if (sess == NULL || !se_init(sess, &wed_opt, NULL, 0)) {
+        fprintf(stderr, "Unable to initialise session\n");
+        return 1;
+    }
+
+    printf("benchmark,size,ops,ns_per_op,cycles_per_op\n");
+
+    const size_t benchmark_num = ARRAY_SIZE(microbenchmarks, Microbenchmark);
+    int success = 1;
+
+    for (size_t k = 0; k < benchmark_num && success; k++) {
+        const Microbenchmark *benchmark = &microbenchmarks[k];
+        int selected = optind == argc;
+
+        for (int a = optind; a < argc && !selected; a++) {
+            selected = strstr(benchmark->name, argv[a]) != NULL;
+        }
+
+        if (!selected) {
+            continue;
+        }
+
+        for (size_t size = MB_MIN_SIZE; size <= max_size && success;
+             size *= MB_SIZE_FACTOR) {
+            BenchContext ctx;
+            memset(&ctx, 0, sizeof(BenchContext));
+            ctx.sess = sess;
+            ctx.size = size;
+            ctx.entries = size / MB_ENTRY_SIZE;
+            ctx.rng = 0x9E3779B97F4A7C15ULL;
+
+            success = mb_run(benchmark, &ctx, time_budget_ns);
+            fflush(stdout);
+        }
+    }
+
+    se_free(sess);
+
+    return !success;
+}
+
+static int mb_run(const Microbenchmark *benchmark, BenchContext *ctx,
+                  uint64_t time_budget_ns)
+{
+    size_t max_ops = benchmark->setup(ctx);
+
+    if (max_ops == 0) {
+        fprintf(stderr, "Unable to set up %s with size %zu\n",
+                benchmark->name, ctx->size);
+        benchmark->teardown(ctx);
+        return 0;
+    }
+
+    size_t ops = 0;
+    uint64_t start_ns = mb_time_ns();
+    uint64_t start_cycles = mb_cycles();
+    uint64_t elapsed_ns;
+
+    do {
+        size_t batch_end = MIN(ops + MB_BATCH_SIZE, max_ops);
+
+        for (; ops < batch_end; ops++) {
+            benchmark->run(ctx, ops);
+        }
+
+        elapsed_ns = mb_time_ns() - start_ns;
+    } while (ops < max_ops && elapsed_ns < time_budget_ns);
+
+    uint64_t cycles = mb_cycles() - start_cycles;
+
+    printf("%s,%zu,%zu,%.2f,", benchmark->name, ctx->size, ops,
+           (double)elapsed_ns / ops);
+
+    if (MB_HAVE_CYCLE_COUNTER) {
+        printf("%.1f", (double)cycles / ops);
+    }
+
+    printf("\n");
+
+    benchmark->teardown(ctx);
+
+    return 1;
+}
+
+static uint64_t mb_random(BenchContext *ctx)
+{
+    uint64_t x = ctx->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    ctx->rng = x;
+
+    return x;
+}
+
+static uint64_t mb_cycles(void)
+{
+#if MB_HAVE_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint64_t mb_time_ns(void)
+{
+    struct timespec now;
+    get_monotonic_time(&now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static size_t mb_parse_size(const char *str)
+{
+    char *end;
+    size_t size = strtoull(str, &end, 10);
+
+    switch (*end) {
+        case 'G':
+        case 'g':
+            size <<= 10;
+            /* Fall through */
+        case 'M':
+        case 'm':
+            size <<= 10;
+            /* Fall through */
+        case 'K':
+        case 'k':
+            size <<= 10;
+            break;
+        default:
+            break;
+    }
+
+    return size;
+}
+
+/* Populate gb with lines of ASCII or multibyte UTF-8 text */
+static int mb_fill_text(GapBuffer *gb, size_t size, int utf8)
+{
+    static const char *ascii_line = "The quick brown fox jumps over the "
+                                    "lazy dog\tand keeps running 0123456789";
+    /* Mixture of 1, 2, 3 and 4 byte characters */
+    static const char *utf8_line = "Grüße, 日本語のテキスト, 中文 😀 "
+                                   "ascii text façade ÅÄÖ 한국어";
+    const char *text = utf8 ? utf8_line : ascii_line;
+    size_t text_len = strlen(text);
+    char line[MB_LINE_LENGTH * 2 + 1];
+    size_t line_len = 0;
+
+    while (line_len + text_len < MB_LINE_LENGTH * 2) {
+        memcpy(line + line_len, text, text_len);
+        line_len += text_len;
+    }
+
+    line[line_len++] = '\n';
+
+    if (!gb_preallocate(gb, size)) {
+        return 0;
+    }
+
+    while (gb_length(gb) < size) {
+        if (!gb_add(gb, line, MIN(line_len, size - gb_length(gb)))) {
+            return 0;
+        }
+    }
+
+    gb_set_point(gb, 0);
+
+    return 1;
+}
+
+static int mb_generate_keys(BenchContext *ctx)
+{
+    ctx->keys = malloc(ctx->entries * MB_KEY_SIZE);
+
+    if (ctx->keys == NULL) {
+        return 0;
+    }
+
+    for (size_t k = 0; k < ctx->entries; k++) {
+        snprintf(ctx->keys + k * MB_KEY_SIZE, MB_KEY_SIZE, "key-%011zx",
+                 (size_t)(mb_random(ctx) & 0xFFFFFFFFFFF));
+    }
+
+    return 1;
+}
+
+static size_t gb_insert_setup(BenchContext *ctx)
+{
+    if ((ctx->gb = gb_new(GAP_INCREMENT)) == NULL ||
+        !mb_fill_text(ctx->gb, ctx->size, 0)) {
+        return 0;
+    }
+
+    return MB_MAX_OPS;
+}
+
+static void gb_insert_random_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    gb_set_point(ctx->gb, mb_random(ctx) % (gb_length(ctx->gb) + 1));
+    gb_insert(ctx->gb, "x", 1);
+}
+
+static void gb_insert_local_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    size_t point = gb_get_point(ctx->gb) + mb_random(ctx) % MB_LOCAL_DISTANCE;
+    gb_set_point(ctx->gb, MIN(point, gb_length(ctx->gb)));
+    gb_insert(ctx->gb, "x", 1);
+}
+
+static size_t gb_delete_setup(BenchContext *ctx)
+{
+    if (gb_insert_setup(ctx) == 0) {
+        return 0;
+    }
+
+    /* Leave at least half the data set in place */
+    return ctx->size / 2;
+}
+
+static void gb_delete_random_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    gb_set_point(ctx->gb, mb_random(ctx) % gb_length(ctx->gb));
+    gb_delete(ctx->gb, 1);
+}
+
+static void gb_delete_local_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    size_t length = gb_length(ctx->gb);
+    size_t point = gb_get_point(ctx->gb) + mb_random(ctx) % MB_LOCAL_DISTANCE;
+    gb_set_point(ctx->gb, point < length ? point : length / 2);
+    gb_delete(ctx->gb, 1);
+}
+
+static void gb_get_range_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    gb_get_range(ctx->gb, mb_random(ctx) % gb_length(ctx->gb), ctx->range,
+                 MB_RANGE_SIZE);
+}
+
+/* Append the data set to an empty buffer MB_RANGE_SIZE bytes at a time,
+ * as happens when command output or a large paste is read into a buffer */
+static size_t gb_stream_insert_setup(BenchContext *ctx)
+{
+    if ((ctx->gb = gb_new(GAP_INCREMENT)) == NULL) {
+        return 0;
+    }
+
+    for (size_t k = 0; k < MB_RANGE_SIZE; k++) {
+        ctx->range[k] = (k + 1) % MB_LINE_LENGTH == 0 ? '\n' : 'a' + k % 26;
+    }
+
+    return MAX(ctx->size / MB_RANGE_SIZE, 1);
+}
+
+static void gb_stream_insert_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    gb_add(ctx->gb, ctx->range, MB_RANGE_SIZE);
+}
+
+static void gb_teardown(BenchContext *ctx)
+{
+    gb_free(ctx->gb);
+}
+
+static size_t hashmap_set_setup(BenchContext *ctx)
+{
+    if (!mb_generate_keys(ctx) || (ctx->hashmap = new_hashmap()) == NULL) {
+        return 0;
+    }
+
+    return ctx->entries;
+}
+
+static void hashmap_set_run(BenchContext *ctx, size_t op)
+{
+    hashmap_set(ctx->hashmap, ctx->keys + op * MB_KEY_SIZE, ctx);
+}
+
+static size_t hashmap_get_setup(BenchContext *ctx)
+{
+    if (hashmap_set_setup(ctx) == 0) {
+        return 0;
+    }
+
+    for (size_t k = 0; k < ctx->entries; k++) {
+        if (!hashmap_set(ctx->hashmap, ctx->keys + k * MB_KEY_SIZE, ctx)) {
+            return 0;
+        }
+    }
+
+    return MB_MAX_OPS;
+}
+
+static void hashmap_get_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    size_t k = mb_random(ctx) % ctx->entries;
+    hashmap_get(ctx->hashmap, ctx->keys + k * MB_KEY_SIZE);
+}
+
+static void hashmap_teardown(BenchContext *ctx)
+{
+    free_hashmap(ctx->hashmap);
+    free(ctx->keys);
+}
+
+static size_t rt_find_setup(BenchContext *ctx)
+{
+    if (!mb_generate_keys(ctx) || (ctx->rtree = rt_new()) == NULL) {
+        return 0;
+    }
+
+    for (size_t k = 0; k < ctx->entries; k++) {
+        const char *key = ctx->keys + k * MB_KEY_SIZE;
+
+        if (!rt_insert(ctx->rtree, key, MB_KEY_SIZE - 1, ctx)) {
+            return 0;
+        }
+    }
+
+    return MB_MAX_OPS;
+}
+
+static void rt_find_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    size_t k = mb_random(ctx) % ctx->entries;
+    rt_find(ctx->rtree, ctx->keys + k * MB_KEY_SIZE, MB_KEY_SIZE - 1,
+            NULL, NULL);
+}
+
+static void rt_teardown(BenchContext *ctx)
+{
+    rt_free(ctx->rtree);
+    free(ctx->keys);
+}
+
+static size_t rt_frozen_find_setup(BenchContext *ctx)
+{
+    if (rt_find_setup(ctx) == 0) {
+        return 0;
+    }
+
+    const RadixTree *rtrees[] = { ctx->rtree };
+
+    if ((ctx->frtree = rt_freeze(rtrees, 1)) == NULL) {
+        return 0;
+    }
+
+    return MB_MAX_OPS;
+}
+
+static void rt_frozen_find_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    size_t k = mb_random(ctx) % ctx->entries;
+    rt_frozen_find(ctx->frtree, ctx->keys + k * MB_KEY_SIZE, MB_KEY_SIZE - 1,
+                   NULL, NULL);
+}
+
+static void rt_frozen_teardown(BenchContext *ctx)
+{
+    rt_free_frozen(ctx->frtree);
+    rt_teardown(ctx);
+}
+
+static size_t list_add_setup(BenchContext *ctx)
+{
+    if ((ctx->list = list_new()) == NULL) {
+        return 0;
+    }
+
+    return ctx->entries;
+}
+
+static void list_add_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    list_add(ctx->list, ctx);
+}
+
+static void list_teardown(BenchContext *ctx)
+{
+    list_free(ctx->list);
+}
+
+/* The pattern searched for only occurs at the very end of the data set so
+ * each search scans the entire buffer */
+static size_t search_setup(BenchContext *ctx)
+{
+    static char pattern[] = "needle";
+
+    if (gb_insert_setup(ctx) == 0 ||
+        !gb_set_point(ctx->gb, gb_length(ctx->gb)) ||
+        !gb_insert(ctx->gb, pattern, sizeof(pattern) - 1) ||
+        !bp_init(&ctx->pos, ctx->gb, &ctx->file_format,
+                 ctx->sess->active_buffer->config)) {
+        return 0;
+    }
+
+    ctx->opt.pattern = pattern;
+    ctx->opt.pattern_len = sizeof(pattern) - 1;
+    ctx->opt.case_insensitive = 1;
+    ctx->opt.forward = 1;
+
+    return MB_MAX_OPS;
+}
+
+static size_t ts_setup(BenchContext *ctx)
+{
+    if (search_setup(ctx) == 0) {
+        return 0;
+    }
+
+    Status status = ts_init(&ctx->text_search, &ctx->opt);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        return 0;
+    }
+
+    ctx->search_initialised = 1;
+
+    return MB_MAX_OPS;
+}
+
+static size_t rs_setup(BenchContext *ctx)
+{
+    if (search_setup(ctx) == 0) {
+        return 0;
+    }
+
+    Status status = rs_init(&ctx->regex_search, &ctx->opt);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        return 0;
+    }
+
+    ctx->search_initialised = 1;
+
+    return MB_MAX_OPS;
+}
+
+static void ts_find_next_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    int found_match = 0;
+    int wrapped = 0;
+    size_t match_point;
+
+    SearchData data = {
+        .search_start_pos = NULL,
+        .current_start_pos = &ctx->pos,
+        .found_match = &found_match,
+        .match_point = &match_point,
+        .wrapped = &wrapped
+    };
+
+    st_free_status(ts_find_next(&ctx->text_search, &ctx->opt, &data));
+}
+
+static void rs_find_next_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    int found_match = 0;
+    int wrapped = 0;
+    size_t match_point;
+
+    SearchData data = {
+        .search_start_pos = NULL,
+        .current_start_pos = &ctx->pos,
+        .found_match = &found_match,
+        .match_point = &match_point,
+        .wrapped = &wrapped
+    };
+
+    st_free_status(rs_find_next(&ctx->regex_search, &ctx->opt, &data));
+}
+
+static void ts_teardown(BenchContext *ctx)
+{
+    if (ctx->search_initialised) {
+        ts_free(&ctx->text_search);
+    }
+
+    gb_free(ctx->gb);
+}
+
+static void rs_teardown(BenchContext *ctx)
+{
+    if (ctx->search_initialised) {
+        rs_free(&ctx->regex_search);
+    }
+
+    gb_free(ctx->gb);
+}
+
+static size_t utf8_char_info_setup(BenchContext *ctx)
+{
+    if ((ctx->gb = gb_new(GAP_INCREMENT)) == NULL ||
+        !mb_fill_text(ctx->gb, ctx->size, 1) ||
+        !bp_init(&ctx->pos, ctx->gb, &ctx->file_format,
+                 ctx->sess->active_buffer->config)) {
+        return 0;
+    }
+
+    return MB_MAX_OPS;
+}
+
+/* Step through the buffer one character at a time as drawing does */
+static void utf8_char_info_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    CharInfo char_info;
+
+    en_utf8_char_info(&char_info, CIP_SCREEN_LENGTH, &ctx->pos,
+                      ctx->pos.config);
+    ctx->pos.offset += char_info.byte_length;
+
+    if (ctx->pos.offset >= gb_length(ctx->gb)) {
+        ctx->pos.offset = 0;
+    }
+}
+
+static size_t bv_update_view_setup(BenchContext *ctx)
+{
+    Buffer *buffer = ctx->sess->active_buffer;
+
+    if (!mb_fill_text(buffer->data, ctx->size, 1)) {
+        return 0;
+    }
+
+    st_free_status(bf_to_buffer_start(buffer, 0));
+
+    return MB_MAX_OPS;
+}
+
+/* Scroll forward through the buffer a page at a time */
+static void bv_update_view_run(BenchContext *ctx, size_t op)
+{
+    (void)op;
+    Buffer *buffer = ctx->sess->active_buffer;
+    size_t page_size = buffer->bv->rows * MB_LINE_LENGTH * 2;
+    size_t offset = buffer->pos.offset + page_size;
+
+    if (offset >= gb_length(buffer->data)) {
+        offset = 0;
+    }
+
+    BufferPos pos = bp_init_from_offset(offset, &buffer->pos);
+    st_free_status(bf_set_bp(buffer, &pos, 0));
+    bv_update_view(ctx->sess, buffer);
+}
+
+static void bv_update_view_teardown(BenchContext *ctx)
+{
+    Buffer *buffer = ctx->sess->active_buffer;
+    gb_clear(buffer->data);
+    st_free_status(bf_to_buffer_start(buffer, 0));
+}
@@ -0,0 +1,167 @@
+#!/usr/bin/env bash
+
+#
+# Copyright (C) 2016 Richard Burke
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+# Runs wed in bench mode against generated files and prints the latency
+# of each operation and the peak RSS of each run as JSON, one object per
+# line. Corpus sizes can be reduced by setting the environment variables
+# below e.g. BENCH_LOG_LINES=100000 make bench
+
+set -o pipefail
+
+BENCH_JSON_RECORDS=${BENCH_JSON_RECORDS:-500000}
+BENCH_LOG_LINES=${BENCH_LOG_LINES:-10000000}
+BENCH_CJK_LINES=${BENCH_CJK_LINES:-500000}
+# Number of times each operation is run
+BENCH_ITERATIONS=${BENCH_ITERATIONS:-20}
+# Line typed to measure inserting runs of printable characters
+BENCH_TYPED_LINE='The quick brown fox jumps over the lazy dog and keeps on running'
+
+warn() {
+    echo "$@" >&2
+}
+
+fatal() {
+    warn "$@"
+    exit 1
+}
+
+# Set working directory to script directory
+cd "$(dirname "$(realpath "$0")")"
+
+WED_BIN=../../wed
+
+if [ ! -f "$WED_BIN" ]; then
+    fatal "$WED_BIN binary doesn't exist"
+fi
+
+BENCH_DIR="$(mktemp -d "${TMPDIR:-/tmp}/wed_bench_XXXXXX")" ||
+    fatal 'Unable to create benchmark directory'
+
+trap '/bin/rm -rf "$BENCH_DIR"' EXIT
+
+# A single line JSON array
+generate_json() {
+    awk -v records="$BENCH_JSON_RECORDS" 'BEGIN {
+        printf "[";
+
+        for (i = 0; i < records; i++) {
+            printf "%s{\"id\":%d,\"name\":\"item-%d\",\"tags\":" \
+                   "[\"alpha\",\"beta\"],\"value\":%d}",
+                   (i > 0 ? "," : ""), i, i, i * 7;
+        }
+
+        printf ",{\"id\":%d,\"name\":\"needle\"}]\n", records;
+    }'
+}
+
+# Log file with one entry per line
+generate_log() {
+    awk -v lines="$BENCH_LOG_LINES" 'BEGIN {
+        split("INFO INFO INFO WARN ERROR", levels, " ");
+
+        for (i = 0; i < lines - 1; i++) {
+            printf "2016-05-%02d %02d:%02d:%02d.%03d %-5s [worker-%d] " \
+                   "request id=%d path=/api/v1/items/%d status=200 " \
+                   "time=%dms\n",
+                   i % 28 + 1, i % 24, i % 60, i % 59, i % 1000,
+                   levels[i % 5 + 1], i % 16, i, i % 9973, i % 250;
+        }
+
+        print "2016-05-28 23:59:59.999 INFO  [worker-0] needle";
+    }'
+}
+
+# Multibyte UTF-8 text containing CJK characters
+generate_cjk() {
+    awk -v lines="$BENCH_CJK_LINES" 'BEGIN {
+        text[0] = "日本語のテキストを編集する速度を測定します。";
+        text[1] = "中文文本编辑器的性能测试，包括搜索和替换。";
+        text[2] = "한국어 텍스트도 포함되어 있습니다 日本 中国";
+
+        for (i = 0; i < lines - 1; i++) {
+            printf "%d: %s %s\n", i, text[i % 3], text[(i + 1) % 3];
+        }
+
+        print "needle";
+    }'
+}
+
+# Print key string s repeated BENCH_ITERATIONS times
+repeat() {
+    local keystr=''
+
+    for ((i = 0; i < BENCH_ITERATIONS; i++)); do
+        keystr+="$1"
+    done
+
+    printf '%s' "$keystr"
+}
+
+# Build key string which exercises each benchmarked operation.
+# Arguments: line count, replace pattern, replacement
+bench_keystr() {
+    local lines=$1
+    local pattern=$2
+    local replacement=$3
+    local keystr=''
+
+    for ((i = 1; i <= BENCH_ITERATIONS; i++)); do
+        keystr+="<wed-goto-line>$((lines * i / BENCH_ITERATIONS))"
+        keystr+='<wed-prompt-submit>'
+    done
+
+    keystr+='<wed-move-buffer-start>'
+    keystr+="$(repeat '<wed-move-next-page>')"
+    keystr+="$(repeat '<wed-find>needle<wed-prompt-submit><wed-prompt-cancel>')"
+    keystr+="<wed-find-replace>$pattern<wed-prompt-submit>$replacement"
+    keystr+='<wed-prompt-submit>a<wed-prompt-submit>'
+    keystr+="<wed-find-replace>$replacement<wed-prompt-submit>$pattern"
+    keystr+='<wed-prompt-submit>a<wed-prompt-submit>'
+    keystr+="$(repeat 'x<wed-undo>')"
+    keystr+="$(repeat "$BENCH_TYPED_LINE<Enter>")"
+    keystr+="<wed-record-macro>$BENCH_TYPED_LINE<Enter><wed-record-macro>"
+    keystr+="$(repeat '<wed-play-macro>')"
+    keystr+="$(repeat '<wed-save>')"
+
+    printf '%s' "$keystr"
+}
+
+# Arguments: corpus name, line count, replace pattern, replacement
+run_bench() {
+    local corpus=$1
+    local file="$BENCH_DIR/$corpus"
+
+    "generate_$corpus" > "$file" ||
+        fatal "Unable to generate $corpus corpus"
+
+    local keystr="$(bench_keystr "$2" "$3" "$4")"
+
+    # Label each result with the corpus it was measured against. Journals
+    # are written below the benchmark directory rather than ~/.wed
+    HOME="$BENCH_DIR" "$WED_BIN" --bench-mode --key-string "$keystr" "$file" |
+        sed "s/^{/{\"corpus\":\"$corpus\",/" ||
+        fatal "Benchmark $corpus FAILED"
+
+    /bin/rm -f "$file"
+}
+
+run_bench json 1 alpha gamma
+run_bench log "$BENCH_LOG_LINES" INFO info
+run_bench cjk "$BENCH_CJK_LINES" 日本 中国
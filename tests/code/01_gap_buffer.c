@@ -13,6 +13,8 @@ static void gap_buffer_movement(GapBuffer *);
 static void gap_buffer_retrieval(GapBuffer *, const char *, size_t);
 static void gap_buffer_delete(GapBuffer *);
 static void gap_buffer_replace(GapBuffer *);
+static void gap_buffer_compact(GapBuffer *);
+static void gap_buffer_apply_edits(GapBuffer *);
 static void gap_buffer_clear(GapBuffer *);
 
 int main(int argc, char *argv[])
@@ -20,7 +22,7 @@ int main(int argc, char *argv[])
     (void)argc;
     (void)argv;
 
-    plan(74);
+    plan(84);
 
     GapBuffer *buffer = gb_new(GAP_INCREMENT);
 
@@ -38,6 +40,8 @@ int main(int argc, char *argv[])
     gap_buffer_retrieval(buffer, str, str_len);
     gap_buffer_delete(buffer);
     gap_buffer_replace(buffer);
+    gap_buffer_compact(buffer);
+    gap_buffer_apply_edits(buffer);
     gap_buffer_clear(buffer);
 
     return exit_status();
@@ -170,6 +174,63 @@ static void gap_buffer_replace(GapBuffer *buffer)
     ok(strncmp(buf_start, buf_end, buffer_len) == 0, "Text range retrieved matches starting text");
 }
 
+static void gap_buffer_compact(GapBuffer *buffer)
+{
+    msg("Compact:");
+    size_t buffer_len = gb_length(buffer);
+    ok(gb_set_point(buffer, 2), "Point set");
+    ok(gb_preallocate(buffer, buffer_len + 1024 * 1024), "Preallocate large gap");
+    size_t allocated = gb_allocated(buffer);
+    ok(gb_compact(buffer), "Compact buffer");
+    ok(gb_allocated(buffer) < allocated && gb_allocated(buffer) - gb_gap_size(buffer) == buffer_len, "Gap shrunk and text accounted for");
+    ok(gb_length(buffer) == buffer_len && gb_get_point(buffer) == 2 && gb_get_at(buffer, 0) == 'T', "Content and point unchanged");
+}
+
+static void gap_buffer_apply_edits(GapBuffer *buffer)
+{
+    msg("Apply Edits:");
+    gb_clear(buffer);
+    gb_add(buffer, "abc\ndef\nghi", 11);
+
+    const GapBufferEdit edits[] = {
+        { 0, 0, "X", 1 },
+        { 4, 1, "Y\n", 2 },
+        { 8, 3, "", 0 },
+        { 11, 0, "!", 1 }
+    };
+
+    const char *expected = "Xabc\nY\nef\n!";
+    char buf[32];
+
+    ok(gb_apply_edits(buffer, edits, 4), "Edits applied");
+    ok(gb_length(buffer) == 11 && gb_get_range(buffer, 0, buf, 11) == 11 && strncmp(buf, expected, 11) == 0, "Text matches edited text");
+    ok(gb_lines(buffer) == 3, "Line count updated");
+
+    enum { EDIT_NUM = 1001 };
+    static GapBufferEdit many_edits[EDIT_NUM];
+    static char text[EDIT_NUM - 1];
+    static char result[EDIT_NUM * 2];
+    int alternating = 1;
+
+    memset(text, 'a', sizeof(text));
+    gb_clear(buffer);
+    gb_add(buffer, text, sizeof(text));
+
+    for (size_t k = 0; k < EDIT_NUM; k++) {
+        many_edits[k] = (GapBufferEdit) { k, 0, "b", 1 };
+    }
+
+    ok(gb_apply_edits(buffer, many_edits, EDIT_NUM), "Many edits applied");
+
+    gb_get_range(buffer, 0, result, sizeof(result));
+
+    for (size_t k = 0; k < sizeof(result) - 1; k++) {
+        alternating &= (result[k] == (k % 2 == 0 ? 'b' : 'a'));
+    }
+
+    ok(gb_length(buffer) == sizeof(result) - 1 && alternating, "Inserted text interleaved with original text");
+}
+
 static void gap_buffer_clear(GapBuffer *buffer)
 {
     msg("Clear:");
@@ -7,6 +7,8 @@ static void radix_tree_insert(RadixTree *rtree, const char *strings[],
                               size_t string_num);
 static void radix_tree_find(RadixTree *rtree, const char *strings[],
                             size_t string_num);
+static void radix_tree_freeze(RadixTree *rtree, const char *strings[],
+                              size_t string_num);
 static void radix_tree_delete(RadixTree *rtree, const char *strings[],
                               size_t string_num);
 
@@ -15,7 +17,7 @@ int main(int argc, char *argv[])
     (void)argc;
     (void)argv;
 
-    plan(93);
+    plan(105);
 
     RadixTree *rtree = rt_new();
 
@@ -32,6 +34,7 @@ int main(int argc, char *argv[])
 
     radix_tree_insert(rtree, strings, string_num);
     radix_tree_find(rtree, strings, string_num);
+    radix_tree_freeze(rtree, strings, string_num);
     radix_tree_delete(rtree, strings, string_num);
 
     rt_free(rtree);
@@ -78,6 +81,71 @@ static void radix_tree_find(RadixTree *rtree, const char *strings[],
     ok(!is_prefix, "Entry not identified as prefix");
 }
 
+static void radix_tree_freeze(RadixTree *rtree, const char *strings[],
+                              size_t string_num)
+{
+    msg("Freeze:");
+
+    int value = 1;
+    RadixTree *override = rt_new();
+
+    if (!ok(override != NULL && rt_insert(override, "ab", 2, &value) &&
+            rt_insert(override, "zz", 2, &value), "Create second tree")) {
+        rt_free(override);
+        return;
+    }
+
+    const RadixTree *rtrees[] = { override, rtree };
+    FrozenRadixTree *frtree = rt_freeze(rtrees, 2);
+
+    if (!ok(frtree != NULL, "Freeze trees")) {
+        rt_free(override);
+        return;
+    }
+
+    ok(frtree->entries == string_num + 1, "Entry count correct after merge");
+
+    int found = 1;
+
+    for (size_t k = 0; k < string_num; k++) {
+        found = found && rt_frozen_find(frtree, strings[k],
+                                        strlen(strings[k]), NULL, NULL);
+    }
+
+    ok(found, "Found strings from both trees");
+
+    void *data = NULL;
+    int is_prefix;
+
+    ok(rt_frozen_find(frtree, "ab", 2, &data, NULL) && data == &value,
+       "Earlier tree takes precedence");
+    ok(rt_frozen_find(frtree, "zz", 2, NULL, &is_prefix) && !is_prefix,
+       "Found string only in earlier tree");
+    ok(!rt_frozen_find(frtree, "b", 1, NULL, &is_prefix),
+       "No false positive match");
+    ok(is_prefix, "Identified as prefix");
+    ok(!rt_frozen_find(frtree, "adc", 3, NULL, &is_prefix) && !is_prefix,
+       "Not identified as prefix");
+    ok(!rt_frozen_find(frtree, "z", 1, NULL, &is_prefix) && is_prefix,
+       "Identified as prefix of string in earlier tree");
+    ok(!rt_frozen_find(frtree, "abcdx", 5, NULL, &is_prefix) && !is_prefix,
+       "String longer than entry not found");
+
+    rt_free_frozen(frtree);
+    rt_free(override);
+
+    RadixTree *empty_tree = rt_new();
+    const RadixTree *empty_trees[] = { empty_tree };
+    frtree = empty_tree != NULL ? rt_freeze(empty_trees, 1) : NULL;
+
+    ok(frtree != NULL && frtree->entries == 0 &&
+       !rt_frozen_find(frtree, "a", 1, NULL, &is_prefix) && !is_prefix,
+       "Freeze empty tree");
+
+    rt_free_frozen(frtree);
+    rt_free(empty_tree);
+}
+
 static void radix_tree_delete(RadixTree *rtree, const char *strings[],
                               size_t string_num)
 {
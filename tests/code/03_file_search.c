@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../file_search.h"
+#include "../../project_index.h"
+
+/* Collects results written by a FileSearch */
+typedef struct {
+    OutputStream os;
+    char text[4096];
+    size_t text_len;
+} ResultStream;
+
+/* binary.dat contains a null byte so is rewritten with its full length
+ * after the test files are created */
+static const char binary_text[] = "bin\0ary needle\n";
+
+/* Files are created in the order below and removed in reverse order.
+ * Entries without content are directories */
+static const char *test_files[][2] = {
+    { ".gitignore", "build/\n*.log\n!keep.log\n/top.txt\n# comment\n" },
+    { "a.txt", "needle first\nnothing\nsecond needle\r\n" },
+    { "top.txt", "needle\n" },
+    { "debug.log", "needle\n" },
+    { "keep.log", "needle\n" },
+    { "binary.dat", binary_text },
+    { "build/", NULL },
+    { "build/out.txt", "needle\n" },
+    { "sub/", NULL },
+    { "sub/.gitignore", "skip.txt\n" },
+    { "sub/top.txt", "no match\nlast needle" },
+    { "sub/skip.txt", "needle\n" },
+    { ".git/", NULL },
+    { ".git/HEAD", "needle\n" }
+};
+
+#define TEST_FILE_NUM (sizeof(test_files) / sizeof(test_files[0]))
+
+static Status result_stream_write(OutputStream *, const char buf[],
+                                  size_t buf_len, size_t *bytes_written);
+static void file_search_text(void);
+static void project_index_find(void);
+static const char *best_match(const ProjectIndex *, const char *query);
+static int find_match(const FileSearch *, const char *file_path,
+                      size_t line_no, size_t col_no);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(19);
+
+    char dir_template[] = "/tmp/wed_file_search_XXXXXX";
+    char cwd[4096];
+
+    if (!ok(getcwd(cwd, sizeof(cwd)) != NULL &&
+            mkdtemp(dir_template) != NULL &&
+            chdir(dir_template) == 0, "Create test directory")) {
+        return exit_status();
+    }
+
+    if (ok(fx_create_files(test_files, TEST_FILE_NUM) &&
+           fx_write_file_len("binary.dat", binary_text,
+                             sizeof(binary_text) - 1), "Create test files")) {
+        file_search_text();
+        project_index_find();
+    }
+
+    fx_remove_files(test_files, TEST_FILE_NUM);
+
+    if (chdir(cwd) == 0) {
+        rmdir(dir_template);
+    }
+
+    return exit_status();
+}
+
+static Status result_stream_write(OutputStream *os, const char buf[],
+                                  size_t buf_len, size_t *bytes_written)
+{
+    ResultStream *rs = (ResultStream *)os;
+    size_t space = sizeof(rs->text) - rs->text_len - 1;
+    size_t write_len = buf_len < space ? buf_len : space;
+
+    memcpy(rs->text + rs->text_len, buf, write_len);
+    rs->text_len += write_len;
+    rs->text[rs->text_len] = '\0';
+    *bytes_written = buf_len;
+
+    return STATUS_SUCCESS;
+}
+
+static void file_search_text(void)
+{
+    msg("Text search:");
+
+    SearchOptions opt = {
+        .pattern = "needle",
+        .pattern_len = 6,
+        .case_insensitive = 0,
+        .forward = 1
+    };
+
+    FileSearch *fs = fs_new(".", &opt, 0);
+
+    if (!ok(fs != NULL, "Create FileSearch")) {
+        return;
+    }
+
+    Status status = fs_start(fs);
+
+    if (!ok(STATUS_IS_SUCCESS(status), "Start search")) {
+        st_free_status(status);
+        fs_free(fs);
+        return;
+    }
+
+    ResultStream rs = {
+        .os = { .write = result_stream_write, .close = NULL },
+        .text_len = 0
+    };
+
+    fs_wait(fs);
+    status = fs_write_results(fs, (OutputStream *)&rs);
+
+    ok(STATUS_IS_SUCCESS(status), "Write results");
+    ok(fs_finished(fs), "Search finished once results written");
+    ok(fs_match_num(fs) == 4, "Found one match per matching line");
+    ok(fs_file_num(fs) == 3, "Found matches in expected files");
+    ok(find_match(fs, "a.txt", 1, 1), "Match at start of file");
+    ok(find_match(fs, "a.txt", 3, 8), "Match on later line");
+    ok(find_match(fs, "keep.log", 1, 1), "Negated pattern not ignored");
+    ok(find_match(fs, "sub/top.txt", 2, 6),
+       "Match in subdirectory without trailing newline");
+    ok(strstr(rs.text, "a.txt:3:8:second needle\n") != NULL,
+       "Result line written without carriage return");
+
+    st_free_status(status);
+    fs_free(fs);
+}
+
+static void project_index_find(void)
+{
+    msg("Project index:");
+
+    ProjectIndex *pi = pi_new(".");
+
+    if (!ok(pi != NULL, "Create ProjectIndex")) {
+        return;
+    }
+
+    Status status = pi_start(pi);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = pi_wait(pi);
+    }
+
+    ok(STATUS_IS_SUCCESS(status), "Build index");
+    ok(pi_path_num(pi) == 6, "Index contains files that aren't ignored");
+    ok(strcmp(best_match(pi, "stop"), "sub/top.txt") == 0,
+       "Query matches across directories");
+    ok(strcmp(best_match(pi, "KL"), "keep.log") == 0,
+       "Query matches ignoring case");
+    ok(strcmp(best_match(pi, "xyz"), "") == 0, "Unmatched query");
+
+    st_free_status(status);
+    pi_free(pi);
+}
+
+static const char *best_match(const ProjectIndex *pi, const char *query)
+{
+    ProjectIndexMatch match;
+
+    if (pi_find(pi, query, strlen(query), &match, 1) == 0) {
+        return "";
+    }
+
+    return match.indexed_path->path;
+}
+
+static int find_match(const FileSearch *fs, const char *file_path,
+                      size_t line_no, size_t col_no)
+{
+    const FileSearchMatch *match;
+
+    for (size_t k = 0; k < fs_match_num(fs); k++) {
+        match = fs_get_match(fs, k);
+
+        if (strcmp(match->file_path, file_path) == 0 &&
+            match->line_no == line_no && match->col_no == col_no) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../large_file.h"
+#include "../../buffer.h"
+#include "../../config.h"
+
+/* A small chunk size is used so that chunk boundaries can be tested. With
+ * a chunk size of 16 the file below is divided into the chunks:
+ * "alpha\nbeta\n", "gamma delta\n", "epsilon\n", "zeta eta theta i",
+ * "ota kappa\n" and "lambda\nmu" */
+#define TEST_CHUNK_SIZE 16
+
+static const char *test_text =
+    "alpha\nbeta\ngamma delta\nepsilon\nzeta eta theta iota kappa\n"
+    "lambda\nmu";
+
+static int chunk_equals(const LargeFile *, size_t chunk_index,
+                        const char *text);
+static size_t line_chunk(LargeFile *, size_t line_no);
+static void large_file_index(const char *path);
+static void large_file_search(const char *path);
+static void large_file_write(const char *path, const char *out_path);
+static void large_file_window(const char *path);
+static int find_next(LargeFile *, const char *pattern, size_t *chunk_index,
+                     size_t *match_offset);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(22);
+
+    char path[] = "/tmp/wed_large_file_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    char out_path[sizeof(path) + 4];
+    snprintf(out_path, sizeof(out_path), "%s.out", path);
+
+    if (ok(fd != -1 && fx_write_file(path, test_text), "Create test file")) {
+        large_file_index(path);
+        large_file_search(path);
+        large_file_write(path, out_path);
+        large_file_window(path);
+    }
+
+    unlink(path);
+    unlink(out_path);
+
+    return exit_status();
+}
+
+static int chunk_equals(const LargeFile *lf, size_t chunk_index,
+                        const char *text)
+{
+    char buf[1024];
+    size_t len = lf_chunk_length(lf, chunk_index);
+    Status status = lf_read_chunk(lf, chunk_index, buf);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        return 0;
+    }
+
+    return len == strlen(text) && memcmp(buf, text, len) == 0;
+}
+
+static size_t line_chunk(LargeFile *lf, size_t line_no)
+{
+    size_t chunk_index = SIZE_MAX;
+    Status status = lf_index_to_line(lf, line_no, &chunk_index);
+    st_free_status(status);
+
+    return chunk_index;
+}
+
+static void large_file_index(const char *path)
+{
+    msg("Index:");
+
+    LargeFile lf;
+    Status status = lf_init(&lf, path, TEST_CHUNK_SIZE);
+
+    if (!ok(STATUS_IS_SUCCESS(status), "Open file")) {
+        st_free_status(status);
+        lf_free(&lf);
+        return;
+    }
+
+    ok(line_chunk(&lf, 3) == 1 && lf.chunk_num == 2 &&
+       !lf_index_complete(&lf), "Index only as far as line requested");
+
+    status = lf_index_to_chunk(&lf, SIZE_MAX);
+
+    ok(STATUS_IS_SUCCESS(status) && lf_index_complete(&lf) &&
+       lf.chunk_num == 6, "Index whole file");
+    ok(chunk_equals(&lf, 0, "alpha\nbeta\n") &&
+       chunk_equals(&lf, 1, "gamma delta\n"), "Chunks end after new line");
+    ok(chunk_equals(&lf, 3, "zeta eta theta i"),
+       "Chunk ends mid line when line is longer than chunk size");
+    ok(chunk_equals(&lf, 5, "lambda\nmu"), "Last chunk ends at file end");
+    ok(lf_lines_indexed(&lf) == 6 && lf.chunks[4].start_line == 4,
+       "Count new lines");
+    ok(line_chunk(&lf, 1) == 0 && line_chunk(&lf, 5) == 3 &&
+       line_chunk(&lf, 6) == 5 && line_chunk(&lf, 7) == 5,
+       "Find chunk line starts in");
+    ok(line_chunk(&lf, 100) == 5, "Line past file end maps to last chunk");
+
+    st_free_status(status);
+    lf_free(&lf);
+}
+
+static int find_next(LargeFile *lf, const char *pattern, size_t *chunk_index,
+                     size_t *match_offset)
+{
+    BufferSearch search;
+    memset(&search, 0, sizeof(BufferSearch));
+    search.search_type = BST_TEXT;
+    search.opt.pattern = (char *)pattern;
+    search.opt.pattern_len = strlen(pattern);
+    search.opt.forward = 1;
+
+    int found_match = 0;
+    Status status = ts_init(&search.type.text, &search.opt);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = lf_find_next(lf, &search, 0, SIZE_MAX, chunk_index,
+                              match_offset, &found_match);
+        ts_free(&search.type.text);
+    }
+
+    st_free_status(status);
+
+    return found_match;
+}
+
+static void large_file_search(const char *path)
+{
+    msg("Search:");
+
+    LargeFile lf;
+    Status status = lf_init(&lf, path, TEST_CHUNK_SIZE);
+
+    if (!ok(STATUS_IS_SUCCESS(status), "Open file")) {
+        st_free_status(status);
+        lf_free(&lf);
+        return;
+    }
+
+    size_t chunk_index, match_offset;
+
+    ok(find_next(&lf, "kappa", &chunk_index, &match_offset) &&
+       chunk_index == 4 && match_offset == 4, "Find match in later chunk");
+    ok(find_next(&lf, "iota", &chunk_index, &match_offset) &&
+       chunk_index == 3 && match_offset == 15,
+       "Find match spanning chunk boundary");
+    ok(!find_next(&lf, "omega", &chunk_index, &match_offset),
+       "No match for absent pattern");
+
+    lf_free(&lf);
+}
+
+static void large_file_write(const char *path, const char *out_path)
+{
+    msg("Edit and write:");
+
+    LargeFile lf;
+    Status status = lf_init(&lf, path, TEST_CHUNK_SIZE);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = lf_index_to_chunk(&lf, 2);
+    }
+
+    if (!ok(STATUS_IS_SUCCESS(status), "Open file and index part of it")) {
+        st_free_status(status);
+        lf_free(&lf);
+        return;
+    }
+
+    lf_set_chunk_text(&lf, 1, strdup("GAMMA\nDELTA\n"), 12);
+
+    ok(lf.modified && lf.chunks[1].lines == 2 && lf.chunks[2].start_line == 4,
+       "Edited chunk updates following line numbers");
+
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    status = fd != -1 ? lf_write(&lf, fd) : STATUS_SUCCESS;
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    char *text = fx_read_file(out_path);
+
+    ok(fd != -1 && STATUS_IS_SUCCESS(status) && text != NULL &&
+       strcmp(text, "alpha\nbeta\nGAMMA\nDELTA\nepsilon\n"
+                    "zeta eta theta iota kappa\nlambda\nmu") == 0,
+       "Write edits and unindexed part of file");
+    free(text);
+    st_free_status(status);
+
+    status = lf_saved(&lf, out_path);
+
+    ok(STATUS_IS_SUCCESS(status) && !lf.modified &&
+       lf.chunks[1].text == NULL && chunk_equals(&lf, 1, "GAMMA\nDELTA\n") &&
+       chunk_equals(&lf, 2, "epsilon\n"), "Chunks read from saved file");
+
+    st_free_status(status);
+    status = lf_index_to_chunk(&lf, SIZE_MAX);
+
+    ok(STATUS_IS_SUCCESS(status) && lf.chunk_num == 6 &&
+       chunk_equals(&lf, 5, "lambda\nmu"), "Index continues in saved file");
+
+    st_free_status(status);
+    lf_free(&lf);
+}
+
+static void large_file_window(const char *path)
+{
+    msg("Buffer window:");
+
+    Config *config = cf_new_config(NULL, CL_SESSION);
+    FileInfo file_info;
+    Status status = fi_init(&file_info, path);
+    Buffer *buffer = NULL;
+
+    if (STATUS_IS_SUCCESS(status)) {
+        buffer = config == NULL ? NULL : bf_new(&file_info, config);
+
+        if (buffer == NULL) {
+            fi_free(&file_info);
+        }
+    }
+
+    if (buffer != NULL) {
+        status = bf_load_large_file(buffer, TEST_CHUNK_SIZE);
+    }
+
+    if (!ok(buffer != NULL && STATUS_IS_SUCCESS(status) &&
+            buffer->large_file->window_chunks == 2,
+            "Load first window of chunks into buffer")) {
+        st_free_status(status);
+        bf_free(buffer);
+        cf_free_config(config);
+        return;
+    }
+
+    const LargeFile *lf = buffer->large_file;
+    status = bf_insert_string(buffer, "X", 1, 0);
+
+    /* Moving the cursor into the last loaded chunk loads the next chunk */
+    if (STATUS_IS_SUCCESS(status)) {
+        BufferPos pos = buffer->pos;
+        bp_to_buffer_end(&pos);
+        status = bf_set_bp(buffer, &pos, 0);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_update_large_file_window(buffer);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && lf->window_chunks == 3 &&
+       lf->modified,
+       "Moving window keeps edits");
+    ok(lf->chunks[0].text != NULL && lf->chunks[0].text_len == 12 &&
+       memcmp(lf->chunks[0].text, "Xalpha\nbeta\n", 12) == 0 &&
+       lf->chunks[1].text == NULL && lf->chunks[2].text == NULL,
+       "Only edited chunks are stored");
+    st_free_status(status);
+
+    bf_free(buffer);
+    cf_free_config(config);
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tap.h"
+#include "../../hashmap.h"
+
+/* Enough entries to cause the hashmap to resize several times */
+#define TEST_KEY_NUM 1000
+
+static void make_key(char *key, size_t key_size, size_t index);
+static void hashmap_insert(HashMap *);
+static void hashmap_find(HashMap *);
+static void hashmap_iterate(HashMap *);
+static void hashmap_remove(HashMap *);
+
+static size_t values[TEST_KEY_NUM];
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(18);
+
+    for (size_t k = 0; k < TEST_KEY_NUM; k++) {
+        values[k] = k;
+    }
+
+    HashMap *hashmap = new_hashmap();
+
+    if (!ok(hashmap != NULL, "Create HashMap")) {
+        return exit_status();
+    }
+
+    hashmap_insert(hashmap);
+    hashmap_find(hashmap);
+    hashmap_iterate(hashmap);
+    hashmap_remove(hashmap);
+
+    free_hashmap(hashmap);
+
+    return exit_status();
+}
+
+/* Every third key is too long to be stored inline */
+static void make_key(char *key, size_t key_size, size_t index)
+{
+    if (index % 3 == 0) {
+        snprintf(key, key_size, "long key which is stored separately %zu",
+                 index);
+    } else {
+        snprintf(key, key_size, "key%zu", index);
+    }
+}
+
+static void hashmap_insert(HashMap *hashmap)
+{
+    msg("Insert:");
+
+    char key[64];
+    int inserted = 1;
+
+    for (size_t k = 0; k < TEST_KEY_NUM; k++) {
+        make_key(key, sizeof(key), k);
+        inserted = inserted && hashmap_set(hashmap, key, &values[k]);
+    }
+
+    ok(inserted, "Insert keys");
+    ok(hashmap_size(hashmap) == TEST_KEY_NUM,
+       "Entry count correct after insertions");
+    ok(hashmap_set(hashmap, "key1", &values[2]) &&
+       hashmap_size(hashmap) == TEST_KEY_NUM,
+       "Setting existing key doesn't add entry");
+    ok(hashmap_get(hashmap, "key1") == &values[2],
+       "Setting existing key replaces value");
+    ok(hashmap_set(hashmap, "key1", &values[1]), "Restore value");
+    ok(!hashmap_set(hashmap, NULL, &values[0]), "NULL key rejected");
+}
+
+static void hashmap_find(HashMap *hashmap)
+{
+    msg("Find:");
+
+    char key[64];
+    int found = 1;
+
+    for (size_t k = 0; k < TEST_KEY_NUM; k++) {
+        make_key(key, sizeof(key), k);
+        found = found && hashmap_get(hashmap, key) == &values[k];
+    }
+
+    ok(found, "Found inserted keys");
+    ok(hashmap_get(hashmap, "key") == NULL &&
+       hashmap_get(hashmap, "key1000") == NULL &&
+       hashmap_get(hashmap, "") == NULL, "No false positive match");
+
+    HashMapKey hm_key = hashmap_hash_key("key10");
+
+    ok(hashmap_get_hashed(hashmap, &hm_key) == &values[10],
+       "Found key using precomputed hash");
+    ok(hashmap_set_hashed(hashmap, &hm_key, &values[11]) &&
+       hashmap_get(hashmap, "key10") == &values[11] &&
+       hashmap_set_hashed(hashmap, &hm_key, &values[10]),
+       "Set key using precomputed hash");
+}
+
+static void hashmap_iterate(HashMap *hashmap)
+{
+    msg("Iterate:");
+
+    static int visited[TEST_KEY_NUM];
+    HashMapIterator iter;
+    const char *key;
+    void *value;
+    size_t entries = 0;
+    int keys_match = 1;
+    char expected_key[64];
+
+    hashmap_iter_init(&iter, hashmap);
+
+    while (hashmap_iter_next(&iter, &key, &value)) {
+        size_t index = (size_t *)value - values;
+        make_key(expected_key, sizeof(expected_key), index);
+        keys_match = keys_match && strcmp(key, expected_key) == 0;
+        visited[index]++;
+        entries++;
+    }
+
+    int visited_once = 1;
+
+    for (size_t k = 0; k < TEST_KEY_NUM; k++) {
+        visited_once = visited_once && visited[k] == 1;
+    }
+
+    ok(entries == TEST_KEY_NUM && visited_once,
+       "Iterator visits each entry once");
+    ok(keys_match, "Iterator returns key for each value");
+}
+
+static void hashmap_remove(HashMap *hashmap)
+{
+    msg("Delete:");
+
+    char key[64];
+    int deleted = 1;
+
+    for (size_t k = 0; k < TEST_KEY_NUM; k += 2) {
+        make_key(key, sizeof(key), k);
+        deleted = deleted && hashmap_delete(hashmap, key);
+    }
+
+    ok(deleted && hashmap_size(hashmap) == TEST_KEY_NUM / 2,
+       "Delete keys");
+
+    int found = 1;
+
+    for (size_t k = 0; k < TEST_KEY_NUM; k++) {
+        make_key(key, sizeof(key), k);
+        found = found && (hashmap_get(hashmap, key) ==
+                          (k % 2 == 0 ? NULL : &values[k]));
+    }
+
+    ok(found, "Only remaining keys found");
+    ok(!hashmap_delete(hashmap, "key0"), "Can't delete key twice");
+
+    int inserted = 1;
+
+    /* Repeatedly deleting and inserting reuses deleted slots rather than
+     * growing the hashmap */
+    for (size_t i = 0; i < 10; i++) {
+        for (size_t k = 0; k < TEST_KEY_NUM; k += 2) {
+            make_key(key, sizeof(key), k);
+            inserted = inserted && hashmap_set(hashmap, key, &values[k]);
+        }
+
+        for (size_t k = 0; k < TEST_KEY_NUM; k += 2) {
+            make_key(key, sizeof(key), k);
+            inserted = inserted && hashmap_delete(hashmap, key);
+        }
+    }
+
+    ok(inserted && hashmap_size(hashmap) == TEST_KEY_NUM / 2 &&
+       hashmap_get(hashmap, "key1") == &values[1] &&
+       hashmap_get(hashmap, "key2") == NULL,
+       "Insert and delete keys repeatedly");
+
+    hashmap_clear(hashmap);
+
+    ok(hashmap_size(hashmap) == 0 && hashmap_get(hashmap, "key1") == NULL,
+       "Clear hashmap");
+}
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../file_explorer.h"
+#include "../../config.h"
+
+/* Entries without content are directories */
+static const char *test_files[][2] = {
+    { "b.txt", "b\n" },
+    { "A.txt", "a\n" },
+    { "sub/", NULL },
+    { "sub/c.txt", "c\n" }
+};
+
+#define TEST_FILE_NUM (sizeof(test_files) / sizeof(test_files[0]))
+
+/* Several levels of expanded directories */
+static const char *nested_files[][2] = {
+    { "nested/", NULL },
+    { "nested/a/", NULL },
+    { "nested/a/x.txt", "x\n" },
+    { "nested/b/", NULL },
+    { "nested/b/c/", NULL },
+    { "nested/b/c/y.txt", "y\n" },
+    { "nested/b/z.txt", "z\n" },
+    { "nested/w.txt", "w\n" }
+};
+
+#define NESTED_FILE_NUM (sizeof(nested_files) / sizeof(nested_files[0]))
+
+static void file_explorer_tree(const char *dir_path);
+static void file_explorer_nested(const char *dir_path);
+static int toggle_row(FileExplorer *, size_t line_no);
+static int rows_equal(FileExplorer *, const char *dir_path,
+                      const char *paths[], size_t path_num);
+static int buffer_equals(const FileExplorer *, const char *text);
+static int select_row(FileExplorer *, size_t line_no);
+static int wait_for_update(FileExplorer *);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(20);
+
+    char dir_template[] = "/tmp/wed_file_explorer_XXXXXX";
+    char cwd[4096];
+
+    if (!ok(getcwd(cwd, sizeof(cwd)) != NULL &&
+            mkdtemp(dir_template) != NULL &&
+            chdir(dir_template) == 0, "Create test directory")) {
+        return exit_status();
+    }
+
+    if (ok(fx_create_files(test_files, TEST_FILE_NUM),
+           "Create test files")) {
+        file_explorer_tree(dir_template);
+    }
+
+    if (ok(fx_create_files(nested_files, NESTED_FILE_NUM),
+           "Create nested test files")) {
+        file_explorer_nested(dir_template);
+    }
+
+    rmdir("nested/0");
+    fx_remove_files(nested_files, NESTED_FILE_NUM);
+    unlink("d.txt");
+    fx_remove_files(test_files, TEST_FILE_NUM);
+
+    if (chdir(cwd) == 0) {
+        rmdir(dir_template);
+    }
+
+    return exit_status();
+}
+
+static void file_explorer_tree(const char *dir_path)
+{
+    Config *config = cf_new_config(NULL, CL_SESSION);
+    Buffer *buffer = config != NULL ?
+                     bf_new_empty("file_explorer", config) : NULL;
+    FileExplorer *fe = buffer != NULL ? fe_new(buffer) : NULL;
+
+    if (!ok(fe != NULL, "Create FileExplorer")) {
+        bf_free(buffer);
+        cf_free_config(config);
+        return;
+    }
+
+    Status status = fe_read_directory(fe, dir_path);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = fe_wait(fe);
+    }
+
+    ok(STATUS_IS_SUCCESS(status), "Read directory");
+    st_free_status(status);
+    ok(buffer_equals(fe, "../\nsub/\nA.txt\nb.txt"),
+       "Directories listed first then files ignoring case");
+
+    int toggled = 0;
+    status = select_row(fe, 2) ? fe_toggle_selected(fe, &toggled)
+                               : STATUS_SUCCESS;
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = fe_wait(fe);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && toggled, "Expand directory");
+    st_free_status(status);
+    ok(buffer_equals(fe, "../\nsub/\n  c.txt\nA.txt\nb.txt"),
+       "Directory entries indented below directory");
+
+    ok(fe_is_directory_row(fe, 0) && fe_is_directory_row(fe, 1) &&
+       !fe_is_directory_row(fe, 2) && !fe_is_directory_row(fe, 3),
+       "Directory rows identified");
+
+    char *selected = select_row(fe, 3) ? fe_get_selected(fe) : NULL;
+    char expected[4096];
+    snprintf(expected, sizeof(expected), "%s/sub/c.txt", dir_path);
+    ok(selected != NULL && strcmp(selected, expected) == 0,
+       "Selected path includes expanded directory");
+    free(selected);
+
+    FILE *file = fopen("d.txt", "w");
+
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    ok(wait_for_update(fe), "Update on file creation");
+    ok(buffer_equals(fe, "../\nsub/\n  c.txt\nA.txt\nb.txt\nd.txt"),
+       "Created file added in order");
+
+    unlink("sub/c.txt");
+
+    ok(wait_for_update(fe), "Update on file removal");
+    ok(buffer_equals(fe, "../\nsub/\nA.txt\nb.txt\nd.txt"),
+       "Removed file removed from expanded directory");
+
+    fe_free(fe);
+    cf_free_config(config);
+}
+
+static void file_explorer_nested(const char *dir_path)
+{
+    msg("Nested directories:");
+
+    char nested_path[4096];
+    snprintf(nested_path, sizeof(nested_path), "%s/nested", dir_path);
+
+    Config *config = cf_new_config(NULL, CL_SESSION);
+    Buffer *buffer = config != NULL ?
+                     bf_new_empty("file_explorer", config) : NULL;
+    FileExplorer *fe = buffer != NULL ? fe_new(buffer) : NULL;
+    Status status = fe != NULL ? fe_read_directory(fe, nested_path)
+                               : STATUS_SUCCESS;
+
+    if (STATUS_IS_SUCCESS(status) && fe != NULL) {
+        status = fe_wait(fe);
+    }
+
+    if (!ok(fe != NULL && STATUS_IS_SUCCESS(status), "Read directory")) {
+        st_free_status(status);
+        fe_free(fe);
+        bf_free(buffer);
+        cf_free_config(config);
+        return;
+    }
+
+    /* Expand b, then a before it, then c within b */
+    ok(toggle_row(fe, 3) && toggle_row(fe, 2) && toggle_row(fe, 5) &&
+       buffer_equals(fe, "../\na/\n  x.txt\nb/\n  c/\n    y.txt\n"
+                         "  z.txt\nw.txt"),
+       "Expand several directories");
+
+    const char *expanded_paths[] = {
+        "..", "a", "a/x.txt", "b", "b/c", "b/c/y.txt", "b/z.txt", "w.txt"
+    };
+
+    ok(rows_equal(fe, nested_path, expanded_paths, 8),
+       "Each row maps to its entry");
+
+    ok(mkdir("nested/0", 0700) == 0 && wait_for_update(fe) &&
+       buffer_equals(fe, "../\n0/\na/\n  x.txt\nb/\n  c/\n    y.txt\n"
+                         "  z.txt\nw.txt"),
+       "Directory added before expanded directories");
+
+    const char *added_paths[] = {
+        "..", "0", "a", "a/x.txt", "b", "b/c", "b/c/y.txt", "b/z.txt",
+        "w.txt"
+    };
+
+    ok(rows_equal(fe, nested_path, added_paths, 9),
+       "Rows map to entries after expanded directories move");
+
+    const char *collapsed_paths[] = {
+        "..", "0", "a", "b", "b/c", "b/c/y.txt", "b/z.txt", "w.txt"
+    };
+
+    ok(toggle_row(fe, 3) && rows_equal(fe, nested_path, collapsed_paths, 8),
+       "Rows map to entries after directory collapsed");
+
+    fe_free(fe);
+    cf_free_config(config);
+}
+
+static int toggle_row(FileExplorer *fe, size_t line_no)
+{
+    int toggled = 0;
+    Status status = select_row(fe, line_no) ?
+                    fe_toggle_selected(fe, &toggled) : STATUS_SUCCESS;
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = fe_wait(fe);
+    }
+
+    int success = STATUS_IS_SUCCESS(status) && toggled;
+    st_free_status(status);
+
+    return success;
+}
+
+/* Check the path selected on each row. Paths are relative to dir_path */
+static int rows_equal(FileExplorer *fe, const char *dir_path,
+                      const char *paths[], size_t path_num)
+{
+    char expected[4096];
+    char *selected;
+    int equal;
+
+    for (size_t k = 0; k < path_num; k++) {
+        snprintf(expected, sizeof(expected), "%s/%s", dir_path, paths[k]);
+        selected = select_row(fe, k + 1) ? fe_get_selected(fe) : NULL;
+        equal = selected != NULL && strcmp(selected, expected) == 0;
+
+        if (!equal) {
+            msg("Row %zu selected: %s", k + 1,
+                selected != NULL ? selected : "NULL");
+        }
+
+        free(selected);
+
+        if (!equal) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int buffer_equals(const FileExplorer *fe, const char *text)
+{
+    char *str = bf_to_string(fe_get_buffer(fe));
+    int equal = str != NULL && strcmp(str, text) == 0;
+
+    if (!equal) {
+        msg("Buffer contained: %s", str != NULL ? str : "NULL");
+    }
+
+    free(str);
+
+    return equal;
+}
+
+static int select_row(FileExplorer *fe, size_t line_no)
+{
+    Buffer *buffer = fe_get_buffer(fe);
+    BufferPos pos = bp_init_from_line_col(line_no, 1, &buffer->pos);
+    Status status = bf_set_bp(buffer, &pos, 0);
+    int selected = STATUS_IS_SUCCESS(status) &&
+                   buffer->pos.line_no == line_no;
+    st_free_status(status);
+
+    return selected;
+}
+
+/* Process events until the file explorer is updated or a second has
+ * passed without any */
+static int wait_for_update(FileExplorer *fe)
+{
+    int updated = 0;
+
+    while (!updated) {
+        fd_set read_fds;
+        int max_fd = -1;
+        FD_ZERO(&read_fds);
+        fe_add_fds(fe, &read_fds, &max_fd);
+
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+
+        if (max_fd == -1 ||
+            select(max_fd + 1, &read_fds, NULL, NULL, &timeout) <= 0) {
+            return 0;
+        }
+
+        Status status = fe_process(fe, &read_fds, &updated);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            st_free_status(status);
+            return 0;
+        }
+    }
+
+    return 1;
+}
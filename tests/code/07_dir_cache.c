@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../dir_cache.h"
+
+/* Entries without content are directories */
+static const char *test_files[][2] = {
+    { "beta.c", "b\n" },
+    { "alpha.c", "a\n" },
+    { "alphabet.h", "a\n" },
+    { "lib/", NULL }
+};
+
+#define TEST_FILE_NUM (sizeof(test_files) / sizeof(test_files[0]))
+
+static void dir_cache_listing(const char *dir_path);
+static int matches_equal(const DirListing *, const char *names);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(12);
+
+    char dir_template[] = "/tmp/wed_dir_cache_XXXXXX";
+    char cwd[4096];
+
+    if (!ok(getcwd(cwd, sizeof(cwd)) != NULL &&
+            mkdtemp(dir_template) != NULL &&
+            chdir(dir_template) == 0, "Create test directory")) {
+        return exit_status();
+    }
+
+    if (ok(fx_create_files(test_files, TEST_FILE_NUM),
+           "Create test files")) {
+        dir_cache_listing(dir_template);
+    }
+
+    unlink("gamma.c");
+    fx_remove_files(test_files, TEST_FILE_NUM);
+
+    if (chdir(cwd) == 0) {
+        rmdir(dir_template);
+    }
+
+    return exit_status();
+}
+
+static void dir_cache_listing(const char *dir_path)
+{
+    DirCache *dc = dc_new();
+
+    if (!ok(dc != NULL, "Create DirCache")) {
+        return;
+    }
+
+    DirListing *listing;
+    Status status = dc_get_listing(dc, dir_path, &listing);
+    int uncached = STATUS_IS_SUCCESS(status) && listing == NULL;
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = dc_wait(dc, -1);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = dc_get_listing(dc, dir_path, &listing);
+    }
+
+    ok(uncached, "Directory read in background when not cached");
+    ok(STATUS_IS_SUCCESS(status) && listing != NULL,
+       "Listing available once read");
+    st_free_status(status);
+
+    if (listing == NULL) {
+        dc_free(dc);
+        return;
+    }
+
+    ok(listing->entry_num == 4 &&
+       strcmp(listing->entries[0].name, "alpha.c") == 0 &&
+       strcmp(listing->entries[3].name, "lib") == 0 &&
+       listing->entries[3].is_dir && !listing->entries[0].is_dir,
+       "Entries sorted by name with directories identified");
+
+    status = dc_find(listing, "", 0);
+    ok(STATUS_IS_SUCCESS(status) && listing->match_num == 4,
+       "Empty query matches all entries");
+    st_free_status(status);
+
+    status = dc_find(listing, "al", 2);
+    ok(STATUS_IS_SUCCESS(status) &&
+       matches_equal(listing, "alpha.c alphabet.h"),
+       "Query matches entries containing it");
+    st_free_status(status);
+
+    /* Only the previous matches are checked, so changing them shows the
+     * query was narrowed rather than checked against every entry */
+    listing->match_num = 1;
+    status = dc_find(listing, "alph", 4);
+    ok(STATUS_IS_SUCCESS(status) && matches_equal(listing, "alpha.c"),
+       "Longer query narrows previous matches");
+    st_free_status(status);
+
+    status = dc_find(listing, "a", 1);
+    ok(STATUS_IS_SUCCESS(status) &&
+       matches_equal(listing, "alpha.c alphabet.h beta.c"),
+       "Shorter query checks every entry");
+    st_free_status(status);
+
+    status = dc_get_listing(dc, dir_path, &listing);
+    ok(STATUS_IS_SUCCESS(status) && listing != NULL,
+       "Unchanged directory served from cache");
+    st_free_status(status);
+
+    FILE *file = fopen("gamma.c", "w");
+
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    /* Wait for the change to be reported by inotify, otherwise the
+     * modification time will have changed */
+    fd_set read_fds;
+    int max_fd = -1;
+    int updated;
+    FD_ZERO(&read_fds);
+    dc_add_fds(dc, &read_fds, &max_fd);
+    struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+
+    if (max_fd != -1 &&
+        select(max_fd + 1, &read_fds, NULL, NULL, &timeout) > 0) {
+        st_free_status(dc_process(dc, &read_fds, &updated));
+    }
+
+    status = dc_get_listing(dc, dir_path, &listing);
+    int stale = STATUS_IS_SUCCESS(status) && listing == NULL;
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = dc_wait(dc, -1);
+    }
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = dc_get_listing(dc, dir_path, &listing);
+    }
+
+    ok(stale && STATUS_IS_SUCCESS(status) && listing != NULL &&
+       listing->entry_num == 5, "Changed directory read again");
+    st_free_status(status);
+
+    dc_free(dc);
+}
+
+/* names lists the expected matches separated by spaces */
+static int matches_equal(const DirListing *listing, const char *names)
+{
+    char matched[1024] = "";
+
+    for (size_t k = 0; k < listing->match_num; k++) {
+        if (k > 0) {
+            strcat(matched, " ");
+        }
+
+        strcat(matched, listing->entries[listing->matches[k]].name);
+    }
+
+    if (strcmp(matched, names) != 0) {
+        msg("Matched: %s", matched);
+        return 0;
+    }
+
+    return 1;
+}
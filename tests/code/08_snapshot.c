@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tap.h"
+#include "../../snapshot.h"
+#include "../../session.h"
+
+static int write_snapshot(const char *path);
+static void read_snapshot(const char *path);
+static void invalid_snapshot(const char *path);
+static void restore_session(const char *path);
+static void text_hash(void);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(17);
+
+    char path[] = "/tmp/wed_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (!ok(fd != -1, "Create snapshot file")) {
+        return exit_status();
+    }
+
+    close(fd);
+
+    if (ok(write_snapshot(path), "Write snapshot")) {
+        read_snapshot(path);
+        invalid_snapshot(path);
+        restore_session(path);
+    }
+
+    text_hash();
+
+    unlink(path);
+
+    return exit_status();
+}
+
+static int write_snapshot(const char *path)
+{
+    SnapshotWriter writer;
+    SnapshotBuffer *buffer;
+    sn_init_writer(&writer);
+
+    int success =
+        STATUS_IS_SUCCESS(sn_set_cwd(&writer, "/home/wed")) &&
+        STATUS_IS_SUCCESS(sn_add_history(&writer, SH_SEARCH, "needle")) &&
+        STATUS_IS_SUCCESS(sn_add_history(&writer, SH_COMMAND, "ln=0;")) &&
+        STATUS_IS_SUCCESS(sn_add_buffer(&writer, "a.c", "/home/wed/a.c",
+                                        &buffer));
+
+    if (success) {
+        buffer->hash = 42;
+        buffer->positions[SP_CURSOR] = 10;
+        success =
+            STATUS_IS_SUCCESS(sn_add_setting(&writer, "tabwidth",
+                                             INT_VAL(4))) &&
+            STATUS_IS_SUCCESS(sn_add_setting(&writer, "filetype",
+                                             STR_VAL("c"))) &&
+            STATUS_IS_SUCCESS(sn_set_search(&writer, "ne+dle",
+                                            SS_REGEX | SS_FORWARD)) &&
+            STATUS_IS_SUCCESS(sn_add_buffer(&writer, "b.txt",
+                                            "/home/wed/b.txt", &buffer));
+    }
+
+    if (success) {
+        writer.header.active_buffer_index = 1;
+        success = STATUS_IS_SUCCESS(sn_write(&writer, path));
+    }
+
+    sn_free_writer(&writer);
+
+    return success;
+}
+
+static void read_snapshot(const char *path)
+{
+    Snapshot snapshot;
+    Status status = sn_open(&snapshot, path);
+
+    if (!ok(STATUS_IS_SUCCESS(status) && sn_is_open(&snapshot),
+            "Open snapshot")) {
+        st_free_status(status);
+        return;
+    }
+
+    const SnapshotHeader *header = snapshot.header;
+
+    ok(header->buffer_num == 2 && header->setting_num == 2 &&
+       header->history_num == 2 && header->active_buffer_index == 1,
+       "Record counts restored");
+    ok(strcmp(sn_string(&snapshot, header->cwd), "/home/wed") == 0,
+       "Working directory restored");
+    ok(snapshot.history[0].history == SH_SEARCH &&
+       strcmp(sn_string(&snapshot, snapshot.history[0].text),
+              "needle") == 0 &&
+       snapshot.history[1].history == SH_COMMAND,
+       "History restored in order");
+
+    const SnapshotBuffer *buffer = &snapshot.buffers[0];
+
+    ok(strcmp(sn_string(&snapshot, buffer->rel_path), "a.c") == 0 &&
+       strcmp(sn_string(&snapshot, buffer->abs_path), "/home/wed/a.c") == 0,
+       "Buffer paths restored");
+    ok(buffer->hash == 42 && buffer->positions[SP_CURSOR] == 10 &&
+       buffer->positions[SP_SELECT_START] == SN_NO_POSITION,
+       "Buffer positions restored");
+
+    ok(strcmp(sn_string(&snapshot, buffer->search_pattern), "ne+dle") == 0 &&
+       buffer->search_flags == (SS_REGEX | SS_FORWARD) &&
+       *sn_string(&snapshot, snapshot.buffers[1].search_pattern) == '\0' &&
+       snapshot.buffers[1].search_flags == 0,
+       "Buffer search restored");
+
+    Value tabwidth = sn_setting_value(&snapshot, &snapshot.settings[0]);
+    Value filetype = sn_setting_value(&snapshot, &snapshot.settings[1]);
+
+    ok(buffer->setting_start == 0 && buffer->setting_num == 2 &&
+       tabwidth.type == VAL_TYPE_INT && IVAL(tabwidth) == 4 &&
+       filetype.type == VAL_TYPE_STR && strcmp(SVAL(filetype), "c") == 0,
+       "Buffer settings restored");
+    ok(snapshot.buffers[1].setting_start == 2 &&
+       snapshot.buffers[1].setting_num == 0,
+       "Settings belong to the buffer added before them");
+
+    sn_close(&snapshot);
+    ok(!sn_is_open(&snapshot), "Close snapshot");
+}
+
+static void invalid_snapshot(const char *path)
+{
+    Snapshot snapshot;
+    Status status;
+
+    /* Truncating the file removes the end of the string table */
+    if (truncate(path, sizeof(SnapshotHeader) + sizeof(SnapshotBuffer))
+            == 0) {
+        status = sn_open(&snapshot, path);
+        ok(status.error_code == ERR_INVALID_SNAPSHOT &&
+           !sn_is_open(&snapshot), "Truncated snapshot rejected");
+        st_free_status(status);
+    } else {
+        ok(0, "Truncated snapshot rejected");
+    }
+
+    FILE *file = fopen(path, "w");
+
+    if (file != NULL) {
+        fputs("Not a snapshot, but long enough to contain a header\n",
+              file);
+        fclose(file);
+    }
+
+    status = sn_open(&snapshot, path);
+    ok(status.error_code == ERR_INVALID_SNAPSHOT, "Other file rejected");
+    st_free_status(status);
+}
+
+static int has_buffer(const Session *sess, const char *abs_path)
+{
+    const char *buffer_path;
+
+    for (size_t k = 0; k < sess->buffer_num; k++) {
+        buffer_path = se_get_buffer(sess, k)->file_info.abs_path;
+
+        if (buffer_path != NULL && strcmp(buffer_path, abs_path) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void restore_session(const char *path)
+{
+    char dir_path[] = "/tmp/wed_snapshot_dir_XXXXXX";
+    char file_path[] = "/tmp/wed_snapshot_file_XXXXXX";
+    int fd = mkstemp(file_path);
+    SnapshotWriter writer;
+    SnapshotBuffer *buffer;
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    /* The first file has been replaced by a directory since the snapshot
+     * was taken */
+    sn_init_writer(&writer);
+    int success =
+        fd != -1 && mkdtemp(dir_path) != NULL &&
+        STATUS_IS_SUCCESS(sn_set_cwd(&writer, "/nonexistent")) &&
+        STATUS_IS_SUCCESS(sn_add_buffer(&writer, "dir", dir_path,
+                                        &buffer)) &&
+        STATUS_IS_SUCCESS(sn_add_buffer(&writer, "file", file_path,
+                                        &buffer)) &&
+        STATUS_IS_SUCCESS(sn_write(&writer, path));
+    sn_free_writer(&writer);
+
+    Session *sess = success ? se_new() : NULL;
+    WedOpt wed_opt = { .test_mode = 1, .session_file_path = (char *)path };
+    char *errors = NULL;
+
+    if (sess != NULL && se_init(sess, &wed_opt, NULL, 0)) {
+        errors = bf_to_string(sess->error_buffer);
+        success = has_buffer(sess, file_path) && !has_buffer(sess, dir_path);
+    } else {
+        success = 0;
+    }
+
+    ok(success && errors != NULL && strstr(errors, "is a directory") != NULL,
+       "Buffers after one which can't be opened are restored");
+
+    free(errors);
+    se_free(sess);
+    rmdir(dir_path);
+    unlink(file_path);
+}
+
+static void text_hash(void)
+{
+    const char *text = "The hash of text doesn't depend on the gap\n";
+    const size_t text_len = strlen(text);
+    GapBuffer *start_gap = gb_new(text_len);
+    GapBuffer *middle_gap = gb_new(text_len);
+
+    if (start_gap == NULL || middle_gap == NULL) {
+        ok(0, "Hash independent of gap position");
+        gb_free(start_gap);
+        gb_free(middle_gap);
+        return;
+    }
+
+    gb_add(start_gap, text, text_len);
+    gb_set_point(start_gap, 0);
+    gb_add(middle_gap, text, text_len);
+    gb_set_point(middle_gap, 13);
+
+    uint64_t hash = sn_hash_text(start_gap);
+
+    ok(hash != 0 && hash == sn_hash_text(middle_gap),
+       "Hash independent of gap position");
+
+    gb_set_point(middle_gap, text_len);
+    gb_insert(middle_gap, "!", 1);
+    ok(hash != sn_hash_text(middle_gap), "Hash changes with text");
+
+    gb_free(start_gap);
+    gb_free(middle_gap);
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../buffer.h"
+#include "../../config.h"
+
+static const char *test_text = "first line\nsecond line\nthird line\n";
+
+static int text_equals(const Buffer *, const char *text);
+static void buffer_unload(const char *path, const Config *);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(8);
+
+    char path[] = "/tmp/wed_buffer_unload_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    Config *config = cf_new_config(NULL, CL_SESSION);
+
+    if (ok(fd != -1 && config != NULL && fx_write_file(path, test_text),
+           "Create test file")) {
+        buffer_unload(path, config);
+    }
+
+    cf_free_config(config);
+    unlink(path);
+
+    return exit_status();
+}
+
+static int text_equals(const Buffer *buffer, const char *text)
+{
+    const size_t text_len = strlen(text);
+    char buf[256];
+
+    if (bf_length(buffer) != text_len || text_len >= sizeof(buf)) {
+        return 0;
+    }
+
+    BufferPos pos = buffer->pos;
+    bp_to_buffer_start(&pos);
+
+    return bf_get_text(buffer, &pos, buf, text_len) == text_len &&
+           memcmp(buf, text, text_len) == 0;
+}
+
+static void buffer_unload(const char *path, const Config *config)
+{
+    FileInfo file_info;
+    Status status = fi_init(&file_info, path);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        ok(0, "Create unloaded buffer");
+        return;
+    }
+
+    Buffer *buffer = bf_new_unloaded(&file_info, config);
+
+    if (!ok(buffer != NULL && !bf_is_view_initialised(buffer),
+            "Create unloaded buffer")) {
+        fi_free(&file_info);
+        return;
+    }
+
+    status = bf_init_view(buffer);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_load_file(buffer);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && bf_is_view_initialised(buffer) &&
+       text_equals(buffer, test_text), "Load unloaded buffer");
+    st_free_status(status);
+
+    status = bf_unload(buffer);
+    ok(STATUS_IS_SUCCESS(status) && !bf_is_view_initialised(buffer) &&
+       bf_length(buffer) == 0, "Unload buffer content and view");
+    st_free_status(status);
+
+    ok(!bf_is_dirty(buffer), "Unloaded buffer is unmodified");
+
+    status = bf_init_view(buffer);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_load_file(buffer);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && text_equals(buffer, test_text) &&
+       !bf_is_dirty(buffer), "Load buffer again");
+    st_free_status(status);
+
+    status = bf_insert_string(buffer, "new ", 4, 1);
+    ok(STATUS_IS_SUCCESS(status) && bf_is_dirty(buffer), "Modify buffer");
+    st_free_status(status);
+
+    status = bf_unload(buffer);
+    ok(status.error_code == ERR_BUFFER_MODIFIED &&
+       bf_is_view_initialised(buffer) && bf_length(buffer) ==
+       strlen(test_text) + 4, "Modified buffer isn't unloaded");
+    st_free_status(status);
+
+    bf_free(buffer);
+}
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../journal.h"
+#include "../../session.h"
+
+static const char *test_text = "first line\nsecond line\n";
+
+static int write_journal(const char *dir, const char *path,
+                         const struct stat *);
+static void recover_journal(const char *dir, const char *path,
+                            const struct stat *);
+static void locked_journal(const char *dir, const char *path,
+                           const struct stat *);
+static void replay_journal(const char *dir, const char *path,
+                           const struct stat *);
+static int read_changes(Journal *, size_t *change_num);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(14);
+
+    char dir[] = "/tmp/wed_journal_XXXXXX";
+    char path[] = "/tmp/wed_journal_file_XXXXXX";
+    struct stat file_stat;
+    int fd = mkstemp(path);
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    if (!ok(fd != -1 && mkdtemp(dir) != NULL &&
+            fx_write_file(path, test_text) && stat(path, &file_stat) == 0,
+            "Create test file and journal directory")) {
+        return exit_status();
+    }
+
+    if (ok(write_journal(dir, path, &file_stat), "Write journal")) {
+        recover_journal(dir, path, &file_stat);
+    }
+
+    locked_journal(dir, path, &file_stat);
+    replay_journal(dir, path, &file_stat);
+
+    unlink(path);
+    rmdir(dir);
+
+    return exit_status();
+}
+
+/* The writer is freed without freeing the journal, which leaves the
+ * journal file in place as if wed had been killed */
+static int write_journal(const char *dir, const char *path,
+                         const struct stat *file_stat)
+{
+    JournalWriter *writer = jn_new_writer(dir);
+    Journal *journal = NULL;
+
+    if (writer == NULL ||
+        !STATUS_IS_SUCCESS(jn_new(writer, path, file_stat, &journal))) {
+        jn_free_writer(writer);
+        return 0;
+    }
+
+    int success = !jn_recoverable(journal);
+
+    jn_add_insert(journal, 0, "new ", 4);
+    jn_add_delete(journal, 4, 6);
+    jn_sync(writer);
+
+    success = success && fx_file_exists(journal->journal_path) &&
+              STATUS_IS_SUCCESS(jn_get_error(journal));
+
+    jn_free_writer(writer);
+
+    return success;
+}
+
+static void recover_journal(const char *dir, const char *path,
+                            const struct stat *file_stat)
+{
+    struct stat changed_stat = *file_stat;
+    changed_stat.st_size++;
+
+    /* The writer is freed without freeing the journal, as freeing it
+     * would remove the journal file */
+    JournalWriter *writer = jn_new_writer(dir);
+    Journal *journal = NULL;
+
+    if (writer != NULL &&
+        STATUS_IS_SUCCESS(jn_new(writer, path, &changed_stat, &journal))) {
+        ok(!jn_recoverable(journal), "Changed file isn't recoverable");
+    } else {
+        ok(0, "Changed file isn't recoverable");
+    }
+
+    jn_free_writer(writer);
+    writer = jn_new_writer(dir);
+
+    if (writer == NULL ||
+        !STATUS_IS_SUCCESS(jn_new(writer, path, file_stat, &journal))) {
+        ok(0, "Unchanged file is recoverable");
+        jn_free_writer(writer);
+        return;
+    }
+
+    ok(jn_recoverable(journal), "Unchanged file is recoverable");
+
+    size_t change_num;
+    ok(read_changes(journal, &change_num) && change_num == 2,
+       "Changes read in order");
+
+    /* A record only partly written is ignored */
+    JournalRecord record = { .change_type = TCT_INSERT, .length = 100 };
+    FILE *file = fopen(journal->journal_path, "a");
+
+    if (file != NULL) {
+        fwrite(&record, 1, sizeof(record) / 2, file);
+        fclose(file);
+    }
+
+    ok(read_changes(journal, &change_num) && change_num == 2,
+       "Partly written record ignored");
+
+    jn_decline_recovery(journal);
+    jn_sync(writer);
+    ok(!jn_recoverable(journal) && !fx_file_exists(journal->journal_path),
+       "Declining recovery removes journal");
+
+    char *journal_path = strdup(journal->journal_path);
+    jn_add_insert(journal, 0, "x", 1);
+    jn_sync(writer);
+    int written = journal_path != NULL && fx_file_exists(journal_path);
+
+    jn_free(journal);
+    jn_sync(writer);
+    ok(written && !fx_file_exists(journal_path),
+       "Freeing journal removes its file");
+
+    free(journal_path);
+    jn_free_writer(writer);
+}
+
+/* A journal file locked by another wed is still being written, so it
+ * can't be recovered and mustn't be replaced or removed */
+static void locked_journal(const char *dir, const char *path,
+                           const struct stat *file_stat)
+{
+    JournalWriter *writer = jn_new_writer(dir);
+    Journal *journal = NULL;
+    char *journal_path = NULL;
+
+    if (writer != NULL &&
+        STATUS_IS_SUCCESS(jn_new(writer, path, file_stat, &journal))) {
+        journal_path = strdup(journal->journal_path);
+        jn_free(journal);
+    }
+
+    jn_free_writer(writer);
+
+    int fd = journal_path != NULL && write_journal(dir, path, file_stat) ?
+             open(journal_path, O_RDONLY) : -1;
+
+    if (fd == -1 || flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        ok(0, "Locked journal isn't recoverable");
+        free(journal_path);
+        return;
+    }
+
+    writer = jn_new_writer(dir);
+    Status status = writer == NULL ? STATUS_SUCCESS :
+                    jn_new(writer, path, file_stat, &journal);
+
+    if (writer != NULL && STATUS_IS_SUCCESS(status)) {
+        ok(!jn_recoverable(journal), "Locked journal isn't recoverable");
+
+        st_free_status(status);
+        jn_add_insert(journal, 0, "x", 1);
+        jn_sync(writer);
+        status = jn_get_error(journal);
+        ok(status.error_code == ERR_UNABLE_TO_WRITE_TO_FILE,
+           "Changes aren't journalled whilst journal is locked");
+
+        jn_free(journal);
+        jn_sync(writer);
+    } else {
+        ok(0, "Locked journal isn't recoverable");
+        ok(0, "Changes aren't journalled whilst journal is locked");
+    }
+
+    st_free_status(status);
+    jn_free_writer(writer);
+
+    struct stat journal_stat;
+    ok(stat(journal_path, &journal_stat) == 0 &&
+       journal_stat.st_size > (off_t)sizeof(JournalHeader),
+       "Locked journal isn't replaced or removed");
+
+    close(fd);
+    writer = jn_new_writer(dir);
+
+    if (writer != NULL &&
+        STATUS_IS_SUCCESS(jn_new(writer, path, file_stat, &journal))) {
+        ok(jn_recoverable(journal), "Unlocked journal is recoverable");
+        jn_free(journal);
+    } else {
+        ok(0, "Unlocked journal is recoverable");
+    }
+
+    jn_free_writer(writer);
+    unlink(journal_path);
+    free(journal_path);
+}
+
+/* Replay a journal left in HOME as though wed had been killed whilst
+ * editing the file */
+static void replay_journal(const char *dir, const char *path,
+                           const struct stat *file_stat)
+{
+    char journal_dir[PATH_MAX];
+    char file_path[PATH_MAX];
+
+    snprintf(journal_dir, sizeof(journal_dir), "%s/.wed/journal", dir);
+
+    if (realpath(path, file_path) == NULL ||
+        setenv("HOME", dir, 1) != 0 ||
+        !write_journal(journal_dir, file_path, file_stat)) {
+        ok(0, "Journal is recoverable when file is opened");
+        return;
+    }
+
+    Session *sess = se_new();
+    WedOpt wed_opt = { .test_mode = 0 };
+    char *paths[] = { file_path };
+
+    if (!ok(sess != NULL && se_init(sess, &wed_opt, paths, 1) &&
+            jn_recoverable(sess->active_buffer->journal),
+            "Journal is recoverable when file is opened")) {
+        se_free(sess);
+        return;
+    }
+
+    Buffer *buffer = sess->active_buffer;
+    Status status = se_recover_buffer(sess, buffer);
+    char *text = bf_to_string(buffer);
+
+    ok(STATUS_IS_SUCCESS(status) && text != NULL &&
+       strcmp(text, "new line\nsecond line\n") == 0 && bf_is_dirty(buffer),
+       "Journalled changes are replayed into buffer");
+    st_free_status(status);
+    free(text);
+
+    se_free(sess);
+
+    /* Freeing the session removed the journal file */
+    rmdir(journal_dir);
+    snprintf(journal_dir, sizeof(journal_dir), "%s/.wed", dir);
+    rmdir(journal_dir);
+}
+
+static int read_changes(Journal *journal, size_t *change_num)
+{
+    JournalReader reader;
+    JournalChange change;
+    int valid = 1;
+    *change_num = 0;
+
+    if (!STATUS_IS_SUCCESS(jn_read(journal, &reader))) {
+        return 0;
+    }
+
+    while (jn_next_change(&reader, &change)) {
+        if (*change_num == 0) {
+            valid = valid && change.change_type == TCT_INSERT &&
+                    change.offset == 0 && change.length == 4 &&
+                    memcmp(change.str, "new ", 4) == 0;
+        } else {
+            valid = valid && change.change_type == TCT_DELETE &&
+                    change.offset == 4 && change.length == 6;
+        }
+
+        (*change_num)++;
+    }
+
+    jn_free_reader(&reader);
+
+    return valid;
+}
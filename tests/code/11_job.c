@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include "tap.h"
+#include "../../job.h"
+#include "../../session.h"
+#include "../../config.h"
+
+static int text_equals(const Buffer *, const char *text);
+static Buffer *new_buffer(const char *text, const Config *);
+static void job_run(const Config *);
+static void job_modified(const Config *);
+static void job_kill(const Config *);
+static void job_cancel_read(const Config *);
+static void job_close_buffer(void);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(14);
+
+    char home[] = "/tmp/wed_job_XXXXXX";
+
+    /* The session writes journals and reads config below HOME */
+    if (!ok(mkdtemp(home) != NULL && setenv("HOME", home, 1) == 0,
+            "Create test home directory")) {
+        return exit_status();
+    }
+
+    Config *config = cf_new_config(NULL, CL_SESSION);
+
+    if (config != NULL) {
+        job_run(config);
+        job_modified(config);
+        job_kill(config);
+        job_cancel_read(config);
+    }
+
+    job_close_buffer();
+
+    cf_free_config(config);
+    rmdir(home);
+
+    return exit_status();
+}
+
+static int text_equals(const Buffer *buffer, const char *text)
+{
+    char *buffer_text = bf_to_string(buffer);
+    int equal = buffer_text != NULL && strcmp(buffer_text, text) == 0;
+    free(buffer_text);
+
+    return equal;
+}
+
+static Buffer *new_buffer(const char *text, const Config *config)
+{
+    Buffer *buffer = bf_new_empty("job", config);
+
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    Status status = bf_insert_string(buffer, text, strlen(text), 0);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        bf_free(buffer);
+        return NULL;
+    }
+
+    return buffer;
+}
+
+static void job_run(const Config *config)
+{
+    Buffer *buffer = new_buffer("abc\ndef\n", config);
+    Job *job = buffer == NULL ? NULL :
+               jb_new(1, JT_FILTER, "tr a-z A-Z", buffer, config);
+    Status status = STATUS_SUCCESS;
+
+    if (job != NULL) {
+        status = jb_start(job);
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = jb_run_to_completion(job);
+        }
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = jb_complete(job);
+        }
+    }
+
+    ok(job != NULL && STATUS_IS_SUCCESS(status) &&
+       text_equals(buffer, "ABC\nDEF\n"), "Filter job replaces buffer");
+    st_free_status(status);
+    jb_free(job);
+
+    job = buffer == NULL ? NULL :
+          jb_new(2, JT_READ, "printf 'read\\n'; sleep 0.1; printf 'more\\n'",
+                 buffer, config);
+    status = STATUS_SUCCESS;
+
+    if (job != NULL) {
+        status = jb_start(job);
+
+        /* Edits made before output arrives are kept and the insert
+         * position moves with the text it was started at */
+        if (STATUS_IS_SUCCESS(status)) {
+            status = bf_insert_string(buffer, "edit ", 5, 0);
+        }
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = jb_run_to_completion(job);
+        }
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = jb_complete(job);
+        }
+    }
+
+    ok(job != NULL && STATUS_IS_SUCCESS(status) &&
+       text_equals(buffer, "edit read\nmore\nABC\nDEF\n") &&
+       ec_cmd_successfull(job->ec.cmd_status),
+       "Read job inserts output at tracked position");
+    st_free_status(status);
+    jb_free(job);
+
+    status = buffer == NULL ? STATUS_SUCCESS :
+             bc_undo(&buffer->changes, buffer);
+    ok(STATUS_IS_SUCCESS(status) && text_equals(buffer, "edit ABC\nDEF\n"),
+       "Read job output is undone in one step");
+    st_free_status(status);
+    bf_free(buffer);
+}
+
+static void job_modified(const Config *config)
+{
+    Buffer *buffer = new_buffer("abc\n", config);
+    Job *job = buffer == NULL ? NULL :
+               jb_new(1, JT_FILTER, "tr a-z A-Z", buffer, config);
+    Status status = STATUS_SUCCESS;
+
+    if (job != NULL) {
+        status = jb_start(job);
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = bf_insert_string(buffer, "edit ", 5, 0);
+        }
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = jb_run_to_completion(job);
+        }
+
+        if (STATUS_IS_SUCCESS(status)) {
+            status = jb_complete(job);
+        }
+    }
+
+    ok(status.error_code == ERR_BUFFER_MODIFIED &&
+       text_equals(buffer, "edit abc\n"),
+       "Filter output is discarded when buffer is modified");
+    st_free_status(status);
+    jb_free(job);
+    bf_free(buffer);
+}
+
+static void job_kill(const Config *config)
+{
+    Buffer *buffer = new_buffer("text\n", config);
+    Job *job = buffer == NULL ? NULL :
+               jb_new(1, JT_FILTER, "sleep 10; echo output", buffer, config);
+    Status status = job == NULL ? STATUS_SUCCESS : jb_start(job);
+
+    if (!ok(job != NULL && STATUS_IS_SUCCESS(status) &&
+            !jb_io_finished(job), "Start long running job")) {
+        st_free_status(status);
+        jb_free(job);
+        bf_free(buffer);
+        return;
+    }
+
+    jb_cancel(job);
+    status = jb_run_to_completion(job);
+    const int cmd_status = job->ec.cmd_status;
+
+    ok(STATUS_IS_SUCCESS(status) && WIFSIGNALED(cmd_status) &&
+       WTERMSIG(cmd_status) == SIGTERM, "Killed job is terminated");
+    st_free_status(status);
+
+    status = jb_complete(job);
+    ok(STATUS_IS_SUCCESS(status) && text_equals(buffer, "text\n"),
+       "Killed job output is discarded");
+    st_free_status(status);
+
+    jb_free(job);
+    bf_free(buffer);
+}
+
+static void job_close_buffer(void)
+{
+    Session *sess = se_new();
+    WedOpt wed_opt = { .test_mode = 0 };
+
+    if (!ok(sess != NULL && se_init(sess, &wed_opt, NULL, 0) &&
+            STATUS_IS_SUCCESS(se_add_new_empty_buffer(sess)),
+            "Create session")) {
+        se_free(sess);
+        return;
+    }
+
+    se_clear_errors(sess);
+    Buffer *buffer = sess->active_buffer;
+    Status status = se_add_job(sess, JT_READ, "sleep 10", buffer);
+    const Job *job = se_has_jobs(sess) ? list_get(sess->jobs, 0) : NULL;
+    const pid_t pid = job == NULL ? -1 : job->ec.pid;
+
+    ok(STATUS_IS_SUCCESS(status) && pid > 0 && kill(pid, 0) == 0,
+       "Start job in session");
+    st_free_status(status);
+
+    status = se_add_job(sess, JT_FILTER, "cat", buffer);
+    ok(status.error_code == ERR_JOB_RUNNING && list_size(sess->jobs) == 1,
+       "Only one job can run on a buffer");
+    st_free_status(status);
+
+    se_remove_buffer(sess, buffer);
+
+    ok(!se_has_jobs(sess) && pid > 0 && kill(pid, 0) == -1 &&
+       errno == ESRCH, "Closing buffer terminates its job");
+
+    se_free(sess);
+}
+
+static void job_cancel_read(const Config *config)
+{
+    Buffer *buffer = new_buffer("text\n", config);
+    Job *job = buffer == NULL ? NULL :
+               jb_new(1, JT_READ, "printf 'output\\n'; sleep 10", buffer,
+                      config);
+    Status status = job == NULL ? STATUS_SUCCESS : jb_start(job);
+    int output_written = 0;
+
+    /* Wait for the output to be inserted whilst the job is running */
+    for (int k = 0; k < 100 && STATUS_IS_SUCCESS(status) &&
+                    job != NULL && !output_written; k++) {
+        fd_set read_fds, write_fds;
+        int max_fd = -1;
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = 50000 };
+
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        jb_add_fds(job, &read_fds, &write_fds, &max_fd);
+
+        if (select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout) >= 0) {
+            status = jb_process(job, &read_fds, &write_fds,
+                                &output_written);
+        }
+    }
+
+    if (!ok(job != NULL && STATUS_IS_SUCCESS(status) && output_written &&
+            !jb_io_finished(job) && text_equals(buffer, "output\ntext\n"),
+            "Read output is inserted as it arrives")) {
+        st_free_status(status);
+        jb_free(job);
+        bf_free(buffer);
+        return;
+    }
+
+    jb_cancel(job);
+    status = jb_run_to_completion(job);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = jb_complete(job);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && text_equals(buffer, "text\n"),
+       "Cancelling read job undoes its output");
+    st_free_status(status);
+
+    jb_free(job);
+    bf_free(buffer);
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../tail_follow.h"
+#include "../../buffer.h"
+#include "../../config.h"
+
+static const char *test_text = "one\ntwo\n";
+
+static int text_equals(const Buffer *, const char *text);
+static Buffer *load_buffer(const char *path, const Config *);
+static Status follow_update(TailFollow *, size_t max_lines,
+                            TailFollowEvent *);
+static int append_file(const char *path, const char *text);
+static void follow_trim(const char *path, const Config *);
+static void follow_truncate(const char *path, const Config *);
+static void follow_replace(const char *path, const Config *);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(11);
+
+    char path[] = "/tmp/wed_tail_follow_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    Config *config = cf_new_config(NULL, CL_SESSION);
+
+    if (ok(fd != -1 && config != NULL && fx_write_file(path, test_text),
+           "Create test file")) {
+        follow_trim(path, config);
+        follow_truncate(path, config);
+        follow_replace(path, config);
+    }
+
+    cf_free_config(config);
+    unlink(path);
+
+    return exit_status();
+}
+
+static int text_equals(const Buffer *buffer, const char *text)
+{
+    char *buffer_text = bf_to_string(buffer);
+    int equal = buffer_text != NULL && strcmp(buffer_text, text) == 0;
+    free(buffer_text);
+
+    return equal;
+}
+
+static Buffer *load_buffer(const char *path, const Config *config)
+{
+    FileInfo file_info;
+    Status status = fi_init(&file_info, path);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        return NULL;
+    }
+
+    Buffer *buffer = bf_new(&file_info, config);
+
+    if (buffer == NULL) {
+        fi_free(&file_info);
+        return NULL;
+    }
+
+    status = bf_load_file(buffer);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        st_free_status(status);
+        bf_free(buffer);
+        return NULL;
+    }
+
+    return buffer;
+}
+
+/* Check the file as though its watch descriptor was ready to read */
+static Status follow_update(TailFollow *tf, size_t max_lines,
+                            TailFollowEvent *event)
+{
+    fd_set read_fds;
+    int max_fd = -1;
+
+    FD_ZERO(&read_fds);
+    tf_add_fds(tf, &read_fds, &max_fd);
+
+    return tf_process(tf, &read_fds, max_lines, event);
+}
+
+static int append_file(const char *path, const char *text)
+{
+    int fd = open(path, O_WRONLY | O_APPEND);
+
+    if (fd == -1) {
+        return 0;
+    }
+
+    ssize_t written = write(fd, text, strlen(text));
+    close(fd);
+
+    return written == (ssize_t)strlen(text);
+}
+
+static void follow_trim(const char *path, const Config *config)
+{
+    msg("Limit lines:");
+
+    Buffer *buffer = load_buffer(path, config);
+    TailFollow *tf = buffer == NULL ? NULL : tf_new(buffer);
+    Status status = tf == NULL ? STATUS_SUCCESS : tf_start(tf);
+    TailFollowEvent event = TFE_NONE;
+
+    if (tf != NULL && STATUS_IS_SUCCESS(status)) {
+        status = append_file(path, "three\n") ?
+                 follow_update(tf, 2, &event) :
+                 st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE, "Append failed");
+    }
+
+    ok(tf != NULL && STATUS_IS_SUCCESS(status) && event == TFE_APPENDED &&
+       text_equals(buffer, "two\nthree\n") && buffer->is_partial,
+       "Lines removed from buffer start mark it as partial");
+    st_free_status(status);
+
+    status = buffer == NULL ? STATUS_SUCCESS : bf_write_file(buffer, path);
+    char *text = fx_read_file(path);
+
+    ok(status.error_code == ERR_UNABLE_TO_WRITE_TO_FILE && text != NULL &&
+       strcmp(text, "one\ntwo\nthree\n") == 0,
+       "Partial buffer isn't saved over its file");
+    free(text);
+    st_free_status(status);
+
+    tf_free(tf);
+    bf_free(buffer);
+}
+
+static void follow_truncate(const char *path, const Config *config)
+{
+    msg("Truncate file:");
+
+    Buffer *buffer = fx_write_file(path, test_text) ?
+                     load_buffer(path, config) : NULL;
+    TailFollow *tf = buffer == NULL ? NULL : tf_new(buffer);
+    Status status = tf == NULL ? STATUS_SUCCESS : tf_start(tf);
+    TailFollowEvent event = TFE_NONE;
+
+    if (!ok(tf != NULL && STATUS_IS_SUCCESS(status), "Follow file")) {
+        st_free_status(status);
+        tf_free(tf);
+        bf_free(buffer);
+        return;
+    }
+
+    status = fx_write_file(path, "new\n") ?
+             follow_update(tf, 0, &event) :
+             st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE, "Truncate failed");
+
+    ok(STATUS_IS_SUCCESS(status) && event == TFE_TRUNCATED &&
+       text_equals(buffer, "new\n") && !bf_is_dirty(buffer),
+       "Unmodified buffer is reloaded when file is truncated");
+    st_free_status(status);
+
+    BufferPos start = buffer->pos;
+    bp_to_buffer_start(&start);
+    status = bf_set_bp(buffer, &start, 0);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        status = bf_insert_string(buffer, "edit ", 5, 0);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && bf_is_dirty(buffer), "Modify buffer");
+    st_free_status(status);
+
+    status = fx_write_file(path, "") ?
+             follow_update(tf, 0, &event) :
+             st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE, "Truncate failed");
+
+    ok(status.error_code == ERR_UNABLE_TO_FOLLOW_FILE,
+       "Truncating file stops it being followed when buffer is modified");
+    ok(text_equals(buffer, "edit new\n") && bf_is_dirty(buffer),
+       "Modified buffer is kept");
+    st_free_status(status);
+
+    tf_free(tf);
+    bf_free(buffer);
+}
+
+static void follow_replace(const char *path, const Config *config)
+{
+    msg("Replace file:");
+
+    char old_path[64];
+    snprintf(old_path, sizeof(old_path), "%s.1", path);
+
+    Buffer *buffer = fx_write_file(path, test_text) ?
+                     load_buffer(path, config) : NULL;
+    TailFollow *tf = buffer == NULL ? NULL : tf_new(buffer);
+    Status status = tf == NULL ? STATUS_SUCCESS : tf_start(tf);
+    TailFollowEvent event = TFE_NONE;
+
+    if (!ok(tf != NULL && STATUS_IS_SUCCESS(status), "Follow file")) {
+        st_free_status(status);
+        tf_free(tf);
+        bf_free(buffer);
+        return;
+    }
+
+    /* Rotate the file as a logger would, writing a final line to the old
+     * file before creating the new one */
+    int rotated = append_file(path, "three\n") &&
+                  rename(path, old_path) == 0 && fx_write_file(path, "new\n");
+    status = rotated ? follow_update(tf, 0, &event) :
+             st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE, "Rotate failed");
+
+    ok(STATUS_IS_SUCCESS(status) && event == TFE_REPLACED &&
+       text_equals(buffer, "new\n") && !bf_is_dirty(buffer) &&
+       !buffer->is_partial,
+       "Unmodified buffer is reloaded when file is replaced");
+    st_free_status(status);
+
+    status = bf_insert_string(buffer, "edit ", 5, 0);
+
+    if (STATUS_IS_SUCCESS(status)) {
+        rotated = rename(path, old_path) == 0 && fx_write_file(path, "");
+        status = rotated ? follow_update(tf, 0, &event) :
+                 st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE, "Rotate failed");
+    }
+
+    ok(status.error_code == ERR_UNABLE_TO_FOLLOW_FILE &&
+       bf_is_dirty(buffer),
+       "Replacing file stops it being followed when buffer is modified");
+    st_free_status(status);
+
+    tf_free(tf);
+    bf_free(buffer);
+    unlink(old_path);
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tap.h"
+#include "fixture.h"
+#include "../../session.h"
+#include "../../config.h"
+
+#define FILE_NUM 6
+/* Two of the files loaded together exceed a buffermemory limit of 1MB */
+#define FILE_SIZE (700 * 1024)
+
+static int create_files(const char *home, char *paths[]);
+static int set_active_buffer(Session *, size_t buffer_index);
+static int buffers_loaded(const Session *, const int loaded[FILE_NUM]);
+static void buffer_memory(const char *home, char *paths[]);
+static void remove_files(const char *home, char *paths[]);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    plan(10);
+
+    char home[] = "/tmp/wed_buffer_memory_XXXXXX";
+    char *paths[FILE_NUM] = { NULL };
+
+    /* The session writes journals and reads config below HOME */
+    if (ok(mkdtemp(home) != NULL && setenv("HOME", home, 1) == 0 &&
+           create_files(home, paths), "Create test files")) {
+        buffer_memory(home, paths);
+    }
+
+    remove_files(home, paths);
+
+    return exit_status();
+}
+
+static int create_files(const char *home, char *paths[])
+{
+    char *data = malloc(FILE_SIZE);
+
+    if (data == NULL) {
+        return 0;
+    }
+
+    for (size_t k = 0; k < FILE_SIZE; k++) {
+        data[k] = k % 64 == 63 ? '\n' : 'a' + k % 26;
+    }
+
+    int success = 1;
+
+    for (size_t k = 0; k < FILE_NUM && success; k++) {
+        success = (paths[k] = malloc(strlen(home) + 16)) != NULL;
+
+        if (success) {
+            sprintf(paths[k], "%s/file%zu", home, k);
+            success = fx_write_file_len(paths[k], data, FILE_SIZE);
+        }
+    }
+
+    free(data);
+
+    return success;
+}
+
+static int set_active_buffer(Session *sess, size_t buffer_index)
+{
+    return se_set_active_buffer(sess, buffer_index) &&
+           sess->active_buffer == se_get_buffer(sess, buffer_index);
+}
+
+static int buffers_loaded(const Session *sess, const int loaded[FILE_NUM])
+{
+    for (size_t k = 0; k < FILE_NUM; k++) {
+        if (bf_is_view_initialised(se_get_buffer(sess, k)) != loaded[k]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void buffer_memory(const char *home, char *paths[])
+{
+    Session *sess = se_new();
+    WedOpt wed_opt = { .test_mode = 0 };
+
+    if (!ok(sess != NULL && se_init(sess, &wed_opt, paths, FILE_NUM) &&
+            sess->buffer_num == FILE_NUM &&
+            buffers_loaded(sess, (int []) { 1, 0, 0, 0, 0, 0 }),
+            "Only the active buffer is loaded on start")) {
+        se_free(sess);
+        return;
+    }
+
+    se_clear_errors(sess);
+    st_free_status(cf_set_var(CE_VAL(sess, NULL), CL_SESSION,
+                              CV_BUFFERMEMORY, INT_VAL(1)));
+
+    Status status = STATUS_SUCCESS;
+    int following = 0;
+
+    /* Each buffer made active is written to in a way that should keep it
+     * loaded */
+    if (set_active_buffer(sess, 1)) {
+        status = bf_insert_string(sess->active_buffer, "edit ", 5, 0);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && bf_is_dirty(sess->active_buffer) &&
+       buffers_loaded(sess, (int []) { 0, 1, 0, 0, 0, 0 }),
+       "Clean inactive buffer is unloaded when limit is exceeded");
+    st_free_status(status);
+
+    if (set_active_buffer(sess, 2)) {
+        status = se_add_job(sess, JT_READ, "sleep 10", sess->active_buffer);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && se_has_jobs(sess),
+       "Start job writing to buffer");
+    st_free_status(status);
+
+    SearchOptions opt = { .pattern = "needle", .pattern_len = 6,
+                          .case_insensitive = 1, .forward = 1 };
+
+    if (set_active_buffer(sess, 3)) {
+        status = se_add_file_search(sess, sess->active_buffer, home, &opt,
+                                    0);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) &&
+       se_get_file_search(sess, sess->active_buffer) != NULL,
+       "Start file search writing to buffer");
+    st_free_status(status);
+
+    if (set_active_buffer(sess, 4)) {
+        status = se_toggle_tail_follow(sess, sess->active_buffer,
+                                       &following);
+    }
+
+    ok(STATUS_IS_SUCCESS(status) && following, "Follow buffer file");
+    st_free_status(status);
+
+    ok(set_active_buffer(sess, 5) &&
+       buffers_loaded(sess, (int []) { 0, 1, 1, 1, 1, 1 }),
+       "Modified buffers and buffers written to by jobs, searches and "
+       "tail follows aren't unloaded");
+    ok(!se_has_errors(sess), "No errors whilst limiting buffer memory");
+
+    /* Replacing the file of the unloaded buffer with a directory means it
+     * can no longer be read */
+    int replaced = unlink(paths[0]) == 0 && mkdir(paths[0], 0700) == 0;
+
+    ok(replaced && se_set_active_buffer(sess, 0) &&
+       sess->active_buffer == se_get_buffer(sess, 5) &&
+       !bf_is_view_initialised(se_get_buffer(sess, 0)) &&
+       se_has_errors(sess),
+       "Buffer whose file can't be read stays unloaded and inactive");
+
+    se_clear_errors(sess);
+
+    if (replaced) {
+        rmdir(paths[0]);
+        fx_write_file(paths[0], "");
+    }
+
+    ok(set_active_buffer(sess, 0) &&
+       bf_is_view_initialised(sess->active_buffer) &&
+       bf_length(sess->active_buffer) == 0,
+       "Buffer is loaded once its file can be read");
+
+    se_free(sess);
+}
+
+static void remove_files(const char *home, char *paths[])
+{
+    char path[64];
+
+    for (size_t k = 0; k < FILE_NUM; k++) {
+        if (paths[k] != NULL) {
+            unlink(paths[k]);
+            free(paths[k]);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/.wed/journal", home);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/.wed", home);
+    rmdir(path);
+    rmdir(home);
+}
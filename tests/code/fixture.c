@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fixture.h"
+
+int fx_write_file(const char *path, const char *text)
+{
+    return fx_write_file_len(path, text, strlen(text));
+}
+
+int fx_write_file_len(const char *path, const char *data, size_t data_len)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        return 0;
+    }
+
+    size_t written = fwrite(data, 1, data_len, file);
+
+    return fclose(file) == 0 && written == data_len;
+}
+
+/* Returns the first 1023 bytes of a file as a string */
+char *fx_read_file(const char *path)
+{
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    char *text = calloc(1, 1024);
+
+    if (text != NULL) {
+        size_t read = fread(text, 1, 1023, file);
+        text[read] = '\0';
+    }
+
+    fclose(file);
+
+    return text;
+}
+
+int fx_file_exists(const char *path)
+{
+    struct stat file_stat;
+    return stat(path, &file_stat) == 0;
+}
+
+int fx_create_files(TestFiles files, size_t file_num)
+{
+    for (size_t k = 0; k < file_num; k++) {
+        const char *path = files[k][0];
+        const char *content = files[k][1];
+
+        if (content == NULL) {
+            if (mkdir(path, 0700) != 0) {
+                return 0;
+            }
+        } else if (!fx_write_file(path, content)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void fx_remove_files(TestFiles files, size_t file_num)
+{
+    for (size_t k = file_num; k > 0; k--) {
+        const char *path = files[k - 1][0];
+
+        if (files[k - 1][1] == NULL) {
+            rmdir(path);
+        } else {
+            unlink(path);
+        }
+    }
+}
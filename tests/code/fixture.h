@@ -0,0 +1,19 @@
+#ifndef WED_FIXTURE_H
+#define WED_FIXTURE_H
+
+/* Files and directories used by code tests */
+
+#include <stddef.h>
+
+/* A list of { path, content } pairs. Entries are created in order and
+ * removed in reverse order. Entries without content are directories */
+typedef const char *TestFiles[][2];
+
+int fx_write_file(const char *path, const char *text);
+int fx_write_file_len(const char *path, const char *data, size_t data_len);
+char *fx_read_file(const char *path);
+int fx_file_exists(const char *path);
+int fx_create_files(TestFiles, size_t file_num);
+void fx_remove_files(TestFiles, size_t file_num);
+
+#endif
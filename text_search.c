@@ -36,44 +36,8 @@ static int ts_find_next_str_in_range(const char *text, size_t *start_point,
                                      const TextSearch *);
 static void ts_populate_bad_char_table(size_t bad_char_table[ALPHABET_SIZE],
                                        const char *pattern, size_t pattern_len);
-static void ts_update_search_chars(int case_insensitive);
-
-static int ts_search_chars_lc = 0;
-
-static uchar ts_search_chars[ALPHABET_SIZE] = {
-    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
-    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
-    0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
-    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
-    0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
-    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
-    0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
-    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
-    0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
-    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
-    0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
-    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
-    0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
-    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
-    0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F,
-    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
-    0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
-    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
-    0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
-    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
-    0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
-    0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7,
-    0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
-    0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7,
-    0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF,
-    0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7,
-    0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
-    0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7,
-    0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
-    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7,
-    0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
-};
+static void ts_populate_search_chars(uchar search_chars[ALPHABET_SIZE],
+                                     int case_insensitive);
 
 Status ts_init(TextSearch *search, const SearchOptions *opt)
 {
@@ -93,13 +57,14 @@ Status ts_init(TextSearch *search, const SearchOptions *opt)
 
     search->pattern_len = opt->pattern_len;
 
+    ts_populate_search_chars(search->search_chars, opt->case_insensitive);
+
     if (opt->case_insensitive) {
-        ts_update_search_chars(opt->case_insensitive);
         uchar *pat = (uchar *)search->pattern;
 
         /* Convert ASCII characters in pattern to lower case */
         for (size_t k = 0; k < opt->pattern_len; k++) {
-            pat[k] = ts_search_chars[pat[k]];
+            pat[k] = search->search_chars[pat[k]];
         }
     }
 
@@ -124,8 +89,6 @@ void ts_free(TextSearch *search)
 Status ts_find_next(TextSearch *search, const SearchOptions *opt,
                     SearchData *data)
 {
-    ts_update_search_chars(opt->case_insensitive);
-
     BufferPos pos = *data->current_start_pos;
     size_t limit;
 
@@ -169,7 +132,7 @@ Status ts_find_next(TextSearch *search, const SearchOptions *opt,
 Status ts_find_prev(TextSearch *search, const SearchOptions *opt,
                     SearchData *data)
 {
-    ts_update_search_chars(opt->case_insensitive);
+    (void)opt;
 
     BufferPos pos = *data->current_start_pos;
     size_t limit;
@@ -208,6 +171,19 @@ Status ts_find_prev(TextSearch *search, const SearchOptions *opt,
     return STATUS_SUCCESS;
 }
 
+/* Search contiguous text which isn't stored in a GapBuffer e.g. a memory
+ * mapped file. The search only reads from the TextSearch instance so can be
+ * performed by multiple threads simultaneously */
+int ts_find_next_in_text(const TextSearch *search, const char *text,
+                         size_t point, size_t limit, size_t *next)
+{
+    if (search->pattern_len == 0 || point + search->pattern_len > limit) {
+        return 0;
+    }
+
+    return ts_find_next_str_in_range(text, &point, limit, next, search);
+}
+
 /* Perform a reverse search by splitting the buffer into chunks
  * of size SEARCH_BUFFER_SIZE (or remaining space) and searching
  * forwards in each chunk */
@@ -363,7 +339,8 @@ static int ts_find_next_str_in_range(const char *text, size_t *start_point,
         sub_start_point = point;
 
         while (pattern_idx != 0 && 
-               ts_search_chars[*(txt + point)] == pattern[pattern_idx - 1]) {
+               search->search_chars[*(txt + point)] ==
+               pattern[pattern_idx - 1]) {
             pattern_idx--;
             point--;
         }
@@ -375,7 +352,7 @@ static int ts_find_next_str_in_range(const char *text, size_t *start_point,
             /* Shift pattern */
             point = sub_start_point +
                     search->bad_char_table[
-                        ts_search_chars[*(txt + sub_start_point)]
+                        search->search_chars[*(txt + sub_start_point)]
                     ];
         }
     }
@@ -402,22 +379,19 @@ static void ts_populate_bad_char_table(size_t bad_char_table[ALPHABET_SIZE],
     }
 }
 
-/* If case insensitive set the relevant ASCII chars to their
- * lower case equivalents otherwise set them back to their
- * original values */
-static void ts_update_search_chars(int case_insensitive)
+/* Each character in the text is mapped through search_chars before being
+ * compared with the pattern. If case insensitive the ASCII upper case
+ * characters are mapped to their lower case equivalents */
+static void ts_populate_search_chars(uchar search_chars[ALPHABET_SIZE],
+                                     int case_insensitive)
 {
-    if (case_insensitive && !ts_search_chars_lc) {
-        for (int k = 'A'; k <= 'Z'; k++) {
-            ts_search_chars[k] += 32;
-        }
+    for (size_t k = 0; k < ALPHABET_SIZE; k++) {
+        search_chars[k] = (uchar)k;
+    }
 
-        ts_search_chars_lc = 1;
-    } else if (!case_insensitive && ts_search_chars_lc) {
+    if (case_insensitive) {
         for (int k = 'A'; k <= 'Z'; k++) {
-            ts_search_chars[k] -= 32;
+            search_chars[k] += 32;
         }
-
-        ts_search_chars_lc = 0;
     }
 }
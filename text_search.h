@@ -41,6 +41,8 @@ typedef struct {
     size_t bad_char_table[ALPHABET_SIZE]; /* Array populated with pattern
                                              shift lengths for each character
                                              in the alphabet */
+    uchar search_chars[ALPHABET_SIZE]; /* Maps text characters before they
+                                          are compared with the pattern */
 } TextSearch;
 
 Status ts_init(TextSearch *, const SearchOptions *);
@@ -50,5 +52,7 @@ Status ts_find_next(TextSearch *, const SearchOptions *,
                     SearchData *);
 Status ts_find_prev(TextSearch *, const SearchOptions *,
                     SearchData *);
+int ts_find_next_in_text(const TextSearch *, const char *text, size_t point,
+                         size_t limit, size_t *next);
 
 #endif
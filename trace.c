@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "trace.h"
+#include "util.h"
+
+/* Number of spans retained. Older spans are overwritten */
+#define TR_MAX_EVENTS 65536
+/* Number of frames frame statistics are calculated from */
+#define TR_FRAME_HISTORY 256
+
+/* A completed span */
+typedef struct {
+    const char *name; /* Span name */
+    uint64_t start; /* Start time in nanoseconds */
+    uint64_t duration; /* Duration in nanoseconds */
+} TraceEvent;
+
+/* Tracing is process wide as spans are recorded in code which has no access
+ * to the Session. Spans are only recorded on the main thread */
+static TraceEvent tr_events[TR_MAX_EVENTS];
+static size_t tr_event_num; /* Total number of events recorded */
+static uint64_t tr_frames[TR_FRAME_HISTORY];
+static size_t tr_frame_num; /* Total number of frames recorded */
+static int tr_overlay;
+
+static uint64_t tr_now(void);
+static int tr_frame_comparator(const void *, const void *);
+
+static uint64_t tr_now(void)
+{
+    struct timespec now;
+    get_monotonic_time(&now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+TraceSpan tr_start_span(const char *name, int is_frame)
+{
+    return (TraceSpan) {
+        .name = name,
+        .start = tr_now(),
+        .is_frame = is_frame
+    };
+}
+
+void tr_end_span(TraceSpan *span)
+{
+    uint64_t duration = tr_now() - span->start;
+
+    tr_events[tr_event_num++ % TR_MAX_EVENTS] = (TraceEvent) {
+        .name = span->name,
+        .start = span->start,
+        .duration = duration
+    };
+
+    if (span->is_frame) {
+        tr_frames[tr_frame_num++ % TR_FRAME_HISTORY] = duration;
+    }
+}
+
+void tr_toggle_overlay(void)
+{
+    tr_overlay = !tr_overlay;
+}
+
+int tr_overlay_enabled(void)
+{
+    return tr_overlay;
+}
+
+static int tr_frame_comparator(const void *v1, const void *v2)
+{
+    uint64_t f1 = *(const uint64_t *)v1;
+    uint64_t f2 = *(const uint64_t *)v2;
+
+    return (f1 > f2) - (f1 < f2);
+}
+
+void tr_get_frame_stats(FrameStats *stats)
+{
+    memset(stats, 0, sizeof(FrameStats));
+    size_t frame_num = MIN(tr_frame_num, TR_FRAME_HISTORY);
+
+    if (frame_num == 0) {
+        return;
+    }
+
+    uint64_t frames[TR_FRAME_HISTORY];
+    uint64_t total = 0;
+    memcpy(frames, tr_frames, frame_num * sizeof(uint64_t));
+
+    for (size_t k = 0; k < frame_num; k++) {
+        total += frames[k];
+    }
+
+    qsort(frames, frame_num, sizeof(uint64_t), tr_frame_comparator);
+
+    /* Nearest rank percentile */
+    size_t p99_rank = (99 * frame_num + 99) / 100;
+
+    stats->frame_num = frame_num;
+    stats->last = tr_frames[(tr_frame_num - 1) % TR_FRAME_HISTORY] / 1e6;
+    stats->average = total / (double)frame_num / 1e6;
+    stats->p99 = frames[p99_rank - 1] / 1e6;
+}
+
+/* Write retained spans as complete ("X") events, oldest first.
+ * Timestamps are in microseconds */
+Status tr_write_chrome_trace(const char *file_path)
+{
+    FILE *file = fopen(file_path, "w");
+
+    if (file == NULL) {
+        return st_get_error(ERR_UNABLE_TO_OPEN_FILE,
+                            "Unable to open file %s for writing: %s",
+                            file_path, strerror(errno));
+    }
+
+    size_t event_num = MIN(tr_event_num, TR_MAX_EVENTS);
+    size_t first = tr_event_num - event_num;
+    const TraceEvent *event;
+
+    fprintf(file, "{\"traceEvents\":[");
+
+    for (size_t k = 0; k < event_num; k++) {
+        event = &tr_events[(first + k) % TR_MAX_EVENTS];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"wed\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                k > 0 ? "," : "", event->name, event->start / 1000.0,
+                event->duration / 1000.0);
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (fclose(file) != 0) {
+        return st_get_error(ERR_UNABLE_TO_WRITE_TO_FILE,
+                            "Unable to write to file %s: %s",
+                            file_path, strerror(errno));
+    }
+
+    return STATUS_SUCCESS;
+}
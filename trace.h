@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 Richard Burke
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WED_TRACE_H
+#define WED_TRACE_H
+
+#include "build_config.h"
+
+/* Instrumentation of hot code paths. A span records the time taken by the
+ * enclosing function, starting where TR_SPAN is declared and ending when
+ * the function returns. Recent spans are kept in memory so they can be
+ * written out in the Chrome trace event format (viewable in
+ * chrome://tracing). Frame spans additionally record screen redraw times
+ * which can be displayed in the status bar.
+ *
+ * Tracing is only compiled in when wed is configured with --enable-trace,
+ * otherwise the macros below expand to nothing */
+
+#if WED_FEATURE_TRACE
+
+#include <stdint.h>
+#include <stddef.h>
+#include "status.h"
+
+typedef struct {
+    const char *name; /* Span name, must be a string literal */
+    uint64_t start; /* Start time in nanoseconds */
+    int is_frame; /* True if span is a screen redraw */
+} TraceSpan;
+
+/* Statistics for recent frames in milliseconds */
+typedef struct {
+    size_t frame_num; /* Number of frames statistics are based on */
+    double last; /* Duration of last frame */
+    double average; /* Average frame duration */
+    double p99; /* 99th percentile frame duration */
+} FrameStats;
+
+#define TR_SPAN_VAR(name, is_frame) \
+    TraceSpan tr_span __attribute__((cleanup(tr_end_span))) = \
+        tr_start_span(name, is_frame)
+#define TR_SPAN(name) TR_SPAN_VAR(name, 0)
+#define TR_FRAME_SPAN(name) TR_SPAN_VAR(name, 1)
+
+TraceSpan tr_start_span(const char *name, int is_frame);
+void tr_end_span(TraceSpan *);
+void tr_toggle_overlay(void);
+int tr_overlay_enabled(void);
+void tr_get_frame_stats(FrameStats *);
+Status tr_write_chrome_trace(const char *file_path);
+
+#else
+
+#define TR_SPAN(name)
+#define TR_FRAME_SPAN(name)
+
+#endif
+
+#endif
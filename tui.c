@@ -21,12 +21,19 @@
 #include "tui.h"
 #include "util.h"
 #include "config.h"
+#include "trace.h"
 
 #define DOUBLE_CLICK_TIMEFRAME_NS 500000000 
 #define SC_COLOR_PAIR(screen_comp) (COLOR_PAIR((screen_comp) + 1))
 #define WED_MOUSE_BUFFER_CLICK "<wed-buffer-mouse-click>"
 #define WED_MOUSE_FILE_EXPLORER_CLICK "<wed-file-explorer-mouse-click>"
 #define WED_MOUSE_TAB_CLICK "<wed-tab-mouse-click>"
+/* Bracketed paste mode wraps pasted text in CSI 200 ~ and CSI 201 ~ */
+#define BRACKETED_PASTE_START 200
+#define BRACKETED_PASTE_END 201
+/* Read input in larger chunks than termkey does by default so that
+ * large pastes are read with fewer system calls */
+#define INPUT_BUFFER_SIZE 65536
 
 static Status ti_init(UI *);
 static void ti_init_display(UI *);
@@ -42,6 +49,11 @@ static int ti_monitor_for_double_click_event(TUI *, const WINDOW *,
                                              const MouseClickEvent *);
 static void ti_get_mouse_double_click_event(const TUI *, const WINDOW *,
                                             MouseClickEvent *);
+static int ti_is_paste_sequence(TermKey *, const TermKeyKey *,
+                                int *paste_start);
+static Status ti_add_paste_key(TUI *, const TermKeyKey *);
+static Status ti_end_paste(TUI *, int *paste_added);
+static void ti_set_bracketed_paste(const TUI *, int enable);
 static Status ti_get_input(UI *);
 static Status ti_update(UI *);
 static void ti_setup_window(WINDOW *, const ViewDimensions *new,
@@ -104,6 +116,7 @@ static Status ti_init(UI *ui)
     /* Represent ASCII DEL character as backspace */
     termkey_set_canonflags(tui->termkey,
                            TERMKEY_CANON_DELBS | TERMKEY_CANON_SPACESYMBOL);
+    termkey_set_buffer_size(tui->termkey, INPUT_BUFFER_SIZE);
 
     if (tui->sess->wed_opt.test_mode) {
         tui->rows = 24;
@@ -150,6 +163,7 @@ static void ti_init_display(UI *ui)
     tui->status_win = newwin(0, tui->cols, tui->rows - 1, 0);
     tui->line_no_win = newwin(0, 0, 1, 0);
     tui->file_explorer_win = newwin(0, 0, 1, 0);
+    ti_set_bracketed_paste(tui, 1);
 }
 
 static short ti_get_ncurses_color(DrawColor draw_color)
@@ -347,6 +361,23 @@ static Status ti_get_input(UI *ui)
         termkey_advisereadable(termkey);
 
         while ((ret = termkey_getkey(termkey, &key)) == TERMKEY_RES_KEY) {
+            int paste_start, paste_added;
+
+            if (ti_is_paste_sequence(termkey, &key, &paste_start)) {
+                if (paste_start) {
+                    tui->paste.active = 1;
+                } else if (tui->paste.active) {
+                    /* The pasted text is inserted by a single operation */
+                    RETURN_IF_FAIL(ti_end_paste(tui, &paste_added));
+                    keys_added += paste_added;
+                }
+
+                continue;
+            } else if (tui->paste.active) {
+                RETURN_IF_FAIL(ti_add_paste_key(tui, &key));
+                continue;
+            }
+
             keystr_len = termkey_strfkey(termkey, keystr, MAX_KEY_STR_SIZE,
                                          &key, TERMKEY_FORMAT_VIM);
 
@@ -450,14 +481,137 @@ static Status ti_get_input(UI *ui)
     return status;
 }
 
+/* Determine if key is the sequence sent by the terminal at the start or
+ * end of pasted text */
+static int ti_is_paste_sequence(TermKey *termkey, const TermKeyKey *key,
+                                int *paste_start)
+{
+    long args[16];
+    size_t arg_num = ARRAY_SIZE(args, long);
+    unsigned long cmd;
+
+    if (key->type != TERMKEY_TYPE_UNKNOWN_CSI ||
+        termkey_interpret_csi(termkey, key, args, &arg_num,
+                              &cmd) != TERMKEY_RES_KEY ||
+        cmd != '~' || arg_num != 1) {
+        return 0;
+    }
+
+    if (args[0] == BRACKETED_PASTE_START) {
+        *paste_start = 1;
+        return 1;
+    } else if (args[0] == BRACKETED_PASTE_END) {
+        *paste_start = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Convert a key received during a paste back into the text pasted */
+static Status ti_add_paste_key(TUI *tui, const TermKeyKey *key)
+{
+    const char *text = NULL;
+
+    if (key->type == TERMKEY_TYPE_UNICODE) {
+        if (key->modifiers == 0) {
+            text = key->utf8;
+        } else if (key->modifiers == TERMKEY_KEYMOD_CTRL &&
+                   key->code.codepoint == 'j') {
+            text = "\n";
+        }
+    } else if (key->type == TERMKEY_TYPE_KEYSYM && key->modifiers == 0) {
+        if (key->code.sym == TERMKEY_SYM_SPACE) {
+            text = " ";
+        } else if (key->code.sym == TERMKEY_SYM_TAB) {
+            text = "\t";
+        } else if (key->code.sym == TERMKEY_SYM_ENTER) {
+            text = "\r";
+        }
+    }
+
+    /* Other control characters and escape sequences are dropped */
+    if (text == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    BracketedPaste *paste = &tui->paste;
+    size_t text_len = strlen(text);
+
+    if (paste->text_len + text_len > paste->text_alloc) {
+        size_t alloc = MAX(paste->text_alloc * 2, INPUT_BUFFER_SIZE);
+        char *paste_text = realloc(paste->text, alloc);
+
+        if (paste_text == NULL) {
+            return OUT_OF_MEMORY("Unable to save pasted text");
+        }
+
+        paste->text = paste_text;
+        paste->text_alloc = alloc;
+    }
+
+    memcpy(paste->text + paste->text_len, text, text_len);
+    paste->text_len += text_len;
+
+    return STATUS_SUCCESS;
+}
+
+/* Pass the completed paste to the input buffer. Terminals send \r for
+ * each new line so line endings are converted to \n */
+static Status ti_end_paste(TUI *tui, int *paste_added)
+{
+    BracketedPaste *paste = &tui->paste;
+    char *text = paste->text;
+    size_t text_len = 0;
+
+    for (size_t k = 0; k < paste->text_len; k++) {
+        if (text[k] == '\r') {
+            text[text_len++] = '\n';
+
+            if (k + 1 < paste->text_len && text[k + 1] == '\n') {
+                k++;
+            }
+        } else {
+            text[text_len++] = text[k];
+        }
+    }
+
+    memset(paste, 0, sizeof(BracketedPaste));
+    *paste_added = 0;
+
+    if (text_len == 0) {
+        free(text);
+        return STATUS_SUCCESS;
+    }
+
+    *paste_added = 1;
+
+    return ip_add_paste_event(&tui->sess->input_buffer, WED_BRACKETED_PASTE,
+                              strlen(WED_BRACKETED_PASTE), text, text_len);
+}
+
+/* When enabled the terminal marks the start and end of pasted text */
+static void ti_set_bracketed_paste(const TUI *tui, int enable)
+{
+    if (tui->sess->wed_opt.test_mode) {
+        return;
+    }
+
+    fputs(enable ? "\033[?2004h" : "\033[?2004l", stdout);
+    fflush(stdout);
+}
+
 static Status ti_update(UI *ui)
 {
     TUI *tui = (TUI *)ui;
 
-    if (tui->sess->wed_opt.test_mode) {
+    if (tui->sess->wed_opt.test_mode || se_macro_playing(tui->sess)) {
+        /* The screen is drawn once a macro has finished playing */
         return STATUS_SUCCESS;
     }
 
+    TR_FRAME_SPAN("ti_update");
+
     RETURN_IF_FAIL(tv_update(&tui->tv, tui->sess));
     ti_draw_buffer_tabs(tui);
 
@@ -573,7 +727,8 @@ static void ti_draw_line_no(TUI *tui)
 
         if (line->line_no != 0) {
             wattron(tui->line_no_win, SC_COLOR_PAIR(SC_LINENO));
-            wprintw(tui->line_no_win, "%*zu ", ((int)cols - 1), line->line_no);
+            wprintw(tui->line_no_win, "%*zu ", ((int)cols - 1),
+                    line->line_no + tv->line_no_offset);
             wattroff(tui->line_no_win, SC_COLOR_PAIR(SC_LINENO));
         } else {
             wprintw(tui->line_no_win, "%*s ", ((int)cols - 1), "");
@@ -629,26 +784,29 @@ static void ti_draw_file_explorer(TUI *tui)
 
     const Buffer *buffer = fe_get_buffer(file_explorer);
     const BufferView *bv = buffer->bv;
-    const size_t dir_entries = file_explorer->dir_entries;
 
     wmove(win, 1, 0);
     wattron(win, SC_COLOR_PAIR(SC_FILE_EXPLORER_FILE_ENTRY));
     ti_draw_buffer_view(bv, win);
     wattroff(win, SC_COLOR_PAIR(SC_FILE_EXPLORER_FILE_ENTRY));
 
-    const size_t visible_dir_entries =
-        bv->screen_start.line_no <= dir_entries ?
-        dir_entries - (bv->screen_start.line_no - 1) : 0;
+    /* Only visible rows are checked so drawing doesn't depend on the
+     * number of entries listed */
+    const size_t first_row = bv->screen_start.line_no - 1;
+    const size_t row_num = MIN(bf_lines(buffer) - first_row,
+                               rows > 0 ? rows - 1 : 0);
 
-    for (size_t row = 0; row < visible_dir_entries; row++) {
-        mvwchgat(win, row + 1, 0, cols - 1, A_NORMAL,
-                 SC_FILE_EXPLORER_DIRECTORY_ENTRY + 1, NULL);
+    for (size_t row = 0; row < row_num; row++) {
+        if (fe_is_directory_row(file_explorer, first_row + row)) {
+            mvwchgat(win, row + 1, 0, cols - 1, A_NORMAL,
+                     SC_FILE_EXPLORER_DIRECTORY_ENTRY + 1, NULL);
+        }
     }
 
     size_t selected_line_offset =
         buffer->pos.line_no - bv->screen_start.line_no;
     size_t selected_colour_pair =
-        selected_line_offset < visible_dir_entries ?
+        fe_is_directory_row(file_explorer, buffer->pos.line_no - 1) ?
         SC_FILE_EXPLORER_DIRECTORY_ENTRY + 1 : 1;
 
     attr_t selected_attr = A_REVERSE;
@@ -720,7 +878,8 @@ static int ti_draw_buffer_cell(WINDOW *win, const Cell *cell)
 {
     attr_t attr = A_NORMAL;
 
-    if (cell->attr & CA_SELECTION && !(cell->attr & CA_SEARCH_MATCH)) {
+    if ((cell->attr & CA_SELECTION && !(cell->attr & CA_SEARCH_MATCH)) ||
+        cell->attr & CA_ADDITIONAL_CURSOR) {
         attr |= A_REVERSE;
     }
 
@@ -937,6 +1096,7 @@ static Status ti_resize(UI *ui)
 static Status ti_suspend(UI *ui)
 {
     TUI *tui = (TUI *)ui;
+    ti_set_bracketed_paste(tui, 0);
     endwin();
     termkey_stop(tui->termkey);
 
@@ -962,6 +1122,7 @@ static Status ti_end(UI *ui)
     delwin(tui->status_win);
     delwin(tui->line_no_win);
     delwin(tui->file_explorer_win);
+    ti_set_bracketed_paste(tui, 0);
     endwin();
 
     return STATUS_SUCCESS;
@@ -971,7 +1132,13 @@ static Status ti_free(UI *ui)
 {
     TUI *tui = (TUI *)ui;
 
-    termkey_destroy(tui->termkey);
+    /* The UI isn't initialised when a session is used without a
+     * terminal e.g. in code tests */
+    if (tui->termkey != NULL) {
+        termkey_destroy(tui->termkey);
+    }
+
+    free(tui->paste.text);
     free(ui);
 
     return STATUS_SUCCESS;
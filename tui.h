@@ -32,6 +32,14 @@ typedef struct {
     struct timespec last_mouse_press_time; /* Last mouse press time */
 } DoubleClickMonitor;
 
+/* Collect text pasted into the terminal whilst in bracketed paste mode */
+typedef struct {
+    int active; /* True between the paste start and end sequences */
+    char *text; /* Text pasted so far */
+    size_t text_len; /* Length of text */
+    size_t text_alloc; /* Size of text allocation */
+} BracketedPaste;
+
 /* This implements the UI interface from ui.h */
 typedef struct {
     UI ui; /* Extend the UI structure. TUI specific function pointers will be
@@ -52,6 +60,7 @@ typedef struct {
     TermKey *termkey; /* Use to process user input */
     DoubleClickMonitor double_click_monitor; /* Monitor mouse clicks for
                                                 double click occurrences */
+    BracketedPaste paste; /* Text being pasted into the terminal */
 } TUI;
 
 UI *ti_new(Session *);
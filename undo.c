@@ -22,6 +22,7 @@
 #include "undo.h"
 #include "buffer.h"
 #include "util.h"
+#include "trace.h"
 
 #define LIST_CHILDREN_INIT 4
 
@@ -39,7 +40,11 @@ static BufferChange *bc_new(BufferChangeType, Change);
 static void bc_free_change(BufferChangeType, Change);
 static void bc_free_buffer_change(BufferChange *);
 static void bc_free_stack(BufferChange *);
+static size_t bc_change_memory_usage(const BufferChange *);
+static size_t bc_stack_memory_usage(const BufferChange *);
 static Status bc_add_change(BufferChanges *, BufferChangeType, Change);
+static Status bc_undo_grouped_change(BufferChanges *, Buffer *);
+static Status bc_redo_grouped_change(BufferChanges *, Buffer *);
 static Status bc_apply(BufferChange *, Buffer *, int redo);
 static Status bc_tc_apply(TextChange *, Buffer *, int redo);
 
@@ -113,12 +118,21 @@ static Status bc_add_text_change_to_prev(BufferChanges *changes,
 {
     *added_to_prev_change = 0;
 
-    if (changes->undo == NULL ||
-        changes->undo->change_type != BCT_TEXT_CHANGE) {
+    BufferChange *prev_buffer_change = changes->undo;
+
+    /* Whilst changes are grouped the previous change is the last one
+     * added to the group. This keeps the number of changes stored down
+     * when many edits are grouped, e.g. when a macro is played */
+    if (changes->group_changes && prev_buffer_change != NULL) {
+        prev_buffer_change = list_get_last(prev_buffer_change->children);
+    }
+
+    if (prev_buffer_change == NULL ||
+        prev_buffer_change->change_type != BCT_TEXT_CHANGE) {
         return STATUS_SUCCESS;
     }
 
-    TextChange *prev_change = changes->undo->change.text_change; 
+    TextChange *prev_change = prev_buffer_change->change.text_change; 
 
     if (prev_change->change_type != change_type) {
         return STATUS_SUCCESS;
@@ -169,6 +183,7 @@ static Status bc_add_text_change_to_prev(BufferChanges *changes,
             prev_change->str_len = new_str_len;
         }
 
+        prev_buffer_change->version++;
         changes->undo->version++;
         *added_to_prev_change = 1;
     }
@@ -194,6 +209,8 @@ static Status bc_add_text_change(BufferChanges *changes,
                                  const char *str, size_t str_len,
                                  const BufferPos *pos)
 {
+    TR_SPAN("bc_add_text_change");
+
     assert(pos != NULL);
     assert(str_len > 0);
      
@@ -221,6 +238,55 @@ static Status bc_add_text_change(BufferChanges *changes,
     return bc_add_change(changes, BCT_TEXT_CHANGE, change);
 }
 
+/* Allocate a batch of edit_num edits with text_len bytes of storage
+ * for their text. The caller populates the edits */
+BatchChange *bc_batch_new(size_t edit_num, size_t text_len)
+{
+    BatchChange *batch = malloc(sizeof(BatchChange));
+    RETURN_IF_NULL(batch);
+
+    memset(batch, 0, sizeof(BatchChange));
+
+    batch->edits = malloc(MAX(edit_num, 1) * sizeof(TextEdit));
+    batch->text = malloc(MAX(text_len, 1));
+
+    if (batch->edits == NULL || batch->text == NULL) {
+        bc_batch_free(batch);
+        return NULL;
+    }
+
+    batch->edit_num = edit_num;
+    batch->text_len = text_len;
+
+    return batch;
+}
+
+void bc_batch_free(BatchChange *batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+
+    free(batch->edits);
+    free(batch->text);
+    free(batch);
+}
+
+/* Takes ownership of batch */
+Status bc_add_batch_change(BufferChanges *changes, BatchChange *batch)
+{
+    assert(batch != NULL);
+
+    if (!bc_enabled(changes)) {
+        bc_batch_free(batch);
+        return STATUS_SUCCESS;
+    }
+
+    Change change = { .batch_change = batch };
+
+    return bc_add_change(changes, BCT_BATCH_CHANGE, change);
+}
+
 static BufferChange *bc_new(BufferChangeType change_type, Change change)
 {
     BufferChange *buffer_change = malloc(sizeof(BufferChange));
@@ -241,6 +307,11 @@ static void bc_free_change(BufferChangeType change_type, Change change)
                 bc_tc_free(change.text_change);
                 break;
             }
+        case BCT_BATCH_CHANGE:
+            {
+                bc_batch_free(change.batch_change);
+                break;
+            }
         default:
             {
                 break;
@@ -299,6 +370,8 @@ static Status bc_add_change(BufferChanges *changes,
         if (!list_add(changes->undo->children, buffer_change)) {
             return OUT_OF_MEMORY("Unable to save buffer change");
         }
+
+        changes->undo->version++;
     } else {
         /* Add the change to the top of the undo stack */
         if (changes->undo != NULL) {
@@ -331,9 +404,9 @@ int bc_grouped_changes_started(const BufferChanges *changes)
 
 Status bc_start_grouped_changes(BufferChanges *changes)
 {
-    assert(!changes->group_changes);
-
     if (changes->group_changes) {
+        /* Nested groups are added to the outermost group */
+        changes->group_changes++;
         return STATUS_SUCCESS;
     }
 
@@ -358,7 +431,10 @@ Status bc_start_grouped_changes(BufferChanges *changes)
 Status bc_end_grouped_changes(BufferChanges *changes)
 {
     assert(changes->group_changes);
-    changes->group_changes = 0;
+
+    if (changes->group_changes == 0 || --changes->group_changes > 0) {
+        return STATUS_SUCCESS;
+    }
 
     assert(changes->undo != NULL);
     assert(changes->undo->change_type == BCT_GROUPED_CHANGE);
@@ -382,6 +458,17 @@ Status bc_end_grouped_changes(BufferChanges *changes)
 
 Status bc_undo(BufferChanges *changes, Buffer *buffer)
 {
+    if (changes->group_changes) {
+        /* Changes can be undone whilst they're grouped e.g. when a
+         * macro which undoes a change is played. Only changes made
+         * since the group was started can be undone */
+        if (list_size(changes->undo->children) > 0) {
+            return bc_undo_grouped_change(changes, buffer);
+        }
+
+        return STATUS_SUCCESS;
+    }
+
     if (!bc_can_undo(changes)) {
         return STATUS_SUCCESS;
     }
@@ -413,6 +500,8 @@ Status bc_redo(BufferChanges *changes, Buffer *buffer)
 {
     if (!bc_can_redo(changes)) {
         return STATUS_SUCCESS;
+    } else if (changes->group_changes) {
+        return bc_redo_grouped_change(changes, buffer);
     }
 
     BufferChange *buffer_change = changes->redo;
@@ -433,6 +522,53 @@ Status bc_redo(BufferChanges *changes, Buffer *buffer)
     return STATUS_SUCCESS;
 }
 
+static Status bc_undo_grouped_change(BufferChanges *changes, Buffer *buffer)
+{
+    BufferChange *group = changes->undo;
+    BufferChange *buffer_change = list_get_last(group->children);
+
+    bc_disable(changes);
+    Status status = bc_apply(buffer_change, buffer, 0);
+    bc_enable(changes);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        return status;
+    }
+
+    list_pop(group->children);
+    group->version++;
+    buffer_change->next = changes->redo;
+    changes->redo = buffer_change;
+
+    return STATUS_SUCCESS;
+}
+
+/* The change is redone as part of the group being made */
+static Status bc_redo_grouped_change(BufferChanges *changes, Buffer *buffer)
+{
+    BufferChange *group = changes->undo;
+    BufferChange *buffer_change = changes->redo;
+
+    if (!list_add(group->children, buffer_change)) {
+        return OUT_OF_MEMORY("Unable to save buffer change");
+    }
+
+    bc_disable(changes);
+    Status status = bc_apply(buffer_change, buffer, 1);
+    bc_enable(changes);
+
+    if (!STATUS_IS_SUCCESS(status)) {
+        list_pop(group->children);
+        return status;
+    }
+
+    changes->redo = buffer_change->next;
+    buffer_change->next = NULL;
+    group->version++;
+
+    return STATUS_SUCCESS;
+}
+
 /* Determine the change type and undo/redo it */
 static Status bc_apply(BufferChange *buffer_change, Buffer *buffer, int redo)
 {
@@ -475,6 +611,15 @@ static Status bc_apply(BufferChange *buffer_change, Buffer *buffer, int redo)
 
                 break;
             }
+        case BCT_BATCH_CHANGE:
+            {
+                /* The stored edits reverse the last application of the
+                 * batch and are replaced by the edits that reverse this
+                 * one, so undo and redo are handled identically */
+                status = bf_apply_batch_change(
+                             buffer, &buffer_change->change.batch_change);
+                break;
+            }
         default:
             {
                 break;
@@ -559,3 +704,52 @@ int bc_has_state_changed(const BufferChanges *changes,
     return change_state.version > 0;
 }
 
+size_t bc_memory_usage(const BufferChanges *changes)
+{
+    return bc_stack_memory_usage(changes->undo) +
+           bc_stack_memory_usage(changes->redo);
+}
+
+static size_t bc_stack_memory_usage(const BufferChange *buffer_change)
+{
+    size_t bytes = 0;
+
+    while (buffer_change != NULL) {
+        bytes += bc_change_memory_usage(buffer_change);
+        buffer_change = buffer_change->next;
+    }
+
+    return bytes;
+}
+
+static size_t bc_change_memory_usage(const BufferChange *buffer_change)
+{
+    size_t bytes = sizeof(BufferChange);
+
+    if (buffer_change->change_type == BCT_TEXT_CHANGE) {
+        const TextChange *text_change = buffer_change->change.text_change;
+        bytes += sizeof(TextChange);
+
+        /* Only deletes keep a copy of the text */
+        if (text_change->str != NULL) {
+            bytes += text_change->str_len;
+        }
+    } else if (buffer_change->change_type == BCT_BATCH_CHANGE) {
+        const BatchChange *batch = buffer_change->change.batch_change;
+        bytes += sizeof(BatchChange) + batch->edit_num * sizeof(TextEdit) +
+                 batch->text_len;
+    }
+
+    if (buffer_change->children != NULL) {
+        const List *children = buffer_change->children;
+        size_t child_num = list_size(children);
+
+        bytes += sizeof(List) + children->allocated * sizeof(void *);
+
+        for (size_t k = 0; k < child_num; k++) {
+            bytes += bc_change_memory_usage(list_get(children, k));
+        }
+    }
+
+    return bytes;
+}
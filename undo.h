@@ -55,6 +55,29 @@ struct TextChange {
                   would be unnecessary duplication */
 };
 
+/* Replaces delete_len bytes at pos with str. A sorted sequence of
+ * non-overlapping edits can be applied to a buffer in a single pass
+ * using bf_apply_edits */
+typedef struct {
+    BufferPos pos; /* Where the edit takes place. Positions are relative
+                      to the buffer before any edit in a sequence is
+                      applied */
+    size_t delete_len; /* Number of bytes to delete from pos */
+    const char *str; /* Text to insert at pos */
+    size_t str_len; /* Length of str */
+} TextEdit;
+
+/* A batch of edits applied together e.g. typing with multiple cursors.
+ * The edits stored are those which reverse the batch, so undoing and
+ * redoing are the same operation: apply the edits, then replace them
+ * with the edits which reverse that application */
+typedef struct {
+    TextEdit *edits; /* Edits sorted by position */
+    size_t edit_num; /* Number of edits */
+    char *text; /* Storage for the text inserted by each edit */
+    size_t text_len; /* Total length of text */
+} BatchChange;
+
 /* Text changes aren't the only possible changes that we could want
  * to track to provide undo/redo e.g. A user closes a buffer
  * accidentally and re-opens it with <C-z>
@@ -66,14 +89,16 @@ struct TextChange {
 /* The type of change that took place on the buffer */
 typedef enum {
     BCT_TEXT_CHANGE, /* A text change */
-    BCT_GROUPED_CHANGE /* A change comprised of multiple child changes
-                          i.e. multiple changes grouped together into one */
+    BCT_GROUPED_CHANGE, /* A change comprised of multiple child changes
+                           i.e. multiple changes grouped together into one */
+    BCT_BATCH_CHANGE /* Edits at multiple positions applied in one pass */
 } BufferChangeType;
 
 /* Abstraction of a change to allow other types of changes
  * to be tracked */
 typedef union {
     TextChange *text_change;
+    BatchChange *batch_change;
 } Change;
 
 typedef struct BufferChange BufferChange;
@@ -101,9 +126,11 @@ struct BufferChange {
 typedef struct {
     BufferChange *undo; /* Undo stack */
     BufferChange *redo; /* Redo stack */
-    int group_changes; /* When true all subsequent BufferChange's are
+    int group_changes; /* When non zero all subsequent BufferChange's are
                           grouped together as children of a single
-                          BufferChange until set to false */
+                          BufferChange. Groups can be nested, this is
+                          the depth of nesting, only the outermost
+                          group is created */
     int accept_new_changes; /* Set true by default. When false all further
                                changes are ignored. This is used when
                                actually applying an undo/redo which
@@ -129,6 +156,9 @@ void bc_free(BufferChanges *);
 Status bc_add_text_insert(BufferChanges *, size_t str_len, const BufferPos *);
 Status bc_add_text_delete(BufferChanges *, const char *str, size_t str_len,
                           const BufferPos *);
+BatchChange *bc_batch_new(size_t edit_num, size_t text_len);
+void bc_batch_free(BatchChange *);
+Status bc_add_batch_change(BufferChanges *, BatchChange *);
 int bc_can_undo(const BufferChanges *);
 int bc_can_redo(const BufferChanges *);
 int bc_grouped_changes_started(const BufferChanges *);
@@ -141,5 +171,6 @@ void bc_disable(BufferChanges *);
 void bc_enable(BufferChanges *);
 BufferChangeState bc_get_current_state(const BufferChanges *);
 int bc_has_state_changed(const BufferChanges *, BufferChangeState);
+size_t bc_memory_usage(const BufferChanges *);
 
 #endif
@@ -28,6 +28,7 @@
 #include "input.h"
 #include "file.h"
 #include "config.h"
+#include "bench.h"
 #include "build_config.h"
 
 static void we_init_wedopt(WedOpt *);
@@ -46,6 +47,7 @@ static void we_free_wedopt(WedOpt *wed_opt)
 {
     free(wed_opt->keystr_input);
     free(wed_opt->config_file_path);
+    free(wed_opt->session_file_path);
 }
 
 static void we_print_usage(void)
@@ -63,6 +65,9 @@ OPTIONS:\n\
 -h, --help                 Print this message and exit.\n\
 -k, --key-string KEYSTR    Process KEYSTR string representation of key\n\
                            presses after initialisation.\n\
+-s, --session SESSION      Restore the buffers, positions, searches and\n\
+                           histories saved in the SESSION file and save\n\
+                           them to it on exit.\n\
 -v, --version              Print version information and exit.\n\
 \n\
 ";
@@ -84,7 +89,8 @@ WED - Windows terminal EDitor %s (%s, Built %s)\n\
         const int enabled;
     } const features[] = {
         { "Lua", WED_FEATURE_LUA },
-        { "GNU Source-highlight", WED_FEATURE_GNU_SOURCE_HIGHLIGHT }
+        { "GNU Source-highlight", WED_FEATURE_GNU_SOURCE_HIGHLIGHT },
+        { "Tracing", WED_FEATURE_TRACE }
     };
 
     const size_t feature_num = ARRAY_SIZE(features, struct Feature);
@@ -103,10 +109,14 @@ static int we_parse_args(WedOpt *wed_opt, int argc, char *argv[],
         { "config-file", required_argument, 0, 'c' },
         { "help"       , no_argument      , 0, 'h' },
         { "key-string" , required_argument, 0, 'k' },
+        { "session"    , required_argument, 0, 's' },
         { "version"    , no_argument      , 0, 'v' },
         /* Used only for running tests by run_text_tests.sh
          * so don't mention in help text above */
         { "test-mode"  , no_argument      , 0,  0  },
+        /* Used only for running benchmarks by run_benchmarks.sh.
+         * Implies test mode */
+        { "bench-mode" , no_argument      , 0, 'B' },
         { 0, 0, 0, 0 }
     };
 
@@ -117,7 +127,7 @@ static int we_parse_args(WedOpt *wed_opt, int argc, char *argv[],
     opterr = 0;
 
 
-    while ((c = getopt_long(argc, argv, ":hvc:k:", wed_options, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, ":hvc:k:s:", wed_options, NULL)) != -1) {
         switch (c) {
             case 'c':
                 {
@@ -138,6 +148,14 @@ static int we_parse_args(WedOpt *wed_opt, int argc, char *argv[],
                         fatal("Out Of Memory - Unable to parse options");
                     }
 
+                    break;
+                }
+            case 's':
+                {
+                    if ((wed_opt->session_file_path = strdup(optarg)) == NULL) {
+                        fatal("Out Of Memory - Unable to parse options");
+                    }
+
                     break;
                 }
             case 'v':
@@ -150,6 +168,12 @@ static int we_parse_args(WedOpt *wed_opt, int argc, char *argv[],
                     wed_opt->test_mode = 1;
                     break;
                 }
+            case 'B':
+                {
+                    wed_opt->test_mode = 1;
+                    wed_opt->bench_mode = 1;
+                    break;
+                }
             case ':':
                 {
                     switch (optopt) {
@@ -166,6 +190,13 @@ static int we_parse_args(WedOpt *wed_opt, int argc, char *argv[],
                                         "requires a KEYSTR argument\n");
                                 break;
                             }
+                        case 's':
+                            {
+                                fprintf(stderr, "Option -s, --session "
+                                        "requires a SESSION filepath "
+                                        "argument\n");
+                                break;
+                            }
                         default:
                             {
                                 fprintf(stderr, "Unknown option: %c\n",
@@ -226,12 +257,41 @@ int main(int argc, char *argv[])
     argc -= file_args_index;
     argv += file_args_index;
 
+    Bench *bench = NULL;
+
+    if (wed_opt.bench_mode) {
+        if ((bench = bm_new()) == NULL) {
+            fatal("Out Of Memory - Unable to create Bench");
+        }
+
+        bm_start(bench, "load");
+    }
+
     if (!se_init(sess, &wed_opt, argv, argc)) {
         fatal("Unable to initialise session");
     }
 
+    if (bench != NULL) {
+        se_add_error(sess, bm_end(bench));
+        se_set_bench(sess, bench);
+    }
+
     ip_edit(sess);
 
+    if (wed_opt.session_file_path != NULL) {
+        Status status = se_save_snapshot(sess);
+
+        if (!STATUS_IS_SUCCESS(status)) {
+            warn(status.msg);
+            st_free_status(status);
+        }
+    }
+
+    if (bench != NULL) {
+        bm_write_results(bench, stdout);
+        bm_free(bench);
+    }
+
     int return_code = 0;
 
     if (wed_opt.test_mode) {
@@ -21,8 +21,10 @@
 
 typedef struct {
     int test_mode;
+    int bench_mode;
     char *keystr_input;
     char *config_file_path;
+    char *session_file_path;
 } WedOpt;
 
 #endif
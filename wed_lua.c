@@ -134,6 +134,19 @@ void ls_free(LuaState *ls)
     free(ls);
 }
 
+/* Bytes currently in use by the Lua interpreter */
+size_t ls_memory_usage(const LuaState *ls)
+{
+    if (ls == NULL || ls->state == NULL) {
+        return 0;
+    }
+
+    size_t kbytes = lua_gc(ls->state, LUA_GCCOUNT, 0);
+    size_t bytes = lua_gc(ls->state, LUA_GCCOUNTB, 0);
+
+    return (kbytes * 1024) + bytes;
+}
+
 Status ls_init(LuaState *ls)
 {
     Session *sess = ls->sess;
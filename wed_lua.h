@@ -35,6 +35,7 @@ typedef struct {
 
 LuaState *ls_new(struct Session *);
 void ls_free(LuaState *);
+size_t ls_memory_usage(const LuaState *);
 Status ls_init(LuaState *);
 Status ls_load_syntax_def(LuaState *, const char *);
 SyntaxMatches *ls_generate_matches(LuaState *, const char *syntax_type,
@@ -33,6 +33,7 @@ static SyntaxMatches *ws_generate_matches(const SyntaxDefinition *,
 static void ws_add_match(SyntaxMatches *, const SyntaxMatch *);
 static int ws_match_cmp(const void *, const void *);
 static void ws_free(SyntaxDefinition *syn_def);
+static size_t ws_memory_usage(const SyntaxDefinition *);
 
 SyntaxDefinition *ws_new(Session *sess)
 {
@@ -45,6 +46,7 @@ SyntaxDefinition *ws_new(Session *sess)
     wed_def->syn_def.load = ws_load;
     wed_def->syn_def.generate_matches = ws_generate_matches;
     wed_def->syn_def.free = ws_free;
+    wed_def->syn_def.memory_usage = ws_memory_usage;
 
     return (SyntaxDefinition *)wed_def;
 }
@@ -240,3 +242,16 @@ static void ws_free(SyntaxDefinition *syn_def)
     free(wed_def);
 }
 
+static size_t ws_memory_usage(const SyntaxDefinition *syn_def)
+{
+    const WedSyntaxDefinition *wed_def = (const WedSyntaxDefinition *)syn_def;
+    size_t bytes = sizeof(WedSyntaxDefinition);
+
+    for (const SyntaxPattern *pattern = wed_def->patterns; pattern != NULL;
+         pattern = pattern->next) {
+        bytes += sizeof(SyntaxPattern) + ru_memory_usage(&pattern->regex);
+    }
+
+    return bytes;
+}
+